@@ -0,0 +1,75 @@
+# Host build of the hardware independent engines of codal-microbit-v2.
+#
+# The engines are compiled unchanged, against codal-core, with headers in host/inc standing in for the few parts
+# of the target they touch: the CMSIS device header (for the cycle counter), MicroBit.h and the target
+# configuration normally generated from target.json. host/source provides a RAM backed NVMController, a simulated
+# system timer and the target HAL functions the engines call.
+#
+#   cmake -S . -B host-build -DMICROBIT_HOST_BUILD=ON -DCODAL_CORE_DIR=../codal-core
+#   cmake --build host-build
+#   perf record ./host-build/microbit-host-benchmark
+#   valgrind --tool=cachegrind ./host-build/microbit-host-benchmark
+
+cmake_minimum_required( VERSION 3.6 )
+
+if( NOT CODAL_CORE_DIR )
+    message( FATAL_ERROR "Set CODAL_CORE_DIR to a checkout of codal-core to build for the host." )
+endif()
+
+get_filename_component( CODAL_CORE_DIR "${CODAL_CORE_DIR}" ABSOLUTE )
+get_filename_component( CODAL_LIBRARIES_DIR "${CODAL_CORE_DIR}" DIRECTORY )
+
+set( HOST_ROOT "${CMAKE_CURRENT_LIST_DIR}/.." )
+
+if( NOT CMAKE_BUILD_TYPE )
+    set( CMAKE_BUILD_TYPE RelWithDebInfo )
+endif()
+
+set( CMAKE_CXX_STANDARD 11 )
+
+# The engines built. MicroBitLog and MicroBitFileSystem are left out, as they sit on MicroBitUSBFlashManager,
+# NRF52Serial and MicroBitFlash, and SoundEmojiSynthesizer needs the fiber scheduler.
+set( HOST_ENGINE_SOURCES
+    "${HOST_ROOT}/source/AudioBufferPool.cpp"
+    "${HOST_ROOT}/source/AudioKernels.cpp"
+    "${HOST_ROOT}/source/AudioStats.cpp"
+    "${HOST_ROOT}/source/FSCache.cpp"
+    "${HOST_ROOT}/source/MicroSynth.cpp"
+    "${HOST_ROOT}/source/Mixer2.cpp"
+)
+
+# The codal-core types they depend on.
+set( HOST_CORE_SOURCES
+    "${CODAL_CORE_DIR}/source/core/CodalCompat.cpp"
+    "${CODAL_CORE_DIR}/source/types/Event.cpp"
+    "${CODAL_CORE_DIR}/source/types/ManagedBuffer.cpp"
+    "${CODAL_CORE_DIR}/source/types/ManagedString.cpp"
+    "${CODAL_CORE_DIR}/source/types/RefCounted.cpp"
+    "${CODAL_CORE_DIR}/source/streams/DataStream.cpp"
+)
+
+set( HOST_SUPPORT_SOURCES
+    "${HOST_ROOT}/host/source/HostNVMController.cpp"
+    "${HOST_ROOT}/host/source/HostSupport.cpp"
+)
+
+add_library( microbit-host STATIC ${HOST_ENGINE_SOURCES} ${HOST_CORE_SOURCES} ${HOST_SUPPORT_SOURCES} )
+
+# host/inc comes first, so that its headers are found in place of those of the target.
+target_include_directories( microbit-host PUBLIC
+    "${HOST_ROOT}/host/inc"
+    "${HOST_ROOT}/inc"
+    "${CODAL_CORE_DIR}/inc"
+    "${CODAL_CORE_DIR}/inc/core"
+    "${CODAL_CORE_DIR}/inc/types"
+    "${CODAL_CORE_DIR}/inc/driver-models"
+    "${CODAL_CORE_DIR}/inc/streams"
+    "${CODAL_CORE_DIR}/inc/drivers"
+    "${CODAL_LIBRARIES_DIR}"
+)
+
+# Keep frame pointers, so that perf can unwind the engines' call stacks.
+target_compile_options( microbit-host PUBLIC -include HostConfig.h -fwrapv -fno-omit-frame-pointer )
+
+add_executable( microbit-host-benchmark "${HOST_ROOT}/host/source/HostBenchmark.cpp" )
+target_link_libraries( microbit-host-benchmark microbit-host m )
@@ -0,0 +1,54 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Target configuration for the host build, standing in for the definitions generated from target.json.
+ * Included ahead of every source file.
+ */
+
+#ifndef HOST_CONFIG_H
+#define HOST_CONFIG_H
+
+#include <stdint.h>
+
+#define MICROBIT_HOST_BUILD                     1
+
+#define DEVICE_HEAP_ALLOCATOR                   0
+#define DEVICE_TAG                              0
+#define DEVICE_BLE                              0
+#define DEVICE_USB                              0
+#define DEVICE_COMPONENT_COUNT                  60
+#define DEVICE_PANIC_HEAP_FULL                  0
+#define DMESG_SERIAL_DEBUG                      0
+#define CODAL_DEBUG                             CODAL_DEBUG_DISABLED
+#define CODAL_TIMESTAMP                         uint64_t
+#define PROCESSOR_WORD_TYPE                     uintptr_t
+#define SCHEDULER_TICK_PERIOD_US                4000
+#define EVENT_LISTENER_DEFAULT_FLAGS            MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY
+#define MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH    10
+#define CODAL_VERSION                           "host"
+
+#define CODAL_POLYSYNTH                         1
+
+#endif
@@ -0,0 +1,88 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOST_NVM_CONTROLLER_H
+#define HOST_NVM_CONTROLLER_H
+
+#include "NVMController.h"
+
+namespace codal
+{
+
+/**
+ * A RAM backed NVMController for the host build, with the semantics of NRF52FlashManager: logical addresses
+ * start at 0, lengths are in 32 bit words, erased memory reads as 0xFF, and a write can only clear bits.
+ *
+ * Operations are counted, so the flash traffic of an engine can be measured along with its speed.
+ */
+class HostNVMController : public NVMController
+{
+    uint8_t *memory;
+    uint32_t pageCount;
+    uint32_t pageSize;
+
+    public:
+
+    uint32_t reads;             // The number of read operations.
+    uint32_t writes;            // The number of write operations.
+    uint32_t erases;            // The number of pages erased.
+    uint32_t bytesRead;         // The number of bytes read.
+    uint32_t bytesWritten;      // The number of bytes written.
+
+    /**
+     * Constructor.
+     *
+     * @param pageCount The number of pages to make available for use.
+     * @param pageSize The size of a single page, in bytes.
+     */
+    HostNVMController(uint32_t pageCount, uint32_t pageSize = 4096);
+
+    /**
+     * Destructor.
+     */
+    ~HostNVMController();
+
+    virtual int read(uint32_t* dest, uint32_t address, uint32_t length) override;
+
+    virtual int write(uint32_t address, uint32_t *data, uint32_t length) override;
+
+    virtual int erase(uint32_t page) override;
+
+    virtual uint32_t getFlashStart() override;
+
+    virtual uint32_t getFlashEnd() override;
+
+    virtual uint32_t getPageSize() override;
+
+    virtual uint32_t getFlashSize() override;
+
+    /**
+     * Resets the operation counters.
+     */
+    void resetStats();
+};
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOST_SUPPORT_H
+#define HOST_SUPPORT_H
+
+#include <stdint.h>
+
+/**
+ * Selects the time source of the system timer in the host build.
+ *
+ * By default, the system timer follows host time. Once simulated, it only moves when advanced with
+ * host_timer_advance_us(), so that time dependent behaviour can be reproduced exactly from one run to the next.
+ *
+ * @param simulated true to simulate time, false to follow host time.
+ */
+void host_timer_set_simulated(bool simulated);
+
+/**
+ * Advances the simulated system timer.
+ *
+ * @param us the time to advance by, in microseconds.
+ */
+void host_timer_advance_us(uint64_t us);
+
+#endif
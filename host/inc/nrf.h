@@ -0,0 +1,71 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Stands in for the CMSIS device header in the host build.
+ *
+ * Only the processor cycle counter used by AudioStats and MicroBitTrace is provided. It counts nanoseconds of
+ * host time, and SystemCoreClock is set to match, so cycle counts convert to time just as they do on the device.
+ */
+
+#ifndef HOST_NRF_H
+#define HOST_NRF_H
+
+#include <stdint.h>
+
+/**
+ * Determines the current host time, in nanoseconds, truncated to 32 bits.
+ */
+uint32_t host_cycle_count();
+
+struct HostCycleCounter
+{
+    uint32_t base;
+
+    operator uint32_t() const { return host_cycle_count() - base; }
+    HostCycleCounter &operator=(uint32_t value) { base = host_cycle_count() - value; return *this; }
+};
+
+struct HostDWT
+{
+    uint32_t            CTRL;
+    HostCycleCounter    CYCCNT;
+};
+
+struct HostCoreDebug
+{
+    uint32_t            DEMCR;
+};
+
+extern HostDWT host_dwt;
+extern HostCoreDebug host_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define DWT                             (&host_dwt)
+#define CoreDebug                       (&host_core_debug)
+
+#define DWT_CTRL_CYCCNTENA_Msk          (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1UL << 24)
+
+#endif
@@ -0,0 +1,310 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Host benchmark of the audio and storage engines.
+ *
+ * Renders the PolySynth scripts of samples/synth_benchmark, mixes a number of always ready channels through Mixer2,
+ * and runs a mixed read/write workload through FSCache over a RAM backed NVMController. Times are measured with the
+ * host clock, so "cycles" here are nanoseconds. Run under perf or cachegrind to profile the engines off device.
+ */
+
+#include "MicroBit.h"
+#include "MicroSynth.h"
+#include "Mixer2.h"
+#include "FSCache.h"
+#include "AudioStats.h"
+#include "HostNVMController.h"
+#include "HostSupport.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace codal;
+
+#define BENCHMARK_POLYSYNTH_VOICES      8
+#define BENCHMARK_RELEASE_TIME          0.5f        // seconds rendered after the notes of a script end
+
+#define BENCHMARK_MIXER_CHANNELS        4
+#define BENCHMARK_MIXER_PULLS           20000
+
+#define BENCHMARK_FS_PAGES              64
+#define BENCHMARK_FS_BLOCK_SIZE         256
+#define BENCHMARK_FS_CACHE_SIZE         8
+#define BENCHMARK_FS_OPERATIONS         100000
+
+struct SynthScript
+{
+    const char          *name;
+    int                 preset;
+    int                 voices;
+    float               duration;
+};
+
+static const SynthScript scripts[] = {
+    { "saw pad x1",         0,  1,  1.0f },
+    { "saw pad x4",         0,  4,  1.0f },
+    { "saw pad x8",         0,  8,  1.0f },
+    { "fm bell x1",         1,  1,  1.0f },
+    { "fm bell x4",         1,  4,  1.0f },
+    { "bl lead x1",         2,  1,  1.0f },
+    { "bl lead x4",         2,  4,  1.0f },
+    { "gated organ x4",     3,  4,  1.0f },
+};
+
+static const int chord[BENCHMARK_POLYSYNTH_VOICES] = { 48, 55, 60, 64, 67, 71, 72, 76 };
+
+static SynthPreset presets[4];
+static uint16_t block[SynthBlockSize];
+
+/**
+ * A source that always has a buffer ready: a ramp of 16 bit unsigned samples, handed out without copying, that
+ * requests its own next pull as each is taken.
+ */
+class BenchmarkSource : public DataSource
+{
+    DataSink            *downStream;
+    ManagedBuffer       buffer;
+
+    public:
+    BenchmarkSource(int samples, int step) : downStream(NULL), buffer(samples * sizeof(uint16_t))
+    {
+        uint16_t *p = (uint16_t *) &buffer[0];
+
+        for (int i = 0; i < samples; i++)
+            p[i] = (uint16_t) (32768 + ((i * step) & 0x3FFF) - 0x2000);
+    }
+
+    virtual void connect(DataSink &sink) override
+    {
+        downStream = &sink;
+        downStream->pullRequest();
+    }
+
+    virtual bool isConnected() override
+    {
+        return downStream != NULL;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    }
+
+    virtual ManagedBuffer pull() override
+    {
+        downStream->pullRequest();
+        return buffer;
+    }
+};
+
+/**
+ * A sink that accepts, and ignores, pull requests, so that the mixer may be driven by hand.
+ */
+class BenchmarkSink : public DataSink
+{
+    public:
+    virtual int pullRequest() override
+    {
+        return DEVICE_OK;
+    }
+};
+
+static void initPresets()
+{
+    memset(presets, 0, sizeof(presets));
+
+    for (int i = 0; i < 4; i++)
+    {
+        SynthPreset &p = presets[i];
+
+        p.osc1Vol = 0.5f;
+        p.osc2Vol = 0.4f;
+        p.filterCutoff = 0.6f;
+        p.filterReso = 0.3f;
+        p.envA = 0.01f;
+        p.envD = 0.1f;
+        p.envS = 0.6f;
+        p.envR = 0.2f;
+        p.lfoShape = OscType::Triangle;
+        p.lfoFreq = 3.0f;
+        p.gain = 0.3f;
+    }
+
+    presets[0].osc1Shape = OscType::Saw;
+    presets[0].osc2Shape = OscType::Saw;
+    presets[0].osc2Transpose = 0.1f;
+    presets[0].filterType = FilterType::LPF;
+    presets[0].filterReso = 0.6f;
+    presets[0].filterLfo = 0.2f;
+
+    presets[1].osc1Shape = OscType::Triangle;
+    presets[1].osc2Shape = OscType::Triangle;
+    presets[1].osc2Transpose = 12.0f;
+    presets[1].fmAmount = 0.4f;
+    presets[1].filterType = FilterType::BPF;
+    presets[1].envS = 0.0f;
+
+    presets[2].osc1Shape = OscType::BLSaw;
+    presets[2].osc2Shape = OscType::BLPulse;
+    presets[2].osc2Transpose = 7.0f;
+    presets[2].osc2Pwm = 0.3f;
+    presets[2].filterType = FilterType::LPF;
+    presets[2].filterEnv = 0.4f;
+    presets[2].filterKeyFollow = 0.5f;
+    presets[2].vibFreq = 5.0f;
+    presets[2].vibAmount = 0.2f;
+
+    presets[3].osc1Shape = OscType::Pulse;
+    presets[3].osc2Shape = OscType::Pulse;
+    presets[3].osc2Transpose = 12.0f;
+    presets[3].osc1Pw = 0.2f;
+    presets[3].filterType = FilterType::HPF;
+    presets[3].filterCutoff = 0.1f;
+    presets[3].noise = 0.05f;
+    presets[3].ampGate = true;
+}
+
+static void benchmarkPolySynth()
+{
+    for (uint32_t i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++)
+    {
+        const SynthScript &script = scripts[i];
+        PolySynth synth(BENCHMARK_POLYSYNTH_VOICES);
+
+        for (int v = 0; v < script.voices; v++)
+            synth.noteOn(chord[v], 0.8f, script.duration, &presets[script.preset]);
+
+        uint32_t total = (uint32_t) ((script.duration + BENCHMARK_RELEASE_TIME) * SynthSampleRate);
+        uint32_t samples = 0;
+        uint64_t ns = 0;
+
+        while (samples < total)
+        {
+            uint32_t start = audio_stats_begin();
+            synth.process(block, SynthBlockSize);
+            ns += audio_stats_begin() - start;
+
+            samples += SynthBlockSize;
+        }
+
+        printf("polysynth %s: %u samples, %.1f ns/sample, real time x%.1f\n", script.name, samples,
+            (double) ns / samples, ((double) samples / SynthSampleRate) / (ns / 1e9));
+    }
+}
+
+static void benchmarkMixer()
+{
+    Mixer2 mixer;
+    BenchmarkSink sink;
+    BenchmarkSource *sources[BENCHMARK_MIXER_CHANNELS];
+
+    mixer.connect(sink);
+
+    // Channels at a mix of rates, so that both the direct and resampling kernels are exercised.
+    for (int i = 0; i < BENCHMARK_MIXER_CHANNELS; i++)
+    {
+        sources[i] = new BenchmarkSource(256, 17 * (i + 1));
+        mixer.addChannel(*sources[i], i & 1 ? 22050 : mixer.getSampleRate());
+    }
+
+    uint32_t samples = 0;
+    uint64_t ns = 0;
+
+    for (int i = 0; i < BENCHMARK_MIXER_PULLS; i++)
+    {
+        host_timer_advance_us(mixer.getOutputLatency());
+
+        uint32_t start = audio_stats_begin();
+        ManagedBuffer b = mixer.pull();
+        ns += audio_stats_begin() - start;
+
+        samples += b.length() / sizeof(uint16_t);
+    }
+
+    printf("mixer %d channels: %u samples, %.1f ns/sample, real time x%.1f\n", BENCHMARK_MIXER_CHANNELS, samples,
+        (double) ns / samples, ((double) samples / mixer.getSampleRate()) / (ns / 1e9));
+
+    for (int i = 0; i < BENCHMARK_MIXER_CHANNELS; i++)
+        delete sources[i];
+}
+
+static void benchmarkFSCache()
+{
+    HostNVMController nvm(BENCHMARK_FS_PAGES);
+    FSCache cache(nvm, BENCHMARK_FS_BLOCK_SIZE, BENCHMARK_FS_CACHE_SIZE);
+    uint8_t data[64];
+    uint32_t seed = 12345;
+    uint32_t size = BENCHMARK_FS_PAGES * nvm.getPageSize();
+
+    memset(data, 0, sizeof(data));
+
+    uint32_t start = audio_stats_begin();
+
+    // Mostly reads, with hot spots at the start of storage (file table) and a sequential scan every so often.
+    for (int i = 0; i < BENCHMARK_FS_OPERATIONS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t r = seed >> 8;
+        uint32_t address = (r & 3) ? (r % 2048) & ~3 : (r % (size - sizeof(data))) & ~3;
+
+        if (r % 61 == 0)
+        {
+            for (uint32_t a = address & ~(nvm.getPageSize() - 1); a < (address | (nvm.getPageSize() - 1)); a += sizeof(data))
+                cache.read(a, data, sizeof(data));
+        }
+        else if (r % 7 == 0)
+        {
+            cache.write(address, data, 16);
+        }
+        else
+        {
+            cache.read(address, data, sizeof(data));
+        }
+    }
+
+    cache.flush();
+
+    uint64_t ns = audio_stats_begin() - start;
+    FSCacheStats stats = cache.getStats();
+
+    printf("fscache: %d operations, %.1f ns/operation\n", BENCHMARK_FS_OPERATIONS, (double) ns / BENCHMARK_FS_OPERATIONS);
+    printf("fscache: hits %u misses %u readAhead %u evictions %u writeThroughs %u writeBacks %u\n", stats.hits, stats.misses,
+        stats.readAhead, stats.evictions, stats.writeThroughs, stats.writeBacks);
+    printf("nvm: reads %u (%u bytes) writes %u (%u bytes) erases %u\n", nvm.reads, nvm.bytesRead, nvm.writes,
+        nvm.bytesWritten, nvm.erases);
+}
+
+int main()
+{
+    // The mixer is driven by hand, so give it a timer that advances one buffer per pull rather than in real time.
+    host_timer_set_simulated(true);
+
+    initPresets();
+
+    benchmarkPolySynth();
+    benchmarkMixer();
+    benchmarkFSCache();
+
+    return 0;
+}
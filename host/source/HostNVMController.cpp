@@ -0,0 +1,156 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "HostNVMController.h"
+#include "ErrorNo.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param pageCount The number of pages to make available for use.
+ * @param pageSize The size of a single page, in bytes.
+ */
+HostNVMController::HostNVMController(uint32_t pageCount, uint32_t pageSize)
+{
+    this->pageCount = pageCount;
+    this->pageSize = pageSize;
+
+    memory = (uint8_t *) malloc(pageCount * pageSize);
+    memset(memory, 0xFF, pageCount * pageSize);
+
+    resetStats();
+}
+
+/**
+ * Destructor.
+ */
+HostNVMController::~HostNVMController()
+{
+    free(memory);
+}
+
+/**
+ * Reads a block of memory from non-volatile memory into RAM
+ *
+ * @param dest The address in RAM in which to store the result of the read operation
+ * @param address The logical address in non-voltile memory to read from
+ * @param length The number 32-bit words to read.
+ */
+int HostNVMController::read(uint32_t* dest, uint32_t address, uint32_t length)
+{
+    if (address + length * sizeof(uint32_t) > getFlashSize())
+        return DEVICE_INVALID_PARAMETER;
+
+    memcpy(dest, memory + address, length * sizeof(uint32_t));
+
+    reads++;
+    bytesRead += length * sizeof(uint32_t);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes data to the specified location in non-volatile memory. As with flash, bits can only be cleared.
+ *
+ * @param address the location to write to
+ * @param data a buffer containing the data to write
+ * @param length the number of 32-bit words to write
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the range is out of bounds.
+ */
+int HostNVMController::write(uint32_t address, uint32_t *data, uint32_t length)
+{
+    if (address + length * sizeof(uint32_t) > getFlashSize())
+        return DEVICE_INVALID_PARAMETER;
+
+    uint32_t *p = (uint32_t *) (memory + address);
+
+    for (uint32_t i = 0; i < length; i++)
+        p[i] &= data[i];
+
+    writes++;
+    bytesWritten += length * sizeof(uint32_t);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Erases a given page in non-volatile memory.
+ *
+ * @param page The address of the page to erase (logical address of the start of the page).
+ */
+int HostNVMController::erase(uint32_t page)
+{
+    if (page % pageSize || page >= getFlashSize())
+        return DEVICE_INVALID_PARAMETER;
+
+    memset(memory + page, 0xFF, pageSize);
+    erases++;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the logical address of the start of non-volatile memory region
+ */
+uint32_t HostNVMController::getFlashStart()
+{
+    return 0;
+}
+
+/**
+ * Determines the logical address of the end of the non-volatile memory region
+ */
+uint32_t HostNVMController::getFlashEnd()
+{
+    return getFlashSize();
+}
+
+/**
+ * Determines the size of a non-volatile memory page, in bytes.
+ */
+uint32_t HostNVMController::getPageSize()
+{
+    return pageSize;
+}
+
+/**
+ * Determines the amount of available storage, in bytes.
+ */
+uint32_t HostNVMController::getFlashSize()
+{
+    return pageCount * pageSize;
+}
+
+/**
+ * Resets the operation counters.
+ */
+void HostNVMController::resetStats()
+{
+    reads = writes = erases = bytesRead = bytesWritten = 0;
+}
@@ -0,0 +1,109 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * The parts of the target that the engines touch in the host build: the target HAL, the system timer and
+ * the processor cycle counter.
+ */
+
+#include "HostSupport.h"
+#include "Timer.h"
+#include "codal_target_hal.h"
+#include "nrf.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace codal;
+
+HostDWT host_dwt;
+HostCoreDebug host_core_debug;
+uint32_t SystemCoreClock = 1000000000;
+
+static bool timerSimulated = false;
+static uint64_t timerSimulatedUs = 0;
+
+static uint64_t host_time_ns()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Determines the current host time, in nanoseconds, truncated to 32 bits.
+ */
+uint32_t host_cycle_count()
+{
+    return (uint32_t) host_time_ns();
+}
+
+/**
+ * Selects the time source of the system timer.
+ *
+ * @param simulated true to simulate time, false to follow host time.
+ */
+void host_timer_set_simulated(bool simulated)
+{
+    timerSimulated = simulated;
+}
+
+/**
+ * Advances the simulated system timer.
+ *
+ * @param us the time to advance by, in microseconds.
+ */
+void host_timer_advance_us(uint64_t us)
+{
+    timerSimulatedUs += us;
+}
+
+CODAL_TIMESTAMP codal::system_timer_current_time_us()
+{
+    static const uint64_t start = host_time_ns();
+
+    return timerSimulated ? timerSimulatedUs : (host_time_ns() - start) / 1000;
+}
+
+CODAL_TIMESTAMP codal::system_timer_current_time()
+{
+    return system_timer_current_time_us() / 1000;
+}
+
+// There is only ever one thread in the host build, so there is nothing for interrupts to be masked against.
+void target_enable_irq()
+{
+}
+
+void target_disable_irq()
+{
+}
+
+void target_wait_for_event()
+{
+}
+
+void target_panic(int statusCode)
+{
+    fprintf(stderr, "PANIC %d\n", statusCode);
+    abort();
+}
@@ -0,0 +1,68 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_BUFFER_POOL_H
+#define CODAL_AUDIO_BUFFER_POOL_H
+
+#include "ManagedBuffer.h"
+
+// The number of output buffers each audio producer keeps for reuse. This should cover the buffers queued
+// downstream plus the one being filled; demand beyond this is met from the heap as before.
+#ifndef CONFIG_AUDIO_BUFFER_POOL_SIZE
+#define CONFIG_AUDIO_BUFFER_POOL_SIZE 4
+#endif
+
+namespace codal
+{
+    /**
+     * A small pool of recycled audio buffers.
+     *
+     * Buffers handed out by the pool remain referenced by it. Once every other reference has been dropped
+     * (i.e. the downstream sink has finished with it), a buffer is handed out again rather than a new one
+     * being allocated from the heap. Each pool is intended for use by a single producer.
+     */
+    class AudioBufferPool
+    {
+        ManagedBuffer   buffers[CONFIG_AUDIO_BUFFER_POOL_SIZE];
+
+        public:
+
+        /**
+         * Provides a buffer of the given length, reusing a released buffer if one is available.
+         * The content of a reused buffer is undefined, so the caller is expected to fill it in full.
+         *
+         * @param length The length of the buffer, in bytes.
+         * @return A buffer of the requested length.
+         */
+        ManagedBuffer allocate(int length);
+
+        /**
+         * Releases every buffer held by the pool, so their memory is returned to the heap once downstream
+         * references are dropped.
+         */
+        void clear();
+    };
+}
+
+#endif
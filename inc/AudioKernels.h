@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_KERNELS_H
+#define CODAL_AUDIO_KERNELS_H
+
+#include <stdint.h>
+
+/**
+ * Block processing kernels for the audio pipeline.
+ *
+ * Each kernel processes a whole buffer of 16 bit samples. Samples are handled in pairs, each pair being
+ * loaded or stored as a single 32 bit word. On processors with the DSP extension (e.g. the Cortex-M4 in the nRF52833)
+ * the packed halfword multiply instructions are used where they apply. Elsewhere, equivalent portable code is used.
+ */
+namespace codal
+{
+    /**
+     * Accumulates signed 16 bit samples, scaled by a gain, into 32 bit accumulators:
+     * acc[i] += (in[i] * gain) >> 16, saturating where supported.
+     *
+     * @param acc The accumulators to update.
+     * @param in The samples to add.
+     * @param len The number of samples.
+     * @param gain The gain to apply, in Q16 fixed point.
+     */
+    void audio_accumulate_s16(int32_t *acc, const int16_t *in, int len, int32_t gain);
+
+    /**
+     * Scales 32 bit fixed point samples, clamps them to the given range and packs them into unsigned 16 bit samples,
+     * then applies an OR mask: out[i] = clamp(((in[i] * scale) >> shift) + offset, lo, hi) | mask.
+     *
+     * @param out The buffer to write.
+     * @param in The samples to pack.
+     * @param len The number of samples.
+     * @param scale The scale to apply.
+     * @param shift The number of fractional bits in the product of each sample and the scale.
+     * @param offset The offset to add after scaling.
+     * @param lo The lowest output level.
+     * @param hi The highest output level.
+     * @param mask The bitmask to logical OR with each sample.
+     */
+    void audio_pack_u16(uint16_t *out, const int32_t *in, int len, int32_t scale, int shift, int32_t offset, int32_t lo, int32_t hi, uint16_t mask);
+
+    /**
+     * Scales floating point samples, clamps them to the given range and packs them into unsigned 16 bit samples,
+     * then applies an OR mask: out[i] = clamp((in[i] * scale) + offset, lo, hi) | mask.
+     *
+     * @param out The buffer to write.
+     * @param in The samples to pack.
+     * @param len The number of samples.
+     * @param scale The scale to apply.
+     * @param offset The offset to add after scaling.
+     * @param lo The lowest output level.
+     * @param hi The highest output level.
+     * @param mask The bitmask to logical OR with each sample.
+     */
+    void audio_pack_float_u16(uint16_t *out, const float *in, int len, float scale, float offset, int32_t lo, int32_t hi, uint16_t mask);
+
+    /**
+     * Fills a buffer with a single 16 bit sample value, e.g. to generate silence.
+     *
+     * @param out The buffer to write.
+     * @param len The number of samples.
+     * @param value The sample value.
+     */
+    void audio_fill_u16(uint16_t *out, int len, uint16_t value);
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_STATS_H
+#define CODAL_AUDIO_STATS_H
+
+#include "CodalConfig.h"
+#include "ManagedBuffer.h"
+
+// Enable/Disable collection of CPU load statistics for each stage of the audio pipeline, measured in processor cycles.
+// Set '1' to enable.
+#ifndef CONFIG_AUDIO_STATS
+#define CONFIG_AUDIO_STATS 0
+#endif
+
+// A pull is counted as late if it arrives more than this percentage of a buffer period after the previous one.
+#ifndef CONFIG_AUDIO_STATS_LATE_MARGIN
+#define CONFIG_AUDIO_STATS_LATE_MARGIN 25
+#endif
+
+// Enable/Disable measurement of end to end audio latency, from the production of each buffer of samples
+// through to the playout of those samples by the PWM. Set '1' to enable.
+#ifndef CONFIG_AUDIO_LATENCY
+#define CONFIG_AUDIO_LATENCY 0
+#endif
+
+// The number of produced buffers whose production time can be held at once, awaiting collection by the mixer.
+#ifndef CONFIG_AUDIO_LATENCY_STAMPS
+#define CONFIG_AUDIO_LATENCY_STAMPS 8
+#endif
+
+namespace codal
+{
+    /**
+     * Processing statistics for a single stage of the audio pipeline.
+     */
+    struct AudioStats
+    {
+        uint32_t        count;                      // Buffers produced.
+        uint64_t        cycles;                     // Total processor cycles spent producing them.
+        uint32_t        worst;                      // The most processor cycles spent producing any single buffer.
+        uint32_t        late;                       // Late pulls, where the downstream sink may have run dry (the mixer only).
+        uint32_t        resetTime;                  // The system time (in milliseconds) at which collection started.
+    };
+
+    /**
+     * Latency statistics for a stream of audio, measured from the production of samples to their playout.
+     */
+    struct AudioLatency
+    {
+        uint32_t        count;                      // Buffers measured.
+        uint64_t        total;                      // The sum of their latencies, in microseconds.
+        uint64_t        squares;                    // The sum of the squares of their latencies, to derive the jitter.
+        uint32_t        min;                        // The lowest latency measured, in microseconds.
+        uint32_t        max;                        // The highest latency measured, in microseconds.
+    };
+
+    /**
+     * Determines the current processor cycle count, enabling the cycle counter if necessary.
+     *
+     * @return The current value of the cycle counter.
+     */
+    uint32_t audio_stats_begin();
+
+    /**
+     * Records the cost of producing one buffer.
+     *
+     * @param stats The statistics to update.
+     * @param start The cycle count returned by audio_stats_begin() when processing started.
+     */
+    void audio_stats_end(AudioStats &stats, uint32_t start);
+
+    /**
+     * Resets the given statistics to zero, and restarts the collection period.
+     *
+     * @param stats The statistics to reset.
+     */
+    void audio_stats_reset(AudioStats &stats);
+
+    /**
+     * Outputs the given statistics via DMESG, including the average and worst case cost of each buffer,
+     * and the share of the processor used by the stage since collection started.
+     *
+     * @param name The name of the stage.
+     * @param stats The statistics to output.
+     */
+    void audio_stats_print(const char *name, const AudioStats &stats);
+
+    /**
+     * Records the time at which a buffer of samples was produced, so that its latency can be measured once it is played out.
+     * If the buffer was stamped before (e.g. it has been recycled), its previous stamp is replaced.
+     *
+     * @param buffer The buffer that has been produced.
+     */
+    void audio_latency_stamp(ManagedBuffer &buffer);
+
+    /**
+     * Retrieves, and forgets, the time at which a buffer of samples was produced.
+     *
+     * @param buffer The buffer received.
+     * @return The time given by system_timer_current_time_us() when the buffer was stamped, or zero if it was not stamped.
+     */
+    uint32_t audio_latency_claim(ManagedBuffer &buffer);
+
+    /**
+     * Records a single latency measurement.
+     *
+     * @param latency The statistics to update.
+     * @param us The latency measured, in microseconds.
+     */
+    void audio_latency_record(AudioLatency &latency, uint32_t us);
+
+    /**
+     * Resets the given latency statistics to zero.
+     *
+     * @param latency The statistics to reset.
+     */
+    void audio_latency_reset(AudioLatency &latency);
+
+    /**
+     * Outputs the given latency statistics via DMESG: the average, range and jitter (standard deviation) of the latency.
+     *
+     * @param name The name of the stream.
+     * @param latency The statistics to output.
+     */
+    void audio_latency_print(const char *name, const AudioLatency &latency);
+
+    /**
+     * Measures the cycles spent within a scope, and records them on exit.
+     */
+    class AudioStatsScope
+    {
+        AudioStats      &stats;
+        uint32_t        start;
+
+        public:
+        AudioStatsScope(AudioStats &s) : stats(s), start(audio_stats_begin()) {}
+        ~AudioStatsScope() { audio_stats_end(stats, start); }
+    };
+}
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+#define AUDIO_STATS_SCOPE(s)        codal::AudioStatsScope audioStatsScope(s)
+#else
+#define AUDIO_STATS_SCOPE(s)
+#endif
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+#define AUDIO_LATENCY_STAMP(b)      codal::audio_latency_stamp(b)
+#else
+#define AUDIO_LATENCY_STAMP(b)
+#endif
+
+#endif
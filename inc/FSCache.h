@@ -25,10 +25,25 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalCompat.h"
 
 #define FSCACHE_FLAG_PINNED				0x01
+#define FSCACHE_FLAG_DIRTY				0x02
+#define FSCACHE_FLAG_PRIORITY			0x04
+
+// Priority classes for pinned ranges.
+#define FSCACHE_PRIORITY_NORMAL			0		// Replaced in least recently used order.
+#define FSCACHE_PRIORITY_HIGH			1		// Only replaced when no normal entry is available, and never by read ahead.
+#define FSCACHE_PRIORITY_PINNED			2		// Never replaced until unpinned.
 
 #define CODAL_FS_CACHE_VALIDATE			1
 #define CODAL_FS_DEFAULT_CACHE_SZE		4
 
+// The number of blocks following a sequential cache miss to read in the same NVMController transaction (0 to disable).
+#ifndef CODAL_FS_CACHE_READ_AHEAD
+#define CODAL_FS_CACHE_READ_AHEAD		2
+#endif
+
+// The number of bytes of arena needed to hold all page buffers of an FSCache with the given block size and number of pages.
+#define FSCACHE_ARENA_SIZE(blockSize, size)	((blockSize) * ((size) + (CODAL_FS_CACHE_READ_AHEAD ? CODAL_FS_CACHE_READ_AHEAD + 1 : 0)))
+
 namespace codal
 {
 	struct CacheEntry
@@ -36,9 +51,23 @@ namespace codal
 		uint32_t address;
 		uint16_t lastUsed;
 		uint16_t flags;
+		uint16_t dirtyStart;		// Offset of the first modified byte not yet written back, if FSCACHE_FLAG_DIRTY is set (word aligned).
+		uint16_t dirtyEnd;			// Offset of the end of the modified bytes not yet written back (word aligned, exclusive).
 		uint8_t  *page;
 	};
 
+	struct FSCacheStats
+	{
+		uint32_t hits;				// Blocks requested that were already held in the cache.
+		uint32_t misses;			// Blocks requested that had to be read from the NVMController.
+		uint32_t readAhead;			// Blocks read from the NVMController ahead of being requested.
+		uint32_t evictions;			// Cached blocks replaced to make space for another.
+		uint32_t writeThroughs;		// Write operations passed directly to the NVMController.
+		uint32_t writeBacks;		// Write operations issued to the NVMController when modified data was flushed.
+		uint32_t bytesRead;			// Total bytes read from the NVMController.
+		uint32_t bytesWritten;		// Total bytes written to the NVMController.
+	};
+
 	class FSCache
 	{
 		private:
@@ -48,19 +77,103 @@ namespace codal
 			int cacheSize;
 			uint16_t operationCount;
 
+			// Direct mapped index from block number to the cache entry most recently holding it, and the last entry hit.
+			// Both are hints, validated against the entry before use.
+			uint16_t *index;
+			uint32_t indexMask;
+			CacheEntry *lastHit;
+
+			// If set, writes are held in the cache until the page is evicted or flush() is called.
+			bool writeBack;
+
+			// The address of the block immediately following the last blocks read from the NVMController. A miss on this
+			// block indicates a sequential scan, and triggers read ahead into readAheadBuffer (allocated on first use).
+			uint32_t readAheadAddress;
+			uint8_t *readAheadBuffer;
+
+			// If set, a contiguous region of FSCACHE_ARENA_SIZE() bytes holding the page buffers of each cache entry (in order),
+			// followed by the read ahead buffer. Pages are never allocated from or returned to the heap while an arena is in use.
+			uint8_t *arena;
+
+			// Counters describing cache effectiveness.
+			FSCacheStats stats;
+
+			/**
+			 * Record that the given cache entry holds the block at its address, so that future lookups find it directly.
+			 */
+			void indexEntry(CacheEntry *c);
+
+			/**
+			 * Write any modified data held by the given cache entry back to the NVMController, as a single operation.
+			 */
+			int flush(CacheEntry *c);
+
+			/**
+			 * Determine the cache entry to replace with a newly loaded block.
+			 * Empty entries are preferred, followed by the least recently used unpinned entry of the lowest priority.
+			 *
+			 * @param start the address of the first block being loaded. Entries holding blocks in this range are never chosen.
+			 * @param end the address of the end of the range being loaded.
+			 * @param clean if true, entries holding modified data or of high priority are never chosen.
+			 * @return the entry to replace, or NULL if clean is set and no suitable entry exists.
+			 */
+			CacheEntry *getVictim(uint32_t start, uint32_t end, bool clean);
+
+			/**
+			 * Determine how many blocks can be read in a single operation following a sequential miss on the given block,
+			 * without crossing a physical page of the NVMController or evicting pinned, high priority or modified entries.
+			 *
+			 * @param address the logical address of the block that missed.
+			 * @return the number of blocks to read, including the block at the given address.
+			 */
+			int getReadAheadLength(uint32_t address);
+
 		public:
 		  /**
 			* @param nvm non - volatile memory controller to use as backing store
 			* @param blockSize - the size of a logical block, in bytes (n.b. this may be smaller than the physical page size)
 			* @param size the maximum number of pages in the cache
+			* @param arena optional caller provided buffer of FSCACHE_ARENA_SIZE(blockSize, size) bytes, used to hold all page buffers.
+			*        If NULL, page buffers are allocated from the heap as needed, unless reserve() is called.
 			*/
-			FSCache(NVMController &nvm, int blockSize, int size = CODAL_FS_DEFAULT_CACHE_SZE);
+			FSCache(NVMController &nvm, int blockSize, int size = CODAL_FS_DEFAULT_CACHE_SZE, uint8_t *arena = NULL);
 
 			/**
-			 * Clear all cache entries, and free any allocated RAM.
+			 * Allocate all memory the cache needs as a single contiguous block from the heap, to be used in place of
+			 * individually allocated page buffers for the lifetime of the cache. Has no effect if an arena is already in use.
+			 *
+			 * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the memory could not be allocated.
+			 */
+			int reserve();
+
+			/**
+			 * Clear all cache entries, and free any allocated RAM (other than an arena).
+			 * n.b. Any data not yet written back is discarded.
 			 */
 			void clear();
 
+			/**
+			 * Determines if writes are written through to the NVMController immediately (the default), or held in the cache.
+			 * In write back mode, each cache entry records the range of bytes modified, and the whole range is written in one
+			 * operation when the entry is evicted or flush() is called. Disabling write back mode flushes the cache.
+			 *
+			 * @param enable true to enable write back mode, false for write through.
+			 */
+			void setWriteBack(bool enable);
+
+			/**
+			 * Write all modified data held in the cache back to the NVMController, in ascending address order.
+			 * Modified ranges that run on from one block into the next are written in a single operation.
+			 *
+			 * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if a write to the NVMController failed.
+			 */
+			int flush();
+
+			/**
+			 * Determines if the cache holds any modified data not yet written back to the NVMController.
+			 */
+			bool isDirty();
+
 			/**
 			 * Erase a single page of FLASH memory at the given address
 			 */
@@ -84,11 +197,31 @@ namespace codal
 			 */
 			int pin(uint32_t address);
 
+			/**
+			 * Pin all pages holding the given range of memory into cache space, with the given priority class.
+			 * n.b. The priority of a high priority page is lost if it is eventually replaced.
+			 *
+			 * @param address the logical address of the start of the range.
+			 * @param len the length of the range, in bytes.
+			 * @param priority FSCACHE_PRIORITY_PINNED to keep the pages resident until unpinned, FSCACHE_PRIORITY_HIGH to keep
+			 *        them in preference to other pages, or FSCACHE_PRIORITY_NORMAL to return them to normal replacement.
+			 * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if pinning the range would leave no page free for other data.
+			 */
+			int pin(uint32_t address, int len, int priority = FSCACHE_PRIORITY_PINNED);
+
 			/**
 			* Unpin the given page into cache space.
 			*/
 			int unpin(uint32_t address);
 
+			/**
+			 * Return all pages holding the given range of memory to normal replacement.
+			 *
+			 * @param address the logical address of the start of the range.
+			 * @param len the length of the range, in bytes.
+			 */
+			int unpin(uint32_t address, int len);
+
 			/**
 			 * Retrieves a given block from the cache, if it is present.
 			 * @param address the logical address of the block.
@@ -103,6 +236,18 @@ namespace codal
 			 */
 			CacheEntry *cachePage(uint32_t address);
 
+			/**
+			 * Retrieve counters describing the effectiveness of the cache since it was created, or since resetStats() was called.
+			 *
+			 * @return a copy of the current counters.
+			 */
+			FSCacheStats getStats();
+
+			/**
+			 * Reset all counters returned by getStats() to zero.
+			 */
+			void resetStats();
+
 			void debug(bool verbose = true);
 			void debug(CacheEntry *c, bool verbose = true);
 	};
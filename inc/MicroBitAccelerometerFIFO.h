@@ -0,0 +1,165 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_ACCELEROMETER_FIFO_H
+#define MICROBIT_ACCELEROMETER_FIFO_H
+
+#include "CodalConfig.h"
+#include "MicroBitI2C.h"
+#include "LSM303Accelerometer.h"
+#include "codal-core/inc/driver-models/Accelerometer.h"
+#include "codal-core/inc/types/CoordinateSystem.h"
+
+#define MICROBIT_ID_ACCELEROMETER_FIFO          3033
+
+// Events, raised on MICROBIT_ID_ACCELEROMETER_FIFO.
+#define MICROBIT_ACCELEROMETER_FIFO_EVT_DATA    1       // Samples have been added to the buffer.
+#define MICROBIT_ACCELEROMETER_FIFO_EVT_POLL    2       // Timer event, used internally to drain the hardware FIFO.
+
+// LSM303AGR accelerometer FIFO registers and fields.
+#define MICROBIT_LSM303_CTRL_REG3_A             0x22
+#define MICROBIT_LSM303_CTRL_REG5_A             0x24
+#define MICROBIT_LSM303_OUT_X_L_A               0x28
+#define MICROBIT_LSM303_FIFO_CTRL_REG_A         0x2E
+#define MICROBIT_LSM303_FIFO_SRC_REG_A          0x2F
+#define MICROBIT_LSM303_AUTO_INCREMENT          0x80
+#define MICROBIT_LSM303_FIFO_EN                 0x40
+#define MICROBIT_LSM303_FIFO_MODE_STREAM        0x80
+#define MICROBIT_LSM303_FIFO_SRC_OVRN           0x40
+#define MICROBIT_LSM303_FIFO_SRC_FSS            0x1F
+#define MICROBIT_LSM303_FIFO_DEPTH              32
+
+// The number of samples held in software, awaiting collection by the application.
+#ifndef MICROBIT_ACCELEROMETER_FIFO_BUFFER
+#define MICROBIT_ACCELEROMETER_FIFO_BUFFER      96
+#endif
+
+// The default number of samples the hardware collects between each burst read.
+#ifndef MICROBIT_ACCELEROMETER_FIFO_WATERMARK
+#define MICROBIT_ACCELEROMETER_FIFO_WATERMARK   16
+#endif
+
+namespace codal
+{
+    /**
+     * Burst reads of accelerometer samples through the hardware FIFO of the LSM303.
+     *
+     * Once enabled, the sensor buffers samples itself at the rate set by the accelerometer's period, and they are
+     * collected a batch at a time, in a single I2C transaction, into a ring buffer read through read(). This makes
+     * high rate capture far cheaper than calling requestUpdate() once per sample.
+     *
+     * The accelerometer's range and period should be set before the FIFO is enabled, as reconfiguring the
+     * accelerometer returns it to its normal, single sample, mode. While the FIFO is enabled, the regular
+     * Accelerometer API is not updated.
+     */
+    class MicroBitAccelerometerFIFO
+    {
+        MicroBitI2C         &i2c;                                               // The I2C bus the sensor is on.
+        Accelerometer       &accelerometer;                                     // The accelerometer driver in use.
+        CoordinateSpace     coordinateSpace;                                    // The orientation of the sensor.
+        uint16_t            address;                                            // The I2C address of the sensor.
+        uint8_t             watermark;                                          // The samples collected between each burst read.
+        uint8_t             ctrlReg3;                                           // CTRL_REG3_A, as set by the driver.
+        bool                enabled;                                            // true if the hardware FIFO is in use.
+        uint16_t            head;                                               // The index of the next sample to read.
+        uint16_t            count;                                              // The number of samples held.
+        uint32_t            overruns;                                           // Samples lost, in hardware or software.
+        Sample3D            buffer[MICROBIT_ACCELEROMETER_FIFO_BUFFER];         // The samples held.
+
+        /**
+         * Drains the hardware FIFO into the ring buffer.
+         */
+        void onPoll(Event);
+
+        /**
+         * Adds a sample to the ring buffer, overwriting the oldest if it is full.
+         */
+        void store(Sample3D sample);
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param i2c The I2C bus the sensor is on.
+         * @param accelerometer The accelerometer driver in use, e.g. MicroBit::accelerometer.
+         * @param address The I2C address of the sensor. Defaults to LSM303_A_DEFAULT_ADDR.
+         */
+        MicroBitAccelerometerFIFO(MicroBitI2C &i2c, Accelerometer &accelerometer, uint16_t address = LSM303_A_DEFAULT_ADDR);
+
+        /**
+         * Destructor. Disables the hardware FIFO, if enabled.
+         */
+        ~MicroBitAccelerometerFIFO();
+
+        /**
+         * Enables the hardware FIFO.
+         *
+         * @param watermark The number of samples to collect between each burst read, between 1 and 31.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the watermark is out of range,
+         * DEVICE_NOT_SUPPORTED if no LSM303 was detected, or DEVICE_I2C_ERROR if the sensor could not be configured.
+         */
+        int enable(int watermark = MICROBIT_ACCELEROMETER_FIFO_WATERMARK);
+
+        /**
+         * Disables the hardware FIFO, returning the accelerometer to its normal mode.
+         * Samples already collected may still be read.
+         *
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the sensor could not be configured.
+         */
+        int disable();
+
+        /**
+         * Determines if the hardware FIFO is enabled.
+         *
+         * @return true if enabled, false otherwise.
+         */
+        bool isEnabled();
+
+        /**
+         * Determines the number of samples waiting to be read.
+         *
+         * @return The number of samples held.
+         */
+        int available();
+
+        /**
+         * Reads, and removes, the oldest samples held, in milli-g and in the same coordinate space as the accelerometer.
+         *
+         * @param samples The array to fill.
+         * @param len The maximum number of samples to read.
+         * @return The number of samples read.
+         */
+        int read(Sample3D *samples, int len);
+
+        /**
+         * Determines the number of samples lost since the FIFO was enabled, because either buffer was full.
+         *
+         * @return The number of samples lost.
+         */
+        uint32_t getOverruns();
+    };
+}
+
+#endif
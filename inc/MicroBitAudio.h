@@ -34,13 +34,17 @@ DEALINGS IN THE SOFTWARE.
 #include "StreamSplitter.h"
 #include "LevelDetectorSPL.h"
 #include "LowPassFilter.h"
+#include "MicroBitMicrophoneStream.h"
+#include "MicroBitMicrophoneDecimator.h"
 
 // Status Flags
 #define MICROBIT_AUDIO_STATUS_DEEPSLEEP       0x0001
+#define MICROBIT_AUDIO_STATUS_PWM_BYPASS      0x0002
 #define CONFIG_DEFAULT_MICROPHONE_GAIN        0.1f
 
 
 // Configurable options
+// The output latency at the default mixer buffer size. The latency at the current size is available from Mixer2::getOutputLatency().
 #ifndef CONFIG_AUDIO_MIXER_OUTPUT_LATENCY_US
 #define CONFIG_AUDIO_MIXER_OUTPUT_LATENCY_US              (uint32_t) ((CONFIG_MIXER_BUFFER_SIZE/2) * (1000000.0f/44100.0f))
 #endif
@@ -61,6 +65,8 @@ namespace codal
         StreamSplitter          *rawSplitter;   // Stream Splitter instance (raw input)
         LevelDetectorSPL        *levelSPL;      // Level Detector SPL instance
         LowPassFilter           *micFilter;     // Low pass filter to remove high frequency noise on the mic
+        MicroBitMicrophoneStream *micStream;    // Direct access to the raw microphone buffers, created on demand
+        MicroBitMicrophoneDecimator *micDecimator; // The microphone at a reduced sample rate, created on demand
 
         private:
         volatile bool micEnabled;               // State of on board mic
@@ -78,6 +84,10 @@ namespace codal
 
         int micDriverTimeout;
 
+        uint32_t bypassPeriodUs;                // The period of the tone being generated directly by the PWM, in microseconds.
+        int bypassValue;                        // The amplitude of the tone being generated directly by the PWM (0..128).
+        uint16_t bypassSequence;                // The single sample PWM sequence used to generate that tone.
+
         public:
         SoundExpressions soundExpressions;      // SoundExpression intepreter
         SoundOutputPin   virtualOutputPin;      // Virtual PWM channel (backward compatibility).
@@ -113,6 +123,24 @@ namespace codal
           */
         void deactivateMic();
 
+        /**
+         * Provides direct access to the raw microphone stream: each buffer produced by the ADC, shared rather than copied,
+         * together with its RMS and peak level. The stream is created on first use, and enables the microphone when started.
+         *
+         * @return The microphone stream.
+         */
+        MicroBitMicrophoneStream *getMicrophoneStream();
+
+        /**
+         * Provides the microphone stream decimated to a lower sample rate (e.g. 8 or 16kHz), filtered as each buffer
+         * arrives from the ADC. The stream is created on first use, and enables the microphone when connected to.
+         * It is shared, so the rate set by the most recent call applies to all of its consumers.
+         *
+         * @param sampleRate The output sample rate to aim for. See MicroBitMicrophoneDecimator::getSampleRate() for the rate delivered.
+         * @return The decimated microphone stream.
+         */
+        MicroBitMicrophoneDecimator *getDecimatedMicrophone(float sampleRate = 16000);
+
         /**
           * Set normaliser gain
           * @param gain value to set the microphone gain to
@@ -168,6 +196,41 @@ namespace codal
          */
         bool isPlaying();
 
+        /**
+         * Attempts to play a constant square wave tone by programming the PWM peripheral directly, bypassing the mixer.
+         * This is only possible whilst every mixer channel, other than that of the caller, is suspended. Once in place,
+         * the bypass remains until another source requests activation of the audio pipeline, or endToneBypass() is called.
+         *
+         * @param channel The mixer channel of the caller, which is disregarded when deciding if a bypass is possible.
+         * @param periodUs The period of the tone, in microseconds. Zero for silence.
+         * @param value The amplitude of the tone, in the range 0..128.
+         * @return true if the tone is now being generated directly by the PWM, false if it must be mixed as normal.
+         */
+        bool setToneBypass(MixerChannel *channel, uint32_t periodUs, int value);
+
+        /**
+         * Stops any tone being generated by setToneBypass(), and returns the PWM peripheral to the mixer.
+         */
+        void endToneBypass();
+
+        /**
+         * Determines if a tone is currently being generated directly by the PWM peripheral.
+         * @return true if setToneBypass() is in effect.
+         */
+        bool isToneBypassed();
+
+        /**
+         * Outputs the CPU load statistics of each stage of the audio pipeline via DMESG: the mixer and each of
+         * its channels, the sound expression synthesizer and the virtual output pin.
+         * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+         */
+        void printStats();
+
+        /**
+         * Resets the CPU load statistics of each stage of the audio pipeline.
+         */
+        void resetStats();
+
         /**
          * Define which pin on the edge connector is used for audio.
          * @param pin The pin to use for auxiliary audio.
@@ -190,6 +253,13 @@ namespace codal
           * Puts the component in (or out of) sleep (low power) mode.
           */
         virtual int setSleep(bool doSleep) override;
+
+        private:
+
+        /**
+         * Programs the PWM peripheral to generate the tone defined by setToneBypass(), on the pins currently enabled.
+         */
+        void updateToneBypass();
     };
 }
 
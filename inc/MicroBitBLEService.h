@@ -32,6 +32,13 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitBLEChar.h"
 
+// Notification priorities, for queueChrValue(). Higher priority notifications are sent first,
+// and a high priority notification is sent without waiting for the next connection interval.
+#define MICROBIT_BLE_NOTIFY_PRIORITY_HIGH       0
+#define MICROBIT_BLE_NOTIFY_PRIORITY_NORMAL     1
+#define MICROBIT_BLE_NOTIFY_PRIORITY_LOW        2
+#define MICROBIT_BLE_NOTIFY_PRIORITIES          3
+
 namespace codal
 {
 
@@ -107,6 +114,21 @@ class MicroBitBLEService
     bool notifyChrValue( int idx, const uint8_t *data, uint16_t length)
     { return characteristicPtr( idx)->notifyChrValue( getConnectionHandle(), data, length); }
 
+    /**
+      * Queues a notification of a characteristic's value with MicroBitBLEManager, to be sent along with
+      * those of other services once per connection interval (see MICROBIT_BLE_NOTIFY_SCHEDULER).
+      * If the scheduler is disabled, the notification is sent straight away.
+      *
+      * @note Only the latest value queued for each characteristic is sent, and it is read when it is sent,
+      *       so data should be the characteristic's own buffer, holding the latest sample.
+      */
+    bool queueChrValue( int idx, const uint8_t *data, uint16_t length, int priority = MICROBIT_BLE_NOTIFY_PRIORITY_NORMAL);
+
+    /**
+      * Determines if a notification queued with queueChrValue() has yet to be sent.
+      */
+    bool chrValueQueued( int idx);
+
     bool indicateChrValue( int idx, const uint8_t *data, uint16_t len)
     { return characteristicPtr( idx)->indicateChrValue( getConnectionHandle(), data, len); }
                                              
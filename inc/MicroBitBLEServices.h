@@ -37,6 +37,12 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_BLE_SERVICES_MAX 20
 #endif
 
+// The number of GATT attribute handles that can be mapped directly to their service and characteristic.
+// Attributes with larger handles are still found, by searching each service in turn.
+#ifndef MICROBIT_BLE_SERVICES_MAX_HANDLES
+#define MICROBIT_BLE_SERVICES_MAX_HANDLES 192
+#endif
+
 #ifndef MICROBIT_BLE_SERVICES_OBSERVER_PRIO
 #define MICROBIT_BLE_SERVICES_OBSERVER_PRIO 2
 #endif
@@ -69,11 +75,35 @@ class MicroBitBLEServices
 
     void AddService(    MicroBitBLEService *service);
     void RemoveService( MicroBitBLEService *service);
+
+    /**
+      * Records the attribute handles of a characteristic, so that events on them can be passed
+      * straight to the service that owns them.
+      */
+    void AddHandles( MicroBitBLEService *service, int idx, const microbit_charhandles_t *handles);
+
+    /**
+      * Finds the service and characteristic that own an attribute handle.
+      *
+      * @param handle The attribute handle.
+      * @param idx Set to the index of the characteristic within its service.
+      * @param type Set to the attribute of the characteristic the handle refers to.
+      * @return The owning service, or NULL if the handle isn't in our table.
+      */
+    MicroBitBLEService *FindHandle( uint16_t handle, int *idx, microbit_charattr_t *type);
     
     void onBleEvent( microbit_ble_evt_t const * p_ble_evt);
 
-    int                  bs_services_count;
-    MicroBitBLEService   *bs_services[ MICROBIT_BLE_SERVICES_MAX];
+    typedef struct microbit_handle_entry_t
+    {
+        uint8_t     service;    // index into bs_services, or 0xFF if unused
+        uint8_t     idx;
+        uint8_t     type;
+    } microbit_handle_entry_t;
+
+    int                     bs_services_count;
+    MicroBitBLEService      *bs_services[ MICROBIT_BLE_SERVICES_MAX];
+    microbit_handle_entry_t bs_handles[ MICROBIT_BLE_SERVICES_MAX_HANDLES];
 };
 
 } // namespace codal
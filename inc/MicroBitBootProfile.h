@@ -0,0 +1,92 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_BOOT_PROFILE_H
+#define MICROBIT_BOOT_PROFILE_H
+
+#include "MicroBitConfig.h"
+#include "codal-core/inc/driver-models/Serial.h"
+
+//
+// Boot profile (if CONFIG_MICROBIT_BOOT_PROFILE is enabled).
+// Each phase of start up is timed in microseconds, measured from the first phase to begin (i.e. shortly after reset).
+// Phases may nest: MICROBIT_BOOT_PHASE_INIT covers the whole of MicroBit::init().
+//
+#define MICROBIT_BOOT_PHASE_POWER_MANAGER           0           // MicroBitPowerManager constructor.
+#define MICROBIT_BOOT_PHASE_USB_FLASH_MANAGER       1           // MicroBitUSBFlashManager constructor.
+#define MICROBIT_BOOT_PHASE_ACCELEROMETER           2           // MicroBitAccelerometer::autoDetect(), including the sensor probe.
+#define MICROBIT_BOOT_PHASE_COMPASS                 3           // MicroBitCompass::autoDetect().
+#define MICROBIT_BOOT_PHASE_INIT                    4           // MicroBit::init(), from entry until it returns to main().
+#define MICROBIT_BOOT_PHASE_ERASE_USER_STORAGE      5           // MicroBit::eraseUserStorage().
+#define MICROBIT_BOOT_PHASE_COMPONENTS              6           // init() of each registered component.
+#define MICROBIT_BOOT_PHASE_PAIRING_MODE            7           // Detection of BLE pairing mode.
+#define MICROBIT_BOOT_PHASE_BLE                     8           // MicroBitBLEManager::init().
+#define MICROBIT_BOOT_PHASES                        9
+
+typedef struct {
+    uint32_t start;                                             // Time at which the phase began, or zero if it has not run.
+    uint32_t time;                                              // Time taken by the phase, or zero if it has not completed.
+} MicroBitBootPhase;
+
+namespace codal
+{
+    /**
+     * Records the start of a phase of start up.
+     * The first call starts the clock that all phases are measured against.
+     *
+     * @param phase the phase (one of MICROBIT_BOOT_PHASE_*).
+     */
+    void microbit_boot_profile_begin(int phase);
+
+    /**
+     * Records the end of a phase of start up.
+     *
+     * @param phase the phase (one of MICROBIT_BOOT_PHASE_*).
+     */
+    void microbit_boot_profile_end(int phase);
+
+    /**
+     * Retrieves the boot timeline.
+     *
+     * @return an array of MICROBIT_BOOT_PHASES entries, indexed by phase, or NULL if profiling is disabled.
+     */
+    const MicroBitBootPhase *microbit_boot_profile_get();
+
+    /**
+     * Print the boot timeline to the given serial port, in the order the phases began.
+     *
+     * @param serial the serial port to print to.
+     */
+    void microbit_boot_profile_print(Serial &serial);
+}
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+#define MICROBIT_BOOT_PROFILE_BEGIN(p)      codal::microbit_boot_profile_begin(p)
+#define MICROBIT_BOOT_PROFILE_END(p)        codal::microbit_boot_profile_end(p)
+#else
+#define MICROBIT_BOOT_PROFILE_BEGIN(p)
+#define MICROBIT_BOOT_PROFILE_END(p)
+#endif
+
+#endif
@@ -33,8 +33,54 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitDisplay.h"
 #include "MicroBitStorage.h"
 
+/**
+ * Set to 1 to refine the sphere fit of an interactive calibration into an axis aligned ellipsoid fit.
+ */
+#ifndef MICROBIT_COMPASS_CALIBRATOR_ELLIPSOID
+#define MICROBIT_COMPASS_CALIBRATOR_ELLIPSOID                   0
+#endif
+
+/**
+ * Background calibration parameters.
+ */
+#ifndef MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_MIN_SAMPLES
+#define MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_MIN_SAMPLES      32          // Accepted samples required before a fit is first applied.
+#endif
+
+#ifndef MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_UPDATE
+#define MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_UPDATE           8           // Accepted samples between each refit.
+#endif
+
+#ifndef MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_WINDOW
+#define MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_WINDOW           256         // Effective number of samples in the fit, after which older samples are forgotten.
+#endif
+
+#ifndef MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_SPACING
+#define MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_SPACING          2000        // Distance (raw units) a sample must be from the last accepted sample.
+#endif
+
+#ifndef MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_STORE_DELTA
+#define MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_STORE_DELTA      1000        // Distance (raw units) the centre must move before the calibration is stored again.
+#endif
+
 namespace codal
 {
+    /**
+     * Running state of a background calibration: the sums of the least squares normal equations for an axis aligned
+     * ellipsoid, A.x^2 + B.y^2 + C.x + D.y + E.z + F = -z^2, and the extent of the samples gathered.
+     */
+    struct MicroBitCompassFit
+    {
+        float               m[6][6];        // Sum of the outer product of each sample's terms with itself.
+        float               v[6];           // Sum of each sample's terms, multiplied by -z^2.
+        float               weight;         // Effective number of samples in the sums.
+        int                 accepted;       // Samples accepted since the last refit.
+        Sample3D            last;           // The last accepted sample.
+        Sample3D            lo;             // The smallest value seen on each axis.
+        Sample3D            hi;             // The largest value seen on each axis.
+        Sample3D            stored;         // The centre of the calibration last stored.
+    };
+
     /**
      * Class definition for an interactive compass calibration algorithm.
      *
@@ -46,6 +92,9 @@ namespace codal
      *
      * This class listens for calibration requests from the compass (on the default event model),
      * and automatically initiates a calibration sequence as necessary.
+     *
+     * Alternatively, calibration may be run in the background: samples are then gathered from the compass during
+     * normal use, and a running least squares fit is used to update the calibration without stopping the application.
      */
     class MicroBitCompassCalibrator
     {
@@ -53,6 +102,7 @@ namespace codal
         Accelerometer&          accelerometer;
         MicroBitDisplay&        display;
         MicroBitStorage*        storage;
+        MicroBitCompassFit*     fit;
 
         public:
 
@@ -117,8 +167,43 @@ namespace codal
       */
      static CompassCalibration calibrate(Sample3D *data, int samples);
 
+    /**
+      * Starts calibrating the compass in the background.
+      *
+      * Samples are gathered from the compass as it is used, and the calibration is refitted and applied as
+      * they arrive, once they cover enough of each axis. If persistent storage is available, the calibration is
+      * stored whenever its centre has moved significantly.
+      *
+      * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if memory could not be allocated.
+      */
+    int startBackgroundCalibration();
+
+    /**
+      * Stops calibrating the compass in the background. The calibration last applied remains in use.
+      *
+      * @return MICROBIT_OK on success.
+      */
+    int stopBackgroundCalibration();
+
+    /**
+      * Determines if the compass is being calibrated in the background.
+      *
+      * @return true if background calibration is running, false otherwise.
+      */
+    bool isBackgroundCalibrating();
+
     private:
 
+    /**
+     * Event handler for new compass data, used during background calibration.
+     */
+    void onCompassData(MicroBitEvent);
+
+    /**
+     * Solves the running least squares fit of a background calibration, and applies the result if it is sound.
+     */
+    void backgroundRefit();
+
     /**
      * Scoring function for a hill climb algorithm.
      *
@@ -130,6 +215,29 @@ namespace codal
      */
     static float measureScore(Sample3D &c, Sample3D *data, int samples);
 
+    /**
+     * Determines the centre of the sphere that best fits the given data points, by a closed form linear least squares fit.
+     *
+     * @param data An array of all data points
+     * @param samples The number of samples in the 'data' array.
+     * @param centre The centre point of the sphere, if one is found.
+     *
+     * @return true on success, or false if the data points do not describe a sphere.
+     */
+    static bool fitSphere(Sample3D *data, int samples, Sample3D &centre);
+
+    /**
+     * Refines a sphere fit into an axis aligned ellipsoid fit, giving an independent centre and scale factor for each axis.
+     *
+     * @param centre A previously calculated centre point of all data, about which the refined fit is made.
+     * @param data An array of all data points
+     * @param samples The number of samples in the 'data' array.
+     * @param cal The calibration to fill in.
+     *
+     * @return true on success, or false if the data points do not describe an ellipsoid.
+     */
+    static bool fitEllipsoid(Sample3D centre, Sample3D *data, int samples, CompassCalibration &cal);
+
     /*
      * Performs an interative approximation (hill descent) algorithm to determine an
      * estimated centre point of a sphere upon which the given data points reside.
@@ -123,13 +123,73 @@
 
 //
 // FileSystem writeback cache size, in bytes. Defines how many bytes will be stored
-// in RAM before being written back to FLASH. Set to zero to disable this feature.
+// in RAM before being written back to FLASH. Set to zero to disable this feature by default.
+// A cache can also be requested for individual files, by opening them with the MB_CACHED flag.
 // Should be <= MBFS_BLOCK_SIZE.
 //
 #ifndef MBFS_CACHE_SIZE
     #define MBFS_CACHE_SIZE        0
 #endif
 
+//
+// Size of the pool of RAM shared by all FileSystem writeback caches, in bytes.
+// The pool is divided into buffers of MBFS_BLOCK_SIZE bytes, and allocated the first time a cached file is opened.
+// Files opened when the pool is exhausted are not cached.
+//
+#ifndef MBFS_CACHE_POOL_SIZE
+    #define MBFS_CACHE_POOL_SIZE   (MBFS_BLOCK_SIZE * 2)
+#endif
+
+//
+// Number of slots in the RAM index of FileSystem directory entries, used to locate files by name without
+// scanning directories in FLASH. Each slot uses 8 bytes of RAM. Should be larger than the number of files expected.
+// Set to zero to disable this feature.
+//
+#ifndef MBFS_DIRECTORY_INDEX_SIZE
+    #define MBFS_DIRECTORY_INDEX_SIZE   128
+#endif
+
+//
+// Number of FLASH page erases performed by the FileSystem between saves of its per-page erase counters.
+// Counters are saved to FLASH when a file is closed or removed. Lower values improve the accuracy of
+// wear levelling after a loss of power, at the cost of additional FLASH writes.
+//
+#ifndef MBFS_WEAR_SAVE_INTERVAL
+    #define MBFS_WEAR_SAVE_INTERVAL     16
+#endif
+
+//
+// Difference in erase count between the most and least worn pages of the FileSystem at which
+// long lived file data is migrated off the least worn page, so that page can take its share of erases.
+// Set to zero to disable static wear levelling.
+//
+#ifndef MBFS_WEAR_LEVELLING_THRESHOLD
+    #define MBFS_WEAR_LEVELLING_THRESHOLD   64
+#endif
+
+//
+// Maximum number of blocks appended by a single FileSystem write before they are recorded in the file table.
+// Entries for consecutive blocks are written to FLASH together.
+//
+#ifndef MBFS_FILE_TABLE_BATCH_SIZE
+    #define MBFS_FILE_TABLE_BATCH_SIZE      16
+#endif
+
+//
+// Number of erased FLASH pages the FileSystem tries to keep in reserve, by erasing pages in a background fiber.
+// This allows writes to find a scratch page without waiting for an erase. Set to zero to disable background garbage collection.
+//
+#ifndef MBFS_ERASED_PAGE_POOL_SIZE
+    #define MBFS_ERASED_PAGE_POOL_SIZE      2
+#endif
+
+//
+// Number of DELETED blocks at which the FileSystem starts compacting them in the background, so they can be reused.
+//
+#ifndef MBFS_GC_THRESHOLD
+    #define MBFS_GC_THRESHOLD               16
+#endif
+
 // Address of the end of the current program in FLASH memory.
 // This is recorded by the C/C++ linker, but the symbol name varies depending on which compiler is used.
 #if defined(__arm)
@@ -268,6 +328,115 @@
 #define MICROBIT_BLE_UTILITY_SERVICE 0
 #endif
 
+// Enable/Disable rotating Eddystone advertising, via MicroBitBLEManager::advertiseEddystoneRotation().
+// The URL and UID frames last given to the BLE manager are advertised in turn, interleaved with Eddystone TLM
+// (telemetry) frames if requested. Requires MICROBIT_BLE_EDDYSTONE_URL and/or MICROBIT_BLE_EDDYSTONE_UID.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_EDDYSTONE_ROTATION
+#define MICROBIT_BLE_EDDYSTONE_ROTATION 0
+#endif
+
+// Enable/Disable BLE Service: MicroBitBenchmarkService
+// Measures GATT throughput in each direction, and reports it with the connection interval, PHY and MTU.
+// Intended for development only.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_BENCHMARK_SERVICE
+#define MICROBIT_BLE_BENCHMARK_SERVICE 0
+#endif
+
+// The number of notifications the SoftDevice may queue for transmission on a connection.
+// Larger queues allow several notifications to be sent in each connection event, at the cost of SoftDevice RAM
+// (which may require the application RAM start to be moved). A value of 1 leaves the SoftDevice default.
+#ifndef MICROBIT_BLE_HVN_TX_QUEUE_SIZE
+    #define MICROBIT_BLE_HVN_TX_QUEUE_SIZE          1
+#endif
+
+// Enable/Disable batching of events sent by MicroBitEventService.
+// When enabled, events raised between idle callbacks are packed into a single notification of the microBitEvent
+// characteristic, as many (type, reason) pairs as the negotiated MTU allows. Clients must then read every pair
+// in each notification, rather than just the first.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_EVENT_SERVICE_BATCH
+    #define MICROBIT_BLE_EVENT_SERVICE_BATCH        0
+#endif
+
+// Enable/Disable the notification scheduler of MicroBitBLEManager.
+// When enabled, services that stream sampled values (the IO pin, accelerometer, magnetometer and temperature services)
+// queue their notifications with the manager rather than sending them straight away. The manager sends everything
+// queued once per connection interval, in priority order, so that updates share connection events. Only the latest
+// value queued for each characteristic is sent.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_NOTIFY_SCHEDULER
+    #define MICROBIT_BLE_NOTIFY_SCHEDULER           0
+#endif
+
+// The number of characteristics that may have a notification queued with the scheduler at once.
+#ifndef MICROBIT_BLE_NOTIFY_QUEUE_SIZE
+    #define MICROBIT_BLE_NOTIFY_QUEUE_SIZE          8
+#endif
+
+// Enable/Disable interrupt driven change detection in MicroBitIOPinService.
+// When enabled, digital inputs are watched using pin edge events (GPIO SENSE/GPIOTE) rather than being read on every
+// idle callback, and analog inputs are sampled on a timer, every MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_PERIOD
+// milliseconds, with a notification sent only when a value moves by at least MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_THRESHOLD.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_IO_PIN_SERVICE_EVENTS
+    #define MICROBIT_BLE_IO_PIN_SERVICE_EVENTS      0
+#endif
+
+#ifndef MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_PERIOD
+    #define MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_PERIOD       50
+#endif
+
+// The change in an analog input (in the 8 bit units reported over BLE) needed to send a notification.
+#ifndef MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_THRESHOLD
+    #define MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_THRESHOLD    1
+#endif
+
+// Enable/Disable the batch characteristic of MicroBitAccelerometerService.
+// When enabled, each accelerometer sample is also timestamped and held in a ring buffer, and clients that enable
+// notifications of the batch characteristic receive as many samples per notification as the negotiated MTU allows.
+// Samples are only lost if the ring buffer fills, e.g. while the link is unable to keep up.
+// Set '1' to enable.
+#ifndef MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH
+    #define MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH        0
+#endif
+
+// The number of samples held by the ring buffer of the accelerometer batch characteristic.
+#ifndef MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER
+    #define MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER 64
+#endif
+
+// The longest time (in milliseconds) a sample may wait for a batch to fill before a partial batch is sent.
+#ifndef MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_LATENCY
+    #define MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_LATENCY 100
+#endif
+
+// The change in any axis of the magnetometer (in the units of its data characteristic) needed before a new sample is sent by
+// MicroBitMagnetometerService. A value of 0 sends every sample.
+#ifndef MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD
+    #define MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD     0
+#endif
+
+// The number of magnetometer samples MicroBitMagnetometerService packs into each notification of its data
+// characteristic, limited by the negotiated MTU. Clients must then read every sample in each notification.
+// A value of 1 sends each sample on its own.
+#ifndef MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH
+    #define MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH         1
+#endif
+
+// The change in temperature (in degrees Celsius) needed before a new sample is sent by MicroBitTemperatureService.
+// A value of 0 sends every sample.
+#ifndef MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD
+    #define MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD      0
+#endif
+
+// The number of temperature samples MicroBitTemperatureService packs into each notification of its data
+// characteristic, limited by the negotiated MTU. A value of 1 sends each sample on its own.
+#ifndef MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH
+    #define MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH          1
+#endif
+
 // Enable/Disable Nordic Firmware style BLE based UART implimentation.
 // The default codal implimentation reverses the TX/RX ids  
 // Set to '1' to enable
@@ -282,6 +451,13 @@
     #define MICROBIT_RADIO_MAX_PACKET_SIZE          32
 #endif
 
+// Enable/Disable use of the radio while the BLE stack is running.
+// If enabled, the radio borrows the RADIO from the SoftDevice in timeslots between BLE events, sharing its throughput with BLE.
+// Set '1' to enable.
+#ifndef MICROBIT_RADIO_TIMESLOT
+    #define MICROBIT_RADIO_TIMESLOT                 0
+#endif
+
 // Versioning options.
 // We use semantic versioning (http://semver.org/) to identify different versions of the micro:bit runtime.
 // If this isn't available, it can be defined manually as a configuration option.
@@ -318,6 +494,130 @@
 #endif
 
 
+// Enables collection of per command statistics (counts, retries, busy responses and latency) for I2C transactions
+// with the USB interface chip, made by MicroBitUSBFlashManager and MicroBitPowerManager.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_INTERFACE_STATS
+    #define CONFIG_MICROBIT_INTERFACE_STATS    0
+#endif
+
+// Enable/Disable timing of each phase of deep sleep entry and exit by MicroBitPowerManager,
+// including the time taken by each component's deep sleep callback.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_DEEPSLEEP_PROFILE
+    #define CONFIG_MICROBIT_DEEPSLEEP_PROFILE    0
+#endif
+
+// Enable/Disable accounting of the time each power hungry subsystem (radio, display, microphone, BLE connections
+// and deep sleep) spends active, as reported to MicroBitPowerManager.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_ENERGY_ACCOUNTING
+    #define CONFIG_MICROBIT_ENERGY_ACCOUNTING    0
+#endif
+
+// Enable/Disable tickless idle. When enabled, and no component requires periodic system tick callbacks,
+// the scheduler idle loop sleeps until the next wake up timer event rather than waking for every scheduler tick.
+// MicroBit then debounces buttons A and B from pin edges (see MicroBitButton::setInterruptMode()), as polled buttons
+// need every tick. Components an application adds that are polled from the system tick still prevent it.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_TICKLESS_IDLE
+    #define CONFIG_MICROBIT_TICKLESS_IDLE    0
+#endif
+
+// Enable/Disable periodic tasks on MicroBitPowerManager. When enabled, a task registered with addPeriodicTask() also runs
+// during deep sleep, waking only the components it declares, and deep sleep resumes as soon as it returns.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_PERIODIC_TASKS
+    #define CONFIG_MICROBIT_PERIODIC_TASKS    0
+#endif
+
+// Enable/Disable the fast boot path through MicroBit::init(). When enabled, the accelerometer/compass type detected
+// is cached (see CONFIG_MICROBIT_SENSOR_CACHE), the BLE stack is started in a background fiber rather than before
+// main() runs, and delays that only serve BLE pairing mode detection are skipped where possible.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_FAST_BOOT
+    #define CONFIG_MICROBIT_FAST_BOOT    0
+#endif
+
+// Enable/Disable caching of the accelerometer/compass type and address detected, across soft resets. A cached result
+// is validated with a single WHO_AM_I read, skipping the sensor power up delay; a full probe is made only on mismatch.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_SENSOR_CACHE
+    #define CONFIG_MICROBIT_SENSOR_CACHE    CONFIG_MICROBIT_FAST_BOOT
+#endif
+
+// Enable/Disable timing of each phase of start up (driver constructors, sensor detection, MicroBit::init() and
+// the BLE stack), available through microbit_boot_profile_get() and microbit_boot_profile_print().
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_BOOT_PROFILE
+    #define CONFIG_MICROBIT_BOOT_PROFILE    0
+#endif
+
+// Enable/Disable a pool of entropy, filled from the hardware random number generator by interrupt in the background
+// (see microbit_random_bytes()). When enabled, seedRandom() takes its seed from the pool rather than polling the RNG.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_RANDOM_POOL
+    #define CONFIG_MICROBIT_RANDOM_POOL    0
+#endif
+
+// Enable/Disable caching of the region table built by MicroBitMemoryMap across soft resets. The cache is validated
+// against the hash record it was built from, so the scan of flash for that record is only repeated after a reflash.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_MEMORY_MAP_CACHE
+    #define CONFIG_MICROBIT_MEMORY_MAP_CACHE    0
+#endif
+
+// Enable/Disable the trace buffer, which records timestamped events from interrupt handlers and other hot paths
+// (see MicroBitTrace.h). Recording starts with microbit_trace_start(), and may be dumped with microbit_trace_print().
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_TRACE
+    #define CONFIG_MICROBIT_TRACE    0
+#endif
+
+// Enable/Disable interrupt driven debouncing by default for MicroBitButton. When enabled, buttons are debounced by a
+// short timer started on each edge of their pin, rather than being sampled on every system tick.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_BUTTON_INTERRUPT_MODE
+    #define CONFIG_MICROBIT_BUTTON_INTERRUPT_MODE    0
+#endif
+
+// Enable/Disable the append only log format for MicroBitStorage (see MicroBitKeyValueLog.h). Updates are appended to
+// KEY_VALUE_STORE_PAGE, which is only erased once full, rather than on every put(). Enabling this reformats the page,
+// so any pairs stored in the KeyValueStorage format are lost.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_STORAGE_LOG
+    #define CONFIG_MICROBIT_STORAGE_LOG    0
+#endif
+
+// Enable/Disable counting of heap allocations made by MicroBitLog, FSCache, MicroBitRadio, AudioBufferPool and
+// PacketBuffer (see MicroBitHeapProfile.h), reported along with the heap's high water mark and fragmentation.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_HEAP_PROFILE
+    #define CONFIG_MICROBIT_HEAP_PROFILE    0
+#endif
+
+// Enable/Disable sampling of the stack depth of each fiber from the SysTick interrupt (see MicroBitStackProfile.h),
+// to find the deepest paths and size fiber stacks from real data. Takes over SysTick_Handler when enabled.
+// 0: Disabled
+// 1: Enabled
+#ifndef CONFIG_MICROBIT_STACK_PROFILE
+    #define CONFIG_MICROBIT_STACK_PROFILE    0
+#endif
+
 // Defines the MicrobitLog HTML header used
 // 0: data.microbit.org data logging experience
 // 1: basic experience supported by dl.js in this repository hosted on microbit.org
@@ -30,11 +30,16 @@ DEALINGS IN THE SOFTWARE.
 #define MBFS_FILENAME_LENGTH        16        
 #define MBFS_MAGIC                  "MICROBIT_FS_1_0"
 
+// Name of the file in the root directory holding per-page erase counters.
+// This contains a non-printable character, so cannot be opened or removed by applications.
+#define MBFS_WEAR_TABLE             "\177wear"
+
 // open() flags.
 #define MB_READ     0x01
 #define MB_WRITE    0x02
 #define MB_CREAT    0x04
 #define MB_APPEND   0x08
+#define MB_CACHED   0x10
 
 // seek() flags.
 #define MB_SEEK_SET 0x01
@@ -43,6 +48,8 @@ DEALINGS IN THE SOFTWARE.
 
 // Status flags
 #define MBFS_STATUS_INITIALISED           0x01
+#define MBFS_STATUS_INDEXED               0x02
+#define MBFS_STATUS_COLLECTING            0x04
 
 // FileTable codes
 #define MBFS_UNUSED                       0xFFFF
@@ -85,6 +92,17 @@ struct Directory
     DirectoryEntry entry[0];
 };
 
+//
+// An entry in the RAM index of directory entries, hashed by name and parent directory.
+// Free slots have a NULL dirent and a zero hash. Slots of removed entries have a NULL dirent and a non-zero hash.
+//
+struct DirectoryIndexEntry
+{
+    DirectoryEntry *dirent;                     // The indexed directory entry, in FLASH.
+    uint16_t parent;                            // First block of the directory holding the entry.
+    uint16_t hash;                              // Hash of the entry's name and parent.
+};
+
 //
 // A FileDescriptor holds contextual information needed for each OPEN file.
 //
@@ -112,8 +130,15 @@ struct FileDescriptor
     FileDescriptor *next;
 
     // Optional writeback cache, to minimise FLASH write operations at the expense of RAM.
+    // Allocated from the shared cache pool, or NULL if this file is not cached.
     uint16_t cacheLength;
-    uint8_t cache[MBFS_CACHE_SIZE];
+    uint16_t cacheSize;
+    uint8_t *cache;
+
+    // The most recently used position in this file's block chain, to avoid walking the chain from its start on every access.
+    // block is the physical block holding the logical block at index blockIndex.
+    uint16_t blockIndex;
+    uint16_t block;
 };
 
 /**
@@ -151,12 +176,35 @@ class MicroBitFileSystem
     // Cache of the last block allocated. Used to enable round robin use of blocks.
     uint16_t lastBlockAllocated;
 
+    // Bitmap of blocks marked as UNUSED in the file table, to enable fast allocation. Rebuilt whenever the file table is loaded or recycled.
+    uint32_t *freeBlockMap;
+
+    // Bitmap of physical pages whose DELETED blocks are known to be erased, so the page can be reused without an erase.
+    uint32_t *erasedPageMap;
+
+    // Number of blocks marked as UNUSED in the file table.
+    uint16_t freeBlockCount;
+
+    // Number of blocks marked as DELETED in the file table. These can be reused once the file table is recycled.
+    uint16_t deletedBlockCount;
+
     // Reference to the root directory of the file system.
     DirectoryEntry *rootDirectory;
 
     // Chain of open files.
     FileDescriptor *openFiles;
 
+    // Pool of RAM shared by all writeback caches, and a bitmap of the buffers in use.
+    uint8_t *cachePool;
+    uint32_t cachePoolUsed;
+
+    // Open addressed hash table of all directory entries, valid while MBFS_STATUS_INDEXED is set.
+    DirectoryIndexEntry *directoryIndex;
+
+    // Number of times each physical page of the file system has been erased, and the number of erases since these were last saved.
+    uint16_t *eraseCounts;
+    uint16_t erasesSinceSave;
+
     /**
       * Initialize the flash storage system
       *
@@ -174,7 +222,7 @@ class MicroBitFileSystem
     /**
       * Attempts to detect and load an existing file system.
       *
-      * @return MICROBIT_OK on success, or MICROBIT_NO_DATA if the file system could not be found.
+      * @return MICROBIT_OK on success, MICROBIT_NO_DATA if the file system could not be found, or MICROBIT_NO_RESOURCES if memory could not be allocated.
       */
     int load();
 
@@ -247,6 +295,99 @@ class MicroBitFileSystem
     */
     int recycleFileTable();
 
+    /**
+    * Determine if a physical page holds no live data, and so can be used as scratch space.
+    *
+    * @param page The first block of the page.
+    * @param erased Set to true if the page is known to be erased, false if it would need erasing before use.
+    * @return true if none of the blocks on the page are in use.
+    */
+    bool isPageFree(uint16_t page, bool &erased);
+
+    /**
+    * Record whether the DELETED blocks on a physical page are known to be erased.
+    *
+    * @param address Any address within the page.
+    * @param erased true if the page has just been erased or recycled, false if it may now contain stale data.
+    */
+    void setPageErased(void *address, bool erased);
+
+    /**
+    * Perform a single step of background garbage collection, keeping MBFS_ERASED_PAGE_POOL_SIZE erased pages in reserve
+    * and, once at least MBFS_GC_THRESHOLD blocks are DELETED, compacting them so they can be reused.
+    *
+    * @return true if any work was performed, false if there is nothing left to do.
+    */
+    bool collectGarbage();
+
+    /**
+    * Fiber that performs background garbage collection until there is no more work to do.
+    *
+    * @param fs The MicroBitFileSystem to collect garbage for.
+    */
+    static void collectionTask(void *fs);
+
+    /**
+    * Start the background garbage collection fiber, if it is not already running.
+    */
+    void startGarbageCollection();
+
+    /**
+    * Erase a physical page, updating its erase counter if it is part of the file system.
+    *
+    * @param page The address of the page to erase.
+    */
+    void erasePage(uint32_t *page);
+
+    /**
+    * Update the erase counter of a physical page, if it is part of the file system.
+    *
+    * @param page The address of a page that has been erased.
+    */
+    void recordErase(uint32_t *page);
+
+    /**
+    * Allocate the per-page erase counters, and load any previously saved values from FLASH.
+    *
+    * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the counters could not be allocated.
+    */
+    int loadEraseCounts();
+
+    /**
+    * Save the per-page erase counters to FLASH.
+    * A fresh block is written each time, so that saving does not itself require a page erase.
+    *
+    * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the file system is full.
+    */
+    int saveEraseCounts();
+
+    /**
+    * Save the erase counters if enough erases have occured since the last save, and if the difference in wear
+    * between pages exceeds MBFS_WEAR_LEVELLING_THRESHOLD, migrate a file off the least worn page holding data.
+    * Only called when no internal operation is in progress.
+    */
+    void levelWear();
+
+    /**
+    * Search a directory (and any subdirectories) for a closed regular file holding a block on the given page.
+    *
+    * @param directory The directory to search.
+    * @param page The first block of the page of interest.
+    * @param parent Set to the directory holding the returned file.
+    * @return The DirectoryEntry of a matching file, or NULL if none was found.
+    */
+    DirectoryEntry* findFileOnPage(DirectoryEntry *directory, uint16_t page, DirectoryEntry **parent);
+
+    /**
+    * Copy a closed regular file into freshly allocated blocks, avoiding the given page, and delete the original.
+    *
+    * @param dirent The DirectoryEntry of the file to move.
+    * @param directory The directory holding the file.
+    * @param avoid The first block of a page that the file should be moved off.
+    * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the file system is full.
+    */
+    int migrateFile(DirectoryEntry *dirent, DirectoryEntry *directory, uint16_t avoid);
+
     /**
     * Retrieve a memory pointer for the start of the physical memory page containing the given block.
     *
@@ -274,6 +415,20 @@ class MicroBitFileSystem
     */
     uint16_t getNextFileBlock(uint16_t block);
 
+    /**
+    * Retrieve the block of a file holding the given byte position, walking the block chain
+    * from the file's most recently used block where possible.
+    *
+    * n.b. A position on a block boundary resolves to the end of the preceding block.
+    *
+    * @param file The file descriptor of the file.
+    * @param position The byte position within the file.
+    * @param offset Set to the byte offset of the position within the returned block.
+    *
+    * @return The block number holding the given position.
+    */
+    uint16_t getFileBlock(FileDescriptor *file, uint32_t position, uint32_t &offset);
+
     /**
     * Determine the logical block that contains the given address.
     *
@@ -299,6 +454,54 @@ class MicroBitFileSystem
     */
     int fileTableWrite(uint16_t block, uint16_t value);
 
+    /**
+    * Rebuild the bitmap of free blocks and the free/deleted block counts from the file table.
+    *
+    * The bitmap of erased pages is allocated on first use too.
+    *
+    * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if either bitmap could not be allocated.
+    */
+    int rebuildFreeBlockMap();
+
+    /**
+    * Calculate the index hash of a directory entry.
+    *
+    * @param name The name of the entry. Only the first MBFS_FILENAME_LENGTH characters are used.
+    * @param parent The first block of the directory holding the entry.
+    * @return A non-zero hash value.
+    */
+    uint16_t getDirectoryHash(char const *name, uint16_t parent);
+
+    /**
+    * Rebuild the RAM index of directory entries, by walking every directory in the file system.
+    * If the index cannot hold every entry, it is disabled and lookups fall back to scanning FLASH.
+    */
+    void rebuildDirectoryIndex();
+
+    /**
+    * Add all of the entries in the given directory (and any subdirectories) to the directory index.
+    *
+    * @param directory The directory to index.
+    */
+    void indexDirectory(DirectoryEntry *directory);
+
+    /**
+    * Add a directory entry to the directory index.
+    * If the index is full, it is disabled and lookups fall back to scanning FLASH.
+    *
+    * @param dirent The entry to add.
+    * @param directory The directory holding the entry.
+    */
+    void indexAdd(DirectoryEntry *dirent, const DirectoryEntry *directory);
+
+    /**
+    * Remove a directory entry from the directory index.
+    *
+    * @param dirent The entry to remove.
+    * @param directory The directory holding the entry.
+    */
+    void indexRemove(DirectoryEntry *dirent, const DirectoryEntry *directory);
+
     /**
     * Searches the list of open files for one with the given identifier.
     *
@@ -311,7 +514,7 @@ class MicroBitFileSystem
     /**
     * Initialises a new file system
     *
-    * @return MICROBIT_OK on success, or an error code.
+    * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if memory could not be allocated.
     */
     int format();
 
@@ -334,6 +537,41 @@ class MicroBitFileSystem
       */
     int writeBuffer(FileDescriptor *file, uint8_t* buffer, int length);
 
+    /**
+      * Allocate a writeback cache buffer for the given file from the shared pool, if one is available.
+      *
+      * @param file FileDescriptor of the file to cache.
+      * @param size The requested size of the cache, in bytes. Limited to MBFS_BLOCK_SIZE.
+      */
+    void allocateCache(FileDescriptor *file, int size);
+
+    /**
+      * Remove a block from the pool of free blocks, ahead of it being recorded in the file table by commitBlocks().
+      *
+      * @param block The UNUSED block to reserve.
+      */
+    void reserveBlock(uint16_t block);
+
+    /**
+      * Record a chain of reserved blocks in the file table, appending them after the given block.
+      *
+      * The entries for the new blocks are written first, in as few FLASH operations as possible, and the chain is
+      * then linked into the file with a single entry update. If power is lost before this point, the file is unchanged.
+      *
+      * @param tail The current last block of the file.
+      * @param blocks The blocks to append, in order.
+      * @param count The number of blocks to append.
+      */
+    void commitBlocks(uint16_t tail, uint16_t *blocks, int count);
+
+    /**
+      * Return any writeback cache buffer held by the given file to the shared pool.
+      * Any cached data must have already been written back.
+      *
+      * @param file FileDescriptor of the file.
+      */
+    void releaseCache(FileDescriptor *file);
+
 
     /**
      * Determines if the given filename is a valid filename for use in MicroBitFileSystem. 
@@ -360,12 +598,15 @@ class MicroBitFileSystem
       *  - MB_READ : read from the file.
       *  - MB_WRITE : write to the file.
       *  - MB_CREAT : create a new file, if it doesn't already exist.
+      *  - MB_CACHED : coalesce small writes in a RAM writeback cache, flushed on close(), flush(), seek() and read().
       *
       * If a file is opened that doesn't exist, and MB_CREAT isn't passed,
       * an error is returned, otherwise the file is created.
       *
       * @param filename name of the file to open, must contain only printable characters.
-      * @param flags One or more of MB_READ, MB_WRITE or MB_CREAT. 
+      * @param flags One or more of MB_READ, MB_WRITE, MB_CREAT or MB_CACHED.
+      * @param cacheSize The size of writeback cache to use, in bytes (up to MBFS_BLOCK_SIZE). If zero, a full block is used.
+      *        Only used if MB_CACHED is set, or MBFS_CACHE_SIZE is non-zero.
       * @return return the file handle,MICROBIT_NOT_SUPPORTED if the file system has
       *         not been initialised MICROBIT_INVALID_PARAMETER if the filename is
       *         too large, MICROBIT_NO_RESOURCES if the file system is full.
@@ -377,7 +618,7 @@ class MicroBitFileSystem
       *    print("file open error");
       * @endcode
       */
-    int open(char const * filename, uint32_t flags);
+    int open(char const * filename, uint32_t flags, int cacheSize = MBFS_CACHE_SIZE);
 
     /**
      * Writes back all state associated with the given file to FLASH memory, 
@@ -492,6 +733,28 @@ class MicroBitFileSystem
       */
     int read(int fd, uint8_t* buffer, int size);
 
+    /**
+      * Map file data in place, without copying it into RAM.
+      *
+      * Files are held in memory mapped FLASH, so their data can be read directly. This returns a pointer to the
+      * longest contiguous run of the file's data starting at the given offset. The seek position is not changed.
+      * The pointer remains valid until the file is written to, closed or removed.
+      *
+      * @param fd File handle, obtained with open()
+      * @param offset The byte offset in the file at which the run starts.
+      * @param length Set to the number of bytes of file data available at the returned pointer.
+      * @return A pointer to the file data in FLASH, or NULL if the file system is not initialised, the given
+      *         file handle is invalid, or offset is at or beyond the end of the file.
+      *
+      * @code
+      * MicroBitFileSystem f;
+      * int fd = f.open("samples.raw", MB_READ);
+      * uint32_t len;
+      * const uint8_t *data = f.map(fd, 0, &len);
+      * @endcode
+      */
+    const uint8_t* map(int fd, uint32_t offset, uint32_t *length);
+
     /**
       * Remove a file from the system, and free allocated assets
       * (including assigned blocks which are returned for use by other files).
@@ -517,6 +780,52 @@ class MicroBitFileSystem
     * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the path is invalid, or MICROBT_NO_RESOURCES if the FileSystem is full.
     */
     int createDirectory(char const *name);
+
+    /**
+    * Determines the amount of space available for new file data.
+    * This includes space held by deleted files, which is reclaimed automatically when needed.
+    *
+    * @return The number of bytes available, in units of MBFS_BLOCK_SIZE.
+    */
+    int getFreeSpace();
+};
+
+/**
+  * Iterates over the contiguous runs of an open file's data in FLASH, using MicroBitFileSystem::map().
+  *
+  * @code
+  * FileRunIterator runs(f, fd);
+  * uint32_t len;
+  * const uint8_t *data;
+  *
+  * while ((data = runs.next(&len)) != NULL)
+  *     process(data, len);
+  * @endcode
+  */
+class FileRunIterator
+{
+    MicroBitFileSystem &fs;
+    int fd;
+    uint32_t offset;
+
+    public:
+
+    /**
+      * Constructor.
+      *
+      * @param fs The file system holding the file.
+      * @param fd File handle, obtained with open()
+      * @param offset The byte offset in the file at which to start.
+      */
+    FileRunIterator(MicroBitFileSystem &fs, int fd, uint32_t offset = 0);
+
+    /**
+      * Retrieve the next run of file data.
+      *
+      * @param length Set to the number of bytes in the run.
+      * @return A pointer to the run in FLASH, or NULL if there is no more data.
+      */
+    const uint8_t* next(uint32_t *length);
 };
 
 } // namespace codal
@@ -45,6 +45,12 @@ class MicroBitFlash
     int need_erase(uint8_t* source, uint8_t* flash_addr, int len);
  
     public:
+
+    // Running totals of the bytes programmed and pages erased through any MicroBitFlash instance.
+    // Intended for benchmarking and diagnostics; these may be reset at any time.
+    static uint32_t bytesProgrammed;
+    static uint32_t pagesErased;
+
     /**
       * Default constructor.
       */
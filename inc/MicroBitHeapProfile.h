@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_HEAP_PROFILE_H
+#define MICROBIT_HEAP_PROFILE_H
+
+#include "MicroBitConfig.h"
+#include "codal-core/inc/driver-models/Serial.h"
+
+#define MICROBIT_ID_HEAP_PROFILE                    3037
+
+// Events, raised on MICROBIT_ID_HEAP_PROFILE.
+#define MICROBIT_HEAP_PROFILE_EVT_REPORT            1           // A periodic report is due.
+
+//
+// Allocation tags (if CONFIG_MICROBIT_HEAP_PROFILE is enabled), one for each subsystem instrumented.
+//
+#define MICROBIT_HEAP_TAG_LOG                       0           // MicroBitLog row, heading and column buffers.
+#define MICROBIT_HEAP_TAG_FSCACHE                   1           // FSCache pages, index and read ahead buffer.
+#define MICROBIT_HEAP_TAG_RADIO                     2           // MicroBitRadio FrameBuffer pools and queues.
+#define MICROBIT_HEAP_TAG_AUDIO                     3           // AudioBufferPool buffers (see below).
+#define MICROBIT_HEAP_TAG_PACKET_BUFFER             4           // PacketBuffer payloads and slabs.
+#define MICROBIT_HEAP_TAG_USER                      5           // The first tag free for application use.
+
+// The number of tags counted.
+#ifndef MICROBIT_HEAP_TAGS
+#define MICROBIT_HEAP_TAGS                          8
+#endif
+
+typedef struct {
+    uint32_t allocations;                                       // The number of successful allocations.
+    uint32_t frees;                                             // The number of blocks freed.
+    uint32_t failures;                                          // The number of allocations that failed.
+    uint32_t bytes;                                             // The number of bytes currently allocated, including heap headers.
+    uint32_t peakBytes;                                         // The most bytes allocated at once.
+    uint32_t failedBytes;                                       // The size of the last allocation that failed.
+} MicroBitHeapTagStats;
+
+typedef struct {
+    uint32_t size;                                              // The total size of the heap, in bytes.
+    uint32_t used;                                              // The bytes in use, including heap headers.
+    uint32_t free;                                              // The bytes free.
+    uint32_t largestFree;                                       // The largest allocation that could succeed, including its header.
+    uint32_t usedBlocks;                                        // The number of blocks in use.
+    uint32_t freeBlocks;                                        // The number of runs of free memory.
+    uint32_t highWater;                                         // The most bytes seen in use at once, by any sample of the heap.
+} MicroBitHeapStats;
+
+namespace codal
+{
+    /**
+     * Records an allocation made by a tagged call site. Safe to call from any context.
+     *
+     * @param tag the call site (one of MICROBIT_HEAP_TAG_*).
+     * @param ptr the block allocated, or NULL if the allocation failed.
+     * @param size the size requested, in bytes.
+     */
+    void microbit_heap_tag_alloc(int tag, void *ptr, uint32_t size);
+
+    /**
+     * Records that a block allocated by a tagged call site is about to be freed. Safe to call from any context.
+     *
+     * @param tag the call site (one of MICROBIT_HEAP_TAG_*), as given when the block was allocated.
+     * @param ptr the block, or NULL (which is ignored).
+     */
+    void microbit_heap_tag_free(int tag, void *ptr);
+
+    /**
+     * Walks the heap, measuring the memory in use and its fragmentation, and updates the high water mark.
+     * Interrupts are disabled during the walk, which visits every block.
+     *
+     * @param stats the structure to fill in.
+     * @return MICROBIT_OK on success, or MICROBIT_NOT_SUPPORTED if the CODAL heap allocator is not in use.
+     */
+    int microbit_heap_get_stats(MicroBitHeapStats &stats);
+
+    /**
+     * Provides the counters of a tagged call site.
+     *
+     * @param tag the call site (one of MICROBIT_HEAP_TAG_*).
+     * @param stats the structure to fill in.
+     * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the tag is out of range.
+     */
+    int microbit_heap_get_tag_stats(int tag, MicroBitHeapTagStats &stats);
+
+    /**
+     * Prints a report of the heap and of each tagged call site that has allocated memory to the given serial port.
+     *
+     * The output is a header line, "HEAP <size> <used> <free> <largest free> <used blocks> <free blocks> <high water>
+     * <fragmentation %>", followed by one line per tag of "TAG <name> <allocations> <frees> <failures> <bytes> <peak bytes>
+     * <last failed size>", and ends with "END". Fragmentation is the proportion of free memory outside the largest free block.
+     *
+     * @param serial the serial port to print to.
+     */
+    void microbit_heap_print(Serial &serial);
+
+    /**
+     * Prints a report with microbit_heap_print() periodically, from a fiber, to keep watch over a long running program.
+     *
+     * @param serial the serial port to print to.
+     * @param period the time between reports in milliseconds, or 0 to stop reporting.
+     * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if there is no message bus.
+     */
+    int microbit_heap_report_every(Serial &serial, uint32_t period);
+}
+
+//
+// Tagging macros, which compile to nothing unless CONFIG_MICROBIT_HEAP_PROFILE is enabled.
+// Blocks freed other than through a tagged call site (e.g. ManagedBuffers released downstream) are not counted as freed.
+//
+#if CONFIG_ENABLED(CONFIG_MICROBIT_HEAP_PROFILE)
+#define MICROBIT_HEAP_ALLOC(tag, ptr, size)         codal::microbit_heap_tag_alloc((tag), (void *) (ptr), (size))
+#define MICROBIT_HEAP_FREE(tag, ptr)                codal::microbit_heap_tag_free((tag), (void *) (ptr))
+#else
+#define MICROBIT_HEAP_ALLOC(tag, ptr, size)         ((void) 0)
+#define MICROBIT_HEAP_FREE(tag, ptr)                ((void) 0)
+#endif
+
+#endif
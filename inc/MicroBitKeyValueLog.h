@@ -0,0 +1,244 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_KEY_VALUE_LOG_H
+#define MICROBIT_KEY_VALUE_LOG_H
+
+#include "MicroBitConfig.h"
+#include "ManagedString.h"
+#include "NVMController.h"
+#include "ErrorNo.h"
+#include "codal-core/inc/drivers/KeyValueStorage.h"
+
+// Written to the first word of the page once it has been formatted as a log.
+#define MICROBIT_KEY_VALUE_LOG_MAGIC            0x4B564C31
+
+// The most keys that may be stored at once. Each takes 8 bytes of RAM for its index entry.
+#ifndef MICROBIT_KEY_VALUE_LOG_MAX_KEYS
+#define MICROBIT_KEY_VALUE_LOG_MAX_KEYS         32
+#endif
+
+// Record types, held in the header word of each record.
+#define MICROBIT_KEY_VALUE_LOG_TAG              0xC0DE0000
+#define MICROBIT_KEY_VALUE_LOG_TAG_MASK         0xFFFF0000
+#define MICROBIT_KEY_VALUE_LOG_VALUE            0x0100      // A new value for the key. The low byte holds its length.
+#define MICROBIT_KEY_VALUE_LOG_REMOVED          0x0200      // The key has been removed.
+#define MICROBIT_KEY_VALUE_LOG_TYPE_MASK        0xFF00
+
+namespace codal
+{
+
+/**
+  * A single record of the log, as held in flash.
+  */
+struct MicroBitKeyValueRecord
+{
+    uint32_t        header;                     // MICROBIT_KEY_VALUE_LOG_TAG | type | length, or 0xFFFFFFFF if unused.
+    KeyValuePair    pair;                       // The key, and (for a new value) the value.
+};
+
+/**
+  * Class definition for MicroBitKeyValueLog.
+  *
+  * A drop in replacement for KeyValueStorage (see CONFIG_MICROBIT_STORAGE_LOG), holding its pairs as an append only log
+  * in a single page of flash. Each put() or remove() appends a record to the log, so no page is erased until the log
+  * fills, at which point the live records are compacted back into the page. An index of the live keys is rebuilt in RAM
+  * the first time the store is used, so lookups read only the record they need.
+  */
+class MicroBitKeyValueLog
+{
+    struct IndexEntry
+    {
+        uint32_t    hash;                       // The hash of the key.
+        uint32_t    offset;                     // The offset of its latest record from the start of the page.
+    };
+
+    NVMController   &controller;                // The flash we live in.
+    uint32_t        pageAddress;                // The address of our page.
+    uint32_t        end;                        // The offset of the first unused record.
+    int             keys;                       // The number of live keys.
+    bool            loaded;                     // true once the index has been built.
+    IndexEntry      index[MICROBIT_KEY_VALUE_LOG_MAX_KEYS];
+
+    public:
+
+    /**
+      * Constructor.
+      *
+      * Creates an instance of MicroBitKeyValueLog, which acts like a KeyValueStorage that allows user code to store
+      * and retrieve key value pairs in non-volatile memory.
+      *
+      * @param controller The non-volatile memory controller to use.
+      * @param pageNumber The page of the controller to hold the log, counting from the start of its memory. Defaults to 0.
+      */
+    MicroBitKeyValueLog(NVMController &controller, int pageNumber = 0);
+
+    /**
+      * Places a given key, and it's corresponding value into flash at the earliest
+      * available point.
+      *
+      * @param key the unique name that should be used as an identifier for the given data.
+      *            The key is presumed to be null terminated.
+      *
+      * @param data a pointer to the beginning of the data to be persisted.
+      *
+      * @param dataSize the size of the data to be persisted
+      *
+      * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the key or size is too large,
+      *         MICROBIT_NO_RESOURCES if the storage page is full
+      */
+    int put(const char *key, uint8_t *data, int dataSize);
+
+    /**
+      * Places a given key, and it's corresponding value into flash at the earliest
+      * available point.
+      *
+      * @param key the unique name that should be used as an identifier for the given data.
+      *
+      * @param data a pointer to the beginning of the data to be persisted.
+      *
+      * @param dataSize the size of the data to be persisted
+      *
+      * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the key or size is too large,
+      *         MICROBIT_NO_RESOURCES if the storage page is full
+      */
+    int put(ManagedString key, uint8_t *data, int dataSize);
+
+    /**
+      * Retreives a KeyValuePair identified by a given key.
+      *
+      * @param key the unique name used to identify a KeyValuePair in flash.
+      *
+      * @return a pointer to a heap allocated KeyValuePair struct, this pointer will be
+      *         NULL if the key was not found in storage.
+      *
+      * @note it is up to the user to free memory after use.
+      */
+    KeyValuePair *get(const char *key);
+
+    /**
+      * Retreives a KeyValuePair identified by a given key.
+      *
+      * @param key the unique name used to identify a KeyValuePair in flash.
+      *
+      * @return a pointer to a heap allocated KeyValuePair struct, this pointer will be
+      *         NULL if the key was not found in storage.
+      *
+      * @note it is up to the user to free memory after use.
+      */
+    KeyValuePair *get(ManagedString key);
+
+    /**
+      * Removes a KeyValuePair identified by a given key.
+      *
+      * @param key the unique name used to identify a KeyValuePair in flash.
+      *
+      * @return MICROBIT_OK on success, or MICROBIT_NO_DATA if the given key
+      *         was not found in flash.
+      */
+    int remove(const char *key);
+
+    /**
+      * Removes a KeyValuePair identified by a given key.
+      *
+      * @param key the unique name used to identify a KeyValuePair in flash.
+      *
+      * @return MICROBIT_OK on success, or MICROBIT_NO_DATA if the given key
+      *         was not found in flash.
+      */
+    int remove(ManagedString key);
+
+    /**
+      * The size of the flash based KeyValueStore.
+      *
+      * @return the number of entries in the key value store
+      */
+    int size();
+
+    /**
+      * Erase all contents of this KeyValue store.
+      *
+      * @return MICROBIT_OK on success, or an error code from the flash controller.
+      */
+    int wipe();
+
+    private:
+
+    /**
+      * Builds the index of live keys from the log, formatting the page first if it doesn't hold one.
+      */
+    void load();
+
+    /**
+      * Erases our page, and writes the log header to it.
+      */
+    int format();
+
+    /**
+      * Locates the index entry of a key.
+      *
+      * @param key the key, null padded to KEY_VALUE_STORAGE_KEY_SIZE bytes.
+      * @param hash the hash of the key.
+      *
+      * @return the position of the key in the index, or -1 if it is not stored.
+      */
+    int find(const uint8_t *key, uint32_t hash);
+
+    /**
+      * Appends a record to the log, compacting the log first if it is full.
+      *
+      * @param record the record to append.
+      * @param offset set to the offset of the record from the start of the page.
+      *
+      * @return MICROBIT_OK on success, MICROBIT_NO_RESOURCES if there is no room even after compaction,
+      *         or an error code from the flash controller.
+      */
+    int append(MicroBitKeyValueRecord &record, uint32_t &offset);
+
+    /**
+      * Rewrites the page to hold only the latest record of each live key.
+      */
+    int compact();
+
+    /**
+      * Determines if the record at the given offset is free to be written, i.e. still erased.
+      */
+    bool isFree(uint32_t offset);
+
+    /**
+      * Converts a key into its null padded form.
+      *
+      * @return true on success, false if the key is too long.
+      */
+    static bool padKey(const char *key, uint8_t *padded);
+
+    /**
+      * Computes the hash of a null padded key (32 bit FNV-1a).
+      */
+    static uint32_t hash(const uint8_t *key);
+};
+
+}
+
+#endif
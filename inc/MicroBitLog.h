@@ -118,6 +118,58 @@ DEALINGS IN THE SOFTWARE.
 #define CONFIG_MICROBIT_LOG_INVALID_CHAR_VALUE  '_'
 #endif
 
+#ifndef CONFIG_MICROBIT_LOG_ROW_INDEX_SIZE
+#define CONFIG_MICROBIT_LOG_ROW_INDEX_SIZE      64
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_ROW_INDEX_STRIDE
+#define CONFIG_MICROBIT_LOG_ROW_INDEX_STRIDE    16
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT
+#define CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT       1000
+#endif
+
+// Power aware buffering. See MicroBitLog::setPowerAware(). While the supply is healthy, buffered data is held for up to
+// CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT milliseconds. Once the battery falls below CONFIG_MICROBIT_LOG_LOW_BATTERY
+// microvolts, every row is committed as it is written, until the battery recovers by CONFIG_MICROBIT_LOG_LOW_BATTERY_HYSTERESIS.
+#ifndef CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT
+#define CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT   10000
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_LOW_BATTERY
+#define CONFIG_MICROBIT_LOG_LOW_BATTERY         2400000
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_LOW_BATTERY_HYSTERESIS
+#define CONFIG_MICROBIT_LOG_LOW_BATTERY_HYSTERESIS  100000
+#endif
+
+// The minimum time (in milliseconds) between checks of the supply, each of which queries the interface chip.
+#ifndef CONFIG_MICROBIT_LOG_POWER_CHECK_PERIOD
+#define CONFIG_MICROBIT_LOG_POWER_CHECK_PERIOD  1000
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE
+#define CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE     64
+#endif
+
+#ifndef CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE
+#define CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE  512
+#endif
+
+// The number of leading columns whose values may be delta encoded, when compression is enabled (at most 32).
+#ifndef CONFIG_MICROBIT_LOG_DELTA_COLUMNS
+#define CONFIG_MICROBIT_LOG_DELTA_COLUMNS       16
+#endif
+
+#if CONFIG_MICROBIT_LOG_DELTA_COLUMNS > 32
+#error "CONFIG_MICROBIT_LOG_DELTA_COLUMNS must be no more than 32"
+#endif
+
+#define MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE   32
+#define MICROBIT_LOG_TIMESTAMP_MAX_LENGTH   24
+
 #define MICROBIT_LOG_VERSION                "UBIT_LOG_FS_V_002\n"           // MUST be 18 characters.
 #define MICROBIT_LOG_JOURNAL_ENTRY_SIZE     8
 
@@ -125,9 +177,44 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_LOG_STATUS_ROW_STARTED     0x0002
 #define MICROBIT_LOG_STATUS_FULL            0x0004
 #define MICROBIT_LOG_STATUS_SERIAL_MIRROR   0x0008
+#define MICROBIT_LOG_STATUS_BUFFERED        0x0010
+#define MICROBIT_LOG_STATUS_BINARY          0x0020
+#define MICROBIT_LOG_STATUS_RING            0x0040
+#define MICROBIT_LOG_STATUS_ERASING         0x0080
+#define MICROBIT_LOG_STATUS_COMPRESSED      0x0100
+#define MICROBIT_LOG_STATUS_POWER_AWARE     0x0200
+#define MICROBIT_LOG_STATUS_POWER_LOW       0x0400
 
 
 #define MICROBIT_LOG_EVT_LOG_FULL           1
+#define MICROBIT_LOG_EVT_FLUSH              2
+#define MICROBIT_LOG_EVT_ERASE_COMPLETE     3
+#define MICROBIT_LOG_EVT_LOW_POWER          4       // The battery has fallen below CONFIG_MICROBIT_LOG_LOW_BATTERY, and buffered data has been committed.
+
+//
+// Binary record format.
+// A binary record is a row starting with MICROBIT_LOG_RECORD_START, and terminated with a newline like any other row.
+// Each value is encoded as one or more 5 bit digits (most significant first), optionally preceded by a type marker.
+// Signed values are zigzag encoded. No byte of a record can be confused with a separator or unused (0xFF) memory.
+// When compression is enabled, values may instead be stored relative to the previous value in the same column, and
+// timestamps relative to the previous interval between timestamps, with small changes taking a single byte.
+// As with timestamps, the first value of each column in a cache block is always stored in full.
+//
+#define MICROBIT_LOG_RECORD_START                   0x01
+#define MICROBIT_LOG_RECORD_EMPTY                   0x02
+#define MICROBIT_LOG_RECORD_TIME                    0x03    // Absolute timestamp, no fractional part.
+#define MICROBIT_LOG_RECORD_TIME_FRACTION           0x04    // Absolute timestamp, in hundredths.
+#define MICROBIT_LOG_RECORD_TIME_DELTA              0x05    // Timestamp relative to the previous timestamp, no fractional part.
+#define MICROBIT_LOG_RECORD_TIME_DELTA_FRACTION     0x06    // Timestamp relative to the previous timestamp, in hundredths.
+#define MICROBIT_LOG_RECORD_DELTA                   0x07    // Value relative to the previous value in this column, with the same decimal places.
+#define MICROBIT_LOG_RECORD_SMALL_DELTA             0x80    // MICROBIT_LOG_RECORD_SMALL_DELTA + n: as MICROBIT_LOG_RECORD_DELTA by zigzag value n (0..63),
+                                                            // or for a timestamp, an interval that differs from the previous interval by n. No digits follow.
+#define MICROBIT_LOG_RECORD_SMALL_DELTA_RANGE       0x40
+#define MICROBIT_LOG_RECORD_FIXED                   0x10    // MICROBIT_LOG_RECORD_FIXED + n: Fixed point value with n decimal places (1..9).
+#define MICROBIT_LOG_RECORD_DIGIT                   0x40
+#define MICROBIT_LOG_RECORD_DIGIT_MORE              0x20
+#define MICROBIT_LOG_RECORD_MAX_FIELD_LENGTH        14
+#define MICROBIT_LOG_DECODE_MAX_LENGTH              32
 
 namespace codal
 {
@@ -146,6 +233,13 @@ namespace codal
         ManagedString value;
     };
 
+    class ColumnHandle
+    {
+        public:
+        ManagedString key;
+        uint32_t column;
+    };
+
     
     enum class TimeStampFormat
     {
@@ -184,6 +278,89 @@ namespace codal
     };
 
 
+    /**
+     * Streaming decoder, used to expand binary records into CSV text.
+     * Text rows are passed through unchanged.
+     */
+    class MicroBitLogDecoder
+    {
+        bool        record;                 // true if we are currently decoding a binary record.
+        bool        lineStart;              // true if the next byte is the first byte of a row.
+        uint32_t    field;                  // The number of fields decoded in the current record.
+        uint8_t     type;                   // The type marker for the value currently being decoded.
+        uint64_t    value;                  // The value currently being decoded.
+        uint64_t    timeStamp;              // The most recently decoded timestamp.
+        int64_t     interval;               // The most recently decoded interval between timestamps.
+        int32_t     timeColumn;             // The column holding timestamps, or -1 if none has been decoded.
+        bool        timeFraction;           // true if timestamps have a fractional part.
+        uint32_t    valid;                  // Bitmask of the columns with an entry in values.
+        int32_t     values[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];      // The most recently decoded value of each column.
+        uint8_t     decimals[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];    // The number of decimal places of each of those values.
+
+        /**
+         * Record the value just decoded for the given column, and expand it to CSV text.
+         */
+        int expandValue(uint32_t column, int64_t v, int places, char *out);
+
+        public:
+
+        /**
+         * Reset the decoder, ready to decode from the start of a row.
+         */
+        void reset();
+
+        /**
+         * Decode a single byte of stored log data, generating the equivalent CSV text.
+         *
+         * @param b the next byte of stored data.
+         * @param out a buffer of at least MICROBIT_LOG_DECODE_MAX_LENGTH bytes, into which any CSV text is written.
+         * @return the number of bytes of CSV text generated.
+         */
+        int decode(uint8_t b, char *out);
+    };
+
+    class MicroBitLog;
+
+    /**
+     * A cursor over a range of rows in a MicroBitLog, obtained from MicroBitLog::getRowCursor().
+     * Rows are streamed out of storage in caller sized chunks, so arbitrarily large ranges can be read with bounded RAM use.
+     * Any binary records are expanded to CSV text.
+     *
+     * A cursor becomes invalid if the log is cleared, or if a ring log overwrites the data it refers to.
+     */
+    class LogCursor
+    {
+        friend class MicroBitLog;
+
+        MicroBitLog         *log;                   // The log this cursor reads from, or NULL if the cursor is unused.
+        uint32_t            generation;             // The generation of the log when this cursor was created.
+        uint32_t            address;                // Logical address of the next byte of stored data to read.
+        uint32_t            start;                  // Logical address of the first byte of stored data to return.
+        uint32_t            end;                    // Logical address of the end of the range.
+        bool                decode;                 // true if stored data needs to be expanded into CSV text.
+        MicroBitLogDecoder  decoder;                // Decoder state, used if decode is set.
+        char                pending[MICROBIT_LOG_DECODE_MAX_LENGTH * 2]; // CSV text decoded, but not yet returned.
+        uint8_t             pendingLength;          // The number of bytes in pending.
+        uint8_t             pendingPosition;        // The number of bytes in pending already returned.
+
+        public:
+
+        /**
+         * Constructor.
+         * Creates an empty cursor. Use MicroBitLog::getRowCursor() to obtain a cursor over a log.
+         */
+        LogCursor();
+
+        /**
+         * Read the next chunk of data from the log.
+         *
+         * @param buffer the buffer to fill.
+         * @param len the maximum number of bytes to read.
+         * @return the number of bytes read, zero if no more data is available, or DEVICE_INVALID_STATE if the cursor is no longer valid.
+         */
+        int next(void *buffer, uint32_t len);
+    };
+
     enum class DataFormat
     {
         HTMLHeader = 0,   // The HTML header without the data
@@ -195,14 +372,16 @@ namespace codal
      * Class definition for MicroBitLog. A simple text only, append only, single file log file system.
      * Also contains a key/value pair abstraction to enable dynamic creation of CSV based logfiles.
      */
-    class MicroBitLog 
+    class MicroBitLog : public CodalComponent
     {
+        friend class LogCursor;
+
         private:
         MicroBitUSBFlashManager         &flash;             // Non-volatile memory controller to use for storage.
-        MicroBitPowerManager            &power;             // To obtain the Interface chip firmware (DAPLink) version.
+        MicroBitPowerManager            &power;             // To obtain the Interface chip firmware (DAPLink) version, and the state of the power supply.
         NRF52Serial                     &serial;            // Reference to serial port used for data mirroring.
         FSCache                         cache;              // Write through RAM cache.
-        uint32_t                        status;             // Status flags.
+        uint32_t                        logStatus;          // Status flags (MICROBIT_LOG_STATUS_*), kept apart from those of CodalComponent.
         FiberLock                       mutex;              // Mutual exclusion primitive to serialise APi calls.
 
         uint32_t                        startAddress;       // Logical address of the start of the Log file system.
@@ -211,6 +390,10 @@ namespace codal
         uint32_t                        journalHead;        // Logical address of the last valid journal entry.
         uint32_t                        dataStart;          // Logical address of the start of the Data section.
         uint32_t                        dataEnd;            // Logical address of the end of valid data.
+        uint32_t                        dataHead;           // Logical address of the oldest valid row. Equal to dataStart, unless a ring log has wrapped.
+        uint32_t                        eraseAddress;       // Physical address of the next page to be erased by a background erase.
+        uint32_t                        eraseEnd;           // Physical address of the last page to be erased by a background erase.
+        uint32_t                        generation;         // Incremented each time the log is cleared, used to invalidate any LogCursor.
         uint32_t                        logEnd;             // Logical address of the end of the file system space.
         uint32_t                        headingStart;       // Logical address of the start of the column header data. Zero if no data is present.
         uint32_t                        headingLength;      // The length (in bytes) of the column header data.
@@ -223,6 +406,48 @@ namespace codal
         TimeStampFormat                 timeStampFormat;    // The format of timestamp to log on each row.
         ManagedString                   timeStampHeading;   // The title of the timestamp column, including units.
 
+        uint32_t                        *rowIndex;          // Sparse row index. Entry i holds the logical address of the start of row (i * rowIndexStride).
+        uint32_t                        rowIndexLength;     // The number of valid entries in the row index.
+        uint32_t                        rowIndexStride;     // The number of rows between consecutive row index entries.
+        uint32_t                        rowCount;           // The total number of complete (newline terminated) rows in the log.
+        bool                            rowIndexValid;      // Flag to indicate if the row index reflects the current contents of the log.
+
+        uint8_t                         *writeBuffer;       // RAM append buffer used to group commit rows, when buffered mode is enabled.
+        uint32_t                        writeBufferLength;  // The number of bytes held in the write buffer, awaiting commit to persistent storage.
+        uint32_t                        flushTimeout;       // The time (in milliseconds) after which buffered and cached data is committed.
+        CODAL_TIMESTAMP                 powerCheckTime;     // The time the supply was last checked, when power aware buffering is enabled.
+
+        char                            *rowBuffer;         // Scratch buffer used to serialize rows and headers.
+        uint32_t                        rowBufferSize;      // The size of the scratch buffer, in bytes.
+
+        uint32_t                        lastColumn;         // The index of the most recently matched column. Used to optimise column lookup.
+        ColumnHandle*                   columnHandles;      // Collection of column handles issued by getColumnHandle().
+        uint32_t                        columnHandleCount;  // The number of column handles issued.
+
+        uint8_t                         *mirrorBuffer;      // Ring buffer of text waiting to be mirrored to the serial port.
+        uint32_t                        mirrorHead;         // Index in mirrorBuffer at which the next byte will be queued.
+        uint32_t                        mirrorTail;         // Index in mirrorBuffer of the next byte to be sent.
+        uint32_t                        mirrorDropped;      // The number of rows not mirrored, due to lack of buffer space.
+
+        uint32_t                        expandedLength;     // The number of additional bytes needed to expand stored binary records to CSV. Valid if rowIndexValid is set.
+        uint32_t                        lastRecordBlock;    // The cache block containing the most recent timestamped binary record.
+        uint64_t                        lastRecordTimeStamp;// The timestamp of the most recent timestamped binary record.
+        int64_t                         lastRecordInterval; // The interval between the timestamps of the two most recent timestamped binary records.
+        bool                            lastRecordIntervalValid; // true if lastRecordInterval was recorded in lastRecordBlock.
+        bool                            lastRecordFraction; // true if the most recent timestamp was recorded with a fractional part.
+        uint32_t                        lastValueBlock;     // The cache block containing the most recent binary record.
+        uint32_t                        lastValueMask;      // Bitmask of the columns with an entry in lastValues.
+        int32_t                         lastValues[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];  // The most recently recorded value of each column.
+        uint8_t                         lastDecimals[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];// The number of decimal places of each of those values.
+
+        MicroBitLogDecoder              readDecoder;        // State of the most recent expanded read, used to optimise sequential reads.
+        uint32_t                        readAddress;        // Logical address of the next byte to be decoded by readDecoder.
+        uint32_t                        readIndex;          // Offset into the expanded CSV text of readPending[readPendingPosition].
+        char                            readPending[MICROBIT_LOG_DECODE_MAX_LENGTH]; // Most recently decoded CSV text.
+        uint8_t                         readPendingLength;  // The number of bytes in readPending.
+        uint8_t                         readPendingPosition;// The number of bytes in readPending already consumed.
+        bool                            readValid;          // true if the read state above is valid.
+
         const static uint8_t            header[2048];       // static header to prepend to FS in physical storage.
 
         public:
@@ -266,9 +491,15 @@ namespace codal
          * A full erase option is is supported that elimates all trace of user data, but this is not recommended
          * unless strictly necessary as it will take a long time to complete and promotes excessive flash wear.
          *
+         * A full erase can optionally be performed in the background. In this case only the FS metadata and the first page
+         * of data are erased before this method returns, and the remaining pages are erased one at a time by a separate fiber.
+         * New data can be logged immediately, as pages ahead of the write head are always erased before use.
+         * A MICROBIT_LOG_EVT_ERASE_COMPLETE event is raised when the background erase completes.
+         *
          * @param fullErase if set to true, all data will be hard erased from storage.
+         * @param background if set to true, a full erase is completed in the background. Ignored unless fullErase is set.
          */
-        void clear(bool fullErase = CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT);
+        void clear(bool fullErase = CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT, bool background = false);
 
         /**
          * Marks an existing Log as invalid. The log will be cleared with the default settings the next time
@@ -289,10 +520,104 @@ namespace codal
         /**
          * Defines if data logging should also be streamed over the serial port.
          *
+         * Mirrored rows are queued in a RAM buffer of CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE bytes, and sent in the background
+         * as space becomes available in the serial transmit buffer, so logging never waits for the serial port.
+         * If the buffer is full, the row is not mirrored (it is still logged), and the overflow count is incremented.
+         *
          * @param enable True to enable serial port streaming, false to disable.
          */
         void setSerialMirroring(bool enable);
 
+        /**
+         * Determines the number of rows that could not be mirrored to the serial port, as the mirror buffer was full.
+         *
+         * @return the number of rows dropped since the device started.
+         */
+        uint32_t getMirrorOverflowCount();
+
+        /**
+         * Defines if rows should be stored as compact binary records, rather than CSV text.
+         * Rows containing only empty cells, integers and decimal numbers (in canonical form) are stored as binary records,
+         * with timestamps delta encoded. Any other row is stored as CSV text as usual.
+         *
+         * Binary records are transparently expanded to CSV by readData(), getDataLength() and getRows(),
+         * but are not human readable when MY_DATA.HTM is viewed directly from the MICROBIT drive.
+         *
+         * @param enable True to enable binary records, false to disable.
+         */
+        void setBinaryFormat(bool enable);
+
+        /**
+         * Defines if binary records should be compressed, by storing values as the change from the previous value in the same
+         * column, and timestamps as the change in the interval between them. Small changes take a single byte each, which suits
+         * regularly logged, slowly changing sensor data. Enabling compression also enables binary records.
+         *
+         * Compressed records are expanded to exactly the same CSV text as uncompressed ones, and each cache block can
+         * still be decoded on its own, so reads from anywhere in the log are no more expensive than before.
+         *
+         * @param enable True to enable compression, false to disable.
+         */
+        void setCompression(bool enable);
+
+        /**
+         * Defines if logged data should be buffered in RAM before being committed to persistent storage.
+         * When enabled, rows are accumulated and committed as a single block aligned write with a single
+         * journal entry. This greatly increases sustained throughput, and reduces flash wear.
+         *
+         * Buffered data is committed when a cache block is filled, CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT milliseconds after
+         * the first pending write, when flush() is called, when the log is read, or when the device enters deep sleep.
+         *
+         * @note Data held in the buffer will be lost on a reset or loss of power. See setPowerAware().
+         *
+         * @param enable True to enable buffering, false to disable. Any buffered data is committed when buffering is disabled.
+         */
+        void setBuffered(bool enable);
+
+        /**
+         * Defines if buffering should adapt to the state of the power supply, trading throughput for durability only when needed.
+         *
+         * While running from USB, or from a healthy battery, buffered data is held for up to CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT
+         * milliseconds, so that rows are batched into as few flash commits as possible. If the battery falls below
+         * CONFIG_MICROBIT_LOG_LOW_BATTERY, anything buffered is committed at once, a MICROBIT_LOG_EVT_LOW_POWER event is raised,
+         * and each subsequent row is committed as it is written, so that a brown out loses at most the row being written.
+         *
+         * The supply is checked as rows are written, at most once every CONFIG_MICROBIT_LOG_POWER_CHECK_PERIOD milliseconds.
+         * This has no effect unless buffering is enabled with setBuffered().
+         *
+         * @param enable True to enable power aware buffering, false to use a fixed CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT.
+         */
+        void setPowerAware(bool enable);
+
+        /**
+         * Determines if the battery was low when the supply was last checked by power aware buffering.
+         *
+         * @return true if each row is being committed as it is written, because the battery is low.
+         */
+        bool isPowerLow();
+
+        /**
+         * Commits any data held in the RAM write buffer to persistent storage.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int flush();
+
+        /**
+         * Defines if the log should operate as a ring buffer.
+         * When enabled, the log never becomes full. Instead, once the data region has been filled, the oldest page of data
+         * is erased and reused each time the write head moves onto a new page. Only whole rows are returned by
+         * readData() and getRows(), starting from the oldest row that remains intact.
+         *
+         * Ring mode determines how stored data is interpreted, so should be set before any other operation on the log.
+         * A log that has already wrapped is detected automatically.
+         *
+         * @note When viewed directly through MY_DATA.HTM, a wrapped log shows only the data written since the last wrap.
+         *
+         * @param enable True to enable ring mode, false to disable.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if the data already stored cannot be interpreted in the requested mode.
+         */
+        int setRingMode(bool enable);
+
 
         /**
          * Creates a new row in the log, ready to be populated by logData()
@@ -319,6 +644,41 @@ namespace codal
          */
         int logData(ManagedString key, ManagedString value);
 
+        /**
+         * Obtains a handle for the given column, which can be used to efficiently log data via logData(int, ManagedString).
+         * If the column does not yet exist, it is created.
+         *
+         * @param key the name of the column.
+         * @return a non-negative handle for the column.
+         */
+        int getColumnHandle(ManagedString key);
+
+        /**
+         * Populates the current row with the given value, in the column identified by the given handle.
+         * This avoids the cost of locating the column by name, and is recommended for high rate logging.
+         *
+         * @param columnHandle a handle previously obtained from getColumnHandle().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the handle is not valid.
+         */
+        int logData(int columnHandle, ManagedString value);
+
+        /**
+         * Logs a block of complete rows of integer values, held as one array per column.
+         * The log is locked once for the whole block, and values are stored without the cleaning text values need.
+         *
+         * @param columnHandles the handles of the columns to populate, previously obtained from getColumnHandle().
+         * @param values an array of values for each column, indexed by row.
+         * @param columns the number of columns.
+         * @param rows the number of rows.
+         * @param times if not NULL, the time (in milliseconds) to record each row against in the timestamp column,
+         * if timestamps are enabled. Otherwise, rows are stamped with the current time.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if a handle is not valid, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int logRows(const int *columnHandles, const int32_t * const *values, int columns, int rows, const CODAL_TIMESTAMP *times = NULL);
+
         /**
          * Complete a row in the log, and pushes to persistent storage.
          * @return DEVICE_OK on success.
@@ -376,6 +736,26 @@ namespace codal
         */
         ManagedString getRows(uint32_t fromRowIndex, int nRows);
 
+        /**
+        * Get a cursor that streams the given range of rows, without copying the whole range into RAM.
+        * Unlike getRows(), every row returned (including the last) is terminated with a newline.
+        * @param fromRowIndex 0-based index of starting row.
+        * @param nRows number of rows to read from fromRowIndex, or a negative value to read to the end of the log.
+        * @return a LogCursor over the given range. The range is empty if fromRowIndex is beyond the end of the log.
+        */
+        LogCursor getRowCursor(uint32_t fromRowIndex = 0, int nRows = -1);
+
+        /**
+         * Perform functions related to deep sleep.
+         * Any buffered or cached data is committed to persistent storage before the device enters deep sleep.
+         */
+        virtual int deepSleepCallback(deepSleepCallbackReason reason, deepSleepCallbackData *data) override;
+
+        /**
+         * Periodic callback from the scheduler, used to send any queued serial mirror output.
+         */
+        virtual void idleCallback() override;
+
     private:
 
         /**
@@ -389,14 +769,23 @@ namespace codal
          */
         bool _isPresent();
         void _setVisibility(bool visible);
-        void _clear(bool fullErase = CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT);
+        void _clear(bool fullErase = CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT, bool background = false);
         void _invalidate();
         void _setTimeStamp(TimeStampFormat format);
         int _beginRow();
         int _endRow();
+        int _endRow(CODAL_TIMESTAMP time);
         int _logData(ManagedString key, ManagedString value);
+        int _logData(int columnHandle, ManagedString value);
+        int _findColumn(int columnHandle);
+        int _getColumnHandle(ManagedString key);
         int _logString(const char *s);
         int _logString(ManagedString s);
+        int _logString(const char *s, uint32_t len);
+        int _logRecord(const char *s, uint32_t len, const char *text, uint32_t textLength);
+        int _readExpanded(uint8_t *data, uint32_t index, uint32_t len);
+        int _flush();
+        void checkPower();
 
         int _readData(uint8_t *data, uint32_t index, uint32_t len, DataFormat format, uint32_t length);
         
@@ -414,6 +803,87 @@ namespace codal
          */
         int _readSource( uint8_t *&data, uint32_t &index, uint32_t &len, uint32_t &srcIndex, const void *srcPtr, uint32_t srcAddress, uint32_t srcLen);
 
+        /**
+         * Write the given data to the end of the log in persistent storage, and update the journal accordingly.
+         * The data is assumed to be clean, and to fit within the space available.
+         *
+         * @param data the data to write.
+         * @param len the number of bytes to write.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int _commit(const char *data, uint32_t len);
+
+        /**
+         * Provides a scratch buffer of at least the given size, used to serialize rows and headers.
+         * The buffer is retained between calls, and only reallocated if a larger buffer is needed.
+         *
+         * @param len the minimum size of the buffer, in bytes.
+         * @return a pointer to the scratch buffer.
+         */
+        char *getRowBuffer(uint32_t len);
+
+        /**
+         * Encode the current row as a binary record.
+         *
+         * @param buffer the buffer to encode into. Must be at least (headingCount * MICROBIT_LOG_RECORD_MAX_FIELD_LENGTH + 2) bytes long.
+         * @param timeStampColumn the index of the timestamp column, or -1 if no timestamp is to be recorded.
+         * @param timeStamp the timestamp to record.
+         * @return the length of the record, or 0 if the row contains values that cannot be represented in binary form.
+         */
+        uint32_t encodeRecord(uint8_t *buffer, int timeStampColumn, uint64_t timeStamp);
+
+        /**
+         * Expand the given range of stored log data into CSV text.
+         *
+         * @param start the logical address of the start of a row.
+         * @param end the logical address of the end of the range.
+         * @param out the buffer to write CSV text into, or NULL to simply calculate the length of the CSV text.
+         * @return the length of the CSV text.
+         */
+        uint32_t expandRange(uint32_t start, uint32_t end, char *out);
+
+        /**
+         * Determine where decoding must start, for binary records at the given address to be decoded correctly.
+         *
+         * @param address the logical address of the start of a row.
+         * @return the logical address of the start of a row from which decoding can begin.
+         */
+        uint32_t getDecodeStart(uint32_t address);
+
+        /**
+         * Queue the given row of text for mirroring to the serial port.
+         *
+         * @param text the row of text, including its trailing newline.
+         * @param len the length of the text.
+         */
+        void mirror(const char *text, uint32_t len);
+
+        /**
+         * Send as much queued mirror output as the serial port can accept, without blocking.
+         */
+        void drainMirror();
+
+        /**
+         * Read the next chunk of data from the given cursor.
+         *
+         * @param cursor the cursor to read from.
+         * @param data the buffer to fill.
+         * @param len the maximum number of bytes to read.
+         * @return the number of bytes read, zero if no more data is available, or DEVICE_INVALID_STATE if the cursor is no longer valid.
+         */
+        int readCursor(LogCursor &cursor, uint8_t *data, uint32_t len);
+        int _readCursor(LogCursor &cursor, uint8_t *data, uint32_t len);
+
+        /**
+         * Event handler, used to commit buffered and cached data following a timeout.
+         */
+        void onFlushEvent(Event e);
+
+        /**
+         * Schedules a commit of buffered and cached data, flushTimeout milliseconds from now, replacing any already scheduled.
+         */
+        void scheduleFlush();
+
         /**
          * Add the given heading to the list of headings in use. If the heading already exists,
          * this method has no effect.
@@ -424,6 +894,15 @@ namespace codal
          */
         void addHeading(ManagedString key, ManagedString value, bool head = false);
 
+        /**
+         * Determines the column index of the given heading.
+         * Columns are typically logged in the same order for every row, so the column following the last one found is tested first.
+         *
+         * @param key the heading to find.
+         * @return the index of the column, or -1 if no such heading exists.
+         */
+        int findColumn(ManagedString key);
+
         /**
          * Clean the given buffer of invalid LogFS symbols ("-->" and optionally ",\t\n")
          *
@@ -433,6 +912,79 @@ namespace codal
          * @return a cleaned version of the string supplied, if any changes are necessary. Otherwise, an empty string is returned.
          */
         ManagedString cleanBuffer(const char *s, int len, bool removeSeparators = true);
+
+        /**
+         * Discard the current row index. The index will be rebuilt the next time it is required.
+         */
+        void resetRowIndex();
+
+        /**
+         * Build the row index for the current log, if it is not already valid.
+         * The data region is scanned once, in blocks, after which the index is maintained incrementally as data is logged.
+         */
+        void buildRowIndex();
+
+        /**
+         * Update the row index with the given data, which has been (or is about to be) stored at the given address.
+         *
+         * @param address the logical address of the first byte of data.
+         * @param data the data to index.
+         * @param len the number of bytes of data to index.
+         */
+        void indexRowData(uint32_t address, const uint8_t *data, uint32_t len);
+
+        /**
+         * Scan forward from the given address until the given number of rows have been passed.
+         *
+         * @param address the logical address to start scanning from.
+         * @param rows the number of row separators to skip.
+         * @return the logical address of the byte following the last row separator skipped, or dataEnd if the data ends first.
+         */
+        uint32_t skipRows(uint32_t address, uint32_t rows);
+
+        /**
+         * Determine the logical address of the start of the given row, using the row index.
+         *
+         * @param row the 0-based index of the row to locate. Must be no greater than rowCount.
+         * @return the logical address of the start of the given row.
+         */
+        uint32_t getRowAddress(uint32_t row);
+
+        /**
+         * Determine the size of the data region used by a ring log. This is the data region rounded down to a whole number of pages.
+         */
+        uint32_t getRingSize();
+
+        /**
+         * Translate a logical address in the data region into a physical address, taking account of any wrap around in ring mode.
+         *
+         * @param address the logical address to translate.
+         * @return the physical address of the given logical address.
+         */
+        uint32_t getPhysicalAddress(uint32_t address);
+
+        /**
+         * Read data from the data region, taking account of any wrap around in ring mode.
+         *
+         * @param address the logical address to read from.
+         * @param data the buffer to fill.
+         * @param len the number of bytes to read.
+         * @return DEVICE_OK on success.
+         */
+        int readLog(uint32_t address, void *data, uint32_t len);
+
+        /**
+         * Recalculate the start of valid data, after the oldest data in a ring log has been erased.
+         */
+        void updateDataHead();
+
+        /**
+         * Erase the pages scheduled for a background erase, one page at a time.
+         * Runs in its own fiber, started by _clear().
+         *
+         * @param log the MicroBitLog instance to erase.
+         */
+        static void eraseTask(void *log);
     };
 }
 
@@ -101,6 +101,22 @@ class MicroBitMemoryMap
 
     uint8_t regionCount = 0;
 
+    // The location and size of the hash record the region table was built from, or zero if none was found.
+    uint32_t recordAddress = 0;
+    uint32_t recordLength = 0;
+
+    /**
+     * Restores the region table from the cache kept in no-init RAM, if it was built from the hash record now in flash.
+     *
+     * @return true if the cache was valid, false otherwise.
+     */
+    bool loadCache();
+
+    /**
+     * Saves the region table to the cache kept in no-init RAM, if a hash record was found.
+     */
+    void storeCache();
+
     public:
 
     MemoryMapStore memoryMapStore;
@@ -143,6 +159,42 @@ class MicroBitMemoryMap
      * @return MICROBIT_OK success, MICROBIT_INVALID_PARAM if the region.id is too great
      */
     int processRecord(uint32_t *address);
+
+    /**
+     * Computes the hashes of consecutive pages of a region, so that a new build can be diffed against it a page at
+     * a time. The hashes may be fetched in several calls, e.g. to fit each into a BLE notification.
+     *
+     * @param regionId The id of the region, e.g. REGION_MAKECODE.
+     * @param hashes The array to store the CRC32 of each page in.
+     * @param count The maximum number of hashes to compute.
+     * @param first The index of the first page of the region to hash.
+     *
+     * @return The number of hashes computed, or MICROBIT_NO_DATA if the region is not in the map.
+     */
+    int getPageHashes(uint8_t regionId, uint32_t *hashes, int count, int first = 0);
+
+    /**
+     * Computes the hash of a page of flash, as used to decide whether a page need be flashed again.
+     *
+     * @param address The address of the page.
+     * @param length The size of the page, in bytes.
+     *
+     * @return The CRC32 of the contents of the page.
+     */
+    static uint32_t pageHash(uint32_t address, uint32_t length);
+
+    /**
+     * Compares the hashes of a series of consecutive pages against the current contents of flash.
+     *
+     * @param address The address of the first page.
+     * @param length The size of each page, in bytes.
+     * @param hashes The CRC32 of each page as it should be, e.g. as computed over a new program padded with 0xFF.
+     * @param count The number of hashes.
+     * @param differs A bitmap of at least (count + 7) / 8 bytes, in which the bit for each page that differs is set.
+     *
+     * @return The number of pages that differ.
+     */
+    static int comparePages(uint32_t address, uint32_t length, const uint32_t *hashes, int count, uint8_t *differs);
 };
 
 } // namespace codal
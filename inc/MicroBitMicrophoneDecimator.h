@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_MICROPHONE_DECIMATOR_H
+#define MICROBIT_MICROPHONE_DECIMATOR_H
+
+#include "DataStream.h"
+#include "ManagedBuffer.h"
+
+// The order of the CIC filter used to decimate the microphone. Higher orders reject more aliasing, at the cost of
+// more droop across the passband and a few more additions per input sample.
+#ifndef CONFIG_MICROPHONE_DECIMATOR_ORDER
+#define CONFIG_MICROPHONE_DECIMATOR_ORDER               3
+#endif
+
+// The largest supported decimation factor. The filter state grows by log2(factor) bits per order, so this bounds the
+// integrators to 32 bits for 16 bit input.
+#define MICROBIT_MICROPHONE_DECIMATOR_MAX_FACTOR        16
+
+namespace codal
+{
+    /**
+     * A decimating stage for the raw microphone stream, delivering samples at a reduced rate (e.g. 8 or 16kHz) for
+     * voice level and keyword applications that have no use for the full ADC rate.
+     *
+     * Samples are filtered by a CIC (cascaded integrator-comb) filter and decimated by an integer factor as each ADC
+     * buffer arrives, within the same pullRequest() that delivers it, so stages downstream only ever see the reduced
+     * rate. The output is signed 16 bit, in the same units as the raw input and with any unsigned bias removed.
+     */
+    class MicroBitMicrophoneDecimator : public DataSink, public DataSource
+    {
+        DataSource              &upstream;      // The raw microphone channel we consume.
+        DataSink                *downstream;    // The consumer of our decimated output, if any.
+        ManagedBuffer           output;         // The most recent buffer of decimated samples.
+        float                   requestedRate;  // The output sample rate asked for.
+        float                   inputRate;      // The sample rate of the upstream source, as last determined.
+        int                     factor;         // The decimation factor, or zero if yet to be determined.
+        int                     phase;          // The number of input samples integrated towards the next output sample.
+        int32_t                 scale;          // The reciprocal of the CIC gain (factor ^ order), in Q24 fixed point.
+        uint32_t                integrator[CONFIG_MICROPHONE_DECIMATOR_ORDER];  // Integrator state, at the input rate.
+        uint32_t                comb[CONFIG_MICROPHONE_DECIMATOR_ORDER];        // Comb delay state, at the output rate.
+        bool                    active;         // true if we are connected to the microphone.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The raw microphone stream to consume, e.g. a channel of MicroBitAudio::rawSplitter.
+         * @param sampleRate The output sample rate to aim for. The rate delivered is the nearest integer division of the
+         * input rate, as reported by getSampleRate().
+         */
+        MicroBitMicrophoneDecimator(DataSource &source, float sampleRate = 16000);
+
+        /**
+         * Destructor. Disconnects from the microphone, if connected.
+         */
+        ~MicroBitMicrophoneDecimator();
+
+        /**
+         * Changes the output sample rate. The filter is reset, so there is a short transient in the output.
+         *
+         * @param sampleRate The output sample rate to aim for.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the rate is not positive.
+         */
+        int setSampleRate(float sampleRate);
+
+        /**
+         * Determines the decimation factor in use, i.e. the number of input samples consumed per output sample.
+         *
+         * @return The decimation factor.
+         */
+        int getDecimationFactor();
+
+        /**
+         * Provide the most recent buffer of decimated samples to our downstream caller.
+         */
+        virtual ManagedBuffer pull() override;
+
+        /**
+         * Define a downstream component for the decimated stream. Connecting enables the microphone.
+         *
+         * @param sink The component that data will be delivered to.
+         */
+        virtual void connect(DataSink &sink) override;
+
+        /**
+         * Disconnects the downstream component. The microphone is disabled once it has no other consumers.
+         */
+        virtual void disconnect() override;
+
+        /**
+         * Determines the format of the decimated samples.
+         *
+         * @return DATASTREAM_FORMAT_16BIT_SIGNED.
+         */
+        virtual int getFormat() override;
+
+        /**
+         * Determines the sample rate of the decimated stream.
+         *
+         * @return The input sample rate divided by the decimation factor.
+         */
+        virtual float getSampleRate() override;
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest() override;
+
+        private:
+
+        void configure();
+
+        template <typename T> int16_t *decimate(const T *data, int len, int32_t bias, int16_t *out);
+    };
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_MICROPHONE_STREAM_H
+#define MICROBIT_MICROPHONE_STREAM_H
+
+#include "DataStream.h"
+#include "ManagedBuffer.h"
+
+namespace codal
+{
+    /**
+     * The level of a single buffer of microphone samples, in raw sample units.
+     */
+    struct MicrophoneLevel
+    {
+        int             samples;                // The number of samples in the buffer.
+        int             mean;                   // The mean sample value (i.e. the DC offset of the microphone).
+        int             rms;                    // The RMS level of the samples, about their mean.
+        int             peak;                   // The largest distance of any sample from the mean.
+    };
+
+    /**
+     * Callback invoked with each buffer of microphone samples, from within the audio pipeline (typically interrupt context).
+     *
+     * @param samples The buffer, as provided by the ADC. This is shared with other consumers of the microphone, so must not be modified.
+     * @param level The level of the samples in the buffer.
+     * @param context The context pointer given to MicroBitMicrophoneStream::start().
+     */
+    typedef void (*MicrophoneStreamHandler)(ManagedBuffer samples, const MicrophoneLevel &level, void *context);
+
+    /**
+     * A consumer of the raw microphone stream, giving direct access to each buffer of samples produced by the ADC.
+     *
+     * Buffers are passed on by reference rather than copied, and their level is measured in the same pass that
+     * receives them. The handler is invoked directly from the audio pipeline, with no fiber or event in between,
+     * so it should do little more than record or hand on what it needs.
+     */
+    class MicroBitMicrophoneStream : public DataSink
+    {
+        DataSource              &upstream;      // The raw microphone channel we consume.
+        MicrophoneStreamHandler handler;        // The consumer of each buffer, if any.
+        void                    *context;       // Context pointer for the handler.
+        ManagedBuffer           last;           // The most recent buffer received.
+        MicrophoneLevel         level;          // The level of the most recent buffer received.
+        bool                    active;         // true if we are connected to the microphone.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The raw microphone stream to consume, e.g. a channel of MicroBitAudio::rawSplitter.
+         */
+        MicroBitMicrophoneStream(DataSource &source);
+
+        /**
+         * Destructor. Stops the stream, if running.
+         */
+        ~MicroBitMicrophoneStream();
+
+        /**
+         * Starts streaming, enabling the microphone if necessary.
+         *
+         * @param handler The function to invoke with each buffer of samples, or NULL to only record the most recent.
+         * @param context A pointer passed to the handler with each buffer.
+         * @return DEVICE_OK on success.
+         */
+        int start(MicrophoneStreamHandler handler = NULL, void *context = NULL);
+
+        /**
+         * Stops streaming. The microphone is disabled once it has no other consumers.
+         *
+         * @return DEVICE_OK on success.
+         */
+        int stop();
+
+        /**
+         * Determines if the stream is running.
+         *
+         * @return true if started, false otherwise.
+         */
+        bool isStreaming();
+
+        /**
+         * Provides the most recent buffer of samples received, without copying it.
+         *
+         * @return The most recent buffer, or an empty buffer if none has been received.
+         */
+        ManagedBuffer getBuffer();
+
+        /**
+         * Provides the level of the most recent buffer of samples received.
+         *
+         * @return The level, which is all zero if no buffer has been received.
+         */
+        MicrophoneLevel getLevel();
+
+        /**
+         * Determines the format of the samples in each buffer.
+         *
+         * @return The data format, e.g. DATASTREAM_FORMAT_16BIT_SIGNED.
+         */
+        int getFormat();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest() override;
+    };
+}
+
+#endif
@@ -31,6 +31,7 @@ DEALINGS IN THE SOFTWARE.
 #include "codal-core/inc/core/CodalComponent.h"
 #include "codal-core/inc/driver-models/I2C.h"
 #include "codal-core/inc/driver-models/Pin.h"
+#include "codal-core/inc/driver-models/Serial.h"
 
 
 // Constants for USB Interface Power Management Protocol
@@ -47,6 +48,17 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_UIPM_MAX_RETRIES                   20
 #define MICROBIT_USB_INTERFACE_IRQ_THRESHOLD        30
 
+// Defines if requests from the interface chip are detected from edges on the IRQ line (1), or by polling the line from the idle loop (0).
+#ifndef CONFIG_MICROBIT_USB_INTERFACE_IRQ_EVENTS
+#define CONFIG_MICROBIT_USB_INTERFACE_IRQ_EVENTS    1
+#endif
+
+// Time (milliseconds) the IRQ line must remain active after a falling edge before the interface chip is checked for a request.
+// Other devices share the line, and are much more likely to be the source of an interrupt.
+#ifndef MICROBIT_USB_INTERFACE_IRQ_DEBOUNCE
+#define MICROBIT_USB_INTERFACE_IRQ_DEBOUNCE         5
+#endif
+
 //
 // Command codes for the USB Interface Chip
 //
@@ -72,6 +84,7 @@ DEALINGS IN THE SOFTWARE.
 
 //
 // KL27 User event sources
+// n.b. These are also raised as event values from the MicroBitPowerManager's id when received.
 //
 #define MICROBIT_UIPM_EVENT_WAKE_RESET              0x01
 #define MICROBIT_UIPM_EVENT_WAKE_USB_INSERTION      0x02
@@ -136,6 +149,97 @@ typedef struct {
     float estimatedPowerConsumption;
 } MicroBitPowerData;
 
+//
+// Statistics for I2C transactions with the USB interface chip (if CONFIG_MICROBIT_INTERFACE_STATS is enabled).
+// Latency bucket i counts transactions completed in under (MICROBIT_INTERFACE_STATS_BUCKET_US << i) microseconds.
+// The last bucket counts all longer transactions.
+//
+#define MICROBIT_INTERFACE_STATS_BUCKETS            10
+#define MICROBIT_INTERFACE_STATS_BUCKET_US          250
+#define MICROBIT_UIPM_STATS_SIZE                    (MICROBIT_UIPM_PROPERTY_KL27_USER_EVENT + 1)
+
+typedef struct {
+    uint32_t count;                                             // Transactions issued.
+    uint32_t retries;                                           // Additional attempts made, after a failure or a not ready response.
+    uint32_t busy;                                              // Busy responses received.
+    uint32_t failures;                                          // Transactions that failed after all retries.
+    uint32_t latency[MICROBIT_INTERFACE_STATS_BUCKETS];         // Histogram of the time taken by each transaction.
+} MicroBitInterfaceStats;
+
+/**
+ * Record the completion of a transaction with the USB interface chip.
+ *
+ * @param stats the statistics to update.
+ * @param start the time the transaction started, in microseconds.
+ * @param retries the number of additional attempts made.
+ * @param busy the number of busy responses received.
+ * @param ok true if the transaction succeeded, false otherwise.
+ */
+void microbit_interface_stats_record(MicroBitInterfaceStats &stats, CODAL_TIMESTAMP start, int retries, int busy, bool ok);
+
+/**
+ * Print a table of the given statistics to a serial port, one line per command.
+ *
+ * @param serial the serial port to print to.
+ * @param name a label printed at the start of each line.
+ * @param stats an array of statistics, indexed by command.
+ * @param count the number of elements in stats.
+ */
+void microbit_interface_stats_print(Serial &serial, const char *name, MicroBitInterfaceStats *stats, int count);
+
+//
+// Deep sleep profile (if CONFIG_MICROBIT_DEEPSLEEP_PROFILE is enabled).
+// Each phase of deep sleep entry and exit is timed in microseconds. The slowest component callbacks seen are also recorded.
+//
+#define MICROBIT_DEEPSLEEP_PHASE_PREPARE            0           // deepSleepCallbackPrepare callbacks, made when a deep sleep is first requested.
+#define MICROBIT_DEEPSLEEP_PHASE_ENTER_COMPONENTS   1           // deepSleepCallbackBegin callbacks, including each component's setSleep(true).
+#define MICROBIT_DEEPSLEEP_PHASE_ENTER_TIMER        2           // Reconfiguration of the system timer and wake up sources.
+#define MICROBIT_DEEPSLEEP_PHASE_SLEEP              3           // Time spent asleep.
+#define MICROBIT_DEEPSLEEP_PHASE_EXIT_TIMER         4           // Restoration of the system timer and wake up sources.
+#define MICROBIT_DEEPSLEEP_PHASE_EXIT_COMPONENTS    5           // deepSleepCallbackEnd callbacks, including each component's setSleep(false).
+#define MICROBIT_DEEPSLEEP_PHASES                   6
+#define MICROBIT_DEEPSLEEP_PROFILE_COMPONENTS       4
+
+typedef struct {
+    uint16_t id;                                                // EventModel id of the component.
+    uint8_t  reason;                                            // The deepSleepCallbackReason of the callback.
+    uint32_t time;                                              // Worst case time taken by the callback.
+} MicroBitDeepSleepComponentTime;
+
+typedef struct {
+    uint32_t count;                                             // Deep sleeps completed.
+    uint32_t last[MICROBIT_DEEPSLEEP_PHASES];                   // Time taken by each phase of the most recent deep sleep.
+    uint32_t worst[MICROBIT_DEEPSLEEP_PHASES];                  // Worst case time taken by each phase.
+    MicroBitDeepSleepComponentTime slowest[MICROBIT_DEEPSLEEP_PROFILE_COMPONENTS];  // Slowest component callbacks, slowest first.
+} MicroBitDeepSleepProfile;
+
+//
+// Energy accounting (if CONFIG_MICROBIT_ENERGY_ACCOUNTING is enabled).
+// Subsystems report transitions between their active and inactive states, from which cumulative active time is derived.
+//
+#define MICROBIT_ENERGY_RADIO                       0           // MicroBitRadio enabled.
+#define MICROBIT_ENERGY_DISPLAY                     1           // LED matrix enabled and strobing.
+#define MICROBIT_ENERGY_MICROPHONE                  2           // Microphone powered.
+#define MICROBIT_ENERGY_BLE_CONNECTION              3           // BLE connection open.
+#define MICROBIT_ENERGY_DEEPSLEEP                   4           // Processor in deep sleep.
+#define MICROBIT_ENERGY_SUBSYSTEMS                  5
+
+typedef struct {
+    uint32_t        activations;                                // Number of inactive to active transitions.
+    uint64_t        activeTime;                                 // Cumulative time spent active, in microseconds, excluding any current active period.
+    CODAL_TIMESTAMP activeSince;                                // Start of the current active period, in microseconds.
+    bool            active;                                     // true if the subsystem is currently active.
+} MicroBitEnergyAccount;
+
+/**
+ * Reports a change in the state of a power hungry subsystem, for energy accounting.
+ * Repeated reports of the same state are ignored. Safe to call from interrupt context.
+ *
+ * @param subsystem the subsystem (one of MICROBIT_ENERGY_*).
+ * @param active true if the subsystem has become active, false if it has become inactive.
+ */
+void microbit_energy_report(int subsystem, bool active);
+
 //
 // USB Interface Chip Power States
 //
@@ -148,7 +252,13 @@ typedef struct {
 #define MICROBIT_USB_INTERFACE_AWAITING_RESPONSE   0x01
 #define MICROBIT_USB_INTERFACE_VERSION_LOADED      0x02
 #define MICROBIT_USB_INTERFACE_ALWAYS_NOP          0x04
+#define MICROBIT_USB_INTERFACE_POWER_SOURCE_CACHED 0x08
+#define MICROBIT_USB_INTERFACE_POWER_DATA_CACHED   0x10
 #define MICROBIT_USB_INTERFACE_BUSY_FLAG_SUPPORTED 0x20
+#define MICROBIT_USB_INTERFACE_USB_STATUS_CACHED   0x40
+#define MICROBIT_USB_INTERFACE_REFRESHING          0x80
+#define MICROBIT_USB_INTERFACE_IRQ_LISTENER        0x100
+#define MICROBIT_USB_INTERFACE_RESPONSE_LISTENER   0x200
 
 //
 // Minimum deep sleep time (milliseconds)
@@ -157,6 +267,56 @@ typedef struct {
 #define CONFIG_MINIMUM_DEEP_SLEEP_TIME  100
 #endif
 
+//
+// Maximum time (milliseconds) spent in a single tickless idle sleep (if CONFIG_MICROBIT_TICKLESS_IDLE is enabled).
+// This bounds the delay to timer events and fiber sleeps that are not flagged as wake up sources.
+//
+#ifndef CONFIG_MICROBIT_TICKLESS_IDLE_MAX_TIME
+#define CONFIG_MICROBIT_TICKLESS_IDLE_MAX_TIME  1000
+#endif
+
+//
+// Event value raised when the interface chip may have a response ready, or the response poll interval has elapsed.
+//
+#define MICROBIT_POWER_EVT_UIPM_RESPONSE        0xFFFE
+
+//
+// Periodic tasks (if CONFIG_MICROBIT_PERIODIC_TASKS is enabled). See MicroBitPowerManager::addPeriodicTask().
+//
+#define MICROBIT_POWER_EVT_PERIODIC_TASK        0xFFFF      // Event value raised by the timer that runs periodic tasks while awake.
+
+#ifndef MICROBIT_PERIODIC_TASK_MAX
+#define MICROBIT_PERIODIC_TASK_MAX              4           // The number of periodic tasks that may be registered.
+#endif
+
+#ifndef MICROBIT_PERIODIC_TASK_COMPONENTS
+#define MICROBIT_PERIODIC_TASK_COMPONENTS       2           // The number of components a periodic task may declare.
+#endif
+
+/**
+ * A periodic task. During deep sleep, this runs in the scheduler idle context, with the system timer suspended,
+ * so it must not sleep, wait on other fibers or rely on the system time advancing.
+ *
+ * @param context The context pointer given to MicroBitPowerManager::addPeriodicTask().
+ */
+typedef void (*MicroBitPeriodicTaskHandler)(void *context);
+
+typedef struct {
+    MicroBitPeriodicTaskHandler handler;                        // The task.
+    void                        *context;                       // Context pointer for the task.
+    uint32_t                    period;                         // The interval between runs, in microseconds.
+    CODAL_TIMESTAMP             due;                            // The time of the next run, in microseconds.
+    codal::CodalComponent       *components[MICROBIT_PERIODIC_TASK_COMPONENTS];    // The components woken from deep sleep for the task, or NULL.
+} MicroBitPeriodicTask;
+
+//
+// Time (milliseconds) for which values read by getPowerSource(), getPowerData() and getUSBStatus() are reused before the
+// interface chip is queried again. Values older than half this time are refreshed in the background. 0 disables caching.
+//
+#ifndef CONFIG_MICROBIT_POWER_DATA_CACHE_TIME
+#define CONFIG_MICROBIT_POWER_DATA_CACHE_TIME  0
+#endif
+
 //
 // Minimum time between power up and power down (milliseconds)
 //
@@ -198,7 +358,8 @@ class MicroBitPowerManager : public CodalComponent
         /**
          * Attempts to determine the power source currently in use on this micro:bit.
          * 
-         * @note This will query the USB interface chip via I2C, and wait for completion.
+         * @note This will query the USB interface chip via I2C, and wait for completion, unless a value cached
+         * within the last CONFIG_MICROBIT_POWER_DATA_CACHE_TIME milliseconds is available (@see setCacheTime()).
          * 
          * @return the current power source used by this micro:bit
          */
@@ -219,7 +380,8 @@ class MicroBitPowerManager : public CodalComponent
         /**
          * Requests the current power data from the interface chip, and calculates some approximate, but potentially useful values.
          * 
-         * @note This will query the USB interface chip via I2C, and wait for completion.
+         * @note This will query the USB interface chip via I2C, and wait for completion, unless a value cached
+         * within the last CONFIG_MICROBIT_POWER_DATA_CACHE_TIME milliseconds is available (@see setCacheTime()).
          * 
          * @warning Values in micro-volts in the returned structure are measured, whereas <code>estimatedPowerConsumption</code> is an approximation and subject to change.
          * 
@@ -239,11 +401,20 @@ class MicroBitPowerManager : public CodalComponent
         /**
          * Attempts to determine the status of the USB interface on this micro:bit.
          * 
-         * @note This will query the USB interface chip via I2C, and wait for completion.
+         * @note This will query the USB interface chip via I2C, and wait for completion, unless a value cached
+         * within the last CONFIG_MICROBIT_POWER_DATA_CACHE_TIME milliseconds is available (@see setCacheTime()).
          * 
          * @return the current status of the USB interface on this micro:bit
          */
         MicroBitUSBStatus getUSBStatus();
+
+        /**
+         * Defines how long values returned by getPowerSource(), getPowerData() and getUSBStatus() are reused before
+         * the interface chip is queried again. Values older than half this time are refreshed in the background.
+         *
+         * @param ms the time to reuse values for, in milliseconds, or 0 to always query the interface chip.
+         */
+        void setCacheTime(uint32_t ms);
         
         /**
          * Attempts to issue a control packet to the USB interface chip.
@@ -262,11 +433,12 @@ class MicroBitPowerManager : public CodalComponent
 
         /**
          * Awaits a response to a previous requests to the USB interface chip.
-         * Up to MICROBIT_UIPM_MAX_RETRIES attempts will be made at ~1ms intervals.
+         * Up to MICROBIT_UIPM_MAX_RETRIES attempts will be made, each as soon as the IRQ line falls, or after ~1ms.
          * 
+         * @param property the property the request refers to, used to record statistics.
          * @return A buffer containing the complete response.
          */
-        ManagedBuffer awaitUIPMPacket();
+        ManagedBuffer awaitUIPMPacket(int property = 0);
 
         /**
          * Attempts to issue a control packet to the USB interface chip.
@@ -282,6 +454,15 @@ class MicroBitPowerManager : public CodalComponent
          */
         ManagedBuffer readProperty(int property);
 
+        /**
+         * Reads a property from the USB interface chip, and copies its value out of the response.
+         * @param property The property to read
+         * @param value The location to copy the value to, left unchanged if the read fails
+         * @param length The length of the value, in bytes
+         * @return MICROBIT_OK on success, or MICROBIT_I2C_ERROR if no valid response of at least that length was received
+         */
+        int readProperty(int property, void *value, int length);
+
         /**
          * Perform a NULL opertion I2C transcation wit the interface chip.
          * This is used to awken the KL27 interface chip from light sleep, 
@@ -316,6 +497,87 @@ class MicroBitPowerManager : public CodalComponent
          */
         void awaitingPacket(bool awaiting);
 
+        /**
+         * Allows a subsystem to request that events are raised on edges of the shared IRQ line.
+         * Requests are reference counted, so edge events remain enabled until every subsystem that enabled them
+         * has disabled them again.
+         *
+         * @param enable true to request edge events, false to release a previous request.
+         */
+        void enableIrqEvents(bool enable);
+
+        /**
+         * Retrieves statistics on transactions with the USB interface chip's control interface for a given property.
+         * Statistics are only collected if CONFIG_MICROBIT_INTERFACE_STATS is enabled.
+         *
+         * @param property the property to query (one of MICROBIT_UIPM_PROPERTY_*).
+         * @return the statistics for the given property, or NULL if statistics are disabled or the property is invalid.
+         */
+        const MicroBitInterfaceStats *getStats(int property);
+
+        /**
+         * Reset all transaction statistics to zero.
+         */
+        void resetStats();
+
+        /**
+         * Print the statistics for each property with recorded transactions to the given serial port.
+         *
+         * @param serial the serial port to print to.
+         */
+        void printStats(Serial &serial);
+
+        /**
+         * Retrieves timing information for each phase of deep sleep entry and exit.
+         * Timings are only collected if CONFIG_MICROBIT_DEEPSLEEP_PROFILE is enabled.
+         *
+         * @return the deep sleep profile, or NULL if profiling is disabled.
+         */
+        const MicroBitDeepSleepProfile *getDeepSleepProfile();
+
+        /**
+         * Reset the deep sleep profile.
+         */
+        void resetDeepSleepProfile();
+
+        /**
+         * Print the deep sleep profile to the given serial port.
+         *
+         * @param serial the serial port to print to.
+         */
+        void printDeepSleepProfile(Serial &serial);
+
+        /**
+         * Retrieves the energy account of a given subsystem.
+         * Accounts are only maintained if CONFIG_MICROBIT_ENERGY_ACCOUNTING is enabled.
+         *
+         * @param subsystem the subsystem to query (one of MICROBIT_ENERGY_*).
+         * @return the account for the given subsystem, or NULL if accounting is disabled or the subsystem is invalid.
+         */
+        const MicroBitEnergyAccount *getEnergyAccount(int subsystem);
+
+        /**
+         * Determines the cumulative time a given subsystem has been active since accounts were last reset,
+         * including any current active period.
+         *
+         * @param subsystem the subsystem to query (one of MICROBIT_ENERGY_*).
+         * @return the active time in microseconds, or 0 if accounting is disabled or the subsystem is invalid.
+         */
+        uint64_t getActiveTime(int subsystem);
+
+        /**
+         * Reset all energy accounts. Subsystems that are currently active remain active, from the time of the reset.
+         */
+        void resetEnergyAccounts();
+
+        /**
+         * Print the active time and duty cycle of each subsystem to the given serial port,
+         * along with the current power data reported by the USB interface chip.
+         *
+         * @param serial the serial port to print to.
+         */
+        void printEnergyAccounts(Serial &serial);
+
         /**
          * Destructor.
          */
@@ -416,8 +678,66 @@ class MicroBitPowerManager : public CodalComponent
          */
         void cancelDeepSleep();
 
+        /**
+         * Registers a task to run at a fixed period, whether awake or in deep sleep. While awake, the task runs from the
+         * message bus. During deep sleep, the processor wakes only for the task: the components it declares are sent a
+         * deep sleep end callback, the task runs, they are sent a deep sleep begin callback, and deep sleep resumes.
+         * No other component, nor any fiber, is woken. This keeps the cost of each wake to a minimum for periodic
+         * sampling workloads (e.g. reading a sensor into a log).
+         *
+         * Only available if CONFIG_MICROBIT_PERIODIC_TASKS is enabled.
+         *
+         * @param handler The task to run.
+         * @param context A pointer passed to the task each time it runs.
+         * @param period The interval between runs, in milliseconds. The first run is one period from now.
+         * @param components The components the task uses, which are woken from deep sleep while it runs. May be NULL.
+         * @param count The number of components, up to MICROBIT_PERIODIC_TASK_COMPONENTS.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the handler or period is invalid or too many
+         *         components are given, MICROBIT_NO_RESOURCES if MICROBIT_PERIODIC_TASK_MAX tasks are already registered,
+         *         or MICROBIT_NOT_SUPPORTED if periodic tasks are not enabled.
+         */
+        int addPeriodicTask(MicroBitPeriodicTaskHandler handler, void *context, uint32_t period, CodalComponent **components = NULL, int count = 0);
+
+        /**
+         * Removes a task registered with addPeriodicTask(). Must not be called from within a periodic task.
+         *
+         * @param handler The task.
+         * @param context The context pointer it was registered with.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if no such task is registered.
+         */
+        int removePeriodicTask(MicroBitPeriodicTaskHandler handler, void *context);
+
+        /**
+         * Sleeps the processor without waking for the periodic scheduler tick, until the next timer event created with the
+         * CODAL_TIMER_EVENT_FLAGS_WAKEUP flag, any other interrupt, or CONFIG_MICROBIT_TICKLESS_IDLE_MAX_TIME has passed.
+         * Peripherals are left running. Called from the scheduler idle loop when CONFIG_MICROBIT_TICKLESS_IDLE is enabled.
+         *
+         * @return DEVICE_OK if a tickless sleep occurred, DEVICE_INVALID_STATE if any component requires system tick callbacks or
+         * the next wake up is due within a scheduler tick, or DEVICE_NOT_SUPPORTED if the system timer is unavailable.
+         */
+        int idleSleep();
+
+        /**
+         * Blocks the calling fiber for the given time, with its deadline flagged as a wake up so that idleSleep() doesn't
+         * sleep past it. The flag is withdrawn afterwards, and isn't set while deep sleep is pending, as fiber sleeps don't
+         * bound deep sleep. Used by MicroBit::sleep() when CONFIG_MICROBIT_TICKLESS_IDLE is enabled.
+         *
+         * @param milliSeconds The period of time to sleep, in milliseconds.
+         */
+        void ticklessSleep(uint32_t milliSeconds);
+
         private:
 
+        /**
+         * Picks the value of the next timer event raised on our id to wake us up, skipping those reserved for
+         * interface chip responses and periodic tasks.
+         *
+         * @return a value distinct from those of any other wake up timer still pending.
+         */
+        uint16_t nextWakeUpValue();
+
         /**
           * Listener
           */
@@ -430,6 +750,7 @@ class MicroBitPowerManager : public CodalComponent
          */
         void prepareDeepSleep();
 
+
         /**
          * Wait on the lock;
          */
@@ -445,10 +766,110 @@ class MicroBitPowerManager : public CodalComponent
         static volatile uint16_t timer_irq_channels;
         static void deepSleepTimerIRQ(uint16_t chan);
 
+        /**
+         * Event handler, called when the shared IRQ line falls. Checks the interface chip for a request,
+         * unless the line is released within MICROBIT_USB_INTERFACE_IRQ_DEBOUNCE, or a transaction is in progress.
+         */
+        void onInterfaceIrq(Event);
+
+        /**
+         * Blocks the calling fiber until the shared IRQ line falls, or ~1ms has elapsed.
+         * Falls back to a 1ms busy wait if the calling context cannot block.
+         */
+        void awaitResponseIrq();
+
+        /**
+         * Event handler, called when the shared IRQ line falls while a response is awaited.
+         */
+        void onResponseIrq(Event);
+
+        /**
+         * Query the interface chip for the current power source, power data or USB status, updating the cached values.
+         */
+        MicroBitPowerSource readPowerSource();
+        MicroBitPowerData readPowerData();
+        MicroBitUSBStatus readUSBStatus();
+
+        /**
+         * Determines if a cached value may be returned, scheduling a background refresh if it is becoming stale.
+         *
+         * @param flag the status flag indicating the value is cached.
+         * @param timestamp the time the value was read.
+         * @return true if the cached value is valid, false if the interface chip must be queried.
+         */
+        bool isCached(uint16_t flag, CODAL_TIMESTAMP timestamp);
+
+        /**
+         * Refreshes the cached values that are becoming stale.
+         * Runs in its own fiber, started by isCached().
+         *
+         * @param manager the MicroBitPowerManager to refresh.
+         */
+        static void refreshTask(void *manager);
+
+        /**
+         * Determines when the next periodic task is due.
+         *
+         * @return The time the next task is due, in microseconds, or 0 if no tasks are registered.
+         */
+        CODAL_TIMESTAMP nextPeriodicTask();
+
+        /**
+         * Runs all periodic tasks that are due.
+         *
+         * @param now The current time, in microseconds.
+         * @param asleep true if called during deep sleep, in which case the components each task declares are woken for it.
+         * @param wakeUpSources true if the deep sleep in progress uses external wake up sources.
+         */
+        void runPeriodicTasks(CODAL_TIMESTAMP now, bool asleep, bool wakeUpSources);
+
+        /**
+         * Schedules the timer event that runs periodic tasks while awake, for when the next task is due.
+         */
+        void schedulePeriodicTasks();
+
+        /**
+         * Event handler, called when the next periodic task is due while awake.
+         */
+        void onPeriodicTask(Event);
+
         FiberLock               deepSleepLock;
         int                     powerDownDisableCount;
         CODAL_TIMESTAMP         powerUpTime;
         uint16_t                eventValue;
+        uint32_t                cacheTime;
+        int                     irqEventCount;
+        uint16_t                refreshRequests;
+        CODAL_TIMESTAMP         powerSourceTime;
+        CODAL_TIMESTAMP         powerDataTime;
+        CODAL_TIMESTAMP         usbStatusTime;
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+        MicroBitInterfaceStats  stats[MICROBIT_UIPM_STATS_SIZE];
+#endif
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+        MicroBitDeepSleepProfile    profile;
+#endif
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+        MicroBitPeriodicTask        periodicTasks[MICROBIT_PERIODIC_TASK_MAX];
+        int                         periodicTaskCount;
+#endif
+
+        /**
+         * Issues the given deep sleep callback to all components, profiling each callback if enabled.
+         *
+         * @param reason the reason for the callback.
+         * @param data the data associated with the callback.
+         * @param phase the deep sleep phase (one of MICROBIT_DEEPSLEEP_PHASE_*) to attribute the time taken to.
+         */
+        void deepSleepComponents(deepSleepCallbackReason reason, deepSleepCallbackData *data, int phase);
+
+        /**
+         * Records the time taken by a phase of deep sleep entry or exit.
+         *
+         * @param phase the phase (one of MICROBIT_DEEPSLEEP_PHASE_*).
+         * @param time the time taken, in microseconds.
+         */
+        void profileDeepSleepPhase(int phase, uint32_t time);
 
         /**
          * Check if there are suitable wake-up sources for deep sleep
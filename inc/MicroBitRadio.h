@@ -38,6 +38,9 @@ namespace codal
 #include "MicroBitConfig.h"
 #include "MicroBitRadioDatagram.h"
 #include "MicroBitRadioEvent.h"
+#include "MicroBitRadioReliable.h"
+#include "MicroBitRadioTDMA.h"
+#include "MicroBitRadioMesh.h"
 
 /**
  * Provides a simple broadcast radio abstraction, built upon the raw nrf51822 RADIO module.
@@ -53,9 +56,9 @@ namespace codal
  * TODO: Meshing should also be considered - again a GLOSSY approach may be effective here, and highly complementary to
  * the master/slave arachitecture of BLE.
  *
- * TODO: This implementation only operates whilst the BLE stack is disabled. The nrf51822 provides a timeslot API to allow
- * BLE to cohabit with other protocols. Future work to allow this colocation would be benefical, and would also allow for the
- * creation of wireless BLE bridges.
+ * NOTE: By default, this implementation only operates whilst the BLE stack is disabled. If MICROBIT_RADIO_TIMESLOT is enabled,
+ * the radio may also be enabled while the BLE stack is running, in which case it borrows the RADIO from the SoftDevice in
+ * timeslots between BLE events. Throughput is then shared with BLE, which allows the creation of wireless BLE bridges.
  *
  * NOTE: This API does not contain any form of encryption, authentication or authorization. It's purpose is solely for use as a
  * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
@@ -66,6 +69,9 @@ namespace codal
 #define MICROBIT_RADIO_STATUS_INITIALISED       0x0001
 #define MICROBIT_RADIO_STATUS_DEEPSLEEP_IRQ     0x0002
 #define MICROBIT_RADIO_STATUS_DEEPSLEEP_INIT    0x0004
+#define MICROBIT_RADIO_STATUS_AUTO_BAND         0x0008
+#define MICROBIT_RADIO_STATUS_TIMESLOT          0x0010
+#define MICROBIT_RADIO_STATUS_LISTEN            0x0020
 
 // Default configuration values
 #define MICROBIT_RADIO_BASE_ADDRESS             0x75626974
@@ -73,9 +79,35 @@ namespace codal
 #define MICROBIT_RADIO_DEFAULT_TX_POWER         6
 #define MICROBIT_RADIO_DEFAULT_FREQUENCY        7
 #define MICROBIT_RADIO_HEADER_SIZE              4
-#define MICROBIT_RADIO_MAXIMUM_RX_BUFFERS       4
+#define MICROBIT_RADIO_MAXIMUM_RX_BUFFERS       4       // Default receive queue depth. See MicroBitRadio::setQueueDepth().
+#define MICROBIT_RADIO_MAXIMUM_QUEUE_DEPTH      255
+#define MICROBIT_RADIO_TX_QUEUE_SIZE            4       // Number of frames that may be queued by sendAsync().
 #define MICROBIT_RADIO_POWER_LEVELS             8
 
+// SoftDevice timeslot configuration (in microseconds). See MICROBIT_RADIO_TIMESLOT.
+#define MICROBIT_RADIO_TIMESLOT_LENGTH          10000   // The length of each timeslot requested.
+#define MICROBIT_RADIO_TIMESLOT_TIMEOUT         100000  // The longest we'll wait for the SoftDevice to grant a timeslot, before asking again.
+#define MICROBIT_RADIO_TIMESLOT_GUARD           200     // Time reserved at the end of each timeslot to shut down the RADIO.
+
+// Low power listening. See MicroBitRadio::setListenSchedule(). Timer events are raised on DEVICE_ID_RADIO_LISTEN,
+// and handled in interrupt context.
+#define DEVICE_ID_RADIO_LISTEN                  3038
+#define MICROBIT_RADIO_LISTEN_EVT_OPEN          1       // A receive window opens.
+#define MICROBIT_RADIO_LISTEN_EVT_CLOSE         2       // A receive window closes.
+#define MICROBIT_RADIO_LISTEN_MIN_WINDOW        500     // The shortest receive window (in microseconds). A full frame takes around 450us on air.
+#define MICROBIT_RADIO_LISTEN_HOLD              2000    // Time (in microseconds) a window is held open after each frame heard, so bursts are received whole.
+#define MICROBIT_RADIO_LISTEN_GUARD             1000    // Time (in microseconds) a synchronised window opens ahead of the expected frame, allowing for drift.
+
+// RSSI histogram layout. Bin 0 counts frames at -49dBm or stronger, each following bin is 10dBm weaker,
+// and the last bin counts all frames at -110dBm or weaker.
+#define MICROBIT_RADIO_RSSI_BINS                8
+#define MICROBIT_RADIO_RSSI_BIN_START           40
+#define MICROBIT_RADIO_RSSI_BIN_WIDTH           10
+
+// Number of preallocated receive buffers needed for a given queue depth. Enough for the buffer owned by the RADIO hardware,
+// a full receive queue, and a full datagram queue (which may hold one more than the queue depth).
+#define MICROBIT_RADIO_RX_POOL_SIZE(depth)      (2 * (depth) + 2)
+
 // Max packet size is configurable, so ensure maximum value is not exceeded
 // TODO: Update this value once issue codal-microbit-v2#383 is resolved
 // https://github.com/lancaster-university/codal-microbit-v2/issues/383
@@ -86,9 +118,26 @@ namespace codal
 // Known Protocol Numbers
 #define MICROBIT_RADIO_PROTOCOL_DATAGRAM        1       // A simple, single frame datagram. a little like UDP but with smaller packets. :-)
 #define MICROBIT_RADIO_PROTOCOL_EVENTBUS        2       // Transparent propogation of events from one micro:bit to another.
+#define MICROBIT_RADIO_PROTOCOL_FRAGMENT        3       // A fragment of a large datagram, reassembled by MicroBitRadioDatagram.
+#define MICROBIT_RADIO_PROTOCOL_RELIABLE        4       // Reliable, ordered point to point delivery. A little like TCP, but without the connections.
+#define MICROBIT_RADIO_PROTOCOL_TDMA            5       // TDMA beacons and slot requests.
+#define MICROBIT_RADIO_PROTOCOL_MESH            6       // A broadcast message, flooded across multiple hops.
 
 // Events
 #define MICROBIT_RADIO_EVT_DATAGRAM             1       // Event to signal that a new datagram has been received.
+#define MICROBIT_RADIO_EVT_TX_COMPLETE          2       // Event to signal that a frame queued by sendAsync() has been transmitted.
+#define MICROBIT_RADIO_EVT_LARGE_DATAGRAM       3       // Event to signal that a large datagram has been reassembled.
+#define MICROBIT_RADIO_EVT_RELIABLE_DATA        4       // Event to signal that data from a reliable peer is ready to read.
+#define MICROBIT_RADIO_EVT_RELIABLE_WINDOW      5       // Event to signal that reliable frames have been acknowledged.
+#define MICROBIT_RADIO_EVT_RELIABLE_FAILED      6       // Event to signal that reliable frames were abandoned, as a peer stopped responding.
+#define MICROBIT_RADIO_EVT_EVENTBUS_FLUSH       7       // Event to signal that forwarded events gathered into a batch should be sent.
+#define MICROBIT_RADIO_EVT_MESH_DATA            8       // Event to signal that a message received from the mesh is ready to read.
+#define MICROBIT_RADIO_EVT_TX_IDLE              9       // Event to signal that the transmit queue has emptied, as its frames were sent or abandoned.
+
+// Transmitter states
+#define MICROBIT_RADIO_TX_IDLE                  0       // Receiving.
+#define MICROBIT_RADIO_TX_DISABLING             1       // Waiting for the receiver to shut down before transmitting.
+#define MICROBIT_RADIO_TX_SENDING               2       // Transmitting the frame at the head of the transmit queue.
 
 namespace codal
 {
@@ -102,6 +151,33 @@ namespace codal
         uint8_t         payload[MICROBIT_RADIO_MAX_PACKET_SIZE];    // User / higher layer protocol data
         FrameBuffer     *next;                              // Linkage, to allow this and other protocols to queue packets pending processing.
         int             rssi;                               // Received signal strength of this frame.
+        uint32_t        timestamp;                          // The time (in microseconds) reception of this frame completed.
+
+        /**
+         * Releases a FrameBuffer. Buffers taken from the MicroBitRadio receive pool are returned to it, all others
+         * are freed to the heap. This allows received buffers to be deleted as before.
+         */
+        static void operator delete(void *p);
+    };
+
+    struct MicroBitRadioStatistics
+    {
+        uint32_t            rxOk;                           // Frames received with a valid CRC.
+        uint32_t            rxCrcErrors;                    // Frames received with an invalid CRC.
+        uint32_t            rxQueueFull;                    // Valid frames dropped because the receive queue was full.
+        uint32_t            rxAllocFailures;                // Valid frames dropped because no receive buffer was free to replace them.
+        uint32_t            txCount;                        // Frames transmitted.
+        uint32_t            txTime;                         // Time spent transmitting (in microseconds), including transmitter ramp up.
+        uint32_t            rssi[MICROBIT_RADIO_RSSI_BINS]; // Valid frames received, by signal strength.
+    };
+
+    struct FrameBufferPool
+    {
+        FrameBuffer         *buffers;                       // The preallocated buffers.
+        volatile uint8_t    *used;                          // Nonzero for each buffer currently in use.
+        PacketData          *packets;                       // A PacketBuffer header for each buffer, so frames can be adopted without copying.
+        int                 size;                           // The number of buffers in this pool.
+        FrameBufferPool     *next;                          // Linkage, as pools are added when the queue depth grows.
     };
 
 
@@ -110,14 +186,144 @@ namespace codal
         uint8_t                 band;       // The radio transmission and reception frequency band.
         uint8_t                 power;      // The radio output power level of the transmitter.
         uint8_t                 group;      // The radio group to which this micro:bit belongs.
-        uint8_t                 queueDepth; // The number of packets in the receiver queue.
+        volatile uint8_t        queueDepth; // The number of packets in the receiver queue.
+        uint8_t                 queueSize;  // The maximum number of packets in the receiver queue.
+        uint8_t                 rxHead;     // The index in rxQueue of the oldest queued packet.
         int                     rssi;
-        FrameBuffer             *rxQueue;   // A linear list of incoming packets, queued awaiting processing.
+        FrameBuffer             **rxQueue;  // A ring of incoming packets, queued awaiting processing.
         FrameBuffer             *rxBuf;     // A pointer to the buffer being actively used by the RADIO hardware.
+        FrameBuffer             *rxSpare;   // A buffer ready to replace rxBuf when the current frame has been received.
+        volatile bool           rxArmed;    // true if rxSpare has been handed to the RADIO for the next reception.
+        FrameBufferPool         *rxPool;    // Preallocated receive buffers, allocated when the radio is first enabled.
+        int                     rxPoolSize; // The total number of buffers in rxPool.
+        MicroBitRadioStatistics stats;      // Link statistics, since the last call to resetStatistics().
+        uint32_t                txStart;    // The time (in microseconds) the transmitter was last enabled.
+        FrameBuffer             *txQueue;   // A ring of frames queued by sendAsync(), awaiting transmission.
+        volatile uint8_t        txHead;     // The position of the frame being transmitted, modulo twice the queue size. Moved only by the RADIO interrupt.
+        volatile uint8_t        txTail;     // The position at which sendAsync() queues the next frame, as txHead. Moved only by sendAsync().
+        volatile uint8_t        txState;    // The state of the transmitter (one of MICROBIT_RADIO_TX_*).
+        volatile bool           txHold;     // true if queued frames are being held back. See setTransmitHold().
+        volatile bool           slotActive; // true while the RADIO is ours, within a SoftDevice timeslot.
+        volatile bool           listening;  // false between the receive windows of a listen schedule.
+        volatile bool           rxBusy;     // true while a frame is being received.
+        volatile bool           rxLocked;   // true while lockRadio() is held in timeslot mode. Received frames are then dropped.
+        volatile uint8_t        txCompleteRaised;   // In timeslot mode, the MICROBIT_RADIO_EVT_TX_COMPLETE events raised by the RADIO interrupt...
+        volatile uint8_t        txCompleteSeen;     // ...and those since passed on to the event bus by the software interrupt.
+        volatile uint8_t        txIdleRaised;       // Likewise for MICROBIT_RADIO_EVT_TX_IDLE.
+        volatile uint8_t        txIdleSeen;
+        uint32_t                listenWindow;   // The length of each receive window (in microseconds), or 0 to listen continuously.
+        uint32_t                listenPeriod;   // The interval between the start of each receive window (in microseconds).
+        uint32_t                listenFrames;   // The number of frames heard when the current window was last extended.
+
+        /**
+         * Blocks the calling fiber until fewer than the given number of frames are queued by sendAsync(), or, if depth
+         * is zero, until the transmitter is idle. Falls back to waiting for an interrupt if the caller cannot block.
+         *
+         * @param depth the queue depth to wait for, or zero to wait for the transmitter to be idle.
+         */
+        void awaitTxDepth(int depth);
+
+        /**
+         * Determines the number of frames queued by sendAsync() and not yet transmitted. txHead and txTail each have a
+         * single writer, so this may be called from any context without locking.
+         *
+         * @return the number of frames in txQueue.
+         */
+        int txQueued();
+
+        /**
+         * Raises a transmit event from the RADIO interrupt. In timeslot mode this runs in the SoftDevice's highest
+         * priority signal handler, where the event bus must not be used, so the event is passed on to a software
+         * interrupt at application priority instead.
+         *
+         * @param value MICROBIT_RADIO_EVT_TX_COMPLETE or MICROBIT_RADIO_EVT_TX_IDLE.
+         */
+        void raiseTxEvent(uint16_t value);
+
+        /**
+         * Grows the receive pool so that it holds at least the given number of buffers.
+         *
+         * @param size the number of buffers required.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the buffers could not be allocated.
+         */
+        int growRxPool(int size);
+
+        /**
+         * Takes a free buffer from the receive pool. Only the RADIO interrupt (or code running while it is disabled)
+         * takes buffers, and buffers are released with a single store, so no locking is needed.
+         *
+         * @return a free buffer, or NULL if the pool is exhausted or not yet allocated.
+         */
+        FrameBuffer* allocRxBuf();
+
+        /**
+         * Applies our packet format, address, group, band and power settings to the RADIO.
+         */
+        void configureRadio();
+
+        /**
+         * Opens a SoftDevice radio session, and requests the first timeslot. Used to enable the radio while the BLE stack is running.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_NOT_SUPPORTED if timeslots are not available.
+         */
+        int openTimeslotSession();
+
+        /**
+         * Determines if the RADIO registers may be used. They may not while we're waiting for a SoftDevice timeslot.
+         *
+         * @return true if the RADIO registers may be used, false otherwise.
+         */
+        bool ownsRadio();
+
+        /**
+         * Masks the RADIO interrupt, to protect state shared with it. In timeslot mode, the RADIO interrupt belongs to the
+         * SoftDevice and cannot be masked, so the application interrupts are masked using a SoftDevice critical region,
+         * and the RADIO interrupt drops any frame received meanwhile rather than touch the receive queue.
+         *
+         * @return true if interrupts were masked by this call, and should be restored with unlockRadio().
+         */
+        bool lockRadio();
+
+        /**
+         * Restores interrupts masked by lockRadio().
+         *
+         * @param irq the value returned by lockRadio().
+         */
+        void unlockRadio(bool irq);
+
+        /**
+         * Starts the receiver. The READY_START short begins reception once the receiver has ramped up.
+         */
+        void startReceiver();
+
+        /**
+         * Starts transmission of the frame at the head of the transmit queue, stopping the receiver first if necessary.
+         * Must be called with the RADIO locked, while the transmitter is idle.
+         */
+        void startTransmitter();
+
+        /**
+         * Opens a receive window of the listen schedule, and schedules the next.
+         */
+        void openListenWindow();
+
+        /**
+         * Closes the current receive window of the listen schedule, unless frames are still arriving.
+         */
+        void closeListenWindow();
+
+        /**
+         * Cancels any listen schedule timer events, and turns the receiver back on if it is between windows.
+         */
+        void stopListenSchedule();
 
         public:
         MicroBitRadioDatagram   datagram;   // A simple datagram service.
         MicroBitRadioEvent      event;      // A simple event handling service.
+        MicroBitRadioReliable   reliable;   // A reliable, ordered point to point transport.
+        MicroBitRadioTDMA       tdma;       // An optional time slotted transmission schedule.
+        MicroBitRadioMesh       mesh;       // Multi-hop broadcast delivery, by flooding.
         static MicroBitRadio    *instance;  // A singleton reference, used purely by the interrupt service routine.
 
         /**
@@ -160,11 +366,98 @@ namespace codal
         /**
          * Attempt to queue a buffer received by the radio hardware, if sufficient space is available.
          *
-         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if a replacement receiver buffer
-         *         could not be allocated (either by policy or memory exhaustion).
+         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the queue is full or no replacement receiver buffer
+         *         was armed in time (either by policy or memory exhaustion).
          */
         int queueRxBuf();
 
+        /**
+         * Returns a buffer to the receive pool, if it was taken from it.
+         *
+         * @param buffer the buffer to release.
+         *
+         * @return true if the buffer belongs to the receive pool and has been released, false otherwise.
+         */
+        bool releaseRxBuf(FrameBuffer *buffer);
+
+        /**
+         * Provides the PacketBuffer header reserved for a buffer in the receive pool, allowing a received
+         * frame to be wrapped in a PacketBuffer without copying.
+         *
+         * @param buffer the received buffer.
+         *
+         * @return the header for the buffer, or NULL if the buffer does not belong to the receive pool.
+         */
+        PacketData* getRxPacketData(FrameBuffer *buffer);
+
+        /**
+         * Hands a spare buffer to the RADIO, to be used for the next reception. Called on the ADDRESS event,
+         * as PACKETPTR is double buffered and is read again when reception restarts at the end of the frame.
+         *
+         * @note should only be called from RADIO_IRQHandler...
+         */
+        void armRxBuf();
+
+        /**
+         * Keeps the buffer holding a frame that was not queued (e.g. due to a CRC error) as the next spare,
+         * if reception has already moved on to the armed buffer.
+         *
+         * @note should only be called from RADIO_IRQHandler...
+         */
+        void recycleRxBuf();
+
+        /**
+         * Changes the maximum number of received packets that may be queued awaiting processing.
+         * Deeper queues absorb larger bursts of traffic. If the queue currently holds more packets than the new depth,
+         * the oldest are discarded.
+         *
+         * @param depth the new queue depth, in the range 1..MICROBIT_RADIO_MAXIMUM_QUEUE_DEPTH.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the depth is out of range,
+         *         or DEVICE_NO_RESOURCES if memory for the deeper queue could not be allocated.
+         */
+        int setQueueDepth(int depth);
+
+        /**
+         * Determines the maximum number of received packets that may be queued awaiting processing.
+         *
+         * @return the receive queue depth.
+         */
+        int getQueueDepth();
+
+        /**
+         * Determines the number of received packets dropped because the receive queue was full.
+         *
+         * @return the number of packets dropped since the last call to resetDroppedCount().
+         */
+        uint32_t getDroppedCount();
+
+        /**
+         * Resets the count of received packets dropped because the receive queue was full.
+         */
+        void resetDroppedCount();
+
+        /**
+         * Provides a snapshot of the link statistics gathered by the radio.
+         *
+         * @return the statistics gathered since the last call to resetStatistics().
+         */
+        MicroBitRadioStatistics getStatistics();
+
+        /**
+         * Resets all link statistics to zero.
+         */
+        void resetStatistics();
+
+        /**
+         * Records the reception of a frame in the link statistics, using the RSSI last set by setRSSI().
+         *
+         * @param crcOk true if the frame was received with a valid CRC.
+         *
+         * @note should only be called from RADIO_IRQHandler...
+         */
+        void recordRxFrame(bool crcOk);
+
         /**
          * Sets the RSSI for the most recent packet.
          * The value is measured in -dbm. The higher the value, the stronger the signal.
@@ -186,19 +479,27 @@ namespace codal
         int getRSSI();
 
         /**
-         * Initialises the radio for use as a multipoint sender/receiver
+         * Initialises the radio for use as a multipoint sender/receiver.
+         * If the BLE stack is running and MICROBIT_RADIO_TIMESLOT is enabled, the radio operates in SoftDevice timeslots.
          *
-         * @return MICROBIT_OK on success, MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         * @return MICROBIT_OK on success, MICROBIT_NOT_SUPPORTED if the BLE stack is running and timeslots are not available.
          */
         int enable();
 
         /**
          * Disables the radio for use as a multipoint sender/receiver.
          *
-         * @return MICROBIT_OK on success, MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         * @return MICROBIT_OK on success, MICROBIT_NOT_SUPPORTED if the BLE stack is running and the radio is not in timeslot mode.
          */
         int disable();
 
+        /**
+         * Determines if the radio is operating in SoftDevice timeslots, alongside the BLE stack.
+         *
+         * @return true if the radio is in timeslot mode, false otherwise.
+         */
+        bool isTimeslotMode();
+
         /**
          * Sets the radio to listen to packets sent with the given group id.
          *
@@ -208,6 +509,77 @@ namespace codal
          */
         int setGroup(uint8_t group);
 
+        /**
+         * Enables or disables automatic frequency band assignment. When enabled, each group is placed on one of
+         * a fixed set of well separated bands, chosen from the group id, so that groups sharing a space also share
+         * the available spectrum rather than all colliding on the default band. All members of a group must enable
+         * this to hear each other.
+         *
+         * While enabled, the band is reassigned whenever the group changes.
+         *
+         * @param enabled true to assign the band from the group, false to leave the band as it is.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int setAutomaticBand(bool enabled);
+
+        /**
+         * Determines the frequency band used for the given group by automatic band assignment.
+         *
+         * @param group The group id.
+         *
+         * @return the frequency band assigned to the group.
+         */
+        static int getBandForGroup(uint8_t group);
+
+        /**
+         * Applies a low power listening schedule. Rather than listening continuously, the receiver is turned on for a short
+         * window at the start of each period, and is off in between, leaving the processor free to sleep until the next window
+         * (e.g. through the tickless idle of MicroBitPowerManager). A window is held open for MICROBIT_RADIO_LISTEN_HOLD after
+         * each frame heard, so that bursts are received whole. Frames may still be sent at any time.
+         *
+         * Senders must make sure their frames fall within a window, either by repeating a frame for a full period, or by
+         * aligning the schedule to a known transmission time with syncListenSchedule(), as MicroBitRadioTDMA does with its beacons.
+         *
+         * @param window The length of each receive window (in microseconds), or 0 to listen continuously.
+         *
+         * @param period The interval between the start of each window (in microseconds).
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the window is shorter than MICROBIT_RADIO_LISTEN_MIN_WINDOW
+         *         or not shorter than the period, MICROBIT_NO_RESOURCES if no default EventModel is available, or
+         *         MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int setListenSchedule(uint32_t window, uint32_t period);
+
+        /**
+         * Aligns the listen schedule to a sender, so that the next receive window opens after the given delay.
+         * Later windows follow on at the scheduled period. A window that is currently open is left to close as usual.
+         *
+         * @param delay The time until the next window opens (in microseconds).
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_STATE if no listen schedule is in use.
+         */
+        int syncListenSchedule(uint32_t delay);
+
+        /**
+         * Determines if a listen schedule is in use.
+         *
+         * @return true if the receiver is turned on in windows, false if it listens continuously.
+         */
+        bool isListenScheduled();
+
+        /**
+         * Determines if the receiver is currently turned on.
+         *
+         * @return true if the radio is enabled and listening, false if it is disabled or between receive windows.
+         */
+        bool isListening();
+
+        /**
+         * Listen schedule timer event handler, called in interrupt context at the start and end of each receive window.
+         */
+        void listenEvent(Event e);
+
         /**
          * A background, low priority callback that is triggered whenever the processor is idle.
          * Here, we empty our queue of received packets, and pass them onto higher level protocol handlers.
@@ -243,6 +615,83 @@ namespace codal
          */
         int send(FrameBuffer *buffer);
 
+        /**
+         * Queues the given buffer for transmission onto the broadcast radio, and returns immediately.
+         * The buffer is copied, so may be reused as soon as this call returns. Queued frames are sent back to back by
+         * the RADIO interrupt, and a MICROBIT_RADIO_EVT_TX_COMPLETE event is raised as each one is transmitted.
+         *
+         * @param buffer The packet contents to transmit.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the buffer is invalid, DEVICE_INVALID_STATE if the radio
+         *         is not enabled, DEVICE_NO_RESOURCES if the transmit queue is full, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int sendAsync(FrameBuffer *buffer);
+
+        /**
+         * Determines if frames queued by sendAsync() are awaiting transmission.
+         *
+         * @return true if frames are queued or being transmitted, false otherwise.
+         */
+        bool isTransmitting();
+
+        /**
+         * Waits until all frames queued by sendAsync() have been transmitted.
+         * Other fibers continue to run in the meantime.
+         */
+        void awaitTxIdle();
+
+        /**
+         * Waits until the transmit queue has room for another frame.
+         * Other fibers continue to run in the meantime.
+         */
+        void awaitTxSpace();
+
+        /**
+         * Determines the state of the transmitter.
+         *
+         * @return one of MICROBIT_RADIO_TX_IDLE, MICROBIT_RADIO_TX_DISABLING or MICROBIT_RADIO_TX_SENDING.
+         */
+        int getTransmitterState();
+
+        /**
+         * Holds back (or releases) frames queued by sendAsync(). While held, frames are queued but not transmitted,
+         * and a frame already on air is allowed to complete. This allows transmissions to be confined to time slots.
+         *
+         * @param hold true to hold queued frames, false to transmit them.
+         *
+         * @note may be called from interrupt context.
+         */
+        void setTransmitHold(bool hold);
+
+        /**
+         * Moves the transmitter on to its next state, each time the RADIO signals it has been disabled.
+         * This either starts transmission of the next queued frame, or returns the RADIO to receive mode.
+         *
+         * @note should only be called from RADIO_IRQHandler...
+         */
+        void serviceTxQueue();
+
+        /**
+         * Raises the transmit events recorded by the RADIO interrupt in timeslot mode. See raiseTxEvent().
+         *
+         * @note should only be called from the software interrupt raiseTxEvent() pends.
+         */
+        void raiseDeferredEvents();
+
+        /**
+         * Takes over the RADIO at the start of a SoftDevice timeslot, and sends any queued frames or starts listening.
+         *
+         * @note should only be called from the timeslot signal handler...
+         */
+        void startTimeslot();
+
+        /**
+         * Hands the RADIO back at the end of a SoftDevice timeslot. A frame cut short is sent again in the next timeslot.
+         *
+         * @note should only be called from the timeslot signal handler...
+         */
+        void endTimeslot();
+
         /**
           * Puts the component in (or out of) sleep (low power) mode.
           */
@@ -30,6 +30,27 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitRadio.h"
 #include "ManagedString.h"
 
+// Fragmentation of large datagrams, sent with sendLarge() as MICROBIT_RADIO_PROTOCOL_FRAGMENT frames.
+// Each fragment carries a transfer id, its index within the transfer and the total length of the transfer.
+#define MICROBIT_RADIO_FRAGMENT_HEADER_SIZE     4
+#define MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE    (MICROBIT_RADIO_MAX_PACKET_SIZE - MICROBIT_RADIO_FRAGMENT_HEADER_SIZE)
+#define MICROBIT_RADIO_FRAGMENT_MAX_COUNT       256
+
+// The largest payload that may be sent with sendLarge(), and so the largest reassembly buffer that will be allocated.
+#ifndef MICROBIT_RADIO_LARGE_MAX_SIZE
+#define MICROBIT_RADIO_LARGE_MAX_SIZE           4096
+#endif
+
+// Time (in milliseconds) after the last fragment has been received before an incomplete transfer is abandoned.
+#ifndef MICROBIT_RADIO_FRAGMENT_TIMEOUT
+#define MICROBIT_RADIO_FRAGMENT_TIMEOUT         500
+#endif
+
+// Number of reassembled datagrams that may be queued awaiting recvLarge().
+#ifndef MICROBIT_RADIO_LARGE_QUEUE_SIZE
+#define MICROBIT_RADIO_LARGE_QUEUE_SIZE         2
+#endif
+
 namespace codal
 {
     /**
@@ -48,6 +69,23 @@ namespace codal
         MicroBitRadio   &radio;     // The underlying radio module used to send and receive data.
         FrameBuffer     *rxQueue;   // A linear list of incoming packets, queued awaiting processing.
 
+        PacketBuffer    fragmentBuffer;                                     // The large datagram being reassembled.
+        uint32_t        fragmentMap[MICROBIT_RADIO_FRAGMENT_MAX_COUNT / 32];    // One bit for each fragment received.
+        uint16_t        fragmentsRemaining;                                 // Number of fragments still awaited, or zero if idle.
+        uint8_t         fragmentId;                                         // The transfer id of the datagram being reassembled.
+        uint8_t         txFragmentId;                                       // The transfer id of the last datagram sent with sendLarge().
+        CODAL_TIMESTAMP fragmentTime;                                       // The time the last fragment was received.
+
+        PacketBuffer    largeQueue[MICROBIT_RADIO_LARGE_QUEUE_SIZE];        // A ring of reassembled datagrams awaiting recvLarge().
+        uint8_t         largeHead;                                          // The index in largeQueue of the oldest datagram.
+        uint8_t         largeDepth;                                         // The number of datagrams in largeQueue.
+
+        /**
+         * Abandons the datagram being reassembled, if no fragment of it has been received within
+         * MICROBIT_RADIO_FRAGMENT_TIMEOUT milliseconds, releasing its reassembly buffer.
+         */
+        void expireFragments();
+
         public:
 
         /**
@@ -125,12 +163,64 @@ namespace codal
          */
         int send(ManagedString data);
 
+        /**
+         * Transmits the given buffer onto the broadcast radio, split into as many fragments as are needed.
+         * Fragments are queued back to back with MicroBitRadio::sendAsync(), then reassembled by the receiver
+         * and delivered through recvLarge().
+         *
+         * This is a synchronous call that will wait until the transmission of the last fragment
+         * has completed before returning.
+         *
+         * @param buffer The datagram contents to transmit.
+         *
+         * @param len The number of bytes to transmit, up to MICROBIT_RADIO_LARGE_MAX_SIZE.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the buffer is invalid or the
+         *         number of bytes to transmit is out of range.
+         *
+         * @note There is no acknowledgement or retransmission, so a transfer is lost if any of its fragments
+         *       are lost. Only one large datagram can be reassembled at a time, so concurrent large transfers
+         *       from different senders in the same group will interfere with each other.
+         */
+        int sendLarge(uint8_t *buffer, int len);
+
+        /**
+         * Transmits the given buffer onto the broadcast radio, split into as many fragments as are needed.
+         *
+         * This is a synchronous call that will wait until the transmission of the last fragment
+         * has completed before returning.
+         *
+         * @param data The datagram contents to transmit.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the buffer is empty or
+         *         larger than MICROBIT_RADIO_LARGE_MAX_SIZE.
+         */
+        int sendLarge(PacketBuffer data);
+
+        /**
+         * Retrieves a large datagram, reassembled from the fragments sent by sendLarge().
+         *
+         * If a datagram is already available, then it will be returned immediately to the caller.
+         * A MICROBIT_RADIO_EVT_LARGE_DATAGRAM event is raised as each one becomes available.
+         *
+         * @return the data received, or an empty PacketBuffer if no data is available.
+         */
+        PacketBuffer recvLarge();
+
         /**
          * Protocol handler callback. This is called when the radio receives a packet marked as a datagram.
          *
          * This function process this packet, and queues it for user reception.
          */
         void packetReceived();
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as a fragment.
+         *
+         * This function copies the fragment into the reassembly buffer, and queues the datagram for user
+         * reception once all of its fragments have been received.
+         */
+        void fragmentReceived();
     };
 }
 
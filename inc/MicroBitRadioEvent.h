@@ -29,6 +29,17 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitRadio.h"
 #include "codal-core/inc/types/Event.h"
 
+// Events raised within this many milliseconds of the first are sent together in one frame. Zero sends each event at once.
+#ifndef MICROBIT_RADIO_EVENT_BATCH_WINDOW
+#define MICROBIT_RADIO_EVENT_BATCH_WINDOW       5
+#endif
+
+// Frame versions. Version 1 frames carry a single Event, version 2 frames carry a list of (id, value) pairs.
+#define MICROBIT_RADIO_EVENT_VERSION_SINGLE     1
+#define MICROBIT_RADIO_EVENT_VERSION_BATCH      2
+#define MICROBIT_RADIO_EVENT_PAIR_SIZE          4
+#define MICROBIT_RADIO_EVENT_BATCH_SIZE         (MICROBIT_RADIO_MAX_PACKET_SIZE / MICROBIT_RADIO_EVENT_PAIR_SIZE)
+
 namespace codal
 {
     /**
@@ -48,6 +59,19 @@ namespace codal
     {
         bool            suppressForwarding;     // A private flag used to prevent event forwarding loops.
         MicroBitRadio   &radio;                 // A reference to the underlying radio module to use.
+        uint16_t        batchWindow;            // The time (in milliseconds) over which events are gathered into one frame.
+        uint8_t         batchLength;            // The number of events gathered so far.
+        uint16_t        batch[MICROBIT_RADIO_EVENT_BATCH_SIZE * 2];  // (id, value) pairs of the events gathered so far.
+
+        /**
+         * Transmits the events gathered so far, in a single frame.
+         */
+        void flush();
+
+        /**
+         * Event handler callback, called when the batch window closes.
+         */
+        void flushEvent(Event e);
 
         public:
 
@@ -125,17 +149,28 @@ namespace codal
          */
         int ignore(uint16_t id, uint16_t value, EventModel &eventBus);
 
+        /**
+         * Sets the time over which forwarded events are gathered into a single frame. Batching reduces radio airtime
+         * and processing at high event rates, at the cost of a little latency.
+         *
+         * @param window The batch window in milliseconds, or zero to transmit each event as soon as it is raised.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the window is negative or too long.
+         */
+        int setBatchWindow(int window);
+
         /**
          * Protocol handler callback. This is called when the radio receives a packet marked as using the event protocol.
          *
-         * This function process this packet, and fires the event contained inside onto the default EventModel.
+         * This function process this packet, and fires the events contained inside onto the default EventModel.
          */
         void packetReceived();
 
         /**
          * Event handler callback. This is called whenever an event is received matching one of those registered through
-         * the registerEvent() method described above. Upon receiving such an event, it is wrapped into
-         * a radio packet and transmitted to any other micro:bits in the same group.
+         * the registerEvent() method described above. Upon receiving such an event, it is gathered into
+         * a radio packet with any others raised within the batch window, and transmitted to any other
+         * micro:bits in the same group.
          */
         void eventReceived(Event e);
     };
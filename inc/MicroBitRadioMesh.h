@@ -0,0 +1,212 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#ifndef MICROBIT_RADIO_MESH_H
+#define MICROBIT_RADIO_MESH_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "PacketBuffer.h"
+
+// Frame layout. Each frame starts with the serial number of the micro:bit that originated it, and that node's
+// sequence number for it, which together identify the message across the mesh. These are followed by the number
+// of hops the message may still travel, and the number it has travelled so far.
+#define MICROBIT_RADIO_MESH_HEADER_SIZE         8
+#define MICROBIT_RADIO_MESH_PAYLOAD_SIZE        (MICROBIT_RADIO_MAX_PACKET_SIZE - MICROBIT_RADIO_MESH_HEADER_SIZE)
+
+// Number of hops a message may travel by default, including the first.
+#ifndef MICROBIT_RADIO_MESH_DEFAULT_TTL
+#define MICROBIT_RADIO_MESH_DEFAULT_TTL         4
+#endif
+
+// Number of recently seen messages remembered, so that copies heard again are not delivered or forwarded twice.
+#ifndef MICROBIT_RADIO_MESH_CACHE_SIZE
+#define MICROBIT_RADIO_MESH_CACHE_SIZE          16
+#endif
+
+// Number of received messages that may be held awaiting recv(). Further messages are still forwarded, but not delivered.
+#ifndef MICROBIT_RADIO_MESH_RX_QUEUE_SIZE
+#define MICROBIT_RADIO_MESH_RX_QUEUE_SIZE       4
+#endif
+
+// Number of messages that may be awaiting rebroadcast at once. Further messages are delivered, but not forwarded.
+#ifndef MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE
+#define MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE  4
+#endif
+
+// Bounds of the random delay (in microseconds) before a message is rebroadcast. Spreading rebroadcasts out keeps
+// the neighbours of a sender from all transmitting at once, and gives each time to hear the others.
+#ifndef MICROBIT_RADIO_MESH_DELAY_MIN
+#define MICROBIT_RADIO_MESH_DELAY_MIN           2000
+#endif
+
+#ifndef MICROBIT_RADIO_MESH_DELAY_MAX
+#define MICROBIT_RADIO_MESH_DELAY_MAX           30000
+#endif
+
+// Number of neighbours heard rebroadcasting a message, while our own rebroadcast of it waits, after which ours is
+// abandoned. In a dense mesh this keeps the number of transmissions of each message close to the number of hops,
+// rather than the number of nodes.
+#ifndef MICROBIT_RADIO_MESH_REDUNDANCY
+#define MICROBIT_RADIO_MESH_REDUNDANCY          2
+#endif
+
+namespace codal
+{
+    struct MicroBitRadioMeshId
+    {
+        uint32_t        origin;                 // The serial number of the micro:bit that originated the message.
+        uint16_t        seq;                    // The originator's sequence number for the message.
+    };
+
+    struct MicroBitRadioMeshForward
+    {
+        FrameBuffer     *frame;                 // The frame to rebroadcast, with its hop counts already updated, or NULL if unused.
+        uint32_t        due;                    // The time (in microseconds) at which the frame is to be rebroadcast.
+        uint8_t         heard;                  // The number of copies of the message heard from neighbours since it was queued.
+    };
+
+    /**
+     * Provides multi-hop broadcast delivery between micro:bits, by flooding messages over MicroBitRadio.
+     *
+     * Every node rebroadcasts each message it hears for the first time, until the message has travelled its
+     * allowed number of hops. Nodes remember the messages they have seen recently so that copies arriving by
+     * other routes are discarded, wait for a random time before rebroadcasting, and abandon a rebroadcast
+     * altogether if enough neighbours are heard forwarding the same message first.
+     *
+     * All nodes in the mesh must share a radio group, and have forwarding enabled to relay messages for others.
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioMesh
+    {
+        MicroBitRadio               &radio;                                             // The underlying radio module used to send and receive data.
+        MicroBitRadioMeshId         cache[MICROBIT_RADIO_MESH_CACHE_SIZE];              // The messages seen most recently.
+        uint8_t                     cacheNext;                                          // The cache entry to be replaced next.
+        FrameBuffer                 *rxQueue[MICROBIT_RADIO_MESH_RX_QUEUE_SIZE];        // Messages received, awaiting recv().
+        uint8_t                     rxHead;                                             // The index in rxQueue of the oldest message.
+        uint8_t                     rxDepth;                                            // The number of messages in rxQueue.
+        MicroBitRadioMeshForward    forwardQueue[MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE]; // Messages awaiting rebroadcast.
+        uint16_t                    nextSeq;                                            // The sequence number of the next message we originate.
+        bool                        seeded;                                             // true once nextSeq has been given a random starting point.
+        bool                        forwarding;                                         // true if messages from other nodes are rebroadcast.
+
+        /**
+         * Records a message as seen.
+         *
+         * @return true if the message was already in the cache, false if it is new.
+         */
+        bool seen(uint32_t origin, uint16_t seq);
+
+        /**
+         * Queues a copy of a received frame for rebroadcast after a random delay, with one fewer hop to travel.
+         */
+        void forward(FrameBuffer *packet);
+
+        /**
+         * Notes that a neighbour has rebroadcast a message, abandoning our own rebroadcast of it if enough have.
+         */
+        void overheard(uint32_t origin, uint16_t seq);
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * Creates an instance of MicroBitRadioMesh which offers multi-hop broadcast
+         * delivery of data to other micro:bits beyond the range of a single radio hop.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioMesh(MicroBitRadio &r);
+
+        /**
+         * Broadcasts the given buffer across the mesh.
+         *
+         * @param buffer The data to send.
+         *
+         * @param len The number of bytes to send, up to MICROBIT_RADIO_MESH_PAYLOAD_SIZE.
+         *
+         * @param ttl The number of hops the message may travel, in the range 1..255. A value of 1 reaches only our neighbours.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the parameters are invalid, or the error
+         *         from MicroBitRadio::sendAsync() if the radio cannot transmit.
+         */
+        int send(uint8_t *buffer, int len, int ttl = MICROBIT_RADIO_MESH_DEFAULT_TTL);
+
+        /**
+         * Broadcasts the given buffer across the mesh.
+         *
+         * @param data The data to send.
+         *
+         * @param ttl The number of hops the message may travel, in the range 1..255. A value of 1 reaches only our neighbours.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the parameters are invalid, or the error
+         *         from MicroBitRadio::sendAsync() if the radio cannot transmit.
+         */
+        int send(PacketBuffer data, int ttl = MICROBIT_RADIO_MESH_DEFAULT_TTL);
+
+        /**
+         * Retrieves the next message received from the mesh.
+         * A MICROBIT_RADIO_EVT_MESH_DATA event is raised as messages become available.
+         *
+         * @param origin If not NULL, set to the serial number of the micro:bit that originated the message.
+         *
+         * @param hops If not NULL, set to the number of hops the message travelled to reach us, 1 meaning it was heard directly.
+         *
+         * @return the data received, or an empty PacketBuffer if no data is available. The RSSI is that of the last hop.
+         */
+        PacketBuffer recv(uint32_t *origin = NULL, int *hops = NULL);
+
+        /**
+         * Enables or disables the rebroadcast of messages originated by other nodes. Enabled by default.
+         * Messages are received either way.
+         *
+         * @param enabled true to relay messages for other nodes, false to act only as an end point.
+         */
+        void setForwarding(bool enabled);
+
+        /**
+         * Determines if messages originated by other nodes are rebroadcast.
+         *
+         * @return true if forwarding is enabled, false otherwise.
+         */
+        bool isForwarding();
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as using the mesh protocol.
+         *
+         * This function delivers and forwards messages not seen before, and discards the rest.
+         */
+        void packetReceived();
+
+        /**
+         * Periodic callback, from MicroBitRadio's idle callback. Rebroadcasts messages whose delay has expired.
+         */
+        void idleCallback();
+    };
+}
+
+#endif
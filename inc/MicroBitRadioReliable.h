@@ -0,0 +1,224 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 British Broadcasting Corporation.
+This software is provided by Lancaster University by arrangement with the BBC.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RADIO_RELIABLE_H
+#define MICROBIT_RADIO_RELIABLE_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "PacketBuffer.h"
+
+// Frame layout. Each frame starts with its type and the serial numbers of its source and destination.
+// DATA frames then carry their sequence number and the sender's oldest unacknowledged sequence number.
+// ACK frames carry the next sequence number expected in order, and a bitmap of the frames received beyond it.
+#define MICROBIT_RADIO_RELIABLE_HEADER_SIZE     11
+#define MICROBIT_RADIO_RELIABLE_PAYLOAD_SIZE    (MICROBIT_RADIO_MAX_PACKET_SIZE - MICROBIT_RADIO_RELIABLE_HEADER_SIZE)
+
+// Frame types
+#define MICROBIT_RADIO_RELIABLE_DATA            0
+#define MICROBIT_RADIO_RELIABLE_ACK             1
+
+// Number of frames that may be in flight to (and buffered from) each peer.
+#ifndef MICROBIT_RADIO_RELIABLE_WINDOW
+#define MICROBIT_RADIO_RELIABLE_WINDOW          8
+#endif
+
+#if MICROBIT_RADIO_RELIABLE_WINDOW > 8
+    #error "MICROBIT_RADIO_RELIABLE_WINDOW cannot be larger than the 8 bit selective acknowledgement bitmap"
+#endif
+
+// Number of peers for which transport state is held. Idle peers are evicted to make room for new ones.
+#ifndef MICROBIT_RADIO_RELIABLE_PEERS
+#define MICROBIT_RADIO_RELIABLE_PEERS           4
+#endif
+
+// Retransmission timeout bounds (in microseconds). The timeout adapts to the measured round trip time between these.
+#ifndef MICROBIT_RADIO_RELIABLE_RTO_INITIAL
+#define MICROBIT_RADIO_RELIABLE_RTO_INITIAL     20000
+#endif
+
+#ifndef MICROBIT_RADIO_RELIABLE_RTO_MIN
+#define MICROBIT_RADIO_RELIABLE_RTO_MIN         2000
+#endif
+
+#ifndef MICROBIT_RADIO_RELIABLE_RTO_MAX
+#define MICROBIT_RADIO_RELIABLE_RTO_MAX         1000000
+#endif
+
+// Number of times a frame is retransmitted before the peer is considered unreachable.
+#ifndef MICROBIT_RADIO_RELIABLE_MAX_RETRIES
+#define MICROBIT_RADIO_RELIABLE_MAX_RETRIES     8
+#endif
+
+// Number of in order frames received before an acknowledgement is sent. Out of order and duplicate frames are acknowledged at once.
+#ifndef MICROBIT_RADIO_RELIABLE_ACK_EVERY
+#define MICROBIT_RADIO_RELIABLE_ACK_EVERY       2
+#endif
+
+namespace codal
+{
+    struct MicroBitRadioPeer
+    {
+        uint32_t        id;                                         // The serial number of the peer.
+        FrameBuffer     *tx[MICROBIT_RADIO_RELIABLE_WINDOW];        // Frames sent but not yet acknowledged, indexed by sequence number.
+        uint32_t        txTime[MICROBIT_RADIO_RELIABLE_WINDOW];     // The time (in microseconds) each frame was last transmitted.
+        uint8_t         txRetries[MICROBIT_RADIO_RELIABLE_WINDOW];  // The number of times each frame has been retransmitted.
+        uint8_t         txBase;                                     // The oldest unacknowledged sequence number.
+        uint8_t         txNext;                                     // The sequence number of the next frame to be sent.
+        FrameBuffer     *rx[MICROBIT_RADIO_RELIABLE_WINDOW];        // Frames received but not yet read, indexed by sequence number.
+        uint8_t         rxRead;                                     // The sequence number of the next frame to be read.
+        uint8_t         rxNext;                                     // The first sequence number not yet received in order.
+        uint8_t         ackPending;                                 // The number of frames received since the last acknowledgement.
+        bool            failed;                                     // true if frames to this peer were abandoned since the last flush().
+        uint32_t        srtt;                                       // Smoothed round trip time (in microseconds).
+        uint32_t        rttvar;                                     // Round trip time variation (in microseconds).
+        uint32_t        rto;                                        // Retransmission timeout (in microseconds).
+        CODAL_TIMESTAMP lastActive;                                 // The time a frame was last exchanged with this peer.
+    };
+
+    /**
+     * Provides a reliable, ordered, point to point transport between micro:bits, built upon MicroBitRadio.
+     *
+     * Peers are addressed by their serial number. Frames are numbered per peer, delivered in order, and
+     * acknowledged with a cumulative acknowledgement plus a selective acknowledgement bitmap. Up to
+     * MICROBIT_RADIO_RELIABLE_WINDOW frames may be in flight to each peer, and lost frames are retransmitted
+     * after a timeout that adapts to the measured round trip time.
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioReliable
+    {
+        MicroBitRadio       &radio;                                 // The underlying radio module used to send and receive data.
+        MicroBitRadioPeer   *peers[MICROBIT_RADIO_RELIABLE_PEERS];  // Transport state for each peer, allocated on demand.
+        uint8_t             nextPeer;                               // The peer to be considered first by recv(), for fairness.
+
+        /**
+         * Finds the transport state held for the given peer.
+         *
+         * @param id The serial number of the peer.
+         *
+         * @param create If true, allocate state for the peer if none is held, evicting the least recently active idle peer if necessary.
+         *
+         * @return the peer's state, or NULL if none is held and none could be allocated.
+         */
+        MicroBitRadioPeer* getPeer(uint32_t id, bool create);
+
+        /**
+         * (Re)transmits the given unacknowledged frame to a peer.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the radio transmit queue is full.
+         */
+        int transmit(MicroBitRadioPeer *peer, uint8_t seq);
+
+        /**
+         * Sends an acknowledgement of the frames received from a peer.
+         */
+        void sendAck(MicroBitRadioPeer *peer);
+
+        /**
+         * Releases an acknowledged frame, and (if it was not retransmitted) uses it to update the peer's round trip time estimate.
+         */
+        void acknowledge(MicroBitRadioPeer *peer, uint8_t seq);
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * Creates an instance of MicroBitRadioReliable which offers reliable, ordered
+         * delivery of data to other micro:bits in the vicinity.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioReliable(MicroBitRadio &r);
+
+        /**
+         * Queues the given buffer for reliable delivery to a peer.
+         *
+         * Returns as soon as the frame has been sent for the first time, waiting only if the window of
+         * frames awaiting acknowledgement from that peer is full. Use flush() to wait for delivery.
+         *
+         * @param destination The serial number of the micro:bit to send to.
+         *
+         * @param buffer The data to send.
+         *
+         * @param len The number of bytes to send, up to MICROBIT_RADIO_RELIABLE_PAYLOAD_SIZE.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the parameters are invalid,
+         *         MICROBIT_NO_RESOURCES if no state could be allocated for the peer, or the error from
+         *         MicroBitRadio::sendAsync() if the radio cannot transmit.
+         */
+        int send(uint32_t destination, uint8_t *buffer, int len);
+
+        /**
+         * Queues the given buffer for reliable delivery to a peer.
+         *
+         * @param destination The serial number of the micro:bit to send to.
+         *
+         * @param data The data to send.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the parameters are invalid, or
+         *         MICROBIT_NO_RESOURCES if no state could be allocated for the peer.
+         */
+        int send(uint32_t destination, PacketBuffer data);
+
+        /**
+         * Waits until all frames sent to a peer have been acknowledged, or abandoned.
+         *
+         * @param destination The serial number of the micro:bit.
+         *
+         * @return MICROBIT_OK if all frames were delivered, or MICROBIT_CANCELLED if frames were abandoned
+         *         after MICROBIT_RADIO_RELIABLE_MAX_RETRIES retransmissions since the last call.
+         */
+        int flush(uint32_t destination);
+
+        /**
+         * Retrieves the next frame received in order from any peer.
+         * A MICROBIT_RADIO_EVT_RELIABLE_DATA event is raised as frames become available.
+         *
+         * @param source If not NULL, set to the serial number of the micro:bit that sent the frame.
+         *
+         * @return the data received, or an empty PacketBuffer if no data is available.
+         */
+        PacketBuffer recv(uint32_t *source = NULL);
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as using the reliable protocol.
+         *
+         * This function stores new data frames for recv() and acknowledges them, and releases acknowledged frames.
+         */
+        void packetReceived();
+
+        /**
+         * Periodic callback, from MicroBitRadio's idle callback. Retransmits frames whose acknowledgement has
+         * timed out, and sends any delayed acknowledgements.
+         */
+        void idleCallback();
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 British Broadcasting Corporation.
+This software is provided by Lancaster University by arrangement with the BBC.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RADIO_TDMA_H
+#define MICROBIT_RADIO_TDMA_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "codal-core/inc/types/Event.h"
+
+#define DEVICE_ID_RADIO_TDMA                    3031
+
+// Timer events, raised on DEVICE_ID_RADIO_TDMA and handled in interrupt context.
+#define MICROBIT_RADIO_TDMA_EVT_SUPERFRAME      1       // The beacon node's superframe begins.
+#define MICROBIT_RADIO_TDMA_EVT_SLOT_START      2       // Our transmit slot begins.
+#define MICROBIT_RADIO_TDMA_EVT_SLOT_END        3       // Our transmit slot ends.
+#define MICROBIT_RADIO_TDMA_EVT_SYNC_LOST       4       // No beacon has been heard for MICROBIT_RADIO_TDMA_SYNC_TIMEOUT superframes.
+
+// Frame types
+#define MICROBIT_RADIO_TDMA_BEACON              0
+#define MICROBIT_RADIO_TDMA_JOIN                1
+
+// Modes
+#define MICROBIT_RADIO_TDMA_OFF                 0
+#define MICROBIT_RADIO_TDMA_NODE                1
+#define MICROBIT_RADIO_TDMA_BEACON_NODE         2
+
+// Superframe layout. Slot 0 carries the beacon (and any data from the beacon node), slot 1 is shared by nodes
+// without an assignment, and the remaining slots are assigned one per node by the beacon.
+#define MICROBIT_RADIO_TDMA_FIRST_SLOT          2
+#define MICROBIT_RADIO_TDMA_MAX_SLOTS           32
+#define MICROBIT_RADIO_TDMA_BEACON_HEADER_SIZE  4
+#define MICROBIT_RADIO_TDMA_ASSIGNMENT_SIZE     5
+
+#ifndef MICROBIT_RADIO_TDMA_DEFAULT_SLOTS
+#define MICROBIT_RADIO_TDMA_DEFAULT_SLOTS       10
+#endif
+
+// Slot length (in microseconds). At 1Mbit, a full frame takes around 450us on air, including transmitter ramp up.
+#ifndef MICROBIT_RADIO_TDMA_DEFAULT_SLOT_LENGTH
+#define MICROBIT_RADIO_TDMA_DEFAULT_SLOT_LENGTH 2000
+#endif
+
+// Time (in microseconds) at the end of each slot in which no new frame is started, so the last one finishes in time.
+#ifndef MICROBIT_RADIO_TDMA_GUARD_TIME
+#define MICROBIT_RADIO_TDMA_GUARD_TIME          500
+#endif
+
+// Number of superframes without a beacon after which a node falls back to transmitting at will.
+#ifndef MICROBIT_RADIO_TDMA_SYNC_TIMEOUT
+#define MICROBIT_RADIO_TDMA_SYNC_TIMEOUT        4
+#endif
+
+namespace codal
+{
+    /**
+     * Provides an optional time division multiple access (TDMA) mode for MicroBitRadio.
+     *
+     * One micro:bit in the group acts as the beacon node. At the start of each superframe it broadcasts a beacon
+     * carrying the slot layout and a rotating list of slot assignments. Other nodes synchronise to the end of each beacon
+     * they receive, ask for a slot in the shared slot, and from then on only transmit during their own slot. Frames
+     * sent at other times are held in the MicroBitRadio transmit queue until the slot begins.
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioTDMA
+    {
+        MicroBitRadio       &radio;                                         // The underlying radio module used to send and receive data.
+        uint8_t             mode;                                           // One of MICROBIT_RADIO_TDMA_OFF/NODE/BEACON_NODE.
+        uint8_t             slots;                                          // The number of slots in each superframe.
+        uint16_t            slotLength;                                     // The length of each slot (in microseconds).
+        uint8_t             slot;                                           // Our transmit slot.
+        bool                assigned;                                       // true if the beacon has assigned us a slot.
+        bool                synchronised;                                   // true if we have heard a beacon recently.
+        uint8_t             nextAssignment;                                 // The next assignment to advertise in a beacon.
+        uint32_t            assignments[MICROBIT_RADIO_TDMA_MAX_SLOTS];     // The serial number to which each slot is assigned, or 0.
+
+        /**
+         * Schedules the given timer event, replacing any matching event already scheduled.
+         */
+        void schedule(uint16_t event, uint32_t delay);
+
+        /**
+         * Cancels all scheduled timer events.
+         */
+        void cancelAll();
+
+        /**
+         * Builds and queues a beacon, advertising as many slot assignments as fit in a frame.
+         */
+        void sendBeacon();
+
+        /**
+         * Handles a beacon, synchronising our slot schedule to the time it was received.
+         */
+        void beaconReceived(FrameBuffer *packet);
+
+        /**
+         * Handles a request for a slot, assigning the first free slot to the node if it has none already.
+         */
+        void joinReceived(FrameBuffer *packet);
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioTDMA(MicroBitRadio &r);
+
+        /**
+         * Starts TDMA as the beacon node for the group.
+         *
+         * @param slots The number of slots in each superframe, in the range 3..MICROBIT_RADIO_TDMA_MAX_SLOTS.
+         *
+         * @param slotLength The length of each slot (in microseconds). Must exceed MICROBIT_RADIO_TDMA_GUARD_TIME.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the layout is invalid, or
+         *         MICROBIT_NO_RESOURCES if no default EventModel is available.
+         */
+        int startBeacon(int slots = MICROBIT_RADIO_TDMA_DEFAULT_SLOTS, int slotLength = MICROBIT_RADIO_TDMA_DEFAULT_SLOT_LENGTH);
+
+        /**
+         * Starts TDMA as an ordinary node. Until a beacon is heard, frames are transmitted at will.
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if no default EventModel is available.
+         */
+        int startNode();
+
+        /**
+         * Stops TDMA. Queued frames are transmitted at once, and subsequent frames are transmitted at will.
+         *
+         * @return MICROBIT_OK on success.
+         */
+        int stop();
+
+        /**
+         * Determines the slot in which we transmit.
+         *
+         * @return our assigned slot, 1 if we share the unassigned slot, 0 if we are the beacon node,
+         *         or MICROBIT_INVALID_STATE if TDMA is not active or not synchronised.
+         */
+        int getSlot();
+
+        /**
+         * Determines if our transmissions are currently confined to a slot.
+         *
+         * @return true if TDMA is active and synchronised to a beacon, false otherwise.
+         */
+        bool isSynchronised();
+
+        /**
+         * Discards all slot assignments made by the beacon node. Nodes will ask for new ones.
+         */
+        void resetAssignments();
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as using the TDMA protocol.
+         */
+        void packetReceived();
+
+        /**
+         * Timer event handler, called in interrupt context at slot boundaries.
+         */
+        void timerEvent(Event e);
+    };
+}
+
+#endif
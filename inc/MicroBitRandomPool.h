@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RANDOM_POOL_H
+#define MICROBIT_RANDOM_POOL_H
+
+#include "MicroBitConfig.h"
+
+// The number of bytes of entropy held in the pool. Must be a power of two.
+#ifndef MICROBIT_RANDOM_POOL_SIZE
+#define MICROBIT_RANDOM_POOL_SIZE               32
+#endif
+
+namespace codal
+{
+    /**
+     * Starts filling the random pool from the hardware random number generator, in the background.
+     *
+     * Values are collected by the RNG interrupt, with bias correction enabled, and the generator is stopped whenever
+     * the pool is full to save power. While the BLE stack is running it owns the generator, so the pool is
+     * instead topped up from the SoftDevice's own pool on demand.
+     */
+    void microbit_random_pool_start();
+
+    /**
+     * Stops filling the random pool from the hardware random number generator. Bytes already in the pool remain
+     * available. This is called before the BLE stack is started, which requires the generator to be free.
+     */
+    void microbit_random_pool_stop();
+
+    /**
+     * Determines if the random pool is being filled, either from the hardware or the SoftDevice.
+     *
+     * @return true if the pool is running, false otherwise.
+     */
+    bool microbit_random_pool_running();
+
+    /**
+     * Determines how many bytes of entropy can be taken from the pool immediately.
+     *
+     * @return The number of bytes available.
+     */
+    int microbit_random_available();
+
+    /**
+     * Takes bytes of entropy from the pool, without waiting for more to be generated. This may be called from any
+     * context, including interrupt handlers.
+     *
+     * @param buffer The buffer to fill.
+     * @param len The number of bytes required.
+     *
+     * @return The number of bytes written to the buffer, which may be fewer than len if the pool is running low.
+     */
+    int microbit_random_bytes(uint8_t *buffer, int len);
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#ifndef MICROBIT_SENSOR_CAPTURE_H
+#define MICROBIT_SENSOR_CAPTURE_H
+
+#include "CodalConfig.h"
+#include "MicroBitLog.h"
+#include "MicroBitThermometer.h"
+#include "NRF52LedMatrix.h"
+#include "codal-core/inc/driver-models/Accelerometer.h"
+#include "codal-core/inc/driver-models/Compass.h"
+
+#define MICROBIT_ID_SENSOR_CAPTURE              3039
+
+// Events, raised on MICROBIT_ID_SENSOR_CAPTURE and used internally.
+#define MICROBIT_SENSOR_CAPTURE_EVT_SAMPLE      1       // Timer event, on which every source is sampled.
+#define MICROBIT_SENSOR_CAPTURE_EVT_FLUSH       2       // Enough samples are buffered to be written to the log.
+
+// The most channels that can be captured: three for each of the accelerometer and compass, and one each for temperature and light level.
+#define MICROBIT_SENSOR_CAPTURE_MAX_CHANNELS    8
+
+// The number of samples of each channel held in memory, awaiting a write to the log.
+#ifndef MICROBIT_SENSOR_CAPTURE_BUFFER
+#define MICROBIT_SENSOR_CAPTURE_BUFFER          64
+#endif
+
+// The number of samples buffered before they are written to the log in a block.
+#ifndef MICROBIT_SENSOR_CAPTURE_FLUSH_THRESHOLD
+#define MICROBIT_SENSOR_CAPTURE_FLUSH_THRESHOLD 32
+#endif
+
+#if MICROBIT_SENSOR_CAPTURE_FLUSH_THRESHOLD > MICROBIT_SENSOR_CAPTURE_BUFFER
+    #error "MICROBIT_SENSOR_CAPTURE_FLUSH_THRESHOLD cannot be larger than MICROBIT_SENSOR_CAPTURE_BUFFER"
+#endif
+
+// The default time between samples (in milliseconds).
+#ifndef MICROBIT_SENSOR_CAPTURE_DEFAULT_PERIOD
+#define MICROBIT_SENSOR_CAPTURE_DEFAULT_PERIOD  20
+#endif
+
+namespace codal
+{
+    /**
+     * Captures readings from several sensors together into MicroBitLog.
+     *
+     * Every registered source is sampled on a single timer, and the readings are held in a ring buffer
+     * with one array per channel. Once enough have gathered, they are written to the log in a block
+     * through MicroBitLog::logRows(), in a fiber of their own so that sampling carries on meanwhile.
+     * Each row is stamped with the time it was sampled, rather than the time it was written.
+     *
+     * Every channel is a whole number, so rows are stored compactly if MicroBitLog::setBinaryFormat()
+     * (and, optionally, MicroBitLog::setCompression()) is enabled.
+     */
+    class MicroBitSensorCapture
+    {
+        MicroBitLog         &log;                                               // The log written to.
+        Accelerometer       *accelerometer;                                     // The accelerometer sampled, if any.
+        Compass             *compass;                                           // The compass sampled, if any.
+        MicroBitThermometer *thermometer;                                       // The thermometer sampled, if any.
+        NRF52LEDMatrix      *display;                                           // The display whose light level is sampled, if any.
+        int                 channels;                                           // The number of channels being captured.
+        int                 columnHandles[MICROBIT_SENSOR_CAPTURE_MAX_CHANNELS];// The log column of each channel.
+        int32_t             *samples;                                           // The buffered samples, MICROBIT_SENSOR_CAPTURE_BUFFER for each channel in turn.
+        CODAL_TIMESTAMP     *times;                                             // The time (in milliseconds) at which each row of samples was taken.
+        uint16_t            head;                                               // The index of the oldest buffered row.
+        uint16_t            count;                                              // The number of buffered rows, including any being sampled.
+        uint32_t            overruns;                                           // Rows lost because the buffer was full.
+        bool                running;                                            // true if sampling.
+        bool                flushing;                                           // true while buffered rows are being written to the log.
+        bool                sampling;                                           // true while the newest row is reserved, but not yet sampled.
+        int                 result;                                             // The result of the last write to the log.
+
+        /**
+         * Takes a sample from every source.
+         */
+        void onSample(Event);
+
+        /**
+         * Writes the buffered rows to the log.
+         */
+        void onFlush(Event);
+
+        /**
+         * Writes the buffered rows to the log, unless another fiber is already doing so.
+         */
+        void drain();
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param log The log to write to, e.g. MicroBit::log.
+         */
+        MicroBitSensorCapture(MicroBitLog &log);
+
+        /**
+         * Destructor. Stops capturing, if running.
+         */
+        ~MicroBitSensorCapture();
+
+        /**
+         * Adds the accelerometer as a source, captured in the "accel x", "accel y" and "accel z" columns, in milli-g.
+         *
+         * @param accelerometer The accelerometer to sample, e.g. MicroBit::accelerometer.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+         */
+        int addAccelerometer(Accelerometer &accelerometer);
+
+        /**
+         * Adds the compass as a source, captured in the "compass x", "compass y" and "compass z" columns, in nano teslas.
+         *
+         * @param compass The compass to sample, e.g. MicroBit::compass.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+         */
+        int addCompass(Compass &compass);
+
+        /**
+         * Adds the thermometer as a source, captured in the "temperature" column, in degrees Celsius.
+         *
+         * @param thermometer The thermometer to sample, e.g. MicroBit::thermometer.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+         */
+        int addThermometer(MicroBitThermometer &thermometer);
+
+        /**
+         * Adds the light level sensed by the display as a source, captured in the "light" column, from 0 to 255.
+         *
+         * @param display The display to sample, e.g. MicroBit::display.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+         */
+        int addLightLevel(NRF52LEDMatrix &display);
+
+        /**
+         * Starts capturing from every source added.
+         *
+         * @param period The time between samples (in milliseconds).
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the period is not positive, DEVICE_INVALID_STATE
+         * if no sources have been added, or DEVICE_NO_RESOURCES if no buffer could be allocated or no default EventModel is available.
+         */
+        int start(int period = MICROBIT_SENSOR_CAPTURE_DEFAULT_PERIOD);
+
+        /**
+         * Stops capturing, and writes any buffered rows to the log.
+         *
+         * @return DEVICE_OK on success, or the error from MicroBitLog::logRows() if the rows could not be written.
+         */
+        int stop();
+
+        /**
+         * Writes any buffered rows to the log, waiting for a write already in progress to complete.
+         *
+         * @return DEVICE_OK on success, or the error from MicroBitLog::logRows() if the rows could not be written.
+         */
+        int flush();
+
+        /**
+         * Determines if capture is running.
+         *
+         * @return true if running, false otherwise.
+         */
+        bool isRunning();
+
+        /**
+         * Determines the number of rows lost since capture started, because the log could not be written quickly enough.
+         *
+         * @return the number of rows lost.
+         */
+        uint32_t getOverrunCount();
+    };
+}
+
+#endif
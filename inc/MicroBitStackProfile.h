@@ -0,0 +1,108 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_STACK_PROFILE_H
+#define MICROBIT_STACK_PROFILE_H
+
+#include "MicroBitConfig.h"
+#include "CodalFiber.h"
+#include "codal-core/inc/driver-models/Serial.h"
+
+// The number of fibers whose stack depth can be recorded at once. Samples from any others are counted as unattributed.
+#ifndef MICROBIT_STACK_PROFILE_FIBERS
+#define MICROBIT_STACK_PROFILE_FIBERS               12
+#endif
+
+// The default number of samples taken per second.
+#ifndef MICROBIT_STACK_PROFILE_SAMPLE_RATE
+#define MICROBIT_STACK_PROFILE_SAMPLE_RATE          1000
+#endif
+
+typedef struct {
+    codal::Fiber *fiber;                                        // The fiber sampled.
+    uint32_t maxDepth;                                          // The deepest its stack was seen, in bytes below DEVICE_STACK_BASE.
+    uint32_t samples;                                           // The number of samples taken while it was running.
+    uint32_t savedBytes;                                        // The size of the buffer its stack is paged out into, in bytes.
+} MicroBitStackProfileRecord;
+
+namespace codal
+{
+    /**
+     * Starts sampling the stack depth of whichever fiber is running, from the SysTick interrupt at the lowest priority.
+     *
+     * Sampling continues until microbit_stack_profile_stop() is called. Watermarks are kept from one run to the next,
+     * until cleared with microbit_stack_profile_clear().
+     *
+     * @param rate the number of samples to take per second.
+     * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the rate is out of range, or MICROBIT_NOT_SUPPORTED
+     *         if CONFIG_MICROBIT_STACK_PROFILE is not enabled.
+     */
+    int microbit_stack_profile_start(uint32_t rate = MICROBIT_STACK_PROFILE_SAMPLE_RATE);
+
+    /**
+     * Stops sampling.
+     */
+    void microbit_stack_profile_stop();
+
+    /**
+     * Discards all watermarks and sample counts.
+     */
+    void microbit_stack_profile_clear();
+
+    /**
+     * Samples the stack depth of the calling fiber now. Placed at the deepest point of a path, e.g. with
+     * MICROBIT_STACK_SAMPLE(), this records its exact peak, which periodic sampling may miss.
+     */
+    void microbit_stack_sample();
+
+    /**
+     * Provides the watermarks recorded, one per fiber sampled, in the order the fibers were first seen.
+     *
+     * @param buffer the array to fill in.
+     * @param count the number of entries in the array.
+     * @return the number of entries filled in.
+     */
+    int microbit_stack_profile_read(MicroBitStackProfileRecord *buffer, int count);
+
+    /**
+     * Prints a report of the watermarks recorded to the given serial port.
+     *
+     * The output is a header line, "STACK <deepest> <stack size> <samples> <unattributed samples>", followed by one line
+     * per fiber of "FIBER <address> <max depth> <samples> <saved bytes>", and ends with "END". Depths are in bytes.
+     *
+     * @param serial the serial port to print to.
+     */
+    void microbit_stack_profile_print(Serial &serial);
+}
+
+//
+// Sampling macro, which compiles to nothing unless CONFIG_MICROBIT_STACK_PROFILE is enabled.
+//
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+#define MICROBIT_STACK_SAMPLE()                     codal::microbit_stack_sample()
+#else
+#define MICROBIT_STACK_SAMPLE()                     ((void) 0)
+#endif
+
+#endif
@@ -28,6 +28,11 @@ DEALINGS IN THE SOFTWARE.
 
 #define MICROBIT_THERMOMETER_PERIOD             1000
 
+// The number of measurements averaged into each sample. Each measurement takes around 36us.
+#ifndef MICROBIT_THERMOMETER_OVERSAMPLE
+#define MICROBIT_THERMOMETER_OVERSAMPLE         1
+#endif
+
 /*
  * Temperature events
  */
@@ -46,11 +51,27 @@ namespace codal
     {
         unsigned long           sampleTime;
         uint32_t                samplePeriod;
-        int16_t                 temperature;
+        volatile int16_t        temperature;
         int16_t                 offset;
+        volatile bool           measuring;          // true while a measurement by the TEMP peripheral is in progress.
+        volatile bool           sampleValid;        // true once the first sample has completed.
+        volatile uint8_t        measurements;       // The number of measurements taken towards the current sample.
+        volatile int32_t        measurementSum;     // The sum of those measurements, in quarter degrees.
+
+        /**
+         * Records a completed sample, schedules the next, and raises MICROBIT_THERMOMETER_EVT_UPDATE.
+         *
+         * @param sum the sum of MICROBIT_THERMOMETER_OVERSAMPLE measurements, in quarter degrees.
+         */
+        void sampleComplete(int32_t sum);
 
         public:
 
+        /**
+         * Completes a measurement started by updateSample(). Called from the TEMP interrupt.
+         */
+        void measurementComplete();
+
         /**
          * Constructor.
          * Create new MicroBitThermometer that gives an indication of the current temperature.
@@ -113,6 +134,9 @@ namespace codal
          * Updates the temperature sample of this instance of MicroBitThermometer
          * only if isSampleNeeded() indicates that an update is required.
          *
+         * Unless Bluetooth is running, the measurement is only started here, and completes in the
+         * background, raising MICROBIT_THERMOMETER_EVT_UPDATE from the TEMP interrupt.
+         *
          * This call also will add the thermometer to fiber components to receive
          * periodic callbacks.
          *
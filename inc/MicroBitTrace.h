@@ -0,0 +1,142 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_TRACE_H
+#define MICROBIT_TRACE_H
+
+#include "MicroBitConfig.h"
+#include "codal-core/inc/driver-models/Serial.h"
+#include "nrf.h"
+
+// The number of records held by the trace buffer. Must be a power of two. Each record takes 8 bytes.
+#ifndef MICROBIT_TRACE_BUFFER_SIZE
+#define MICROBIT_TRACE_BUFFER_SIZE                  256
+#endif
+
+//
+// Trace events (if CONFIG_MICROBIT_TRACE is enabled).
+// Events describing a span of time are recorded twice: once as they begin, and again with MICROBIT_TRACE_END set.
+//
+#define MICROBIT_TRACE_END                          0x8000      // Set on the record marking the end of a span.
+
+#define MICROBIT_TRACE_RADIO_IRQ                    1           // RADIO interrupt, both direct and in a timeslot. arg: NRF_RADIO->STATE.
+#define MICROBIT_TRACE_DISPLAY_RENDER               2           // NRF52LEDMatrix::render(). arg: the row being strobed.
+#define MICROBIT_TRACE_MIXER_PULL                   3           // Mixer2::pull().
+#define MICROBIT_TRACE_USB_FLASH_TRANSACT           4           // MicroBitUSBFlashManager::_transact(). arg: the request length.
+#define MICROBIT_TRACE_POWER_DEEP_SLEEP             5           // MicroBitPowerManager::deepSleep(). arg: the sleep time in ms (saturated), or 0 if indefinite.
+#define MICROBIT_TRACE_USER                         0x0100      // The first event id free for application use.
+
+typedef struct {
+    uint32_t time;                                              // The processor cycle count when the record was made.
+    uint16_t event;                                             // The event (one of MICROBIT_TRACE_*), with MICROBIT_TRACE_END if it ends a span.
+    uint16_t arg;                                               // Event specific data.
+} MicroBitTraceRecord;
+
+namespace codal
+{
+    extern MicroBitTraceRecord microbit_trace_buffer[MICROBIT_TRACE_BUFFER_SIZE];
+    extern volatile uint32_t microbit_trace_head;
+    extern volatile bool microbit_trace_enabled;
+
+    /**
+     * Records a trace event. Safe to call from any context, including interrupts of any priority, as each record
+     * claims its slot with a single atomic increment. The oldest records are overwritten once the buffer is full.
+     *
+     * @param event the event (one of MICROBIT_TRACE_*).
+     * @param arg event specific data.
+     */
+    static inline void microbit_trace(uint16_t event, uint16_t arg)
+    {
+        if (!microbit_trace_enabled)
+            return;
+
+        uint32_t i = __atomic_fetch_add(&microbit_trace_head, 1, __ATOMIC_RELAXED) & (MICROBIT_TRACE_BUFFER_SIZE - 1);
+        MicroBitTraceRecord &r = microbit_trace_buffer[i];
+
+        r.time = DWT->CYCCNT;
+        r.event = event;
+        r.arg = arg;
+    }
+
+    /**
+     * Starts recording trace events, enabling the processor cycle counter if necessary.
+     */
+    void microbit_trace_start();
+
+    /**
+     * Stops recording trace events. Those already recorded are kept.
+     */
+    void microbit_trace_stop();
+
+    /**
+     * Discards all trace events recorded.
+     */
+    void microbit_trace_clear();
+
+    /**
+     * Copies the trace events recorded, oldest first. Recording should be stopped first, as records made while
+     * copying may overwrite those being copied.
+     *
+     * @param buffer the array to copy records into.
+     * @param count the maximum number of records to copy.
+     * @param first the index of the first record to copy, counting from the oldest. Allows the buffer to be read in chunks.
+     *
+     * @return the number of records copied.
+     */
+    int microbit_trace_read(MicroBitTraceRecord *buffer, int count, int first = 0);
+
+    /**
+     * Prints the trace events recorded to the given serial port, oldest first.
+     *
+     * The output is a header line, "TRACE <records> <cycles per second>", followed by one line per record of
+     * "<time> <event> <arg>" in hexadecimal, and ends with "END". Times are raw cycle counts, which wrap every
+     * 2^32 cycles; records are in order, so wrapped times can be unwound by a decoder as it reads them.
+     *
+     * @param serial the serial port to print to.
+     */
+    void microbit_trace_print(Serial &serial);
+
+    /**
+     * Records the beginning of a span of time on construction, and its end on destruction.
+     */
+    class MicroBitTraceScope
+    {
+        uint16_t event;
+        uint16_t arg;
+
+        public:
+        MicroBitTraceScope(uint16_t e, uint16_t a) : event(e), arg(a) { microbit_trace(event, arg); }
+        ~MicroBitTraceScope() { microbit_trace(event | MICROBIT_TRACE_END, arg); }
+    };
+}
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_TRACE)
+#define MICROBIT_TRACE(e, a)                codal::microbit_trace((e), (a))
+#define MICROBIT_TRACE_SCOPE(e, a)          codal::MicroBitTraceScope microbitTraceScope((e), (a))
+#else
+#define MICROBIT_TRACE(e, a)
+#define MICROBIT_TRACE_SCOPE(e, a)
+#endif
+
+#endif
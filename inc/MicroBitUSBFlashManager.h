@@ -33,6 +33,7 @@ DEALINGS IN THE SOFTWARE.
 #include "codal-core/inc/driver-models/Pin.h"
 #include "MicroBitPowerManager.h"
 #include "NVMController.h"
+#include "CodalFiber.h"
 
 
 // Constants for USB Interface Flash Management Protocol
@@ -53,6 +54,34 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_USB_FLASH_MAX_RX_RETRIES           20
 #endif
 
+// The longest time (in ms) to wait for the interface chip to signal a response on its IRQ line before polling it anyway.
+#ifndef MICROBIT_USB_FLASH_POLL_PERIOD
+#define MICROBIT_USB_FLASH_POLL_PERIOD              1
+#endif
+
+// The longest time (in ms) a short write may be held, waiting to be combined with a following contiguous write.
+#ifndef MICROBIT_USB_FLASH_WRITE_DELAY
+#define MICROBIT_USB_FLASH_WRITE_DELAY              10
+#endif
+
+// The maximum number of bytes the interface chip accepts in a single write transaction.
+#define MICROBIT_USB_FLASH_MAX_WRITE_LENGTH         64
+
+// The maximum number of distinct ranges that can be queued by eraseAsync(). Contiguous ranges are merged.
+#ifndef MICROBIT_USB_FLASH_ERASE_QUEUE_SIZE
+#define MICROBIT_USB_FLASH_ERASE_QUEUE_SIZE         4
+#endif
+
+// Defines if writes initially compare against the existing contents of FLASH, and only send the bytes that differ (see setCompareBeforeWrite()).
+#ifndef CONFIG_MICROBIT_USB_FLASH_COMPARE_WRITES
+#define CONFIG_MICROBIT_USB_FLASH_COMPARE_WRITES    0
+#endif
+
+// When comparing before a write, differing runs of data separated by fewer than this many unchanged bytes are sent as one transaction.
+#ifndef MICROBIT_USB_FLASH_COMPARE_GAP
+#define MICROBIT_USB_FLASH_COMPARE_GAP              8
+#endif
+
 #ifndef MICROBIT_USB_FLASH_MAX_FLASH_STORAGE
 #define MICROBIT_USB_FLASH_MAX_FLASH_STORAGE        0x1F000
 #endif
@@ -74,6 +103,8 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_USB_FLASH_WRITE_CMD                0x0B            // Perform a WRITE operation from applicaiton FLASH memory.
 #define MICROBIT_USB_FLASH_ERASE_CMD                0x0C            // Perform a ERASE operation from applicaiton FLASH memory.
 
+#define MICROBIT_USB_FLASH_STATS_SIZE               (MICROBIT_USB_FLASH_ERASE_CMD + 1)
+
 namespace codal
 {
 
@@ -90,6 +121,12 @@ typedef struct
     uint8_t             blockCount;                                 // The number of available blocks on the disk
 } MicroBitUSBFlashGeometry;
 
+typedef struct
+{
+    uint32_t            address;                                    // The logical address of the first page to erase
+    uint32_t            length;                                     // The number of bytes to erase (a whole number of pages)
+} MicroBitUSBFlashEraseRequest;
+
 
 //
 // Component Status flags
@@ -101,6 +138,17 @@ typedef struct
 #define MICROBIT_USB_FLASH_USE_NULL_TRANSACTION     0x10
 #define MICROBIT_USB_FLASH_BUSY_FLAG_SUPPORTED      0x20
 #define MICROBIT_USB_FLASH_100MS_AFTER_ERASE        0x40
+#define MICROBIT_USB_FLASH_IRQ_LISTENER             0x80
+#define MICROBIT_USB_FLASH_WRITE_LISTENER           0x100
+#define MICROBIT_USB_FLASH_ERASING                  0x200
+#define MICROBIT_USB_FLASH_COMPARE_WRITES           0x400
+
+//
+// Events
+//
+#define MICROBIT_USB_FLASH_EVT_IRQ                  1               // The IRQ line has been asserted, or the poll period has elapsed.
+#define MICROBIT_USB_FLASH_EVT_FLUSH                2               // A pending write has been held for MICROBIT_USB_FLASH_WRITE_DELAY.
+#define MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE       3               // A range queued by eraseAsync() has been erased.
 
 
 /**
@@ -115,6 +163,15 @@ class MicroBitUSBFlashManager : public CodalComponent, public NVMController
         MicroBitUSBFlashConfig      config;                             // Current configuration of the USB File interface
         MicroBitUSBFlashGeometry    geometry;                           // Current geomtry of the USB File interface
         int                         maxWriteLength;                     // The maximum number of bytes that can be written in a single transaction.
+        uint8_t                     pendingData[MICROBIT_USB_FLASH_MAX_WRITE_LENGTH]; // Data held back to be combined with following contiguous writes.
+        uint32_t                    pendingAddress;                     // The address of the pending write.
+        uint32_t                    pendingLength;                      // The number of bytes held in pendingData, or zero if there is no pending write.
+        MicroBitUSBFlashEraseRequest eraseQueue[MICROBIT_USB_FLASH_ERASE_QUEUE_SIZE]; // Ranges waiting to be erased in the background. The first is in progress.
+        int                         eraseQueueLength;                   // The number of ranges in eraseQueue.
+        FiberLock                   transactionLock;                    // Ensures transactions from different fibers are not interleaved.
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+        MicroBitInterfaceStats      stats[MICROBIT_USB_FLASH_STATS_SIZE]; // Transaction statistics, indexed by command.
+#endif
 
     public:
         /**
@@ -232,6 +289,36 @@ class MicroBitUSBFlashManager : public CodalComponent, public NVMController
          */
         virtual int erase(uint32_t page) override;
 
+        /**
+         * Queues one or more whole pages to be erased in the background, and returns immediately.
+         * A MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE event is raised as each queued range is erased.
+         * Reads and writes to a queued range block until it has been erased. If the queue is full, this call blocks
+         * until space is available.
+         *
+         * @param address the logical address of the first page to erase. Must be page aligned.
+         * @param length the number of 32-bit words to erase. Must be a whole number of pages.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the range is invalid or not page aligned, or the error
+         *         from storing a pending write.
+         */
+        int eraseAsync(uint32_t address, uint32_t length);
+
+        /**
+         * Determines if any part of the given range is queued for erasure by eraseAsync(), and not yet erased.
+         *
+         * @param address the logical address of the start of the range.
+         * @param length the length of the range, in bytes.
+         * @return true if the range has an erase pending, false otherwise.
+         */
+        bool isErasePending(uint32_t address, uint32_t length);
+
+        /**
+         * Blocks the calling fiber until the given range has no erase pending.
+         *
+         * @param address the logical address of the start of the range.
+         * @param length the length of the range, in bytes.
+         */
+        void awaitErase(uint32_t address, uint32_t length);
+
 
         /**
          * Determines the logical address of the start of non-volatile memory region
@@ -264,6 +351,45 @@ class MicroBitUSBFlashManager : public CodalComponent, public NVMController
          */
         virtual uint32_t getFlashSize() override;
 
+        /**
+         * Sends any write held back to be combined with following writes to the interface chip.
+         * n.b. Pending writes are also sent automatically after MICROBIT_USB_FLASH_WRITE_DELAY, and before any
+         * conflicting read, erase or configuration operation.
+         *
+         * @return DEVICE_OK on success, or error code.
+         */
+        int flush();
+
+        /**
+         * Determines if each write first reads back the existing contents of FLASH, and only sends the 32-bit aligned runs
+         * of data that differ. Unchanged data is then never rewritten, reducing I2C traffic and interface chip FLASH wear
+         * for metadata heavy workloads, at the cost of a read transaction per write.
+         *
+         * @param enable true to compare before each write, false to always write all data.
+         */
+        void setCompareBeforeWrite(bool enable);
+
+        /**
+         * Retrieves statistics on transactions with the USB interface chip's flash interface for a given command.
+         * Statistics are only collected if CONFIG_MICROBIT_INTERFACE_STATS is enabled.
+         *
+         * @param command the command to query (one of MICROBIT_USB_FLASH_*_CMD).
+         * @return the statistics for the given command, or NULL if statistics are disabled or the command is invalid.
+         */
+        const MicroBitInterfaceStats *getStats(int command);
+
+        /**
+         * Reset all transaction statistics to zero.
+         */
+        void resetStats();
+
+        /**
+         * Print the statistics for each command with recorded transactions to the given serial port.
+         *
+         * @param serial the serial port to print to.
+         */
+        void printStats(Serial &serial);
+
         /**
          * Destructor.
          */
@@ -287,6 +413,50 @@ class MicroBitUSBFlashManager : public CodalComponent, public NVMController
          */
         ManagedBuffer transact(int command);
 
+        /**
+         * Writes a single segment of data of no more than maxWriteLength bytes to the interface chip.
+         * If compare before write is enabled, only the runs of data that differ from the existing contents are sent.
+         *
+         * @param address the location to write to. Must be 32 bit aligned.
+         * @param data a buffer containing the data to write.
+         * @param length the number of bytes to write.
+         * @return DEVICE_OK on success, or error code.
+         */
+        int writeSegment(uint32_t address, const uint8_t *data, uint32_t length);
+
+        /**
+         * Sends a single write transaction of no more than maxWriteLength bytes to the interface chip.
+         *
+         * @param address the location to write to. Must be 32 bit aligned.
+         * @param data a buffer containing the data to write.
+         * @param length the number of bytes to write.
+         * @return DEVICE_OK on success, or error code.
+         */
+        int sendSegment(uint32_t address, const uint8_t *data, uint32_t length);
+
+        /**
+         * Erases the ranges queued by eraseAsync(), in order.
+         * Runs in its own fiber, started by eraseAsync().
+         *
+         * @param manager the MicroBitUSBFlashManager instance to erase.
+         */
+        static void eraseTask(void *manager);
+
+        /**
+         * Event handler, called when a pending write has been held for MICROBIT_USB_FLASH_WRITE_DELAY.
+         */
+        void onFlushEvent(Event);
+
+        /**
+         * Blocks the calling fiber until the IRQ line is asserted, or MICROBIT_USB_FLASH_POLL_PERIOD has elapsed.
+         */
+        void awaitIrq();
+
+        /**
+         * Event handler, called when the IRQ line falls during a transaction.
+         */
+        void onIrq(Event);
+
         /**
          * Determines if the given char is valid for an 8.3 filename.
          */
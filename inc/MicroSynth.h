@@ -34,19 +34,49 @@ SOFTWARE.
 
 #define _PI 3.14159265359f
 
+// The share of each block period, in percent, that PolySynth may spend rendering voices. The number of voices
+// allowed to play at once is adjusted to fit, based on the measured cost of each voice.
+#ifndef CONFIG_POLYSYNTH_CPU_BUDGET
+#define CONFIG_POLYSYNTH_CPU_BUDGET 50
+#endif
+
+// Enable/Disable fixed point synthesis. If enabled, the per sample stages of each voice (oscillators, envelope,
+// filter and mixing) run in integer arithmetic, and integer output is packed directly for the mixer.
+// Parameters that are calculated once per block or note remain floating point. Set '1' to enable.
+#ifndef CONFIG_POLYSYNTH_FIXED_POINT
+#define CONFIG_POLYSYNTH_FIXED_POINT 0
+#endif
+
 namespace codal {
 
 
 static constexpr int SynthBlockSize = 256;
+// Voices are rendered in stages of this many samples, so that intermediate results fit in a small buffer on the stack.
+static constexpr int SynthStageSize = 32;
 static constexpr int SynthSampleRate = 44100;
 static constexpr float SynthSampleRate_f = static_cast<float>(SynthSampleRate);
 
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+typedef int32_t SynthSample;        // Q15 fixed point, with headroom above full scale
+static constexpr int SynthSampleBits = 15;
+#else
+typedef float SynthSample;          // full scale is -1 to 1
+#endif
+
+// Band limited wavetables, one per octave, used by the BLSaw and BLPulse oscillator types.
+static constexpr int SynthWaveTableBits = 8;
+static constexpr int SynthWaveTableSize = 1 << SynthWaveTableBits;
+static constexpr int SynthWaveTables = 10;
+static constexpr int SynthWaveBits = 14;        // fractional bits of each table entry
+static constexpr float SynthWaveBase = 27.5f;   // the first table serves notes up to twice this frequency
+
 /** 
  * Class containing certain precalculated synth data.
  */
 class SynthTables
 {
     static float notetab_[129]; // including guard point
+    static int16_t sawtab_[SynthWaveTables][SynthWaveTableSize + 1]; // including guard points
     static bool inited_;
 public:
     /**
@@ -60,13 +90,21 @@ public:
      * @return scale factor. Note number 69 returns 1.0
      */
     static float noteToScaler(float ind);
+    /**
+     * Get the band limited sawtooth table for an oscillator, with as many harmonics as fit below nyquist.
+     * @param delta oscillator phase increment per sample, as used by Oscillator
+     * @return table of SynthWaveTableSize + 1 entries (including guard point), in SynthWaveBits fixed point
+     */
+    static const int16_t* sawTable(float delta);
 };
 
 enum class OscType : uint8_t
 {
     Saw = 0,
     Pulse,
-    Triangle
+    Triangle,
+    BLSaw,      // band limited sawtooth, read from a wavetable
+    BLPulse     // band limited pulse, read from a wavetable as the difference of two sawtooths
 };
 
 enum class FilterType : uint8_t
@@ -152,6 +190,13 @@ public:
      * @reeturn filtered sample
      */
     float process(float x, FilterType f = FilterType::LPF);
+    /**
+     * Filter a block of samples in place.
+     * @param buf samples to filter
+     * @param num number of samples
+     * @param f filter type to use
+     */
+    void process(SynthSample* buf, int num, FilterType f);
     /**
      * Resets internal filter history.
      */
@@ -184,6 +229,12 @@ public:
      * @return envelope value
      */
     float process();
+    /**
+     * Generate a block of envelope values.
+     * @param buf buffer to write envelope values to
+     * @param num number of values to generate
+     */
+    void process(SynthSample* buf, int num);
     /** 
      * Set envelope gate state. 
      * @param g gate status. True for active gate. 
@@ -220,6 +271,7 @@ class Oscillator
 {
     float acc_ = 0.f, delta_ = 0.f, pw_ = 0.f;
     OscType wave_ = OscType::Saw;
+    const int16_t* table_ = nullptr; // wavetable for the current frequency, for band limited types
 public:
     /**
      * Generate a oscillator sample.
@@ -232,6 +284,20 @@ public:
      * @return oscillator sample 
      */
     float processPM(float pm);
+    /**
+     * Generate a block of oscillator samples.
+     * @param buf buffer to write samples to
+     * @param num number of samples to generate
+     */
+    void process(SynthSample* buf, int num);
+    /**
+     * Generate a block of oscillator samples with phase modulation.
+     * @param buf buffer to write samples to
+     * @param pm phase modulation source, scaled by amount to give values in range -1 to 1
+     * @param amount phase modulation amount
+     * @param num number of samples to generate
+     */
+    void processPM(SynthSample* buf, const SynthSample* pm, float amount, int num);
     /**
      * Set oscillator frequency.
      * @param f frequency in hz
@@ -265,13 +331,14 @@ class Voice
     float smoothedGate_;    // lowpass filtered gate for use instead of envelope
     int gateLength_ = -1;   // -1 means no preset time duration
     int8_t note_ = -1;      // -1 means inactive voice
+    uint32_t age_ = 0;      // samples rendered since triggered
     bool stopping_ = false; // set to true after we've received a note off
     const SynthPreset* preset_ = nullptr;
     int32_t noise_;         // linear congruential noise state
     void apply_preset();
     void set_note(float note);
-    // per sample process
-    float process();
+    // process one stage of at most SynthStageSize samples
+    void process_stage(SynthSample* buf, int num);
 public:
     Voice();
     /** 
@@ -279,7 +346,7 @@ public:
      * @param buf buffer to mix voice output into
      * @param num number of samples to generate
      */
-    void process(float* buf, int num);
+    void process(SynthSample* buf, int num);
     /** 
      * Trigger a new voice, potentially stealing an active voice to do so.
      * @param note MIDI note number
@@ -302,6 +369,20 @@ public:
     * @return true if not is in release phase, false if not
     */
     bool isStopping() const;
+    /**
+    * Get the current output level of the voice, used to choose which voice to steal.
+    * @return Amplitude envelope value, scaled by voice gain
+    */
+    float getLevel() const;
+    /**
+    * Get the age of the voice.
+    * @return Number of samples rendered since the voice was triggered
+    */
+    uint32_t getAge() const;
+    /**
+    * Deactivate the voice immediately, without a release phase.
+    */
+    void kill();
 };
 
 /** 
@@ -310,12 +391,16 @@ public:
 class PolySynth
 {
     Voice* voice_;
-    float mixbuf_[SynthBlockSize];
+    SynthSample mixbuf_[SynthBlockSize];
     int numVoices_;
+    int maxVoices_;         // number of voices that may currently be active, within the cpu budget
+    float voiceCycles_;     // smoothed processor cycles per sample spent rendering each voice
 
     int findVoice(int8_t note);
+    int findVictim();
+    int activeVoices() const;
     Voice& alloc(int note);
-    void process_noclip(float* buf, int num);
+    void process_noclip(SynthSample* buf, int num);
 public:
     PolySynth(int num_voices);
     ~PolySynth();
@@ -344,6 +429,12 @@ public:
     * @param num number of samples to generate
     */
     void process(uint16_t* buf, int num);
+    /**
+    * Get the number of voices that may currently play at once. This is reduced from the total number of voices
+    * when rendering them all would exceed CONFIG_POLYSYNTH_CPU_BUDGET.
+    * @return Voice limit
+    */
+    int getVoiceLimit() const;
 };
 
 /**
@@ -354,6 +445,9 @@ class PolySynthSource : public DataSource
     DataSink* downStream_;
     bool init_ = false;
     PolySynth& synth_;
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    AudioStats stats_;
+#endif
 public:
     /**
      * Constructor.
@@ -380,6 +474,16 @@ public:
      * @return next ManagedBuffer of audio
      */
     virtual ManagedBuffer pull() override;
+    /**
+     * Retrieves the cost of each pull made of this source.
+     * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+     * @return statistics for this source, or NULL if statistics are disabled
+     */
+    const AudioStats* getStats();
+    /**
+     * Resets the statistics of this source.
+     */
+    void resetStats();
 };
 
 } // namespace codal
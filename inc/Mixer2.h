@@ -26,6 +26,8 @@ DEALINGS IN THE SOFTWARE.
 #define CODAL_MIXER2_H
 
 #include "DataStream.h"
+#include "AudioBufferPool.h"
+#include "AudioStats.h"
 
 #ifndef CONFIG_MIXER_BUFFER_SIZE
 #define CONFIG_MIXER_BUFFER_SIZE 512
@@ -48,6 +50,13 @@ DEALINGS IN THE SOFTWARE.
 #define CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE  44100
 #endif
 
+// Enable/Disable integer mixing. If enabled, the mixer accumulates in fixed point rather than floating point,
+// using specialised inner loops for each input format, and saturating arithmetic where the processor supports it.
+// Set '1' to enable.
+#ifndef CONFIG_MIXER_FIXED_POINT
+#define CONFIG_MIXER_FIXED_POINT 0
+#endif
+
 #define DEVICE_ID_MIXER 3030
 
 #define DEVICE_MIXER_EVT_SILENCE 1
@@ -57,6 +66,25 @@ DEALINGS IN THE SOFTWARE.
 namespace codal
 {
 
+class MixerChannel;
+
+// A buffer of samples queued to play on a mixer channel at a given sample time. See MixerChannel::queueClip().
+struct MixerClip
+{
+    ManagedBuffer   buffer;                     // The samples to play, in the format of the channel.
+    uint64_t        time;                       // The mixer sample time at which the first sample is played.
+    MixerClip       *next;                      // The next clip queued on the same channel, in order of time.
+};
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+typedef int32_t MixerSample;                    // Mixer accumulator samples, in Q8 fixed point at CONFIG_MIXER_INTERNAL_RANGE scale.
+#else
+typedef float MixerSample;                      // Mixer accumulator samples, at CONFIG_MIXER_INTERNAL_RANGE scale.
+#endif
+
+// An inner loop that mixes samples from a channel into the accumulator. See Mixer2::selectKernel().
+typedef void (*MixerKernel)(MixerSample *out, int len, MixerChannel *ch);
+
 class MixerChannel : public DataSink
 {
 private:
@@ -77,9 +105,23 @@ private:
     float           volume;                     // Volume leve of channel, in the range 0..CONFIG_MIXER_INTERNAL_RANGE
     int             format;                     // Format of the data recieved on this channel (e.g. DATASTREAM_FORMAT_16BIT_UNSIGNED...)
     int             bytesPerSample;             // The number of bytes used in the input stream for each sample (optimisation)
+    MixerKernel     kernel;                     // The inner loop used to mix this channel, specialised for its format and rate.
+
+    uint64_t        startTime;                  // The mixer sample time before which this channel is held silent.
+    MixerClip       *clips;                     // Clips waiting to be played on this channel, in order of time.
 
     MixerChannel    *next;                      // Internal Linkage - list of all mixer channels
 
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    AudioStats      stats;                      // The cost of mixing this channel, including pulls from its source.
+#endif
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    AudioLatency    latency;                    // The latency of this channel, from production of each buffer to its playout.
+    uint32_t        stamp;                      // The production time of the current buffer, until its first sample is mixed.
+    uint32_t        mixedStamp;                 // The production time of the buffer that started in the last output buffer, or zero.
+    int             mixedOffset;                // The sample offset into the last output buffer at which that buffer started.
+#endif
+
     friend class    Mixer2;
 
 public:
@@ -88,7 +130,73 @@ public:
      * Deliver the next available ManagedBuffer to our downstream caller.
      */
     virtual int pullRequest();
-    virtual ~MixerChannel() {};
+
+    /**
+     * Destructor. Discards any queued clips.
+     */
+    virtual ~MixerChannel();
+
+    /**
+     * Determines if this channel is suspended. A channel is suspended once it has mixed all the data it has
+     * received, it has no clips queued, and its source has not issued a further pullRequest(). Sources that have nothing to play can
+     * therefore stop issuing pullRequests to remain silent until further notice, and the mixer will skip them.
+     *
+     * @return true if this channel has no data available to mix.
+     */
+    bool isSuspended();
+
+    /**
+     * Retrieves the cost of mixing this channel, including the time taken by its source to generate data.
+     * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+     *
+     * @return The statistics for this channel, or NULL if statistics are disabled.
+     */
+    const AudioStats *getStats();
+
+    /**
+     * Retrieves the measured latency of this channel, from the production of each buffer of samples by its source
+     * to the playout of its first sample. Latency is only measured if CONFIG_AUDIO_LATENCY is enabled.
+     *
+     * @return The latency statistics for this channel, or NULL if measurement is disabled.
+     */
+    const AudioLatency *getLatency();
+
+    /**
+     * Holds this channel silent until the mixer reaches the given sample time, then resumes mixing it from
+     * exactly that sample of the output. Data from the source is not consumed while the channel is held, so a
+     * source that starts generating as soon as it is connected (e.g. SoundEmojiSynthesizer::play()) begins
+     * playing at the requested sample rather than at the next buffer boundary.
+     *
+     * @param time The sample time to start at, as given by Mixer2::getSampleTime(). Times already passed start immediately.
+     * @return DEVICE_OK on success.
+     */
+    int startAt(uint64_t time);
+
+    /**
+     * Queues a buffer of samples to play on this channel, starting at the given sample time. Clips play in order
+     * of time, each beginning at exactly its own sample of the output, so a whole phrase can be submitted at once.
+     * A clip that falls due while the previous one (or data from the source) is still playing starts as soon as
+     * that finishes. Use a channel per voice for clips that need to overlap.
+     *
+     * @param clip The samples to play, in the format and at the sample rate of this channel.
+     * @param time The sample time at which to play the first sample, as given by Mixer2::getSampleTime().
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the clip is empty.
+     */
+    int queueClip(ManagedBuffer clip, uint64_t time);
+
+    /**
+     * Discards any clips queued on this channel that have not yet started to play.
+     *
+     * @return DEVICE_OK on success.
+     */
+    int clearClips();
+
+    /**
+     * Determines the number of clips queued on this channel that have not yet started to play.
+     *
+     * @return The number of queued clips.
+     */
+    int getClipCount();
 
     /**
      * @brief Changes the volume between 0 and CONFIG_MIXER_INTERNAL_RANGE
@@ -112,7 +220,7 @@ public:
     void setSampleRate( float rate ) {
         this->rate = rate;
         this->skip = 0.0f;
-        if( this->rate == DATASTREAM_SAMPLE_RATE_UNKNOWN )
+        if( this->rate == DATASTREAM_SAMPLE_RATE_UNKNOWN && stream )
             this->rate = stream->getSampleRate();
     }
 
@@ -130,7 +238,9 @@ class Mixer2 : public DataSource
 {
     MixerChannel    *channels;
     DataSink        *downStream;
-    float           mix[CONFIG_MIXER_BUFFER_SIZE];
+    MixerSample     *mix;                       // The accumulator, holding one entry per output sample.
+    int             mixLength;                  // The number of samples the accumulator holds.
+    int             bufferSize;                 // The size of each output buffer, in bytes.
     float           outputRange;
     float           outputRate;
     int             outputFormat;
@@ -141,6 +251,16 @@ class Mixer2 : public DataSource
     bool            silent;
     CODAL_TIMESTAMP silenceStartTime;
     CODAL_TIMESTAMP silenceEndTime;
+    AudioBufferPool outputPool;
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    AudioStats      stats;                      // The cost of each pull, and the number of late pulls from downstream.
+    CODAL_TIMESTAMP lastPullTime;
+#endif
+    ManagedBuffer   silenceBuffer;              // Cached output for when every channel is suspended, or empty if invalid.
+    uint64_t        sampleTime;                 // The number of output samples generated, i.e. the time of the next buffer.
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    AudioLatency    latency;                    // The latency of all channels together.
+#endif
 
 public:
     /**
@@ -167,6 +287,16 @@ public:
      */
     MixerChannel *addChannel(DataSource &stream, float sampleRate = CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE);
 
+    /**
+     * Add a new channel to the mixer, with no source, that plays only the clips queued on it. See MixerChannel::queueClip().
+     *
+     * @param format The format of the clips that will be queued on the channel (e.g. DATASTREAM_FORMAT_16BIT_SIGNED)
+     * @param sampleRate (samples per second) - if set to zero, defaults to the output sample rate of the Mixer
+     * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level of the clips
+     * @return The new channel, or NULL if the format is invalid.
+     */
+    MixerChannel *addClipChannel(int format, float sampleRate = CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE);
+
     /**
      * Removes a channel from the mixer
      * 
@@ -207,6 +337,8 @@ public:
      * DATASTREAM_FORMAT_16BIT_SIGNED
      * DATASTREAM_FORMAT_8BIT_UNSIGNED
      * DATASTREAM_FORMAT_8BIT_SIGNED
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the format is invalid or the buffer size is not a whole
+     * number of samples in it, or DEVICE_NO_RESOURCES if the accumulator could not be allocated.
      */
     virtual int setFormat(int format);
 
@@ -270,12 +402,30 @@ public:
      */
     int setSilenceLevel(float level);
     
+    /**
+     * Determines the mixer's sample clock: the number of output samples generated since it was created, which is
+     * the time of the first sample of the next buffer to be mixed. Add a number of samples at the output
+     * sample rate to schedule audio relative to now, e.g. getSampleTime() + getSampleRate() / 10 for 100ms.
+     *
+     * @return The current sample time.
+     */
+    uint64_t getSampleTime();
+
     /**
      * Determines if the mixer is silent
      * @return true if the mixer is silent
      */
     bool isSilent();
 
+    /**
+     * Determines if every channel of the mixer, other than the one given, is suspended.
+     * See MixerChannel::isSuspended().
+     *
+     * @param except A channel to disregard, or NULL to consider all channels.
+     * @return true if no channel (other than that given) has data available to mix.
+     */
+    bool isSuspended(MixerChannel *except = NULL);
+
     /**
      * Determines the time at which the mixer has most recently been generating silence 
      *
@@ -292,9 +442,65 @@ public:
      */
     CODAL_TIMESTAMP getSilenceEndTime();
 
+    /**
+     * Changes the size of the buffers generated by this mixer. Smaller buffers reduce output latency,
+     * whereas larger buffers reduce the CPU overhead of each pull.
+     *
+     * @param size The new buffer size, in bytes. This must be a positive multiple of the output sample size.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is invalid, or DEVICE_NO_RESOURCES
+     * if the accumulator could not be allocated.
+     */
+    int setBufferSize(int size);
+
+    /**
+     * Determines the size of the buffers generated by this mixer.
+     *
+     * @return The buffer size, in bytes.
+     */
+    int getBufferSize();
+
+    /**
+     * Determines the playout latency introduced by a single output buffer at the current
+     * buffer size, output format and sample rate.
+     *
+     * @return The latency in microseconds.
+     */
+    uint32_t getOutputLatency();
+
+    /**
+     * Retrieves the cost of each pull, and the number of pulls that arrived late from downstream (i.e. where
+     * the sink may have run out of data). Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+     *
+     * @return The statistics for this mixer, or NULL if statistics are disabled.
+     */
+    const AudioStats *getStats();
+
+    /**
+     * Retrieves the measured latency of the mixer output, from the production of each buffer of samples by any
+     * channel to the playout of its first sample. Latency is only measured if CONFIG_AUDIO_LATENCY is enabled.
+     *
+     * @return The latency statistics for the mixer, or NULL if measurement is disabled.
+     */
+    const AudioLatency *getLatency();
+
+    /**
+     * Resets the statistics of this mixer and all of its channels.
+     */
+    void resetStats();
+
+    /**
+     * Outputs the statistics of this mixer and each of its channels via DMESG.
+     */
+    void printStats();
 
     private:
+    MixerChannel *createChannel(DataSource *stream, float sampleRate, int sampleRange);
     void configureChannel(MixerChannel *c);
+    void selectKernel(MixerChannel *c);
+    int configureOutput(int size, int format);
+
+    template <int format, bool resample> static void accumulate(MixerSample *out, int len, MixerChannel *ch);
+    static void accumulateAny(MixerSample *out, int len, MixerChannel *ch);
 };
 
 } // namespace codal
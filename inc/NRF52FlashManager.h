@@ -28,6 +28,31 @@ DEALINGS IN THE SOFTWARE.
 #include "codal-core/inc/core/CodalComponent.h"
 #include "NVMController.h"
 
+#define MICROBIT_ID_FLASH_MANAGER               3035
+
+/*
+ * Flash events, raised on MICROBIT_ID_FLASH_MANAGER when an asynchronous operation ends.
+ */
+#define NRF52_FLASH_EVT_COMPLETE                1
+#define NRF52_FLASH_EVT_ERROR                   2
+#define NRF52_FLASH_EVT_POLL                    3       // Internal: advances an operation in progress.
+
+// The time (in ms) to wait before retrying an operation the SoftDevice couldn't accept.
+#define NRF52_FLASH_RETRY_INTERVAL              10
+
+// The cumulative erase time (in ms) after which a page is guaranteed to have been erased (tERASEPAGE).
+#define NRF52_FLASH_ERASE_TIME                  85
+
+// The length (in ms) of each slice of a partial erase, while the SoftDevice is disabled.
+#ifndef NRF52_FLASH_ERASE_SLICE
+#define NRF52_FLASH_ERASE_SLICE                 10
+#endif
+
+// The time (in ms) given over to the rest of the system between each slice of a partial erase.
+#ifndef NRF52_FLASH_ERASE_INTERVAL
+#define NRF52_FLASH_ERASE_INTERVAL              10
+#endif
+
 namespace codal
 {
 
@@ -41,6 +66,11 @@ class NRF52FlashManager : public NVMController
         uint32_t pageCount;
         uint32_t pageSize;
 
+        /**
+         * Registers for the events used to advance asynchronous operations, once the message bus is available.
+         */
+        void listen();
+
     public:
         /**
          * Constructor.
@@ -80,6 +110,49 @@ class NRF52FlashManager : public NVMController
          */
         virtual int erase(uint32_t page) override;
 
+        /**
+         * Starts writing data to the specified location, returning before the write has completed.
+         * NRF52_FLASH_EVT_COMPLETE or NRF52_FLASH_EVT_ERROR is raised on MICROBIT_ID_FLASH_MANAGER once it ends.
+         *
+         * While the SoftDevice is running the write is scheduled through it, in between radio activity.
+         * Otherwise, word writes are short enough that the write completes before this call returns.
+         *
+         * @param address the location to write to
+         * @param data a buffer containing the data to write, which must remain valid until the write ends.
+         * @param length the number of 32-bit words to write
+         *
+         * @return MICROBIT_OK on success, or MICROBIT_BUSY if another flash operation is in progress.
+         */
+        int writeAsync(uint32_t address, uint32_t *data, uint32_t length);
+
+        /**
+         * Starts erasing a given page, returning before the erase has completed.
+         * NRF52_FLASH_EVT_COMPLETE or NRF52_FLASH_EVT_ERROR is raised on MICROBIT_ID_FLASH_MANAGER once it ends.
+         *
+         * While the SoftDevice is running the erase is scheduled through it. Otherwise, the erase is split into
+         * partial erases of NRF52_FLASH_ERASE_SLICE ms each, with the rest of the system running in between.
+         *
+         * @param page The address of the page to erase (logical address of the start of the page).
+         *
+         * @return MICROBIT_OK on success, MICROBIT_BUSY if another flash operation is in progress,
+         * or MICROBIT_NOT_SUPPORTED if there is neither the SoftDevice nor a running scheduler to complete the erase.
+         */
+        int eraseAsync(uint32_t page);
+
+        /**
+         * Determines if a flash operation is in progress. Only one may be in progress at a time, across all instances.
+         *
+         * @return true if an operation is in progress, false otherwise.
+         */
+        static bool isBusy();
+
+        /**
+         * Waits for any flash operation in progress to end. The calling fiber sleeps while it does, if it can.
+         *
+         * @return MICROBIT_OK if the last operation succeeded, or MICROBIT_NOT_SUPPORTED if it failed.
+         */
+        static int wait();
+
 
         /**
          * Determines the logical address of the start of non-volatile memory region
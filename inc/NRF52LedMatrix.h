@@ -28,12 +28,52 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "LEDMatrix.h"
 #include "NRFLowLevelTimer.h"
+#include "AudioStats.h"
 
 #define NRF52_LED_MATRIX_CLOCK_FREQUENCY        16000000            // Frequency of underlying hardware clock (must b 1MHz, 2Mhz 4Mhz, 8Mhz or 16MHz)
 #define NRF52_LED_MATRIX_FREQUENCY              60                  // Frequency of the frame update for the display
 #define NRF52_LED_MATRIX_MAXIMUM_COLUMNS        5                   // The maximum number of LEDMatrix columns supported by the hardware.
 #define NRF52_LED_MATRIX_LIGHTSENSE_STROBES     4                   // Multiple of strobe period to use for light sense
 
+// Enable/Disable collection of the processor cycles spent in each display interrupt, and the frame rate.
+// Set '1' to enable.
+#ifndef CONFIG_NRF52_LED_MATRIX_STATS
+#define CONFIG_NRF52_LED_MATRIX_STATS 0
+#endif
+
+// The age, in milliseconds, beyond which readLightLevel() takes a new light reading rather than returning the last one.
+// Light is only sensed on request, so this also limits how often the display gives up a timeslot to sensing.
+#ifndef CONFIG_NRF52_LED_MATRIX_LIGHTSENSE_INTERVAL
+#define CONFIG_NRF52_LED_MATRIX_LIGHTSENSE_INTERVAL 100
+#endif
+
+// Enable/Disable direct row scanning. If enabled, the timer stops itself at the end of each row strobe, and render()
+// drives the row pins through their GPIO port registers rather than through NRF52Pin, so that each strobe interrupt
+// does little more than load the next precomputed row table. Set '1' to enable.
+#ifndef CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN
+#define CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN     0
+#endif
+
+// Enable/Disable adaptive refresh. If enabled, fully dark rows are skipped rather than strobed, and once the display has
+// been static for CONFIG_NRF52_LED_MATRIX_IDLE_FRAMES frames the refresh rate drops to CONFIG_NRF52_LED_MATRIX_IDLE_FREQUENCY,
+// until the display next changes. Set '1' to enable.
+#ifndef CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH
+#define CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH 0
+#endif
+
+// The frame rate used for a static display when adaptive refresh is enabled, in Hz.
+#ifndef CONFIG_NRF52_LED_MATRIX_IDLE_FREQUENCY
+#define CONFIG_NRF52_LED_MATRIX_IDLE_FREQUENCY  50
+#endif
+
+// The number of unchanged frames after which the display is considered static.
+#ifndef CONFIG_NRF52_LED_MATRIX_IDLE_FRAMES
+#define CONFIG_NRF52_LED_MATRIX_IDLE_FRAMES     30
+#endif
+
+// Event raised on the id of the display once the back buffer passed to swap() has been taken.
+#define NRF52_LED_MATRIX_EVT_SWAP_COMPLETE      16
+
 
 // TODO: Replace this with a resource allocated version
 #define NRF52_LEDMATRIX_GPIOTE_CHANNEL_BASE     1
@@ -44,13 +84,28 @@ DEALINGS IN THE SOFTWARE.
 
 namespace codal
 {
+    /**
+     * Interrupt timing statistics for an NRF52LEDMatrix, measured in processor cycles.
+     */
+    struct LEDMatrixStats
+    {
+        uint32_t        strobes;                    // Row strobe interrupts handled.
+        uint64_t        strobeCycles;               // Total processor cycles spent in them.
+        uint32_t        strobeWorst;                // The most processor cycles spent in any single one.
+        uint32_t        senses;                     // Light sense interrupts handled (those that start or complete a light reading).
+        uint64_t        senseCycles;                // Total processor cycles spent in them.
+        uint32_t        senseWorst;                 // The most processor cycles spent in any single one.
+        uint32_t        frames;                     // Frames started.
+        uint32_t        resetTime;                  // The system time (in milliseconds) at which collection started.
+    };
+
     /**
      * Class definition for an optimised LEDMatrix driver using nrf52 PPI and GPIOTE hardware.
      */
     class NRF52LEDMatrix : public Display
     {
         uint8_t strobeRow;                      // The current row being displayed.
-        uint8_t timeslots;                      // The total number of timeslots used by the driver (includes light sensing).
+        uint8_t timeslots;                      // The number of timeslots in each frame (excluding light sensing, which is taken on request).
         DisplayMode mode;                       // The currnet display mode being used.
         bool enabled;                           // Whether or not the display is enabled.
         uint8_t rotation;                       // DisplayRotation
@@ -58,12 +113,76 @@ namespace codal
         const MatrixMap     &matrixMap;         // Data structure that maps screen x/y pixels into GPIO pins.
         NRFLowLevelTimer    &timer;             // The timer module used to drive this LEDMatrix.
         uint32_t            timerPeriod;        // The period of the hardware timer.
+        uint32_t            strobePeriod;       // The period of each row strobe, which is longer than timerPeriod whilst the display is idle.
         uint32_t            quantum;            // The length of time allotted to each brightness level.
         uint32_t            lightLevel;         // Record of the last light level sampled.
+        CODAL_TIMESTAMP     lightTime;          // The system time at which the last light level was sampled, in milliseconds.
+        volatile bool       lightRequest;       // Set to request a light level sample at the end of the current frame.
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+        LEDMatrixStats      stats;              // The cost of each display interrupt.
+#endif
         
         int8_t              gpiote[NRF52_LED_MATRIX_MAXIMUM_COLUMNS];            // GPIOTE channels used by output columns.
         int8_t              ppi[NRF52_LED_MATRIX_MAXIMUM_COLUMNS];               // PPI channels used by output columns.
 
+        uint32_t            *rowCompare;        // Precomputed timer compare values, for each column of each row.
+        uint32_t            *rowConfig;         // Precomputed GPIOTE configuration (including initial polarity), for each column of each row.
+        uint8_t             *tableImage;        // The image the row tables were computed from.
+        bool                tableDirty;         // Set when the rotation, mode or brightness changes, to force the row tables to be recomputed.
+        uint32_t            generation;         // The number of distinct frames shown, incremented each time the row tables are recomputed.
+
+        Image               backBuffer;         // The image drawn by the application when double buffering, allocated on first use.
+        volatile bool       swapPending;        // Set by swap() for the back buffer to be shown from the start of the next frame.
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+        NRF_GPIO_Type       **rowPort;          // The GPIO port of each row pin.
+        uint32_t            *rowMask;           // The bit of each row pin within its GPIO port.
+#endif
+
+        /**
+         * Turns off the LED drive to the given row.
+         */
+        void rowOff(int row);
+
+        /**
+         * Turns on the LED drive to the given row.
+         */
+        void rowOn(int row);
+
+        /**
+         * Recomputes the timer compare values and GPIOTE configuration of every row, if the image, rotation,
+         * mode or brightness has changed since they were last computed.
+         */
+        void updateRowTables();
+
+        /**
+         * Computes the timer compare values and GPIOTE configuration of every row, from the last image recorded by updateRowTables().
+         */
+        void buildRowTables();
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+        uint8_t             *rowSpan;           // The number of timeslots taken by the strobe of each row, including the dark rows it absorbs.
+        uint16_t            staticFrames;       // The number of consecutive frames for which the display has been unchanged.
+
+        /**
+         * Changes the period of each row strobe, rescaling the brightness quantum so that the display is no brighter or dimmer.
+         *
+         * @param period The new strobe period, in timer ticks.
+         */
+        void setStrobePeriod(uint32_t period);
+
+        /**
+         * Drops the refresh rate once the display has been static for a while, and restores it as soon as the display changes.
+         */
+        void updateRefreshRate();
+#endif
+
+        /**
+         * Returns the GPIOTE channel, PPI channel and timer period borrowed for light sensing to LED drive.
+         */
+        void endLightSense();
+
         public:
         /**
          * Configure the next frame to be drawn.
@@ -157,7 +276,64 @@ namespace codal
         int setBrightness(int b);
 
         /**
-         * Determines the last ambient light level sensed.
+         * Retrieves the processor cycles spent in the display interrupt, for row strobes and light sensing separately,
+         * and the number of frames drawn. Statistics are only collected if CONFIG_NRF52_LED_MATRIX_STATS is enabled.
+         *
+         * @return The statistics for this display, or NULL if statistics are disabled.
+         */
+        const LEDMatrixStats *getStats();
+
+        /**
+         * Resets the display interrupt statistics, and restarts the collection period.
+         */
+        void resetStats();
+
+        /**
+         * Outputs the display interrupt statistics via DMESG, including the average and worst case cost of each
+         * kind of interrupt, the frame rate, and the share of the processor used by the display.
+         */
+        void printStats();
+
+        /**
+         * Determines how many distinct frames have been shown. This is incremented whenever the image, rotation, mode or
+         * brightness has changed since the previous frame, so is unchanged for as long as a static image is displayed.
+         *
+         * @return The frame generation.
+         */
+        uint32_t getFrameGeneration();
+
+        /**
+         * Provides a back buffer that can be drawn into without affecting the display, for tear free animation.
+         * Once a frame is complete, call swap() to show it. The back buffer is created on first use, holding a copy
+         * of the image currently displayed.
+         *
+         * @return The back buffer, of the same size as the display.
+         */
+        Image &getBackBuffer();
+
+        /**
+         * Shows the contents of the back buffer, from the start of the next frame scan. The back buffer is copied
+         * into image as that frame starts, so every frame shows either the previous image or the new one, never a
+         * mixture of the two. The back buffer keeps its contents, so the next frame can be drawn over it.
+         *
+         * @param wait If true, the calling fiber waits until the new image has been taken (at most one frame), after
+         * which the back buffer can safely be drawn into again. If false, the back buffer must not be changed until
+         * isSwapPending() returns false.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if getBackBuffer() has not been called.
+         */
+        int swap(bool wait = true);
+
+        /**
+         * Determines if a swap() is still waiting for the start of the next frame.
+         *
+         * @return true if the back buffer has yet to be taken.
+         */
+        bool isSwapPending();
+
+        /**
+         * Determines the last ambient light level sensed. If the last reading is older than CONFIG_NRF52_LED_MATRIX_LIGHTSENSE_INTERVAL,
+         * a new reading is taken at the end of the current frame, and the calling fiber waits for it.
          *
          * @return The light level sensed, as an unsigned 8-bit value in the range 0..255
          */
@@ -30,12 +30,26 @@ DEALINGS IN THE SOFTWARE.
 #include "codal-core/inc/types/Event.h"
 #include "RefCounted.h"
 
+// The smaller of the two slab size classes for PacketBuffer payloads, in bytes. The larger holds MICROBIT_RADIO_MAX_PACKET_SIZE.
+#ifndef MICROBIT_PACKET_BUFFER_SLAB_SMALL
+#define MICROBIT_PACKET_BUFFER_SLAB_SMALL       8
+#endif
+
+// The number of blocks added to a size class each time it runs out. Set to 0 to always allocate payloads from the heap.
+#ifndef MICROBIT_PACKET_BUFFER_SLAB_BLOCKS
+#define MICROBIT_PACKET_BUFFER_SLAB_BLOCKS      4
+#endif
+
 namespace codal
 {
+    struct FrameBuffer;
+
     struct PacketData : RefCounted
     {
         int             rssi;               // The radio signal strength this packet was received.
+        FrameBuffer     *frame;             // The radio receive buffer holding the payload, or NULL if it is held below.
         uint8_t         length;             // The length of the payload in bytes
+        uint8_t         slab;               // The slab size class this was allocated from (counting from 1), or 0 if from the heap.
         uint8_t         payload[0];         // User / higher layer protocol data
     };
 
@@ -49,6 +63,13 @@ namespace codal
     {
         PacketData      *ptr;     // Pointer to payload data
 
+        /**
+         * Drops our reference to the payload data. Data adopted from a radio receive buffer is returned to
+         * the receive pool along with its last reference, and data allocated from a slab to its slab,
+         * rather than being freed to the heap.
+         */
+        void release();
+
         public:
 
         /**
@@ -98,6 +119,20 @@ namespace codal
          */
         PacketBuffer(uint8_t *data, int length, int rssi = 0);
 
+        /**
+         * Constructor.
+         * Creates a Packet Buffer holding the payload of a received radio frame, taking ownership of the frame.
+         *
+         * Frames taken from the MicroBitRadio receive pool are adopted without copying, and are returned to the
+         * pool once the last PacketBuffer referring to them is released. Any other frame is copied and deleted.
+         *
+         * @param frame The received frame.
+         *
+         * @note Adopted frames are unavailable to the receiver until released, so holding many received
+         *       PacketBuffers at once will cause incoming packets to be dropped. See MicroBitRadio::setQueueDepth().
+         */
+        PacketBuffer(FrameBuffer *frame);
+
         /**
          * Copy Constructor.
          * Add ourselves as a reference to an existing PacketBuffer.
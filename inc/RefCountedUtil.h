@@ -0,0 +1,48 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_REF_COUNTED_UTIL_H
+#define CODAL_REF_COUNTED_UTIL_H
+
+#include "RefCounted.h"
+
+namespace codal
+{
+    /**
+     * Determines if the given object is held by a single reference, so that the holder may reuse or recycle it.
+     * RefCounted doesn't store the count directly, so compare against that of a freshly initialised object.
+     *
+     * @param r The object to test.
+     * @return true if r has exactly one reference.
+     */
+    static inline bool refcounted_is_unique(const RefCounted *r)
+    {
+        RefCounted single;
+        single.init();
+
+        return r->refCount == single.refCount;
+    }
+}
+
+#endif
@@ -26,6 +26,8 @@ DEALINGS IN THE SOFTWARE.
 #define SOUND_EMOJI_SYNTHESIZER_H
 
 #include "DataStream.h"
+#include "AudioBufferPool.h"
+#include "AudioStats.h"
 
 #ifndef CONFIG_EMOJI_SYNTHESIZER_OUTPUT_BUFFER_DEPTH
 #define CONFIG_EMOJI_SYNTHESIZER_OUTPUT_BUFFER_DEPTH  3
@@ -34,6 +36,7 @@ DEALINGS IN THE SOFTWARE.
 #define EMOJI_SYNTHESIZER_SAMPLE_RATE         44100
 #define EMOJI_SYNTHESIZER_TONE_WIDTH          1024
 #define EMOJI_SYNTHESIZER_TONE_WIDTH_F        1024.0f
+#define EMOJI_SYNTHESIZER_PHASE_SHIFT         22              // The phase accumulator holds a 10.22 fixed point position within the tonePrint.
 #define EMOJI_SYNTHESIZER_BUFFER_SIZE         512
 
 #define EMOJI_SYNTHESIZER_TONE_EFFECT_PARAMETERS        2
@@ -45,6 +48,7 @@ DEALINGS IN THE SOFTWARE.
 #define EMOJI_SYNTHESIZER_STATUS_ACTIVE                         0x01
 #define EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY        0x02
 #define EMOJI_SYNTHESIZER_STATUS_STOPPING                       0x04
+#define EMOJI_SYNTHESIZER_STATUS_SUSPENDED                      0x08
 
 
 #define DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0 3010
@@ -139,6 +143,10 @@ namespace codal
         ManagedBuffer           buffer2;                // Current playout buffer.
         ManagedBuffer           effectBuffer;           // Current sound effect sequence being generated.
         ManagedBuffer           emptyBuffer;            // Zero length buffer.
+        AudioBufferPool         bufferPool;             // Recycled playout buffers, reused once released downstream.
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+        AudioStats              stats;                  // The cost of each pull.
+#endif
         SoundEffect*            effect;                 // The effect within the current EffectBuffer that's being generated.
         uint16_t*               partialBuffer;          // Reference to a position within a DMA buffer, if a SFX completed mid buffer.
 
@@ -152,7 +160,9 @@ namespace codal
         float                   volume;                 // The instantaneous volume currently being generated within an effect.
         int                     samplesToWrite;         // The number of samples needed from the current sound effect block.
         int                     samplesWritten;         // The number of samples written from the current sound effect block.
-        float                   position;               // Position within the tonePrint.
+        uint32_t                phase;                  // Position within the tonePrint, in 10.22 fixed point. Wraps naturally at the end of the tonePrint.
+        uint16_t*               toneTable;              // The samples of a built in tonePrint, precomputed for the current effect.
+        TonePrintFunction       toneTableFunction;      // The tonePrint held in toneTable.
         float                   samplesPerStep[EMOJI_SYNTHESIZER_TONE_EFFECTS];     // The number of samples to render per step for each effect.
         /**
           * Default Constructor.
@@ -262,6 +272,19 @@ namespace codal
          */
         void allowEmptyBuffers(bool mode);
 
+        /**
+         * Retrieves the cost of each pull made of this component.
+         * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+         *
+         * @return The statistics for this component, or NULL if statistics are disabled.
+         */
+        const AudioStats *getStats();
+
+        /**
+         * Resets the statistics of this component.
+         */
+        void resetStats();
+
 
         private:
 
@@ -279,6 +302,15 @@ namespace codal
         */
         ManagedBuffer fillOutputBuffer();
 
+        /**
+         * Provides a precomputed wavetable for the given tonePrint, if it is a built in tonePrint
+         * whose output depends only upon position.
+         *
+         * @param tone The tonePrint to render.
+         * @return A table of EMOJI_SYNTHESIZER_TONE_WIDTH samples, or NULL if the tonePrint must be evaluated per sample.
+         */
+        const uint16_t *getToneTable(TonePrint &tone);
+
     };
 }
 
@@ -28,8 +28,60 @@ DEALINGS IN THE SOFTWARE.
 #include "ManagedString.h"
 #include "SoundEmojiSynthesizer.h"
 
+// The number of compiled sound expressions to retain, so that repeated playback of the same encoded expression
+// does not parse it again. Built in sounds that apply no randomness are retained separately. The least recently used entry is replaced when full.
+// Expressions that apply randomness are never cached. Set '0' to disable.
+#ifndef CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE
+#define CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE     4
+#endif
+
+// The number of built in sounds.
+#define SOUND_EXPRESSIONS_BUILT_IN_COUNT        10
+
 namespace codal
 {
+    /**
+     * The built in sounds, which may be played by name (e.g. "giggle") or directly by value.
+     */
+    enum class BuiltInSound : uint8_t
+    {
+        Giggle,
+        Happy,
+        Hello,
+        Mysterious,
+        Sad,
+        Slide,
+        Soaring,
+        Spring,
+        Twinkle,
+        Yawn
+    };
+
+    /**
+     * A single effect of a sound expression, decoded from its 72 character form but with no randomness yet applied.
+     * Each field holds the value of the corresponding decimal field of the encoded effect.
+     */
+    struct SoundExpressionEffect
+    {
+        int16_t wave;
+        int16_t volume;
+        int16_t frequency;
+        int16_t duration;
+        int16_t shape;
+        int16_t endFrequency;
+        int16_t endVolume;
+        int16_t steps;
+        int16_t fxChoice;
+        int16_t fxParam;
+        int16_t fxnSteps;
+        int16_t frequencyRandom;
+        int16_t endFrequencyRandom;
+        int16_t volumeRandom;
+        int16_t endVolumeRandom;
+        int16_t durationRandom;
+        int16_t fxParamRandom;
+        int16_t fxnStepsRandom;
+    };
 
     class SoundExpressions
     {
@@ -49,7 +101,7 @@ namespace codal
         /**
          * Plays a sound encoded as a series of decimal encoded effects or specified by name.
          * Blocks until the sound generation is complete, and the synthesizer is ready to accept new requests.
-         * @param sound a string representing the sound effect to play, in the form descripbed by parseSoundExperession().
+         * @param sound a string representing the sound effect to play, in the form descripbed by decodeSoundExpression().
          * @param event the event to wait for - either DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE (default) or DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_PLAYBACK_COMPLETE.
          */
         void play(ManagedString sound, uint16_t event = DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
@@ -57,14 +109,14 @@ namespace codal
         /**
          * Plays a sound encoded as a series of decimal encoded effects or specified by name.
          * Does not block.
-         * @param a string representing the sound effect to play, in the form descripbed by parseSoundExperession().
+         * @param a string representing the sound effect to play, in the form descripbed by decodeSoundExpression().
          */
         void playAsync(ManagedString sound);
 
         /**
          * Plays a sound encoded as a series of decimal encoded effects or specified by name.
          * Blocks until the sound generation is complete, and the synthesizer is ready to accept new requests.
-         * @param sound a string representing the sound effect to play, in the form descripbed by parseSoundExperession().
+         * @param sound a string representing the sound effect to play, in the form descripbed by decodeSoundExpression().
          * @param event the event to wait for - either DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE (default) or DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_PLAYBACK_COMPLETE.
          */
         void play(ManagedBuffer sound, uint16_t event = DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
@@ -74,7 +126,43 @@ namespace codal
          * Does not block unless a sound effect is already queued.
          */
         void playAsync(ManagedBuffer sound);
-        
+
+        /**
+         * Plays one of the built in sounds.
+         * Blocks until the sound generation is complete, and the synthesizer is ready to accept new requests.
+         * @param sound the sound to play.
+         * @param event the event to wait for - either DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE (default) or DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_PLAYBACK_COMPLETE.
+         */
+        void play(BuiltInSound sound, uint16_t event = DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
+
+        /**
+         * Plays one of the built in sounds.
+         * Does not block unless a sound effect is already queued.
+         * @param sound the sound to play.
+         */
+        void playAsync(BuiltInSound sound);
+
+        /**
+         * Compiles a sound encoded as a series of decimal encoded effects or specified by name into an array of
+         * SoundEffect structures. The result is a reusable handle, that may be passed to play(ManagedBuffer) or
+         * playAsync(ManagedBuffer) any number of times without the expression being parsed again.
+         * Any randomness in the expression is applied once, when it is compiled.
+         *
+         * @param sound a string representing the sound effect, in the form described by decodeSoundExpression().
+         * @return a buffer containing the compiled SoundEffects, or an empty buffer if the expression is invalid.
+         */
+        ManagedBuffer compile(ManagedString sound);
+
+        /**
+         * Compiles one of the built in sounds into an array of SoundEffect structures. The built in sounds are held
+         * in flash already decoded, so no parsing is required. The result for those that apply no randomness is
+         * retained, and returned again by later calls.
+         *
+         * @param sound the built in sound.
+         * @return a buffer containing the compiled SoundEffects.
+         */
+        ManagedBuffer compile(BuiltInSound sound);
+
         /**
          * Stops the currently playing sound.
          */
@@ -83,10 +171,20 @@ namespace codal
         private:
         SoundEmojiSynthesizer &synth;
 
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+        ManagedString cacheKey[CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE];        // The expressions held in the cache, as passed to playAsync().
+        ManagedBuffer cacheEffects[CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE];    // The SoundEffects parsed from each expression.
+        uint32_t cacheLastUsed[CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE];        // The value of cacheUseCount when each entry was last used.
+        uint32_t cacheUseCount;                                             // The number of cache lookups and insertions made.
+        ManagedBuffer builtInEffects[SOUND_EXPRESSIONS_BUILT_IN_COUNT];     // The SoundEffects compiled from each deterministic built in sound.
+#endif
+
         static int parseDigits(const char *input, const int digits);
         static int applyRandom(int value, int rand);
-        static ManagedString lookupBuiltIn(ManagedString sound);
-        bool parseSoundExpression(const char *soundChars, SoundEffect *fx);
+        static int lookupBuiltIn(ManagedString sound);
+        static void decodeSoundExpression(const char *soundChars, SoundExpressionEffect *effect);
+        bool buildSoundEffect(const SoundExpressionEffect &effect, SoundEffect *fx);
+        static bool isDeterministic(const SoundExpressionEffect &effect);
 
     };
 }
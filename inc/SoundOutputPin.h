@@ -53,6 +53,13 @@ DEALINGS IN THE SOFTWARE.
 
 #define SOUND_OUTPUT_PIN_STATUS_ENABLED       0x0001            // Synthesizer has been on demand activate
 #define SOUND_OUTPUT_PIN_STATUS_ACTIVE        0x0002            // Synthesizer is actively generating sound
+#define SOUND_OUTPUT_PIN_STATUS_SUSPENDED     0x0004            // Mixer channel has been left idle during silence
+
+// Play constant tones by programming the PWM peripheral directly, rather than through the mixer, whenever no other
+// audio is playing. This allows the mixer and PWM DMA to remain idle during simple tones and melodies. Set '1' to enable.
+#ifndef CONFIG_SOUND_OUTPUT_PIN_PWM_BYPASS
+#define CONFIG_SOUND_OUTPUT_PIN_PWM_BYPASS    0
+#endif
 
 #ifndef CONFIG_SOUND_OUTPUT_PIN_TONEPRINT
 #define CONFIG_SOUND_OUTPUT_PIN_TONEPRINT     0
@@ -80,6 +87,12 @@ namespace codal
         uint8_t*                bufferWritePos;
         float                   position;
         int                     volume;
+        ManagedBuffer           periodicBuffer;         // A whole number of periods of the current output, reused until it changes.
+        int                     periodicPeriodUs;       // The period of the sound held in periodicBuffer.
+        int                     periodicVolume;         // The volume of the sound held in periodicBuffer.
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+        AudioStats              stats;                  // The cost of each pull.
+#endif
 
     public:
 
@@ -174,6 +187,19 @@ namespace codal
          */
         bool isConnected();
 
+        /**
+         * Retrieves the cost of each pull made of this component.
+         * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+         *
+         * @return The statistics for this component, or NULL if statistics are disabled.
+         */
+        const AudioStats *getStats();
+
+        /**
+         * Resets the statistics of this component.
+         */
+        void resetStats();
+
         private:
 
         /**
@@ -188,6 +214,15 @@ namespace codal
          * @param all true if the entre buffer is to be filled, false to fill the nuffer to the current timepoint
          */
         void updateOutputBuffer(bool all = false);
+
+        /**
+         * Provides the next buffer of output whilst the sound parameters are unchanged since the last pull.
+         * In this steady state the output is periodic, so a buffer holding a whole number of periods is
+         * generated once, and then handed out repeatedly until the parameters change.
+         *
+         * @return The next buffer of output, or an empty buffer if the output cannot be generated this way.
+         */
+        ManagedBuffer getPeriodicBuffer();
     };
 }
 
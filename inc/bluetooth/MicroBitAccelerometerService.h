@@ -38,6 +38,21 @@ DEALINGS IN THE SOFTWARE.
 namespace codal
 {
 
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+/**
+  * A single timestamped sample, as sent in notifications of the batch characteristic.
+  * The time is the low 16 bits of the system time, in milliseconds, at which the sample was taken.
+  */
+struct AccelerometerSample
+{
+    uint16_t    time;
+    int16_t     x;
+    int16_t     y;
+    int16_t     z;
+} __attribute__((packed));
+#endif
+
+
 /**
   * Class definition for a MicroBit BLE Accelerometer Service.
   * Provides access to live accelerometer data via Bluetooth, and provides basic configuration options.
@@ -85,17 +100,47 @@ class MicroBitAccelerometerService : public MicroBitBLEService
      */
     void accelerometerUpdate(MicroBitEvent e);
 
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+    /**
+      * Handles BLE events not dispatched by MicroBitBLEService.
+      */
+    virtual bool onBleEvent( const microbit_ble_evt_t *p_ble_evt) override;
+
+    /**
+      * Adds the current sample to the ring buffer, if there is space.
+      */
+    void storeSample();
+
+    /**
+      * Sends as many batches of samples from the ring buffer as the SoftDevice will queue.
+      * A partial batch is only sent once its oldest sample has waited MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_LATENCY ms.
+      */
+    void sendSamples();
+#endif
+
 	codal::Accelerometer	&accelerometer;
 
     // memory for our 8 bit control characteristics.
     uint16_t            accelerometerDataCharacteristicBuffer[3];
     uint16_t            accelerometerPeriodCharacteristicBuffer;
+
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+    // Ring buffer of samples waiting to be sent, and the notification being built.
+    AccelerometerSample *samples;
+    uint8_t             *batchBuffer;
+    volatile uint16_t   sampleHead;
+    volatile uint16_t   sampleCount;
+    volatile bool       sending;
+#endif
     
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
     {
         mbbs_cIdxDATA,
         mbbs_cIdxPERIOD,
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+        mbbs_cIdxBATCH,
+#endif
         mbbs_cIdxCOUNT
     } mbbs_cIdx;
     
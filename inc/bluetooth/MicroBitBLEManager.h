@@ -35,6 +35,7 @@ DEALINGS IN THE SOFTWARE.
 #endif
 
 #include "MicroBitBLETypes.h"
+#include "MicroBitBLEService.h"
 #include "MicroBitStorage.h"
 #include "MicroBitDisplay.h"
 #include "ExternalEvents.h"
@@ -51,6 +52,7 @@ DEALINGS IN THE SOFTWARE.
 
 #define MICROBIT_BLE_EDDYSTONE_ADV_INTERVAL     400
 #define MICROBIT_BLE_EDDYSTONE_DEFAULT_POWER    0xF0
+#define MICROBIT_BLE_EDDYSTONE_ROTATION_PERIOD  1000
 
 // CodalComponent status flags
 #define MICROBIT_BLE_STATUS_DISCONNECT          0x04
@@ -62,9 +64,40 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_MODE_PAIRING                   0
 #define MICROBIT_MODE_APPLICATION               1
 
+// Connection profiles, as requested by setConnectionProfile()
+#define MICROBIT_BLE_PROFILE_DEFAULT            0       // The connection parameters set up by init(). PHY and packet sizes are left to the central.
+#define MICROBIT_BLE_PROFILE_THROUGHPUT         1       // Short connection interval, 2M PHY, data length extension and the largest ATT MTU.
+#define MICROBIT_BLE_PROFILE_LOW_POWER          2       // Long connection interval with peripheral latency, and the 1M PHY.
+
 namespace codal
 {
 
+/**
+  * The parameters in use on a BLE connection, as granted by the central device.
+  */
+struct MicroBitBLELinkParameters
+{
+    uint16_t    interval;           // Connection interval, in units of 1.25ms.
+    uint16_t    latency;            // Peripheral latency, in connection events.
+    uint16_t    timeout;            // Supervision timeout, in units of 10ms.
+    uint8_t     txPhy;              // Transmit PHY: BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_2MBPS.
+    uint8_t     rxPhy;              // Receive PHY: BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_2MBPS.
+    uint16_t    mtu;                // Effective ATT MTU, in bytes.
+    uint16_t    dataLength;         // Largest link layer payload we may transmit, in bytes.
+};
+
+/**
+  * A notification queued with the scheduler of MicroBitBLEManager.
+  */
+struct MicroBitBLENotification
+{
+    MicroBitBLEService  *service;       // The service the characteristic belongs to.
+    const uint8_t       *data;          // The value to send, read when it is sent.
+    uint16_t            length;         // The length of the value, in bytes.
+    uint8_t             idx;            // The index of the characteristic within its service.
+    uint8_t             priority;       // One of MICROBIT_BLE_NOTIFY_PRIORITY_*.
+};
+
 class MicroBitBLEManager;
 typedef MicroBitBLEManager BLEDevice;
 
@@ -205,6 +238,84 @@ class MicroBitBLEManager : public CodalComponent
      */
     bool getConnected();
 
+    /**
+     * Queues a notification of a characteristic's value, to be sent with those of other services in the next
+     * connection event. Notifications are sent once per connection interval, from idleCallback(), highest priority
+     * first. A high priority notification causes everything queued to be sent at the next idle callback.
+     *
+     * If a notification is already queued for the characteristic, it is replaced, keeping the higher priority.
+     *
+     * @param service the service the characteristic belongs to.
+     * @param idx the index of the characteristic within the service.
+     * @param data the value to send. This is read when the notification is sent, so must remain valid until then.
+     * @param length the length of the value, in bytes.
+     * @param priority one of MICROBIT_BLE_NOTIFY_PRIORITY_HIGH, MICROBIT_BLE_NOTIFY_PRIORITY_NORMAL or MICROBIT_BLE_NOTIFY_PRIORITY_LOW.
+     *
+     * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the service or priority is invalid,
+     *         or MICROBIT_NO_RESOURCES if the queue is full and cannot be flushed.
+     *
+     * @note If MICROBIT_BLE_NOTIFY_SCHEDULER is disabled, the notification is sent straight away.
+     */
+    int queueNotification( MicroBitBLEService *service, int idx, const uint8_t *data, uint16_t length, int priority = MICROBIT_BLE_NOTIFY_PRIORITY_NORMAL);
+
+    /**
+     * Sends all queued notifications now, highest priority first, for as long as the SoftDevice has room for them.
+     * Any left over are kept for the next connection interval.
+     *
+     * @return the number of notifications still queued.
+     */
+    int flushNotifications();
+
+    /**
+     * Determines if a notification is queued for a characteristic, and has yet to be sent.
+     *
+     * @param service the service the characteristic belongs to.
+     * @param idx the index of the characteristic within the service.
+     *
+     * @return true if a notification is queued.
+     */
+    bool isNotificationQueued( MicroBitBLEService *service, int idx);
+
+    /**
+     * Determines the largest attribute value that can be sent in a single notification or indication
+     * on the current connection, given the ATT MTU negotiated with the central device.
+     *
+     * @return The size in bytes, which is 20 if not connected or no larger MTU has been negotiated.
+     */
+    uint16_t getMaxAttributeSize();
+
+    /**
+     * Requests a set of connection parameters suited to a given use, for the current connection and any later ones.
+     * The connection interval, PHY, data length and ATT MTU are negotiated with the central device, which may grant
+     * something other than what was asked for. Use getLinkParameters() to see what was granted.
+     *
+     * @param profile One of MICROBIT_BLE_PROFILE_DEFAULT, MICROBIT_BLE_PROFILE_THROUGHPUT or MICROBIT_BLE_PROFILE_LOW_POWER.
+     *
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the profile is not recognised.
+     *
+     * @code
+     * // Ask for the fastest link we can get, e.g. before streaming data over the UART service.
+     * bleManager.setConnectionProfile(MICROBIT_BLE_PROFILE_THROUGHPUT);
+     * @endcode
+     */
+    int setConnectionProfile(int profile);
+
+    /**
+     * Determines the connection profile last requested.
+     *
+     * @return One of MICROBIT_BLE_PROFILE_DEFAULT, MICROBIT_BLE_PROFILE_THROUGHPUT or MICROBIT_BLE_PROFILE_LOW_POWER.
+     */
+    int getConnectionProfile();
+
+    /**
+     * Determines the parameters granted on the current connection.
+     *
+     * @param params The structure to fill in.
+     *
+     * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if not connected.
+     */
+    int getLinkParameters(MicroBitBLELinkParameters &params);
+
 #if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL)
     /**
       * Set the content of Eddystone URL frames
@@ -259,6 +370,32 @@ class MicroBitBLEManager : public CodalComponent
     int advertiseEddystoneUid(const char* uid_namespace, const char* uid_instance, int8_t calibratedPower = MICROBIT_BLE_EDDYSTONE_DEFAULT_POWER, bool connectable = true, uint16_t interval = MICROBIT_BLE_EDDYSTONE_ADV_INTERVAL);
 #endif
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+    /**
+      * Advertises the Eddystone URL and UID frames most recently given to advertiseEddystoneUrl() and advertiseEddystoneUid()
+      * in turn, optionally interleaved with Eddystone TLM (telemetry) frames.
+      *
+      * Each frame is encoded once, when it is set, so moving from one frame to the next only hands a different payload to the SoftDevice.
+      * Calling advertiseEddystoneUrl() or advertiseEddystoneUid() stops the rotation, which may then be restarted to include the new frame.
+      *
+      * @param period the time, in milliseconds, each frame is advertised for. (Defaults to MICROBIT_BLE_EDDYSTONE_ROTATION_PERIOD)
+      *
+      * @param telemetry true to include TLM frames, reporting temperature, uptime and an estimate of the advertising count. (Defaults to true)
+      *
+      * @param connectable true to keep bluetooth connectable for other services, false otherwise. (Defaults to true)
+      *
+      * @param interval the rate at which the micro:bit will advertise frames. (Defaults to MICROBIT_BLE_EDDYSTONE_ADV_INTERVAL)
+      *
+      * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if there are no frames to advertise.
+      */
+    int advertiseEddystoneRotation(uint16_t period = MICROBIT_BLE_EDDYSTONE_ROTATION_PERIOD, bool telemetry = true, bool connectable = true, uint16_t interval = MICROBIT_BLE_EDDYSTONE_ADV_INTERVAL);
+
+    /**
+      * Stops rotating between Eddystone frames, leaving the current frame advertised.
+      */
+    void stopEddystoneRotation();
+#endif
+
   /**
    * Restarts in BLE Mode
    *
@@ -316,6 +453,13 @@ class MicroBitBLEManager : public CodalComponent
     unsigned long pairingTime;
     unsigned long shutdownTime;
 
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    MicroBitBLENotification notifyQueue[ MICROBIT_BLE_NOTIFY_QUEUE_SIZE];
+    int notifyCount = 0;
+    bool notifyUrgent = false;
+    unsigned long notifyTime = 0;
+#endif
+
     /*
      * Default to Application Mode
      * This variable will be set to MICROBIT_MODE_PAIRING if pairingMode() is executed.
@@ -0,0 +1,170 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_BENCHMARK_SERVICE_H
+#define MICROBIT_BENCHMARK_SERVICE_H
+
+#include "MicroBitConfig.h"
+
+#if CONFIG_ENABLED(DEVICE_BLE)
+
+#include "MicroBitBLEManager.h"
+#include "MicroBitBLEService.h"
+
+// Commands written to the control characteristic.
+#define MICROBIT_BENCHMARK_CMD_RESET        0x00    // {cmd} Clears all counters.
+#define MICROBIT_BENCHMARK_CMD_SOURCE       0x01    // {cmd, duration ms (uint32, little endian)} Starts notifying the source characteristic. A duration of 0 runs until stopped.
+#define MICROBIT_BENCHMARK_CMD_STOP         0x02    // {cmd} Stops notifying the source characteristic.
+
+namespace codal
+{
+
+/**
+  * The counters and link parameters of a benchmark run, as read from the results characteristic.
+  * Throughputs are measured from the first to the last packet seen in each direction.
+  */
+struct MicroBitBenchmarkResults
+{
+    uint32_t    rxBytes;            // Bytes written to the sink characteristic.
+    uint32_t    rxPackets;          // Writes to the sink characteristic.
+    uint32_t    rxThroughput;       // Bytes per second written to the sink characteristic.
+    uint32_t    txBytes;            // Bytes notified from the source characteristic.
+    uint32_t    txPackets;          // Notifications of the source characteristic.
+    uint32_t    txThroughput;       // Bytes per second notified from the source characteristic.
+    uint16_t    interval;           // Connection interval, in units of 1.25ms.
+    uint8_t     txPhy;              // Transmit PHY: BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_2MBPS.
+    uint8_t     rxPhy;              // Receive PHY: BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_2MBPS.
+    uint16_t    mtu;                // Effective ATT MTU, in bytes.
+    uint16_t    dataLength;         // Largest link layer payload we may transmit, in bytes.
+} __attribute__((packed));
+
+/**
+  * Class definition for the MicroBit BLE Benchmark Service.
+  * Measures the GATT throughput achieved with a connected device: a sink characteristic counts data written
+  * to it, and a source characteristic notifies as fast as the SoftDevice will accept. The results, together
+  * with the parameters of the connection, are read from the results characteristic.
+  */
+class MicroBitBenchmarkService : public MicroBitBLEService
+{
+    public:
+
+    /**
+      * Constructor.
+      * Create a representation of the BenchmarkService
+      * @param _ble The instance of a BLE device that we're running on.
+      */
+    MicroBitBenchmarkService( BLEDevice &_ble);
+
+    /**
+      * Fills in the results of the current run.
+      *
+      * @param r The structure to fill in.
+      */
+    void getResults( MicroBitBenchmarkResults &r);
+
+    private:
+
+    /**
+      * Invoked when BLE disconnects.
+      */
+    void onDisconnect( const microbit_ble_evt_t *p_ble_evt);
+
+    /**
+      * Callback. Invoked when any of our attributes are written via BLE.
+      */
+    void onDataWritten( const microbit_ble_evt_write_t *params);
+
+    /**
+      * Callback. Invoked when any of our attributes are read via BLE.
+      */
+    void onDataRead( microbit_onDataRead_t *params);
+
+    /**
+      * Handles BLE events not dispatched by MicroBitBLEService.
+      */
+    virtual bool onBleEvent( const microbit_ble_evt_t *p_ble_evt) override;
+
+    /**
+      * Clears all counters.
+      */
+    void reset();
+
+    /**
+      * Queues notifications of the source characteristic until the SoftDevice will take no more.
+      */
+    void sendSource();
+
+    /**
+      * Ends a run of the source characteristic, and notifies the results.
+      */
+    void stopSource();
+
+    // Counters for each direction.
+    uint32_t            rxBytes;
+    uint32_t            rxPackets;
+    uint32_t            rxStart;
+    uint32_t            rxEnd;
+    uint32_t            txBytes;
+    uint32_t            txPackets;
+    uint32_t            txStart;
+    uint32_t            txEnd;
+
+    // State of the source characteristic.
+    bool                sourceRunning;
+    uint32_t            sourceDuration;
+    uint32_t            sourceSequence;
+    uint16_t            sourceLength;
+
+    // memory for our characteristics.
+    uint8_t             *sourceBuffer;
+    uint8_t             controlBuffer[5];
+    MicroBitBenchmarkResults results;
+
+    // Index for each charactersitic in arrays of handles and UUIDs
+    typedef enum mbbs_cIdx
+    {
+        mbbs_cIdxSINK,
+        mbbs_cIdxSOURCE,
+        mbbs_cIdxCONTROL,
+        mbbs_cIdxRESULTS,
+        mbbs_cIdxCOUNT
+    } mbbs_cIdx;
+
+    // UUIDs for our service and characteristics
+    static const uint16_t serviceUUID;
+    static const uint16_t charUUID[ mbbs_cIdxCOUNT];
+
+    // Data for each characteristic when they are held by Soft Device.
+    MicroBitBLEChar      chars[ mbbs_cIdxCOUNT];
+
+    public:
+
+    int              characteristicCount()          { return mbbs_cIdxCOUNT; };
+    MicroBitBLEChar *characteristicPtr( int idx)    { return &chars[ idx]; };
+};
+
+} // namespace codal
+
+#endif // CONFIG_ENABLED(DEVICE_BLE)
+#endif // MICROBIT_BENCHMARK_SERVICE_H
@@ -102,6 +102,25 @@ class MicroBitEddystone
     int getUID( uint8_t *rawFrame /*[frameSizeUID]*/, uint16_t *pLength, const char* uid_namespace, const char* uid_instance, int8_t calibratedPower = 0xF0);
 #endif
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+    static const uint8_t frameSizeTLM = 16;
+
+    /**
+      * Get the content of unencrypted Eddystone TLM (telemetry) frames
+      *
+      * @param batteryVoltage the battery voltage in millivolts, or 0 if not known.
+      *
+      * @param temperature the temperature in degrees Celsius, as signed 8.8 fixed point, or 0x8000 if not known.
+      *
+      * @param advertisingCount the number of advertising PDUs sent since the beacon started.
+      *
+      * @param uptime the time since the beacon started, in units of 0.1 seconds.
+      *
+      * @note More information can be found at https://github.com/google/eddystone/tree/master/eddystone-tlm
+      */
+    int getTLM( uint8_t *rawFrame /*[frameSizeTLM]*/, uint16_t *pLength, uint16_t batteryVoltage, int16_t temperature, uint32_t advertisingCount, uint32_t uptime);
+#endif
+
   private:
 
     /**
@@ -64,6 +64,7 @@ class MicroBitEventService : public MicroBitBLEService, MicroBitComponent
     /**
      * Periodic callback from MicroBit scheduler.
      * If we're no longer connected, remove any registered Message Bus listeners.
+     * Sends any events waiting to be batched, if batching is enabled.
      */
     virtual void idleCallback();
 
@@ -85,6 +86,15 @@ class MicroBitEventService : public MicroBitBLEService, MicroBitComponent
       */
     void onDataRead( microbit_onDataRead_t *params);
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+    /**
+      * Sends any events waiting to be batched, as a single notification.
+      *
+      * @return true if there are no events left waiting.
+      */
+    bool flushEvents();
+#endif
+
     private:
 
     // messageBus we're using.
@@ -96,6 +106,13 @@ class MicroBitEventService : public MicroBitBLEService, MicroBitComponent
     EventServiceEvent   microBitRequirementsBuffer;
     EventServiceEvent   clientRequirementsBuffer;
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+    // Events waiting to be sent, and the characteristic value they are sent through.
+    EventServiceEvent   *pendingEvents;
+    EventServiceEvent   *batchBuffer;
+    uint16_t            pendingCount;
+#endif
+
     // Message bus offset last sent to the client...
     uint16_t messageBusListenerOffset;
     
@@ -38,6 +38,9 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_IO_PIN_SERVICE_DATA_SIZE      10
 #define MICROBIT_PWM_PIN_SERVICE_DATA_SIZE     2
 
+#define MICROBIT_ID_IO_PIN_SERVICE             3032
+#define MICROBIT_IO_PIN_SERVICE_EVT_SAMPLE     1
+
 namespace codal
 {
 
@@ -139,6 +142,39 @@ class MicroBitIOPinService : public MicroBitBLEService, MicroBitComponent
       * @return a reference to the pin
       */
     MicroBitPin &edgePin( int index);
+
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+    /**
+      * Brings the pins we watch into line with the configuration given by our client.
+      * Digital inputs are set to raise edge events, and the analog sampling timer is started or stopped as needed.
+      */
+    void updateWatchedPins();
+
+    /**
+      * Callback. Invoked, in interrupt context, on a rise or fall of a digital input we're watching.
+      */
+    void onPinEvent(MicroBitEvent e);
+
+    /**
+      * Callback. Invoked periodically while any analog inputs are configured, to sample them.
+      */
+    void onAnalogSample(MicroBitEvent e);
+
+    /**
+      * Marks a pin as having a new value to send to our client.
+      *
+      * @param i the enumeration of the pin
+      * @param value the new value of the pin
+      */
+    void setPending(int i, uint8_t value);
+
+    /**
+      * Fills the data characteristic buffer with pins that have changed since the last notification.
+      *
+      * @return number of changed pins
+      */
+    int takePendingInputs();
+#endif
     
     // IO we're using
     MicroBitIO          &io;
@@ -151,6 +187,17 @@ class MicroBitIOPinService : public MicroBitBLEService, MicroBitComponent
 
     // Historic information about our pin data data.
     uint8_t             ioPinServiceIOData[MICROBIT_IO_PIN_SERVICE_PINCOUNT];
+
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+    // Bitmap of the pins with a change waiting to be sent, set from pin events and the analog sampling timer.
+    volatile uint32_t   pendingChanges;
+
+    // Bitmap of the digital pins we have set to raise edge events.
+    uint32_t            edgePins;
+
+    // true if the analog sampling timer is running.
+    bool                analogSampling;
+#endif
     
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
@@ -108,6 +108,12 @@ class MicroBitMagnetometerService : public MicroBitBLEService
      */
     void compassEvents(MicroBitEvent e);
 
+    /**
+      * Sends the current sample to our client, subject to MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD,
+      * and collecting samples into batches if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH is greater than 1.
+      */
+    void sendData();
+
     // Compass we're using.
     codal::Compass     &compass;
 
@@ -117,6 +123,16 @@ class MicroBitMagnetometerService : public MicroBitBLEService
     uint16_t            magnetometerPeriodCharacteristicBuffer;
     uint8_t             magnetometerCalibrationCharacteristicBuffer;
 
+    // The last sample sent to our client, and whether there has been one since connection.
+    int16_t             lastData[3];
+    bool                lastDataValid;
+
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH > 1
+    // Samples waiting to be sent in the next batch.
+    int16_t             batchBuffer[3 * MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH];
+    int                 batchCount;
+#endif
+
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
     {
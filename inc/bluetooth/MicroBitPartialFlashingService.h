@@ -40,13 +40,28 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitEvent.h"
 #include "EventModel.h"
 
-#define PARTIAL_FLASHING_VERSION 0x01
+#define PARTIAL_FLASHING_VERSION 0x02
 
 // BLE PF Control Codes
 #define REGION_INFO 0x00
 #define FLASH_DATA  0x01
 #define END_OF_TRANSMISSION 0x02
 
+// BLE PF Control Codes, version 2: transfer and write a page at a time
+#define FLASH_PAGE_START 0x03
+#define FLASH_PAGE_DATA  0x04
+#define FLASH_PAGE_END   0x05
+#define FLASH_PAGE_HASHES 0x06
+
+// FLASH_PAGE_END status codes
+#define FLASH_PAGE_OK           0xFF      // Page received intact and queued for writing. The next page may be sent.
+#define FLASH_PAGE_MISSING      0xAA      // Followed by the index of each missing granule (up to the packet size). Resend them, then FLASH_PAGE_END again.
+#define FLASH_PAGE_CRC_ERROR    0xCC      // The page failed its CRC check. Resend the whole page.
+#define FLASH_PAGE_INVALID      0xEE      // No such page has been started, or there is not enough memory to receive one.
+
+#define PARTIAL_FLASHING_PAGE_SIZE      4096    // The unit of transfer for version 2. Must be a multiple of the flash page size.
+#define PARTIAL_FLASHING_GRANULE        16      // FLASH_PAGE_DATA offsets, and retransmissions, are in units of this many bytes.
+
 // BLE Utilities
 #define MICROBIT_STATUS 0xEE
 #define MICROBIT_RESET  0xFF
@@ -100,6 +115,25 @@ class MicroBitPartialFlashingService : public MicroBitBLEService
       */
     void flashData(uint8_t *data);
 
+    /**
+      * Process the version 2 FLASH_PAGE_START, FLASH_PAGE_DATA and FLASH_PAGE_END packets
+      */
+    void flashPageStart(const uint8_t *data, int len);
+    void flashPageData(const uint8_t *data, int len);
+    void flashPageEnd(const uint8_t *data, int len);
+    void flashPageHashes(const uint8_t *data, int len);
+
+    /**
+      * Send a FLASH_PAGE_END reply for the given page
+      */
+    void flashPageReply(uint8_t status, uint32_t address, const uint8_t *missing = NULL, int missingCount = 0);
+
+    /**
+      * Prepare for the first write of a flash: mark the flash as incomplete, so a failed flash boots into BLE mode,
+      * and erase any MicroPython filesystem.
+      */
+    void flashBegin(MicroBitFlash &flash);
+
     // Ensure packets are in order
     uint8_t packetCount = 0;
     uint8_t blockPacketCount = 0;
@@ -108,8 +142,25 @@ class MicroBitPartialFlashingService : public MicroBitBLEService
     uint32_t block[16];
     uint8_t  blockNum = 0;
     uint32_t offset   = 0;
-    
-    uint8_t characteristicValue[ 20];
+
+    // Version 2 page transfers. One buffer receives a page while the other is written to flash.
+    uint32_t *pageBuffer[2] = { NULL, NULL };
+    uint32_t pageWriteAddress[2];
+    uint16_t pageWriteLength[2];
+    uint8_t  pageReceived[PARTIAL_FLASHING_PAGE_SIZE / PARTIAL_FLASHING_GRANULE / 8];   // one bit per granule received
+    uint32_t pageAddress = 0xFFFFFFFF;      // the page being received, or 0xFFFFFFFF if none
+    uint8_t  pageReceiving = 0;             // the buffer receiving pageAddress
+    uint8_t  pageWriteNext = 0;             // the buffer to be written by the next FLASH_PAGE_END event
+    volatile uint8_t pageWriting = 0;       // a bit for each buffer queued for writing
+    volatile bool pageAckPending = false;   // set if a FLASH_PAGE_OK reply waits for a buffer to be written
+    bool     pageMode = false;              // set once a version 2 transfer starts
+
+    // A FLASH_PAGE_HASHES request, held for comparison outside the BLE ISR.
+    uint32_t hashAddress;
+    uint8_t  hashCount = 0;
+    uint32_t *hashes = NULL;
+
+    uint8_t *characteristicValue;
 
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
@@ -80,12 +80,28 @@ class MicroBitTemperatureService : public MicroBitBLEService
      */
     void temperatureUpdate(MicroBitEvent e);
 
+    /**
+      * Sends the current sample to our client, subject to MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD,
+      * and collecting samples into batches if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH is greater than 1.
+      */
+    void sendData();
+
     // Thermometer we're using.
     MicroBitThermometer     &thermometer;
 
     // memory for our temperature characteristic.
     int8_t             temperatureDataCharacteristicBuffer;
     uint16_t           temperaturePeriodCharacteristicBuffer;
+
+    // The last sample sent to our client, and whether there has been one since connection.
+    int8_t             lastData;
+    bool               lastDataValid;
+
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH > 1
+    // Samples waiting to be sent in the next batch.
+    int8_t             batchBuffer[MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH];
+    int                batchCount;
+#endif
     
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
@@ -35,6 +35,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitSerial.h"
 
 #define MICROBIT_UART_S_DEFAULT_BUF_SIZE    20
+#define MICROBIT_UART_S_MAX_BUF_SIZE        65534
 
 #define MICROBIT_UART_S_EVT_DELIM_MATCH     1
 #define MICROBIT_UART_S_EVT_HEAD_MATCH      2
@@ -47,6 +48,11 @@ namespace codal
   * Class definition for the custom MicroBit UART Service.
   * Provides a BLE service that acts as a UART port, enabling the reception and transmission
   * of an arbitrary number of bytes.
+  *
+  * Data is sent to the central device using indications or notifications, whichever it enables.
+  * Indications are sent one at a time, each waiting for confirmation. Notifications are queued
+  * as fast as the SoftDevice will take them (see MICROBIT_BLE_HVN_TX_QUEUE_SIZE), so several
+  * may be sent in each connection event.
   */
 class MicroBitUARTService : public MicroBitBLEService
 {
@@ -54,25 +60,25 @@ class MicroBitUARTService : public MicroBitBLEService
 
     uint8_t* txBuffer;
 
-    uint8_t rxBufferHead;
-    uint8_t rxBufferTail;
-    uint8_t rxBufferSize;
+    uint16_t rxBufferHead;
+    uint16_t rxBufferTail;
+    uint16_t rxBufferSize;
 
-    uint8_t txBufferSize;
+    uint16_t txBufferSize;
 
     uint32_t rxCharacteristicHandle;
 
-    //delimeters used for matching on receive.
-    ManagedString delimeters;
+    //delimeters used for matching on receive, as a bitmap of byte values.
+    uint32_t delimeterSet[8];
 
     //a variable used when a user calls the eventAfter() method.
     int rxBuffHeadMatch;
     
-    uint8_t txBufferHead;
-    uint8_t txBufferTail;
+    uint16_t txBufferHead;
+    uint16_t txBufferTail;
 
-    // the number of bytes from the tx buffer that have been sent, pending confirmation
-    uint8_t txValueSize;
+    // the number of bytes from the tx buffer that have been indicated, pending confirmation
+    uint16_t txValueSize;
 
     bool waitingForEmpty;
 
@@ -85,6 +91,16 @@ class MicroBitUARTService : public MicroBitBLEService
       * A callback function for whenever a Bluetooth device consumes our TX Buffer
       */
     void onConfirmation( const microbit_ble_evt_hvc_t *params);
+
+    /**
+      * A callback function for whenever the SoftDevice completes the transmission of queued notifications
+      */
+    void onTxComplete();
+
+    /**
+      * Determines if the connected device has enabled either indications or notifications of our TX characteristic.
+      */
+    bool txEnabled();
     
     
     /**
@@ -93,18 +109,14 @@ class MicroBitUARTService : public MicroBitBLEService
     void onDataWritten(const microbit_ble_evt_write_t *params);
 
     /**
-      * An internal method that copies values from a circular buffer to a linear buffer.
+      * An internal method that finds the first received character that is in the given delimeter set.
       *
-      * @param circularBuff a pointer to the source circular buffer
-      * @param circularBuffSize the size of the circular buffer
-      * @param linearBuff a pointer to the destination linear buffer
-      * @param tailPosition the tail position in the circular buffer you want to copy from
-      * @param headPosition the head position in the circular buffer you want to copy to
+      * @param set the delimeters to match against, as a bitmap of byte values.
+      * @param offset the number of buffered characters already known not to match, which are skipped.
       *
-      * @note this method assumes that the linear buffer has the appropriate amount of
-      *       memory to contain the copy operation
+      * @return the number of characters before the match, or -1 if there is no match.
       */
-    void circularCopy(uint8_t *circularBuff, uint8_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition);
+    int findDelimeter(const uint32_t *set, int offset);
 
     /**
       * An internal method that sends the next block from the tx buffer.
@@ -117,12 +129,14 @@ class MicroBitUARTService : public MicroBitBLEService
     /**
      * Constructor for the UARTService.
      * @param _ble an instance of BLEDevice
-     * @param rxBufferSize the size of the rxBuffer
-     * @param txBufferSize the size of the txBuffer
+     * @param rxBufferSize the size of the rxBuffer, up to MICROBIT_UART_S_MAX_BUF_SIZE bytes
+     * @param txBufferSize the size of the txBuffer, up to MICROBIT_UART_S_MAX_BUF_SIZE bytes
      *
-     * @note The default size is MICROBIT_UART_S_DEFAULT_BUF_SIZE (20 bytes).
+     * @note The default size is MICROBIT_UART_S_DEFAULT_BUF_SIZE (20 bytes). Buffers several times
+     *       the negotiated attribute size let ASYNC writers keep the link busy, and SYNC_SLEEP writers
+     *       block less often.
      */
-    MicroBitUARTService(BLEDevice &_ble, uint8_t rxBufferSize = MICROBIT_UART_S_DEFAULT_BUF_SIZE, uint8_t txBufferSize = MICROBIT_UART_S_DEFAULT_BUF_SIZE);
+    MicroBitUARTService(BLEDevice &_ble, uint16_t rxBufferSize = MICROBIT_UART_S_DEFAULT_BUF_SIZE, uint16_t txBufferSize = MICROBIT_UART_S_DEFAULT_BUF_SIZE);
 
     /**
       * Retreives a single character from our RxBuffer.
@@ -159,7 +173,7 @@ class MicroBitUARTService : public MicroBitBLEService
       *                         device.
       *
       * @return the number of characters written, or MICROBIT_NOT_SUPPORTED if there is
-      *         no connected device, or the connected device has not enabled indications.
+      *         no connected device, or the connected device has not enabled indications or notifications.
       */
     int putc(char c, MicroBitSerialMode mode = SYNC_SLEEP);
 
@@ -181,7 +195,7 @@ class MicroBitUARTService : public MicroBitBLEService
       *                         device.
       *
       * @return the number of characters written, or MICROBIT_NOT_SUPPORTED if there is
-      *         no connected device, or the connected device has not enabled indications.
+      *         no connected device, or the connected device has not enabled indications or notifications.
       */
     int send(const uint8_t *buf, int length, MicroBitSerialMode mode = SYNC_SLEEP);
 
@@ -202,7 +216,7 @@ class MicroBitUARTService : public MicroBitBLEService
       *                         device.
       *
       * @return the number of characters written, or MICROBIT_NOT_SUPPORTED if there is
-      *         no connected device, or the connected device has not enabled indications.
+      *         no connected device, or the connected device has not enabled indications or notifications.
       */
     int send(ManagedString s, MicroBitSerialMode mode = SYNC_SLEEP);
 
@@ -305,6 +319,40 @@ class MicroBitUARTService : public MicroBitBLEService
       */
     int eventAfter(int len, MicroBitSerialMode mode = ASYNC);
 
+    /**
+      * Provides direct access to received characters in the rxBuffer, without copying or consuming them.
+      *
+      * The rxBuffer is circular, so the buffered characters may be split into two contiguous spans.
+      * Call again with an offset of the length of the first span to reach the second.
+      *
+      * @param data set to point to the first character at the given offset.
+      * @param offset the number of buffered characters to skip.
+      *
+      * @return the number of contiguous characters available from data, 0 if there are none,
+      *         or MICROBIT_INVALID_PARAMETER if data is NULL.
+      *
+      * @note the characters stay valid until they are consumed.
+      */
+    int peek(const uint8_t **data, int offset = 0);
+
+    /**
+      * Discards characters from the rxBuffer, e.g. once they have been parsed in place with peek().
+      *
+      * @param len the number of characters to discard.
+      *
+      * @return the number of characters discarded, which is less than len if fewer are buffered.
+      */
+    int consume(int len);
+
+    /**
+      * Finds the first received character that matches one of the given delimeters, without consuming anything.
+      *
+      * @param delimeters the characters to match against e.g. ManagedString("\r\n")
+      *
+      * @return the number of characters before the match, or MICROBIT_NO_DATA if there is no match.
+      */
+    int indexOf(ManagedString delimeters);
+
     /**
       * Determines if we have space in our rxBuff.
       *
@@ -342,6 +390,8 @@ class MicroBitUARTService : public MicroBitBLEService
     
     int              characteristicCount()          { return mbbs_cIdxCOUNT; };
     MicroBitBLEChar *characteristicPtr( int idx)    { return &chars[ idx]; };
+
+    virtual bool onBleEvent( const microbit_ble_evt_t *p_ble_evt) override;
 };
 
 } // namespace codal
@@ -117,7 +117,7 @@ class MicroBitUtilityService : public MicroBitBLEService
     MicroBitStorage     &storage;
     MicroBitLog         &log;
 
-    uint8_t characteristicValue[ 20];
+    uint8_t *characteristicValue;
 
     // Index for each charactersitic in arrays of handles and UUIDs
     typedef enum mbbs_cIdx
@@ -172,6 +172,12 @@ class MicroBitUtilityService : public MicroBitBLEService
      * @return DEVICE_OK if finished
      */
     int processLogRead();
+
+    /**
+     * Process request typeLogExport
+     * @return DEVICE_OK if finished
+     */
+    int processLogExport();
 };
 
 } // namespace codal
@@ -58,6 +58,18 @@ DEALINGS IN THE SOFTWARE.
  *              length    (4 bytes)         - length of whole file, from request type 1 (Log file length)
  * reply        data      (up to 19 bytes)  - 1 or more reply packets, to total batchlen bytes
  *
+ * type 3     - Log file export
+ * request      format    (1 byte)          - 0 = HTML header; 1 = HTML; 2 = CSV
+ *              flags     (1 byte)          - set to zero
+ *              index     (4 bytes)         - unsigned integer index into file
+ *              batchlen  (4 bytes)         - unsigned size in bytes to return, e.g. the whole file
+ *              length    (4 bytes)         - length of whole file, from request type 1 (Log file length)
+ * reply        data      (up to MTU - 4)   - 1 or more reply packets, to total batchlen bytes
+ *
+ *              As type 2, but each reply packet is as large as the negotiated ATT MTU allows, and packets
+ *              are sent back to back as fast as the link accepts them. The client may limit batchlen to
+ *              pace the transfer, and can abandon it at any time by sending a new request.
+ *
  */
 namespace codal::MicroBitUtility
 {
@@ -65,7 +77,8 @@ namespace codal::MicroBitUtility
     {
         requestTypeNone,
         requestTypeLogLength,           // reply data = 4 bytes log data length
-        requestTypeLogRead              // reply data = up to 19 bytes of log data
+        requestTypeLogRead,             // reply data = up to 19 bytes of log data
+        requestTypeLogExport            // reply data = up to MTU - 4 bytes of log data
     } requestType_t;
 
     typedef struct request_t
@@ -28,6 +28,18 @@ DEALINGS IN THE SOFTWARE.
 #include "Button.h"
 #include "MicroBitCompat.h"
 
+// Edge events of button pins in interrupt mode, where the pin would otherwise share the id of its button.
+#define MICROBIT_ID_BUTTON_EDGE                 3036
+
+// Timer events, raised on the id of a button in interrupt mode.
+#define MICROBIT_BUTTON_EVT_DEBOUNCE            16      // The pin has been stable for the debounce time.
+#define MICROBIT_BUTTON_EVT_HOLD_CHECK          17      // The button may have been held down for DEVICE_BUTTON_HOLD_TIME.
+
+// Time in microseconds the pin of a button in interrupt mode must be stable for, after an edge, for a change to be accepted.
+#ifndef MICROBIT_BUTTON_DEBOUNCE_TIME
+#define MICROBIT_BUTTON_DEBOUNCE_TIME           20000
+#endif
+
 namespace codal
 {
 
@@ -92,6 +104,58 @@ class MicroBitButton : public NRF52Pin, public Button
      */
     MicroBitButton(Pin &p, uint16_t id, ButtonEventConfiguration eventConfiguration = DEVICE_BUTTON_ALL_EVENTS, ButtonPolarity polarity = ACTIVE_LOW, PullMode mode = PullMode::None);
 
+    /**
+     * Selects how this button is debounced.
+     *
+     * In interrupt mode the pin raises an event on each edge, and a change in state is accepted once the pin
+     * has been stable for MICROBIT_BUTTON_DEBOUNCE_TIME. The button is then no longer polled from the system tick,
+     * so costs nothing while idle and doesn't prevent tickless idle sleep. Otherwise, the pin is sampled on every
+     * system tick, as by Button.
+     *
+     * @param enable true to use interrupt mode, false to return to polling.
+     * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if there is no message bus to deliver edge events.
+     */
+    int setInterruptMode(bool enable);
+
+    /**
+     * Determines if this button is debounced in interrupt mode.
+     *
+     * @return true if in interrupt mode, false if polled from the system tick.
+     */
+    bool isInterruptMode();
+
+    /**
+     * Changes the event configuration used by this button to the given ButtonEventConfiguration.
+     *
+     * @param config The new configuration for this button. Legal values are MICROBIT_BUTTON_ALL_EVENTS or MICROBIT_BUTTON_SIMPLE_EVENTS.
+     */
+    void setEventConfiguration(ButtonEventConfiguration config);
+
+    /**
+     * Destructor.
+     */
+    ~MicroBitButton();
+
+    private:
+
+    CODAL_TIMESTAMP             downTime;               // The time the button was pressed, in interrupt mode.
+    ButtonEventConfiguration    clickConfiguration;     // Whether click events are generated, in interrupt mode.
+    bool                        interruptMode;          // true if debounced from pin edges rather than the system tick.
+
+    /**
+     * Common initialisation for all constructors.
+     */
+    void initInterruptMode(ButtonEventConfiguration eventConfiguration);
+
+    /**
+     * Callback. Invoked, in interrupt context, on each edge of our pin. (Re)starts the debounce timer.
+     */
+    void onEdge(MicroBitEvent e);
+
+    /**
+     * Callback. Invoked once the pin has been stable for the debounce time, or may have been held long enough to raise a hold event.
+     */
+    void onTimer(MicroBitEvent e);
 };
 
 }
@@ -41,6 +41,7 @@ DEALINGS IN THE SOFTWARE.
 #include "codal-core/inc/drivers/AnimatedDisplay.h"
 #include "codal-core/inc/driver-models/I2C.h"
 #include "codal-core/inc/drivers/KeyValueStorage.h"
+#include "MicroBitKeyValueLog.h"
 
 #include "MicroBitIO.h"
 #include "NRF52Pin.h"
@@ -70,7 +71,11 @@ typedef codal::Image MicroBitImage;
 typedef codal::SerialMode MicroBitSerialMode;
 typedef codal::CodalComponent MicroBitComponent;
 typedef codal::EventLaunchMode MicroBitEventLaunchMode;
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STORAGE_LOG)
+typedef codal::MicroBitKeyValueLog MicroBitStorage;
+#else
 typedef codal::KeyValueStorage MicroBitStorage;
+#endif
 typedef codal::BitmapFont MicroBitFont;
 
 //
@@ -27,15 +27,81 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitCompat.h"
 
+#define MICROBIT_ID_I2C_SCHEDULER               3034
+
+// Transaction priorities, highest first. Clients waiting for the bus are served in priority order, then in the order they asked.
+#define MICROBIT_I2C_PRIORITY_SENSOR            0       // Latency sensitive reads, e.g. the motion sensors.
+#define MICROBIT_I2C_PRIORITY_CONTROL           1       // Control traffic, e.g. MicroBitPowerManager.
+#define MICROBIT_I2C_PRIORITY_BULK              2       // Bulk traffic, e.g. MicroBitUSBFlashManager.
+#define MICROBIT_I2C_PRIORITIES                 3
+
+// Events, raised on MICROBIT_ID_I2C_SCHEDULER.
+#define MICROBIT_I2C_EVT_QUEUED                 1       // An asynchronous transfer has been queued.
+
+// Events, raised on the id given to an asynchronous transfer when it completes.
+#define MICROBIT_I2C_EVT_TRANSFER_COMPLETE      2       // The transfer succeeded.
+#define MICROBIT_I2C_EVT_TRANSFER_ERROR         3       // The transfer failed.
+
+// Writes to a register of up to this many bytes are combined into a single transaction without allocating memory.
+#define MICROBIT_I2C_REGISTER_WRITE_BUFFER      16
+
 namespace codal
 {
 
+class MicroBitI2C;
+
+/**
+  * An asynchronous I2C transfer, queued through MicroBitI2C::transfer() or one of the *Async() methods.
+  * The transfer (and its data) must remain valid until it has completed.
+  */
+struct MicroBitI2CTransfer
+{
+    uint16_t            address;                    // The 8 bit I2C address of the device.
+    int16_t             reg;                        // The register to read from or write to, or -1 to transfer without addressing a register.
+    bool                read;                       // true to read from the device, false to write to it.
+    uint8_t             priority;                   // One of MICROBIT_I2C_PRIORITY_*.
+    uint8_t             *data;                      // The data to write, or the buffer to read into.
+    int                 length;                     // The number of bytes to transfer.
+    volatile int        result;                     // DEVICE_BUSY until the transfer completes, then DEVICE_OK or an I2C error code.
+    uint16_t            id;                         // If non-zero, the id on which a MICROBIT_I2C_EVT_TRANSFER_* event is raised on completion.
+    void                (*callback)(MicroBitI2CTransfer *transfer);  // Invoked on completion, from the scheduler's fiber.
+    void                *context;                   // Available for use by the callback.
+    MicroBitI2CTransfer *next;                      // Used internally, to queue the transfer.
+};
+
 /**
   * Class definition for MicroBit I2C
   *
   */
 class MicroBitI2C : public NRF52I2C
 {
+    bool                busy;                                           // true if a client holds the bus.
+    bool                workerRunning;                                  // true if the fiber servicing asynchronous transfers exists.
+    uint16_t            waiting[MICROBIT_I2C_PRIORITIES];               // The number of fibers waiting for the bus, at each priority.
+    uint16_t            nextTicket[MICROBIT_I2C_PRIORITIES];            // The ticket given to the next fiber to wait, at each priority.
+    uint16_t            servedTicket[MICROBIT_I2C_PRIORITIES];          // The ticket of the next fiber to be granted the bus, at each priority.
+    MicroBitI2CTransfer *queue[MICROBIT_I2C_PRIORITIES];                // Asynchronous transfers awaiting service, at each priority.
+
+    /**
+      * Initialises the bus scheduler.
+      */
+    void initScheduler();
+
+    /**
+      * Services queued asynchronous transfers, highest priority first.
+      */
+    static void worker(void *bus);
+
+    /**
+      * Performs a transfer, holding the bus at the priority of the transfer.
+      */
+    int perform(MicroBitI2CTransfer *transfer);
+
+    /**
+      * Prepares and queues an asynchronous transfer.
+      */
+    int queueAsync(MicroBitI2CTransfer *transfer, uint16_t address, int reg, bool read, uint8_t *data, int length, uint16_t id, int priority);
+
     public:
     /**
       * Constructor.
@@ -70,6 +136,109 @@ class MicroBitI2C : public NRF52I2C
       */
      MicroBitI2C(PinNumber sda, PinNumber scl);
 
+    /**
+      * Awaits exclusive use of the bus, for one or more transfers.
+      * Fibers waiting for the bus are served in priority order, so bulk clients should hold it for a single
+      * transfer at a time, to let latency sensitive clients in between. Calls must not be nested.
+      *
+      * When called from interrupt context, or before the scheduler is running, this returns immediately,
+      * as no fiber can be part way through a transfer.
+      *
+      * @param priority One of MICROBIT_I2C_PRIORITY_*.
+      *
+      * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the priority is out of range.
+      */
+    int acquire(int priority);
+
+    /**
+      * Releases the bus, following a successful call to acquire(), passing it to the highest priority fiber waiting.
+      */
+    void release();
+
+    /**
+      * Queues an asynchronous transfer. Transfers are serviced by a fiber, highest priority first,
+      * with the bus acquired at the priority of the transfer. The callback of the transfer is
+      * invoked from that fiber once the transfer completes.
+      *
+      * @param transfer The transfer to queue.
+      *
+      * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the transfer is invalid,
+      *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+      */
+    int transfer(MicroBitI2CTransfer *transfer);
+
+    /**
+      * Queues an asynchronous read, letting the calling fiber carry on while the transfer takes place.
+      *
+      * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+      * @param address The 8 bit I2C address of the device.
+      * @param data The buffer to read into, which must be in RAM, as it is filled by EasyDMA.
+      * @param length The number of bytes to read.
+      * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+      * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+      *
+      * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+      *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+      */
+    int readAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t *data, int length, uint16_t id = 0, int priority = MICROBIT_I2C_PRIORITY_CONTROL);
+
+    /**
+      * Queues an asynchronous read of one or more registers, as a combined transaction (a write of the
+      * register address, then a repeated start and the read).
+      *
+      * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+      * @param address The 8 bit I2C address of the device.
+      * @param reg The register to read from.
+      * @param data The buffer to read into, which must be in RAM, as it is filled by EasyDMA.
+      * @param length The number of bytes to read.
+      * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+      * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+      *
+      * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+      *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+      */
+    int readRegisterAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t reg, uint8_t *data, int length, uint16_t id = 0, int priority = MICROBIT_I2C_PRIORITY_CONTROL);
+
+    /**
+      * Queues an asynchronous write, letting the calling fiber carry on while the transfer takes place.
+      *
+      * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+      * @param address The 8 bit I2C address of the device.
+      * @param data The data to write, which must remain valid until the transfer completes.
+      * @param length The number of bytes to write.
+      * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+      * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+      *
+      * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+      *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+      */
+    int writeAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t *data, int length, uint16_t id = 0, int priority = MICROBIT_I2C_PRIORITY_CONTROL);
+
+    /**
+      * Queues an asynchronous write to one or more registers, as a single transaction of the register address followed by the data.
+      *
+      * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+      * @param address The 8 bit I2C address of the device.
+      * @param reg The register to write to.
+      * @param data The data to write, which must remain valid until the transfer completes.
+      * @param length The number of bytes to write.
+      * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+      * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+      *
+      * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+      *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+      */
+    int writeRegisterAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t reg, uint8_t *data, int length, uint16_t id = 0, int priority = MICROBIT_I2C_PRIORITY_CONTROL);
+
+    /**
+      * Determines if an asynchronous transfer has completed.
+      *
+      * @param transfer The transfer to check.
+      *
+      * @return true if the transfer has completed (successfully or otherwise), false if it is still queued or in progress.
+      */
+    static bool isComplete(MicroBitI2CTransfer *transfer);
+
 };
 
 }
@@ -27,6 +27,9 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitCompat.h"
 
+// The largest buffer NRF52Serial can hold, as its ring buffer indices are 8 bits.
+#define MICROBIT_SERIAL_MAX_BUFFER_SIZE     255
+
 namespace codal
 {
 
@@ -36,6 +39,11 @@ namespace codal
   */
 class MicroBitSerial : public NRF52Serial
 {
+    /**
+      * Applies the buffer sizes requested of the compat constructors, which NRF52Serial otherwise takes no account of.
+      */
+    void setBufferSizes(uint16_t rxBufferSize, uint16_t txBufferSize);
+
     public:
 
     /**
@@ -56,8 +64,9 @@ class MicroBitSerial : public NRF52Serial
       * @note the default baud rate is 115200.
       *
       *       Buffers aren't allocated until the first send or receive respectively.
+      *       Sizes are limited to MICROBIT_SERIAL_MAX_BUFFER_SIZE by the underlying NRF52Serial.
       */
-    MicroBitSerial(Pin& tx, Pin& rx, uint8_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint8_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
+    MicroBitSerial(Pin& tx, Pin& rx, uint16_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
     
     /**
       * Constructor.
@@ -77,8 +86,9 @@ class MicroBitSerial : public NRF52Serial
       * @note the default baud rate is 115200.
       *
       *       Buffers aren't allocated until the first send or receive respectively.
+      *       Sizes are limited to MICROBIT_SERIAL_MAX_BUFFER_SIZE by the underlying NRF52Serial.
       */
-    MicroBitSerial(PinName tx, PinName rx, uint8_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint8_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
+    MicroBitSerial(PinName tx, PinName rx, uint16_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
 
     /**
       * Constructor.
@@ -98,8 +108,9 @@ class MicroBitSerial : public NRF52Serial
       * @note the default baud rate is 115200.
       *
       *       Buffers aren't allocated until the first send or receive respectively.
+      *       Sizes are limited to MICROBIT_SERIAL_MAX_BUFFER_SIZE by the underlying NRF52Serial.
       */
-    MicroBitSerial(PinNumber tx, PinNumber rx, uint8_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint8_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
+    MicroBitSerial(PinNumber tx, PinNumber rx, uint16_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
 
 
     /**
@@ -164,6 +164,8 @@ int MicroBit::init()
 
     status |= DEVICE_INITIALIZED;
 
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_INIT);
+
     // On a hard reset, wait for the USB interface chip to come online.
     if(NRF_POWER->RESETREAS == 0)
     {
@@ -182,17 +184,27 @@ int MicroBit::init()
 #endif
 
     // Determine if we have been reprogrammed. If so, follow configured policy on erasing any persistent user data.
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_ERASE_USER_STORAGE);
     eraseUserStorage();
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_ERASE_USER_STORAGE);
 
     // Bring up fiber scheduler.
     scheduler_init(messageBus);
 
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_COMPONENTS);
+
     for(int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
     {
         if(CodalComponent::components[i])
             CodalComponent::components[i]->init();
     }
 
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_COMPONENTS);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_RANDOM_POOL)
+    microbit_random_pool_start();
+#endif
+
     // Seed our random number generator
     seedRandom();
 
@@ -228,13 +240,18 @@ int MicroBit::init()
 
     power.readInterfaceRequest();
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_TICKLESS_IDLE)
+    buttonA.setInterruptMode(true);
+    buttonB.setInterruptMode(true);
+#endif
+
 #if CONFIG_ENABLED(DEVICE_BLE) && CONFIG_ENABLED(MICROBIT_BLE_PAIRING_MODE)
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_PAIRING_MODE);
     int i=0;
     // Test if we need to enter BLE pairing mode
     // If a RebootMode Key has been set boot straight into BLE mode
     KeyValuePair* RebootMode = storage.get("RebootMode");
     KeyValuePair* flashIncomplete = storage.get("flashIncomplete");
-    sleep(100);
     // Animation
     uint8_t x = 0; uint8_t y = 0;
     bool triple_reset = 0;
@@ -243,6 +260,12 @@ int MicroBit::init()
     triple_reset = (microbit_no_init_memory_region.resetClickCount == 3);
 #endif
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_FAST_BOOT)
+    // Only wait for the buttons to settle if something suggests we may be entering pairing mode.
+    if (triple_reset || RebootMode != NULL || flashIncomplete != NULL || buttonA.isPressed() || buttonB.isPressed())
+#endif
+    sleep(100);
+
     while (((triple_reset || (buttonA.isPressed() && buttonB.isPressed())) && i<25) || RebootMode != NULL || flashIncomplete != NULL)
     {
         display.image.setPixelValue(x,y,255);
@@ -276,8 +299,44 @@ int MicroBit::init()
             bleManager.pairingMode(display, buttonA);
         }
     }
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_PAIRING_MODE);
+#endif
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_FAST_BOOT) && CONFIG_ENABLED(DEVICE_BLE) && CONFIG_ENABLED(MICROBIT_BLE_ENABLED)
+    // Start BLE once user code first yields, rather than holding up main().
+    create_fiber(MicroBit::initBLEFiber, this);
+#else
+    initBLE();
+#endif
+
+#if !CONFIG_ENABLED(CONFIG_MICROBIT_FAST_BOOT)
+    // Deschedule for a little while, just to allow for any components that finialise initialisation
+    // as a background task, and to allow the power mamanger to repsonse to background events from the KL27
+    // before any user code begins running.
+    
+    sleep(10);
 #endif
 
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_INIT);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Entry point of the fiber used to start BLE in the background, when CONFIG_MICROBIT_FAST_BOOT is enabled.
+  *
+  * @param device The MicroBit instance.
+  */
+void MicroBit::initBLEFiber(void *device)
+{
+    ((MicroBit *)device)->initBLE();
+}
+
+/**
+  * Starts the BLE stack and any default services, and brings up the 64MHz external oscillator.
+  */
+void MicroBit::initBLE()
+{
 #if CONFIG_ENABLED(DEVICE_BLE) && CONFIG_ENABLED(MICROBIT_BLE_ENABLED)
     // Start the BLE stack, if it isn't already running.
     bleManager.init( ManagedString( microbit_friendly_name()), getSerial(), messageBus, storage, false);
@@ -288,6 +347,11 @@ int MicroBit::init()
         MicroBitUtilityService::createShared( *ble, messageBus, storage, log);
     #endif
 
+    #if CONFIG_ENABLED(MICROBIT_BLE_BENCHMARK_SERVICE)
+        MICROBIT_DEBUG_DMESG( "BENCHMARK_SERVICE");
+        new MicroBitBenchmarkService( *ble);
+    #endif
+
     // Bring up the 64MHz external oscillator.
     sd_clock_hfclk_request();
 #else
@@ -295,14 +359,6 @@ int MicroBit::init()
     NRF_CLOCK->TASKS_HFCLKSTART = 1;
     while (NRF_CLOCK->EVENTS_HFCLKSTARTED == 0);
 #endif
-
-    // Deschedule for a little while, just to allow for any components that finialise initialisation
-    // as a background task, and to allow the power mamanger to repsonse to background events from the KL27
-    // before any user code begins running.
-    
-    sleep(10);
-
-    return DEVICE_OK;
 }
 
 /**
@@ -399,6 +455,11 @@ void MicroBit::schedulerIdle()
         }
     }
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_TICKLESS_IDLE)
+    if ( power.idleSleep() == DEVICE_OK)
+        return;
+#endif
+
     target_wait_for_event();
 }
 
@@ -425,7 +486,8 @@ void MicroBit::periodicCallback()
     // Zero our reset_count once the micro:bit has been running for half a second
     static int timeout = 500 / (SCHEDULER_TICK_PERIOD_US/1000);
 
-    if (timeout-- == 0 && microbit_no_init_memory_region.resetClickCount != 0)
+    // This is our only use of the system tick, so stop asking for it once done (it would otherwise rule out tickless idle).
+    if (timeout-- == 0)
     {
         microbit_no_init_memory_region.resetClickCount = 0;
         status &= ~DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
@@ -40,6 +40,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "Button.h"
 #include "MultiButton.h"
+#include "MicroBitButton.h"
 #include "NRF52Pin.h"
 #include "NRF52Serial.h"
 #include "NRF52I2C.h"
@@ -59,10 +60,17 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitCompat.h"
 #include "MicroBitAccelerometer.h"
 #include "MicroBitCompass.h"
+#include "MicroBitAccelerometerFIFO.h"
 #include "MicroBitPowerManager.h"
 #include "NRF52FlashManager.h"
 #include "MicroBitUSBFlashManager.h"
+#include "MicroBitBootProfile.h"
+#include "MicroBitRandomPool.h"
+#include "MicroBitTrace.h"
+#include "MicroBitHeapProfile.h"
+#include "MicroBitStackProfile.h"
 #include "MicroBitLog.h"
+#include "MicroBitSensorCapture.h"
 #include "MicroBitAudio.h"
 #include "StreamNormalizer.h"
 #include "LevelDetector.h"
@@ -83,6 +91,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitUARTService.h"
 #include "MicroBitPartialFlashingService.h"
 #include "MicroBitUtilityService.h"
+#include "MicroBitBenchmarkService.h"
 #endif
 
 #include "MicroBitStorage.h"
@@ -121,6 +130,18 @@ namespace codal
              */
             void onP0ListenerRegisteredEvent(Event evt);
 
+            /**
+             * Starts the BLE stack and any default services, and brings up the 64MHz external oscillator.
+             */
+            void initBLE();
+
+            /**
+             * Entry point of the fiber used to start BLE in the background, when CONFIG_MICROBIT_FAST_BOOT is enabled.
+             *
+             * @param device The MicroBit instance.
+             */
+            static void initBLEFiber(void *device);
+
             // Pin ranges used for LED matrix display.
 
         public:
@@ -151,8 +172,14 @@ namespace codal
             NRF52Pin*                   ledColPins[5];
             const MatrixMap             ledMatrixMap;
             MicroBitDisplay             display;
+#if CONFIG_ENABLED(CONFIG_MICROBIT_TICKLESS_IDLE)
+            // A Button is sampled on every system tick, which would rule out tickless idle, so debounce from pin edges instead.
+            MicroBitButton              buttonA;
+            MicroBitButton              buttonB;
+#else
             Button                      buttonA;
             Button                      buttonB;
+#endif
             MultiButton                 buttonAB;
             TouchButton                 logo;
             MicroBitRadio               radio;
@@ -297,7 +324,12 @@ namespace codal
      */
     inline void MicroBit::sleep(uint32_t milliseconds)
     {
+#if CONFIG_ENABLED(CONFIG_MICROBIT_TICKLESS_IDLE)
+        // Fiber sleeps are woken by the scheduler tick, so flag the deadline as a wake up for tickless idle.
+        power.ticklessSleep(milliseconds);
+#else
         fiber_sleep(milliseconds);
+#endif
     }
 
     /**
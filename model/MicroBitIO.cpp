@@ -33,6 +33,48 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+/**
+  * The GPIO port and bit used by each edge connector pin, in the order of MicroBitIO::pin[].
+  */
+struct MicroBitPortBit
+{
+    uint8_t     port;
+    uint32_t    mask;
+};
+
+#define PORT_BIT(name) { (uint8_t) ((name) >> 5), 1UL << ((name) & 31) }
+
+static const MicroBitPortBit edgePinBits[MICROBIT_IO_EDGE_PINS] = {
+    PORT_BIT(MICROBIT_PIN_P0),
+    PORT_BIT(MICROBIT_PIN_P1),
+    PORT_BIT(MICROBIT_PIN_P2),
+    PORT_BIT(MICROBIT_PIN_P3),
+    PORT_BIT(MICROBIT_PIN_P4),
+    PORT_BIT(MICROBIT_PIN_P5),
+    PORT_BIT(MICROBIT_PIN_P6),
+    PORT_BIT(MICROBIT_PIN_P7),
+    PORT_BIT(MICROBIT_PIN_P8),
+    PORT_BIT(MICROBIT_PIN_P9),
+    PORT_BIT(MICROBIT_PIN_P10),
+    PORT_BIT(MICROBIT_PIN_P11),
+    PORT_BIT(MICROBIT_PIN_P12),
+    PORT_BIT(MICROBIT_PIN_P13),
+    PORT_BIT(MICROBIT_PIN_P14),
+    PORT_BIT(MICROBIT_PIN_P15),
+    PORT_BIT(MICROBIT_PIN_P16),
+    PORT_BIT(MICROBIT_PIN_P19),
+    PORT_BIT(MICROBIT_PIN_P20)
+};
+
+static inline NRF_GPIO_Type *gpio_port(int port)
+{
+#ifdef NRF_P1
+    return port ? NRF_P1 : NRF_P0;
+#else
+    return NRF_P0;
+#endif
+}
+
 /**
   * Constructor.
   *
@@ -112,6 +154,127 @@ MicroBitIO::MicroBitIO(NRF52ADC &a, TouchSensor &s) :
     savedStatus[pins] = 0;
 }
 
+/**
+ * Converts a set of edge connector pins into the bits they occupy in the given GPIO port.
+ * The result can be computed once, and then used with writePort() in time critical code.
+ *
+ * @param pins A bitmap of edge connector pins, in the order of pin[] (bit 0 is P0 ... bit 16 is P16, bit 17 is P19 and bit 18 is P20).
+ * @param port The GPIO port, 0 or 1.
+ * @return A mask of the bits in the given port used by those pins.
+ */
+uint32_t MicroBitIO::getPortMask(uint32_t pins, int port)
+{
+    uint32_t mask = 0;
+
+    for (int i = 0; i < MICROBIT_IO_EDGE_PINS; i++)
+    {
+        if ((pins & (1UL << i)) && edgePinBits[i].port == port)
+            mask |= edgePinBits[i].mask;
+    }
+
+    return mask;
+}
+
+/**
+ * Drives a number of bits of a GPIO port at once, using its OUTSET and OUTCLR registers.
+ * Only the output latch is changed: the pins must already be configured as digital outputs,
+ * for example by a call to setDigitalValue().
+ *
+ * @param port The GPIO port, 0 or 1.
+ * @param mask The bits of the port to change.
+ * @param value The levels to drive. Bits not in the mask are ignored.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the port is not valid.
+ */
+int MicroBitIO::writePort(int port, uint32_t mask, uint32_t value)
+{
+    if (port < 0 || port >= MICROBIT_IO_PORTS)
+        return DEVICE_INVALID_PARAMETER;
+
+    NRF_GPIO_Type *gpio = gpio_port(port);
+
+    gpio->OUTSET = mask & value;
+    gpio->OUTCLR = mask & ~value;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Reads the input levels of all the bits of a GPIO port at once.
+ *
+ * @param port The GPIO port, 0 or 1.
+ * @return The value of the port's IN register, or 0 if the port is not valid.
+ */
+uint32_t MicroBitIO::readPort(int port)
+{
+    if (port < 0 || port >= MICROBIT_IO_PORTS)
+        return 0;
+
+    return gpio_port(port)->IN;
+}
+
+/**
+ * Drives a number of edge connector pins at once, with at most one register write to each GPIO port for each level.
+ * Only the output latch is changed: the pins must already be configured as digital outputs,
+ * for example by a call to setDigitalValue().
+ *
+ * @param mask A bitmap of the edge connector pins to change, in the order of pin[].
+ * @param value The levels to drive, in the same order. Bits not in the mask are ignored.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitIO::writeEdgePins(uint32_t mask, uint32_t value)
+{
+    uint32_t set[MICROBIT_IO_PORTS] = { 0 };
+    uint32_t clr[MICROBIT_IO_PORTS] = { 0 };
+
+    for (int i = 0; i < MICROBIT_IO_EDGE_PINS; i++)
+    {
+        if (mask & (1UL << i))
+        {
+            const MicroBitPortBit &b = edgePinBits[i];
+
+            if (value & (1UL << i))
+                set[b.port] |= b.mask;
+            else
+                clr[b.port] |= b.mask;
+        }
+    }
+
+    for (int p = 0; p < MICROBIT_IO_PORTS; p++)
+    {
+        if (set[p])
+            gpio_port(p)->OUTSET = set[p];
+
+        if (clr[p])
+            gpio_port(p)->OUTCLR = clr[p];
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Takes a snapshot of the input levels of all the edge connector pins at once.
+ * The pins are not reconfigured, so only those already configured as digital inputs give meaningful values.
+ *
+ * @return A bitmap of the levels of the edge connector pins, in the order of pin[].
+ */
+uint32_t MicroBitIO::readEdgePins()
+{
+    uint32_t in[MICROBIT_IO_PORTS];
+    uint32_t levels = 0;
+
+    // Read each port once, so that all the pins are sampled as close together as possible.
+    for (int p = 0; p < MICROBIT_IO_PORTS; p++)
+        in[p] = gpio_port(p)->IN;
+
+    for (int i = 0; i < MICROBIT_IO_EDGE_PINS; i++)
+    {
+        if (in[edgePinBits[i].port] & edgePinBits[i].mask)
+            levels |= (1UL << i);
+    }
+
+    return levels;
+}
+
 #ifdef NRF_P1
 #define PORT (name < 32 ? NRF_P0 : NRF_P1)
 #define PIN ((name) & 31)
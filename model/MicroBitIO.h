@@ -346,6 +346,12 @@ typedef enum {
 
 #define IO_SAVED_STATUS_SAVED                   1
 
+//
+// Port level access to the edge connector
+//
+#define MICROBIT_IO_EDGE_PINS                   19
+#define MICROBIT_IO_PORTS                       2
+
 namespace codal
 {
     /**
@@ -424,6 +430,55 @@ namespace codal
              */
             virtual int deepSleepCallback( deepSleepCallbackReason reason, deepSleepCallbackData *data) override;
 
+            /**
+             * Converts a set of edge connector pins into the bits they occupy in the given GPIO port.
+             * The result can be computed once, and then used with writePort() in time critical code.
+             *
+             * @param pins A bitmap of edge connector pins, in the order of pin[] (bit 0 is P0 ... bit 16 is P16, bit 17 is P19 and bit 18 is P20).
+             * @param port The GPIO port, 0 or 1.
+             * @return A mask of the bits in the given port used by those pins.
+             */
+            static uint32_t getPortMask(uint32_t pins, int port);
+
+            /**
+             * Drives a number of bits of a GPIO port at once, using its OUTSET and OUTCLR registers.
+             * Only the output latch is changed: the pins must already be configured as digital outputs,
+             * for example by a call to setDigitalValue().
+             *
+             * @param port The GPIO port, 0 or 1.
+             * @param mask The bits of the port to change.
+             * @param value The levels to drive. Bits not in the mask are ignored.
+             * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the port is not valid.
+             */
+            static int writePort(int port, uint32_t mask, uint32_t value);
+
+            /**
+             * Reads the input levels of all the bits of a GPIO port at once.
+             *
+             * @param port The GPIO port, 0 or 1.
+             * @return The value of the port's IN register, or 0 if the port is not valid.
+             */
+            static uint32_t readPort(int port);
+
+            /**
+             * Drives a number of edge connector pins at once, with at most one register write to each GPIO port for each level.
+             * Only the output latch is changed: the pins must already be configured as digital outputs,
+             * for example by a call to setDigitalValue().
+             *
+             * @param mask A bitmap of the edge connector pins to change, in the order of pin[].
+             * @param value The levels to drive, in the same order. Bits not in the mask are ignored.
+             * @return MICROBIT_OK on success.
+             */
+            int writeEdgePins(uint32_t mask, uint32_t value);
+
+            /**
+             * Takes a snapshot of the input levels of all the edge connector pins at once.
+             * The pins are not reconfigured, so only those already configured as digital inputs give meaningful values.
+             *
+             * @return A bitmap of the levels of the edge connector pins, in the order of pin[].
+             */
+            uint32_t readEdgePins();
+
         private:
             ManagedBuffer     savedStatus;
 
@@ -0,0 +1,172 @@
+/*
+ * MicroBitFileSystem benchmark.
+ *
+ * Drives MicroBitFileSystem with a set of synthetic workloads (sequential append, random overwrite, many small files,
+ * and fill-to-full then delete), and reports the operations per second, FLASH bytes programmed, FLASH bytes erased
+ * and worst case call latency for each. Results are reported over serial, and via DMESG.
+ *
+ * To use, build this file in place of samples/main.cpp. Files created by a workload are removed before the next runs.
+ */
+#include "MicroBit.h"
+#include "MicroBitFileSystem.h"
+
+#define BENCHMARK_OPS           200
+#define BENCHMARK_CHUNK_SIZE    64
+#define BENCHMARK_SMALL_FILES   50
+#define BENCHMARK_FILL_ROUNDS   2
+
+MicroBit uBit;
+MicroBitFileSystem *fs;
+
+static uint8_t chunk[BENCHMARK_CHUNK_SIZE];
+
+struct BenchmarkResult
+{
+    uint32_t            ops;
+    uint32_t            worst;
+};
+
+typedef void (*BenchmarkWorkload)(BenchmarkResult &result);
+
+static void record(BenchmarkResult &result, CODAL_TIMESTAMP t)
+{
+    uint32_t latency = (uint32_t) (system_timer_current_time_us() - t);
+
+    result.ops++;
+    result.worst = max(result.worst, latency);
+}
+
+static void sequentialAppend(BenchmarkResult &result)
+{
+    int fd = fs->open("seq", MB_WRITE | MB_CREAT);
+
+    for (int i = 0; i < BENCHMARK_OPS; i++)
+    {
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        fs->write(fd, chunk, BENCHMARK_CHUNK_SIZE);
+        record(result, t);
+    }
+
+    fs->close(fd);
+}
+
+static void randomOverwrite(BenchmarkResult &result)
+{
+    // Reuse the file laid down by the sequential append workload.
+    int fd = fs->open("seq", MB_READ | MB_WRITE);
+
+    for (int i = 0; i < BENCHMARK_OPS; i++)
+    {
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        fs->seek(fd, microbit_random(BENCHMARK_OPS - 1) * BENCHMARK_CHUNK_SIZE, MB_SEEK_SET);
+        fs->write(fd, chunk, BENCHMARK_CHUNK_SIZE / 2);
+        record(result, t);
+    }
+
+    fs->close(fd);
+    fs->remove("seq");
+}
+
+static void smallFiles(BenchmarkResult &result)
+{
+    for (int i = 0; i < BENCHMARK_SMALL_FILES; i++)
+    {
+        ManagedString name = ManagedString("f") + ManagedString(i);
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        int fd = fs->open(name.toCharArray(), MB_WRITE | MB_CREAT);
+        fs->write(fd, chunk, 20);
+        fs->close(fd);
+        record(result, t);
+    }
+
+    for (int i = 0; i < BENCHMARK_SMALL_FILES; i++)
+    {
+        ManagedString name = ManagedString("f") + ManagedString(i);
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        fs->remove(name.toCharArray());
+        record(result, t);
+    }
+}
+
+static void fillAndDelete(BenchmarkResult &result)
+{
+    for (int round = 0; round < BENCHMARK_FILL_ROUNDS; round++)
+    {
+        int fd = fs->open("fill", MB_WRITE | MB_CREAT);
+        int written = BENCHMARK_CHUNK_SIZE;
+
+        while (written == BENCHMARK_CHUNK_SIZE)
+        {
+            CODAL_TIMESTAMP t = system_timer_current_time_us();
+            written = fs->write(fd, chunk, BENCHMARK_CHUNK_SIZE);
+            record(result, t);
+        }
+
+        fs->close(fd);
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        fs->remove("fill");
+        record(result, t);
+    }
+}
+
+struct Benchmark
+{
+    const char          *name;
+    BenchmarkWorkload   workload;
+};
+
+static const Benchmark benchmarks[] = {
+    { "sequential append",  sequentialAppend },
+    { "random overwrite",   randomOverwrite },
+    { "small files",        smallFiles },
+    { "fill and delete",    fillAndDelete },
+};
+
+static void runBenchmark(const Benchmark &benchmark)
+{
+    BenchmarkResult result = { 0, 0 };
+
+    MicroBitFlash::bytesProgrammed = 0;
+    MicroBitFlash::pagesErased = 0;
+
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+    benchmark.workload(result);
+    uint32_t elapsed = (uint32_t) (system_timer_current_time_us() - start);
+
+    uint32_t opsPerSecond = elapsed ? (uint32_t) (((uint64_t) result.ops * 1000000) / elapsed) : 0;
+    uint32_t programmed = MicroBitFlash::bytesProgrammed;
+    uint32_t erased = MicroBitFlash::pagesErased * MICROBIT_CODEPAGESIZE;
+
+    uBit.serial.printf("%s: %d ops, %d ops/s, %d bytes programmed, %d bytes erased, worst us %d\r\n", benchmark.name,
+        result.ops, opsPerSecond, programmed, erased, result.worst);
+
+    DMESG("FS_BENCHMARK: %s %d %d %d %d %d", benchmark.name, result.ops, opsPerSecond, programmed, erased, result.worst);
+}
+
+int
+main()
+{
+    uBit.init();
+
+    for (int i = 0; i < BENCHMARK_CHUNK_SIZE; i++)
+        chunk[i] = i;
+
+    fs = new MicroBitFileSystem();
+
+    uBit.serial.printf("MicroBitFileSystem benchmark: %d bytes free\r\n", fs->getFreeSpace());
+
+    for (uint32_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        uBit.display.print((char) ('0' + (i % 10)));
+        runBenchmark(benchmarks[i]);
+    }
+
+    uBit.serial.printf("MicroBitFileSystem benchmark complete\r\n");
+    uBit.display.scroll("DONE");
+
+    while(1)
+        uBit.sleep(1000);
+}
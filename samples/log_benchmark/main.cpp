@@ -0,0 +1,126 @@
+/*
+ * MicroBitLog benchmark.
+ *
+ * Drives MicroBitLog with a set of synthetic workloads, and reports sustained throughput (rows per second),
+ * the distribution of endRow() latency and the number of bytes stored per row for each configuration.
+ * Results are reported over serial, and via DMESG.
+ *
+ * To use, build this file in place of samples/main.cpp. The log is cleared before each configuration is run.
+ */
+#include "MicroBit.h"
+
+#define BENCHMARK_ROWS          200
+#define BENCHMARK_MAX_COLUMNS   8
+
+MicroBit uBit;
+
+struct BenchmarkConfig
+{
+    const char          *name;
+    TimeStampFormat     timeStamp;
+    bool                mirror;
+    bool                buffered;
+    bool                binary;
+    int                 columns;
+};
+
+static const BenchmarkConfig configs[] = {
+    { "baseline",           TimeStampFormat::None,          false,  false,  false,  3 },
+    { "timestamp",          TimeStampFormat::Milliseconds,  false,  false,  false,  3 },
+    { "mirror",             TimeStampFormat::None,          true,   false,  false,  3 },
+    { "one column",         TimeStampFormat::None,          false,  false,  false,  1 },
+    { "many columns",       TimeStampFormat::None,          false,  false,  false,  BENCHMARK_MAX_COLUMNS },
+    { "buffered",           TimeStampFormat::Milliseconds,  false,  true,   false,  3 },
+    { "binary",             TimeStampFormat::Milliseconds,  false,  false,  true,   3 },
+    { "buffered binary",    TimeStampFormat::Milliseconds,  false,  true,   true,   3 },
+};
+
+static ManagedString columnNames[BENCHMARK_MAX_COLUMNS];
+static uint32_t latency[BENCHMARK_ROWS];
+
+static void sort(uint32_t *data, int len)
+{
+    for (int i=1; i<len; i++)
+    {
+        uint32_t v = data[i];
+        int j = i - 1;
+
+        while (j >= 0 && data[j] > v)
+        {
+            data[j+1] = data[j];
+            j--;
+        }
+
+        data[j+1] = v;
+    }
+}
+
+static void runBenchmark(const BenchmarkConfig &config)
+{
+    uBit.log.setSerialMirroring(false);
+    uBit.log.setBuffered(false);
+    uBit.log.clear();
+
+    uBit.log.setTimeStamp(config.timeStamp);
+    uBit.log.setBuffered(config.buffered);
+    uBit.log.setBinaryFormat(config.binary);
+
+    uint32_t startLength = uBit.log.getDataLength(DataFormat::CSV);
+
+    // Only mirror the rows themselves, not the results.
+    uBit.log.setSerialMirroring(config.mirror);
+
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    for (int row = 0; row < BENCHMARK_ROWS; row++)
+    {
+        uBit.log.beginRow();
+
+        for (int c = 0; c < config.columns; c++)
+            uBit.log.logData(columnNames[c], ManagedString((row * (c + 1)) % 1000));
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        uBit.log.endRow();
+        latency[row] = (uint32_t) (system_timer_current_time_us() - t);
+    }
+
+    uBit.log.flush();
+
+    uint32_t elapsed = (uint32_t) (system_timer_current_time_us() - start);
+
+    uBit.log.setSerialMirroring(false);
+
+    uint32_t bytesPerRow = (uBit.log.getDataLength(DataFormat::CSV) - startLength) / BENCHMARK_ROWS;
+    uint32_t rowsPerSecond = elapsed ? (uint32_t) (((uint64_t) BENCHMARK_ROWS * 1000000) / elapsed) : 0;
+
+    sort(latency, BENCHMARK_ROWS);
+
+    uBit.serial.printf("%s: %d rows/s, endRow us min %d p50 %d p95 %d max %d, %d bytes/row\r\n", config.name, rowsPerSecond,
+        latency[0], latency[BENCHMARK_ROWS / 2], latency[(BENCHMARK_ROWS * 95) / 100], latency[BENCHMARK_ROWS - 1], bytesPerRow);
+
+    DMESG("LOG_BENCHMARK: %s %d %d %d %d %d %d", config.name, rowsPerSecond,
+        latency[0], latency[BENCHMARK_ROWS / 2], latency[(BENCHMARK_ROWS * 95) / 100], latency[BENCHMARK_ROWS - 1], bytesPerRow);
+}
+
+int
+main()
+{
+    uBit.init();
+
+    for (int c = 0; c < BENCHMARK_MAX_COLUMNS; c++)
+        columnNames[c] = ManagedString("col") + ManagedString(c);
+
+    uBit.serial.printf("MicroBitLog benchmark: %d rows per configuration\r\n", BENCHMARK_ROWS);
+
+    for (uint32_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        uBit.display.print((char) ('0' + (i % 10)));
+        runBenchmark(configs[i]);
+    }
+
+    uBit.serial.printf("MicroBitLog benchmark complete\r\n");
+    uBit.display.scroll("DONE");
+
+    while(1)
+        uBit.sleep(1000);
+}
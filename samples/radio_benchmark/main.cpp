@@ -0,0 +1,339 @@
+/*
+ * MicroBitRadio benchmark.
+ *
+ * Drives MicroBitRadio and MicroBitRadioDatagram between two micro:bits across a set of payload sizes, transmit powers
+ * and bands, using both the blocking send() and the asynchronous sendAsync(). For each configuration, reports the
+ * packets per second delivered, the loss rate, and the round trip latency (with one-way latency estimated as half the
+ * round trip, as the boards share no clock). Results are reported over serial, and via DMESG.
+ *
+ * To use, build this file in place of samples/main.cpp and flash it to two micro:bits. Press B on one to make it the
+ * reflector, then press A on the other to run the benchmark. Each configuration is agreed on the base band before
+ * both boards switch to it, and the reflector returns to the base band once the initiator falls silent.
+ */
+#include "MicroBit.h"
+
+#define BENCHMARK_GROUP             42
+#define BENCHMARK_BASE_BAND         7
+#define BENCHMARK_BASE_POWER        7
+#define BENCHMARK_PINGS             100
+#define BENCHMARK_BURST             200
+#define BENCHMARK_PING_TIMEOUT      50000       // microseconds
+#define BENCHMARK_RETRIES           30
+#define BENCHMARK_RETRY_INTERVAL    100         // milliseconds
+#define BENCHMARK_SETTLE_TIME       50          // milliseconds
+#define BENCHMARK_IDLE_TIMEOUT      1000        // milliseconds
+
+#define BENCHMARK_PING              1
+#define BENCHMARK_PONG              2
+#define BENCHMARK_DATA              3
+#define BENCHMARK_REPORT_REQUEST    4
+#define BENCHMARK_REPORT            5
+#define BENCHMARK_CONFIG            6
+#define BENCHMARK_CONFIG_ACK        7
+
+MicroBit uBit;
+
+struct BenchmarkConfig
+{
+    const char          *name;
+    int                 size;
+    int                 power;
+    int                 band;
+    bool                async;
+};
+
+static const BenchmarkConfig configs[] = {
+    { "8 bytes blocking",       8,                              7,  7,  false },
+    { "max bytes blocking",     MICROBIT_RADIO_MAX_PACKET_SIZE, 7,  7,  false },
+    { "8 bytes async",          8,                              7,  7,  true },
+    { "max bytes async",        MICROBIT_RADIO_MAX_PACKET_SIZE, 7,  7,  true },
+    { "low power",              MICROBIT_RADIO_MAX_PACKET_SIZE, 0,  7,  true },
+    { "band 50",                MICROBIT_RADIO_MAX_PACKET_SIZE, 7,  50, true },
+    { "band 80",                MICROBIT_RADIO_MAX_PACKET_SIZE, 7,  80, true },
+};
+
+static uint8_t packet[MICROBIT_RADIO_MAX_PACKET_SIZE];
+static uint32_t latency[BENCHMARK_PINGS];
+
+// State updated as packets arrive.
+static volatile bool reflector = false;
+static volatile bool configAcked = false;
+static volatile bool reportReceived = false;
+static volatile int pongSeq = -1;
+static volatile uint32_t pongTime = 0;
+static volatile uint32_t dataCount = 0;
+static volatile uint32_t dataFirst = 0;
+static volatile uint32_t dataLast = 0;
+static volatile uint32_t lastActivity = 0;
+static volatile bool onTestBand = false;
+
+static void sort(uint32_t *data, int len)
+{
+    for (int i=1; i<len; i++)
+    {
+        uint32_t v = data[i];
+        int j = i - 1;
+
+        while (j >= 0 && data[j] > v)
+        {
+            data[j+1] = data[j];
+            j--;
+        }
+
+        data[j+1] = v;
+    }
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint32_t get32(uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void applySettings(int power, int band)
+{
+    uBit.radio.setTransmitPower(power);
+    uBit.radio.setFrequencyBand(band);
+}
+
+static void sendPacket(uint8_t *data, int len, bool async)
+{
+    if (!async)
+    {
+        uBit.radio.datagram.send(data, len);
+        return;
+    }
+
+    FrameBuffer buf;
+
+    buf.length = len + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_DATAGRAM;
+    memcpy(buf.payload, data, len);
+
+    // The transmit queue is short, so wait for space rather than dropping the frame.
+    while (uBit.radio.sendAsync(&buf) == DEVICE_NO_RESOURCES)
+        schedule();
+}
+
+static void onData(MicroBitEvent)
+{
+    PacketBuffer p = uBit.radio.datagram.recv();
+
+    if (p.length() < 1)
+        return;
+
+    uint8_t *data = p.getBytes();
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+
+    lastActivity = (uint32_t) system_timer_current_time();
+
+    switch (data[0])
+    {
+        case BENCHMARK_PING:
+            if (reflector)
+            {
+                data[0] = BENCHMARK_PONG;
+                uBit.radio.datagram.send(p);
+            }
+            break;
+
+        case BENCHMARK_PONG:
+            pongSeq = data[1] | (data[2] << 8);
+            pongTime = now;
+            break;
+
+        case BENCHMARK_DATA:
+            if (dataCount == 0)
+                dataFirst = now;
+            dataLast = now;
+            dataCount++;
+            break;
+
+        case BENCHMARK_REPORT_REQUEST:
+            if (reflector)
+            {
+                uint8_t report[9];
+                report[0] = BENCHMARK_REPORT;
+                put32(&report[1], dataCount);
+                put32(&report[5], dataLast - dataFirst);
+                uBit.radio.datagram.send(report, sizeof(report));
+            }
+            break;
+
+        case BENCHMARK_REPORT:
+            if (p.length() >= 9)
+            {
+                dataCount = get32(&data[1]);
+                dataLast = get32(&data[5]);
+                reportReceived = true;
+            }
+            break;
+
+        case BENCHMARK_CONFIG:
+            if (reflector && data[1] < sizeof(configs) / sizeof(configs[0]))
+            {
+                // Acknowledge on the base band, then follow the initiator onto the configuration under test.
+                uint8_t ack = BENCHMARK_CONFIG_ACK;
+                uBit.radio.datagram.send(&ack, 1);
+
+                applySettings(configs[data[1]].power, configs[data[1]].band);
+                dataCount = 0;
+                onTestBand = true;
+            }
+            break;
+
+        case BENCHMARK_CONFIG_ACK:
+            configAcked = true;
+            break;
+    }
+}
+
+static void runBenchmark(const BenchmarkConfig &config, int index)
+{
+    // Agree the configuration with the reflector on the base band.
+    applySettings(BENCHMARK_BASE_POWER, BENCHMARK_BASE_BAND);
+    configAcked = false;
+
+    for (int i = 0; i < BENCHMARK_RETRIES && !configAcked; i++)
+    {
+        packet[0] = BENCHMARK_CONFIG;
+        packet[1] = index;
+        uBit.radio.datagram.send(packet, 2);
+        uBit.sleep(BENCHMARK_RETRY_INTERVAL);
+    }
+
+    if (!configAcked)
+    {
+        uBit.serial.printf("%s: no reflector\r\n", config.name);
+        return;
+    }
+
+    applySettings(config.power, config.band);
+    uBit.sleep(BENCHMARK_SETTLE_TIME);
+
+    memset(packet, 0, sizeof(packet));
+
+    // Round trip latency: one ping at a time, each waiting for its pong.
+    int pings = 0;
+    int lost = 0;
+
+    for (int seq = 0; seq < BENCHMARK_PINGS; seq++)
+    {
+        packet[0] = BENCHMARK_PING;
+        packet[1] = seq & 0xff;
+        packet[2] = seq >> 8;
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        sendPacket(packet, config.size, config.async);
+
+        while (pongSeq != seq && system_timer_current_time_us() - t < BENCHMARK_PING_TIMEOUT)
+            uBit.sleep(1);
+
+        if (pongSeq == seq)
+            latency[pings++] = pongTime - (uint32_t) t;
+        else
+            lost++;
+    }
+
+    pongSeq = -1;
+
+    // Throughput and loss: a back to back burst, counted by the reflector.
+    packet[0] = BENCHMARK_DATA;
+
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    for (int i = 0; i < BENCHMARK_BURST; i++)
+        sendPacket(packet, config.size, config.async);
+
+    while (uBit.radio.isTransmitting())
+        uBit.sleep(1);
+
+    uint32_t sendTime = (uint32_t) (system_timer_current_time_us() - start);
+
+    uBit.sleep(BENCHMARK_SETTLE_TIME);
+
+    reportReceived = false;
+
+    for (int i = 0; i < BENCHMARK_RETRIES && !reportReceived; i++)
+    {
+        packet[0] = BENCHMARK_REPORT_REQUEST;
+        uBit.radio.datagram.send(packet, 1);
+        uBit.sleep(BENCHMARK_RETRY_INTERVAL);
+    }
+
+    uint32_t delivered = reportReceived ? dataCount : 0;
+    uint32_t rxTime = reportReceived ? dataLast : 0;
+    uint32_t packetsPerSecond = (delivered > 1 && rxTime) ? (uint32_t) (((uint64_t) (delivered - 1) * 1000000) / rxTime) : 0;
+    uint32_t loss = ((BENCHMARK_BURST - delivered) * 100) / BENCHMARK_BURST;
+
+    sort(latency, pings);
+
+    uint32_t p50 = pings ? latency[pings / 2] : 0;
+    uint32_t worst = pings ? latency[pings - 1] : 0;
+
+    uBit.serial.printf("%s: %d pps, loss %d%%, send us %d, rtt us p50 %d max %d, one-way us ~%d, pings lost %d/%d\r\n", config.name,
+        packetsPerSecond, loss, sendTime, p50, worst, p50 / 2, lost, BENCHMARK_PINGS);
+
+    DMESG("RADIO_BENCHMARK: %s %d %d %d %d %d %d", config.name, packetsPerSecond, loss, sendTime, p50, worst, lost);
+
+    // Let the reflector time out back to the base band.
+    applySettings(BENCHMARK_BASE_POWER, BENCHMARK_BASE_BAND);
+    uBit.sleep(BENCHMARK_IDLE_TIMEOUT + BENCHMARK_SETTLE_TIME);
+}
+
+int
+main()
+{
+    uBit.init();
+
+    uBit.radio.enable();
+    uBit.radio.setGroup(BENCHMARK_GROUP);
+    applySettings(BENCHMARK_BASE_POWER, BENCHMARK_BASE_BAND);
+
+    uBit.messageBus.listen(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_DATAGRAM, onData);
+
+    uBit.display.print('?');
+
+    while (!uBit.buttonA.isPressed() && !uBit.buttonB.isPressed())
+        uBit.sleep(10);
+
+    if (uBit.buttonB.isPressed())
+    {
+        reflector = true;
+        uBit.display.print('R');
+        uBit.serial.printf("MicroBitRadio benchmark: reflecting\r\n");
+
+        while(1)
+        {
+            uBit.sleep(100);
+
+            if (onTestBand && (uint32_t) system_timer_current_time() - lastActivity > BENCHMARK_IDLE_TIMEOUT)
+            {
+                applySettings(BENCHMARK_BASE_POWER, BENCHMARK_BASE_BAND);
+                onTestBand = false;
+            }
+        }
+    }
+
+    uBit.serial.printf("MicroBitRadio benchmark: %d pings and %d packets per configuration\r\n", BENCHMARK_PINGS, BENCHMARK_BURST);
+
+    for (uint32_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        uBit.display.print((char) ('0' + (i % 10)));
+        runBenchmark(configs[i], i);
+    }
+
+    uBit.serial.printf("MicroBitRadio benchmark complete\r\n");
+    uBit.display.scroll("DONE");
+
+    while(1)
+        uBit.sleep(1000);
+}
@@ -0,0 +1,238 @@
+/*
+ * Audio synthesizer render benchmark.
+ *
+ * Renders a fixed set of scripts through PolySynth (a number of voices, playing a preset for a given duration) and
+ * through SoundEmojiSynthesizer (each built in sound expression), and reports the processor cycles spent per output
+ * sample and the real time factor (seconds of audio rendered per second of processor time) for each. Results are
+ * reported over serial, and via DMESG.
+ *
+ * Rendering is driven directly, rather than by the audio pipeline, so that only the synthesizers themselves are
+ * measured. The render functions depend only on the synthesizer classes and the cycle counter used by AudioStats,
+ * so may be lifted into a host build to compare changes to the synthesizers off device.
+ *
+ * To use, build this file in place of samples/main.cpp.
+ */
+#include "MicroBit.h"
+#include "MicroSynth.h"
+#include "AudioStats.h"
+
+#define BENCHMARK_POLYSYNTH_VOICES      8
+#define BENCHMARK_RELEASE_TIME          0.5f        // seconds rendered after the notes of a script end
+#define BENCHMARK_MAX_SAMPLES           (10 * 44100)
+
+MicroBit uBit;
+
+struct BenchmarkResult
+{
+    uint32_t            samples;
+    uint32_t            sampleRate;
+    uint64_t            cycles;
+    int                 voiceLimit;
+};
+
+struct SynthScript
+{
+    const char          *name;
+    int                 preset;
+    int                 voices;
+    float               duration;
+};
+
+static const SynthScript scripts[] = {
+    { "saw pad x1",         0,  1,  1.0f },
+    { "saw pad x4",         0,  4,  1.0f },
+    { "saw pad x8",         0,  8,  1.0f },
+    { "fm bell x1",         1,  1,  1.0f },
+    { "fm bell x4",         1,  4,  1.0f },
+    { "bl lead x1",         2,  1,  1.0f },
+    { "bl lead x4",         2,  4,  1.0f },
+    { "gated organ x4",     3,  4,  1.0f },
+};
+
+static const int chord[BENCHMARK_POLYSYNTH_VOICES] = { 48, 55, 60, 64, 67, 71, 72, 76 };
+
+static SynthPreset presets[4];
+static uint16_t block[SynthBlockSize];
+
+/**
+ * A sink that accepts, and ignores, pull requests, so that a synthesizer may be driven by hand.
+ */
+class BenchmarkSink : public DataSink
+{
+    public:
+    virtual int pullRequest() override
+    {
+        return DEVICE_OK;
+    }
+};
+
+static BenchmarkSink sink;
+static volatile bool soundDone = false;
+
+static void initPresets()
+{
+    memset(presets, 0, sizeof(presets));
+
+    for (int i = 0; i < 4; i++)
+    {
+        SynthPreset &p = presets[i];
+
+        p.osc1Vol = 0.5f;
+        p.osc2Vol = 0.4f;
+        p.filterCutoff = 0.6f;
+        p.filterReso = 0.3f;
+        p.envA = 0.01f;
+        p.envD = 0.1f;
+        p.envS = 0.6f;
+        p.envR = 0.2f;
+        p.lfoShape = OscType::Triangle;
+        p.lfoFreq = 3.0f;
+        p.gain = 0.3f;
+    }
+
+    // Detuned sawtooths through a resonant low pass filter.
+    presets[0].osc1Shape = OscType::Saw;
+    presets[0].osc2Shape = OscType::Saw;
+    presets[0].osc2Transpose = 0.1f;
+    presets[0].filterType = FilterType::LPF;
+    presets[0].filterReso = 0.6f;
+    presets[0].filterLfo = 0.2f;
+
+    // Phase modulated triangles, exercising the PM path.
+    presets[1].osc1Shape = OscType::Triangle;
+    presets[1].osc2Shape = OscType::Triangle;
+    presets[1].osc2Transpose = 12.0f;
+    presets[1].fmAmount = 0.4f;
+    presets[1].filterType = FilterType::BPF;
+    presets[1].envS = 0.0f;
+
+    // Band limited wavetable oscillators, with filter envelope, vibrato and PWM.
+    presets[2].osc1Shape = OscType::BLSaw;
+    presets[2].osc2Shape = OscType::BLPulse;
+    presets[2].osc2Transpose = 7.0f;
+    presets[2].osc2Pwm = 0.3f;
+    presets[2].filterType = FilterType::LPF;
+    presets[2].filterEnv = 0.4f;
+    presets[2].filterKeyFollow = 0.5f;
+    presets[2].vibFreq = 5.0f;
+    presets[2].vibAmount = 0.2f;
+
+    // Pulse waves with noise, using the gate rather than the ADSR as amplitude envelope.
+    presets[3].osc1Shape = OscType::Pulse;
+    presets[3].osc2Shape = OscType::Pulse;
+    presets[3].osc2Transpose = 12.0f;
+    presets[3].osc1Pw = 0.2f;
+    presets[3].filterType = FilterType::HPF;
+    presets[3].filterCutoff = 0.1f;
+    presets[3].noise = 0.05f;
+    presets[3].ampGate = true;
+}
+
+static void renderPolySynth(PolySynth &synth, const SynthScript &script, BenchmarkResult &result)
+{
+    for (int i = 0; i < script.voices; i++)
+        synth.noteOn(chord[i], 0.8f, script.duration, &presets[script.preset]);
+
+    uint32_t total = (uint32_t) ((script.duration + BENCHMARK_RELEASE_TIME) * SynthSampleRate);
+
+    result.samples = 0;
+    result.sampleRate = SynthSampleRate;
+    result.cycles = 0;
+    result.voiceLimit = synth.getVoiceLimit();
+
+    while (result.samples < total)
+    {
+        uint32_t start = audio_stats_begin();
+        synth.process(block, SynthBlockSize);
+        result.cycles += audio_stats_begin() - start;
+
+        result.samples += SynthBlockSize;
+        result.voiceLimit = min(result.voiceLimit, synth.getVoiceLimit());
+    }
+}
+
+static void onSoundDone(MicroBitEvent)
+{
+    soundDone = true;
+}
+
+static void renderSoundExpression(SoundEmojiSynthesizer &synth, ManagedBuffer effects, BenchmarkResult &result)
+{
+    soundDone = false;
+    synth.play(effects);
+
+    result.samples = 0;
+    result.sampleRate = synth.sampleRate;
+    result.cycles = 0;
+    result.voiceLimit = 1;
+
+    while (!soundDone && result.samples < BENCHMARK_MAX_SAMPLES)
+    {
+        uint32_t start = audio_stats_begin();
+        ManagedBuffer b = synth.pull();
+        result.cycles += audio_stats_begin() - start;
+
+        result.samples += b.length() / sizeof(uint16_t);
+    }
+}
+
+static void report(const char *type, const char *name, BenchmarkResult &result)
+{
+    // Cycles per sample, and the real time factor in hundredths: (samples / sampleRate) / (cycles / SystemCoreClock).
+    uint32_t cyclesPerSample = result.samples ? (uint32_t) (result.cycles / result.samples) : 0;
+    uint32_t realTime = result.cycles ? (uint32_t) (((uint64_t) result.samples * SystemCoreClock * 100) / (result.cycles * result.sampleRate)) : 0;
+
+    uBit.serial.printf("%s %s: %d samples, %d cycles/sample, real time x%d.%d%d, voice limit %d\r\n", type, name,
+        result.samples, cyclesPerSample, realTime / 100, (realTime / 10) % 10, realTime % 10, result.voiceLimit);
+
+    DMESG("SYNTH_BENCHMARK: %s %s %d %d %d %d", type, name, result.samples, cyclesPerSample, realTime, result.voiceLimit);
+}
+
+int
+main()
+{
+    uBit.init();
+
+    initPresets();
+
+    uBit.serial.printf("Synthesizer benchmark: %d MHz\r\n", SystemCoreClock / 1000000);
+
+    BenchmarkResult result;
+
+    // A fresh synthesizer for each script, so that voice stealing in one doesn't carry over to the next.
+    for (uint32_t i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++)
+    {
+        uBit.display.print((char) ('0' + (i % 10)));
+
+        PolySynth *synth = new PolySynth(BENCHMARK_POLYSYNTH_VOICES);
+        renderPolySynth(*synth, scripts[i], result);
+        delete synth;
+
+        report("polysynth", scripts[i].name, result);
+    }
+
+    // A synthesizer of our own, driven by hand rather than through the mixer.
+    SoundEmojiSynthesizer emoji(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_1);
+    emoji.connect(sink);
+    uBit.messageBus.listen(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_1, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE, onSoundDone, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+    static const char *sounds[SOUND_EXPRESSIONS_BUILT_IN_COUNT] = {
+        "giggle", "happy", "hello", "mysterious", "sad", "slide", "soaring", "spring", "twinkle", "yawn"
+    };
+
+    for (int i = 0; i < SOUND_EXPRESSIONS_BUILT_IN_COUNT; i++)
+    {
+        uBit.display.print((char) ('0' + (i % 10)));
+
+        ManagedBuffer effects = uBit.audio.soundExpressions.compile((BuiltInSound) i);
+        renderSoundExpression(emoji, effects, result);
+
+        report("emoji", sounds[i], result);
+    }
+
+    uBit.serial.printf("Synthesizer benchmark complete\r\n");
+    uBit.display.scroll("DONE");
+
+    while(1)
+        uBit.sleep(1000);
+}
@@ -0,0 +1,99 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioBufferPool.h"
+#include "RefCountedUtil.h"
+#include "MicroBitHeapProfile.h"
+
+using namespace codal;
+
+/**
+ * Determines if the given buffer is referenced only by the pool.
+ */
+static bool audio_buffer_is_free(ManagedBuffer &b)
+{
+    return refcounted_is_unique(b.getBufferData());
+}
+
+/**
+ * Provides a buffer of the given length, reusing a released buffer if one is available.
+ * The content of a reused buffer is undefined, so the caller is expected to fill it in full.
+ *
+ * @param length The length of the buffer, in bytes.
+ * @return A buffer of the requested length.
+ */
+ManagedBuffer AudioBufferPool::allocate(int length)
+{
+    int spare = -1;
+
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+    {
+        if (buffers[i].length() == 0)
+        {
+            if (spare < 0)
+                spare = i;
+
+            continue;
+        }
+
+        if (audio_buffer_is_free(buffers[i]))
+        {
+            if (buffers[i].length() == length)
+                return buffers[i];
+
+            // A released buffer of the wrong size (e.g. after a sample rate change) can make way for a new one.
+            if (spare < 0)
+                spare = i;
+        }
+    }
+
+    ManagedBuffer b(length);
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_AUDIO, b.getBufferData(), length);
+
+    if (spare >= 0)
+    {
+        if (buffers[spare].length() != 0)
+            MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_AUDIO, buffers[spare].getBufferData());
+
+        buffers[spare] = b;
+    }
+
+    return b;
+}
+
+/**
+ * Releases every buffer held by the pool, so their memory is returned to the heap once downstream
+ * references are dropped.
+ */
+void AudioBufferPool::clear()
+{
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+    {
+        // Buffers still referenced downstream are freed later, out of sight of the heap profile.
+        if (buffers[i].length() != 0 && audio_buffer_is_free(buffers[i]))
+            MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_AUDIO, buffers[i].getBufferData());
+
+        buffers[i] = ManagedBuffer();
+    }
+}
@@ -0,0 +1,164 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioKernels.h"
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#define AUDIO_KERNELS_DSP 1
+#endif
+
+using namespace codal;
+
+static inline int32_t audio_add(int32_t a, int32_t b)
+{
+#ifdef AUDIO_KERNELS_DSP
+    return __qadd(a, b);
+#else
+    return a + b;
+#endif
+}
+
+static inline int32_t audio_clamp(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/**
+ * Accumulates signed 16 bit samples, scaled by a gain, into 32 bit accumulators:
+ * acc[i] += (in[i] * gain) >> 16, saturating where supported.
+ *
+ * @param acc The accumulators to update.
+ * @param in The samples to add.
+ * @param len The number of samples.
+ * @param gain The gain to apply, in Q16 fixed point.
+ */
+void codal::audio_accumulate_s16(int32_t *acc, const int16_t *in, int len, int32_t gain)
+{
+    // Bring the input up to word alignment, so that pairs of samples can be loaded together.
+    if (len > 0 && ((uintptr_t) in & 2))
+    {
+        *acc = audio_add(*acc, (int32_t) (((int64_t) *in++ * gain) >> 16));
+        acc++;
+        len--;
+    }
+
+    const uint32_t *pair = (const uint32_t *) in;
+
+    for (; len > 1; len -= 2)
+    {
+        uint32_t p = *pair++;
+
+#ifdef AUDIO_KERNELS_DSP
+        // SMULWB and SMULWT multiply a word by the bottom and top halfwords respectively, keeping the top 32 bits.
+        acc[0] = audio_add(acc[0], __smulwb(gain, p));
+        acc[1] = audio_add(acc[1], __smulwt(gain, p));
+#else
+        acc[0] += (int32_t) (((int64_t) (int16_t) (p & 0xFFFF) * gain) >> 16);
+        acc[1] += (int32_t) (((int64_t) (int16_t) (p >> 16) * gain) >> 16);
+#endif
+        acc += 2;
+    }
+
+    if (len > 0)
+        *acc = audio_add(*acc, (int32_t) (((int64_t) *(const int16_t *) pair * gain) >> 16));
+}
+
+/**
+ * Scales 32 bit fixed point samples, clamps them to the given range and packs them into unsigned 16 bit samples,
+ * then applies an OR mask: out[i] = clamp(((in[i] * scale) >> shift) + offset, lo, hi) | mask.
+ */
+void codal::audio_pack_u16(uint16_t *out, const int32_t *in, int len, int32_t scale, int shift, int32_t offset, int32_t lo, int32_t hi, uint16_t mask)
+{
+    // Bring the output up to word alignment, so that pairs of samples can be stored together.
+    if (len > 0 && ((uintptr_t) out & 2))
+    {
+        *out++ = (uint16_t) audio_clamp((int32_t) (((int64_t) *in++ * scale) >> shift) + offset, lo, hi) | mask;
+        len--;
+    }
+
+    uint32_t *pair = (uint32_t *) out;
+    uint32_t pairMask = mask | ((uint32_t) mask << 16);
+
+    for (; len > 1; len -= 2)
+    {
+        uint32_t s0 = (uint16_t) audio_clamp((int32_t) (((int64_t) in[0] * scale) >> shift) + offset, lo, hi);
+        uint32_t s1 = (uint16_t) audio_clamp((int32_t) (((int64_t) in[1] * scale) >> shift) + offset, lo, hi);
+
+        *pair++ = (s0 | (s1 << 16)) | pairMask;
+        in += 2;
+    }
+
+    if (len > 0)
+        *(uint16_t *) pair = (uint16_t) audio_clamp((int32_t) (((int64_t) *in * scale) >> shift) + offset, lo, hi) | mask;
+}
+
+/**
+ * Scales floating point samples, clamps them to the given range and packs them into unsigned 16 bit samples,
+ * then applies an OR mask: out[i] = clamp((in[i] * scale) + offset, lo, hi) | mask.
+ */
+void codal::audio_pack_float_u16(uint16_t *out, const float *in, int len, float scale, float offset, int32_t lo, int32_t hi, uint16_t mask)
+{
+    if (len > 0 && ((uintptr_t) out & 2))
+    {
+        *out++ = (uint16_t) audio_clamp((int32_t) (*in++ * scale + offset), lo, hi) | mask;
+        len--;
+    }
+
+    uint32_t *pair = (uint32_t *) out;
+    uint32_t pairMask = mask | ((uint32_t) mask << 16);
+
+    for (; len > 1; len -= 2)
+    {
+        uint32_t s0 = (uint16_t) audio_clamp((int32_t) (in[0] * scale + offset), lo, hi);
+        uint32_t s1 = (uint16_t) audio_clamp((int32_t) (in[1] * scale + offset), lo, hi);
+
+        *pair++ = (s0 | (s1 << 16)) | pairMask;
+        in += 2;
+    }
+
+    if (len > 0)
+        *(uint16_t *) pair = (uint16_t) audio_clamp((int32_t) (*in * scale + offset), lo, hi) | mask;
+}
+
+/**
+ * Fills a buffer with a single 16 bit sample value, e.g. to generate silence.
+ */
+void codal::audio_fill_u16(uint16_t *out, int len, uint16_t value)
+{
+    if (len > 0 && ((uintptr_t) out & 2))
+    {
+        *out++ = value;
+        len--;
+    }
+
+    uint32_t *pair = (uint32_t *) out;
+    uint32_t pairValue = value | ((uint32_t) value << 16);
+
+    for (; len > 1; len -= 2)
+        *pair++ = pairValue;
+
+    if (len > 0)
+        *(uint16_t *) pair = value;
+}
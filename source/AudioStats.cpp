@@ -0,0 +1,205 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioStats.h"
+#include "CodalDmesg.h"
+#include "Timer.h"
+#include "nrf.h"
+#include <math.h>
+
+using namespace codal;
+
+// The production times of buffers awaiting collection, keyed by the address of their data.
+static const uint8_t *latencyBuffers[CONFIG_AUDIO_LATENCY_STAMPS];
+static uint32_t latencyTimes[CONFIG_AUDIO_LATENCY_STAMPS];
+static int latencyNext = 0;
+
+/**
+ * Determines the current processor cycle count, enabling the cycle counter if necessary.
+ *
+ * @return The current value of the cycle counter.
+ */
+uint32_t codal::audio_stats_begin()
+{
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    return DWT->CYCCNT;
+}
+
+/**
+ * Records the cost of producing one buffer.
+ *
+ * @param stats The statistics to update.
+ * @param start The cycle count returned by audio_stats_begin() when processing started.
+ */
+void codal::audio_stats_end(AudioStats &stats, uint32_t start)
+{
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    stats.count++;
+    stats.cycles += cycles;
+
+    if (cycles > stats.worst)
+        stats.worst = cycles;
+}
+
+/**
+ * Resets the given statistics to zero, and restarts the collection period.
+ *
+ * @param stats The statistics to reset.
+ */
+void codal::audio_stats_reset(AudioStats &stats)
+{
+    stats.count = 0;
+    stats.cycles = 0;
+    stats.worst = 0;
+    stats.late = 0;
+    stats.resetTime = (uint32_t) system_timer_current_time();
+}
+
+/**
+ * Outputs the given statistics via DMESG, including the average and worst case cost of each buffer,
+ * and the share of the processor used by the stage since collection started.
+ *
+ * @param name The name of the stage.
+ * @param stats The statistics to output.
+ */
+void codal::audio_stats_print(const char *name, const AudioStats &stats)
+{
+    uint32_t elapsed = (uint32_t) system_timer_current_time() - stats.resetTime;
+    uint32_t average = stats.count ? (uint32_t) (stats.cycles / stats.count) : 0;
+    uint64_t available = (uint64_t) elapsed * (SystemCoreClock / 1000);
+
+    // Processor load in tenths of a percent.
+    uint32_t load = available ? (uint32_t) ((stats.cycles * 1000) / available) : 0;
+
+    DMESG("AUDIO_STATS: %s buffers %d avg %d worst %d late %d load %d.%d%%", name, stats.count, average, stats.worst, stats.late, load / 10, load % 10);
+}
+
+/**
+ * Records the time at which a buffer of samples was produced, so that its latency can be measured once it is played out.
+ * If the buffer was stamped before (e.g. it has been recycled), its previous stamp is replaced.
+ *
+ * @param buffer The buffer that has been produced.
+ */
+void codal::audio_latency_stamp(ManagedBuffer &buffer)
+{
+    const uint8_t *data = buffer.getBytes();
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+
+    if (buffer.length() == 0)
+        return;
+
+    for (int i = 0; i < CONFIG_AUDIO_LATENCY_STAMPS; i++)
+    {
+        if (latencyBuffers[i] == data)
+        {
+            latencyTimes[i] = now;
+            return;
+        }
+    }
+
+    // Otherwise take the oldest slot. Stamps that are never claimed (e.g. the buffer was dropped) are overwritten in turn.
+    latencyBuffers[latencyNext] = data;
+    latencyTimes[latencyNext] = now;
+    latencyNext = (latencyNext + 1) % CONFIG_AUDIO_LATENCY_STAMPS;
+}
+
+/**
+ * Retrieves, and forgets, the time at which a buffer of samples was produced.
+ *
+ * @param buffer The buffer received.
+ * @return The time given by system_timer_current_time_us() when the buffer was stamped, or zero if it was not stamped.
+ */
+uint32_t codal::audio_latency_claim(ManagedBuffer &buffer)
+{
+    const uint8_t *data = buffer.getBytes();
+
+    if (buffer.length() == 0)
+        return 0;
+
+    for (int i = 0; i < CONFIG_AUDIO_LATENCY_STAMPS; i++)
+    {
+        if (latencyBuffers[i] == data)
+        {
+            latencyBuffers[i] = NULL;
+            return latencyTimes[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Records a single latency measurement.
+ *
+ * @param latency The statistics to update.
+ * @param us The latency measured, in microseconds.
+ */
+void codal::audio_latency_record(AudioLatency &latency, uint32_t us)
+{
+    if (latency.count == 0 || us < latency.min)
+        latency.min = us;
+
+    if (us > latency.max)
+        latency.max = us;
+
+    latency.count++;
+    latency.total += us;
+    latency.squares += (uint64_t) us * us;
+}
+
+/**
+ * Resets the given latency statistics to zero.
+ *
+ * @param latency The statistics to reset.
+ */
+void codal::audio_latency_reset(AudioLatency &latency)
+{
+    latency.count = 0;
+    latency.total = 0;
+    latency.squares = 0;
+    latency.min = 0;
+    latency.max = 0;
+}
+
+/**
+ * Outputs the given latency statistics via DMESG: the average, range and jitter (standard deviation) of the latency.
+ *
+ * @param name The name of the stream.
+ * @param latency The statistics to output.
+ */
+void codal::audio_latency_print(const char *name, const AudioLatency &latency)
+{
+    uint32_t average = latency.count ? (uint32_t) (latency.total / latency.count) : 0;
+    float variance = latency.count ? (float) latency.squares / latency.count - (float) average * average : 0.0f;
+    uint32_t jitter = variance > 0.0f ? (uint32_t) sqrtf(variance) : 0;
+
+    DMESG("AUDIO_LATENCY: %s buffers %d avg %d min %d max %d jitter %d (us)", name, latency.count, average, latency.min, latency.max, jitter);
+}
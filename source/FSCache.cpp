@@ -19,6 +19,7 @@ DEALINGS IN THE SOFTWARE.
 */
 #include "FSCache.h"
 #include "CodalDmesg.h"
+#include "MicroBitHeapProfile.h"
 
 using namespace codal;
 
@@ -28,30 +29,103 @@ using namespace codal;
  * @param nvm non-volatile memory controller to use as backing store
  * @param blockSize - the size of a logical block, in bytes (n.b. this may be smaller than the physical page size)
  * @param size the maximum number of pages in the cache
+ * @param arena optional caller provided buffer of FSCACHE_ARENA_SIZE(blockSize, size) bytes, used to hold all page buffers.
+ *        If NULL, page buffers are allocated from the heap as needed, unless reserve() is called.
  */
-FSCache::FSCache(NVMController &nvm, int blockSize, int size) : flash(nvm), blockSize(blockSize), cacheSize(size)
+FSCache::FSCache(NVMController &nvm, int blockSize, int size, uint8_t *arena) : flash(nvm), blockSize(blockSize), cacheSize(size), arena(arena)
 {
 	// Initialise space to hold our cached pages.
 	cache = (CacheEntry *) malloc(sizeof(CacheEntry)*size);
+	MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, cache, sizeof(CacheEntry)*size);
 	memset(cache, 0, sizeof(CacheEntry)*size);
 
+	// Size the index at a power of two, with enough slots to make collisions between cached blocks unlikely.
+	uint32_t indexSize = 8;
+	while (indexSize < (uint32_t) size * 4)
+		indexSize <<= 1;
+
+	// Each slot holds a cache entry number, so is wide enough for caches of more than 255 entries.
+	index = (uint16_t *) malloc(sizeof(uint16_t) * indexSize);
+	MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, index, sizeof(uint16_t) * indexSize);
+	memset(index, 0, sizeof(uint16_t) * indexSize);
+	indexMask = indexSize - 1;
+	lastHit = NULL;
+	writeBack = false;
+	readAheadAddress = 0xFFFFFFFF;
+	readAheadBuffer = arena && CODAL_FS_CACHE_READ_AHEAD ? arena + blockSize * size : NULL;
+	resetStats();
+
 	// Reset operation counter (used for least-recently-used cache replacement policy)
 	operationCount = 0;
 }
 
 /**
-* Clear all cache entries, and free any allocated RAM.
+* Allocate all memory the cache needs as a single contiguous block from the heap, to be used in place of
+* individually allocated page buffers for the lifetime of the cache. Has no effect if an arena is already in use.
+*
+* @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the memory could not be allocated.
 */
-void FSCache::clear()
+int FSCache::reserve()
 {
+	if (arena)
+		return DEVICE_OK;
+
+	uint8_t *a = (uint8_t *) malloc(FSCACHE_ARENA_SIZE(blockSize, cacheSize));
+	MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, a, FSCACHE_ARENA_SIZE(blockSize, cacheSize));
+
+	if (a == NULL)
+		return DEVICE_NO_RESOURCES;
+
+	// Move any pages already held into the arena, so that their contents (and any unwritten changes) are retained.
 	for (int i = 0; i < cacheSize; i++)
 	{
 		if (cache[i].page != NULL)
+		{
+			memcpy(a + i * blockSize, cache[i].page, blockSize);
+			MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_FSCACHE, cache[i].page);
+			free(cache[i].page);
+			cache[i].page = a + i * blockSize;
+		}
+	}
+
+	if (readAheadBuffer != NULL)
+	{
+		MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_FSCACHE, readAheadBuffer);
+		free(readAheadBuffer);
+	}
+
+	arena = a;
+	readAheadBuffer = CODAL_FS_CACHE_READ_AHEAD ? arena + blockSize * cacheSize : NULL;
+
+	return DEVICE_OK;
+}
+
+/**
+* Clear all cache entries, and free any allocated RAM (other than an arena).
+*/
+void FSCache::clear()
+{
+	for (int i = 0; i < cacheSize; i++)
+	{
+		if (cache[i].page != NULL && arena == NULL)
+		{
+			MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_FSCACHE, cache[i].page);
 			free(cache[i].page);
+		}
 	}
 
 	// reset all state.
 	memset(cache, 0, sizeof(CacheEntry)*cacheSize);
+	lastHit = NULL;
+
+	if (readAheadBuffer != NULL && arena == NULL)
+	{
+		MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_FSCACHE, readAheadBuffer);
+		free(readAheadBuffer);
+		readAheadBuffer = NULL;
+	}
+
+	readAheadAddress = 0xFFFFFFFF;
 
 	// Reset operation counter (used for least-recently-used cache replacement policy)
 	operationCount = 0;
@@ -65,11 +139,12 @@ int FSCache::erase(uint32_t address)
 {
 	CacheEntry *c = getCacheEntry(address);
 
-	// Erase the page in our cache (if it is present)
+	// Erase the page in our cache (if it is present). Any unwritten changes are lost along with the page.
 	if (c != NULL)
 	{
 		memset(c->page, 0xFF, blockSize);
 		c->lastUsed = ++operationCount;
+		c->flags &= ~FSCACHE_FLAG_DIRTY;
 	}
 
 	return DEVICE_OK;
@@ -147,7 +222,7 @@ int FSCache::write(uint32_t address, const void *data, int len)
 
 #endif
 
-	// Write operation is valid. Update cache and perform a write-through operation to FLASH.
+	// Write operation is valid. Update cache and perform a write-through operation to FLASH, or record the change for later.
 	bytesCopied = 0;
 	while (bytesCopied < len)
 	{
@@ -165,8 +240,32 @@ int FSCache::write(uint32_t address, const void *data, int len)
 		// update cache.
 		memcpy(c->page + offset, (uint8_t *)data + bytesCopied, l);
 
-		// Write through (maintaining 32-bit aligned operations)
-		flash.write(alignedStart, (uint32_t *)(c->page + (alignedStart % blockSize)), (alignedEnd - alignedStart)/4);
+		if (writeBack)
+		{
+			// Merge this write with any others pending on this page. Any unmodified bytes in between hold the same
+			// value in the cache as in FLASH, so rewriting them is harmless.
+			uint16_t start = alignedStart - block;
+			uint16_t end = alignedEnd - block;
+
+			if (c->flags & FSCACHE_FLAG_DIRTY)
+			{
+				c->dirtyStart = min(c->dirtyStart, start);
+				c->dirtyEnd = max(c->dirtyEnd, end);
+			}
+			else
+			{
+				c->dirtyStart = start;
+				c->dirtyEnd = end;
+				c->flags |= FSCACHE_FLAG_DIRTY;
+			}
+		}
+		else
+		{
+			// Write through (maintaining 32-bit aligned operations)
+			stats.writeThroughs++;
+			stats.bytesWritten += alignedEnd - alignedStart;
+			flash.write(alignedStart, (uint32_t *)(c->page + (alignedStart % blockSize)), (alignedEnd - alignedStart)/4);
+		}
 
 		// Move to next page
 		bytesCopied += l;
@@ -175,6 +274,122 @@ int FSCache::write(uint32_t address, const void *data, int len)
 	return DEVICE_OK;
 }
 
+/**
+* Determines if writes are written through to the NVMController immediately (the default), or held in the cache.
+* In write back mode, each cache entry records the range of bytes modified, and the whole range is written in one
+* operation when the entry is evicted or flush() is called. Disabling write back mode flushes the cache.
+*
+* @param enable true to enable write back mode, false for write through.
+*/
+void FSCache::setWriteBack(bool enable)
+{
+	if (!enable)
+		flush();
+
+	writeBack = enable;
+}
+
+/**
+* Write all modified data held in the cache back to the NVMController, in ascending address order.
+* Modified ranges that run on from one block into the next are written in a single operation, up to the
+* size of the read ahead buffer, without crossing a physical page of the NVMController.
+*
+* @return DEVICE_OK on success, or DEVICE_INVALID_STATE if a write to the NVMController failed.
+*/
+int FSCache::flush()
+{
+	int result = DEVICE_OK;
+	uint32_t pageSize = flash.getPageSize();
+
+	while (true)
+	{
+		CacheEntry *c = NULL;
+
+		for (int i = 0; i < cacheSize; i++)
+		{
+			if ((cache[i].flags & FSCACHE_FLAG_DIRTY) && (c == NULL || cache[i].address < c->address))
+				c = &cache[i];
+		}
+
+		if (c == NULL)
+			return result;
+
+		// Gather the blocks whose modified ranges join on to this one.
+		CacheEntry *run[CODAL_FS_CACHE_READ_AHEAD + 1];
+		int blocks = 1;
+		run[0] = c;
+
+		while (blocks <= CODAL_FS_CACHE_READ_AHEAD && run[blocks - 1]->dirtyEnd == blockSize)
+		{
+			uint32_t a = c->address + blocks * blockSize;
+			CacheEntry *next = getCacheEntry(a);
+
+			if (next == NULL || !(next->flags & FSCACHE_FLAG_DIRTY) || next->dirtyStart != 0 || (pageSize >= (uint32_t) blockSize && a % pageSize == 0))
+				break;
+
+			run[blocks++] = next;
+		}
+
+		if (blocks > 1 && readAheadBuffer == NULL)
+		{
+			readAheadBuffer = (uint8_t *) malloc(blockSize * (CODAL_FS_CACHE_READ_AHEAD + 1));
+			MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, readAheadBuffer, blockSize * (CODAL_FS_CACHE_READ_AHEAD + 1));
+		}
+
+		if (blocks == 1 || readAheadBuffer == NULL)
+		{
+			if (flush(c) != DEVICE_OK)
+				result = DEVICE_INVALID_STATE;
+
+			continue;
+		}
+
+		// Stage the run in the read ahead buffer, which is only used transiently by cachePage(), and write it in one operation.
+		uint32_t start = c->dirtyStart;
+		uint32_t end = (blocks - 1) * blockSize + run[blocks - 1]->dirtyEnd;
+
+		for (int i = 0; i < blocks; i++)
+		{
+			memcpy(readAheadBuffer + i * blockSize, run[i]->page, blockSize);
+			run[i]->flags &= ~FSCACHE_FLAG_DIRTY;
+		}
+
+		stats.writeBacks++;
+		stats.bytesWritten += end - start;
+
+		if (flash.write(c->address + start, (uint32_t *)(readAheadBuffer + start), (end - start)/4) != DEVICE_OK)
+			result = DEVICE_INVALID_STATE;
+	}
+}
+
+/**
+* Write any modified data held by the given cache entry back to the NVMController, as a single operation.
+*/
+int FSCache::flush(CacheEntry *c)
+{
+	if (!(c->flags & FSCACHE_FLAG_DIRTY))
+		return DEVICE_OK;
+
+	c->flags &= ~FSCACHE_FLAG_DIRTY;
+
+	stats.writeBacks++;
+	stats.bytesWritten += c->dirtyEnd - c->dirtyStart;
+
+	return flash.write(c->address + c->dirtyStart, (uint32_t *)(c->page + c->dirtyStart), (c->dirtyEnd - c->dirtyStart)/4);
+}
+
+/**
+* Determines if the cache holds any modified data not yet written back to the NVMController.
+*/
+bool FSCache::isDirty()
+{
+	for (int i = 0; i < cacheSize; i++)
+		if (cache[i].flags & FSCACHE_FLAG_DIRTY)
+			return true;
+
+	return false;
+}
+
 /**
 * Pin the given page into cache space.
 */
@@ -191,6 +406,53 @@ int FSCache::pin(uint32_t address)
 	return DEVICE_NOT_SUPPORTED;
 }
 
+/**
+* Pin all pages holding the given range of memory into cache space, with the given priority class.
+* n.b. The priority of a high priority page is lost if it is eventually replaced.
+*
+* @param address the logical address of the start of the range.
+* @param len the length of the range, in bytes.
+* @param priority FSCACHE_PRIORITY_PINNED to keep the pages resident until unpinned, FSCACHE_PRIORITY_HIGH to keep
+*        them in preference to other pages, or FSCACHE_PRIORITY_NORMAL to return them to normal replacement.
+* @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if pinning the range would leave no page free for other data.
+*/
+int FSCache::pin(uint32_t address, int len, int priority)
+{
+	uint32_t start = (address / blockSize) * blockSize;
+	uint32_t end = address + len;
+
+	if (len <= 0)
+		return DEVICE_INVALID_PARAMETER;
+
+	// Ensure at least one entry is always left for other data.
+	if (priority == FSCACHE_PRIORITY_PINNED)
+	{
+		int pinned = (end - start + blockSize - 1) / blockSize;
+
+		for (int i = 0; i < cacheSize; i++)
+			if (cache[i].page && (cache[i].flags & FSCACHE_FLAG_PINNED) && (cache[i].address < start || cache[i].address >= end))
+				pinned++;
+
+		if (pinned >= cacheSize)
+			return DEVICE_NO_RESOURCES;
+	}
+
+	for (uint32_t a = start; a < end; a += blockSize)
+	{
+		CacheEntry *c = cachePage(a);
+
+		c->flags &= ~(FSCACHE_FLAG_PINNED | FSCACHE_FLAG_PRIORITY);
+
+		if (priority == FSCACHE_PRIORITY_PINNED)
+			c->flags |= FSCACHE_FLAG_PINNED;
+
+		if (priority == FSCACHE_PRIORITY_HIGH)
+			c->flags |= FSCACHE_FLAG_PRIORITY;
+	}
+
+	return DEVICE_OK;
+}
+
 /**
 * Unpin the given page in the cache.
 */
@@ -204,48 +466,202 @@ int FSCache::unpin(uint32_t address)
 	return DEVICE_OK;
 }
 
+/**
+* Return all pages holding the given range of memory to normal replacement.
+*
+* @param address the logical address of the start of the range.
+* @param len the length of the range, in bytes.
+*/
+int FSCache::unpin(uint32_t address, int len)
+{
+	uint32_t start = (address / blockSize) * blockSize;
+
+	for (int i = 0; i < cacheSize; i++)
+		if (cache[i].page && cache[i].address >= start && cache[i].address < address + len)
+			cache[i].flags &= ~(FSCACHE_FLAG_PINNED | FSCACHE_FLAG_PRIORITY);
+
+	return DEVICE_OK;
+}
+
 /**
 * Page a given block into the cache, replacing the LRU block if necessary.
+* If the block immediately follows the last block read from the NVMController, the blocks after it
+* are read in the same operation, to speed up sequential scans.
 * @param address the logical address of the block to cache.
 */
 CacheEntry* FSCache::cachePage(uint32_t address)
 {
-	CacheEntry *lru = NULL;
+	CacheEntry *c = NULL;
+	CacheEntry *result = NULL;
+	int blocks = 1;
+	int loaded = 0;
 
 	// Ensure the page is not already in the cache. If so, then nothing to do...
-	lru = getCacheEntry(address);
-	if (lru)
-		return lru;
+	c = getCacheEntry(address);
+	if (c)
+	{
+		stats.hits++;
+		return c;
+	}
+
+	stats.misses++;
+
+	// If this miss continues a sequential scan, try to read ahead.
+	if (address == readAheadAddress)
+		blocks = getReadAheadLength(address);
+
+	if (blocks > 1 && readAheadBuffer == NULL)
+	{
+		readAheadBuffer = (uint8_t *) malloc(blockSize * (CODAL_FS_CACHE_READ_AHEAD + 1));
+		MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, readAheadBuffer, blockSize * (CODAL_FS_CACHE_READ_AHEAD + 1));
+	}
+
+	if (blocks > 1 && (readAheadBuffer == NULL || flash.read((uint32_t *)readAheadBuffer, address, (blocks * blockSize) / 4) != DEVICE_OK))
+		blocks = 1;
+	else if (blocks > 1)
+		stats.bytesRead += blocks * blockSize;
+
+	for (int i = 0; i < blocks; i++)
+	{
+		uint32_t a = address + i * blockSize;
+
+		// The requested block may displace any unpinned entry. Blocks read ahead only displace entries that can be
+		// dropped without a write (getReadAheadLength() has already ensured enough exist).
+		c = getVictim(address, address + blocks * blockSize, i > 0);
+		if (c == NULL)
+			break;
+
+		// We now have the best block to replace. Write back any changes it holds, then update metadata and load in the block.
+		if (c->page != NULL)
+			stats.evictions++;
+
+		flush(c);
+
+		c->address = a;
+		c->flags = 0;
+		c->lastUsed = ++operationCount;
+		if (c->page == NULL && arena)
+			c->page = arena + (c - cache) * blockSize;
+
+		if (c->page == NULL)
+		{
+			c->page = (uint8_t *) malloc(blockSize);
+			MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_FSCACHE, c->page, blockSize);
+		}
+
+		if (blocks > 1)
+			memcpy(c->page, readAheadBuffer + i * blockSize, blockSize);
+		else
+		{
+			stats.bytesRead += blockSize;
+			flash.read((uint32_t *)c->page, a, blockSize / 4);
+		}
+
+		if (i > 0)
+			stats.readAhead++;
+
+		indexEntry(c);
+
+		if (i == 0)
+			result = c;
+
+		loaded++;
+	}
+
+	readAheadAddress = address + loaded * blockSize;
+
+	// Leave the requested block as the last hit, as it is about to be used.
+	lastHit = result;
+
+	return result;
+}
+
+/**
+* Determine the cache entry to replace with a newly loaded block.
+* Empty entries are preferred, followed by the least recently used unpinned entry of the lowest priority.
+*
+* @param start the address of the first block being loaded. Entries holding blocks in this range are never chosen.
+* @param end the address of the end of the range being loaded.
+* @param clean if true, entries holding modified data or of high priority are never chosen.
+* @return the entry to replace, or NULL if clean is set and no suitable entry exists.
+*/
+CacheEntry *FSCache::getVictim(uint32_t start, uint32_t end, bool clean)
+{
+	CacheEntry *lru = NULL;
 
-	// Determine the LRU block to replace, or prefereably unused block.
-	lru = &cache[0];
 	for (int i = 0; i < cacheSize; i++)
 	{
 		// Simply return the first empty block we find
 		if (cache[i].page == NULL)
+			return &cache[i];
+
+		if ((cache[i].flags & FSCACHE_FLAG_PINNED) || (cache[i].address >= start && cache[i].address < end))
+			continue;
+
+		if (clean && (cache[i].flags & (FSCACHE_FLAG_DIRTY | FSCACHE_FLAG_PRIORITY)))
+			continue;
+
+		// Alternatively, record the least recently used block, preferring normal entries to high priority ones.
+		bool priority = cache[i].flags & FSCACHE_FLAG_PRIORITY;
+
+		if (lru == NULL || (!priority && (lru->flags & FSCACHE_FLAG_PRIORITY)))
 		{
 			lru = &cache[i];
-			break;
+			continue;
 		}
 
-		// Alternatively, record the least recently used block
-		if (!(cache[i].flags & FSCACHE_FLAG_PINNED) && (operationCount - cache[i].lastUsed > operationCount - lru->lastUsed))
+		if (priority == ((lru->flags & FSCACHE_FLAG_PRIORITY) != 0) && (operationCount - cache[i].lastUsed > operationCount - lru->lastUsed))
 			lru = &cache[i];
 	}
 
-	// We now have the best block to replace. Update metadata and load in the block from storage.
-	// We are a write through cache, so all old values are soft state.
-	lru->address = address;
-	lru->flags = 0;
-	lru->lastUsed = ++operationCount;
-	if (lru->page == NULL)
-		lru->page = (uint8_t *) malloc(blockSize);
-
-	flash.read((uint32_t *)lru->page, address, blockSize / 4);
+	if (lru == NULL && !clean)
+		lru = &cache[0];
 
 	return lru;
 }
 
+/**
+* Determine how many blocks can be read in a single operation following a sequential miss on the given block,
+* without crossing a physical page of the NVMController or evicting pinned, high priority or modified entries.
+*
+* @param address the logical address of the block that missed.
+* @return the number of blocks to read, including the block at the given address.
+*/
+int FSCache::getReadAheadLength(uint32_t address)
+{
+	uint32_t pageSize = flash.getPageSize();
+	uint32_t pageEnd = pageSize >= (uint32_t) blockSize ? (address / pageSize + 1) * pageSize : address + blockSize;
+	int spare = -1;
+	int blocks = 1;
+
+	// Count the entries that could hold a block read ahead. One will be used for the requested block.
+	for (int i = 0; i < cacheSize; i++)
+		if (cache[i].page == NULL || !(cache[i].flags & (FSCACHE_FLAG_PINNED | FSCACHE_FLAG_PRIORITY | FSCACHE_FLAG_DIRTY)))
+			spare++;
+
+	while (blocks <= CODAL_FS_CACHE_READ_AHEAD && blocks <= spare)
+	{
+		uint32_t a = address + blocks * blockSize;
+
+		// Stop at the end of the physical page or the device, or at a block we already hold.
+		if (a >= pageEnd || a + blockSize > flash.getFlashEnd() || getCacheEntry(a))
+			break;
+
+		blocks++;
+	}
+
+	return blocks;
+}
+
+/**
+* Record that the given cache entry holds the block at its address, so that future lookups find it directly.
+*/
+void FSCache::indexEntry(CacheEntry *c)
+{
+	index[(c->address / blockSize) & indexMask] = c - cache;
+	lastHit = c;
+}
+
 /**
 * Retrieves a given block from the cache, if it is present.
 * @param address the logical address of the block.
@@ -253,11 +669,32 @@ CacheEntry* FSCache::cachePage(uint32_t address)
 */
 CacheEntry *FSCache::getCacheEntry(uint32_t address)
 {
+	CacheEntry *c = lastHit;
+
+	// Fast path: repeated accesses to the same block.
+	if (c && c->address == address && c->page)
+	{
+		c->lastUsed = ++operationCount;
+		return c;
+	}
+
+	// Next, try the entry the index suggests.
+	c = &cache[index[(address / blockSize) & indexMask]];
+	if (c->address == address && c->page)
+	{
+		c->lastUsed = ++operationCount;
+		lastHit = c;
+		return c;
+	}
+
+	// The index entry may have been overwritten by a colliding block, so confirm with a full search.
+	// n.b. This only happens on a collision or a miss, and a miss is followed by a much slower read from the NVMController.
 	for (int i = 0; i < cacheSize; i++)
 	{
 		if (cache[i].address == address && cache[i].page)
 		{
 			cache[i].lastUsed = ++operationCount;
+			indexEntry(&cache[i]);
 			return &cache[i];
 		}
 	}
@@ -265,8 +702,29 @@ CacheEntry *FSCache::getCacheEntry(uint32_t address)
 	return NULL;
 }
 
+/**
+* Retrieve counters describing the effectiveness of the cache since it was created, or since resetStats() was called.
+*
+* @return a copy of the current counters.
+*/
+FSCacheStats FSCache::getStats()
+{
+	return stats;
+}
+
+/**
+* Reset all counters returned by getStats() to zero.
+*/
+void FSCache::resetStats()
+{
+	memset(&stats, 0, sizeof(FSCacheStats));
+}
+
 void FSCache::debug(bool verbose)
 {
+	DMESG("FSCache: [hits: %d] [misses: %d] [readAhead: %d] [evictions: %d] [writeThroughs: %d] [writeBacks: %d] [bytesRead: %d] [bytesWritten: %d]\n",
+		stats.hits, stats.misses, stats.readAhead, stats.evictions, stats.writeThroughs, stats.writeBacks, stats.bytesRead, stats.bytesWritten);
+
 	for (int i = 0; i < cacheSize; i++)
 		debug(&cache[i], verbose);
 }
@@ -32,12 +32,28 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitError.h"
 #include "LSM303Accelerometer.h"
 #include "LSM303Magnetometer.h"
+#include "MicroBitBootProfile.h"
 
 
 using namespace codal;
 
 Accelerometer* MicroBitAccelerometer::driver = NULL;
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_SENSOR_CACHE)
+// The result of a successful probe, retained across soft resets so the full probe (and its power up delay) can be skipped.
+#define MICROBIT_SENSOR_CACHE_MAGIC         0x534E5352
+#define MICROBIT_SENSOR_TYPE_LSM303         1
+
+struct MicroBitSensorCache
+{
+    volatile uint32_t  magic;
+    volatile uint16_t  type;
+    volatile uint16_t  address;
+};
+
+static MicroBitSensorCache __attribute__ ((section (".noinit"))) microbit_sensor_cache;
+#endif
+
 
 MicroBitAccelerometer::MicroBitAccelerometer(MicroBitI2C &i2c, CoordinateSpace &coordinateSpace, uint16_t id) : Accelerometer(coordinateSpace, id)
 {
@@ -56,19 +72,51 @@ Accelerometer& MicroBitAccelerometer::autoDetect(MicroBitI2C &i2c)
 
     if (!autoDetectCompleted)
     {
-        /*
-        * In essence, the LSM needs at least 6.4ms from power-up before we can use it.
-        * https://github.com/microbit-foundation/codal-microbit/issues/33
-        */
-        target_wait(7);
+        MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_ACCELEROMETER);
+
+        bool cached = false;
+        bool detected = false;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_SENSOR_CACHE)
+        // The sensor stays powered through a soft reset, so a previous probe is still likely to be valid.
+        // Only a positive result is remembered, so a sensor that was slow to respond is always probed again.
+        if (NRF_POWER->RESETREAS == 0)
+            microbit_sensor_cache.magic = 0;
+
+        cached = (microbit_sensor_cache.magic == MICROBIT_SENSOR_CACHE_MAGIC && microbit_sensor_cache.type == MICROBIT_SENSOR_TYPE_LSM303);
+#endif
+
+        if (!cached)
+        {
+            /*
+            * In essence, the LSM needs at least 6.4ms from power-up before we can use it.
+            * https://github.com/microbit-foundation/codal-microbit/issues/33
+            */
+            target_wait(7);
+        }
 
         // Add pullup resistor to IRQ line (it's floating ACTIVE LO)
         irq1.getDigitalValue();
         irq1.setPull(PullMode::Up);
         irq1.setActiveLo();
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_SENSOR_CACHE)
+        // Validate a cached result with a single WHO_AM_I read.
+        if (cached)
+            detected = LSM303Accelerometer::isDetected(i2c, microbit_sensor_cache.address);
+#endif
+
         // Now, probe for the LSM303, and if it doesn't reply, panic
-        if ( LSM303Accelerometer::isDetected(i2c, LSM303_A_DEFAULT_ADDR) )
+        if (!detected)
+            detected = LSM303Accelerometer::isDetected(i2c, LSM303_A_DEFAULT_ADDR);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_SENSOR_CACHE)
+        microbit_sensor_cache.type = MICROBIT_SENSOR_TYPE_LSM303;
+        microbit_sensor_cache.address = LSM303_A_DEFAULT_ADDR;
+        microbit_sensor_cache.magic = detected ? MICROBIT_SENSOR_CACHE_MAGIC : 0;
+#endif
+
+        if ( detected )
         {
             MicroBitAccelerometer::driver = new LSM303Accelerometer( i2c, irq1, coordinateSpace, LSM303_A_DEFAULT_ADDR );
             MicroBitCompass::driver = new LSM303Magnetometer( i2c, irq1, coordinateSpace, LSM303_M_DEFAULT_ADDR );
@@ -81,6 +129,8 @@ Accelerometer& MicroBitAccelerometer::autoDetect(MicroBitI2C &i2c)
         MicroBitCompass::driver->setAccelerometer( *MicroBitAccelerometer::driver );
 
         autoDetectCompleted = true;
+
+        MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_ACCELEROMETER);
     }
 
     return *driver;
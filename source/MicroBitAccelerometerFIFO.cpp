@@ -0,0 +1,254 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitAccelerometerFIFO.h"
+#include "ErrorNo.h"
+#include "EventModel.h"
+#include "Timer.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param i2c The I2C bus the sensor is on.
+ * @param accelerometer The accelerometer driver in use, e.g. MicroBit::accelerometer.
+ * @param address The I2C address of the sensor. Defaults to LSM303_A_DEFAULT_ADDR.
+ */
+MicroBitAccelerometerFIFO::MicroBitAccelerometerFIFO(MicroBitI2C &i2c, Accelerometer &accelerometer, uint16_t address) :
+    i2c(i2c),
+    accelerometer(accelerometer),
+    coordinateSpace(SIMPLE_CARTESIAN, true, COORDINATE_SPACE_ROTATED_0),  // As used by MicroBitAccelerometer::autoDetect().
+    address(address)
+{
+    watermark = MICROBIT_ACCELEROMETER_FIFO_WATERMARK;
+    ctrlReg3 = 0;
+    enabled = false;
+    head = 0;
+    count = 0;
+    overruns = 0;
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(MICROBIT_ID_ACCELEROMETER_FIFO, MICROBIT_ACCELEROMETER_FIFO_EVT_POLL, this, &MicroBitAccelerometerFIFO::onPoll);
+}
+
+/**
+ * Destructor. Disables the hardware FIFO, if enabled.
+ */
+MicroBitAccelerometerFIFO::~MicroBitAccelerometerFIFO()
+{
+    disable();
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->ignore(MICROBIT_ID_ACCELEROMETER_FIFO, MICROBIT_ACCELEROMETER_FIFO_EVT_POLL, this, &MicroBitAccelerometerFIFO::onPoll);
+}
+
+/**
+ * Enables the hardware FIFO.
+ *
+ * @param watermark The number of samples to collect between each burst read, between 1 and 31.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the watermark is out of range,
+ * DEVICE_NOT_SUPPORTED if no LSM303 was detected, or DEVICE_I2C_ERROR if the sensor could not be configured.
+ */
+int MicroBitAccelerometerFIFO::enable(int watermark)
+{
+    if (watermark < 1 || watermark >= MICROBIT_LSM303_FIFO_DEPTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (enabled)
+        disable();
+
+    if (!LSM303Accelerometer::isDetected(i2c, address))
+        return DEVICE_NOT_SUPPORTED;
+
+    uint8_t ctrlReg5;
+
+    if (i2c.readRegister(address, MICROBIT_LSM303_CTRL_REG3_A, &ctrlReg3, 1) != DEVICE_OK ||
+        i2c.readRegister(address, MICROBIT_LSM303_CTRL_REG5_A, &ctrlReg5, 1) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    // The interrupt line is shared with the driver, which reads a sample whenever it is active. Silence it while we
+    // own the FIFO, so the driver can't take samples from under us, and poll the FIFO at the watermark period instead.
+    // That costs one I2C transaction per batch, rather than one per sample.
+    if (i2c.writeRegister(address, MICROBIT_LSM303_CTRL_REG3_A, 0) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_FIFO_CTRL_REG_A, 0) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_CTRL_REG5_A, ctrlReg5 | MICROBIT_LSM303_FIFO_EN) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_FIFO_CTRL_REG_A, MICROBIT_LSM303_FIFO_MODE_STREAM | watermark) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    this->watermark = watermark;
+    enabled = true;
+    overruns = 0;
+
+    int period = accelerometer.getPeriod() * watermark;
+    system_timer_event_every(period > 0 ? period : 1, MICROBIT_ID_ACCELEROMETER_FIFO, MICROBIT_ACCELEROMETER_FIFO_EVT_POLL);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Disables the hardware FIFO, returning the accelerometer to its normal mode.
+ * Samples already collected may still be read.
+ *
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the sensor could not be configured.
+ */
+int MicroBitAccelerometerFIFO::disable()
+{
+    if (!enabled)
+        return DEVICE_OK;
+
+    system_timer_cancel_event(MICROBIT_ID_ACCELEROMETER_FIFO, MICROBIT_ACCELEROMETER_FIFO_EVT_POLL);
+    enabled = false;
+
+    uint8_t ctrlReg5;
+
+    if (i2c.readRegister(address, MICROBIT_LSM303_CTRL_REG5_A, &ctrlReg5, 1) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_FIFO_CTRL_REG_A, 0) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_CTRL_REG5_A, ctrlReg5 & ~MICROBIT_LSM303_FIFO_EN) != DEVICE_OK ||
+        i2c.writeRegister(address, MICROBIT_LSM303_CTRL_REG3_A, ctrlReg3) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if the hardware FIFO is enabled.
+ *
+ * @return true if enabled, false otherwise.
+ */
+bool MicroBitAccelerometerFIFO::isEnabled()
+{
+    return enabled;
+}
+
+/**
+ * Determines the number of samples waiting to be read.
+ *
+ * @return The number of samples held.
+ */
+int MicroBitAccelerometerFIFO::available()
+{
+    return count;
+}
+
+/**
+ * Reads, and removes, the oldest samples held, in milli-g and in the same coordinate space as the accelerometer.
+ *
+ * @param samples The array to fill.
+ * @param len The maximum number of samples to read.
+ * @return The number of samples read.
+ */
+int MicroBitAccelerometerFIFO::read(Sample3D *samples, int len)
+{
+    int n = 0;
+
+    while (n < len && count > 0)
+    {
+        samples[n++] = buffer[head];
+        head = (head + 1) % MICROBIT_ACCELEROMETER_FIFO_BUFFER;
+        count--;
+    }
+
+    return n;
+}
+
+/**
+ * Determines the number of samples lost since the FIFO was enabled, because either buffer was full.
+ *
+ * @return The number of samples lost.
+ */
+uint32_t MicroBitAccelerometerFIFO::getOverruns()
+{
+    return overruns;
+}
+
+/**
+ * Adds a sample to the ring buffer, overwriting the oldest if it is full.
+ */
+void MicroBitAccelerometerFIFO::store(Sample3D sample)
+{
+    if (count == MICROBIT_ACCELEROMETER_FIFO_BUFFER)
+    {
+        head = (head + 1) % MICROBIT_ACCELEROMETER_FIFO_BUFFER;
+        count--;
+        overruns++;
+    }
+
+    buffer[(head + count) % MICROBIT_ACCELEROMETER_FIFO_BUFFER] = sample;
+    count++;
+}
+
+/**
+ * Drains the hardware FIFO into the ring buffer.
+ */
+void MicroBitAccelerometerFIFO::onPoll(Event)
+{
+    if (!enabled)
+        return;
+
+    uint8_t src;
+
+    i2c.acquire(MICROBIT_I2C_PRIORITY_SENSOR);
+
+    if (i2c.readRegister(address, MICROBIT_LSM303_FIFO_SRC_REG_A, &src, 1) != DEVICE_OK)
+    {
+        i2c.release();
+        return;
+    }
+
+    int n = src & MICROBIT_LSM303_FIFO_SRC_FSS;
+
+    // In stream mode, an overrun means the FIFO is full and its oldest sample has been replaced.
+    if (src & MICROBIT_LSM303_FIFO_SRC_OVRN)
+    {
+        n = MICROBIT_LSM303_FIFO_DEPTH;
+        overruns++;
+    }
+
+    // With the FIFO enabled, an auto incrementing read of the output registers wraps back to OUT_X_L_A after
+    // each sample, so the whole batch is collected in a single transaction.
+    int16_t data[MICROBIT_LSM303_FIFO_DEPTH * 3];
+    int result = n > 0 ? i2c.readRegister(address, MICROBIT_LSM303_OUT_X_L_A | MICROBIT_LSM303_AUTO_INCREMENT, (uint8_t *)data, n * 6) : DEVICE_OK;
+
+    i2c.release();
+
+    if (n == 0 || result != DEVICE_OK)
+        return;
+
+    int range = accelerometer.getRange();
+
+    // Scale into milli-g, as the driver does, and align to the accelerometer's coordinate space.
+    for (int i = 0; i < n; i++)
+    {
+        Sample3D s;
+
+        s.x = (data[i * 3] / 32) * range;
+        s.y = (data[i * 3 + 1] / 32) * range;
+        s.z = (data[i * 3 + 2] / 32) * range;
+
+        store(coordinateSpace.transform(s));
+    }
+
+    Event(MICROBIT_ID_ACCELEROMETER_FIFO, MICROBIT_ACCELEROMETER_FIFO_EVT_DATA);
+}
@@ -30,12 +30,15 @@ DEALINGS IN THE SOFTWARE.
 #include "SoundExpressions.h"
 #include "SoundEmojiSynthesizer.h"
 #include "StreamSplitter.h"
+#include <math.h>
 
 using namespace codal;
 
 MicroBitAudio* MicroBitAudio::instance = NULL;
 
 MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC &adc, NRF52Pin &microphone, NRF52Pin &runmic):
+    micStream(NULL),
+    micDecimator(NULL),
     micEnabled(false),
     micSleepState(false),
     speakerEnabled(true),
@@ -48,6 +51,9 @@ MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC &adc, NR
     adc(adc),
     microphone(microphone),
     runmic(runmic),
+    bypassPeriodUs(0),
+    bypassValue(0),
+    bypassSequence(0),
     soundExpressions(synth),
     virtualOutputPin(mixer)
 {
@@ -108,6 +114,7 @@ void MicroBitAudio::activateMic(){
     runmic.setHighDrive(true);
     adc.activateChannel(mic);
     this->micEnabled = true;
+    microbit_energy_report(MICROBIT_ENERGY_MICROPHONE, true);
 }
 
 void MicroBitAudio::deactivateMic(){
@@ -115,6 +122,40 @@ void MicroBitAudio::deactivateMic(){
     //mic->disable();
     runmic.setDigitalValue(0);
     runmic.setHighDrive(false);
+    microbit_energy_report(MICROBIT_ENERGY_MICROPHONE, false);
+}
+
+/**
+ * Provides direct access to the raw microphone stream: each buffer produced by the ADC, shared rather than copied,
+ * together with its RMS and peak level. The stream is created on first use, and enables the microphone when started.
+ *
+ * @return The microphone stream.
+ */
+MicroBitMicrophoneStream *MicroBitAudio::getMicrophoneStream()
+{
+    // The stream only connects to its splitter channel when started, so creating it doesn't activate the mic.
+    if (micStream == NULL)
+        micStream = new MicroBitMicrophoneStream(*rawSplitter->createChannel());
+
+    return micStream;
+}
+
+/**
+ * Provides the microphone stream decimated to a lower sample rate (e.g. 8 or 16kHz), filtered as each buffer
+ * arrives from the ADC. The stream is created on first use, and enables the microphone when connected to.
+ *
+ * @param sampleRate The output sample rate to aim for.
+ * @return The decimated microphone stream.
+ */
+MicroBitMicrophoneDecimator *MicroBitAudio::getDecimatedMicrophone(float sampleRate)
+{
+    // As with the raw stream, the decimator only connects to its splitter channel once it has a consumer of its own.
+    if (micDecimator == NULL)
+        micDecimator = new MicroBitMicrophoneDecimator(*rawSplitter->createChannel(), sampleRate);
+    else
+        micDecimator->setSampleRate(sampleRate);
+
+    return micDecimator;
 }
 
 void MicroBitAudio::setMicrophoneGain(int gain){
@@ -135,7 +176,11 @@ int MicroBitAudio::enable()
         setPinEnabled( pinEnabled );
 
         if ( soundExpressionChannel == NULL )
+        {
+            // Let the synthesizer fall silent between effects, so its mixer channel can be suspended.
+            synth.allowEmptyBuffers(true);
             soundExpressionChannel = mixer.addChannel(synth);
+        }
     }
     return DEVICE_OK;
 }
@@ -153,7 +198,11 @@ int MicroBitAudio::disable()
 void MicroBitAudio::requestActivation()
 {
     if (MicroBitAudio::instance)
+    {
+        // Another source needs the mixer, so return the PWM to it.
+        MicroBitAudio::instance->endToneBypass();
         MicroBitAudio::instance->enable();
+    }
 }
 
 int MicroBitAudio::setVolume(int volume)
@@ -163,6 +212,9 @@ int MicroBitAudio::setVolume(int volume)
 
     mixer.setVolume(volume*4);
 
+    if (status & MICROBIT_AUDIO_STATUS_PWM_BYPASS)
+        updateToneBypass();
+
     return DEVICE_OK;
 }
 
@@ -172,6 +224,9 @@ int MicroBitAudio::getVolume() {
 
 void MicroBitAudio::setSpeakerEnabled(bool on) {
     speakerEnabled = on;
+
+    if (status & MICROBIT_AUDIO_STATUS_PWM_BYPASS)
+        updateToneBypass();
     
     if (pwm)
     {
@@ -203,6 +258,9 @@ void MicroBitAudio::setPinEnabled(bool on)
 {
     pinEnabled = on;
 
+    if (status & MICROBIT_AUDIO_STATUS_PWM_BYPASS)
+        updateToneBypass();
+
     if (pwm)
     {
         if (on)
@@ -230,6 +288,9 @@ int MicroBitAudio::setSleep(bool doSleep)
 {
     if (doSleep)
     {
+      // Return the PWM to the mixer, so that it is released and restored as normal below.
+      endToneBypass();
+
       if (pwm)
       {
           status |= MICROBIT_AUDIO_STATUS_DEEPSLEEP;
@@ -259,9 +320,149 @@ int MicroBitAudio::setSleep(bool doSleep)
 
 bool MicroBitAudio::isPlaying()
 {
+    if (status & MICROBIT_AUDIO_STATUS_PWM_BYPASS)
+        return bypassPeriodUs > 0 && bypassValue > 0;
+
     uint32_t t = system_timer_current_time_us();
     uint32_t start = mixer.getSilenceStartTime();
     uint32_t end = mixer.getSilenceEndTime();
+    uint32_t latency = mixer.getOutputLatency();
+
+    return !((start && t >= (start + latency)) && (end == 0 || t < (end + latency - 100)));
+}
+
+/**
+ * Outputs the CPU load statistics of each stage of the audio pipeline via DMESG: the mixer and each of
+ * its channels, the sound expression synthesizer and the virtual output pin.
+ * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+ */
+/**
+ * Attempts to play a constant square wave tone by programming the PWM peripheral directly, bypassing the mixer.
+ * This is only possible whilst every mixer channel, other than that of the caller, is suspended. Once in place,
+ * the bypass remains until another source requests activation of the audio pipeline, or endToneBypass() is called.
+ *
+ * @param channel The mixer channel of the caller, which is disregarded when deciding if a bypass is possible.
+ * @param periodUs The period of the tone, in microseconds. Zero for silence.
+ * @param value The amplitude of the tone, in the range 0..128.
+ * @return true if the tone is now being generated directly by the PWM, false if it must be mixed as normal.
+ */
+bool MicroBitAudio::setToneBypass(MixerChannel *channel, uint32_t periodUs, int value)
+{
+    if (!(status & MICROBIT_AUDIO_STATUS_PWM_BYPASS))
+    {
+        if (pwm == NULL || !mixer.isSuspended(channel))
+            return false;
+
+        // Release the PWM driver (and with it the mixer), as we do when entering deep sleep.
+        NVIC_DisableIRQ(PWM1_IRQn);
+        pwm->disable();
+        pwm->disconnectPin(speaker);
+        pwm->disconnectPin(*pin);
+        delete pwm;
+        pwm = NULL;
+
+        status |= MICROBIT_AUDIO_STATUS_PWM_BYPASS;
+    }
+
+    bypassPeriodUs = periodUs;
+    bypassValue = value;
+    updateToneBypass();
+
+    return true;
+}
+
+/**
+ * Programs the PWM peripheral to generate the tone defined by setToneBypass(), on the pins currently enabled.
+ */
+void MicroBitAudio::updateToneBypass()
+{
+    // Select the finest prescaler that can represent the period in the 15 bit PWM counter.
+    uint32_t ticks = bypassPeriodUs * 16;
+    uint32_t prescaler = 0;
+
+    while (ticks > 0x7FFF && prescaler < PWM_PRESCALER_PRESCALER_DIV_128)
+    {
+        ticks >>= 1;
+        prescaler++;
+    }
+
+    if (ticks < 3)
+        ticks = 3;
+
+    if (ticks > 0x7FFF)
+        ticks = 0x7FFF;
+
+    // The mixed output is a square wave whose peak to peak amplitude is the fraction p of full scale. At full scale,
+    // a pulse of duty cycle d has a fundamental of the same strength when sin(pi * d) = p, so use that duty cycle.
+    float p = (bypassValue / 128.0f) * (mixer.getVolume() / 1023.0f);
+    float duty = (bypassPeriodUs && p > 0.0f) ? asinf(p < 1.0f ? p : 1.0f) / (float) M_PI : 0.0f;
+
+    bypassSequence = (uint16_t) (duty * ticks) | 0x8000;
+
+    NRF_PWM1->PSEL.OUT[0] = pinEnabled ? pin->name : 0xFFFFFFFF;
+    NRF_PWM1->PSEL.OUT[1] = speakerEnabled ? speaker.name : 0xFFFFFFFF;
+    NRF_PWM1->ENABLE = 1;
+    NRF_PWM1->MODE = PWM_MODE_UPDOWN_Up;
+    NRF_PWM1->PRESCALER = prescaler;
+    NRF_PWM1->COUNTERTOP = ticks;
+    NRF_PWM1->DECODER = (PWM_DECODER_LOAD_Common << PWM_DECODER_LOAD_Pos) | (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+    NRF_PWM1->LOOP = 0;
+
+    // A single sample sequence. The PWM holds the last value of a sequence once it ends, so no further DMA takes place.
+    NRF_PWM1->SEQ[0].PTR = (uint32_t) &bypassSequence;
+    NRF_PWM1->SEQ[0].CNT = 1;
+    NRF_PWM1->SEQ[0].REFRESH = 0;
+    NRF_PWM1->SEQ[0].ENDDELAY = 0;
+    NRF_PWM1->TASKS_SEQSTART[0] = 1;
+}
+
+/**
+ * Stops any tone being generated by setToneBypass(), and returns the PWM peripheral to the mixer.
+ */
+void MicroBitAudio::endToneBypass()
+{
+    if (!(status & MICROBIT_AUDIO_STATUS_PWM_BYPASS))
+        return;
 
-    return !((start && t >= (start + CONFIG_AUDIO_MIXER_OUTPUT_LATENCY_US)) && (end == 0 || t < (end + CONFIG_AUDIO_MIXER_OUTPUT_LATENCY_US - 100)));
+    NRF_PWM1->TASKS_STOP = 1;
+    NRF_PWM1->ENABLE = 0;
+    NRF_PWM1->PSEL.OUT[0] = 0xFFFFFFFF;
+    NRF_PWM1->PSEL.OUT[1] = 0xFFFFFFFF;
+    NRF_PWM1->EVENTS_STOPPED = 0;
+    NRF_PWM1->EVENTS_SEQEND[0] = 0;
+    NRF_PWM1->EVENTS_SEQSTARTED[0] = 0;
+
+    status &= ~MICROBIT_AUDIO_STATUS_PWM_BYPASS;
+
+    // Recreate the PWM driver, which reconfigures the peripheral from scratch.
+    enable();
+}
+
+/**
+ * Determines if a tone is currently being generated directly by the PWM peripheral.
+ * @return true if setToneBypass() is in effect.
+ */
+bool MicroBitAudio::isToneBypassed()
+{
+    return (status & MICROBIT_AUDIO_STATUS_PWM_BYPASS) != 0;
+}
+
+void MicroBitAudio::printStats()
+{
+    mixer.printStats();
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_print("synth", *synth.getStats());
+    audio_stats_print("pin", *virtualOutputPin.getStats());
+#endif
+}
+
+/**
+ * Resets the CPU load statistics of each stage of the audio pipeline.
+ */
+void MicroBitAudio::resetStats()
+{
+    mixer.resetStats();
+    synth.resetStats();
+    virtualOutputPin.resetStats();
 }
\ No newline at end of file
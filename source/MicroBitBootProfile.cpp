@@ -0,0 +1,131 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitBootProfile.h"
+#include "nrf.h"
+
+using namespace codal;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+static MicroBitBootPhase bootPhases[MICROBIT_BOOT_PHASES];
+
+// Much of start up runs before the system timer is running, so the processor cycle counter is used as the time base.
+static uint32_t boot_profile_time()
+{
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    // Add one, so that a phase starting as the clock starts is distinguishable from one that has not run.
+    return DWT->CYCCNT / (SystemCoreClock / 1000000) + 1;
+}
+#endif
+
+/**
+ * Records the start of a phase of start up.
+ * The first call starts the clock that all phases are measured against.
+ *
+ * @param phase the phase (one of MICROBIT_BOOT_PHASE_*).
+ */
+void codal::microbit_boot_profile_begin(int phase)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+    if (phase < 0 || phase >= MICROBIT_BOOT_PHASES)
+        return;
+
+    bootPhases[phase].start = boot_profile_time();
+    bootPhases[phase].time = 0;
+#endif
+}
+
+/**
+ * Records the end of a phase of start up.
+ *
+ * @param phase the phase (one of MICROBIT_BOOT_PHASE_*).
+ */
+void codal::microbit_boot_profile_end(int phase)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+    if (phase < 0 || phase >= MICROBIT_BOOT_PHASES || bootPhases[phase].start == 0)
+        return;
+
+    bootPhases[phase].time = boot_profile_time() - bootPhases[phase].start;
+#endif
+}
+
+/**
+ * Retrieves the boot timeline.
+ *
+ * @return an array of MICROBIT_BOOT_PHASES entries, indexed by phase, or NULL if profiling is disabled.
+ */
+const MicroBitBootPhase *codal::microbit_boot_profile_get()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+    return bootPhases;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Print the boot timeline to the given serial port, in the order the phases began.
+ *
+ * @param serial the serial port to print to.
+ */
+void codal::microbit_boot_profile_print(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BOOT_PROFILE)
+    static const char *phaseNames[MICROBIT_BOOT_PHASES] = { "power manager", "usb flash manager", "accelerometer", "compass", "init", "erase user storage", "components", "pairing mode", "ble" };
+    int last = -1;
+
+    // A simple selection by start time (then by phase), as there are only a handful of phases.
+    while (true)
+    {
+        int next = -1;
+
+        for (int i = 0; i < MICROBIT_BOOT_PHASES; i++)
+        {
+            if (bootPhases[i].start == 0)
+                continue;
+
+            if (last >= 0 && (bootPhases[i].start < bootPhases[last].start || (bootPhases[i].start == bootPhases[last].start && i <= last)))
+                continue;
+
+            if (next < 0 || bootPhases[i].start < bootPhases[next].start)
+                next = i;
+        }
+
+        if (next < 0)
+            break;
+
+        last = next;
+        serial.printf("BOOT %s: start %d time %d\r\n", phaseNames[next], bootPhases[next].start - 1, bootPhases[next].time);
+    }
+#else
+    serial.printf("BOOT: profiling disabled\r\n");
+#endif
+}
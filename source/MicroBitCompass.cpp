@@ -30,6 +30,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitDevice.h"
 #include "MicroBitError.h"
 #include "LSM303Magnetometer.h"
+#include "MicroBitBootProfile.h"
 
 using namespace codal;
 
@@ -46,9 +47,13 @@ MicroBitCompass::MicroBitCompass(CoordinateSpace &coordinateSpace, uint16_t id)
 
 Compass& MicroBitCompass::autoDetect(MicroBitI2C &i2c)
 {
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_COMPASS);
+
     // We only have combined sensors, so rely on the accelerometer detection code to also detect the magnetometer.
     MicroBitAccelerometer::autoDetect(i2c);
 
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_COMPASS);
+
     return *MicroBitCompass::driver;
 }
 
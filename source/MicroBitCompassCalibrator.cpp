@@ -31,6 +31,119 @@ using namespace codal;
 
 #define CALIBRATION_INCREMENT     200
 
+// Samples are fitted in units of this many raw units, to keep the sums of their fourth powers well within float range.
+#define FIT_NORMALISE      1000.0f
+
+/**
+ * Solves a small linear system in place, by Gaussian elimination with partial pivoting.
+ *
+ * @param a The augmented matrix of the system, with n rows and the right hand side in column n.
+ * @param n The number of unknowns, no more than 6.
+ * @param p The array to store the n unknowns in.
+ *
+ * @return true on success, or false if the system is singular.
+ */
+static bool solveLinear(float a[6][7], int n, float *p)
+{
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+
+        for (int row = col + 1; row < n; row++)
+            if (fabsf(a[row][col]) > fabsf(a[pivot][col]))
+                pivot = row;
+
+        if (fabsf(a[pivot][col]) < 1e-9f)
+            return false;
+
+        if (pivot != col)
+        {
+            for (int k = col; k <= n; k++)
+            {
+                float tmp = a[col][k];
+                a[col][k] = a[pivot][k];
+                a[pivot][k] = tmp;
+            }
+        }
+
+        for (int row = col + 1; row < n; row++)
+        {
+            float f = a[row][col] / a[col][col];
+
+            for (int k = col; k <= n; k++)
+                a[row][k] -= f * a[col][k];
+        }
+    }
+
+    for (int row = n - 1; row >= 0; row--)
+    {
+        float sum = a[row][n];
+
+        for (int k = row + 1; k < n; k++)
+            sum -= a[row][k] * p[k];
+
+        p[row] = sum / a[row][row];
+    }
+
+    return true;
+}
+
+/**
+ * Solves the least squares fit of an axis aligned ellipsoid, A.x^2 + B.y^2 + C.x + D.y + E.z + F = -z^2, from the
+ * sums of its normal equations, and converts it into a calibration in the form produced by spherify: each axis is
+ * scaled up to the largest, so that corrected samples lie on a sphere of that radius.
+ *
+ * @param m The sums of the outer product of each sample's terms with itself. Only the upper triangle is used.
+ * @param v The sums of each sample's terms.
+ * @param offset The point the samples were taken relative to, in raw units, before being normalised.
+ * @param cal The calibration to fill in.
+ *
+ * @return true on success, or false if the samples do not describe an ellipsoid.
+ */
+static bool ellipsoidCalibration(float m[6][6], float v[6], Sample3D offset, CompassCalibration &cal)
+{
+    float a[6][7];
+    float p[6];
+
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < 6; j++)
+            a[i][j] = i <= j ? m[i][j] : m[j][i];
+
+        a[i][6] = v[i];
+    }
+
+    if (!solveLinear(a, 6, p))
+        return false;
+
+    // Fixing the z^2 coefficient at one, rather than the constant term, keeps the fit sound wherever the origin lies.
+    if (p[0] <= 0 || p[1] <= 0)
+        return false;
+
+    float cx = -p[2] / (2 * p[0]);
+    float cy = -p[3] / (2 * p[1]);
+    float cz = -p[4] / 2;
+    float g = p[0] * cx * cx + p[1] * cy * cy + cz * cz - p[5];
+
+    if (g <= 0)
+        return false;
+
+    float rx = sqrtf(g / p[0]) * FIT_NORMALISE;
+    float ry = sqrtf(g / p[1]) * FIT_NORMALISE;
+    float rz = sqrtf(g) * FIT_NORMALISE;
+    float radius = max(rx, max(ry, rz));
+
+    cal.centre.x = offset.x + (int) (cx * FIT_NORMALISE);
+    cal.centre.y = offset.y + (int) (cy * FIT_NORMALISE);
+    cal.centre.z = offset.z + (int) (cz * FIT_NORMALISE);
+    cal.scale.x = (int) (1024 * radius / rx);
+    cal.scale.y = (int) (1024 * radius / ry);
+    cal.scale.z = (int) (1024 * radius / rz);
+    cal.radius = (int) radius;
+
+    return true;
+}
+
 /**
   * Constructor.
   *
@@ -51,6 +164,7 @@ using namespace codal;
 MicroBitCompassCalibrator::MicroBitCompassCalibrator(Compass& _compass, Accelerometer& _accelerometer, MicroBitDisplay& _display) : compass(_compass), accelerometer(_accelerometer), display(_display)
 {
     this->storage = NULL;
+    this->fit = NULL;
 
     if (EventModel::defaultEventBus)
         EventModel::defaultEventBus->listen(MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_CALIBRATE, this, &MicroBitCompassCalibrator::calibrateUX, MESSAGE_BUS_LISTENER_IMMEDIATE);
@@ -75,6 +189,7 @@ MicroBitCompassCalibrator::MicroBitCompassCalibrator(Compass& _compass, Accelero
 MicroBitCompassCalibrator::MicroBitCompassCalibrator(Compass& _compass, Accelerometer& _accelerometer, MicroBitDisplay& _display, MicroBitStorage &storage) : compass(_compass), accelerometer(_accelerometer), display(_display)
 {
     this->storage = &storage;
+    this->fit = NULL;
 
     //Attempt to load any stored calibration datafor the compass.
     KeyValuePair *calibrationData =  this->storage->get("compassCal");
@@ -135,8 +250,133 @@ float MicroBitCompassCalibrator::measureScore(Sample3D &c, Sample3D *data, int s
  */
 CompassCalibration MicroBitCompassCalibrator::calibrate(Sample3D *data, int samples)
 {
-    Sample3D centre = approximateCentre(data, samples);
-    return spherify(centre, data, samples);
+    Sample3D centre;
+    CompassCalibration result;
+
+    // Fall back to the iterative search should the samples be too degenerate for a closed form fit.
+    if (!fitSphere(data, samples, centre))
+        return spherify(approximateCentre(data, samples), data, samples);
+
+#if CONFIG_ENABLED(MICROBIT_COMPASS_CALIBRATOR_ELLIPSOID)
+    if (fitEllipsoid(centre, data, samples, result))
+        return result;
+#endif
+
+    result = spherify(centre, data, samples);
+    return result;
+}
+
+/**
+ * Determines the centre of the sphere that best fits the given data points, by a closed form linear least squares fit
+ * of x^2 + y^2 + z^2 = 2a.x + 2b.y + 2c.z + d.
+ *
+ * @param data An array of all data points
+ * @param samples The number of samples in the 'data' array.
+ * @param centre The centre point of the sphere, if one is found.
+ *
+ * @return true on success, or false if the data points do not describe a sphere.
+ */
+bool MicroBitCompassCalibrator::fitSphere(Sample3D *data, int samples, Sample3D &centre)
+{
+    float a[6][7];
+    float p[4];
+    Sample3D mean = { 0,0,0 };
+
+    if (samples < 4)
+        return false;
+
+    // Fit about the centre of mass, in normalised units, to keep the sums well conditioned.
+    for (int i = 0; i < samples; i++)
+    {
+        mean.x += data[i].x;
+        mean.y += data[i].y;
+        mean.z += data[i].z;
+    }
+
+    mean.x = mean.x / samples;
+    mean.y = mean.y / samples;
+    mean.z = mean.z / samples;
+
+    memset(a, 0, sizeof(a));
+
+    for (int i = 0; i < samples; i++)
+    {
+        float x = (data[i].x - mean.x) / FIT_NORMALISE;
+        float y = (data[i].y - mean.y) / FIT_NORMALISE;
+        float z = (data[i].z - mean.z) / FIT_NORMALISE;
+        float t[4] = { x, y, z, 1.0f };
+        float w = x * x + y * y + z * z;
+
+        for (int j = 0; j < 4; j++)
+        {
+            for (int k = j; k < 4; k++)
+                a[j][k] += t[j] * t[k];
+
+            a[j][4] += t[j] * w;
+        }
+    }
+
+    for (int j = 0; j < 4; j++)
+        for (int k = 0; k < j; k++)
+            a[j][k] = a[k][j];
+
+    if (!solveLinear(a, 4, p))
+        return false;
+
+    // The squared radius is d + a^2 + b^2 + c^2, which must be positive for a real sphere.
+    float cx = p[0] / 2;
+    float cy = p[1] / 2;
+    float cz = p[2] / 2;
+
+    if (p[3] + cx * cx + cy * cy + cz * cz <= 0)
+        return false;
+
+    centre.x = mean.x + (int) (cx * FIT_NORMALISE);
+    centre.y = mean.y + (int) (cy * FIT_NORMALISE);
+    centre.z = mean.z + (int) (cz * FIT_NORMALISE);
+
+    return true;
+}
+
+/**
+ * Refines a sphere fit into an axis aligned ellipsoid fit, giving an independent centre and scale factor for each axis.
+ *
+ * @param centre A previously calculated centre point of all data, about which the refined fit is made.
+ * @param data An array of all data points
+ * @param samples The number of samples in the 'data' array.
+ * @param cal The calibration to fill in.
+ *
+ * @return true on success, or false if the data points do not describe an ellipsoid.
+ */
+bool MicroBitCompassCalibrator::fitEllipsoid(Sample3D centre, Sample3D *data, int samples, CompassCalibration &cal)
+{
+    float m[6][6];
+    float v[6];
+
+    if (samples < 6)
+        return false;
+
+    memset(m, 0, sizeof(m));
+    memset(v, 0, sizeof(v));
+
+    for (int i = 0; i < samples; i++)
+    {
+        float x = (data[i].x - centre.x) / FIT_NORMALISE;
+        float y = (data[i].y - centre.y) / FIT_NORMALISE;
+        float z = (data[i].z - centre.z) / FIT_NORMALISE;
+        float t[6] = { x * x, y * y, x, y, z, 1.0f };
+        float w = -z * z;
+
+        for (int j = 0; j < 6; j++)
+        {
+            for (int k = j; k < 6; k++)
+                m[j][k] += t[j] * t[k];
+
+            v[j] += t[j] * w;
+        }
+    }
+
+    return ellipsoidCalibration(m, v, centre, cal);
 }
 /**
  * Calculates an independent scale factor for X,Y and Z axes that places the given data points on a bounding sphere
@@ -425,3 +665,155 @@ void MicroBitCompassCalibrator::calibrateUX(MicroBitEvent)
     // Retore the display brightness to the level it was at before this function was called.
     display.setBrightness(displayBrightness);
 }
+
+/**
+  * Starts calibrating the compass in the background.
+  *
+  * Samples are gathered from the compass as it is used, and the calibration is refitted and applied as
+  * they arrive, once they cover enough of each axis. If persistent storage is available, the calibration is
+  * stored whenever its centre has moved significantly.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if memory could not be allocated.
+  */
+int MicroBitCompassCalibrator::startBackgroundCalibration()
+{
+    if (fit)
+        return DEVICE_OK;
+
+    fit = (MicroBitCompassFit *) malloc(sizeof(MicroBitCompassFit));
+
+    if (fit == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    memset(fit, 0, sizeof(MicroBitCompassFit));
+
+    fit->lo.x = fit->lo.y = fit->lo.z = INT32_MAX;
+    fit->hi.x = fit->hi.y = fit->hi.z = INT32_MIN;
+
+    // Start from the calibration in use, so that we only store again once we have found a better one.
+    fit->stored = compass.getCalibration().centre;
+
+    // Registering for data updates also ensures the compass is being sampled.
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_DATA_UPDATE, this, &MicroBitCompassCalibrator::onCompassData);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Stops calibrating the compass in the background. The calibration last applied remains in use.
+  *
+  * @return DEVICE_OK on success.
+  */
+int MicroBitCompassCalibrator::stopBackgroundCalibration()
+{
+    if (fit == NULL)
+        return DEVICE_OK;
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->ignore(MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_DATA_UPDATE, this, &MicroBitCompassCalibrator::onCompassData);
+
+    free(fit);
+    fit = NULL;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines if the compass is being calibrated in the background.
+  *
+  * @return true if background calibration is running, false otherwise.
+  */
+bool MicroBitCompassCalibrator::isBackgroundCalibrating()
+{
+    return fit != NULL;
+}
+
+/**
+ * Event handler for new compass data, used during background calibration.
+ */
+void MicroBitCompassCalibrator::onCompassData(MicroBitEvent)
+{
+    if (fit == NULL)
+        return;
+
+    Sample3D s = compass.getSample(RAW);
+
+    // Skip samples close to the last one we accepted, so that a device held still doesn't dominate the fit.
+    if (fit->weight > 0 && fit->last.dSquared(s) < (float) MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_SPACING * MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_SPACING)
+        return;
+
+    fit->last = s;
+
+    fit->lo.x = min(fit->lo.x, s.x);
+    fit->lo.y = min(fit->lo.y, s.y);
+    fit->lo.z = min(fit->lo.z, s.z);
+    fit->hi.x = max(fit->hi.x, s.x);
+    fit->hi.y = max(fit->hi.y, s.y);
+    fit->hi.z = max(fit->hi.z, s.z);
+
+    float x = s.x / FIT_NORMALISE;
+    float y = s.y / FIT_NORMALISE;
+    float z = s.z / FIT_NORMALISE;
+    float t[6] = { x * x, y * y, x, y, z, 1.0f };
+    float w = -z * z;
+
+    // Once the window is full, age the existing sums so that the fit follows any change in the device's surroundings.
+    if (fit->weight >= MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_WINDOW)
+    {
+        float decay = 1.0f - 1.0f / MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_WINDOW;
+
+        for (int i = 0; i < 6; i++)
+        {
+            for (int j = i; j < 6; j++)
+                fit->m[i][j] *= decay;
+
+            fit->v[i] *= decay;
+        }
+
+        fit->weight *= decay;
+    }
+
+    // The normal equations are symmetric, so only the upper triangle is accumulated.
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = i; j < 6; j++)
+            fit->m[i][j] += t[i] * t[j];
+
+        fit->v[i] += t[i] * w;
+    }
+
+    fit->weight += 1.0f;
+    fit->accepted++;
+
+    if (fit->weight >= MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_MIN_SAMPLES && fit->accepted >= MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_UPDATE)
+    {
+        fit->accepted = 0;
+        backgroundRefit();
+    }
+}
+
+/**
+ * Solves the running least squares fit of a background calibration, and applies the result if it is sound.
+ */
+void MicroBitCompassCalibrator::backgroundRefit()
+{
+    Sample3D origin = { 0,0,0 };
+    CompassCalibration cal;
+
+    if (!ellipsoidCalibration(fit->m, fit->v, origin, cal))
+        return;
+
+    // Only trust the fit once the samples span at least one radius on each axis.
+    if (fit->hi.x - fit->lo.x < cal.radius * 1024 / cal.scale.x || fit->hi.y - fit->lo.y < cal.radius * 1024 / cal.scale.y || fit->hi.z - fit->lo.z < cal.radius * 1024 / cal.scale.z)
+        return;
+
+    compass.setCalibration(cal);
+
+    // Only write to FLASH once the centre has moved significantly, to spare the flash from wear.
+    if (this->storage && fit->stored.dSquared(cal.centre) >= (float) MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_STORE_DELTA * MICROBIT_COMPASS_CALIBRATOR_BACKGROUND_STORE_DELTA)
+    {
+        fit->stored = cal.centre;
+        this->storage->put("compassCal", (uint8_t *) &cal, sizeof(CompassCalibration));
+    }
+}
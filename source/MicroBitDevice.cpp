@@ -24,6 +24,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitConfig.h"
 #include "MicroBitDevice.h"
+#include "MicroBitRandomPool.h"
 #include "nrf.h"
 #include "hal/nrf_gpio.h"
 #include "cmsis_compiler.h"
@@ -68,6 +69,31 @@ void MicroBitDevice::seedRandom()
 {
     uint32_t r = 0xBBC5EED;
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_RANDOM_POOL)
+    // Take the seed from the pool. Without BLE, this only waits if the pool hasn't yet had time to fill.
+    if(microbit_random_pool_running())
+    {
+        uint8_t b;
+        int count = 0;
+
+        while(count < 4)
+        {
+            if(microbit_random_bytes(&b, 1) == 1)
+            {
+                r = (r << 8) | b;
+                count++;
+            }
+            else if(ble_running())
+            {
+                break;
+            }
+        }
+
+        seedRandom(r);
+        return;
+    }
+#endif
+
     if(!ble_running())
     {
         // Start the Random number generator. No need to leave it running... I hope. :-)
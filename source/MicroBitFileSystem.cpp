@@ -25,6 +25,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitStorage.h"        
 #include "MicroBitCompat.h"
 #include "ErrorNo.h"
+#include "CodalFiber.h"
 
 using namespace codal;
 
@@ -39,43 +40,49 @@ MicroBitFileSystem* MicroBitFileSystem::defaultFileSystem = NULL;
   */
 uint16_t MicroBitFileSystem::getFreeBlock()
 {
-    // Walk the File Table and allocate the first free block - starting immediately after the last block allocated,
-    // and wrapping around the filesystem space if we reach the end.
-    uint16_t block;
-    uint16_t deletedBlock = 0;
-
-    for (block = (lastBlockAllocated + 1) % fileSystemSize; block != lastBlockAllocated; block++)
+    // If no UNUSED blocks are available, try to recycle those marked as DELETED.
+    // If there are none of these either, then we're out of space and there's nothing we can do.
+    if (freeBlockCount == 0)
     {
-        if (fileSystemTable[block] == MBFS_UNUSED)
-        {
-            lastBlockAllocated = block;
-            return block;
-        }
+        if (deletedBlockCount == 0)
+            return 0;
 
-        if (fileSystemTable[block] == MBFS_DELETED)
-            deletedBlock = block;
+        // recycle the FileTable, such that we can mark all previously deleted blocks as re-usable.
+        // Better to do this in bulk, rather than on a block by block basis to improve efficiency. 
+        recycleFileTable();
+
+        if (freeBlockCount == 0)
+            return 0;
     }
 
-    // if no UNUSED blocks are available, try to recycle one marked as DELETED.
-    block = deletedBlock;
+    // Search the free block bitmap for the first free block - starting immediately after the last block allocated,
+    // and wrapping around the filesystem space if we reach the end. We examine 32 blocks at a time.
+    int words = (fileSystemSize + 31) / 32;
+    int start = (lastBlockAllocated + 1) % fileSystemSize;
 
-    // If no blocks are available - either UNUSED or marked as DELETED, then we're out of space and there's nothing we can do.
-    if (block)
+    for (int i = 0; i <= words; i++)
     {
-        // recycle the FileTable, such that we can mark all previously deleted blocks as re-usable.
-        // Better to do this in bulk, rather than on a block by block basis to improve efficiency. 
-        recycleFileTable();
+        int w = ((start / 32) + i) % words;
+        uint32_t bits = freeBlockMap[w];
+
+        // Ignore blocks before our starting point on the first pass.
+        if (i == 0)
+            bits &= 0xFFFFFFFF << (start % 32);
 
-        // Record the block we just allocated, so we can round-robin around blocks for load balancing.
-        lastBlockAllocated = block;
+        if (bits)
+        {
+            // Record the block we just allocated, so we can round-robin around blocks for load balancing.
+            lastBlockAllocated = w * 32 + __builtin_ctz(bits);
+            return lastBlockAllocated;
+        }
     }
 
-    return block;
+    return 0;
 }
 
 /**
   * Allocates a free physical page of memory.
-  * This is chosen using a round robin algorithm, to even out the wear on the physical device.
+  * The least worn page available is chosen, using a round robin algorithm to break ties.
   * @return NULL on error, page address on success
   */
 uint32_t* MicroBitFileSystem::getFreePage()
@@ -86,56 +93,496 @@ uint32_t* MicroBitFileSystem::getFreePage()
     // get a handle on the next physical page.
     uint16_t currentPage = getBlockNumber(getPage(lastBlockAllocated));
     uint16_t page = (currentPage + blocksPerPage) % fileSystemSize;
+    uint16_t emptyPage = 0;
     uint16_t recyclablePage = 0;
 
     // Walk around the file table, looking for a free page.
     while (page != currentPage)
     {
-        bool empty = true;
-        bool deleted = false;
-        uint16_t next;
+        bool erased;
 
-        for (int i = 0; i < blocksPerPage; i++)
+        // make note of the least worn erased page, and least worn unused but un-erased page we find (if any).
+        if (isPageFree(page, erased))
         {
-            next = getNextFileBlock(page + i);
-            
-            if (next == MBFS_DELETED)
-                deleted = true;
-            
-            else if (next != MBFS_UNUSED)
-            {
-                empty = false;
-                break;
-            }
-        }
+            uint16_t wear = eraseCounts[page / blocksPerPage];
 
-        // See if we found one...
-        if (empty)
-        {
-            lastBlockAllocated = page;
-            return getBlock(page);
-        }
+            if (erased && (!emptyPage || wear < eraseCounts[emptyPage / blocksPerPage]))
+                emptyPage = page;
 
-        // make note of the first unused but un-erased page we find (if any).
-        if (deleted && !recyclablePage)
-            recyclablePage = page;
+            if (!erased && (!recyclablePage || wear < eraseCounts[recyclablePage / blocksPerPage]))
+                recyclablePage = page;
+        }
 
         page = (page + blocksPerPage) % fileSystemSize;
     }
 
+    // See if we found one... The caller will use this page, so it can no longer be considered erased.
+    if (emptyPage)
+    {
+        erasedPageMap[emptyPage / blocksPerPage / 32] &= ~(1u << ((emptyPage / blocksPerPage) % 32));
+        lastBlockAllocated = emptyPage;
+        return getBlock(emptyPage);
+    }
+
     // No empty pages are available, but we may be able to recycle one.
     if (recyclablePage)
     {
         uint32_t *address = getBlock(recyclablePage);
-        flash.erase_page(address);
+        erasePage(address);
         return address;
     }
 
     // Nothing available at all. Use the default.
-    flash.erase_page(defaultScratchPage);
+    erasePage(defaultScratchPage);
     return defaultScratchPage;
 }
 
+/**
+  * Determine if a physical page holds no live data, and so can be used as scratch space.
+  *
+  * @param page The first block of the page.
+  * @param erased Set to true if the page is known to be erased, false if it would need erasing before use.
+  * @return true if none of the blocks on the page are in use.
+  */
+bool MicroBitFileSystem::isPageFree(uint16_t page, bool &erased)
+{
+    int blocksPerPage = (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+    bool deleted = false;
+
+    for (int i = 0; i < blocksPerPage; i++)
+    {
+        uint16_t next = getNextFileBlock(page + i);
+
+        if (next == MBFS_DELETED)
+            deleted = true;
+
+        else if (next != MBFS_UNUSED)
+            return false;
+    }
+
+    // UNUSED blocks are always erased, and DELETED blocks are erased once the page has been recycled.
+    erased = !deleted || (erasedPageMap[page / blocksPerPage / 32] & (1u << ((page / blocksPerPage) % 32)));
+
+    return true;
+}
+
+/**
+  * Record whether the DELETED blocks on a physical page are known to be erased.
+  *
+  * @param address Any address within the page.
+  * @param erased true if the page has just been erased or recycled, false if it may now contain stale data.
+  */
+void MicroBitFileSystem::setPageErased(void *address, bool erased)
+{
+    uint32_t offset = (uint32_t) address - (uint32_t) fileSystemTable;
+
+    if ((uint32_t) address < (uint32_t) fileSystemTable || offset / MBFS_BLOCK_SIZE >= (uint32_t) fileSystemSize)
+        return;
+
+    uint32_t p = offset / MICROBIT_CODEPAGESIZE;
+
+    if (erased)
+        erasedPageMap[p / 32] |= 1u << (p % 32);
+    else
+        erasedPageMap[p / 32] &= ~(1u << (p % 32));
+}
+
+/**
+  * Perform a single step of background garbage collection, keeping MBFS_ERASED_PAGE_POOL_SIZE erased pages in reserve
+  * and, once at least MBFS_GC_THRESHOLD blocks are DELETED, compacting them so they can be reused.
+  *
+  * @return true if any work was performed, false if there is nothing left to do.
+  */
+bool MicroBitFileSystem::collectGarbage()
+{
+    int blocksPerPage = (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+    int erasedPages = 0;
+    int dirtyPage = -1;
+    int compactPage = -1;
+
+    for (uint16_t page = 0; page < fileSystemSize; page += blocksPerPage)
+    {
+        bool erased;
+        uint32_t bit = erasedPageMap[page / blocksPerPage / 32] & (1u << ((page / blocksPerPage) % 32));
+
+        // The file table is recycled separately.
+        if (getBlock(page + blocksPerPage - 1) < (uint32_t *)rootDirectory)
+            continue;
+
+        if (isPageFree(page, erased))
+        {
+            if (erased)
+                erasedPages++;
+            else if (dirtyPage < 0 || eraseCounts[page / blocksPerPage] < eraseCounts[dirtyPage / blocksPerPage])
+                dirtyPage = page;
+        }
+        else if (!bit && compactPage < 0)
+        {
+            for (int i = 0; i < blocksPerPage; i++)
+                if (getNextFileBlock(page + i) == MBFS_DELETED)
+                    compactPage = page;
+        }
+    }
+
+    // Top up the pool of erased pages, so that getFreePage() doesn't have to erase a page in the foreground.
+    if (erasedPages < MBFS_ERASED_PAGE_POOL_SIZE && dirtyPage >= 0)
+    {
+        erasePage(getBlock(dirtyPage));
+        setPageErased(getBlock(dirtyPage), true);
+        return true;
+    }
+
+    if (deletedBlockCount < MBFS_GC_THRESHOLD)
+        return false;
+
+    // Erase the DELETED blocks on each page, one page at a time.
+    if (compactPage >= 0)
+    {
+        recycleBlock(compactPage);
+        return true;
+    }
+
+    if (dirtyPage >= 0)
+    {
+        erasePage(getBlock(dirtyPage));
+        setPageErased(getBlock(dirtyPage), true);
+        return true;
+    }
+
+    // Once every DELETED block has been erased, return them all to use by recycling the file table.
+    for (uint16_t block = 0; getPage(block) < (uint32_t *)rootDirectory; block += blocksPerPage)
+        recycleBlock(block);
+
+    return true;
+}
+
+/**
+  * Fiber that performs background garbage collection until there is no more work to do.
+  *
+  * @param fs The MicroBitFileSystem to collect garbage for.
+  */
+void MicroBitFileSystem::collectionTask(void *fs)
+{
+    MicroBitFileSystem *f = (MicroBitFileSystem *) fs;
+
+    // n.b. No file system operation blocks, so each step runs to completion without interruption from other fibers.
+    while (f->collectGarbage())
+        schedule();
+
+    f->status &= ~MBFS_STATUS_COLLECTING;
+}
+
+/**
+  * Start the background garbage collection fiber, if it is not already running.
+  */
+void MicroBitFileSystem::startGarbageCollection()
+{
+    if (MBFS_ERASED_PAGE_POOL_SIZE == 0 || (status & MBFS_STATUS_COLLECTING))
+        return;
+
+    status |= MBFS_STATUS_COLLECTING;
+    create_fiber(MicroBitFileSystem::collectionTask, this);
+}
+
+/**
+  * Erase a physical page, updating its erase counter if it is part of the file system.
+  *
+  * @param page The address of the page to erase.
+  */
+void MicroBitFileSystem::erasePage(uint32_t *page)
+{
+    flash.erase_page(page);
+    recordErase(page);
+}
+
+/**
+  * Update the erase counter of a physical page, if it is part of the file system.
+  *
+  * @param page The address of a page that has been erased.
+  */
+void MicroBitFileSystem::recordErase(uint32_t *page)
+{
+    uint32_t offset = (uint32_t) page - (uint32_t) fileSystemTable;
+
+    if ((uint32_t) page >= (uint32_t) fileSystemTable && offset / MBFS_BLOCK_SIZE < (uint32_t) fileSystemSize)
+    {
+        uint16_t *count = &eraseCounts[offset / MICROBIT_CODEPAGESIZE];
+
+        if (*count < 0xFFFF)
+            (*count)++;
+
+        erasesSinceSave++;
+    }
+}
+
+/**
+  * Allocate the per-page erase counters, and load any previously saved values from FLASH.
+  *
+  * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the counters could not be allocated.
+  */
+int MicroBitFileSystem::loadEraseCounts()
+{
+    int pages = fileSystemSize / (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+
+    if (eraseCounts == NULL)
+    {
+        eraseCounts = (uint16_t *) malloc(pages * sizeof(uint16_t));
+        if (eraseCounts == NULL)
+            return MICROBIT_NO_RESOURCES;
+
+        memset(eraseCounts, 0, pages * sizeof(uint16_t));
+    }
+
+    erasesSinceSave = 0;
+
+    DirectoryEntry *dirent = getDirectoryEntry(MBFS_WEAR_TABLE, rootDirectory);
+
+    if (dirent && dirent->flags == MBFS_DIRECTORY_ENTRY_VALID)
+        memcpy(eraseCounts, getBlock(dirent->first_block), min(min(dirent->length, pages * sizeof(uint16_t)), MBFS_BLOCK_SIZE));
+
+    return MICROBIT_OK;
+}
+
+/**
+  * Save the per-page erase counters to FLASH.
+  * A fresh block is written each time, so that saving does not itself require a page erase.
+  *
+  * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the file system is full.
+  */
+int MicroBitFileSystem::saveEraseCounts()
+{
+    // n.b. Only the first MBFS_BLOCK_SIZE / 2 pages are persisted, which covers any file system that fits in the nRF52833.
+    int length = min(fileSystemSize / (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE) * sizeof(uint16_t), MBFS_BLOCK_SIZE);
+
+    DirectoryEntry *oldDirent = getDirectoryEntry(MBFS_WEAR_TABLE, rootDirectory);
+    DirectoryEntry *dirent;
+    DirectoryEntry d;
+
+    // Any erases performed while saving will be recorded in the next save.
+    erasesSinceSave = 0;
+
+    uint16_t block = getFreeBlock();
+    if (block == 0)
+        return MICROBIT_NO_RESOURCES;
+
+    fileTableWrite(block, MBFS_EOF);
+    flash.flash_write(getBlock(block), eraseCounts, length);
+
+    dirent = createDirectoryEntry(rootDirectory);
+    if (dirent == NULL)
+    {
+        fileTableWrite(block, MBFS_DELETED);
+        return MICROBIT_NO_RESOURCES;
+    }
+
+    // Retire the previous copy of the counters (if any) and publish the new one.
+    if (oldDirent)
+    {
+        uint16_t value = MBFS_DIRECTORY_ENTRY_DELETED;
+
+        indexRemove(oldDirent, rootDirectory);
+        flash.flash_write(&oldDirent->flags, &value, 2);
+        fileTableWrite(oldDirent->first_block, MBFS_DELETED);
+    }
+
+    strcpy(d.file_name, MBFS_WEAR_TABLE);
+    d.first_block = block;
+    d.flags = MBFS_DIRECTORY_ENTRY_VALID;
+    d.length = length;
+
+    flash.flash_write(dirent, &d, sizeof(DirectoryEntry));
+    indexAdd(dirent, rootDirectory);
+
+    return MICROBIT_OK;
+}
+
+/**
+  * Save the erase counters if enough erases have occured since the last save, and if the difference in wear
+  * between pages exceeds MBFS_WEAR_LEVELLING_THRESHOLD, migrate a file off the least worn page holding data.
+  * Only called when no internal operation is in progress.
+  */
+void MicroBitFileSystem::levelWear()
+{
+    int blocksPerPage = (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+    int pages = fileSystemSize / blocksPerPage;
+    uint16_t hottest = 0;
+    int coldest = -1;
+
+    if (erasesSinceSave < MBFS_WEAR_SAVE_INTERVAL)
+        return;
+
+    saveEraseCounts();
+
+    if (MBFS_WEAR_LEVELLING_THRESHOLD == 0)
+        return;
+
+    // Find the most worn page, and the least worn page holding file data.
+    // n.b. The pages holding the file table and root directory cannot be moved.
+    for (int p = 0; p < pages; p++)
+    {
+        hottest = max(hottest, eraseCounts[p]);
+
+        if (getBlock(p * blocksPerPage) <= (uint32_t *)rootDirectory)
+            continue;
+
+        for (int i = 0; i < blocksPerPage; i++)
+        {
+            uint16_t next = getNextFileBlock(p * blocksPerPage + i);
+
+            if (next != MBFS_UNUSED && next != MBFS_DELETED)
+            {
+                if (coldest < 0 || eraseCounts[p] < eraseCounts[coldest])
+                    coldest = p;
+
+                break;
+            }
+        }
+    }
+
+    // Data that is rarely rewritten keeps its page cold. Move it, so the page can be reused for more volatile data.
+    if (coldest >= 0 && hottest - eraseCounts[coldest] > MBFS_WEAR_LEVELLING_THRESHOLD)
+    {
+        DirectoryEntry *directory;
+        DirectoryEntry *dirent = findFileOnPage(rootDirectory, coldest * blocksPerPage, &directory);
+
+        if (dirent)
+            migrateFile(dirent, directory, coldest * blocksPerPage);
+    }
+}
+
+/**
+  * Search a directory (and any subdirectories) for a closed regular file holding a block on the given page.
+  *
+  * @param directory The directory to search.
+  * @param page The first block of the page of interest.
+  * @param parent Set to the directory holding the returned file.
+  * @return The DirectoryEntry of a matching file, or NULL if none was found.
+  */
+DirectoryEntry* MicroBitFileSystem::findFileOnPage(DirectoryEntry *directory, uint16_t page, DirectoryEntry **parent)
+{
+    uint16_t block = directory->first_block;
+    int blocksPerPage = (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+
+    while (block != MBFS_EOF)
+    {
+        DirectoryEntry *dirent = (DirectoryEntry *) getBlock(block);
+
+        for (uint16_t entry = 0; entry < MBFS_BLOCK_SIZE / sizeof(DirectoryEntry); entry++, dirent++)
+        {
+            // Only consider files and directories that have been closed.
+            if ((dirent->flags & MBFS_DIRECTORY_ENTRY_VALID) == 0 || dirent->flags == MBFS_DIRECTORY_ENTRY_NEW || dirent == rootDirectory)
+                continue;
+
+            if (dirent->flags & MBFS_DIRECTORY_ENTRY_DIRECTORY)
+            {
+                DirectoryEntry *result = findFileOnPage(dirent, page, parent);
+                if (result)
+                    return result;
+
+                continue;
+            }
+
+            bool open = false;
+            for (FileDescriptor *file = openFiles; file; file = file->next)
+                if (file->dirent == dirent)
+                    open = true;
+
+            if (open)
+                continue;
+
+            for (uint16_t b = dirent->first_block; b != MBFS_EOF; b = getNextFileBlock(b))
+            {
+                if (b >= page && b < page + blocksPerPage)
+                {
+                    *parent = directory;
+                    return dirent;
+                }
+            }
+        }
+
+        block = getNextFileBlock(block);
+    }
+
+    return NULL;
+}
+
+/**
+  * Copy a closed regular file into freshly allocated blocks, avoiding the given page, and delete the original.
+  *
+  * @param dirent The DirectoryEntry of the file to move.
+  * @param directory The directory holding the file.
+  * @param avoid The first block of a page that the file should be moved off.
+  * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the file system is full.
+  */
+int MicroBitFileSystem::migrateFile(DirectoryEntry *dirent, DirectoryEntry *directory, uint16_t avoid)
+{
+    int blocksPerPage = (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
+    uint16_t first = 0;
+    uint16_t last = 0;
+    uint16_t block;
+
+    // Build a copy of the block chain. As the new blocks are unused, this requires no page erases.
+    for (uint16_t b = dirent->first_block; b != MBFS_EOF; b = getNextFileBlock(b))
+    {
+        int attempts = 0;
+
+        do {
+            block = getFreeBlock();
+        } while (block && block >= avoid && block < avoid + blocksPerPage && ++attempts < blocksPerPage);
+
+        if (block == 0 || (block >= avoid && block < avoid + blocksPerPage))
+            break;
+
+        fileTableWrite(block, MBFS_EOF);
+        flash.flash_write(getBlock(block), getBlock(b), MBFS_BLOCK_SIZE);
+
+        if (last)
+            fileTableWrite(last, block);
+        else
+            first = block;
+
+        last = block;
+
+        if (getNextFileBlock(b) == MBFS_EOF)
+            block = MBFS_EOF;
+    }
+
+    DirectoryEntry *newDirent = block == MBFS_EOF ? createDirectoryEntry(directory) : NULL;
+
+    // If we ran out of space, abandon the copy.
+    if (newDirent == NULL)
+    {
+        while (first && first != MBFS_EOF)
+        {
+            block = getNextFileBlock(first);
+            fileTableWrite(first, MBFS_DELETED);
+            first = block;
+        }
+
+        return MICROBIT_NO_RESOURCES;
+    }
+
+    DirectoryEntry d = *dirent;
+    uint16_t value = MBFS_DIRECTORY_ENTRY_DELETED;
+
+    d.first_block = first;
+
+    // Replace the original directory entry, and release its blocks.
+    indexRemove(dirent, directory);
+    flash.flash_write(&dirent->flags, &value, 2);
+    flash.flash_write(newDirent, &d, sizeof(DirectoryEntry));
+    indexAdd(newDirent, directory);
+
+    for (uint16_t b = dirent->first_block; b != MBFS_EOF;)
+    {
+        block = getNextFileBlock(b);
+        fileTableWrite(b, MBFS_DELETED);
+        b = block;
+    }
+
+    return MICROBIT_OK;
+}
+
 
 /**
   * Constructor. Creates an instance of a MicroBitFileSystem.
@@ -178,8 +625,17 @@ int MicroBitFileSystem::init(uint32_t flashStart, int flashPages)
     // Zero initialise default parameters (mbed/ARMCC does not permit this is the class definition).
     fileSystemTable = NULL;
     lastBlockAllocated = 0;
+    freeBlockMap = NULL;
+    erasedPageMap = NULL;
+    freeBlockCount = 0;
+    deletedBlockCount = 0;
     rootDirectory = NULL;
     openFiles = NULL;
+    cachePool = NULL;
+    cachePoolUsed = 0;
+    directoryIndex = NULL;
+    eraseCounts = NULL;
+    erasesSinceSave = 0;
 
     // If we have a zero length, then dynamically determine our geometry.
     if (flashStart == 0)
@@ -200,25 +656,30 @@ int MicroBitFileSystem::init(uint32_t flashStart, int flashPages)
     fileSystemTable = (uint16_t *)flashStart;
 
     // First, try to load an existing file system at this location.
-    if (load() != MICROBIT_OK)
+    int result = load();
+
+    if (result == MICROBIT_NO_DATA)
     {
         // No file system was found, so format a fresh one.
         // Bring up a freshly formatted file system here.
         fileSystemSize = flashPages * (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE);
         fileSystemTableSize = calculateFileTableSize();
 
-        format();
+        result = format();
     }
 
+    if (result != MICROBIT_OK)
+        return result;
+
     // indicate that we have a valid FileSystem
-    status = MBFS_STATUS_INITIALISED;
+    status |= MBFS_STATUS_INITIALISED;
     return MICROBIT_OK;
 }
 
 /**
   * Attempts to detect and load an exisitng file file system.
   *
-  * @return MICROBIT_OK on success, or MICROBIT_NO_DATA if the file system could not be found.
+  * @return MICROBIT_OK on success, MICROBIT_NO_DATA if the file system could not be found, or MICROBIT_NO_RESOURCES if memory could not be allocated.
   */
 int MicroBitFileSystem::load()
 {
@@ -240,14 +701,19 @@ int MicroBitFileSystem::load()
     fileSystemSize = root->length;
     fileSystemTableSize = calculateFileTableSize();
 
-    return MICROBIT_OK;
+    if (rebuildFreeBlockMap() != MICROBIT_OK)
+        return MICROBIT_NO_RESOURCES;
+
+    rebuildDirectoryIndex();
+
+    return loadEraseCounts();
 }
 
 
 /**
   * Initialises a new file system. Assumes all pages are already erased.
   *
-  * @return MICROBIT_OK on success, or an error code..
+  * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if memory could not be allocated.
   */
 int MicroBitFileSystem::format()
 {
@@ -274,7 +740,12 @@ int MicroBitFileSystem::format()
     rootDirectory = (DirectoryEntry *)getBlock(fileSystemTableSize);
     flash.flash_write(rootDirectory, &magic, sizeof(DirectoryEntry));
 
-    return MICROBIT_OK;
+    if (rebuildFreeBlockMap() != MICROBIT_OK)
+        return MICROBIT_NO_RESOURCES;
+
+    rebuildDirectoryIndex();
+
+    return loadEraseCounts();
 }
 
 /**
@@ -292,118 +763,389 @@ DirectoryEntry* MicroBitFileSystem::getDirectoryEntry(char const * filename, con
     uint16_t block;
     DirectoryEntry *dirent;
 
-    // Determine the filename from the (potentially) fully qualified filename.
-    file = filename + strlen(filename);
-    while (file >= filename && *file != '/')
-        file--;
-    file++;
+    // Determine the filename from the (potentially) fully qualified filename.
+    file = filename + strlen(filename);
+    while (file >= filename && *file != '/')
+        file--;
+    file++;
+
+    // Obtain a handle on the directory to search.
+    if (directory == NULL)
+        directory = rootDirectory;
+
+    // If we have a complete index, we need only consider the entries with a matching hash.
+    if (status & MBFS_STATUS_INDEXED)
+    {
+        uint16_t hash = getDirectoryHash(file, directory->first_block);
+
+        for (int i = 0; i < MBFS_DIRECTORY_INDEX_SIZE; i++)
+        {
+            DirectoryIndexEntry *e = &directoryIndex[(hash + i) % MBFS_DIRECTORY_INDEX_SIZE];
+
+            if (e->dirent == NULL && e->hash == 0)
+                break;
+
+            if (e->dirent && e->hash == hash && e->parent == directory->first_block && strcmp(e->dirent->file_name, file) == 0)
+                return e->dirent;
+        }
+
+        return NULL;
+    }
+
+    block = directory->first_block;
+    dir = (Directory *) getBlock(block);
+    dirent = &dir->entry[0];
+
+    // Iterate through the directory entries until we find our file, or run out of space.
+    while (1)
+    {
+        if ((uint32_t)(dirent + 1) > (uint32_t)dir + MBFS_BLOCK_SIZE)
+        {
+            block = getNextFileBlock(block);
+            if (block == MBFS_EOF)
+                return NULL;
+
+            dir = (Directory *)getBlock(block);
+            dirent = &dir->entry[0];
+        }
+
+        // Check for a valid match
+        if (dirent->flags & MBFS_DIRECTORY_ENTRY_VALID && strcmp(dirent->file_name, file) == 0)
+            return dirent;
+
+        // Move onto the next entry.
+        dirent++;
+    }
+
+    return NULL;
+}
+
+/**
+  * Determine the number of logical blocks required to hold the file table.
+  *
+  * @return The number of logical blocks required to hold the file table.
+  */
+uint16_t MicroBitFileSystem::calculateFileTableSize()
+{
+    uint16_t size = (fileSystemSize * 2) / MBFS_BLOCK_SIZE;
+    if ((fileSystemSize * 2) % MBFS_BLOCK_SIZE)
+        size++;
+
+    return size;
+}
+
+/**
+  * Retrieve a memory pointer for the start of the physical memory page containing the given block.
+  *
+  * @param block A valid block number.
+  *
+  * @return A pointer to the physical page in FLASH memory holding the given block.
+  */
+uint32_t *MicroBitFileSystem::getPage(uint16_t block)
+{
+    uint32_t address = (uint32_t) getBlock(block);
+    return (uint32_t *) (address - address % MICROBIT_CODEPAGESIZE);
+}
+
+/**
+  * Retrieve a memory pointer for the start of the given block.
+  *
+  * @param block A valid block number.
+  *
+  * @return A pointer to the FLASH memory associated with the given block.
+  */
+uint32_t *MicroBitFileSystem::getBlock(uint16_t block)
+{
+    return (uint32_t *)((uint32_t)fileSystemTable + block * MBFS_BLOCK_SIZE);
+}
+
+/**
+  * Retrieve the next block in a chain.
+  *
+  * @param block A valid block number.
+  *
+  * @return The block number of the next block in the file.
+  */
+uint16_t MicroBitFileSystem::getNextFileBlock(uint16_t block)
+{
+    return fileSystemTable[block];
+}
+
+/**
+  * Retrieve the block of a file holding the given byte position, walking the block chain
+  * from the file's most recently used block where possible.
+  *
+  * n.b. A position on a block boundary resolves to the end of the preceding block.
+  *
+  * @param file The file descriptor of the file.
+  * @param position The byte position within the file.
+  * @param offset Set to the byte offset of the position within the returned block.
+  *
+  * @return The block number holding the given position.
+  */
+uint16_t MicroBitFileSystem::getFileBlock(FileDescriptor *file, uint32_t position, uint32_t &offset)
+{
+    uint16_t index = position ? (position - 1) / MBFS_BLOCK_SIZE : 0;
+
+    // The chain can only be walked forwards, so restart from the first block if we're moving backwards.
+    if (index < file->blockIndex)
+    {
+        file->blockIndex = 0;
+        file->block = file->dirent->first_block;
+    }
+
+    while (file->blockIndex < index)
+    {
+        file->block = getNextFileBlock(file->block);
+        file->blockIndex++;
+    }
+
+    offset = position - index * MBFS_BLOCK_SIZE;
+
+    return file->block;
+}
+
+/**
+  * Determine the logical block that contains the given address.
+  *
+  * @param address A valid memory location within the file system space.
+  *
+  * @return The block number containing the given address.
+  */
+uint16_t MicroBitFileSystem::getBlockNumber(void *address)
+{
+    return (((uint32_t) address - (uint32_t) fileSystemTable) / MBFS_BLOCK_SIZE);
+}
+
+/**
+  * Update a file table entry to a given value.
+  *
+  * @param block The block to update.
+  * @param value The value to store in the file table.
+  * @return MICROBIT_OK on success.
+  */
+int MicroBitFileSystem::fileTableWrite(uint16_t block, uint16_t value)
+{
+    uint16_t oldValue = fileSystemTable[block];
+
+    flash.flash_write(&fileSystemTable[block], &value, 2);
+
+    // Keep our free block accounting up to date.
+    // n.b. FLASH writes can only clear bits, so a block can only leave the UNUSED state here, never enter it.
+    if (oldValue == MBFS_UNUSED && fileSystemTable[block] != MBFS_UNUSED)
+    {
+        freeBlockMap[block / 32] &= ~(1u << (block % 32));
+        freeBlockCount--;
+    }
+
+    // A newly DELETED block still holds its data, so its page can no longer be considered erased.
+    if (oldValue != MBFS_DELETED && fileSystemTable[block] == MBFS_DELETED)
+    {
+        setPageErased(getBlock(block), false);
+        deletedBlockCount++;
+    }
+
+    return MICROBIT_OK;
+}
+
+/**
+  * Rebuild the bitmap of free blocks and the free/deleted block counts from the file table.
+  *
+  * The bitmap of erased pages is allocated on first use too.
+  *
+  * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if either bitmap could not be allocated.
+  */
+int MicroBitFileSystem::rebuildFreeBlockMap()
+{
+    int words = (fileSystemSize + 31) / 32;
+
+    if (freeBlockMap == NULL)
+    {
+        freeBlockMap = (uint32_t *) malloc(words * sizeof(uint32_t));
+        if (freeBlockMap == NULL)
+            return MICROBIT_NO_RESOURCES;
+    }
+
+    // Nothing is known to be erased until it has been recycled.
+    if (erasedPageMap == NULL)
+    {
+        int pageWords = (fileSystemSize / (MICROBIT_CODEPAGESIZE / MBFS_BLOCK_SIZE) + 31) / 32;
+        erasedPageMap = (uint32_t *) malloc(pageWords * sizeof(uint32_t));
+        if (erasedPageMap == NULL)
+            return MICROBIT_NO_RESOURCES;
 
-    // Obtain a handle on the directory to search.
-    if (directory == NULL)
-        directory = rootDirectory;
+        memset(erasedPageMap, 0, pageWords * sizeof(uint32_t));
+    }
 
-    block = directory->first_block;
-    dir = (Directory *) getBlock(block);
-    dirent = &dir->entry[0];
+    memset(freeBlockMap, 0, words * sizeof(uint32_t));
+    freeBlockCount = 0;
+    deletedBlockCount = 0;
 
-    // Iterate through the directory entries until we find our file, or run out of space.
-    while (1)
+    for (uint16_t block = 0; block < fileSystemSize; block++)
     {
-        if ((uint32_t)(dirent + 1) > (uint32_t)dir + MBFS_BLOCK_SIZE)
+        if (fileSystemTable[block] == MBFS_UNUSED)
         {
-            block = getNextFileBlock(block);
-            if (block == MBFS_EOF)
-                return NULL;
-
-            dir = (Directory *)getBlock(block);
-            dirent = &dir->entry[0];
+            freeBlockMap[block / 32] |= 1u << (block % 32);
+            freeBlockCount++;
         }
 
-        // Check for a valid match
-        if (dirent->flags & MBFS_DIRECTORY_ENTRY_VALID && strcmp(dirent->file_name, file) == 0)
-            return dirent;
-
-        // Move onto the next entry.
-        dirent++;
+        if (fileSystemTable[block] == MBFS_DELETED)
+            deletedBlockCount++;
     }
 
-    return NULL;
+    return MICROBIT_OK;
 }
 
 /**
-  * Determine the number of logical blocks required to hold the file table.
+  * Calculate the index hash of a directory entry.
   *
-  * @return The number of logical blocks required to hold the file table.
+  * @param name The name of the entry. Only the first MBFS_FILENAME_LENGTH characters are used.
+  * @param parent The first block of the directory holding the entry.
+  * @return A non-zero hash value.
   */
-uint16_t MicroBitFileSystem::calculateFileTableSize()
+uint16_t MicroBitFileSystem::getDirectoryHash(char const *name, uint16_t parent)
 {
-    uint16_t size = (fileSystemSize * 2) / MBFS_BLOCK_SIZE;
-    if ((fileSystemSize * 2) % MBFS_BLOCK_SIZE)
-        size++;
+    // 32 bit FNV-1a, folded to 16 bits.
+    uint32_t hash = 2166136261UL ^ parent;
 
-    return size;
+    for (int i = 0; i < MBFS_FILENAME_LENGTH && name[i]; i++)
+    {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619UL;
+    }
+
+    hash = (hash >> 16) ^ (hash & 0xFFFF);
+
+    return hash ? hash : 1;
 }
 
 /**
-  * Retrieve a memory pointer for the start of the physical memory page containing the given block.
-  *
-  * @param block A valid block number.
-  *
-  * @return A pointer to the physical page in FLASH memory holding the given block.
+  * Rebuild the RAM index of directory entries, by walking every directory in the file system.
+  * If the index cannot hold every entry, it is disabled and lookups fall back to scanning FLASH.
   */
-uint32_t *MicroBitFileSystem::getPage(uint16_t block)
+void MicroBitFileSystem::rebuildDirectoryIndex()
 {
-    uint32_t address = (uint32_t) getBlock(block);
-    return (uint32_t *) (address - address % MICROBIT_CODEPAGESIZE);
+    status &= ~MBFS_STATUS_INDEXED;
+
+    if (MBFS_DIRECTORY_INDEX_SIZE == 0)
+        return;
+
+    if (directoryIndex == NULL)
+    {
+        directoryIndex = (DirectoryIndexEntry *) malloc(MBFS_DIRECTORY_INDEX_SIZE * sizeof(DirectoryIndexEntry));
+        if (directoryIndex == NULL)
+            return;
+    }
+
+    memset(directoryIndex, 0, MBFS_DIRECTORY_INDEX_SIZE * sizeof(DirectoryIndexEntry));
+
+    // indexAdd() clears this flag if the index overflows.
+    status |= MBFS_STATUS_INDEXED;
+    indexDirectory(rootDirectory);
 }
 
 /**
-  * Retrieve a memory pointer for the start of the given block.
+  * Add all of the entries in the given directory (and any subdirectories) to the directory index.
   *
-  * @param block A valid block number.
-  *
-  * @return A pointer to the FLASH memory associated with the given block.
+  * @param directory The directory to index.
   */
-uint32_t *MicroBitFileSystem::getBlock(uint16_t block)
+void MicroBitFileSystem::indexDirectory(DirectoryEntry *directory)
 {
-    return (uint32_t *)((uint32_t)fileSystemTable + block * MBFS_BLOCK_SIZE);
+    uint16_t block = directory->first_block;
+
+    while (block != MBFS_EOF && (status & MBFS_STATUS_INDEXED))
+    {
+        DirectoryEntry *dirent = (DirectoryEntry *) getBlock(block);
+
+        for (uint16_t entry = 0; entry < MBFS_BLOCK_SIZE / sizeof(DirectoryEntry); entry++)
+        {
+            // Skip unused and deleted entries. n.b. unused entries are erased, so their name is also erased.
+            if ((dirent->flags & MBFS_DIRECTORY_ENTRY_VALID) && dirent->file_name[0] != (char) 0xFF)
+            {
+                indexAdd(dirent, directory);
+
+                if (dirent->flags != MBFS_DIRECTORY_ENTRY_NEW && (dirent->flags & MBFS_DIRECTORY_ENTRY_DIRECTORY))
+                    indexDirectory(dirent);
+            }
+
+            dirent++;
+        }
+
+        block = getNextFileBlock(block);
+    }
 }
 
 /**
-  * Retrieve the next block in a chain.
-  *
-  * @param block A valid block number.
+  * Add a directory entry to the directory index.
+  * If the index is full, it is disabled and lookups fall back to scanning FLASH.
   *
-  * @return The block number of the next block in the file.
+  * @param dirent The entry to add.
+  * @param directory The directory holding the entry.
   */
-uint16_t MicroBitFileSystem::getNextFileBlock(uint16_t block)
+void MicroBitFileSystem::indexAdd(DirectoryEntry *dirent, const DirectoryEntry *directory)
 {
-    return fileSystemTable[block];
+    if ((status & MBFS_STATUS_INDEXED) == 0)
+        return;
+
+    uint16_t hash = getDirectoryHash(dirent->file_name, directory->first_block);
+
+    for (int i = 0; i < MBFS_DIRECTORY_INDEX_SIZE; i++)
+    {
+        DirectoryIndexEntry *e = &directoryIndex[(hash + i) % MBFS_DIRECTORY_INDEX_SIZE];
+
+        if (e->dirent == NULL)
+        {
+            e->dirent = dirent;
+            e->parent = directory->first_block;
+            e->hash = hash;
+            return;
+        }
+    }
+
+    status &= ~MBFS_STATUS_INDEXED;
 }
 
 /**
-  * Determine the logical block that contains the given address.
+  * Remove a directory entry from the directory index.
   *
-  * @param address A valid memory location within the file system space.
-  *
-  * @return The block number containing the given address.
+  * @param dirent The entry to remove.
+  * @param directory The directory holding the entry.
   */
-uint16_t MicroBitFileSystem::getBlockNumber(void *address)
+void MicroBitFileSystem::indexRemove(DirectoryEntry *dirent, const DirectoryEntry *directory)
 {
-    return (((uint32_t) address - (uint32_t) fileSystemTable) / MBFS_BLOCK_SIZE);
+    if ((status & MBFS_STATUS_INDEXED) == 0)
+        return;
+
+    uint16_t hash = getDirectoryHash(dirent->file_name, directory->first_block);
+
+    for (int i = 0; i < MBFS_DIRECTORY_INDEX_SIZE; i++)
+    {
+        DirectoryIndexEntry *e = &directoryIndex[(hash + i) % MBFS_DIRECTORY_INDEX_SIZE];
+
+        if (e->dirent == NULL && e->hash == 0)
+            return;
+
+        // Leave the hash in place, so that lookups continue to probe past this slot.
+        if (e->dirent == dirent)
+        {
+            e->dirent = NULL;
+            return;
+        }
+    }
 }
 
 /**
-  * Update a file table entry to a given value.
+  * Determines the amount of space available for new file data.
+  * This includes space held by deleted files, which is reclaimed automatically when needed.
   *
-  * @param block The block to update.
-  * @param value The value to store in the file table.
-  * @return MICROBIT_OK on success.
+  * @return The number of bytes available, in units of MBFS_BLOCK_SIZE.
   */
-int MicroBitFileSystem::fileTableWrite(uint16_t block, uint16_t value)
+int MicroBitFileSystem::getFreeSpace()
 {
-    flash.flash_write(&fileSystemTable[block], &value, 2);
-    return MICROBIT_OK;
+    if ((status & MBFS_STATUS_INITIALISED) == 0)
+        return MICROBIT_NOT_SUPPORTED;
+
+    return (freeBlockCount + deletedBlockCount) * MBFS_BLOCK_SIZE;
 }
 
 
@@ -520,9 +1262,17 @@ int MicroBitFileSystem::recycleBlock(uint16_t block, int type)
     }
 
     // Now refresh the page originally holding the block.
-    flash.erase_page(page);
+    erasePage(page);
     flash.flash_write(page, scratch, MICROBIT_CODEPAGESIZE);
-    flash.erase_page(scratch);
+    erasePage(scratch);
+
+    // Any DELETED blocks on the page are now erased, as is the scratch page.
+    setPageErased(page, true);
+    setPageErased(scratch, true);
+
+    // If we have just refreshed part of the file table, any DELETED blocks it held are now UNUSED.
+    if (page < (uint32_t *)rootDirectory)
+        rebuildFreeBlockMap();
 
     return MICROBIT_OK;
 }
@@ -699,6 +1449,8 @@ DirectoryEntry* MicroBitFileSystem::createFile(char const * filename, DirectoryE
     // Push the new data back to FLASH memory
     flash.flash_write(dirent, &d, sizeof(DirectoryEntry));
     fileTableWrite(d.first_block, MBFS_EOF);
+    indexAdd(dirent, directory);
+
     return dirent;
 }
 
@@ -787,7 +1539,8 @@ int MicroBitFileSystem::createDirectory(char const *name)
   * an error is returned, otherwise the file is created.
   *
   * @param filename name of the file to open, must contain only printable characters.
-  * @param flags One or more of MB_READ, MB_WRITE or MB_CREAT. 
+  * @param flags One or more of MB_READ, MB_WRITE, MB_CREAT or MB_CACHED.
+  * @param cacheSize The size of writeback cache to use, in bytes (up to MBFS_BLOCK_SIZE). If zero, a full block is used.
   * @return return the file handle,MICROBIT_NOT_SUPPORTED if the file system has
   *         not been initialised MICROBIT_INVALID_PARAMETER if the filename is
   *         too large, MICROBIT_NO_RESOURCES if the file system is full.
@@ -799,7 +1552,7 @@ int MicroBitFileSystem::createDirectory(char const *name)
   *    print("file open error");
   * @endcode
   */
-int MicroBitFileSystem::open(char const * filename, uint32_t flags)
+int MicroBitFileSystem::open(char const * filename, uint32_t flags, int cacheSize)
 {
     FileDescriptor *file;               // File Descriptor of this file.
     DirectoryEntry* directory;          // Directory holding this file.
@@ -860,13 +1613,20 @@ int MicroBitFileSystem::open(char const * filename, uint32_t flags)
         return MICROBIT_NO_RESOURCES;
 
     // Populate the FileDescriptor
-    file->flags = (flags & ~(MB_CREAT));
+    file->flags = (flags & ~(MB_CREAT | MB_CACHED));
     file->id = id;
     file->length = dirent->flags == MBFS_DIRECTORY_ENTRY_NEW ? 0 : dirent->length;
     file->seek = (flags & MB_APPEND) ? file->length : 0;
     file->dirent = dirent;
     file->directory = directory;
     file->cacheLength = 0;
+    file->cacheSize = 0;
+    file->cache = NULL;
+    file->blockIndex = 0;
+    file->block = dirent->first_block;
+
+    if (flags & MB_CACHED || MBFS_CACHE_SIZE > 0)
+        allocateCache(file, cacheSize);
 
     // Add the file descriptor to the chain of open files.
     file->next = openFiles;
@@ -930,9 +1690,13 @@ int MicroBitFileSystem::flush(int fd)
             uint16_t value = MBFS_DELETED;
 
             // invalidate the old directory entry and create a new one with the updated data.
+            indexRemove(file->dirent, file->directory);
             flash.flash_write(&file->dirent->flags, &value, 2);
             newDirent = createDirectoryEntry(file->directory);
             flash.flash_write(newDirent, &d, sizeof(DirectoryEntry));
+            indexAdd(newDirent, file->directory);
+
+            file->dirent = newDirent;
         }
     }
 
@@ -972,7 +1736,12 @@ int MicroBitFileSystem::close(int fd)
 
     // Remove the file descriptor from the list of open files, and free it.
     // n.b. we know this is safe, as flush() validates this.
-    delete getFileDescriptor(fd, true);
+    FileDescriptor *file = getFileDescriptor(fd, true);
+    releaseCache(file);
+    delete file;
+
+    levelWear();
+    startGarbageCollection();
 
     return MICROBIT_OK;
 }
@@ -1067,7 +1836,6 @@ int MicroBitFileSystem::read(int fd, uint8_t* buffer, int size)
     uint8_t *writePointer;
 
     uint32_t offset;
-    uint32_t position = 0;
     int bytesCopied = 0;
     int segmentLength;
 
@@ -1088,17 +1856,7 @@ int MicroBitFileSystem::read(int fd, uint8_t* buffer, int size)
     size = min(size, file->length - file->seek);
 
     // Find the read position.
-    block = file->dirent->first_block; 
-
-    // Walk the file table until we reach the start block
-    while (file->seek - position > MBFS_BLOCK_SIZE)
-    {
-        block = getNextFileBlock(block);
-        position += MBFS_BLOCK_SIZE;
-    }
-
-    // Once we have the correct start block, handle the byte offset.
-    offset = file->seek - position;
+    block = getFileBlock(file, file->seek, offset);
 
     // Now, start copying bytes into the requested buffer.
     writePointer = buffer;
@@ -1119,6 +1877,13 @@ int MicroBitFileSystem::read(int fd, uint8_t* buffer, int size)
         {
             block = getNextFileBlock(block);
             offset = 0;
+
+            // Keep the cached chain position in step, so sequential reads don't walk the chain again.
+            if (block != MBFS_EOF)
+            {
+                file->block = block;
+                file->blockIndex++;
+            }
         }
     }
 
@@ -1127,6 +1892,79 @@ int MicroBitFileSystem::read(int fd, uint8_t* buffer, int size)
     return bytesCopied;
 }
 
+/**
+  * Map file data in place, without copying it into RAM.
+  *
+  * Files are held in memory mapped FLASH, so their data can be read directly. This returns a pointer to the
+  * longest contiguous run of the file's data starting at the given offset. The seek position is not changed.
+  * The pointer remains valid until the file is written to, closed or removed.
+  *
+  * @param fd File handle, obtained with open()
+  * @param offset The byte offset in the file at which the run starts.
+  * @param length Set to the number of bytes of file data available at the returned pointer.
+  * @return A pointer to the file data in FLASH, or NULL if the file system is not initialised, the given
+  *         file handle is invalid, or offset is at or beyond the end of the file.
+  *
+  * @code
+  * MicroBitFileSystem f;
+  * int fd = f.open("samples.raw", MB_READ);
+  * uint32_t len;
+  * const uint8_t *data = f.map(fd, 0, &len);
+  * @endcode
+  */
+const uint8_t* MicroBitFileSystem::map(int fd, uint32_t offset, uint32_t *length)
+{
+    FileDescriptor *file;
+    uint32_t blockOffset;
+    uint16_t block;
+
+    if (length)
+        *length = 0;
+
+    // Protect against accidental re-initialisation
+    if ((status & MBFS_STATUS_INITIALISED) == 0)
+        return NULL;
+
+    // Ensure the file is open.
+    file = getFileDescriptor(fd);
+
+    if (file == NULL || length == NULL)
+        return NULL;
+
+    // Any data in the writeback cache needs to be in FLASH to be mapped.
+    writeBack(file);
+
+    if (offset >= file->length)
+        return NULL;
+
+    block = getFileBlock(file, offset, blockOffset);
+
+    // A position on a block boundary resolves to the end of the preceding block, so move onto the next.
+    if (blockOffset == MBFS_BLOCK_SIZE)
+    {
+        block = getNextFileBlock(block);
+        blockOffset = 0;
+
+        file->block = block;
+        file->blockIndex++;
+    }
+
+    // Extend the run for as long as the file's blocks are physically adjacent.
+    uint32_t available = file->length - offset;
+    uint32_t run = MBFS_BLOCK_SIZE - blockOffset;
+    uint16_t b = block;
+
+    while (run < available && getNextFileBlock(b) == b + 1)
+    {
+        b++;
+        run += MBFS_BLOCK_SIZE;
+    }
+
+    *length = min(run, available);
+
+    return (uint8_t *)getBlock(block) + blockOffset;
+}
+
 /**
   * Flush a given file's cache back to FLASH memory.
   *
@@ -1146,6 +1984,94 @@ int MicroBitFileSystem::writeBack(FileDescriptor *file)
     return 0;
 }
 
+/**
+  * Remove a block from the pool of free blocks, ahead of it being recorded in the file table by commitBlocks().
+  *
+  * @param block The UNUSED block to reserve.
+  */
+void MicroBitFileSystem::reserveBlock(uint16_t block)
+{
+    freeBlockMap[block / 32] &= ~(1u << (block % 32));
+    freeBlockCount--;
+}
+
+/**
+  * Record a chain of reserved blocks in the file table, appending them after the given block.
+  *
+  * The entries for the new blocks are written first, in as few FLASH operations as possible, and the chain is
+  * then linked into the file with a single entry update. If power is lost before this point, the file is unchanged.
+  *
+  * @param tail The current last block of the file.
+  * @param blocks The blocks to append, in order.
+  * @param count The number of blocks to append.
+  */
+void MicroBitFileSystem::commitBlocks(uint16_t tail, uint16_t *blocks, int count)
+{
+    uint16_t values[MBFS_FILE_TABLE_BATCH_SIZE];
+    int i = 0;
+
+    while (i < count)
+    {
+        // Find a run of consecutive blocks, whose file table entries are therefore adjacent.
+        int run = 1;
+        while (i + run < count && blocks[i + run] == blocks[i] + run)
+            run++;
+
+        for (int j = 0; j < run; j++)
+            values[j] = (i + j + 1 < count) ? blocks[i + j + 1] : MBFS_EOF;
+
+        flash.flash_write(&fileSystemTable[blocks[i]], values, run * sizeof(uint16_t));
+        i += run;
+    }
+
+    fileTableWrite(tail, blocks[0]);
+}
+
+/**
+  * Allocate a writeback cache buffer for the given file from the shared pool, if one is available.
+  *
+  * @param file FileDescriptor of the file to cache.
+  * @param size The requested size of the cache, in bytes. Limited to MBFS_BLOCK_SIZE.
+  */
+void MicroBitFileSystem::allocateCache(FileDescriptor *file, int size)
+{
+    int buffers = min(MBFS_CACHE_POOL_SIZE / MBFS_BLOCK_SIZE, 32);
+
+    if (cachePool == NULL)
+    {
+        cachePool = (uint8_t *) malloc(buffers * MBFS_BLOCK_SIZE);
+        if (cachePool == NULL)
+            return;
+    }
+
+    for (int i = 0; i < buffers; i++)
+    {
+        if (!(cachePoolUsed & (1u << i)))
+        {
+            cachePoolUsed |= (1u << i);
+            file->cache = &cachePool[i * MBFS_BLOCK_SIZE];
+            file->cacheSize = (size > 0 && size < MBFS_BLOCK_SIZE) ? size : MBFS_BLOCK_SIZE;
+            return;
+        }
+    }
+}
+
+/**
+  * Return any writeback cache buffer held by the given file to the shared pool.
+  * Any cached data must have already been written back.
+  *
+  * @param file FileDescriptor of the file.
+  */
+void MicroBitFileSystem::releaseCache(FileDescriptor *file)
+{
+    if (file->cache)
+    {
+        cachePoolUsed &= ~(1u << ((file->cache - cachePool) / MBFS_BLOCK_SIZE));
+        file->cache = NULL;
+        file->cacheSize = 0;
+    }
+}
+
 /**
   * Write a given buffer to the file provided.
   *
@@ -1160,22 +2086,16 @@ int MicroBitFileSystem::writeBuffer(FileDescriptor *file, uint8_t *buffer, int s
     uint8_t *writePointer;
 
     uint32_t offset;
-    uint32_t position = 0;
     int bytesCopied = 0;
     int segmentLength;
 
-    // Find the read position.
-    block = file->dirent->first_block;
-
-    // Walk the file table until we reach the start block
-    while (file->seek - position > MBFS_BLOCK_SIZE)
-    {
-        block = getNextFileBlock(block);
-        position += MBFS_BLOCK_SIZE;
-    }
+    // Blocks appended to the file, but not yet recorded in the file table, and the block they follow.
+    uint16_t staged[MBFS_FILE_TABLE_BATCH_SIZE];
+    uint16_t tail = 0;
+    int stagedCount = 0;
 
-    // Once we have the correct start block, handle the byte offset.
-    offset = file->seek - position;
+    // Find the write position.
+    block = getFileBlock(file, file->seek, offset);
     writePointer = (uint8_t *)getBlock(block) + offset;
 
     // Now, start copying bytes from the requested buffer.
@@ -1186,7 +2106,22 @@ int MicroBitFileSystem::writeBuffer(FileDescriptor *file, uint8_t *buffer, int s
         segmentLength = min(size - bytesCopied, MBFS_BLOCK_SIZE - offset);
 
         if (segmentLength != 0)
-            flash.flash_write(writePointer, readPointer, segmentLength, file->seek + bytesCopied < file->length ? getFreePage() : NULL);
+        {
+            uint32_t *scratch = file->seek + bytesCopied < file->length ? getFreePage() : NULL;
+            bool rewrite = false;
+
+            // Overwriting existing data causes flash_write() to erase the page holding it, and its scratch page.
+            for (int i = 0; i < segmentLength && !rewrite; i++)
+                rewrite = (writePointer[i] & readPointer[i]) != readPointer[i];
+
+            flash.flash_write(writePointer, readPointer, segmentLength, scratch);
+
+            if (rewrite)
+            {
+                recordErase(getPage(getBlockNumber(writePointer)));
+                recordErase(scratch ? scratch : (uint32_t *)MICROBIT_DEFAULT_SCRATCH_PAGE);
+            }
+        }
 
         offset += segmentLength;
         bytesCopied += segmentLength;
@@ -1194,20 +2129,45 @@ int MicroBitFileSystem::writeBuffer(FileDescriptor *file, uint8_t *buffer, int s
 
         if (offset == MBFS_BLOCK_SIZE && bytesCopied < size)
         {
-            newBlock = getFreeBlock();
-            if (newBlock == 0)
-                break;
+            newBlock = stagedCount ? MBFS_EOF : getNextFileBlock(block);
+
+            // If we're at the end of the file, append a new block.
+            if (newBlock == MBFS_EOF)
+            {
+                // Commit what we have if the batch is full, or if allocation may recycle the file table (which would lose our reservations).
+                if (stagedCount == MBFS_FILE_TABLE_BATCH_SIZE || (stagedCount && freeBlockCount == 0))
+                {
+                    commitBlocks(tail, staged, stagedCount);
+                    stagedCount = 0;
+                }
+
+                newBlock = getFreeBlock();
+                if (newBlock == 0)
+                    break;
+
+                reserveBlock(newBlock);
 
-            fileTableWrite(newBlock, MBFS_EOF);
-            fileTableWrite(block, newBlock);
+                if (stagedCount == 0)
+                    tail = block;
+
+                staged[stagedCount++] = newBlock;
+
+                // Keep the pool of erased pages topped up as the file system fills.
+                startGarbageCollection();
+            }
 
             block = newBlock;
+            file->block = block;
+            file->blockIndex++;
 
             writePointer = (uint8_t *)getBlock(block);
             offset = 0;
         }
     }
 
+    if (stagedCount)
+        commitBlocks(tail, staged, stagedCount);
+
     // update the filelength metadata and seek position such that multiple writes are sequential.
     file->length = max(file->length, file->seek + bytesCopied);
     file->seek += bytesCopied;
@@ -1278,23 +2238,28 @@ int MicroBitFileSystem::write(int fd, uint8_t* buffer, int size)
     if (file == NULL || buffer == NULL || size == 0)
         return MICROBIT_INVALID_PARAMETER;
 
+    // Fail fast if the file system cannot hold the data. Each file always has at least one block allocated.
+    uint32_t allocated = max((file->length + MBFS_BLOCK_SIZE - 1) / MBFS_BLOCK_SIZE, 1) * MBFS_BLOCK_SIZE;
+    uint32_t end = file->seek + file->cacheLength + size;
+
+    if (end > allocated && (int)(end - allocated) > getFreeSpace())
+        return MICROBIT_NO_RESOURCES;
+
     // Determine how to handle the write. If the buffer size is less than our cache size, 
     // write the data via the cache. Otherwise, a direct write through is likely more efficient.
     // This may take a few iterations if the cache is already quite full.
-    if (size < MBFS_CACHE_SIZE)
+    if (file->cache && size < file->cacheSize)
     {
         while (bytesCopied < size)
         {
-            segmentSize = min(size, MBFS_CACHE_SIZE - file->cacheLength);
-            memcpy(&file->cache[file->cacheLength], buffer, segmentSize);
+            segmentSize = min(size - bytesCopied, file->cacheSize - file->cacheLength);
+            memcpy(&file->cache[file->cacheLength], buffer + bytesCopied, segmentSize);
 
             file->cacheLength += segmentSize;
             bytesCopied += segmentSize;
             
-            if (file->cacheLength == MBFS_CACHE_SIZE)
+            if (file->cacheLength == file->cacheSize)
                 writeBack(file);
-
-
         }
 
         return bytesCopied;
@@ -1343,12 +2308,45 @@ int MicroBitFileSystem::remove(char const * filename)
     }
 
     // Mark the directory entry of this file as invalid.
+    indexRemove(file->dirent, file->directory);
     value = MBFS_DIRECTORY_ENTRY_DELETED;
     flash.flash_write(&file->dirent->flags, &value, 2);
 
     // release file metadata
+    releaseCache(file);
     delete file;
 
+    levelWear();
+    startGarbageCollection();
+
     return MICROBIT_OK;
 }
 
+/**
+  * Constructor.
+  *
+  * @param fs The file system holding the file.
+  * @param fd File handle, obtained with open()
+  * @param offset The byte offset in the file at which to start.
+  */
+FileRunIterator::FileRunIterator(MicroBitFileSystem &fs, int fd, uint32_t offset) : fs(fs)
+{
+    this->fd = fd;
+    this->offset = offset;
+}
+
+/**
+  * Retrieve the next run of file data.
+  *
+  * @param length Set to the number of bytes in the run.
+  * @return A pointer to the run in FLASH, or NULL if there is no more data.
+  */
+const uint8_t* FileRunIterator::next(uint32_t *length)
+{
+    const uint8_t *run = fs.map(fd, offset, length);
+
+    if (run)
+        offset += *length;
+
+    return run;
+}
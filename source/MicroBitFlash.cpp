@@ -23,6 +23,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitFlash.h"
 #include "MicroBitDevice.h"
 #include "ErrorNo.h"                
+#include <string.h>
 
 #ifdef SOFTDEVICE_PRESENT
 #include "nrf_sdh_soc.h"
@@ -36,6 +37,9 @@ using namespace codal;
 
 #define WORD_ADDR(x) (((uint32_t)x) & 0xFFFFFFFC)
 
+// The number of changed words gathered into a single burn, when only part of a page needs programming.
+#define MICROBIT_FLASH_BURN_RUN     16
+
 /*
  * The underlying Nordic libraries that support BLE do not compile cleanly with the stringent GCC settings we employ
  * If we're compiling under GCC, then we suppress any warnings generated from this code (but not the rest of the DAL)
@@ -78,6 +82,9 @@ NRF_SDH_SOC_OBSERVER( microbitflash_soc_observer, 0, nvmc_event_handler, NULL);
 
 #endif
 
+uint32_t MicroBitFlash::bytesProgrammed = 0;
+uint32_t MicroBitFlash::pagesErased = 0;
+
 /**
   * Default Constructor
   */
@@ -99,9 +106,27 @@ MicroBitFlash::MicroBitFlash()
 int MicroBitFlash::need_erase(uint8_t* source, uint8_t* flash_addr, int len)
 {
     // Erase is necessary if for any byte:
-    // O & ~N != 0
+    // ~O & N != 0
     // Where O = original, and N = new byte.
 
+    // Bring the flash address up to word alignment...
+    for(;len>0 && ((uint32_t)flash_addr & 3);len--)
+    {
+        if((~*(flash_addr++) & *(source++)) != 0x00) return 1;
+    }
+
+    // ... then compare a word at a time. The source need not be aligned, as the M4 supports unaligned loads.
+    for(;len>=4;len-=4)
+    {
+        uint32_t n;
+        memcpy(&n, source, 4);
+
+        if((~*(uint32_t *)flash_addr & n) != 0) return 1;
+
+        flash_addr += 4;
+        source += 4;
+    }
+
     for(;len>0;len--)
     {
         if((~*(flash_addr++) & *(source++)) != 0x00) return 1;
@@ -115,6 +140,8 @@ int MicroBitFlash::need_erase(uint8_t* source, uint8_t* flash_addr, int len)
   */
 void MicroBitFlash::erase_page(uint32_t* pg_addr)
 {
+    pagesErased++;
+
 #ifdef SOFTDEVICE_PRESENT
     if (ble_running())
     {
@@ -157,6 +184,8 @@ void MicroBitFlash::erase_page(uint32_t* pg_addr)
   */
 void MicroBitFlash::flash_burn(uint32_t* addr, uint32_t* buffer, int size)
 {
+    bytesProgrammed += size * 4;
+
 #ifdef SOFTDEVICE_PRESENT
     if (ble_running())
     {
@@ -252,6 +281,11 @@ int MicroBitFlash::flash_write(void* address, void* from_buffer,
 
     uint32_t writeWord = 0;
 
+    // Changed words are gathered into runs of consecutive words, and burned a run at a time.
+    uint32_t run[MICROBIT_FLASH_BURN_RUN];
+    int runStart = 0;
+    int runLength = 0;
+
     for(int i=start;i<end;i++)
     {
         int byteOffset = i%4;
@@ -268,11 +302,31 @@ int MicroBitFlash::flash_write(void* address, void* from_buffer,
 
         if( ((i+1)%4) == 0)
         {
-            this->flash_burn(pgAddr + (i/4), &writeWord, 1);
+            int word = i/4;
+
+            // Skip words that already hold the value wanted (including erased words after an erase), as each
+            // write to a word counts towards the limit on writes between erases.
+            if (writeWord != pgAddr[word])
+            {
+                if (runLength > 0 && (runStart + runLength != word || runLength == MICROBIT_FLASH_BURN_RUN))
+                {
+                    this->flash_burn(pgAddr + runStart, run, runLength);
+                    runLength = 0;
+                }
+
+                if (runLength == 0)
+                    runStart = word;
+
+                run[runLength++] = writeWord;
+            }
+
             writeWord = 0;
         }
     }
 
+    if (runLength > 0)
+        this->flash_burn(pgAddr + runStart, run, runLength);
+
     return MICROBIT_OK;
 }
 
@@ -0,0 +1,272 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitHeapProfile.h"
+#include "CodalHeapAllocator.h"
+#include "EventModel.h"
+#include "Timer.h"
+#include "codal_target_hal.h"
+#include "ErrorNo.h"
+#include <string.h>
+
+using namespace codal;
+
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR)
+// The heaps created by the CODAL heap allocator.
+extern HeapDefinition heap[];
+extern uint8_t heap_count;
+#endif
+
+static MicroBitHeapTagStats tagStats[MICROBIT_HEAP_TAGS];
+static uint32_t heapHighWater = 0;
+static Serial *reportSerial = NULL;
+static bool reportListening = false;
+
+static const char *tagNames[MICROBIT_HEAP_TAG_USER] = { "log", "fscache", "radio", "audio", "packet" };
+
+/**
+ * Determines the size of a heap block, including its header, from the pointer returned when it was allocated.
+ * Returns 0 if that is not known, in which case only allocations are counted.
+ */
+static uint32_t heap_block_bytes(void *ptr)
+{
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR)
+    // Each block is preceded by a header word holding its size in words, including the header itself.
+    return (((PROCESSOR_WORD_TYPE *) ptr)[-1] & ~DEVICE_HEAP_BLOCK_FREE) * DEVICE_HEAP_BLOCK_SIZE;
+#else
+    (void) ptr;
+    return 0;
+#endif
+}
+
+/**
+ * Records an allocation made by a tagged call site. Safe to call from any context.
+ *
+ * @param tag the call site (one of MICROBIT_HEAP_TAG_*).
+ * @param ptr the block allocated, or NULL if the allocation failed.
+ * @param size the size requested, in bytes.
+ */
+void codal::microbit_heap_tag_alloc(int tag, void *ptr, uint32_t size)
+{
+    if (tag < 0 || tag >= MICROBIT_HEAP_TAGS)
+        return;
+
+    MicroBitHeapTagStats &s = tagStats[tag];
+    uint32_t bytes = ptr ? heap_block_bytes(ptr) : 0;
+
+    target_disable_irq();
+
+    if (ptr)
+    {
+        s.allocations++;
+        s.bytes += bytes;
+
+        if (s.bytes > s.peakBytes)
+            s.peakBytes = s.bytes;
+    }
+    else
+    {
+        s.failures++;
+        s.failedBytes = size;
+    }
+
+    target_enable_irq();
+}
+
+/**
+ * Records that a block allocated by a tagged call site is about to be freed. Safe to call from any context.
+ *
+ * @param tag the call site (one of MICROBIT_HEAP_TAG_*), as given when the block was allocated.
+ * @param ptr the block, or NULL (which is ignored).
+ */
+void codal::microbit_heap_tag_free(int tag, void *ptr)
+{
+    if (tag < 0 || tag >= MICROBIT_HEAP_TAGS || ptr == NULL)
+        return;
+
+    MicroBitHeapTagStats &s = tagStats[tag];
+    uint32_t bytes = heap_block_bytes(ptr);
+
+    target_disable_irq();
+
+    s.frees++;
+    s.bytes = s.bytes > bytes ? s.bytes - bytes : 0;
+
+    target_enable_irq();
+}
+
+/**
+ * Walks the heap, measuring the memory in use and its fragmentation, and updates the high water mark.
+ * Interrupts are disabled during the walk, which visits every block.
+ *
+ * @param stats the structure to fill in.
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the CODAL heap allocator is not in use.
+ */
+int codal::microbit_heap_get_stats(MicroBitHeapStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR)
+    target_disable_irq();
+
+    for (int h = 0; h < heap_count; h++)
+    {
+        PROCESSOR_WORD_TYPE *block = heap[h].heap_start;
+        uint32_t run = 0;
+
+        stats.size += (heap[h].heap_end - heap[h].heap_start) * DEVICE_HEAP_BLOCK_SIZE;
+
+        while (block < heap[h].heap_end)
+        {
+            uint32_t bytes = (*block & ~DEVICE_HEAP_BLOCK_FREE) * DEVICE_HEAP_BLOCK_SIZE;
+
+            // A zero length block would mean a corrupt heap, and a walk that never ends.
+            if (bytes == 0)
+                break;
+
+            if (*block & DEVICE_HEAP_BLOCK_FREE)
+            {
+                // The allocator merges neighbouring free blocks lazily, so treat a run of them as one.
+                if (run == 0)
+                    stats.freeBlocks++;
+
+                run += bytes;
+                stats.free += bytes;
+
+                if (run > stats.largestFree)
+                    stats.largestFree = run;
+            }
+            else
+            {
+                run = 0;
+                stats.usedBlocks++;
+                stats.used += bytes;
+            }
+
+            block += bytes / DEVICE_HEAP_BLOCK_SIZE;
+        }
+    }
+
+    if (stats.used > heapHighWater)
+        heapHighWater = stats.used;
+
+    stats.highWater = heapHighWater;
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Provides the counters of a tagged call site.
+ *
+ * @param tag the call site (one of MICROBIT_HEAP_TAG_*).
+ * @param stats the structure to fill in.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the tag is out of range.
+ */
+int codal::microbit_heap_get_tag_stats(int tag, MicroBitHeapTagStats &stats)
+{
+    if (tag < 0 || tag >= MICROBIT_HEAP_TAGS)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    stats = tagStats[tag];
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Prints a report of the heap and of each tagged call site that has allocated memory to the given serial port.
+ *
+ * @param serial the serial port to print to.
+ */
+void codal::microbit_heap_print(Serial &serial)
+{
+    MicroBitHeapStats h;
+    MicroBitHeapTagStats s;
+
+    microbit_heap_get_stats(h);
+
+    uint32_t fragmentation = h.free ? 100 - (uint32_t) (((uint64_t) h.largestFree * 100) / h.free) : 0;
+
+    serial.printf("HEAP %d %d %d %d %d %d %d %d\r\n", h.size, h.used, h.free, h.largestFree, h.usedBlocks, h.freeBlocks, h.highWater, fragmentation);
+
+    for (int i = 0; i < MICROBIT_HEAP_TAGS; i++)
+    {
+        microbit_heap_get_tag_stats(i, s);
+
+        if (s.allocations == 0 && s.failures == 0)
+            continue;
+
+        if (i < MICROBIT_HEAP_TAG_USER)
+            serial.printf("TAG %s", tagNames[i]);
+        else
+            serial.printf("TAG user%d", i - MICROBIT_HEAP_TAG_USER);
+
+        serial.printf(" %d %d %d %d %d %d\r\n", s.allocations, s.frees, s.failures, s.bytes, s.peakBytes, s.failedBytes);
+    }
+
+    serial.printf("END\r\n");
+}
+
+/**
+ * Callback. Invoked periodically, from a fiber, to print a report.
+ */
+static void heap_report(Event)
+{
+    if (reportSerial)
+        microbit_heap_print(*reportSerial);
+}
+
+/**
+ * Prints a report with microbit_heap_print() periodically, from a fiber, to keep watch over a long running program.
+ *
+ * @param serial the serial port to print to.
+ * @param period the time between reports in milliseconds, or 0 to stop reporting.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if there is no message bus.
+ */
+int codal::microbit_heap_report_every(Serial &serial, uint32_t period)
+{
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    if (!reportListening)
+    {
+        EventModel::defaultEventBus->listen(MICROBIT_ID_HEAP_PROFILE, MICROBIT_HEAP_PROFILE_EVT_REPORT, heap_report);
+        reportListening = true;
+    }
+
+    system_timer_cancel_event(MICROBIT_ID_HEAP_PROFILE, MICROBIT_HEAP_PROFILE_EVT_REPORT);
+
+    reportSerial = period ? &serial : NULL;
+
+    if (period)
+        system_timer_event_every(period, MICROBIT_ID_HEAP_PROFILE, MICROBIT_HEAP_PROFILE_EVT_REPORT);
+
+    return DEVICE_OK;
+}
@@ -0,0 +1,487 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitKeyValueLog.h"
+#include <string.h>
+#include <stdlib.h>
+
+using namespace codal;
+
+#define RECORD_SIZE     (sizeof(MicroBitKeyValueRecord))
+#define FIRST_RECORD    (sizeof(uint32_t))
+
+/**
+  * Constructor.
+  *
+  * Creates an instance of MicroBitKeyValueLog, which acts like a KeyValueStorage that allows user code to store
+  * and retrieve key value pairs in non-volatile memory.
+  *
+  * @param controller The non-volatile memory controller to use.
+  * @param pageNumber The page of the controller to hold the log, counting from the start of its memory. Defaults to 0.
+  */
+MicroBitKeyValueLog::MicroBitKeyValueLog(NVMController &controller, int pageNumber) : controller(controller)
+{
+    pageAddress = controller.getFlashStart() + pageNumber * controller.getPageSize();
+    end = FIRST_RECORD;
+    keys = 0;
+    loaded = false;
+}
+
+/**
+  * Places a given key, and it's corresponding value into flash at the earliest
+  * available point.
+  *
+  * @param key the unique name that should be used as an identifier for the given data.
+  *            The key is presumed to be null terminated.
+  *
+  * @param data a pointer to the beginning of the data to be persisted.
+  *
+  * @param dataSize the size of the data to be persisted
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the key or size is too large,
+  *         DEVICE_NO_RESOURCES if the storage page is full
+  */
+int MicroBitKeyValueLog::put(const char *key, uint8_t *data, int dataSize)
+{
+    MicroBitKeyValueRecord record;
+
+    if (dataSize < 0 || dataSize > KEY_VALUE_STORAGE_VALUE_SIZE || (dataSize > 0 && data == NULL))
+        return DEVICE_INVALID_PARAMETER;
+
+    memset(&record, 0, sizeof(record));
+
+    if (!padKey(key, record.pair.key))
+        return DEVICE_INVALID_PARAMETER;
+
+    load();
+
+    uint32_t h = hash(record.pair.key);
+    int i = find(record.pair.key, h);
+
+    record.header = MICROBIT_KEY_VALUE_LOG_TAG | MICROBIT_KEY_VALUE_LOG_VALUE | dataSize;
+    memcpy(record.pair.value, data, dataSize);
+
+    if (i >= 0)
+    {
+        // Writing the value the key already holds costs nothing.
+        MicroBitKeyValueRecord current;
+        controller.read((uint32_t *) &current, pageAddress + index[i].offset, RECORD_SIZE / sizeof(uint32_t));
+
+        if (memcmp(&current, &record, RECORD_SIZE) == 0)
+            return DEVICE_OK;
+    }
+    else if (keys >= MICROBIT_KEY_VALUE_LOG_MAX_KEYS)
+    {
+        return DEVICE_NO_RESOURCES;
+    }
+
+    uint32_t offset;
+    int result = append(record, offset);
+
+    if (result != DEVICE_OK)
+        return result;
+
+    // Appending may have compacted the log, moving every record, so look the key up afresh.
+    i = find(record.pair.key, h);
+
+    if (i < 0)
+    {
+        i = keys++;
+        index[i].hash = h;
+    }
+
+    index[i].offset = offset;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Places a given key, and it's corresponding value into flash at the earliest
+  * available point.
+  *
+  * @param key the unique name that should be used as an identifier for the given data.
+  *
+  * @param data a pointer to the beginning of the data to be persisted.
+  *
+  * @param dataSize the size of the data to be persisted
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the key or size is too large,
+  *         DEVICE_NO_RESOURCES if the storage page is full
+  */
+int MicroBitKeyValueLog::put(ManagedString key, uint8_t *data, int dataSize)
+{
+    return put(key.toCharArray(), data, dataSize);
+}
+
+/**
+  * Retreives a KeyValuePair identified by a given key.
+  *
+  * @param key the unique name used to identify a KeyValuePair in flash.
+  *
+  * @return a pointer to a heap allocated KeyValuePair struct, this pointer will be
+  *         NULL if the key was not found in storage.
+  *
+  * @note it is up to the user to free memory after use.
+  */
+KeyValuePair *MicroBitKeyValueLog::get(const char *key)
+{
+    uint8_t padded[KEY_VALUE_STORAGE_KEY_SIZE];
+
+    if (!padKey(key, padded))
+        return NULL;
+
+    load();
+
+    int i = find(padded, hash(padded));
+
+    if (i < 0)
+        return NULL;
+
+    KeyValuePair *pair = new KeyValuePair();
+    controller.read((uint32_t *) pair, pageAddress + index[i].offset + sizeof(uint32_t), sizeof(KeyValuePair) / sizeof(uint32_t));
+
+    return pair;
+}
+
+/**
+  * Retreives a KeyValuePair identified by a given key.
+  *
+  * @param key the unique name used to identify a KeyValuePair in flash.
+  *
+  * @return a pointer to a heap allocated KeyValuePair struct, this pointer will be
+  *         NULL if the key was not found in storage.
+  *
+  * @note it is up to the user to free memory after use.
+  */
+KeyValuePair *MicroBitKeyValueLog::get(ManagedString key)
+{
+    return get(key.toCharArray());
+}
+
+/**
+  * Removes a KeyValuePair identified by a given key.
+  *
+  * @param key the unique name used to identify a KeyValuePair in flash.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_DATA if the given key
+  *         was not found in flash.
+  */
+int MicroBitKeyValueLog::remove(const char *key)
+{
+    MicroBitKeyValueRecord record;
+
+    memset(&record, 0, sizeof(record));
+
+    if (!padKey(key, record.pair.key))
+        return DEVICE_NO_DATA;
+
+    load();
+
+    int i = find(record.pair.key, hash(record.pair.key));
+
+    if (i < 0)
+        return DEVICE_NO_DATA;
+
+    index[i] = index[--keys];
+
+    // If the log is full, compacting it drops the key anyway, so there is no need for a record of its removal.
+    if (end + RECORD_SIZE > controller.getPageSize())
+        return compact();
+
+    uint32_t offset;
+    record.header = MICROBIT_KEY_VALUE_LOG_TAG | MICROBIT_KEY_VALUE_LOG_REMOVED;
+
+    return append(record, offset);
+}
+
+/**
+  * Removes a KeyValuePair identified by a given key.
+  *
+  * @param key the unique name used to identify a KeyValuePair in flash.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_DATA if the given key
+  *         was not found in flash.
+  */
+int MicroBitKeyValueLog::remove(ManagedString key)
+{
+    return remove(key.toCharArray());
+}
+
+/**
+  * The size of the flash based KeyValueStore.
+  *
+  * @return the number of entries in the key value store
+  */
+int MicroBitKeyValueLog::size()
+{
+    load();
+
+    return keys;
+}
+
+/**
+  * Erase all contents of this KeyValue store.
+  *
+  * @return DEVICE_OK on success, or an error code from the flash controller.
+  */
+int MicroBitKeyValueLog::wipe()
+{
+    loaded = true;
+    keys = 0;
+
+    return format();
+}
+
+/**
+  * Builds the index of live keys from the log, formatting the page first if it doesn't hold one.
+  */
+void MicroBitKeyValueLog::load()
+{
+    if (loaded)
+        return;
+
+    loaded = true;
+    keys = 0;
+    end = FIRST_RECORD;
+
+    uint32_t magic;
+    controller.read(&magic, pageAddress, 1);
+
+    if (magic != MICROBIT_KEY_VALUE_LOG_MAGIC)
+    {
+        format();
+        return;
+    }
+
+    uint32_t pageSize = controller.getPageSize();
+    MicroBitKeyValueRecord record;
+
+    for (uint32_t offset = FIRST_RECORD; offset + RECORD_SIZE <= pageSize; offset += RECORD_SIZE)
+    {
+        if (isFree(offset))
+            continue;
+
+        // Records are only ever appended, so everything after the last one in use is free.
+        end = offset + RECORD_SIZE;
+
+        controller.read((uint32_t *) &record, pageAddress + offset, RECORD_SIZE / sizeof(uint32_t));
+
+        // Skip anything that isn't a complete record, e.g. one interrupted by a reset before its header was written.
+        if ((record.header & MICROBIT_KEY_VALUE_LOG_TAG_MASK) != MICROBIT_KEY_VALUE_LOG_TAG)
+            continue;
+
+        uint32_t h = hash(record.pair.key);
+        int i = find(record.pair.key, h);
+
+        switch (record.header & MICROBIT_KEY_VALUE_LOG_TYPE_MASK)
+        {
+            case MICROBIT_KEY_VALUE_LOG_VALUE:
+                if (i < 0 && keys < MICROBIT_KEY_VALUE_LOG_MAX_KEYS)
+                {
+                    i = keys++;
+                    index[i].hash = h;
+                }
+
+                if (i >= 0)
+                    index[i].offset = offset;
+                break;
+
+            case MICROBIT_KEY_VALUE_LOG_REMOVED:
+                if (i >= 0)
+                    index[i] = index[--keys];
+                break;
+        }
+    }
+}
+
+/**
+  * Erases our page, and writes the log header to it.
+  */
+int MicroBitKeyValueLog::format()
+{
+    uint32_t magic = MICROBIT_KEY_VALUE_LOG_MAGIC;
+    int result = controller.erase(pageAddress);
+
+    end = FIRST_RECORD;
+
+    if (result != DEVICE_OK)
+        return result;
+
+    return controller.write(pageAddress, &magic, 1);
+}
+
+/**
+  * Locates the index entry of a key.
+  *
+  * @param key the key, null padded to KEY_VALUE_STORAGE_KEY_SIZE bytes.
+  * @param hash the hash of the key.
+  *
+  * @return the position of the key in the index, or -1 if it is not stored.
+  */
+int MicroBitKeyValueLog::find(const uint8_t *key, uint32_t hash)
+{
+    uint8_t stored[KEY_VALUE_STORAGE_KEY_SIZE];
+
+    for (int i = 0; i < keys; i++)
+    {
+        if (index[i].hash != hash)
+            continue;
+
+        // Confirm the match against the key in flash, in case two keys share a hash.
+        controller.read((uint32_t *) stored, pageAddress + index[i].offset + sizeof(uint32_t), KEY_VALUE_STORAGE_KEY_SIZE / sizeof(uint32_t));
+
+        if (memcmp(stored, key, KEY_VALUE_STORAGE_KEY_SIZE) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+  * Appends a record to the log, compacting the log first if it is full.
+  *
+  * @param record the record to append.
+  * @param offset set to the offset of the record from the start of the page.
+  *
+  * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if there is no room even after compaction,
+  *         or an error code from the flash controller.
+  */
+int MicroBitKeyValueLog::append(MicroBitKeyValueRecord &record, uint32_t &offset)
+{
+    int result;
+
+    if (end + RECORD_SIZE > controller.getPageSize())
+    {
+        result = compact();
+
+        if (result != DEVICE_OK)
+            return result;
+
+        if (end + RECORD_SIZE > controller.getPageSize())
+            return DEVICE_NO_RESOURCES;
+    }
+
+    offset = end;
+    end += RECORD_SIZE;
+
+    // Write the header last, so that a record interrupted by a reset is never taken for a complete one.
+    result = controller.write(pageAddress + offset + sizeof(uint32_t), (uint32_t *) &record.pair, sizeof(KeyValuePair) / sizeof(uint32_t));
+
+    if (result != DEVICE_OK)
+        return result;
+
+    return controller.write(pageAddress + offset, &record.header, 1);
+}
+
+/**
+  * Rewrites the page to hold only the latest record of each live key.
+  */
+int MicroBitKeyValueLog::compact()
+{
+    MicroBitKeyValueRecord *live = NULL;
+    int result;
+
+    if (keys > 0)
+    {
+        live = (MicroBitKeyValueRecord *) malloc(keys * RECORD_SIZE);
+
+        if (live == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        for (int i = 0; i < keys; i++)
+            controller.read((uint32_t *) &live[i], pageAddress + index[i].offset, RECORD_SIZE / sizeof(uint32_t));
+    }
+
+    result = format();
+
+    if (result == DEVICE_OK && keys > 0)
+    {
+        result = controller.write(pageAddress + FIRST_RECORD, (uint32_t *) live, keys * RECORD_SIZE / sizeof(uint32_t));
+
+        for (int i = 0; i < keys; i++)
+            index[i].offset = FIRST_RECORD + i * RECORD_SIZE;
+
+        end = FIRST_RECORD + keys * RECORD_SIZE;
+    }
+
+    free(live);
+
+    return result;
+}
+
+/**
+  * Determines if the record at the given offset is free to be written, i.e. still erased.
+  */
+bool MicroBitKeyValueLog::isFree(uint32_t offset)
+{
+    uint32_t words[RECORD_SIZE / sizeof(uint32_t)];
+
+    controller.read(words, pageAddress + offset, RECORD_SIZE / sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < RECORD_SIZE / sizeof(uint32_t); i++)
+    {
+        if (words[i] != 0xFFFFFFFF)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+  * Converts a key into its null padded form.
+  *
+  * @return true on success, false if the key is too long.
+  */
+bool MicroBitKeyValueLog::padKey(const char *key, uint8_t *padded)
+{
+    if (key == NULL)
+        return false;
+
+    int length = strlen(key);
+
+    // Leave room for the terminator, as KeyValueStorage does.
+    if (length >= KEY_VALUE_STORAGE_KEY_SIZE)
+        return false;
+
+    memset(padded, 0, KEY_VALUE_STORAGE_KEY_SIZE);
+    memcpy(padded, key, length);
+
+    return true;
+}
+
+/**
+  * Computes the hash of a null padded key (32 bit FNV-1a).
+  */
+uint32_t MicroBitKeyValueLog::hash(const uint8_t *key)
+{
+    uint32_t h = 2166136261UL;
+
+    for (int i = 0; i < KEY_VALUE_STORAGE_KEY_SIZE; i++)
+    {
+        h ^= key[i];
+        h *= 16777619UL;
+    }
+
+    return h;
+}
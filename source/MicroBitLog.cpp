@@ -24,19 +24,338 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitLog.h"
 #include "CodalDmesg.h"
+#include "CodalFiber.h"
+#include "MicroBitHeapProfile.h"
 #include <new>
 
 #define ARRAY_LEN(array)    (sizeof(array) / sizeof(array[0]))
 
 using namespace codal;
 
-static ManagedString padString(ManagedString s, int digits)
+static int writeDecimal(char *buf, uint32_t n, int digits)
 {
-    ManagedString zero = "0";
-    while(s.length() != digits)
-        s = zero + s;
+    char digit[10];
+    int len = 0;
 
-    return s;
+    // Generate digits in reverse order, padding with leading zeroes as necessary.
+    do
+    {
+        digit[len++] = '0' + (n % 10);
+        n = n / 10;
+    } while (n > 0 || len < digits);
+
+    for (int i=0; i<len; i++)
+        buf[i] = digit[len - i - 1];
+
+    return len;
+}
+
+static int writeDecimal64(char *buf, uint64_t n, int digits)
+{
+    // Avoid 64 bit division unless the value actually needs it.
+    if (n <= 0xFFFFFFFF)
+        return writeDecimal(buf, (uint32_t) n, digits);
+
+    int len = writeDecimal(buf, (uint32_t) (n / 1000000000), digits > 9 ? digits - 9 : 1);
+    return len + writeDecimal(buf + len, (uint32_t) (n % 1000000000), 9);
+}
+
+static int writeTimeStamp(char *buf, uint64_t t, bool fraction)
+{
+    if (!fraction)
+        return writeDecimal64(buf, t, 1);
+
+    int len = writeDecimal64(buf, t / 100, 1);
+    buf[len++] = '.';
+    return len + writeDecimal(buf + len, (uint32_t) (t % 100), 2);
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/**
+ * Encode the given value as a sequence of 5 bit digits, most significant first.
+ * Each digit is in the range 0x40..0x7F, with bit 5 set on all but the last digit. The encoding therefore
+ * never contains row separators, column separators or unused memory (0xFF) values.
+ */
+static int varintLength(uint64_t v)
+{
+    int digits = 1;
+    while (digits < 13 && (v >> (5 * digits)))
+        digits++;
+
+    return digits;
+}
+
+static int writeVarint(uint8_t *buf, uint64_t v)
+{
+    int digits = varintLength(v);
+
+    for (int i=0; i<digits; i++)
+        buf[i] = MICROBIT_LOG_RECORD_DIGIT | ((v >> (5 * (digits - i - 1))) & 0x1F) | (i + 1 < digits ? MICROBIT_LOG_RECORD_DIGIT_MORE : 0);
+
+    return digits;
+}
+
+/**
+ * Parse a value that can be represented exactly in a binary record.
+ * Only canonical decimal forms are accepted (no leading zeroes, no leading '+', no negative zero),
+ * such that expanding the binary form yields exactly the original text.
+ *
+ * @return true if the value can be represented, false otherwise.
+ */
+static bool parseValue(const char *s, int len, int32_t &value, int &decimals)
+{
+    int i = 0;
+    int digits = 0;
+    bool negative = false;
+    int64_t v = 0;
+
+    decimals = -1;
+
+    if (len > 0 && s[0] == '-')
+    {
+        negative = true;
+        i++;
+    }
+
+    // Reject empty values, leading zeroes and leading '.'
+    if (i == len || s[i] == '.' || (s[i] == '0' && i + 1 < len && s[i+1] != '.'))
+        return false;
+
+    for (; i<len; i++)
+    {
+        if (s[i] == '.' && decimals < 0)
+        {
+            decimals = 0;
+            continue;
+        }
+
+        if (s[i] < '0' || s[i] > '9' || ++digits > 9)
+            return false;
+
+        v = v * 10 + (s[i] - '0');
+
+        if (decimals >= 0)
+            decimals++;
+    }
+
+    // Trailing '.' can't be represented.
+    if (decimals == 0 || (negative && v == 0))
+        return false;
+
+    if (decimals < 0)
+        decimals = 0;
+
+    value = negative ? -v : v;
+    return true;
+}
+
+static const uint32_t powersOfTen[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+/**
+ * Constructor.
+ * Creates an empty cursor. Use MicroBitLog::getRowCursor() to obtain a cursor over a log.
+ */
+LogCursor::LogCursor()
+{
+    log = NULL;
+    generation = 0;
+    address = 0;
+    start = 0;
+    end = 0;
+    decode = false;
+    pendingLength = 0;
+    pendingPosition = 0;
+    decoder.reset();
+}
+
+/**
+ * Read the next chunk of data from the log.
+ *
+ * @param buffer the buffer to fill.
+ * @param len the maximum number of bytes to read.
+ * @return the number of bytes read, zero if no more data is available, or DEVICE_INVALID_STATE if the cursor is no longer valid.
+ */
+int LogCursor::next(void *buffer, uint32_t len)
+{
+    if (log == NULL)
+        return 0;
+
+    return log->readCursor(*this, (uint8_t *) buffer, len);
+}
+
+/**
+ * Reset the decoder, ready to decode from the start of a row.
+ */
+void MicroBitLogDecoder::reset()
+{
+    record = false;
+    lineStart = true;
+    field = 0;
+    type = 0;
+    value = 0;
+    timeStamp = 0;
+    interval = 0;
+    timeColumn = -1;
+    timeFraction = false;
+    valid = 0;
+}
+
+/**
+ * Record the value just decoded for the given column, and expand it to CSV text.
+ */
+int MicroBitLogDecoder::expandValue(uint32_t column, int64_t v, int places, char *out)
+{
+    int len = 0;
+
+    if (column < CONFIG_MICROBIT_LOG_DELTA_COLUMNS)
+    {
+        valid |= 1UL << column;
+        values[column] = (int32_t) v;
+        decimals[column] = places;
+    }
+
+    if (v < 0)
+    {
+        out[len++] = '-';
+        v = -v;
+    }
+
+    len += writeDecimal(out + len, (uint32_t) (v / powersOfTen[places]), 1);
+
+    if (places)
+    {
+        out[len++] = '.';
+        len += writeDecimal(out + len, (uint32_t) (v % powersOfTen[places]), places);
+    }
+
+    return len;
+}
+
+/**
+ * Decode a single byte of stored log data, generating the equivalent CSV text.
+ *
+ * @param b the next byte of stored data.
+ * @param out a buffer of at least MICROBIT_LOG_DECODE_MAX_LENGTH bytes, into which any CSV text is written.
+ * @return the number of bytes of CSV text generated.
+ */
+int MicroBitLogDecoder::decode(uint8_t b, char *out)
+{
+    int len = 0;
+
+    if (!record)
+    {
+        if (lineStart && b == MICROBIT_LOG_RECORD_START)
+        {
+            record = true;
+            field = 0;
+            type = 0;
+            value = 0;
+            return 0;
+        }
+
+        lineStart = (b == '\n');
+        out[0] = b;
+        return 1;
+    }
+
+    if (b == '\n')
+    {
+        record = false;
+        lineStart = true;
+        out[0] = b;
+        return 1;
+    }
+
+    if (b == MICROBIT_LOG_RECORD_EMPTY)
+    {
+        if (field++)
+            out[len++] = ',';
+
+        return len;
+    }
+
+    if ((b & 0xC0) == MICROBIT_LOG_RECORD_SMALL_DELTA)
+    {
+        uint32_t column = field;
+        int64_t change = unzigzag(b & (MICROBIT_LOG_RECORD_SMALL_DELTA_RANGE - 1));
+
+        if (field++)
+            out[len++] = ',';
+
+        // The encoder only uses small deltas against state it knows we hold, so these tests always pass for a well formed record.
+        if ((int32_t) column == timeColumn)
+        {
+            interval += change;
+            timeStamp += interval;
+            len += writeTimeStamp(out + len, timeStamp, timeFraction);
+        }
+        else if (column < CONFIG_MICROBIT_LOG_DELTA_COLUMNS && (valid & (1UL << column)))
+        {
+            len += expandValue(column, values[column] + change, decimals[column], out + len);
+        }
+
+        return len;
+    }
+
+    if ((b & 0xC0) != MICROBIT_LOG_RECORD_DIGIT)
+    {
+        // A type marker, applying to the next value.
+        type = b;
+        return 0;
+    }
+
+    value = (value << 5) | (b & 0x1F);
+    if (b & MICROBIT_LOG_RECORD_DIGIT_MORE)
+        return 0;
+
+    // We have a complete value. Expand it according to its type.
+    uint32_t column = field;
+
+    if (field++)
+        out[len++] = ',';
+
+    if (type >= MICROBIT_LOG_RECORD_TIME && type <= MICROBIT_LOG_RECORD_TIME_DELTA_FRACTION)
+    {
+        bool delta = type >= MICROBIT_LOG_RECORD_TIME_DELTA;
+
+        if (delta)
+        {
+            interval = unzigzag(value);
+            timeStamp += interval;
+        }
+        else
+        {
+            timeStamp = value;
+        }
+
+        timeColumn = column;
+        timeFraction = type == MICROBIT_LOG_RECORD_TIME_FRACTION || type == MICROBIT_LOG_RECORD_TIME_DELTA_FRACTION;
+        len += writeTimeStamp(out + len, timeStamp, timeFraction);
+    }
+    else if (type == MICROBIT_LOG_RECORD_DELTA)
+    {
+        if (column < CONFIG_MICROBIT_LOG_DELTA_COLUMNS && (valid & (1UL << column)))
+            len += expandValue(column, values[column] + unzigzag(value), decimals[column], out + len);
+    }
+    else
+    {
+        int places = type > MICROBIT_LOG_RECORD_FIXED && type <= MICROBIT_LOG_RECORD_FIXED + 9 ? type - MICROBIT_LOG_RECORD_FIXED : 0;
+        len += expandValue(column, unzigzag(value), places, out + len);
+    }
+
+    type = 0;
+    value = 0;
+
+    return len;
 }
 
 static void writeNum(char *buf, uint32_t n)
@@ -55,10 +374,10 @@ static void writeNum(char *buf, uint32_t n)
 /**
  * Constructor.
  */
-MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, MicroBitPowerManager &power, NRF52Serial &serial) : flash(flash), power(power), serial(serial), cache(flash, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE, 4)
+MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, MicroBitPowerManager &power, NRF52Serial &serial) : CodalComponent(MICROBIT_ID_LOG, 0), flash(flash), power(power), serial(serial), cache(flash, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE, 4)
 {
     this->journalPages = 0;
-    this->status = 0;
+    this->logStatus = 0;
     this->journalHead = 0;
     this->startAddress = 0;
     this->journalStart = 0;
@@ -71,6 +390,29 @@ MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, MicroBitPowerManager &p
     this->timeStampChanged = false;
     this->rowData = NULL;
     this->timeStampFormat = TimeStampFormat::None;
+    this->rowIndex = NULL;
+    this->writeBuffer = NULL;
+    this->writeBufferLength = 0;
+    this->flushTimeout = CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT;
+    this->powerCheckTime = 0;
+    this->rowBuffer = NULL;
+    this->rowBufferSize = 0;
+    this->lastColumn = 0;
+    this->columnHandles = NULL;
+    this->columnHandleCount = 0;
+    this->dataHead = 0;
+    this->eraseAddress = 0;
+    this->eraseEnd = 0;
+    this->generation = 0;
+    this->mirrorBuffer = NULL;
+    this->mirrorHead = 0;
+    this->mirrorTail = 0;
+    this->mirrorDropped = 0;
+    resetRowIndex();
+
+    // Coalesce writes to each cache block. Modified data is written back when a journal entry is committed,
+    // or CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT milliseconds after it was first written.
+    cache.setWriteBack(true);
 }
 
 /**
@@ -79,9 +421,17 @@ MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, MicroBitPowerManager &p
 void MicroBitLog::init()
 {
     // If we're already initialized, do nothing. 
-    if (status & MICROBIT_LOG_STATUS_INITIALIZED)
+    if (logStatus & MICROBIT_LOG_STATUS_INITIALIZED)
         return;
 
+    // Listen for deferred flush requests. n.b. duplicate listeners are ignored by the message bus.
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_FLUSH, this, &MicroBitLog::onFlushEvent);
+
+    // Allocate the cache's page buffers in one contiguous block, so later cache misses never need the heap.
+    // n.b. if this fails, the cache falls back to allocating page buffers as needed.
+    cache.reserve();
+
     if (_isPresent())
     {
         // We have a valid file system.
@@ -91,18 +441,42 @@ void MicroBitLog::init()
         dataEnd = dataStart;
 
         // Load the last entry in the journal.
-        uint32_t journalEntryAddress = journalHead;
+        // Journal pages are filled sequentially after being erased, so each page holds zero or more used entries followed by
+        // unused (0xFF) entries. We can therefore locate the last used entry in each page by binary search, rather than reading
+        // every entry in the journal.
+        uint32_t entriesPerPage = flash.getPageSize() / MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
         bool valid = false;
 
-        while(journalEntryAddress < dataStart)
+        for (uint32_t page = journalStart; page < dataStart; page += flash.getPageSize())
         {
-            cache.read(journalEntryAddress, j.length, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+            uint32_t low = 0;
+            uint32_t high = entriesPerPage;
 
-            // If we have a valid reading follwed by an unused entry, we're done.
-            if (j.containsOnly(0xFF) && valid)
-                break;
+            while (low < high)
+            {
+                uint32_t mid = (low + high) / 2;
+                cache.read(page + mid * MICROBIT_LOG_JOURNAL_ENTRY_SIZE, j.length, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+
+                if (j.containsOnly(0xFF))
+                    high = mid;
+                else
+                    low = mid + 1;
+            }
+
+            // This page holds no used entries. If an earlier page held a valid entry, that was the last one written, so we're done.
+            // Otherwise, carry on searching the following pages.
+            if (low == 0)
+            {
+                if (valid)
+                    break;
+
+                continue;
+            }
+
+            // Parse the last used entry in this page, if it is valid.
+            uint32_t journalEntryAddress = page + (low - 1) * MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
+            cache.read(journalEntryAddress, j.length, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
 
-            // Parse valid entries. We continue processing to the last valid entry, just in case.
             if (!j.containsOnly(0x00))
             {
                 journalHead = journalEntryAddress;
@@ -110,20 +484,37 @@ void MicroBitLog::init()
                 valid = true;
             }
 
-            journalEntryAddress += MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
+            if (valid && low < entriesPerPage)
+                break;
         }
 
+        // Data beyond the end of the physical log can only have been written in ring mode.
+        if (dataEnd > logEnd)
+            logStatus |= MICROBIT_LOG_STATUS_RING;
+
         // Walk the page indicated by dataEnd, and increment until an unused byte (0xFF) is found.
-        uint8_t d = 0;
-        while(dataEnd < logEnd)
+        // n.b. a ring log always maintains an erased page ahead of the write head.
+        uint8_t d[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+        uint32_t scanEnd = (logStatus & MICROBIT_LOG_STATUS_RING) ? dataEnd + getRingSize() : logEnd;
+        bool found = false;
+        while(dataEnd < scanEnd && !found)
         {
-            cache.read(dataEnd, &d, 1);
-            if (d == 0xFF)
-                break;
+            uint32_t l = min(scanEnd - dataEnd, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+            readLog(dataEnd, d, l);
 
-            dataEnd++;
+            for (uint32_t i=0; i<l && !found; i++)
+            {
+                if (d[i] == 0xFF)
+                    found = true;
+                else
+                    dataEnd++;
+            }
         }
 
+        // Determine the oldest data that remains in the log.
+        dataHead = dataStart;
+        updateDataHead();
+
         // Determine if we have any column headers defined
         // If so, parse them.
         uint32_t start = startAddress + sizeof(MicroBitLogMetaData);
@@ -154,6 +545,7 @@ void MicroBitLog::init()
             headingCount = 0;
 
             char *headers = (char *) malloc(headingLength);
+            MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, headers, headingLength);
             cache.read(start, headers, headingLength);
 
             // Count the number of comma separated headers.
@@ -169,6 +561,7 @@ void MicroBitLog::init()
 
             // Allocate a RAM buffer to hold key/value pairs matching those defined
             rowData = (ColumnEntry *) malloc(sizeof(ColumnEntry) * headingCount);
+            MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, rowData, sizeof(ColumnEntry) * headingCount);
 
             // Populate each entry.
             int i=0;
@@ -179,11 +572,15 @@ void MicroBitLog::init()
                 i = i + rowData[h].key.length() + 1;
             }
 
+            MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, headers);
             free(headers);
         }
 
+        // The row index is rebuilt lazily, the first time it is needed.
+        resetRowIndex();
+
         // We may be full here, but this is still a valid state.
-        status |= MICROBIT_LOG_STATUS_INITIALIZED;
+        logStatus |= MICROBIT_LOG_STATUS_INITIALIZED;
         return;
     }
     else
@@ -219,6 +616,9 @@ void MicroBitLog::_setVisibility(bool visible)
 {
     MicroBitUSBFlashConfig config, currentConfig;
 
+    // Ensure everything written so far is visible to the host after any remount.
+    cache.flush();
+
     config.fileName = "MY_DATA.HTM";
     config.fileSize = flash.getFlashEnd() - flash.getFlashStart();
     config.visible = visible;
@@ -236,17 +636,17 @@ void MicroBitLog::_setVisibility(bool visible)
 /**
  * Reset all data stored in persistent storage.
  */
-void MicroBitLog::clear(bool fullErase)
+void MicroBitLog::clear(bool fullErase, bool background)
 {
     mutex.wait();
-    _clear(fullErase);
+    _clear(fullErase, background);
     mutex.notify();
 }
 
 /**
  * Reset all data stored in persistent storage.
  */
-void MicroBitLog::_clear(bool fullErase)
+void MicroBitLog::_clear(bool fullErase, bool background)
 {
     // Calculate where our metadata should start.
     startAddress = sizeof(header);
@@ -255,8 +655,9 @@ void MicroBitLog::_clear(bool fullErase)
     journalHead = journalStart;
     dataStart = journalStart + CONFIG_MICROBIT_LOG_JOURNAL_SIZE;
     dataEnd = dataStart;
+    dataHead = dataStart;
     logEnd = flash.getFlashEnd() - sizeof(uint32_t);
-    status &= MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+    logStatus &= (MICROBIT_LOG_STATUS_SERIAL_MIRROR | MICROBIT_LOG_STATUS_BUFFERED | MICROBIT_LOG_STATUS_BINARY | MICROBIT_LOG_STATUS_COMPRESSED | MICROBIT_LOG_STATUS_RING | MICROBIT_LOG_STATUS_ERASING | MICROBIT_LOG_STATUS_POWER_AWARE | MICROBIT_LOG_STATUS_POWER_LOW);
     
     // Remove any cached state around column headings
     headingsChanged = false;
@@ -267,19 +668,39 @@ void MicroBitLog::_clear(bool fullErase)
 
     if (rowData)
     {
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rowData);
         free(rowData);
         rowData = NULL;
     }
 
+    // The log is now empty, so any existing row index, cursor or buffered data is no longer valid.
+    resetRowIndex();
+    writeBufferLength = 0;
+    generation++;
+
     // Erase block associated with the FULL indicator. We don't perform a pag eerase here to reduce flash wear.
     uint32_t zero = 0x00000000;
     flash.write(logEnd, &zero, 1);
 
     // Erase all pages associated with the header, all meta data and the first page of data storage.
+    // If a background erase has been requested, the remaining pages are erased later.
     cache.clear();
-    for (uint32_t p = flash.getFlashStart(); p <= (fullErase ? logEnd : dataStart); p += flash.getPageSize())
+    for (uint32_t p = flash.getFlashStart(); p <= (fullErase && !background ? logEnd : dataStart); p += flash.getPageSize())
         flash.erase(p);
 
+    if (fullErase)
+    {
+        // Schedule the remaining pages for erasure, or cancel any background erase in progress if we have just erased them all.
+        eraseAddress = background ? dataStart + flash.getPageSize() : logEnd + 1;
+        eraseEnd = logEnd;
+
+        if (background && !(logStatus & MICROBIT_LOG_STATUS_ERASING))
+        {
+            logStatus |= MICROBIT_LOG_STATUS_ERASING;
+            create_fiber(MicroBitLog::eraseTask, this);
+        }
+    }
+
     // Serialise and write header (if we have one)
     // n.b. we use flash.write() here to avoid unecessary preheating of the cache.
     flash.write(flash.getFlashStart(), (uint32_t *)header, sizeof(header)/4);
@@ -291,8 +712,7 @@ void MicroBitLog::_clear(bool fullErase)
     memcpy(metaData.daplinkVersion, "0000\0", 5);
 
     MicroBitVersion versions = power.getVersion();
-    ManagedString verStr = padString(versions.daplink > 9999 ? 9999 : versions.daplink, 4);
-    memcpy(metaData.daplinkVersion, verStr.toCharArray(), 4);
+    writeDecimal(metaData.daplinkVersion, versions.daplink > 9999 ? 9999 : versions.daplink, 4);
     writeNum(metaData.dataStart+2, dataStart);
     writeNum(metaData.logEnd+2, logEnd);
 
@@ -306,7 +726,7 @@ void MicroBitLog::_clear(bool fullErase)
     // If we're doing a full erase, remove the file from view.
     _setVisibility(!fullErase);
 
-    status |= MICROBIT_LOG_STATUS_INITIALIZED;
+    logStatus |= MICROBIT_LOG_STATUS_INITIALIZED;
 
     // Refresh timestamp settings, to inject the timestamp field into the key value pairs.
     _setTimeStamp(this->timeStampFormat);
@@ -374,7 +794,7 @@ void MicroBitLog::_setTimeStamp(TimeStampFormat format)
 
     // Special case for selecting timestamp headings before the first data is logged.
     // Here, we permit rewriting of Timestamp columns to promote simplicity.
-    if (dataStart == dataEnd && headingCount > 0)
+    if (dataStart == dataEnd && writeBufferLength == 0 && headingCount > 0)
     {
         // If this timestamp has already been added. If so, nothing to do.
         if (rowData[0].key == timeStampHeading)
@@ -406,125 +826,709 @@ void MicroBitLog::_setTimeStamp(TimeStampFormat format)
 void MicroBitLog::setSerialMirroring(bool enable)
 {
     if (enable)
-        status |= MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+    {
+        if (mirrorBuffer == NULL)
+        {
+            mirrorBuffer = (uint8_t *) malloc(CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE);
+            MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, mirrorBuffer, CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE);
+        }
+
+        // Enable periodic callbacks, used to drain the mirror buffer.
+        status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+        logStatus |= MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+    }
     else
-        status &= ~MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+    {
+        // Any output already queued continues to be sent.
+        logStatus &= ~MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+    }
 }
 
 /**
- * Creates a new row in the log, ready to be populated by logData()
- * 
- * @return DEVICE_OK on success.
+ * Determines the number of rows that could not be mirrored to the serial port, as the mirror buffer was full.
+ *
+ * @return the number of rows dropped since the device started.
  */
-int MicroBitLog::beginRow()
+uint32_t MicroBitLog::getMirrorOverflowCount()
 {
-    int r;
+    return mirrorDropped;
+}
 
-    mutex.wait();
-    r = _beginRow();
-    mutex.notify();
+/**
+ * Queue the given row of text for mirroring to the serial port.
+ *
+ * @param text the row of text, including its trailing newline.
+ * @param len the length of the text.
+ */
+void MicroBitLog::mirror(const char *text, uint32_t len)
+{
+    // Rows are sent with a CRLF terminator, in place of the stored newline.
+    uint32_t l = len + 1;
+    uint32_t used = (mirrorHead + CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE - mirrorTail) % CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE;
 
-    return r;
-}
+    // Only queue whole rows. One byte of the ring is always left unused, to distinguish a full buffer from an empty one.
+    if (mirrorBuffer == NULL || used + l >= CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE)
+    {
+        mirrorDropped++;
+        return;
+    }
 
+    for (uint32_t i=0; i<l; i++)
+    {
+        mirrorBuffer[mirrorHead] = i < len - 1 ? text[i] : (i == len - 1 ? '\r' : '\n');
+        mirrorHead = (mirrorHead + 1) % CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE;
+    }
+
+    drainMirror();
+}
 
 /**
- * Creates a new row in the log, ready to be populated by logData()
- * 
- * @return DEVICE_OK on success.
+ * Send as much queued mirror output as the serial port can accept, without blocking.
  */
-int MicroBitLog::_beginRow()
+void MicroBitLog::drainMirror()
 {
-    init();
-
-    // If beginRow is called during an open transaction, implicity perform an endRow before proceeding.
-    if (status & MICROBIT_LOG_STATUS_ROW_STARTED)
-        _endRow();
+    while (mirrorTail != mirrorHead)
+    {
+        uint32_t l = (mirrorHead > mirrorTail ? mirrorHead : CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE) - mirrorTail;
+        int sent = serial.send(&mirrorBuffer[mirrorTail], l, ASYNC);
 
-    // Reset all values, ready to populate with a new row.
-    for (uint32_t i=0; i<headingCount; i++)
-        rowData[i].value = ManagedString();
+        if (sent <= 0)
+            return;
 
-    // indicate that we've started a new row.
-    status |= MICROBIT_LOG_STATUS_ROW_STARTED;
+        mirrorTail = (mirrorTail + sent) % CONFIG_MICROBIT_LOG_MIRROR_BUFFER_SIZE;
 
-    return DEVICE_OK;
+        if ((uint32_t) sent < l)
+            return;
+    }
 }
 
 /**
- * Populates the current row with the given key/value pair.
- * @param key the name of the key column) to set.
- * @param value the value to insert 
- * 
- * @return DEVICE_OK on success.
+ * Periodic callback from the scheduler, used to send any queued serial mirror output.
  */
-int MicroBitLog::logData(const char *key, const char *value)
+void MicroBitLog::idleCallback()
 {
-    return logData(ManagedString(key), ManagedString(value));
+    drainMirror();
 }
 
 /**
- * Populates the current row with the given key/value pair.
- * @param key the name of the key column) to set.
- * @param value the value to insert 
+ * Defines if rows should be stored as compact binary records, rather than CSV text.
  *
- * @return DEVICE_OK on success.
+ * @param enable True to enable binary records, false to disable.
  */
-int MicroBitLog::logData(ManagedString key, ManagedString value)
+void MicroBitLog::setBinaryFormat(bool enable)
 {
-    int r;
-
-    mutex.wait();
-    r = _logData(key, value);
-    mutex.notify();
-
-    return r;
+    if (enable)
+        logStatus |= MICROBIT_LOG_STATUS_BINARY;
+    else
+        logStatus &= ~(MICROBIT_LOG_STATUS_BINARY | MICROBIT_LOG_STATUS_COMPRESSED);
 }
 
 /**
- * Populates the current row with the given key/value pair.
- * @param key the name of the key column) to set.
- * @param value the value to insert 
+ * Defines if binary records should be compressed, by storing values that repeat, or differ only a little from,
+ * the previous value in the same column as a repeat marker or a small delta. Enabling compression also enables binary records.
  *
- * @return DEVICE_OK on success.
+ * @param enable True to enable compression, false to disable.
  */
-int MicroBitLog::_logData(ManagedString key, ManagedString value)
+void MicroBitLog::setCompression(bool enable)
 {
-    // Perform lazy instatiation if necessary.
-    init();
+    if (enable)
+        logStatus |= MICROBIT_LOG_STATUS_BINARY | MICROBIT_LOG_STATUS_COMPRESSED;
+    else
+        logStatus &= ~MICROBIT_LOG_STATUS_COMPRESSED;
+}
 
-    // If logData is called before explicitly beginning a row, do so implicitly.
-    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED))
-        _beginRow();
+/**
+ * Defines if logged data should be buffered in RAM before being committed to persistent storage.
+ * When enabled, rows are accumulated and committed as a single block aligned write with a single
+ * journal entry. This greatly increases sustained throughput, and reduces flash wear.
+ *
+ * @param enable True to enable buffering, false to disable. Any buffered data is committed when buffering is disabled.
+ */
+void MicroBitLog::setBuffered(bool enable)
+{
+    mutex.wait();
 
-    ManagedString k = cleanBuffer(key.toCharArray(), key.length());
-    ManagedString v = cleanBuffer(value.toCharArray(), value.length());
+    if (enable && !(logStatus & MICROBIT_LOG_STATUS_BUFFERED))
+    {
+        if (writeBuffer == NULL)
+        {
+            writeBuffer = (uint8_t *) malloc(CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
+            MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, writeBuffer, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
+        }
 
-    if (k.length())
-        key = k;
+        logStatus |= MICROBIT_LOG_STATUS_BUFFERED;
+    }
+
+    if (!enable && (logStatus & MICROBIT_LOG_STATUS_BUFFERED))
+    {
+        _flush();
+
+        logStatus &= ~MICROBIT_LOG_STATUS_BUFFERED;
+    }
+
+    mutex.notify();
+}
+
+/**
+ * Defines if buffering should adapt to the state of the power supply, trading throughput for durability only when needed.
+ *
+ * @param enable True to enable power aware buffering, false to use a fixed CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT.
+ */
+void MicroBitLog::setPowerAware(bool enable)
+{
+    mutex.wait();
+
+    if (enable && !(logStatus & MICROBIT_LOG_STATUS_POWER_AWARE))
+    {
+        logStatus |= MICROBIT_LOG_STATUS_POWER_AWARE;
+        logStatus &= ~MICROBIT_LOG_STATUS_POWER_LOW;
+
+        // Check the supply when the next row is written.
+        powerCheckTime = 0;
+        flushTimeout = CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT;
+    }
+
+    if (!enable && (logStatus & MICROBIT_LOG_STATUS_POWER_AWARE))
+    {
+        logStatus &= ~(MICROBIT_LOG_STATUS_POWER_AWARE | MICROBIT_LOG_STATUS_POWER_LOW);
+        flushTimeout = CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT;
+    }
+
+    mutex.notify();
+}
+
+/**
+ * Determines if the battery was low when the supply was last checked by power aware buffering.
+ *
+ * @return true if each row is being committed as it is written, because the battery is low.
+ */
+bool MicroBitLog::isPowerLow()
+{
+    return logStatus & MICROBIT_LOG_STATUS_POWER_LOW;
+}
+
+/**
+ * Checks the power supply, if it has not been checked recently, and adapts buffering to it.
+ * If the battery has become low, anything buffered is committed at once.
+ */
+void MicroBitLog::checkPower()
+{
+    CODAL_TIMESTAMP now = system_timer_current_time();
+
+    if (powerCheckTime && now - powerCheckTime < CONFIG_MICROBIT_LOG_POWER_CHECK_PERIOD)
+        return;
+
+    powerCheckTime = now ? now : 1;
+
+    // Only the battery can fail beneath us. While USB is connected, the interface chip supplies the board.
+    bool low = false;
+
+    if (power.getPowerSource() == PWR_BATT_ONLY)
+    {
+        uint32_t threshold = CONFIG_MICROBIT_LOG_LOW_BATTERY;
+
+        if (logStatus & MICROBIT_LOG_STATUS_POWER_LOW)
+            threshold += CONFIG_MICROBIT_LOG_LOW_BATTERY_HYSTERESIS;
+
+        low = power.getPowerData().batteryMicroVolts < threshold;
+    }
+
+    if (low == !!(logStatus & MICROBIT_LOG_STATUS_POWER_LOW))
+        return;
+
+    if (low)
+    {
+        logStatus |= MICROBIT_LOG_STATUS_POWER_LOW;
+        flushTimeout = CONFIG_MICROBIT_LOG_FLUSH_TIMEOUT;
+
+        _flush();
+        Event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_LOW_POWER);
+    }
+    else
+    {
+        logStatus &= ~MICROBIT_LOG_STATUS_POWER_LOW;
+        flushTimeout = CONFIG_MICROBIT_LOG_HEALTHY_FLUSH_TIMEOUT;
+    }
+}
+
+/**
+ * Commits any data held in the RAM write buffer to persistent storage.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::flush()
+{
+    int r;
+
+    mutex.wait();
+    r = _flush();
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Commits any data held in the RAM write buffer to persistent storage.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::_flush()
+{
+    int r = DEVICE_OK;
+
+    if (writeBufferLength)
+    {
+        uint32_t l = writeBufferLength;
+        writeBufferLength = 0;
+
+        r = _commit((const char *)writeBuffer, l);
+    }
+
+    // Write back anything held in the cache, and any write the flash manager is holding back.
+    cache.flush();
+    flash.flush();
+
+    return r;
+}
+
+/**
+ * Defines if the log should operate as a ring buffer.
+ *
+ * @param enable True to enable ring mode, false to disable.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if the data already stored cannot be interpreted in the requested mode.
+ */
+int MicroBitLog::setRingMode(bool enable)
+{
+    int r = DEVICE_OK;
+
+    mutex.wait();
+
+    // Once data has been stored beyond the whole pages of the data region, its location depends upon the mode it was written in.
+    bool ambiguous = (logStatus & MICROBIT_LOG_STATUS_INITIALIZED) && dataEnd > dataStart + getRingSize();
+
+    if (enable != !!(logStatus & MICROBIT_LOG_STATUS_RING))
+    {
+        if (ambiguous)
+        {
+            r = DEVICE_INVALID_STATE;
+        }
+        else
+        {
+            if (enable)
+                logStatus |= MICROBIT_LOG_STATUS_RING;
+            else
+                logStatus &= ~MICROBIT_LOG_STATUS_RING;
+        }
+    }
+
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Erase the pages scheduled for a background erase, one page at a time.
+ * Runs in its own fiber, started by _clear().
+ *
+ * @param log the MicroBitLog instance to erase.
+ */
+void MicroBitLog::eraseTask(void *log)
+{
+    MicroBitLog *l = (MicroBitLog *) log;
+    uint32_t pageSize = l->flash.getPageSize();
+
+    l->mutex.wait();
+
+    while (l->eraseAddress <= l->eraseEnd)
+    {
+        // Pages up to and including the one holding the write head have already been erased by the writer before use.
+        l->eraseAddress = max(l->eraseAddress, ((l->dataEnd / pageSize) + 1) * pageSize);
+
+        if (l->eraseAddress > l->eraseEnd)
+            break;
+
+        l->flash.erase(l->eraseAddress);
+        l->eraseAddress += pageSize;
+
+        // Give other fibers (including any waiting to log data) an opportunity to run between pages.
+        l->mutex.notify();
+        schedule();
+        l->mutex.wait();
+    }
+
+    l->logStatus &= ~MICROBIT_LOG_STATUS_ERASING;
+    l->mutex.notify();
+
+    Event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_ERASE_COMPLETE);
+}
+
+/**
+ * Schedules a commit of buffered and cached data, flushTimeout milliseconds from now, replacing any already scheduled.
+ */
+void MicroBitLog::scheduleFlush()
+{
+    // A flush already scheduled may be about to fire, and there's no need for more than one.
+    system_timer_cancel_event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_FLUSH);
+    system_timer_event_after(flushTimeout, MICROBIT_ID_LOG, MICROBIT_LOG_EVT_FLUSH);
+}
+
+/**
+ * Event handler, used to commit buffered and cached data following a timeout.
+ */
+void MicroBitLog::onFlushEvent(Event)
+{
+    flush();
+}
+
+/**
+ * Perform functions related to deep sleep.
+ * Any buffered or cached data is committed to persistent storage before the device enters deep sleep.
+ */
+int MicroBitLog::deepSleepCallback(deepSleepCallbackReason reason, deepSleepCallbackData *data)
+{
+    // We are called in the context of the fiber requesting deep sleep, so it is safe to block here.
+    // Flush even if the write buffer is empty, as committed rows may still be held in the write back cache, or by the flash manager.
+    if (reason == deepSleepCallbackPrepare)
+        flush();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Creates a new row in the log, ready to be populated by logData()
+ * 
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::beginRow()
+{
+    int r;
+
+    mutex.wait();
+    r = _beginRow();
+    mutex.notify();
+
+    return r;
+}
+
+
+/**
+ * Creates a new row in the log, ready to be populated by logData()
+ * 
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::_beginRow()
+{
+    init();
+
+    // If beginRow is called during an open transaction, implicity perform an endRow before proceeding.
+    if (logStatus & MICROBIT_LOG_STATUS_ROW_STARTED)
+        _endRow();
+
+    // Reset all values, ready to populate with a new row.
+    for (uint32_t i=0; i<headingCount; i++)
+        rowData[i].value = ManagedString();
+
+    // indicate that we've started a new row.
+    logStatus |= MICROBIT_LOG_STATUS_ROW_STARTED;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert 
+ * 
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::logData(const char *key, const char *value)
+{
+    return logData(ManagedString(key), ManagedString(value));
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert 
+ *
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::logData(ManagedString key, ManagedString value)
+{
+    int r;
+
+    mutex.wait();
+    r = _logData(key, value);
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert 
+ *
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::_logData(ManagedString key, ManagedString value)
+{
+    // Perform lazy instatiation if necessary.
+    init();
+
+    // If logData is called before explicitly beginning a row, do so implicitly.
+    if (!(logStatus & MICROBIT_LOG_STATUS_ROW_STARTED))
+        _beginRow();
+
+    ManagedString v = cleanBuffer(value.toCharArray(), value.length());
 
     if (v.length())
         value = v;
 
-    // Add the given key/value pair into our cumulative row data. 
-    bool added = false;
-    for (uint32_t i=0; i<headingCount; i++)
+    // Stored headings are always clean, so we only need to clean the key if it doesn't match as given.
+    int column = findColumn(key);
+
+    if (column < 0)
     {
-        if(rowData[i].key == key)
+        ManagedString k = cleanBuffer(key.toCharArray(), key.length());
+
+        if (k.length())
         {
-            rowData[i].value = value;
-            added = true;
-            break;
+            key = k;
+            column = findColumn(key);
         }
     }
 
+    // Add the given key/value pair into our cumulative row data. 
     // If the requested heading is not available, add it.
-    if (!added)
+    if (column >= 0)
+        rowData[column].value = value;
+    else
         addHeading(key, value);
 
     return DEVICE_OK;
 }
 
+/**
+ * Obtains a handle for the given column, which can be used to efficiently log data via logData(int, ManagedString).
+ * If the column does not yet exist, it is created.
+ *
+ * @param key the name of the column.
+ * @return a non-negative handle for the column.
+ */
+int MicroBitLog::getColumnHandle(ManagedString key)
+{
+    int r;
+
+    mutex.wait();
+    r = _getColumnHandle(key);
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Obtains a handle for the given column, which can be used to efficiently log data via logData(int, ManagedString).
+ * If the column does not yet exist, it is created.
+ *
+ * @param key the name of the column.
+ * @return a non-negative handle for the column.
+ */
+int MicroBitLog::_getColumnHandle(ManagedString key)
+{
+    init();
+
+    ManagedString k = cleanBuffer(key.toCharArray(), key.length());
+    if (k.length())
+        key = k;
+
+    int column = findColumn(key);
+    if (column < 0)
+    {
+        addHeading(key, ManagedString::EmptyString);
+        column = findColumn(key);
+    }
+
+    // Reuse any existing handle for this column.
+    for (uint32_t h=0; h<columnHandleCount; h++)
+        if (columnHandles[h].key == key)
+            return h;
+
+    ColumnHandle *newHandles = (ColumnHandle *) malloc(sizeof(ColumnHandle) * (columnHandleCount+1));
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, newHandles, sizeof(ColumnHandle) * (columnHandleCount+1));
+
+    for (uint32_t h=0; h<columnHandleCount; h++)
+    {
+        new (&newHandles[h]) ColumnHandle;
+        newHandles[h].key = columnHandles[h].key;
+        newHandles[h].column = columnHandles[h].column;
+        columnHandles[h].key = ManagedString::EmptyString;
+    }
+
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, columnHandles);
+    if (columnHandles)
+        free(columnHandles);
+
+    // Share the stored heading, so that the handle can later be validated by reference.
+    new (&newHandles[columnHandleCount]) ColumnHandle;
+    newHandles[columnHandleCount].key = rowData[column].key;
+    newHandles[columnHandleCount].column = column;
+
+    columnHandles = newHandles;
+
+    return columnHandleCount++;
+}
+
+/**
+ * Populates the current row with the given value, in the column identified by the given handle.
+ * @param columnHandle a handle previously obtained from getColumnHandle().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the handle is not valid.
+ */
+int MicroBitLog::logData(int columnHandle, ManagedString value)
+{
+    int r;
+
+    mutex.wait();
+    r = _logData(columnHandle, value);
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Populates the current row with the given value, in the column identified by the given handle.
+ * @param columnHandle a handle previously obtained from getColumnHandle().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the handle is not valid.
+ */
+int MicroBitLog::_logData(int columnHandle, ManagedString value)
+{
+    if (columnHandle < 0 || columnHandle >= (int)columnHandleCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    init();
+
+    if (!(logStatus & MICROBIT_LOG_STATUS_ROW_STARTED))
+        _beginRow();
+
+    int column = _findColumn(columnHandle);
+
+    ManagedString v = cleanBuffer(value.toCharArray(), value.length());
+    rowData[column].value = v.length() ? v : value;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the column index currently identified by the given handle, adding the column again if it has been lost.
+ *
+ * @param columnHandle a valid handle previously obtained from getColumnHandle().
+ * @return the index of the column.
+ */
+int MicroBitLog::_findColumn(int columnHandle)
+{
+    ColumnHandle &h = columnHandles[columnHandle];
+
+    // Columns may move (e.g. when a timestamp is added), or be lost if the log is cleared.
+    // Validate our cached column by reference, and only fall back to a string search if it has changed.
+    if (h.column >= headingCount || rowData[h.column].key.toCharArray() != h.key.toCharArray())
+    {
+        int column = findColumn(h.key);
+        if (column < 0)
+        {
+            addHeading(h.key, ManagedString::EmptyString);
+            column = findColumn(h.key);
+        }
+
+        h.column = column;
+        h.key = rowData[column].key;
+    }
+
+    return h.column;
+}
+
+/**
+ * Logs a block of complete rows of integer values, held as one array per column.
+ * The log is locked once for the whole block, and values are stored without the cleaning text values need.
+ *
+ * @param columnHandles the handles of the columns to populate, previously obtained from getColumnHandle().
+ * @param values an array of values for each column, indexed by row.
+ * @param columns the number of columns.
+ * @param rows the number of rows.
+ * @param times if not NULL, the time (in milliseconds) to record each row against in the timestamp column,
+ * if timestamps are enabled. Otherwise, rows are stamped with the current time.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if a handle is not valid, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::logRows(const int *columnHandles, const int32_t * const *values, int columns, int rows, const CODAL_TIMESTAMP *times)
+{
+    if (columnHandles == NULL || values == NULL || columns <= 0 || rows < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    int r = DEVICE_OK;
+
+    mutex.wait();
+
+    for (int c = 0; c < columns; c++)
+    {
+        if (columnHandles[c] < 0 || columnHandles[c] >= (int)columnHandleCount)
+        {
+            mutex.notify();
+            return DEVICE_INVALID_PARAMETER;
+        }
+    }
+
+    init();
+
+    for (int row = 0; row < rows && r == DEVICE_OK; row++)
+    {
+        _beginRow();
+
+        // Numbers never need cleaning, so are stored directly. Columns are looked up for every row, as the first
+        // row may add the timestamp column, moving the others.
+        for (int c = 0; c < columns; c++)
+            rowData[_findColumn(columnHandles[c])].value = ManagedString((int) values[c][row]);
+
+        r = _endRow(times ? times[row] : system_timer_current_time());
+    }
+
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Determines the column index of the given heading.
+ * Columns are typically logged in the same order for every row, so the column following the last one found is tested first.
+ *
+ * @param key the heading to find.
+ * @return the index of the column, or -1 if no such heading exists.
+ */
+int MicroBitLog::findColumn(ManagedString key)
+{
+    if (headingCount == 0)
+        return -1;
+
+    uint32_t c = lastColumn + 1 < headingCount ? lastColumn + 1 : 0;
+
+    for (uint32_t i=0; i<headingCount; i++)
+    {
+        if (rowData[c].key == key)
+        {
+            lastColumn = c;
+            return c;
+        }
+
+        if (++c == headingCount)
+            c = 0;
+    }
+
+    return -1;
+}
+
 /**
  * Complete a row in the log, and pushes to persistent storage.
  * @return DEVICE_OK on success.
@@ -546,7 +1550,17 @@ int MicroBitLog::endRow()
  */
 int MicroBitLog::_endRow()
 {
-    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED))
+    return _endRow(system_timer_current_time());
+}
+
+/**
+ * Complete a row in the log, and pushes to persistent storage.
+ * @param time the time (in milliseconds) to record the row against, if timestamps are enabled.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::_endRow(CODAL_TIMESTAMP time)
+{
+    if (!(logStatus & MICROBIT_LOG_STATUS_ROW_STARTED))
         return DEVICE_INVALID_STATE;
 
     init();
@@ -557,7 +1571,7 @@ int MicroBitLog::_endRow()
     {
         timeStampChanged = false;
         if (timeStampFormat != TimeStampFormat::None)
-            addHeading(timeStampHeading, ManagedString::EmptyString, dataStart == dataEnd);
+            addHeading(timeStampHeading, ManagedString::EmptyString, dataStart == dataEnd && writeBufferLength == 0);
     }
 
     // Special case the condition where no values are present.
@@ -573,96 +1587,391 @@ int MicroBitLog::_endRow()
         }
     }
 
-    // Insert timestamp field if requested.
+    // Generate timestamp field if requested.
+    char timeStamp[MICROBIT_LOG_TIMESTAMP_MAX_LENGTH];
+    int timeStampLength = 0;
+    int timeStampColumn = -1;
+    CODAL_TIMESTAMP timeStampValue = 0;
+
     if (validData && timeStampFormat != TimeStampFormat::None)
     {
-        // handle 32 bit overflow and fractional components of timestamp
-        CODAL_TIMESTAMP t = system_timer_current_time() / (CODAL_TIMESTAMP)timeStampFormat;
-        int billions = t / (CODAL_TIMESTAMP) 1000000000;
-        int units = t % (CODAL_TIMESTAMP) 1000000000;
-        int fraction = 0;
-
-        if ((int)timeStampFormat > 1)
-        {
-            fraction = units % 100;
-            units = units / 100;
-            billions = billions / 100;
-        }
+        // Timestamps are recorded in units of 1/100th of the selected unit, except for milliseconds.
+        timeStampValue = time / (CODAL_TIMESTAMP)timeStampFormat;
+        timeStampLength = writeTimeStamp(timeStamp, timeStampValue, (int)timeStampFormat > 1);
 
-        ManagedString u(units);
-        ManagedString f(fraction);
-        ManagedString s;
-        f = padString(f, 2);
-
-        if (billions)
+        // Locate the timestamp column, adding it if necessary.
+        addHeading(timeStampHeading, ManagedString::EmptyString);
+        for (uint32_t i=0; i<headingCount; i++)
         {
-            s = s + billions;
-            u = padString(u, 9);
+            if (rowData[i].key == timeStampHeading)
+            {
+                timeStampColumn = i;
+                break;
+            }
         }
-
-        s = s + u;
-
-        // Add two decimal places for anything other than milliseconds.
-        if ((int)timeStampFormat > 1)
-            s = s + "." + f;
-
-        _logData(timeStampHeading, s);
     }
 
     // If new columns have been added since the last row, update persistent storage accordingly.
-    ManagedString sep = ",";
-
     if (headingsChanged)
     {
         // If this is the first time we have logged any headings, place them just after the metadata block
         if (headingStart == 0)
             headingStart = startAddress + sizeof(MicroBitLogMetaData);
 
+        // Determine the length of the new headers, including separators and terminating newline.
+        uint32_t length = headingCount;
+        for (uint32_t i=0; i<headingCount;i++)
+            length += rowData[i].key.length();
+
         // create new headers
-        ManagedString h;
-        ManagedBuffer zero(headingLength);
+        char *h = getRowBuffer(length);
+        char *p = h;
 
         for (uint32_t i=0; i<headingCount;i++)
         {
-            h = h + rowData[i].key;
-            if (i + 1 != headingCount)
-                h = h + sep;
+            memcpy(p, rowData[i].key.toCharArray(), rowData[i].key.length());
+            p += rowData[i].key.length();
+            *p++ = (i + 1 != headingCount) ? ',' : '\n';
         }
-        h = h + "\n";
-        
-        cache.write(headingStart, &zero[0], headingLength);
+
+        // Erase the old headers
+        uint8_t zero[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+        memset(zero, 0, sizeof(zero));
+
+        for (uint32_t i=0; i<headingLength; i += sizeof(zero))
+            cache.write(headingStart + i, zero, min(headingLength - i, (uint32_t) sizeof(zero)));
+
         headingStart += headingLength;
-        cache.write(headingStart, h.toCharArray(), h.length());
-        headingLength = h.length();
+        cache.write(headingStart, h, length);
+        headingLength = length;
 
-        _logString(h);
+        _logString(h, length);
 
         headingsChanged = false;
     }
 
     // Serialize data to CSV
-    ManagedString row;
     bool empty = true;
+    uint32_t length = headingCount;
 
     for (uint32_t i=0; i<headingCount;i++)
     {
-        row = row + rowData[i].value;
-         
-        if (rowData[i].value.length())
+        uint32_t l = ((int)i == timeStampColumn) ? timeStampLength : rowData[i].value.length();
+
+        if (l)
             empty = false;
 
-        if (i + 1 != headingCount)
-            row = row + sep;
+        length += l;
     }
-    row = row + "\n";
 
     if (!empty)
-        _logString(row);
+    {
+        // If binary records are enabled, reserve space for the encoded record after the CSV text.
+        uint32_t recordLength = 0;
+        char *row = getRowBuffer((logStatus & MICROBIT_LOG_STATUS_BINARY) ? length + headingCount * MICROBIT_LOG_RECORD_MAX_FIELD_LENGTH + 2 : length);
+        char *p = row;
 
-    status &= ~MICROBIT_LOG_STATUS_ROW_STARTED;
+        for (uint32_t i=0; i<headingCount;i++)
+        {
+            if ((int)i == timeStampColumn)
+            {
+                memcpy(p, timeStamp, timeStampLength);
+                p += timeStampLength;
+            }
+            else
+            {
+                memcpy(p, rowData[i].value.toCharArray(), rowData[i].value.length());
+                p += rowData[i].value.length();
+            }
+
+            *p++ = (i + 1 != headingCount) ? ',' : '\n';
+        }
+
+        // If requested, attempt to store the row as a compact binary record, retaining the CSV text for mirroring.
+        if (logStatus & MICROBIT_LOG_STATUS_BINARY)
+        {
+            recordLength = encodeRecord((uint8_t *)row + length, timeStampColumn, timeStampValue);
+
+            if (recordLength)
+                _logRecord(row + length, recordLength, row, length);
+        }
+
+        if (recordLength == 0)
+            _logString(row, length);
+    }
+
+    logStatus &= ~MICROBIT_LOG_STATUS_ROW_STARTED;
+
+    if (logStatus & MICROBIT_LOG_STATUS_FULL)
+        return DEVICE_NO_RESOURCES;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Encode the current row as a binary record.
+ *
+ * @param buffer the buffer to encode into. Must be at least (headingCount * MICROBIT_LOG_RECORD_MAX_FIELD_LENGTH + 2) bytes long.
+ * @param timeStampColumn the index of the timestamp column, or -1 if no timestamp is to be recorded.
+ * @param timeStamp the timestamp to record.
+ * @return the length of the record, or 0 if the row contains values that cannot be represented in binary form.
+ */
+uint32_t MicroBitLog::encodeRecord(uint8_t *buffer, int timeStampColumn, uint64_t timeStamp)
+{
+    uint8_t *p = buffer;
+    uint32_t recordStart = dataEnd + writeBufferLength;
+    uint32_t recordBlock = recordStart / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE;
+
+    // Values are only compressed against earlier records in the same block, for the same reason as timestamps.
+    // They are tracked whether or not compression is enabled, so that the decoder's view of them always matches ours.
+    // Updates are made to a copy, so an unencodable row leaves the previous values intact.
+    bool compress = logStatus & MICROBIT_LOG_STATUS_COMPRESSED;
+    uint32_t mask = lastValueBlock == recordBlock ? lastValueMask : 0;
+    int32_t values[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];
+    uint8_t places[CONFIG_MICROBIT_LOG_DELTA_COLUMNS];
+
+    memcpy(values, lastValues, sizeof(values));
+    memcpy(places, lastDecimals, sizeof(places));
+
+    int64_t interval = 0;
+    bool intervalValid = false;
+
+    *p++ = MICROBIT_LOG_RECORD_START;
+
+    for (uint32_t i=0; i<headingCount; i++)
+    {
+        if ((int)i == timeStampColumn)
+        {
+            // Timestamps are delta encoded against the previous binary record, except for the first timestamp recorded in each
+            // cache block. This allows any row to be decoded by reading no further back than the start of its block.
+            bool fraction = (int)timeStampFormat > 1;
+
+            if (lastRecordBlock == recordBlock)
+            {
+                interval = (int64_t) (timeStamp - lastRecordTimeStamp);
+                intervalValid = true;
+
+                // When compressed, a regular interval is stored as its change from the previous interval, in a single byte.
+                uint64_t change = zigzag(interval - lastRecordInterval);
+
+                if (compress && lastRecordIntervalValid && fraction == lastRecordFraction && change < MICROBIT_LOG_RECORD_SMALL_DELTA_RANGE)
+                {
+                    *p++ = MICROBIT_LOG_RECORD_SMALL_DELTA | change;
+                }
+                else
+                {
+                    *p++ = fraction ? MICROBIT_LOG_RECORD_TIME_DELTA_FRACTION : MICROBIT_LOG_RECORD_TIME_DELTA;
+                    p += writeVarint(p, zigzag(interval));
+                }
+            }
+            else
+            {
+                *p++ = fraction ? MICROBIT_LOG_RECORD_TIME_FRACTION : MICROBIT_LOG_RECORD_TIME;
+                p += writeVarint(p, timeStamp);
+            }
+
+            continue;
+        }
+
+        if (rowData[i].value.length() == 0)
+        {
+            *p++ = MICROBIT_LOG_RECORD_EMPTY;
+            continue;
+        }
+
+        int32_t v;
+        int decimals;
+
+        if (!parseValue(rowData[i].value.toCharArray(), rowData[i].value.length(), v, decimals))
+            return 0;
+
+        if (i < CONFIG_MICROBIT_LOG_DELTA_COLUMNS)
+        {
+            bool known = compress && (mask & (1UL << i)) && places[i] == decimals;
+            int64_t delta = (int64_t) v - values[i];
+
+            mask |= 1UL << i;
+            values[i] = v;
+            places[i] = decimals;
+
+            if (known && zigzag(delta) < MICROBIT_LOG_RECORD_SMALL_DELTA_RANGE)
+            {
+                *p++ = MICROBIT_LOG_RECORD_SMALL_DELTA | zigzag(delta);
+                continue;
+            }
+
+            // Use a delta only if it is no longer than the value itself, including any type marker.
+            if (known && varintLength(zigzag(delta)) < varintLength(zigzag(v)) + (decimals ? 1 : 0))
+            {
+                *p++ = MICROBIT_LOG_RECORD_DELTA;
+                p += writeVarint(p, zigzag(delta));
+                continue;
+            }
+        }
+
+        if (decimals)
+            *p++ = MICROBIT_LOG_RECORD_FIXED + decimals;
+
+        p += writeVarint(p, zigzag(v));
+    }
+
+    *p++ = '\n';
+
+    lastValueBlock = recordBlock;
+    lastValueMask = mask;
+    memcpy(lastValues, values, sizeof(values));
+    memcpy(lastDecimals, places, sizeof(places));
+
+    if (timeStampColumn >= 0)
+    {
+        lastRecordBlock = recordBlock;
+        lastRecordTimeStamp = timeStamp;
+        lastRecordInterval = interval;
+        lastRecordIntervalValid = intervalValid;
+        lastRecordFraction = (int)timeStampFormat > 1;
+    }
+
+    return p - buffer;
+}
+
+/**
+ * Determine where decoding must start, for binary records at the given address to be decoded correctly.
+ *
+ * @param address the logical address of the start of a row.
+ * @return the logical address of the start of a row from which decoding can begin.
+ */
+uint32_t MicroBitLog::getDecodeStart(uint32_t address)
+{
+    // Binary timestamps may be relative to earlier rows. Find the first row in the same block, which is guaranteed
+    // not to depend on any earlier data, and decode from there.
+    uint32_t start = address - (address % CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
+
+    if (start <= dataHead)
+        return dataHead;
+
+    uint8_t c;
+    readLog(start - 1, &c, 1);
+    if (c != '\n')
+        start = min(skipRows(start, 1), address);
+
+    return start;
+}
+
+/**
+ * Expand the given range of stored log data into CSV text.
+ *
+ * @param start the logical address of the start of a row.
+ * @param end the logical address of the end of the range.
+ * @param out the buffer to write CSV text into, or NULL to simply calculate the length of the CSV text.
+ * @return the length of the CSV text.
+ */
+uint32_t MicroBitLog::expandRange(uint32_t start, uint32_t end, char *out)
+{
+    MicroBitLogDecoder decoder;
+    uint8_t buffer[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+    char text[MICROBIT_LOG_DECODE_MAX_LENGTH];
+    uint32_t length = 0;
+
+    uint32_t address = getDecodeStart(start);
+
+    decoder.reset();
+
+    while (address < end)
+    {
+        uint32_t l = min(end - address, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+        readLog(address, buffer, l);
+
+        for (uint32_t i=0; i<l; i++)
+        {
+            int n = decoder.decode(buffer[i], text);
+
+            if (address + i >= start)
+            {
+                if (out)
+                    memcpy(out + length, text, n);
+
+                length += n;
+            }
+        }
+
+        address += l;
+    }
+
+    return length;
+}
+
+/**
+ * Read data from the log, expanded to CSV text.
+ * Sequential reads are optimised, by continuing to decode from the location of the previous read.
+ *
+ * @param data the buffer to fill.
+ * @param index the 0-based offset into the CSV text to read from.
+ * @param len the number of bytes to read.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the requested data is not available.
+ */
+int MicroBitLog::_readExpanded(uint8_t *data, uint32_t index, uint32_t len)
+{
+    uint8_t buffer[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+    uint32_t bufferLength = 0;
+    uint32_t bufferPosition = 0;
+    uint32_t copied = 0;
+
+    // Rewind within the most recently decoded text if we can, or restart from the beginning if we can't.
+    if (index < readIndex && readIndex - index <= readPendingPosition)
+    {
+        readPendingPosition -= readIndex - index;
+        readIndex = index;
+    }
+
+    if (!readValid || index < readIndex)
+    {
+        readDecoder.reset();
+        readAddress = dataHead;
+        readIndex = 0;
+        readPendingLength = 0;
+        readPendingPosition = 0;
+        readValid = true;
+    }
+
+    while (copied < len)
+    {
+        // Decode more data if we have consumed all the text we have.
+        if (readPendingPosition == readPendingLength)
+        {
+            if (bufferPosition == bufferLength)
+            {
+                bufferLength = min(dataEnd - readAddress, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+                bufferPosition = 0;
+
+                if (bufferLength == 0)
+                    return DEVICE_INVALID_PARAMETER;
+
+                readLog(readAddress, buffer, bufferLength);
+            }
+
+            readPendingLength = readDecoder.decode(buffer[bufferPosition++], readPending);
+            readPendingPosition = 0;
+            readAddress++;
+            continue;
+        }
+
+        uint32_t l = readPendingLength - readPendingPosition;
+
+        // Skip text before the requested index.
+        if (readIndex < index)
+        {
+            l = min(l, index - readIndex);
+        }
+        else
+        {
+            l = min(l, len - copied);
+            memcpy(data + copied, &readPending[readPendingPosition], l);
+            copied += l;
+        }
 
-    if (status & MICROBIT_LOG_STATUS_FULL)
-        return DEVICE_NO_RESOURCES;
+        readPendingPosition += l;
+        readIndex += l;
+    }
 
     return DEVICE_OK;
 }
@@ -720,25 +2029,49 @@ int MicroBitLog::logString(const char *s)
  * @param s the string to inject.
  */
 int MicroBitLog::_logString(const char *s)
-{  
+{
+    return _logString(s, strlen(s));
+}
+
+/**
+ * Inject the given data into the log as text, ignoring key/value pairs.
+ * @param s the data to inject.
+ * @param len the number of bytes of data to inject.
+ */
+int MicroBitLog::_logString(const char *s, uint32_t len)
+{
+    return _logRecord(s, len, NULL, 0);
+}
+
+/**
+ * Inject the given data into the log.
+ *
+ * @param s the data to store.
+ * @param len the number of bytes of data to store.
+ * @param text the CSV text equivalent of the data (used for serial mirroring), or NULL if the data is CSV text.
+ * @param textLength the length of the CSV text equivalent of the data.
+ */
+int MicroBitLog::_logRecord(const char *s, uint32_t len, const char *text, uint32_t textLength)
+{
     init();
 
-    uint32_t oldDataEnd = dataEnd;
-    uint32_t l = strlen(s);
+    uint32_t l = len;
     const char *data = s;
 
     // If this is the first log entry written, ensure that the file visibility is activated.
     // (it may have been disabled following a full erase)
-    if (dataStart == dataEnd)
+    if (dataStart == dataEnd && writeBufferLength == 0)
         _setVisibility(true);
 
-    // If we can't write a whole line of data, then treat the log as full.
-    if (l > logEnd - dataEnd)
+    // If we can't write a whole line of data, then treat the log as full. A ring log is never full.
+    if (!(logStatus & MICROBIT_LOG_STATUS_RING) && l > logEnd - dataEnd - writeBufferLength)
     {
-        if (!(status & MICROBIT_LOG_STATUS_FULL))
+        if (!(logStatus & MICROBIT_LOG_STATUS_FULL))
         {
+            _flush();
             cache.write(logEnd+1, "FUL", 3);
-            status |= MICROBIT_LOG_STATUS_FULL;
+            cache.flush();
+            logStatus |= MICROBIT_LOG_STATUS_FULL;
         }
 
         Event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_LOG_FULL);
@@ -749,13 +2082,72 @@ int MicroBitLog::_logString(const char *s)
     if (cleaned.length())
         data = cleaned.toCharArray();
 
+    if (text == NULL)
+    {
+        text = data;
+        textLength = l;
+    }
+
     // If requested, log the data over the serial port
-    if (status & MICROBIT_LOG_STATUS_SERIAL_MIRROR && l > 0)
+    if (logStatus & MICROBIT_LOG_STATUS_SERIAL_MIRROR && textLength > 0)
+        mirror(text, textLength);
+
+    // Keep track of the length of the data when expanded to CSV, if we know it.
+    if (rowIndexValid)
+        expandedLength += textLength - l;
+
+    // If we're not buffering, commit the data immediately.
+    if (!(logStatus & MICROBIT_LOG_STATUS_BUFFERED))
+        return _commit(data, l);
+
+    if (logStatus & MICROBIT_LOG_STATUS_POWER_AWARE)
+        checkPower();
+
+    // Otherwise, accumulate data in the write buffer. The buffer is committed each time it is filled up to
+    // a cache block boundary, so that each commit results in a single aligned write and journal entry.
+    while (l > 0)
     {
-        serial.send((uint8_t *)data, l-1);
-        serial.send((uint8_t *)"\r\n", 2);
+        uint32_t spaceInBlock = CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE - ((dataEnd + writeBufferLength) % CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
+        uint32_t lengthToBuffer = min(l, spaceInBlock);
+
+        // Schedule a timely commit of any data that isn't committed as a result of filling the buffer.
+        if (writeBufferLength == 0)
+            scheduleFlush();
+
+        memcpy(writeBuffer + writeBufferLength, data, lengthToBuffer);
+        writeBufferLength += lengthToBuffer;
+        data += lengthToBuffer;
+        l -= lengthToBuffer;
+
+        if (lengthToBuffer == spaceInBlock)
+        {
+            int r = _flush();
+            if (r != DEVICE_OK)
+                return r;
+        }
     }
 
+    // If a brown out may be imminent, don't leave anything in RAM.
+    if (logStatus & MICROBIT_LOG_STATUS_POWER_LOW)
+        return _flush();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Write the given data to the end of the log in persistent storage, and update the journal accordingly.
+ * The data is assumed to be clean, and to fit within the space available.
+ *
+ * @param data the data to write.
+ * @param len the number of bytes to write.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::_commit(const char *data, uint32_t len)
+{
+    uint32_t oldDataEnd = dataEnd;
+    uint32_t l = len;
+    bool dirty = cache.isDirty();
+
     while (l > 0)
     {
         uint32_t spaceOnPage = flash.getPageSize() - (dataEnd % flash.getPageSize());
@@ -763,9 +2155,17 @@ int MicroBitLog::_logString(const char *s)
         int lengthToWrite = min(l, spaceOnPage);
 
         // If we're going to fill (or overspill) the current page, erase the next one ready for use.
-        if (spaceOnPage <= l && dataEnd+spaceOnPage < logEnd)
+        // In ring mode, the next page may hold the oldest data in the log. Ensure we don't retain any stale cached copy.
+        bool ring = logStatus & MICROBIT_LOG_STATUS_RING;
+        if (spaceOnPage <= l && (ring || dataEnd+spaceOnPage < logEnd))
         {
-            uint32_t nextPage = ((dataEnd / flash.getPageSize()) + 1) * flash.getPageSize();
+            uint32_t nextPage = getPhysicalAddress(((dataEnd / flash.getPageSize()) + 1) * flash.getPageSize());
+
+            if (ring)
+            {
+                for (uint32_t b = 0; b < flash.getPageSize(); b += CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE)
+                    cache.erase(nextPage + b);
+            }
 
             //DMESG("   ERASING PAGE %p", nextPage);
             flash.erase(nextPage);
@@ -773,12 +2173,20 @@ int MicroBitLog::_logString(const char *s)
 
         // Perform a write through cache update
         //DMESG("   WRITING [ADDRESS: %p] [LENGTH: %d] ", dataEnd, lengthToWrite);
-        cache.write(dataEnd, data, lengthToWrite);
+        cache.write(getPhysicalAddress(dataEnd), data, lengthToWrite);
+
+        // Keep the row index up to date, if we have one.
+        if (rowIndexValid)
+            indexRowData(dataEnd, (const uint8_t *)data, lengthToWrite);
 
         // move on pointers
         dataEnd += lengthToWrite;
         data += lengthToWrite;
         l -= lengthToWrite;
+
+        // If we have just erased the oldest data in a ring log, move on the start of the log.
+        if (ring && dataEnd % flash.getPageSize() == 0)
+            updateDataHead();
     }
 
     // Write a new entry into the log journal if we crossed a cache block boundary
@@ -806,6 +2214,9 @@ int MicroBitLog::_logString(const char *s)
             flash.erase(journalHead);
         }
 
+        // Ensure the data referenced by the journal entry is stored before the entry itself.
+        cache.flush();
+
         // Write journal entry
         JournalEntry je;
         writeNum(je.length, ((dataEnd-dataStart) / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE) * CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
@@ -816,8 +2227,19 @@ int MicroBitLog::_logString(const char *s)
         empty.clear();
         //DMESG("   INVALIDATING: %p", oldJournalHead);
         cache.write(oldJournalHead, &empty, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+        cache.flush();
+
+        // Keep the block holding the journal head resident while data blocks stream through the cache.
+        if (oldJournalHead / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE != journalHead / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE)
+            cache.unpin(oldJournalHead, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+
+        cache.pin(journalHead, MICROBIT_LOG_JOURNAL_ENTRY_SIZE, FSCACHE_PRIORITY_HIGH);
     }
 
+    // Schedule a timely write back of any data left in the cache.
+    if (!dirty && cache.isDirty())
+        scheduleFlush();
+
     // Return NO_RESOURCES if we ran out of FLASH space.
     if (l == 0)
         return DEVICE_OK;
@@ -847,7 +2269,30 @@ int MicroBitLog::logString(ManagedString s)
  */
 int MicroBitLog::_logString(ManagedString s)
 {
-    return _logString(s.toCharArray());
+    return _logString(s.toCharArray(), s.length());
+}
+
+/**
+ * Provides a scratch buffer of at least the given size, used to serialize rows and headers.
+ * The buffer is retained between calls, and only reallocated if a larger buffer is needed.
+ *
+ * @param len the minimum size of the buffer, in bytes.
+ * @return a pointer to the scratch buffer.
+ */
+char *MicroBitLog::getRowBuffer(uint32_t len)
+{
+    if (len > rowBufferSize)
+    {
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rowBuffer);
+        if (rowBuffer)
+            free(rowBuffer);
+
+        rowBufferSize = max(len, (uint32_t) CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE);
+        rowBuffer = (char *) malloc(rowBufferSize);
+        MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, rowBuffer, rowBufferSize);
+    }
+
+    return rowBuffer;
 }
 
 /**
@@ -860,11 +2305,11 @@ int MicroBitLog::_logString(ManagedString s)
  */
 void MicroBitLog::addHeading(ManagedString key, ManagedString value, bool head)
 {
-    for (uint32_t i=0; i<headingCount; i++)
-        if (rowData[i].key == key)
-            return;
+    if (findColumn(key) >= 0)
+        return;
 
     ColumnEntry* newRowData = (ColumnEntry *) malloc(sizeof(ColumnEntry) * (headingCount+1));
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, newRowData, sizeof(ColumnEntry) * (headingCount+1));
     int columnShift = head ? 1 : 0;
     int newColumn = head ? 0 : headingCount;
 
@@ -877,6 +2322,7 @@ void MicroBitLog::addHeading(ManagedString key, ManagedString value, bool head)
         rowData[i].value = ManagedString::EmptyString;
     }   
     
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rowData);
     if (rowData)
         free(rowData);
 
@@ -916,12 +2362,17 @@ void MicroBitLog::_invalidate()
         MicroBitLogMetaData m;
         memclr(&m, sizeof(MicroBitLogMetaData));
 
-        // Erase the LogFS metadata and trailing FULL indicator.
+        // Erase the LogFS metadata and trailing FULL indicator, discarding any cached data belonging to the old log.
+        cache.clear();
         flash.write(startAddress, (uint32_t *) &m, sizeof(MicroBitLogMetaData)/4);
         flash.write(logEnd, (uint32_t *) &m, 1);
     }
 
-    status &= ~MICROBIT_LOG_STATUS_INITIALIZED; 
+    // Any buffered data or cursor belongs to the invalidated log, so discard it.
+    writeBufferLength = 0;
+    generation++;
+
+    logStatus &= ~MICROBIT_LOG_STATUS_INITIALIZED; 
 }
 
 /**
@@ -947,7 +2398,7 @@ bool MicroBitLog::isPresent()
 bool MicroBitLog::_isPresent()
 {
     // Fast path if we;re already initialized.
-    if (status & MICROBIT_LOG_STATUS_INITIALIZED)
+    if (logStatus & MICROBIT_LOG_STATUS_INITIALIZED)
         return true;
 
     // Calculate where our metadata should start, and load the data.
@@ -986,7 +2437,7 @@ bool MicroBitLog::_isPresent()
  */
 bool MicroBitLog::isFull()
 {
-    return (status & MICROBIT_LOG_STATUS_FULL);
+    return (logStatus & MICROBIT_LOG_STATUS_FULL);
 }
 
 /**
@@ -1002,9 +2453,11 @@ uint32_t MicroBitLog::getDataLength(DataFormat format)
     uint32_t r = 0;
     mutex.wait();
     init();
+    _flush();
+    buildRowIndex();
     uint32_t hdr = sizeof(header);
     uint32_t mtr = sizeof(MicroBitLogMetaData);
-    uint32_t csv = dataEnd - dataStart;
+    uint32_t csv = dataEnd - dataHead + expandedLength;
     switch (format)
     {
         case DataFormat::HTMLHeader:
@@ -1047,12 +2500,14 @@ int MicroBitLog::_readData(uint8_t *data, uint32_t index, uint32_t len, DataForm
     int r = DEVICE_OK;
     
     init();
+    _flush();
+    buildRowIndex();
     
     uint32_t hdr = sizeof(header);
     uint32_t mtr = sizeof(MicroBitLogMetaData);
 
     // Check if there is less data than expected
-    uint32_t dataMax = dataEnd - dataStart;
+    uint32_t dataMax = dataEnd - dataHead + expandedLength;
     uint32_t dataLen = dataMax;
     switch (format)
     {
@@ -1089,12 +2544,12 @@ int MicroBitLog::_readData(uint8_t *data, uint32_t index, uint32_t len, DataForm
         case DataFormat::HTML:
             _readSource( data, index, len, pos, header, 0, hdr);
             _readSource( data, index, len, pos, &meta,  0, mtr);
-            r = _readSource( data, index, len, pos, NULL, dataStart, dataLen);
+            r = _readSource( data, index, len, pos, NULL, dataHead, dataLen);
             if (r == DEVICE_OK)
               _readSource( data, index, len, pos, &end, 0, sizeof(end));
             break;
         case DataFormat::CSV:
-            r = _readSource( data, index, len, pos, NULL, dataStart, dataLen);
+            r = _readSource( data, index, len, pos, NULL, dataHead, dataLen);
             break;
     }
     return r;
@@ -1124,8 +2579,10 @@ int MicroBitLog::_readSource( uint8_t *&data, uint32_t &index, uint32_t &len, ui
     {
         if ( srcPtr)
             memcpy(data, (const uint8_t *) srcPtr + (index - srcIndex), length);
+        else if ( srcAddress == dataHead && expandedLength)
+            r = _readExpanded( data, index - srcIndex, length);
         else
-            r = cache.read( srcAddress + (index - srcIndex), data, length);
+            r = readLog( srcAddress + (index - srcIndex), data, length);
     }
 
     if ( r == DEVICE_OK)
@@ -1139,6 +2596,230 @@ int MicroBitLog::_readSource( uint8_t *&data, uint32_t &index, uint32_t &len, ui
     return r;
 }
 
+/**
+ * Discard the current row index. The index will be rebuilt the next time it is required.
+ */
+void MicroBitLog::resetRowIndex()
+{
+    rowIndexLength = 0;
+    rowIndexStride = CONFIG_MICROBIT_LOG_ROW_INDEX_STRIDE;
+    rowCount = 0;
+    rowIndexValid = false;
+    expandedLength = 0;
+    readValid = false;
+    lastRecordBlock = 0xFFFFFFFF;
+    lastRecordIntervalValid = false;
+    lastValueBlock = 0xFFFFFFFF;
+    lastValueMask = 0;
+}
+
+/**
+ * Build the row index for the current log, if it is not already valid.
+ * The data region is scanned once, in blocks, after which the index is maintained incrementally as data is logged.
+ */
+void MicroBitLog::buildRowIndex()
+{
+    if (rowIndexValid)
+        return;
+
+    if (rowIndex == NULL)
+    {
+        rowIndex = (uint32_t *) malloc(sizeof(uint32_t) * CONFIG_MICROBIT_LOG_ROW_INDEX_SIZE);
+        MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, rowIndex, sizeof(uint32_t) * CONFIG_MICROBIT_LOG_ROW_INDEX_SIZE);
+    }
+
+    resetRowIndex();
+
+    // The first row always starts at the beginning of valid data.
+    // If no memory is available for the index, rows are still counted, and located by scanning from the start.
+    if (rowIndex)
+    {
+        rowIndex[0] = dataHead;
+        rowIndexLength = 1;
+    }
+
+    MicroBitLogDecoder decoder;
+    uint8_t buffer[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+    char text[MICROBIT_LOG_DECODE_MAX_LENGTH];
+    uint32_t address = dataHead;
+
+    decoder.reset();
+
+    while (address < dataEnd)
+    {
+        uint32_t l = min(dataEnd - address, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+
+        readLog(address, buffer, l);
+        indexRowData(address, buffer, l);
+
+        // Also determine how much longer the data is when binary records are expanded to CSV.
+        for (uint32_t i=0; i<l; i++)
+            expandedLength += decoder.decode(buffer[i], text) - 1;
+
+        address += l;
+    }
+
+    rowIndexValid = true;
+}
+
+/**
+ * Update the row index with the given data, which has been (or is about to be) stored at the given address.
+ *
+ * @param address the logical address of the first byte of data.
+ * @param data the data to index.
+ * @param len the number of bytes of data to index.
+ */
+void MicroBitLog::indexRowData(uint32_t address, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i=0; i<len; i++)
+    {
+        if (data[i] != '\n')
+            continue;
+
+        rowCount++;
+
+        if (rowIndex == NULL || rowCount % rowIndexStride)
+            continue;
+
+        // If the index is full, discard every other entry and double the stride.
+        // This bounds RAM use, at the cost of a (bounded) linear scan on lookup.
+        if (rowIndexLength == CONFIG_MICROBIT_LOG_ROW_INDEX_SIZE)
+        {
+            for (uint32_t e=1; e<(rowIndexLength+1)/2; e++)
+                rowIndex[e] = rowIndex[e*2];
+
+            rowIndexLength = (rowIndexLength+1)/2;
+            rowIndexStride *= 2;
+
+            if (rowCount % rowIndexStride)
+                continue;
+        }
+
+        rowIndex[rowIndexLength++] = address + i + 1;
+    }
+}
+
+/**
+ * Scan forward from the given address until the given number of rows have been passed.
+ *
+ * @param address the logical address to start scanning from.
+ * @param rows the number of row separators to skip.
+ * @return the logical address of the byte following the last row separator skipped, or dataEnd if the data ends first.
+ */
+uint32_t MicroBitLog::skipRows(uint32_t address, uint32_t rows)
+{
+    uint8_t buffer[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+
+    while (rows > 0 && address < dataEnd)
+    {
+        uint32_t l = min(dataEnd - address, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+        readLog(address, buffer, l);
+
+        for (uint32_t i=0; i<l; i++)
+        {
+            if (buffer[i] == '\n' && --rows == 0)
+                return address + i + 1;
+        }
+
+        address += l;
+    }
+
+    return rows ? dataEnd : address;
+}
+
+/**
+ * Determine the logical address of the start of the given row, using the row index.
+ *
+ * @param row the 0-based index of the row to locate. Must be no greater than rowCount.
+ * @return the logical address of the start of the given row.
+ */
+uint32_t MicroBitLog::getRowAddress(uint32_t row)
+{
+    if (rowIndexLength == 0)
+        return skipRows(dataHead, row);
+
+    uint32_t entry = min(row / rowIndexStride, rowIndexLength - 1);
+
+    return skipRows(rowIndex[entry], row - entry * rowIndexStride);
+}
+
+/**
+ * Determine the size of the data region used by a ring log. This is the data region rounded down to a whole number of pages.
+ */
+uint32_t MicroBitLog::getRingSize()
+{
+    return ((logEnd - dataStart) / flash.getPageSize()) * flash.getPageSize();
+}
+
+/**
+ * Translate a logical address in the data region into a physical address, taking account of any wrap around in ring mode.
+ *
+ * @param address the logical address to translate.
+ * @return the physical address of the given logical address.
+ */
+uint32_t MicroBitLog::getPhysicalAddress(uint32_t address)
+{
+    if (!(logStatus & MICROBIT_LOG_STATUS_RING) || address < dataStart + getRingSize())
+        return address;
+
+    return dataStart + (address - dataStart) % getRingSize();
+}
+
+/**
+ * Read data from the data region, taking account of any wrap around in ring mode.
+ *
+ * @param address the logical address to read from.
+ * @param data the buffer to fill.
+ * @param len the number of bytes to read.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::readLog(uint32_t address, void *data, uint32_t len)
+{
+    uint8_t *p = (uint8_t *) data;
+
+    while (len > 0)
+    {
+        // Split the read where it wraps around the end of the ring.
+        uint32_t physical = getPhysicalAddress(address);
+        uint32_t l = len;
+
+        if (logStatus & MICROBIT_LOG_STATUS_RING)
+            l = min(l, dataStart + getRingSize() - physical);
+
+        int r = cache.read(physical, p, l);
+        if (r != DEVICE_OK)
+            return r;
+
+        address += l;
+        p += l;
+        len -= l;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Recalculate the start of valid data, after the oldest data in a ring log has been erased.
+ */
+void MicroBitLog::updateDataHead()
+{
+    uint32_t pageSize = flash.getPageSize();
+
+    // The page holding the write head is erased before use, so the oldest intact data is held in the page that follows it.
+    uint32_t oldest = ((dataEnd / pageSize) + 1) * pageSize;
+    if (!(logStatus & MICROBIT_LOG_STATUS_RING) || oldest <= dataStart + getRingSize())
+        return;
+
+    oldest -= getRingSize();
+    if (oldest <= dataHead)
+        return;
+
+    // The first row in the oldest page may be incomplete, so skip to the start of the next row.
+    // Any existing row index now refers to data that no longer exists.
+    dataHead = skipRows(oldest, 1);
+    resetRowIndex();
+}
+
 /**
 * Get the number of rows (including the header) in the datalogger.
 * @param fromRowIndex 0-based index of starting row: bumped up to 0 if negative.
@@ -1146,31 +2827,20 @@ int MicroBitLog::_readSource( uint8_t *&data, uint32_t &index, uint32_t &len, ui
 */
 uint32_t MicroBitLog::getNumberOfRows(uint32_t fromRowIndex)
 {
-    constexpr uint8_t rowSeparator = 10; // newline char
-    uint32_t rowCount = 0;
-
-    uint32_t end = dataStart;
-    bool startRowFound = (fromRowIndex == 0) ? true : false;
-
-    // Read read until we see a 0xFF character (unused memory)
-    uint8_t c = 0;
-    while(c != 0xff)
-    { 
-        cache.read(end, &c, 1);
-        if (c == rowSeparator) {
-            rowCount++;
-            if (!startRowFound && fromRowIndex == rowCount) {
-                startRowFound = true;
-                rowCount = 0;
-            }
-        }
-        end++;
-    }
+    uint32_t r = 0;
 
-    // Will be the case if fromRowIndex is beyond the number of rows:
-    if (!startRowFound)
-        return 0;
-    return rowCount;
+    mutex.wait();
+    init();
+    _flush();
+    buildRowIndex();
+
+    // Will be zero if fromRowIndex is beyond the number of rows.
+    if (fromRowIndex <= rowCount)
+        r = rowCount - fromRowIndex;
+
+    mutex.notify();
+
+    return r;
 }
 
 /**
@@ -1184,48 +2854,166 @@ ManagedString MicroBitLog::getRows(uint32_t fromRowIndex, int nRows)
     if (fromRowIndex >= dataEnd || nRows <= 0)
         return ManagedString("", 0);
 
-    constexpr uint8_t rowSeparator = 10; // newline char in asci
-    const uint32_t rowSeparatorTargetCount = fromRowIndex + nRows;
+    mutex.wait();
+    init();
+    _flush();
+    buildRowIndex();
+
+    // fromRowIndex was beyond the datalogger:
+    if (fromRowIndex > rowCount)
+    {
+        mutex.notify();
+        return ManagedString("", 0);
+    }
 
-    uint32_t startOfRowN = dataStart;
+    uint32_t startOfRowN = getRowAddress(fromRowIndex);
     uint32_t endOfDataChunk = dataEnd;
-    
-    uint32_t end = dataStart;
-    uint32_t rowSeparatorCount = 0;
-    bool startRowFound = (fromRowIndex == 0) ? true : false;
-    
-    // Read until we see a 0xFF character (unused memory)
-    uint8_t c = 0;
-    while(c != 0xff)
+
+    // If the requested range ends within the log, exclude the trailing row separator.
+    if (fromRowIndex + nRows <= rowCount)
+        endOfDataChunk = skipRows(startOfRowN, nRows) - 1;
+
+    // Expand any binary records to CSV text if necessary.
+    // n.b. the range may be large, so we stage it on the heap rather than the fiber stack. Use getRowCursor() to avoid staging altogether.
+    const int dataLength = expandedLength ? expandRange(startOfRowN, endOfDataChunk, NULL) : endOfDataChunk - startOfRowN;
+    char *rows = (char *) malloc(dataLength);
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_LOG, rows, dataLength);
+
+    if (rows == NULL)
     {
-        cache.read(end, &c, 1);
+        mutex.notify();
+        return ManagedString("", 0);
+    }
 
-        if (c == rowSeparator) {
-            rowSeparatorCount++;
-            if (!startRowFound && rowSeparatorCount == fromRowIndex) 
-            {
-                startRowFound = true;
-                startOfRowN = end + 1;
-            }
+    if (expandedLength)
+        expandRange(startOfRowN, endOfDataChunk, rows);
+    else
+        readLog(startOfRowN, rows, dataLength);
 
-            else if (rowSeparatorCount == rowSeparatorTargetCount) 
-            {
-                endOfDataChunk = end;
-                break;
-            }
-        }
+    mutex.notify();
+
+    ManagedString result(rows, dataLength);
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rows);
+    free(rows);
+
+    return result;
+}
+
+/**
+* Get a cursor that streams the given range of rows, without copying the whole range into RAM.
+* @param fromRowIndex 0-based index of starting row.
+* @param nRows number of rows to read from fromRowIndex, or a negative value to read to the end of the log.
+* @return a LogCursor over the given range. The range is empty if fromRowIndex is beyond the end of the log.
+*/
+LogCursor MicroBitLog::getRowCursor(uint32_t fromRowIndex, int nRows)
+{
+    LogCursor cursor;
+
+    mutex.wait();
+    init();
+    _flush();
+    buildRowIndex();
 
-        end++;
+    cursor.log = this;
+    cursor.generation = generation;
+    cursor.start = dataEnd;
+    cursor.end = dataEnd;
+
+    if (fromRowIndex <= rowCount)
+    {
+        cursor.start = getRowAddress(fromRowIndex);
+
+        if (nRows >= 0 && fromRowIndex + nRows <= rowCount)
+            cursor.end = skipRows(cursor.start, nRows);
     }
 
-    // fromRowIndex was beyond the datalogger:
-    if (!startRowFound)
-        return ManagedString("", 0);
+    // If there are binary records in the log, prime the decoder from a row that doesn't depend upon earlier data.
+    cursor.decode = expandedLength != 0;
+    cursor.address = cursor.decode ? getDecodeStart(cursor.start) : cursor.start;
+
+    mutex.notify();
+
+    return cursor;
+}
+
+/**
+ * Read the next chunk of data from the given cursor.
+ *
+ * @param cursor the cursor to read from.
+ * @param data the buffer to fill.
+ * @param len the maximum number of bytes to read.
+ * @return the number of bytes read, zero if no more data is available, or DEVICE_INVALID_STATE if the cursor is no longer valid.
+ */
+int MicroBitLog::readCursor(LogCursor &cursor, uint8_t *data, uint32_t len)
+{
+    int r;
+
+    mutex.wait();
+    r = _readCursor(cursor, data, len);
+    mutex.notify();
+
+    return r;
+}
+
+/**
+ * Read the next chunk of data from the given cursor.
+ *
+ * @param cursor the cursor to read from.
+ * @param data the buffer to fill.
+ * @param len the maximum number of bytes to read.
+ * @return the number of bytes read, zero if no more data is available, or DEVICE_INVALID_STATE if the cursor is no longer valid.
+ */
+int MicroBitLog::_readCursor(LogCursor &cursor, uint8_t *data, uint32_t len)
+{
+    uint8_t buffer[MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE];
+    uint32_t copied = 0;
+
+    // Ensure the data referred to by the cursor still exists.
+    if (cursor.generation != generation || cursor.address < dataHead)
+        return DEVICE_INVALID_STATE;
+
+    while (copied < len)
+    {
+        // Return any text that has already been decoded.
+        if (cursor.pendingPosition < cursor.pendingLength)
+        {
+            uint32_t l = min(len - copied, (uint32_t) (cursor.pendingLength - cursor.pendingPosition));
+            memcpy(data + copied, &cursor.pending[cursor.pendingPosition], l);
+            cursor.pendingPosition += l;
+            copied += l;
+            continue;
+        }
 
-    const int dataLength = endOfDataChunk - startOfRowN;
-    char rows[dataLength];
-    cache.read(startOfRowN, rows, dataLength);
-    return ManagedString(rows, dataLength);
+        if (cursor.address >= cursor.end)
+            break;
+
+        // If the log holds only CSV text, read directly into the caller's buffer.
+        if (!cursor.decode)
+        {
+            uint32_t l = min(cursor.end - cursor.address, len - copied);
+            readLog(cursor.address, data + copied, l);
+            cursor.address += l;
+            copied += l;
+            continue;
+        }
+
+        // Otherwise, decode the next chunk of stored data, discarding any text that precedes the start of the range.
+        uint32_t l = min(cursor.end - cursor.address, (uint32_t) MICROBIT_LOG_ROW_SCAN_BUFFER_SIZE);
+        readLog(cursor.address, buffer, l);
+
+        cursor.pendingLength = 0;
+        cursor.pendingPosition = 0;
+
+        for (uint32_t i=0; i<l && cursor.pendingLength <= sizeof(cursor.pending) - MICROBIT_LOG_DECODE_MAX_LENGTH; i++)
+        {
+            int n = cursor.decoder.decode(buffer[i], &cursor.pending[cursor.pendingLength]);
+
+            if (cursor.address++ >= cursor.start)
+                cursor.pendingLength += n;
+        }
+    }
+
+    return copied;
 }
 
 /**
@@ -1233,7 +3021,28 @@ ManagedString MicroBitLog::getRows(uint32_t fromRowIndex, int nRows)
  */
 MicroBitLog::~MicroBitLog()
 {
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rowIndex);
+    if (rowIndex)
+        free(rowIndex);
+
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, writeBuffer);
+    if (writeBuffer)
+        free(writeBuffer);
+
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, rowBuffer);
+    if (rowBuffer)
+        free(rowBuffer);
+
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, mirrorBuffer);
+    if (mirrorBuffer)
+        free(mirrorBuffer);
+
+    for (uint32_t h=0; h<columnHandleCount; h++)
+        columnHandles[h].~ColumnHandle();
 
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_LOG, columnHandles);
+    if (columnHandles)
+        free(columnHandles);
 }
 
 #if (MICROBIT_LOG_MODE == 0)
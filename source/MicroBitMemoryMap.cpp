@@ -39,11 +39,31 @@ DEALINGS IN THE SOFTWARE.
 #include "sdk_config.h"
 #include "app_util.h"
 #include "crc32.h"
+#include <stddef.h>
 
 using namespace codal;
 
 #define MAX_STRING_LENGTH 100
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_MEMORY_MAP_CACHE)
+#define MICROBIT_MEMORY_MAP_CACHE_MAGIC     0x4D4D4150
+
+// The region table last built, retained across soft resets, along with the hash record it was built from.
+struct MicroBitMemoryMapCache
+{
+    uint32_t  magic;
+    uint32_t  programEnd;                   // FLASH_PROGRAM_END of the build that made the cache.
+    uint32_t  recordAddress;
+    uint32_t  recordLength;
+    uint32_t  recordHash;                   // CRC32 of the hash record.
+    uint32_t  regionCount;
+    uint8_t   store[sizeof(((MicroBitMemoryMap *) 0)->memoryMapStore)];
+    uint32_t  crc;                          // CRC32 of all of the above.
+};
+
+static MicroBitMemoryMapCache __attribute__ ((section (".noinit"))) microbit_memory_map_cache;
+#endif
+
 /**
   * Default constructor.
   *
@@ -51,9 +71,77 @@ using namespace codal;
   */
 MicroBitMemoryMap::MicroBitMemoryMap()
 {
+#if CONFIG_ENABLED(CONFIG_MICROBIT_MEMORY_MAP_CACHE)
+      if (loadCache())
+          return;
+#endif
+
       // Find Hashes
       findHashes();
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_MEMORY_MAP_CACHE)
+      storeCache();
+#endif
+}
+
+/**
+ * Restores the region table from the cache kept in no-init RAM, if it was built from the hash record now in flash.
+ *
+ * @return true if the cache was valid, false otherwise.
+ */
+bool MicroBitMemoryMap::loadCache()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_MEMORY_MAP_CACHE)
+    MicroBitMemoryMapCache &cache = microbit_memory_map_cache;
+
+    // RAM holds no meaningful data after a power on reset.
+    if (NRF_POWER->RESETREAS == 0)
+        cache.magic = 0;
+
+    if (cache.magic != MICROBIT_MEMORY_MAP_CACHE_MAGIC || cache.programEnd != FLASH_PROGRAM_END)
+        return false;
+
+    if (crc32_compute((const uint8_t *) &cache, offsetof(MicroBitMemoryMapCache, crc), NULL) != cache.crc)
+        return false;
+
+    // A reflash that changes any region also changes the record of their hashes, so checking it is enough.
+    if (crc32_compute((const uint8_t *) cache.recordAddress, cache.recordLength, NULL) != cache.recordHash)
+        return false;
+
+    memcpy(&memoryMapStore, cache.store, sizeof(memoryMapStore));
+    regionCount = cache.regionCount;
+    recordAddress = cache.recordAddress;
+    recordLength = cache.recordLength;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Saves the region table to the cache kept in no-init RAM, if a hash record was found.
+ */
+void MicroBitMemoryMap::storeCache()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_MEMORY_MAP_CACHE)
+    MicroBitMemoryMapCache &cache = microbit_memory_map_cache;
+
+    // Without a record there's nothing to validate the cache against, so leave the next boot to scan again.
+    cache.magic = 0;
+
+    if (recordLength == 0)
+        return;
+
+    cache.programEnd = FLASH_PROGRAM_END;
+    cache.recordAddress = recordAddress;
+    cache.recordLength = recordLength;
+    cache.recordHash = crc32_compute((const uint8_t *) recordAddress, recordLength, NULL);
+    cache.regionCount = regionCount;
+    memcpy(cache.store, &memoryMapStore, sizeof(memoryMapStore));
+    cache.magic = MICROBIT_MEMORY_MAP_CACHE_MAGIC;
+    cache.crc = crc32_compute((const uint8_t *) &cache, offsetof(MicroBitMemoryMapCache, crc), NULL);
+#endif
 }
 
 /**
@@ -146,6 +234,10 @@ void MicroBitMemoryMap::findHashes()
                 memcpy( memoryMapStore.memoryMap[1].hash, magicAddress + 4, 8);
                 memcpy( memoryMapStore.memoryMap[2].hash, magicAddress + 6, 8);
                 memoryMapStore.memoryMap[2].startAddress = (uint32_t)magicAddress;
+
+                // The magic and both hashes.
+                recordAddress = (uint32_t)magicAddress;
+                recordLength = 8 * sizeof(uint32_t);
                 return;
         }
        
@@ -162,11 +254,91 @@ void MicroBitMemoryMap::findHashes()
                processRecord(magicAddress - ((2 + i) * sizeof(magicAddress))); 
             }
 
+            // The layout records, and the header that follows them.
+            recordAddress = (uint32_t)(magicAddress - ((1 + nRegions) * sizeof(magicAddress)));
+            recordLength = (1 + nRegions) * sizeof(MicroPythonLayoutRecord);
+
         }
     }
 }
 
 
+/**
+ * Computes the hash of a page of flash, as used to decide whether a page need be flashed again.
+ *
+ * @param address The address of the page.
+ * @param length The size of the page, in bytes.
+ *
+ * @return The CRC32 of the contents of the page.
+ */
+uint32_t MicroBitMemoryMap::pageHash(uint32_t address, uint32_t length)
+{
+    return crc32_compute((const uint8_t *) address, length, NULL);
+}
+
+/**
+ * Compares the hashes of a series of consecutive pages against the current contents of flash.
+ *
+ * @param address The address of the first page.
+ * @param length The size of each page, in bytes.
+ * @param hashes The CRC32 of each page as it should be, e.g. as computed over a new program padded with 0xFF.
+ * @param count The number of hashes.
+ * @param differs A bitmap of at least (count + 7) / 8 bytes, in which the bit for each page that differs is set.
+ *
+ * @return The number of pages that differ.
+ */
+int MicroBitMemoryMap::comparePages(uint32_t address, uint32_t length, const uint32_t *hashes, int count, uint8_t *differs)
+{
+    int n = 0;
+
+    memset(differs, 0, (count + 7) / 8);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (pageHash(address + i * length, length) != hashes[i])
+        {
+            differs[i / 8] |= 1 << (i % 8);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Computes the hashes of consecutive pages of a region, so that a new build can be diffed against it a page at
+ * a time. The hashes may be fetched in several calls, e.g. to fit each into a BLE notification.
+ *
+ * @param regionId The id of the region, e.g. REGION_MAKECODE.
+ * @param hashes The array to store the CRC32 of each page in.
+ * @param count The maximum number of hashes to compute.
+ * @param first The index of the first page of the region to hash.
+ *
+ * @return The number of hashes computed, or MICROBIT_NO_DATA if the region is not in the map.
+ */
+int MicroBitMemoryMap::getPageHashes(uint8_t regionId, uint32_t *hashes, int count, int first)
+{
+    for (int i = 0; i < NUMBER_OF_REGIONS; i++)
+    {
+        Region &r = memoryMapStore.memoryMap[i];
+
+        if (r.regionId != regionId || r.endAddress <= r.startAddress)
+            continue;
+
+        // Pages are hashed from the start of the page holding the start of the region, to match how they are flashed.
+        uint32_t start = r.startAddress - (r.startAddress % MICROBIT_CODEPAGESIZE);
+        int pages = (r.endAddress - start + MICROBIT_CODEPAGESIZE - 1) / MICROBIT_CODEPAGESIZE;
+        int n = 0;
+
+        for (int page = first; page < pages && n < count; page++)
+            hashes[n++] = pageHash(start + page * MICROBIT_CODEPAGESIZE, MICROBIT_CODEPAGESIZE);
+
+        return n;
+    }
+
+    return MICROBIT_NO_DATA;
+}
+
 /*
  * Function to process record from uPy build
  * @return MICROBIT_OK success, MICROBIT_INVALID_PARAM if the region.id is too great
@@ -0,0 +1,275 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitMicrophoneDecimator.h"
+#include "CodalCompat.h"
+#include "codal_target_hal.h"
+#include "ErrorNo.h"
+#include <string.h>
+
+using namespace codal;
+
+// The sample rate assumed for the upstream source, until it is able to report one.
+#ifndef CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE
+#define CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE  44100
+#endif
+
+// The number of fractional bits in the reciprocal of the CIC gain.
+#define DECIMATOR_SCALE_BITS        24
+
+/**
+ * Constructor.
+ *
+ * @param source The raw microphone stream to consume, e.g. a channel of MicroBitAudio::rawSplitter.
+ * @param sampleRate The output sample rate to aim for. The rate delivered is the nearest integer division of the
+ * input rate, as reported by getSampleRate().
+ */
+MicroBitMicrophoneDecimator::MicroBitMicrophoneDecimator(DataSource &source, float sampleRate) : upstream(source)
+{
+    downstream = NULL;
+    active = false;
+    requestedRate = sampleRate > 0.0f ? sampleRate : 16000;
+
+    configure();
+}
+
+/**
+ * Destructor. Disconnects from the microphone, if connected.
+ */
+MicroBitMicrophoneDecimator::~MicroBitMicrophoneDecimator()
+{
+    disconnect();
+}
+
+/**
+ * Determines the decimation factor for the requested rate, and resets the filter.
+ */
+void MicroBitMicrophoneDecimator::configure()
+{
+    inputRate = upstream.getSampleRate();
+    if (inputRate <= 0.0f)
+        inputRate = CONFIG_MIXER_DEFAULT_CHANNEL_SAMPLERATE;
+
+    factor = (int) (inputRate / requestedRate + 0.5f);
+    factor = max(1, min(factor, MICROBIT_MICROPHONE_DECIMATOR_MAX_FACTOR));
+
+    uint32_t gain = 1;
+    for (int i = 0; i < CONFIG_MICROPHONE_DECIMATOR_ORDER; i++)
+        gain *= factor;
+
+    scale = (int32_t) ((1 << DECIMATOR_SCALE_BITS) / gain);
+    phase = 0;
+
+    memset(integrator, 0, sizeof(integrator));
+    memset(comb, 0, sizeof(comb));
+}
+
+/**
+ * Changes the output sample rate. The filter is reset, so there is a short transient in the output.
+ *
+ * @param sampleRate The output sample rate to aim for.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the rate is not positive.
+ */
+int MicroBitMicrophoneDecimator::setSampleRate(float sampleRate)
+{
+    if (sampleRate <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (sampleRate == requestedRate)
+        return DEVICE_OK;
+
+    // Buffers are decimated from within the ADC's interrupt context, so don't let one arrive half way through.
+    target_disable_irq();
+    requestedRate = sampleRate;
+    configure();
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the decimation factor in use, i.e. the number of input samples consumed per output sample.
+ *
+ * @return The decimation factor.
+ */
+int MicroBitMicrophoneDecimator::getDecimationFactor()
+{
+    return factor;
+}
+
+/**
+ * Provide the most recent buffer of decimated samples to our downstream caller.
+ */
+ManagedBuffer MicroBitMicrophoneDecimator::pull()
+{
+    return output;
+}
+
+/**
+ * Define a downstream component for the decimated stream. Connecting enables the microphone.
+ *
+ * @param sink The component that data will be delivered to.
+ */
+void MicroBitMicrophoneDecimator::connect(DataSink &sink)
+{
+    downstream = &sink;
+
+    // Connecting to the splitter channel is what enables the microphone, so only do so once we have a consumer.
+    if (!active)
+    {
+        active = true;
+        upstream.connect(*this);
+    }
+}
+
+/**
+ * Disconnects the downstream component. The microphone is disabled once it has no other consumers.
+ */
+void MicroBitMicrophoneDecimator::disconnect()
+{
+    if (active)
+    {
+        active = false;
+        upstream.disconnect();
+    }
+
+    downstream = NULL;
+    output = ManagedBuffer();
+}
+
+/**
+ * Determines the format of the decimated samples.
+ *
+ * @return DATASTREAM_FORMAT_16BIT_SIGNED.
+ */
+int MicroBitMicrophoneDecimator::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Determines the sample rate of the decimated stream.
+ *
+ * @return The input sample rate divided by the decimation factor.
+ */
+float MicroBitMicrophoneDecimator::getSampleRate()
+{
+    return inputRate / factor;
+}
+
+/**
+ * Runs a buffer of samples through the CIC filter, writing an output sample for every factor input samples.
+ * The integrators and combs work in modulo 2^32 arithmetic, which is exact for as long as the true result fits.
+ */
+template <typename T>
+int16_t *MicroBitMicrophoneDecimator::decimate(const T *data, int len, int32_t bias, int16_t *out)
+{
+    uint32_t acc[CONFIG_MICROPHONE_DECIMATOR_ORDER];
+    int p = phase;
+
+    memcpy(acc, integrator, sizeof(acc));
+
+    for (int i = 0; i < len; i++)
+    {
+        uint32_t v = (uint32_t) ((int32_t) data[i] - bias);
+
+        for (int k = 0; k < CONFIG_MICROPHONE_DECIMATOR_ORDER; k++)
+            v = acc[k] += v;
+
+        if (++p == factor)
+        {
+            p = 0;
+
+            for (int k = 0; k < CONFIG_MICROPHONE_DECIMATOR_ORDER; k++)
+            {
+                uint32_t d = v - comb[k];
+                comb[k] = v;
+                v = d;
+            }
+
+            int32_t s = (int32_t) (((int64_t) (int32_t) v * scale) >> DECIMATOR_SCALE_BITS);
+            *out++ = (int16_t) (s < -32768 ? -32768 : s > 32767 ? 32767 : s);
+        }
+    }
+
+    memcpy(integrator, acc, sizeof(acc));
+    phase = p;
+
+    return out;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int MicroBitMicrophoneDecimator::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (!active)
+        return DEVICE_OK;
+
+    // Pick up the real input rate once the source is flowing, if it couldn't be determined beforehand.
+    if (upstream.getSampleRate() > 0.0f && upstream.getSampleRate() != inputRate)
+        configure();
+
+    int format = upstream.getFormat();
+    int len = b.length() / DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int samples = (phase + len) / factor;
+
+    ManagedBuffer decimated(samples * sizeof(int16_t));
+    int16_t *out = (int16_t *) &decimated[0];
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            decimate((const int8_t *) &b[0], len, 0, out);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            decimate((const uint8_t *) &b[0], len, 128, out);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            decimate((const int16_t *) &b[0], len, 0, out);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            decimate((const uint16_t *) &b[0], len, 32768, out);
+            break;
+
+        default:
+            return DEVICE_NOT_SUPPORTED;
+    }
+
+    // Only hand on buffers that hold something, so consumers are woken at the reduced rate.
+    if (samples == 0)
+        return DEVICE_OK;
+
+    output = decimated;
+
+    if (downstream)
+        downstream->pullRequest();
+
+    return DEVICE_OK;
+}
@@ -0,0 +1,215 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitMicrophoneStream.h"
+#include "ErrorNo.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace codal;
+
+// Accumulates the sum, sum of squares and range of a buffer of samples of the given type, in a single pass.
+template <typename T>
+static void measure(const T *data, int len, int32_t bias, int64_t &sum, uint64_t &squares, int32_t &lo, int32_t &hi)
+{
+    for (int i = 0; i < len; i++)
+    {
+        int32_t v = (int32_t) data[i] - bias;
+
+        sum += v;
+        squares += (uint64_t) ((int64_t) v * v);
+
+        if (v < lo)
+            lo = v;
+        if (v > hi)
+            hi = v;
+    }
+}
+
+/**
+ * Constructor.
+ *
+ * @param source The raw microphone stream to consume, e.g. a channel of MicroBitAudio::rawSplitter.
+ */
+MicroBitMicrophoneStream::MicroBitMicrophoneStream(DataSource &source) : upstream(source)
+{
+    handler = NULL;
+    context = NULL;
+    active = false;
+    memset(&level, 0, sizeof(level));
+}
+
+/**
+ * Destructor. Stops the stream, if running.
+ */
+MicroBitMicrophoneStream::~MicroBitMicrophoneStream()
+{
+    stop();
+}
+
+/**
+ * Starts streaming, enabling the microphone if necessary.
+ *
+ * @param handler The function to invoke with each buffer of samples, or NULL to only record the most recent.
+ * @param context A pointer passed to the handler with each buffer.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitMicrophoneStream::start(MicrophoneStreamHandler handler, void *context)
+{
+    this->handler = handler;
+    this->context = context;
+
+    // Connecting to the splitter channel is what enables the microphone.
+    if (!active)
+    {
+        active = true;
+        upstream.connect(*this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops streaming. The microphone is disabled once it has no other consumers.
+ *
+ * @return DEVICE_OK on success.
+ */
+int MicroBitMicrophoneStream::stop()
+{
+    if (active)
+    {
+        active = false;
+        upstream.disconnect();
+    }
+
+    handler = NULL;
+    last = ManagedBuffer();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if the stream is running.
+ *
+ * @return true if started, false otherwise.
+ */
+bool MicroBitMicrophoneStream::isStreaming()
+{
+    return active;
+}
+
+/**
+ * Provides the most recent buffer of samples received, without copying it.
+ *
+ * @return The most recent buffer, or an empty buffer if none has been received.
+ */
+ManagedBuffer MicroBitMicrophoneStream::getBuffer()
+{
+    return last;
+}
+
+/**
+ * Provides the level of the most recent buffer of samples received.
+ *
+ * @return The level, which is all zero if no buffer has been received.
+ */
+MicrophoneLevel MicroBitMicrophoneStream::getLevel()
+{
+    return level;
+}
+
+/**
+ * Determines the format of the samples in each buffer.
+ *
+ * @return The data format, e.g. DATASTREAM_FORMAT_16BIT_SIGNED.
+ */
+int MicroBitMicrophoneStream::getFormat()
+{
+    return upstream.getFormat();
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int MicroBitMicrophoneStream::pullRequest()
+{
+    // We ask for the stream in its native format and rate, so the splitter hands on the ADC's own buffer rather than a converted copy.
+    ManagedBuffer b = upstream.pull();
+
+    if (!active)
+        return DEVICE_OK;
+
+    int64_t sum = 0;
+    uint64_t squares = 0;
+    int32_t lo = INT32_MAX;
+    int32_t hi = INT32_MIN;
+    int len = 0;
+
+    switch (upstream.getFormat())
+    {
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            len = b.length();
+            measure((const int8_t *) &b[0], len, 0, sum, squares, lo, hi);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            len = b.length();
+            measure((const uint8_t *) &b[0], len, 128, sum, squares, lo, hi);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            len = b.length() / 2;
+            measure((const int16_t *) &b[0], len, 0, sum, squares, lo, hi);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            len = b.length() / 2;
+            measure((const uint16_t *) &b[0], len, 32768, sum, squares, lo, hi);
+            break;
+    }
+
+    if (len > 0)
+    {
+        // Measure about the mean, so the DC offset of the microphone doesn't count towards its level.
+        float mean = (float) sum / len;
+        float variance = (float) squares / len - mean * mean;
+
+        level.samples = len;
+        level.mean = (int) mean;
+        level.rms = variance > 0.0f ? (int) sqrtf(variance) : 0;
+        level.peak = (int) ((hi - mean) > (mean - lo) ? (hi - mean) : (mean - lo));
+    }
+    else
+    {
+        memset(&level, 0, sizeof(level));
+    }
+
+    last = b;
+
+    if (handler)
+        handler(b, level, context);
+
+    return DEVICE_OK;
+}
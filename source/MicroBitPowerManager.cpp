@@ -23,8 +23,14 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "MicroBitPowerManager.h"
+#include "MicroBitBootProfile.h"
+#include "MicroBitTrace.h"
 #include "MicroBit.h"
 
+#ifdef SOFTDEVICE_PRESENT
+#include "nrf_soc.h"
+#endif
+
 using namespace codal;
 
 static const uint8_t UIPM_I2C_NOP[3] = {0,0,0};
@@ -58,30 +64,65 @@ MicroBitPowerManager::MicroBitPowerManager(MicroBitI2C &i2c, MicroBitIO &ioPins,
     sysTimer(&systemTimer), 
     powerDownDisableCount(0),
     powerUpTime(0),
-    eventValue(0)
+    eventValue(0),
+    cacheTime(CONFIG_MICROBIT_POWER_DATA_CACHE_TIME),
+    irqEventCount(0),
+    refreshRequests(0),
+    powerSourceTime(0),
+    powerDataTime(0),
+    usbStatusTime(0)
 {
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_POWER_MANAGER);
+
     this->id = id;
 
     memset( &powerData, 0, sizeof(powerData) );
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    periodicTaskCount = 0;
+#endif
+
     // Indicate we'd like to receive periodic callbacks both in idle and interrupt context.
     // Also, be pessimistic about the interface chip in use, until we obtain version information.
     status |= (DEVICE_COMPONENT_STATUS_IDLE_TICK | MICROBIT_USB_INTERFACE_ALWAYS_NOP);
+
+    resetStats();
+    resetDeepSleepProfile();
+
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_POWER_MANAGER);
 }
 
 /**
  * Attempts to determine the power source currently in use on this micro:bit.
- * note: This will query the USB interface chip via I2C, and wait for completion.
+ * note: This will query the USB interface chip via I2C, and wait for completion, unless a recently cached value is available.
  * 
  * @return the current power source used by this micro:bit
  */
 MicroBitPowerSource MicroBitPowerManager::getPowerSource()
+{
+    if (isCached(MICROBIT_USB_INTERFACE_POWER_SOURCE_CACHED, powerSourceTime))
+        return powerSource;
+
+    return readPowerSource();
+}
+
+/**
+ * Query the interface chip for the current power source, updating the cached value.
+ */
+MicroBitPowerSource MicroBitPowerManager::readPowerSource()
 {
     ManagedBuffer b;
     b = readProperty(MICROBIT_UIPM_PROPERTY_POWER_SOURCE);
 
     powerSource = (MicroBitPowerSource)b[3];
 
+    // Only cache valid responses.
+    if (b.length() > 3 && b[0] == MICROBIT_UIPM_COMMAND_READ_RESPONSE)
+    {
+        powerSourceTime = system_timer_current_time();
+        status |= MICROBIT_USB_INTERFACE_POWER_SOURCE_CACHED;
+    }
+
     return powerSource;
 }
 
@@ -95,22 +136,20 @@ MicroBitVersion MicroBitPowerManager::getVersion()
 {
     if (!(status & MICROBIT_USB_INTERFACE_VERSION_LOADED))
     {
-        ManagedBuffer b;
-        
-        // Read Board Revision ID
-        b = readProperty(MICROBIT_UIPM_PROPERTY_BOARD_REVISION);
-        memcpy(&version.board, &b[3], 2);
+        MicroBitVersion v = version;
+
+        // Read Board Revision ID, I2C protocol version and DAPLink version.
+        // If any read fails, leave the version unloaded so that it is read again next time.
+        if (readProperty(MICROBIT_UIPM_PROPERTY_BOARD_REVISION, &v.board, 2) != MICROBIT_OK ||
+            readProperty(MICROBIT_UIPM_PROPERTY_I2C_VERSION, &v.i2c, 2) != MICROBIT_OK ||
+            readProperty(MICROBIT_UIPM_PROPERTY_DAPLINK_VERSION, &v.daplink, 2) != MICROBIT_OK)
+            return version;
+
+        version = v;
 
-        // Read I2C protocol version 
-        b = readProperty(MICROBIT_UIPM_PROPERTY_I2C_VERSION);
-        memcpy(&version.i2c, &b[3], 2);
         if( version.i2c == 2 )
             status |= MICROBIT_USB_INTERFACE_BUSY_FLAG_SUPPORTED;
 
-        // Read DAPLink version
-        b = readProperty(MICROBIT_UIPM_PROPERTY_DAPLINK_VERSION);
-        memcpy(&version.daplink, &b[3], 2);
-
         // Version data in non-volatile, so cache it for later.
         status |= MICROBIT_USB_INTERFACE_VERSION_LOADED;
 
@@ -132,16 +171,35 @@ MicroBitVersion MicroBitPowerManager::getVersion()
 
 /**
  * Attempts to determine the status of the USB interface on this micro:bit.
- * note: This will query the USB interface chip via I2C, and wait for completion.
+ * note: This will query the USB interface chip via I2C, and wait for completion, unless a recently cached value is available.
  * 
  * @return the current status of the USB interface on this micro:bit
  */
 MicroBitUSBStatus MicroBitPowerManager::getUSBStatus()
+{
+    if (isCached(MICROBIT_USB_INTERFACE_USB_STATUS_CACHED, usbStatusTime))
+        return usbStatus;
+
+    return readUSBStatus();
+}
+
+/**
+ * Query the interface chip for the current USB status, updating the cached value.
+ */
+MicroBitUSBStatus MicroBitPowerManager::readUSBStatus()
 {
     ManagedBuffer b;
     b = readProperty(MICROBIT_UIPM_PROPERTY_USB_STATE);
 
     usbStatus = (MicroBitUSBStatus)b[3];
+
+    // Only cache valid responses.
+    if (b.length() > 3 && b[0] == MICROBIT_UIPM_COMMAND_READ_RESPONSE)
+    {
+        usbStatusTime = system_timer_current_time();
+        status |= MICROBIT_USB_INTERFACE_USB_STATUS_CACHED;
+    }
+
     return usbStatus;
 }
 
@@ -153,17 +211,104 @@ uint32_t MicroBitPowerManager::getPowerConsumption()
 
 MicroBitPowerData MicroBitPowerManager::getPowerData()
 {
-    ManagedBuffer b;
-    b = readProperty(MICROBIT_UIPM_PROPERTY_POWER_CONSUMPTION);
+    if (isCached(MICROBIT_USB_INTERFACE_POWER_DATA_CACHED, powerDataTime))
+        return powerData;
 
-    memcpy( &powerData.batteryMicroVolts, &b[3], 4 );
-    memcpy( &powerData.vinMicroVolts, &b[3+4], 4 );
-    
-    powerData.estimatedPowerConsumption = (float)abs( (float)powerData.vinMicroVolts - (float)powerData.batteryMicroVolts );
+    return readPowerData();
+}
+
+/**
+ * Query the interface chip for the current power data, updating the cached value.
+ */
+MicroBitPowerData MicroBitPowerManager::readPowerData()
+{
+    uint32_t microVolts[2];
+
+    // Only use (and cache) valid responses. Otherwise the last values read are returned.
+    if (readProperty(MICROBIT_UIPM_PROPERTY_POWER_CONSUMPTION, microVolts, 8) == MICROBIT_OK)
+    {
+        powerData.batteryMicroVolts = microVolts[0];
+        powerData.vinMicroVolts = microVolts[1];
+        powerData.estimatedPowerConsumption = (float)abs( (float)powerData.vinMicroVolts - (float)powerData.batteryMicroVolts );
+
+        powerDataTime = system_timer_current_time();
+        status |= MICROBIT_USB_INTERFACE_POWER_DATA_CACHED;
+    }
 
     return powerData;
 }
 
+/**
+ * Defines how long values returned by getPowerSource(), getPowerData() and getUSBStatus() are reused before
+ * the interface chip is queried again. Values older than half this time are refreshed in the background.
+ *
+ * @param ms the time to reuse values for, in milliseconds, or 0 to always query the interface chip.
+ */
+void MicroBitPowerManager::setCacheTime(uint32_t ms)
+{
+    cacheTime = ms;
+}
+
+/**
+ * Determines if a cached value may be returned, scheduling a background refresh if it is becoming stale.
+ *
+ * @param flag the status flag indicating the value is cached.
+ * @param timestamp the time the value was read.
+ * @return true if the cached value is valid, false if the interface chip must be queried.
+ */
+bool MicroBitPowerManager::isCached(uint16_t flag, CODAL_TIMESTAMP timestamp)
+{
+    if (cacheTime == 0 || !(status & flag))
+        return false;
+
+    CODAL_TIMESTAMP age = system_timer_current_time() - timestamp;
+
+    if (age >= cacheTime)
+        return false;
+
+    // Refresh values in the background before they expire, so that regular pollers always see a cached value.
+    if (age >= cacheTime / 2)
+    {
+        refreshRequests |= flag;
+
+        if (!(status & MICROBIT_USB_INTERFACE_REFRESHING))
+        {
+            status |= MICROBIT_USB_INTERFACE_REFRESHING;
+            create_fiber(MicroBitPowerManager::refreshTask, this);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Refreshes the cached values that are becoming stale.
+ * Runs in its own fiber, started by isCached().
+ *
+ * @param manager the MicroBitPowerManager to refresh.
+ */
+void MicroBitPowerManager::refreshTask(void *manager)
+{
+    MicroBitPowerManager *m = (MicroBitPowerManager *) manager;
+
+    while (m->refreshRequests)
+    {
+        uint16_t requests = m->refreshRequests;
+        m->refreshRequests = 0;
+
+        if (requests & MICROBIT_USB_INTERFACE_POWER_SOURCE_CACHED)
+            m->readPowerSource();
+
+        if (requests & MICROBIT_USB_INTERFACE_POWER_DATA_CACHED)
+            m->readPowerData();
+
+        if (requests & MICROBIT_USB_INTERFACE_USB_STATUS_CACHED)
+            m->readUSBStatus();
+    }
+
+    m->status &= ~MICROBIT_USB_INTERFACE_REFRESHING;
+}
+
 /**
  * Perform a NULL opertion I2C transaction with the interface chip if needed.
  * This is used to awken the KL27 interface chip from light sleep, 
@@ -176,7 +321,9 @@ void MicroBitPowerManager::nop()
     if (status & MICROBIT_USB_INTERFACE_ALWAYS_NOP)
     {
         uint8_t unused;
+        i2cBus.acquire(MICROBIT_I2C_PRIORITY_CONTROL);
         i2cBus.write(MICROBIT_UIPM_I2C_ADDRESS, &unused, 0, false);
+        i2cBus.release();
     }
 }
 
@@ -188,7 +335,12 @@ void MicroBitPowerManager::nop()
 int MicroBitPowerManager::sendUIPMPacket(ManagedBuffer packet)
 {
     nop();
-    return i2cBus.write(MICROBIT_UIPM_I2C_ADDRESS, &packet[0], packet.length(), false);
+
+    i2cBus.acquire(MICROBIT_I2C_PRIORITY_CONTROL);
+    int result = i2cBus.write(MICROBIT_UIPM_I2C_ADDRESS, &packet[0], packet.length(), false);
+    i2cBus.release();
+
+    return result;
 }
 
 /**
@@ -205,7 +357,12 @@ ManagedBuffer MicroBitPowerManager::recvUIPMPacket()
         ManagedBuffer b(MICROBIT_UIPM_MAX_BUFFER_SIZE);
 
         nop();  
-        if (i2cBus.read(MICROBIT_UIPM_I2C_ADDRESS, &b[0], MICROBIT_UIPM_MAX_BUFFER_SIZE, false) == MICROBIT_OK)
+
+        i2cBus.acquire(MICROBIT_I2C_PRIORITY_CONTROL);
+        int result = i2cBus.read(MICROBIT_UIPM_I2C_ADDRESS, &b[0], MICROBIT_UIPM_MAX_BUFFER_SIZE, false);
+        i2cBus.release();
+
+        if (result == MICROBIT_OK)
             return b;
     }
 
@@ -214,14 +371,20 @@ ManagedBuffer MicroBitPowerManager::recvUIPMPacket()
 
 /**
  * Awaits a response to a previous requests to the USB interface chip.
- * Up to MICROBIT_UIPM_MAX_RETRIES attempts will be made at ~1ms intervals.
+ * Up to MICROBIT_UIPM_MAX_RETRIES attempts will be made, each as soon as the IRQ line falls, or after ~1ms.
  * 
  * @return A buffer containing the complete response.
  */
-ManagedBuffer MicroBitPowerManager::awaitUIPMPacket()
+ManagedBuffer MicroBitPowerManager::awaitUIPMPacket(int property)
 {
     ManagedBuffer response;
     int attempts = 0;
+    int polls = 0;
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+    int busy = 0;
+    MicroBitInterfaceStats &s = stats[property >= 0 && property < MICROBIT_UIPM_STATS_SIZE ? property : 0];
+#endif
 
     awaitingPacket(true);
 
@@ -229,7 +392,9 @@ ManagedBuffer MicroBitPowerManager::awaitUIPMPacket()
     // Retry until we get a valid response or we time out.
     while( attempts++ < MICROBIT_UIPM_MAX_RETRIES )
     {
-        target_wait(1);
+        // If the response is already signalled, collect it straight away. Otherwise, give the KL27 a little time.
+        if (polls++ > 0 || !io.irq1.isActive())
+            awaitResponseIrq();
 
         // Try to read a response from the KL27
         response = recvUIPMPacket();
@@ -244,6 +409,9 @@ ManagedBuffer MicroBitPowerManager::awaitUIPMPacket()
             // Is the KL27 still busy processing something? If so, reset the retries and go again.
             if( (status & MICROBIT_USB_INTERFACE_BUSY_FLAG_SUPPORTED) == MICROBIT_USB_INTERFACE_BUSY_FLAG_SUPPORTED && response[1] == MICROBIT_UIPM_BUSY )
             {
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+                busy++;
+#endif
                 attempts = 0;
                 continue;
             }
@@ -255,6 +423,9 @@ ManagedBuffer MicroBitPowerManager::awaitUIPMPacket()
         // Sanitize the length of the packet to meet specification and return it.
         response.truncate((response[0] == MICROBIT_UIPM_COMMAND_ERROR_RESPONSE || response[0] == MICROBIT_UIPM_COMMAND_WRITE_RESPONSE) ? 2 : 3 + uipmPropertyLengths.get(response[1]));
         awaitingPacket(false);
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+        microbit_interface_stats_record(s, start, polls - 1, busy, true);
+#endif
 
         return response;
     }
@@ -265,6 +436,9 @@ ManagedBuffer MicroBitPowerManager::awaitUIPMPacket()
     error[0] = MICROBIT_UIPM_COMMAND_ERROR_RESPONSE;
     error[1] = MICROBIT_UIPM_WRITE_FAIL;
     awaitingPacket(false);
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    microbit_interface_stats_record(s, start, polls - 1, busy, false);
+#endif
 
     return error;
 }
@@ -281,7 +455,7 @@ ManagedBuffer MicroBitPowerManager::writeProperty(ManagedBuffer request, bool ac
 
     if (sendUIPMPacket(request) == MICROBIT_OK && ack)
     {
-        response = awaitUIPMPacket();
+        response = awaitUIPMPacket(request.length() > 1 ? request[1] : 0);
     }
 
     return response;
@@ -301,11 +475,31 @@ ManagedBuffer MicroBitPowerManager::readProperty(int property)
     request[1] = property;
 
     if (sendUIPMPacket(request) == MICROBIT_OK)
-        response = awaitUIPMPacket();
+        response = awaitUIPMPacket(property);
     
     return response;
 }
         
+/**
+ * Reads a property from the USB interface chip, and copies its value out of the response.
+ * @param property The property to read
+ * @param value The location to copy the value to, left unchanged if the read fails
+ * @param length The length of the value, in bytes
+ * @return MICROBIT_OK on success, or MICROBIT_I2C_ERROR if no valid response of at least that length was received
+ */
+int MicroBitPowerManager::readProperty(int property, void *value, int length)
+{
+    ManagedBuffer b = readProperty(property);
+
+    // The value follows the command, property and length bytes.
+    if (b.length() < 3 + length || b[0] != MICROBIT_UIPM_COMMAND_READ_RESPONSE || b[1] != property)
+        return MICROBIT_I2C_ERROR;
+
+    memcpy(value, &b[3], length);
+
+    return MICROBIT_OK;
+}
+
 /**
  * Powers down the CPU and USB interface and enters OFF state. All user code and peripherals will cease operation. 
  * Device can subsequently be awoken only via a RESET. User program state will be lost and will restart
@@ -345,6 +539,20 @@ void MicroBitPowerManager::idleCallback()
 {
     static int activeCount = 0;
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_USB_INTERFACE_IRQ_EVENTS)
+    // Requests are detected from edges on the IRQ line, so there is no need to poll.
+    // We register here rather than in the constructor, as the message bus may not yet exist at that point.
+    if (!(status & MICROBIT_USB_INTERFACE_IRQ_LISTENER) && EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->listen(io.irq1.id, DEVICE_PIN_EVT_FALL, this, &MicroBitPowerManager::onInterfaceIrq);
+        enableIrqEvents(true);
+        status |= MICROBIT_USB_INTERFACE_IRQ_LISTENER;
+    }
+
+    if (status & MICROBIT_USB_INTERFACE_IRQ_LISTENER)
+        return;
+#endif
+
     // Do nothing if there is a transaction in progress.
     if (status & MICROBIT_USB_INTERFACE_AWAITING_RESPONSE || !io.irq1.isActive())
     {
@@ -364,6 +572,80 @@ void MicroBitPowerManager::idleCallback()
     readInterfaceRequest();
 }
 
+/**
+ * Event handler, called when the shared IRQ line falls. Checks the interface chip for a request,
+ * unless the line is released within MICROBIT_USB_INTERFACE_IRQ_DEBOUNCE, or a transaction is in progress.
+ */
+void MicroBitPowerManager::onInterfaceIrq(Event)
+{
+    // The response to a transaction in progress is consumed by the fiber awaiting it.
+    if (status & MICROBIT_USB_INTERFACE_AWAITING_RESPONSE)
+        return;
+
+    // Interrupts from the motion sensors are short lived, so only query the interface chip if the line stays active.
+    fiber_sleep(MICROBIT_USB_INTERFACE_IRQ_DEBOUNCE);
+    readInterfaceRequest();
+}
+
+/**
+ * Blocks the calling fiber until the shared IRQ line falls, or ~1ms has elapsed.
+ * Falls back to a 1ms busy wait if the calling context cannot block.
+ */
+void MicroBitPowerManager::awaitResponseIrq()
+{
+    if (!fiber_scheduler_running() || (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) || !EventModel::defaultEventBus)
+    {
+        target_wait(1);
+        return;
+    }
+
+    // n.b. the IRQ line is shared with the motion sensors, so edge events are only requested while we wait.
+    if (!(status & MICROBIT_USB_INTERFACE_RESPONSE_LISTENER))
+    {
+        EventModel::defaultEventBus->listen(io.irq1.id, DEVICE_PIN_EVT_FALL, this, &MicroBitPowerManager::onResponseIrq, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        status |= MICROBIT_USB_INTERFACE_RESPONSE_LISTENER;
+    }
+
+    enableIrqEvents(true);
+
+    // The timeout covers edges missed before the fiber started waiting, and the line being held by another device.
+    system_timer_event_after(1, id, MICROBIT_POWER_EVT_UIPM_RESPONSE);
+    fiber_wait_for_event(id, MICROBIT_POWER_EVT_UIPM_RESPONSE);
+    system_timer_cancel_event(id, MICROBIT_POWER_EVT_UIPM_RESPONSE);
+
+    enableIrqEvents(false);
+}
+
+/**
+ * Event handler, called when the shared IRQ line falls while a response is awaited.
+ */
+void MicroBitPowerManager::onResponseIrq(Event)
+{
+    if (status & MICROBIT_USB_INTERFACE_AWAITING_RESPONSE)
+        Event(id, MICROBIT_POWER_EVT_UIPM_RESPONSE);
+}
+
+/**
+ * Allows a subsystem to request that events are raised on edges of the shared IRQ line.
+ * Requests are reference counted, so edge events remain enabled until every subsystem that enabled them
+ * has disabled them again.
+ *
+ * @param enable true to request edge events, false to release a previous request.
+ */
+void MicroBitPowerManager::enableIrqEvents(bool enable)
+{
+    if (enable)
+    {
+        if (irqEventCount++ == 0)
+            io.irq1.eventOn(DEVICE_PIN_EVENT_ON_EDGE);
+    }
+    else if (irqEventCount > 0)
+    {
+        if (--irqEventCount == 0)
+            io.irq1.eventOn(DEVICE_PIN_EVENT_NONE);
+    }
+}
+
 /**
  * Service any IRQ requests raised by the USB interface chip.
  */
@@ -384,7 +666,9 @@ void MicroBitPowerManager::readInterfaceRequest()
         // We have a valid frame.
         if(response[0] == MICROBIT_UIPM_COMMAND_READ_RESPONSE && response[1] == MICROBIT_UIPM_PROPERTY_KL27_USER_EVENT && response[2] == 1)
         {
-            // The frame is for us - process the event.
+            // The frame is for us - notify any interested listeners, then process the event.
+            Event(id, response[3]);
+
             switch (response[3])
             {
                 case MICROBIT_UIPM_EVENT_WAKE_RESET:
@@ -444,6 +728,281 @@ void MicroBitPowerManager::awaitingPacket(bool awaiting)
         status &= ~MICROBIT_USB_INTERFACE_AWAITING_RESPONSE;
 }
 
+/**
+ * Retrieves statistics on transactions with the USB interface chip's control interface for a given property.
+ * Statistics are only collected if CONFIG_MICROBIT_INTERFACE_STATS is enabled.
+ *
+ * @param property the property to query (one of MICROBIT_UIPM_PROPERTY_*).
+ * @return the statistics for the given property, or NULL if statistics are disabled or the property is invalid.
+ */
+const MicroBitInterfaceStats *MicroBitPowerManager::getStats(int property)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    if (property >= 0 && property < MICROBIT_UIPM_STATS_SIZE)
+        return &stats[property];
+#endif
+
+    return NULL;
+}
+
+/**
+ * Reset all transaction statistics to zero.
+ */
+void MicroBitPowerManager::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    memset(stats, 0, sizeof(stats));
+#endif
+}
+
+/**
+ * Print the statistics for each property with recorded transactions to the given serial port.
+ *
+ * @param serial the serial port to print to.
+ */
+void MicroBitPowerManager::printStats(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    microbit_interface_stats_print(serial, "UIPM", stats, MICROBIT_UIPM_STATS_SIZE);
+#else
+    serial.printf("UIPM: statistics disabled\r\n");
+#endif
+}
+
+/**
+ * Record the completion of a transaction with the USB interface chip.
+ *
+ * @param stats the statistics to update.
+ * @param start the time the transaction started, in microseconds.
+ * @param retries the number of additional attempts made.
+ * @param busy the number of busy responses received.
+ * @param ok true if the transaction succeeded, false otherwise.
+ */
+void codal::microbit_interface_stats_record(MicroBitInterfaceStats &stats, CODAL_TIMESTAMP start, int retries, int busy, bool ok)
+{
+    uint32_t latency = (uint32_t) (system_timer_current_time_us() - start);
+    int bucket = 0;
+
+    while (bucket < MICROBIT_INTERFACE_STATS_BUCKETS - 1 && latency >= ((uint32_t) MICROBIT_INTERFACE_STATS_BUCKET_US << bucket))
+        bucket++;
+
+    stats.count++;
+    stats.retries += retries;
+    stats.busy += busy;
+    stats.latency[bucket]++;
+
+    if (!ok)
+        stats.failures++;
+}
+
+/**
+ * Print a table of the given statistics to a serial port, one line per command.
+ *
+ * @param serial the serial port to print to.
+ * @param name a label printed at the start of each line.
+ * @param stats an array of statistics, indexed by command.
+ * @param count the number of elements in stats.
+ */
+void codal::microbit_interface_stats_print(Serial &serial, const char *name, MicroBitInterfaceStats *stats, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (stats[i].count == 0)
+            continue;
+
+        serial.printf("%s [0x%x]: count %d retries %d busy %d failures %d latency", name, i, stats[i].count, stats[i].retries, stats[i].busy, stats[i].failures);
+
+        for (int b = 0; b < MICROBIT_INTERFACE_STATS_BUCKETS; b++)
+            serial.printf(" %d", stats[i].latency[b]);
+
+        serial.printf("\r\n");
+    }
+}
+
+/**
+ * Retrieves timing information for each phase of deep sleep entry and exit.
+ * Timings are only collected if CONFIG_MICROBIT_DEEPSLEEP_PROFILE is enabled.
+ *
+ * @return the deep sleep profile, or NULL if profiling is disabled.
+ */
+const MicroBitDeepSleepProfile *MicroBitPowerManager::getDeepSleepProfile()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    return &profile;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Reset the deep sleep profile.
+ */
+void MicroBitPowerManager::resetDeepSleepProfile()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    memset(&profile, 0, sizeof(profile));
+#endif
+}
+
+/**
+ * Print the deep sleep profile to the given serial port.
+ *
+ * @param serial the serial port to print to.
+ */
+void MicroBitPowerManager::printDeepSleepProfile(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    static const char *phaseNames[MICROBIT_DEEPSLEEP_PHASES] = { "prepare", "enter components", "enter timer", "sleep", "exit timer", "exit components" };
+
+    serial.printf("DEEPSLEEP: count %d\r\n", profile.count);
+
+    for (int i = 0; i < MICROBIT_DEEPSLEEP_PHASES; i++)
+        serial.printf("DEEPSLEEP %s: last %d worst %d\r\n", phaseNames[i], profile.last[i], profile.worst[i]);
+
+    for (int i = 0; i < MICROBIT_DEEPSLEEP_PROFILE_COMPONENTS; i++)
+    {
+        if (profile.slowest[i].time)
+            serial.printf("DEEPSLEEP component [%d] reason %d: worst %d\r\n", profile.slowest[i].id, profile.slowest[i].reason, profile.slowest[i].time);
+    }
+#else
+    serial.printf("DEEPSLEEP: profiling disabled\r\n");
+#endif
+}
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+static MicroBitEnergyAccount energyAccounts[MICROBIT_ENERGY_SUBSYSTEMS];
+static CODAL_TIMESTAMP energyResetTime = 0;
+#endif
+
+/**
+ * Reports a change in the state of a power hungry subsystem, for energy accounting.
+ * Repeated reports of the same state are ignored. Safe to call from interrupt context.
+ *
+ * @param subsystem the subsystem (one of MICROBIT_ENERGY_*).
+ * @param active true if the subsystem has become active, false if it has become inactive.
+ */
+void codal::microbit_energy_report(int subsystem, bool active)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+    if (subsystem < 0 || subsystem >= MICROBIT_ENERGY_SUBSYSTEMS)
+        return;
+
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+    MicroBitEnergyAccount &a = energyAccounts[subsystem];
+
+    target_disable_irq();
+
+    if (active && !a.active)
+    {
+        a.activations++;
+        a.activeSince = now;
+    }
+
+    if (!active && a.active)
+        a.activeTime += now - a.activeSince;
+
+    a.active = active;
+
+    target_enable_irq();
+#endif
+}
+
+/**
+ * Retrieves the energy account of a given subsystem.
+ * Accounts are only maintained if CONFIG_MICROBIT_ENERGY_ACCOUNTING is enabled.
+ *
+ * @param subsystem the subsystem to query (one of MICROBIT_ENERGY_*).
+ * @return the account for the given subsystem, or NULL if accounting is disabled or the subsystem is invalid.
+ */
+const MicroBitEnergyAccount *MicroBitPowerManager::getEnergyAccount(int subsystem)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+    if (subsystem >= 0 && subsystem < MICROBIT_ENERGY_SUBSYSTEMS)
+        return &energyAccounts[subsystem];
+#endif
+
+    return NULL;
+}
+
+/**
+ * Determines the cumulative time a given subsystem has been active since accounts were last reset,
+ * including any current active period.
+ *
+ * @param subsystem the subsystem to query (one of MICROBIT_ENERGY_*).
+ * @return the active time in microseconds, or 0 if accounting is disabled or the subsystem is invalid.
+ */
+uint64_t MicroBitPowerManager::getActiveTime(int subsystem)
+{
+    uint64_t time = 0;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+    if (subsystem < 0 || subsystem >= MICROBIT_ENERGY_SUBSYSTEMS)
+        return 0;
+
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+    MicroBitEnergyAccount &a = energyAccounts[subsystem];
+
+    target_disable_irq();
+    time = a.activeTime;
+    if (a.active)
+        time += now - a.activeSince;
+    target_enable_irq();
+#endif
+
+    return time;
+}
+
+/**
+ * Reset all energy accounts. Subsystems that are currently active remain active, from the time of the reset.
+ */
+void MicroBitPowerManager::resetEnergyAccounts()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    target_disable_irq();
+
+    for (int i = 0; i < MICROBIT_ENERGY_SUBSYSTEMS; i++)
+    {
+        energyAccounts[i].activations = energyAccounts[i].active ? 1 : 0;
+        energyAccounts[i].activeTime = 0;
+        energyAccounts[i].activeSince = now;
+    }
+
+    energyResetTime = now;
+
+    target_enable_irq();
+#endif
+}
+
+/**
+ * Print the active time and duty cycle of each subsystem to the given serial port,
+ * along with the current power data reported by the USB interface chip.
+ *
+ * @param serial the serial port to print to.
+ */
+void MicroBitPowerManager::printEnergyAccounts(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_ENERGY_ACCOUNTING)
+    static const char *subsystemNames[MICROBIT_ENERGY_SUBSYSTEMS] = { "radio", "display", "microphone", "ble connection", "deep sleep" };
+
+    uint64_t elapsed = system_timer_current_time_us() - energyResetTime;
+
+    serial.printf("ENERGY: elapsed ms %d\r\n", (int) (elapsed / 1000));
+
+    for (int i = 0; i < MICROBIT_ENERGY_SUBSYSTEMS; i++)
+    {
+        uint64_t active = getActiveTime(i);
+        serial.printf("ENERGY %s: active ms %d duty %d%% activations %d\r\n", subsystemNames[i], (int) (active / 1000), elapsed ? (int) ((active * 100) / elapsed) : 0, energyAccounts[i].activations);
+    }
+
+    MicroBitPowerData data = getPowerData();
+    serial.printf("ENERGY: battery mV %d vin mV %d estimated consumption %d\r\n", (int) (data.batteryMicroVolts / 1000), (int) (data.vinMicroVolts / 1000), (int) data.estimatedPowerConsumption);
+#else
+    serial.printf("ENERGY: accounting disabled\r\n");
+#endif
+}
+
 /**
  * Destructor.
  */
@@ -470,6 +1029,8 @@ MicroBitPowerManager::~MicroBitPowerManager()
   */
 void MicroBitPowerManager::deepSleep()
 {
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_POWER_DEEP_SLEEP, 0);
+
     // If the scheduler is not running, perform a simple deep sleep.
     if (!fiber_scheduler_running())
     {
@@ -524,6 +1085,8 @@ void MicroBitPowerManager::deepSleep( uint32_t milliSeconds ) {
   */
 bool MicroBitPowerManager::deepSleep(uint32_t milliSeconds, bool interruptable )
 {
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_POWER_DEEP_SLEEP, milliSeconds > 0xFFFF ? 0xFFFF : milliSeconds);
+
     if ( milliSeconds > CONFIG_MINIMUM_DEEP_SLEEP_TIME)
     {
         CODAL_TIMESTAMP timeEntry  = system_timer_current_time_us();
@@ -536,8 +1099,9 @@ bool MicroBitPowerManager::deepSleep(uint32_t milliSeconds, bool interruptable )
             return false;
         }
 
-        eventValue++;
-        int result = system_timer_event_after( milliSeconds, id, eventValue, CODAL_TIMER_EVENT_FLAGS_WAKEUP);
+        uint16_t value = nextWakeUpValue();
+
+        int result = system_timer_event_after( milliSeconds, id, value, CODAL_TIMER_EVENT_FLAGS_WAKEUP);
         if ( result == DEVICE_OK)
         {
             deepSleepWait();
@@ -548,7 +1112,7 @@ bool MicroBitPowerManager::deepSleep(uint32_t milliSeconds, bool interruptable )
             if ( wakeUpTime > awake + 1000 )
             {
                 if( interruptable ) {
-                    system_timer_cancel_event( id, eventValue);
+                    system_timer_cancel_event( id, value);
                     return true;
                 }
 
@@ -557,7 +1121,7 @@ bool MicroBitPowerManager::deepSleep(uint32_t milliSeconds, bool interruptable )
                 fiber_sleep( (wakeUpTime - awake) / 1000);
             }
 
-            system_timer_cancel_event( id, eventValue);
+            system_timer_cancel_event( id, value);
             return false;
         }
     }
@@ -706,7 +1270,7 @@ void MicroBitPowerManager::prepareDeepSleep()
     {
         fiber_scheduler_set_deepsleep_pending( true);
         listen();
-        CodalComponent::deepSleepAll( deepSleepCallbackPrepare, NULL);
+        deepSleepComponents( deepSleepCallbackPrepare, NULL, MICROBIT_DEEPSLEEP_PHASE_PREPARE);
     }
 }
 
@@ -725,6 +1289,371 @@ void MicroBitPowerManager::deepSleepWait()
     deepSleepLock.wait();
 }
 
+/**
+ * Picks the value of the next timer event raised on our id to wake us up, skipping those reserved for
+ * interface chip responses and periodic tasks.
+ *
+ * @return a value distinct from those of any other wake up timer still pending.
+ */
+uint16_t MicroBitPowerManager::nextWakeUpValue()
+{
+    if (++eventValue >= MICROBIT_POWER_EVT_UIPM_RESPONSE)
+        eventValue = 1;
+
+    return eventValue;
+}
+
+/**
+ * Blocks the calling fiber for the given time, with its deadline flagged as a wake up so that idleSleep() doesn't
+ * sleep past it. The flag is withdrawn afterwards, and isn't set while deep sleep is pending, as fiber sleeps don't
+ * bound deep sleep. Used by MicroBit::sleep() when CONFIG_MICROBIT_TICKLESS_IDLE is enabled.
+ *
+ * @param milliSeconds The period of time to sleep, in milliseconds.
+ */
+void MicroBitPowerManager::ticklessSleep(uint32_t milliSeconds)
+{
+    // Each sleep has its own value, so that withdrawing it leaves those of other sleeping fibers in place.
+    uint16_t value = nextWakeUpValue();
+    bool flagged = !fiber_scheduler_get_deepsleep_pending() && system_timer_event_after( milliSeconds, id, value, CODAL_TIMER_EVENT_FLAGS_WAKEUP) == DEVICE_OK;
+
+    fiber_sleep( milliSeconds);
+
+    if (flagged)
+        system_timer_cancel_event( id, value);
+}
+
+/**
+ * Sleeps the processor without waking for the periodic scheduler tick, until the next timer event created with the
+ * CODAL_TIMER_EVENT_FLAGS_WAKEUP flag, any other interrupt, or CONFIG_MICROBIT_TICKLESS_IDLE_MAX_TIME has passed.
+ * Peripherals are left running. Called from the scheduler idle loop when CONFIG_MICROBIT_TICKLESS_IDLE is enabled.
+ *
+ * @return DEVICE_OK if a tickless sleep occurred, DEVICE_INVALID_STATE if any component requires system tick callbacks or
+ * the next wake up is due within a scheduler tick, or DEVICE_NOT_SUPPORTED if the system timer is unavailable.
+ */
+int MicroBitPowerManager::idleSleep()
+{
+    if ( sysTimer == NULL)
+        return DEVICE_NOT_SUPPORTED;
+
+    // Components polled from the system tick (e.g. button debouncing) need every tick, so we can't skip any.
+    for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+    {
+        if (CodalComponent::components[i] && (CodalComponent::components[i]->status & DEVICE_COMPONENT_STATUS_SYSTEM_TICK))
+            return DEVICE_INVALID_STATE;
+    }
+
+    CODAL_TIMESTAMP timeEntry = system_timer_current_time_us();
+    CODAL_TIMESTAMP wakeUpTime = timeEntry + (CODAL_TIMESTAMP) 1000 * CONFIG_MICROBIT_TICKLESS_IDLE_MAX_TIME;
+    CODAL_TIMESTAMP eventTime = 0;
+
+    if (system_timer_deepsleep_wakeup_time( eventTime) && eventTime < wakeUpTime)
+        wakeUpTime = eventTime;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    // Periodic tasks are run by a timer event that isn't a wake up source, so that it doesn't interrupt deep sleep.
+    eventTime = nextPeriodicTask();
+
+    if (eventTime && eventTime < wakeUpTime)
+        wakeUpTime = eventTime;
+#endif
+
+    // If the next deadline is no further away than the next tick anyway, there's nothing to gain.
+    if (wakeUpTime < timeEntry + SCHEDULER_TICK_PERIOD_US)
+        return DEVICE_INVALID_STATE;
+
+    CODAL_TIMESTAMP tickStart;
+    system_timer_deepsleep_begin( tickStart);
+
+    int      channel      = 2;      //System timer uses period = 0, event = 1 and capture = 3
+    uint32_t saveCompare  = sysTimer->timer->CC[channel];
+    uint32_t saveIntenset = sysTimer->timer->INTENSET;
+    uint32_t usPerTick    = 1;
+
+    sysTimer->timer->INTENCLR = sysTimer->timer->INTENSET;
+
+    void (*sysTimerIRQ) (uint16_t channel_bitmsk) = sysTimer->timer_pointer;
+    sysTimer->setIRQ( deepSleepTimerIRQ);
+    timer_irq_channels = 0;
+
+    sysTimer->setCompare( channel, tickStart + (uint32_t) ((wakeUpTime - timeEntry) / usPerTick));
+    sysTimer->enableIRQ();
+
+    // Unlike __WFI(), these return immediately if an interrupt has occurred since the scheduler last waited,
+    // so work made ready by an interrupt just before we got here isn't held up.
+    // When the SoftDevice is enabled, it must be the one to sleep the CPU, so it can handle its own events.
+#ifdef SOFTDEVICE_PRESENT
+    if (ble_running())
+        sd_app_evt_wait();
+    else
+#endif
+    {
+        target_wait_for_event();
+    }
+
+    uint32_t tick1 = sysTimer->captureCounter();
+
+    // Restore timer state
+    sysTimer->disableIRQ();
+    sysTimer->timer->INTENCLR = sysTimer->timer->INTENSET;
+    sysTimer->setIRQ(sysTimerIRQ);
+    sysTimer->timer->CC[channel] = saveCompare;
+
+#if CONFIG_ENABLED(CODAL_TIMER_32BIT)
+    system_timer_deepsleep_end( 0, 0);
+#else
+    system_timer_deepsleep_end( tick1, (tick1 - tickStart) * usPerTick);
+#endif
+
+    sysTimer->timer->INTENSET = saveIntenset;
+
+    return DEVICE_OK;
+}
+
+
+/**
+ * Issues the given deep sleep callback to all components, profiling each callback if enabled.
+ *
+ * @param reason the reason for the callback.
+ * @param data the data associated with the callback.
+ * @param phase the deep sleep phase (one of MICROBIT_DEEPSLEEP_PHASE_*) to attribute the time taken to.
+ */
+void MicroBitPowerManager::deepSleepComponents(deepSleepCallbackReason reason, deepSleepCallbackData *data, int phase)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    // Equivalent to CodalComponent::deepSleepAll(), but timing each callback individually.
+    for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+    {
+        CodalComponent *c = CodalComponent::components[i];
+
+        if (c == NULL)
+            continue;
+
+        CODAL_TIMESTAMP t = system_timer_current_time_us();
+        c->deepSleepCallback(reason, data);
+        uint32_t time = (uint32_t) (system_timer_current_time_us() - t);
+
+        // Replace any previous entry for this callback, or otherwise the fastest entry, if this callback was slower.
+        MicroBitDeepSleepComponentTime *slowest = profile.slowest;
+        int n = MICROBIT_DEEPSLEEP_PROFILE_COMPONENTS - 1;
+
+        for (int j = 0; j < MICROBIT_DEEPSLEEP_PROFILE_COMPONENTS; j++)
+        {
+            if (slowest[j].time && slowest[j].id == c->id && slowest[j].reason == reason)
+            {
+                n = j;
+                break;
+            }
+        }
+
+        if (time <= slowest[n].time)
+            continue;
+
+        // Keep the list ordered, slowest first.
+        while (n > 0 && slowest[n-1].time < time)
+        {
+            slowest[n] = slowest[n-1];
+            n--;
+        }
+
+        slowest[n].id = c->id;
+        slowest[n].reason = reason;
+        slowest[n].time = time;
+    }
+
+    profileDeepSleepPhase(phase, (uint32_t) (system_timer_current_time_us() - start));
+#else
+    CodalComponent::deepSleepAll(reason, data);
+#endif
+}
+
+/**
+ * Records the time taken by a phase of deep sleep entry or exit.
+ *
+ * @param phase the phase (one of MICROBIT_DEEPSLEEP_PHASE_*).
+ * @param time the time taken, in microseconds.
+ */
+void MicroBitPowerManager::profileDeepSleepPhase(int phase, uint32_t time)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    profile.last[phase] = time;
+    profile.worst[phase] = max(profile.worst[phase], time);
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+// Periodic tasks
+
+/**
+  * Registers a task to run at a fixed period, whether awake or in deep sleep. While awake, the task runs from the
+  * message bus. During deep sleep, the processor wakes only for the task: the components it declares are sent a
+  * deep sleep end callback, the task runs, they are sent a deep sleep begin callback, and deep sleep resumes.
+  * No other component, nor any fiber, is woken. This keeps the cost of each wake to a minimum for periodic
+  * sampling workloads (e.g. reading a sensor into a log).
+  *
+  * Only available if CONFIG_MICROBIT_PERIODIC_TASKS is enabled.
+  *
+  * @param handler The task to run.
+  * @param context A pointer passed to the task each time it runs.
+  * @param period The interval between runs, in milliseconds. The first run is one period from now.
+  * @param components The components the task uses, which are woken from deep sleep while it runs. May be NULL.
+  * @param count The number of components, up to MICROBIT_PERIODIC_TASK_COMPONENTS.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the handler or period is invalid or too many
+  *         components are given, DEVICE_NO_RESOURCES if MICROBIT_PERIODIC_TASK_MAX tasks are already registered,
+  *         or DEVICE_NOT_SUPPORTED if periodic tasks are not enabled.
+  */
+int MicroBitPowerManager::addPeriodicTask(MicroBitPeriodicTaskHandler handler, void *context, uint32_t period, CodalComponent **components, int count)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    if (handler == NULL || period == 0 || period > 0xFFFFFFFFul / 1000 || count < 0 || count > MICROBIT_PERIODIC_TASK_COMPONENTS || (count && components == NULL))
+        return DEVICE_INVALID_PARAMETER;
+
+    if (periodicTaskCount >= MICROBIT_PERIODIC_TASK_MAX)
+        return DEVICE_NO_RESOURCES;
+
+    // We register here rather than in the constructor, as the message bus may not yet exist at that point.
+    if (periodicTaskCount == 0 && EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(id, MICROBIT_POWER_EVT_PERIODIC_TASK, this, &MicroBitPowerManager::onPeriodicTask);
+
+    MicroBitPeriodicTask &t = periodicTasks[periodicTaskCount];
+
+    t.handler = handler;
+    t.context = context;
+    t.period = period * 1000;
+    t.due = system_timer_current_time_us() + t.period;
+
+    for (int i = 0; i < MICROBIT_PERIODIC_TASK_COMPONENTS; i++)
+        t.components[i] = i < count ? components[i] : NULL;
+
+    periodicTaskCount++;
+    schedulePeriodicTasks();
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+  * Removes a task registered with addPeriodicTask(). Must not be called from within a periodic task.
+  *
+  * @param handler The task.
+  * @param context The context pointer it was registered with.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no such task is registered.
+  */
+int MicroBitPowerManager::removePeriodicTask(MicroBitPeriodicTaskHandler handler, void *context)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    for (int i = 0; i < periodicTaskCount; i++)
+    {
+        if (periodicTasks[i].handler == handler && periodicTasks[i].context == context)
+        {
+            periodicTaskCount--;
+
+            for (int j = i; j < periodicTaskCount; j++)
+                periodicTasks[j] = periodicTasks[j+1];
+
+            schedulePeriodicTasks();
+
+            return DEVICE_OK;
+        }
+    }
+#endif
+
+    return DEVICE_INVALID_PARAMETER;
+}
+
+/**
+  * Determines when the next periodic task is due.
+  *
+  * @return The time the next task is due, in microseconds, or 0 if no tasks are registered.
+  */
+CODAL_TIMESTAMP MicroBitPowerManager::nextPeriodicTask()
+{
+    CODAL_TIMESTAMP next = 0;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    for (int i = 0; i < periodicTaskCount; i++)
+    {
+        if (next == 0 || periodicTasks[i].due < next)
+            next = periodicTasks[i].due;
+    }
+#endif
+
+    return next;
+}
+
+/**
+  * Runs all periodic tasks that are due.
+  *
+  * @param now The current time, in microseconds.
+  * @param asleep true if called during deep sleep, in which case the components each task declares are woken for it.
+  * @param wakeUpSources true if the deep sleep in progress uses external wake up sources.
+  */
+void MicroBitPowerManager::runPeriodicTasks(CODAL_TIMESTAMP now, bool asleep, bool wakeUpSources)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    for (int i = 0; i < periodicTaskCount; i++)
+    {
+        MicroBitPeriodicTask &t = periodicTasks[i];
+
+        if (t.due > now)
+            continue;
+
+        if (asleep)
+        {
+            for (int j = 0; j < MICROBIT_PERIODIC_TASK_COMPONENTS; j++)
+                if (t.components[j])
+                    t.components[j]->deepSleepCallback(wakeUpSources ? deepSleepCallbackEndWithWakeUps : deepSleepCallbackEnd, NULL);
+        }
+
+        t.handler(t.context);
+
+        if (asleep)
+        {
+            for (int j = MICROBIT_PERIODIC_TASK_COMPONENTS - 1; j >= 0; j--)
+                if (t.components[j])
+                    t.components[j]->deepSleepCallback(wakeUpSources ? deepSleepCallbackBeginWithWakeUps : deepSleepCallbackBegin, NULL);
+        }
+
+        // Keep to the period, but don't try to catch up on runs that were missed altogether.
+        t.due += t.period;
+
+        if (t.due <= now)
+            t.due = now + t.period;
+    }
+#endif
+}
+
+/**
+  * Schedules the timer event that runs periodic tasks while awake, for when the next task is due.
+  */
+void MicroBitPowerManager::schedulePeriodicTasks()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+    system_timer_cancel_event(id, MICROBIT_POWER_EVT_PERIODIC_TASK);
+
+    CODAL_TIMESTAMP next = nextPeriodicTask();
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    // This is deliberately not a wake up source, so that it doesn't interrupt deep sleep. Tasks due during deep sleep
+    // are run by simpleDeepSleep(), and those due during tickless idle are accounted for by idleSleep().
+    if (next)
+        system_timer_event_after_us(next > now ? next - now : 1, id, MICROBIT_POWER_EVT_PERIODIC_TASK);
+#endif
+}
+
+/**
+  * Event handler, called when the next periodic task is due while awake.
+  */
+void MicroBitPowerManager::onPeriodicTask(Event)
+{
+    runPeriodicTasks(system_timer_current_time_us(), false, false);
+    schedulePeriodicTasks();
+}
 
 volatile uint16_t MicroBitPowerManager::timer_irq_channels;
 
@@ -796,7 +1725,13 @@ int MicroBitPowerManager::simpleDeepSleep( bool wakeOnTime, CODAL_TIMESTAMP wake
     setPowerLED( true /*doSleep*/);
 
     // Update peripheral drivers
-    CodalComponent::deepSleepAll( wakeUpSources ? deepSleepCallbackBeginWithWakeUps : deepSleepCallbackBegin, NULL);
+    deepSleepComponents( wakeUpSources ? deepSleepCallbackBeginWithWakeUps : deepSleepCallbackBegin, NULL, MICROBIT_DEEPSLEEP_PHASE_ENTER_COMPONENTS);
+
+    microbit_energy_report(MICROBIT_ENERGY_DEEPSLEEP, true);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    CODAL_TIMESTAMP timeComponents = system_timer_current_time_us();
+#endif
 
     CODAL_TIMESTAMP tickStart;
     CODAL_TIMESTAMP timeStart = system_timer_deepsleep_begin( tickStart);
@@ -837,6 +1772,11 @@ int MicroBitPowerManager::simpleDeepSleep( bool wakeOnTime, CODAL_TIMESTAMP wake
     uint32_t tick0 = tickStart;
     uint32_t tick1 = tick0;
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    // The microsecond clock is suspended from here, so time the rest of the timer setup from the raw counter.
+    profileDeepSleepPhase(MICROBIT_DEEPSLEEP_PHASE_ENTER_TIMER, (uint32_t) (timeStart - timeComponents) + (sysTimer->captureCounter() - tickStart) * usPerTick);
+#endif
+
     // assume wake-up needs at least same time as power down
     // it may need much longer in general
     uint64_t totalTicks = wakeUpTime - timeEntry
@@ -861,6 +1801,26 @@ int MicroBitPowerManager::simpleDeepSleep( bool wakeOnTime, CODAL_TIMESTAMP wake
           remain = ticksMax;
         }
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_PERIODIC_TASKS)
+        // Run any periodic tasks that are due, then sleep on. Otherwise, wake no later than the next one.
+        // The microsecond clock is suspended, so the current time is derived from the ticks slept.
+        CODAL_TIMESTAMP now = timeStart + sleepTicks * usPerTick;
+        CODAL_TIMESTAMP taskTime = nextPeriodicTask();
+
+        if ( taskTime && taskTime <= now)
+        {
+            runPeriodicTasks( now, true, wakeUpSources);
+
+            tick1 = sysTimer->captureCounter();
+            sleepTicks += tick1 - tick0;
+            tick0 = tick1;
+            continue;
+        }
+
+        if ( taskTime && (taskTime - now) / usPerTick < remain)
+            remain = (taskTime - now) / usPerTick;
+#endif
+
         sysTimer->setCompare( channel, tick0 + remain);
 
         // Wait for an interrupt to occur. This will either be the requested transition,
@@ -889,6 +1849,10 @@ int MicroBitPowerManager::simpleDeepSleep( bool wakeOnTime, CODAL_TIMESTAMP wake
     // Disable DETECT events 
     io.irq1.setDetect(GPIO_PIN_CNF_SENSE_Disabled);
 
+    // Restore any edge events requested on the IRQ line.
+    if (irqEventCount > 0)
+        io.irq1.eventOn(DEVICE_PIN_EVENT_ON_EDGE);
+
     if ( !wakeUpSources)
     {
         if ( wakeUpPin)
@@ -908,10 +1872,21 @@ int MicroBitPowerManager::simpleDeepSleep( bool wakeOnTime, CODAL_TIMESTAMP wake
     // Events queued between the return from __WFI() and now will have incorrect times 
 #endif
 
+    microbit_energy_report(MICROBIT_ENERGY_DEEPSLEEP, false);
+
     sysTimer->timer->INTENSET = saveIntenset;
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    profileDeepSleepPhase(MICROBIT_DEEPSLEEP_PHASE_SLEEP, (uint32_t) (sleepTicks * usPerTick));
+    profileDeepSleepPhase(MICROBIT_DEEPSLEEP_PHASE_EXIT_TIMER, (sysTimer->captureCounter() - tick1) * usPerTick);
+#endif
+
     // Configure for running mode.
-    CodalComponent::deepSleepAll( wakeUpSources ? deepSleepCallbackEndWithWakeUps : deepSleepCallbackEnd, NULL);
+    deepSleepComponents( wakeUpSources ? deepSleepCallbackEndWithWakeUps : deepSleepCallbackEnd, NULL, MICROBIT_DEEPSLEEP_PHASE_EXIT_COMPONENTS);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_DEEPSLEEP_PROFILE)
+    profile.count++;
+#endif
 
     setPowerLED(false /*doSleep*/);
 
@@ -28,12 +28,34 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalComponent.h"
 #include "ErrorNo.h"
 #include "CodalFiber.h"
+#include "EventModel.h"
+#include "MicroBitPowerManager.h"
+#include "MicroBitTrace.h"
+#include "MicroBitHeapProfile.h"
+#include "MicroBitStackProfile.h"
 #include "nrf.h"
 
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+#include "nrf_sdh_soc.h"
+#include "nrf_nvic.h"
+
+// The software interrupt that raises transmit events on behalf of the timeslot signal handler. See raiseTxEvent().
+#define MICROBIT_RADIO_EVT_IRQn                 SWI3_EGU3_IRQn
+#endif
+
 using namespace codal;
 
 const uint8_t MICROBIT_RADIO_POWER_LEVEL[] = {0xD8, 0xEC, 0xF0, 0xF4, 0xF8, 0xFC, 0x00, 0x04};
 
+// Bands used by automatic band assignment. These are spaced 4MHz apart, and avoid the BLE advertising channels (bands 2, 26 and 80).
+const uint8_t MICROBIT_RADIO_AUTO_BANDS[] = {7, 11, 15, 19, 23, 30, 34, 38, 42, 46, 50, 54, 58, 62, 66, 70};
+
+// RADIO SHORTS used while receiving: reception starts as soon as the receiver has ramped up, and restarts as soon as each
+// frame ends. While transmitting: transmission starts as soon as the transmitter has ramped up, and the transmitter is
+// disabled as soon as the frame ends.
+#define MICROBIT_RADIO_SHORTS_RX    (RADIO_SHORTS_ADDRESS_RSSISTART_Msk | RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_END_START_Msk)
+#define MICROBIT_RADIO_SHORTS_TX    (RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_END_DISABLE_Msk)
+
 /**
   * Provides a simple broadcast radio abstraction, built upon the raw nrf51822 RADIO module.
   *
@@ -48,9 +70,9 @@ const uint8_t MICROBIT_RADIO_POWER_LEVEL[] = {0xD8, 0xEC, 0xF0, 0xF4, 0xF8, 0xFC
   * TODO: Meshing should also be considered - again a GLOSSY approach may be effective here, and highly complementary to
   * the master/slave arachitecture of BLE.
   *
-  * TODO: This implementation may only operated whilst the BLE stack is disabled. The nrf51822 provides a timeslot API to allow
-  * BLE to cohabit with other protocols. Future work to allow this colocation would be benefical, and would also allow for the
-  * creation of wireless BLE bridges.
+  * NOTE: By default, this implementation may only operate whilst the BLE stack is disabled. If MICROBIT_RADIO_TIMESLOT is enabled,
+  * the radio may also be enabled while the BLE stack is running, in which case it borrows the RADIO from the SoftDevice in
+  * timeslots between BLE events. Throughput is then shared with BLE, which allows the creation of wireless BLE bridges.
   *
   * NOTE: This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
   * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
@@ -59,44 +81,150 @@ const uint8_t MICROBIT_RADIO_POWER_LEVEL[] = {0xD8, 0xEC, 0xF0, 0xF4, 0xF8, 0xFC
 
 MicroBitRadio* MicroBitRadio::instance = NULL;
 
-extern "C" void RADIO_IRQHandler(void)
+static void radio_irq_handler()
 {
-    if(NRF_RADIO->EVENTS_READY)
-    {
-        NRF_RADIO->EVENTS_READY = 0;
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_RADIO_IRQ, NRF_RADIO->STATE);
 
-        // Start listening and wait for the END event
-        NRF_RADIO->TASKS_START = 1;
+    // The RADIO SHORTS restart reception after each frame, and chain each transmission through to DISABLED,
+    // so all that's left for us is to hand over buffers.
+    bool transmitting = MicroBitRadio::instance->getTransmitterState() != MICROBIT_RADIO_TX_IDLE;
+
+    if(NRF_RADIO->EVENTS_DISABLED)
+    {
+        NRF_RADIO->EVENTS_DISABLED = 0;
+        MicroBitRadio::instance->serviceTxQueue();
     }
 
+    // Handle END before ADDRESS. If both are pending, we were too late to arm a buffer for the reception
+    // that END_START has already begun, and the ADDRESS can only be used for the one after.
     if(NRF_RADIO->EVENTS_END)
     {
         NRF_RADIO->EVENTS_END = 0;
-        if(NRF_RADIO->CRCSTATUS == 1)
+
+        if (!transmitting)
         {
-            int sample = (int)NRF_RADIO->RSSISAMPLE;
+            if(NRF_RADIO->CRCSTATUS == 1)
+            {
+                int sample = (int)NRF_RADIO->RSSISAMPLE;
+
+                // Associate this packet's rssi value with the data just
+                // transferred by DMA receive
+                MicroBitRadio::instance->setRSSI(-sample);
+                MicroBitRadio::instance->recordRxFrame(true);
+
+                // Now move on to the next buffer, if possible.
+                // The queued packet will get the rssi value set above.
+                if (MicroBitRadio::instance->queueRxBuf() != DEVICE_OK)
+                    MicroBitRadio::instance->recycleRxBuf();
+            }
+            else
+            {
+                MicroBitRadio::instance->setRSSI(0);
+                MicroBitRadio::instance->recordRxFrame(false);
+                MicroBitRadio::instance->recycleRxBuf();
+            }
+        }
+    }
 
-            // Associate this packet's rssi value with the data just
-            // transferred by DMA receive
-            MicroBitRadio::instance->setRSSI(-sample);
+    if(NRF_RADIO->EVENTS_ADDRESS)
+    {
+        NRF_RADIO->EVENTS_ADDRESS = 0;
 
-            // Now move on to the next buffer, if possible.
-            // The queued packet will get the rssi value set above.
-            MicroBitRadio::instance->queueRxBuf();
+        // PACKETPTR is double buffered, so a fresh buffer handed over now is used for the reception
+        // started by END_START as soon as this frame ends.
+        if (!transmitting)
+            MicroBitRadio::instance->armRxBuf();
+    }
+}
 
-            // Set the new buffer for DMA
-            NRF_RADIO->PACKETPTR = (uint32_t) MicroBitRadio::instance->getRxBuf();
-        }
-        else
-        {
-            MicroBitRadio::instance->setRSSI(0);
-        }
+extern "C" void RADIO_IRQHandler(void)
+{
+    radio_irq_handler();
+}
+
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+
+/*
+ * When the BLE stack is running, the RADIO belongs to the SoftDevice. We borrow it in timeslots granted through the
+ * SoftDevice radio timeslot API, asking for the next one as each ends, so we fill the gaps between BLE events.
+ * The SoftDevice forwards the RADIO and TIMER0 interrupts to the signal handler below during each timeslot.
+ */
+static nrf_radio_request_t timeslot_request;
+static nrf_radio_signal_callback_return_param_t timeslot_return;
+
+static nrf_radio_request_t *radio_timeslot_request()
+{
+    timeslot_request.request_type = NRF_RADIO_REQ_TYPE_EARLIEST;
+    timeslot_request.params.earliest.hfclk = NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED;
+    timeslot_request.params.earliest.priority = NRF_RADIO_PRIORITY_NORMAL;
+    timeslot_request.params.earliest.length_us = MICROBIT_RADIO_TIMESLOT_LENGTH;
+    timeslot_request.params.earliest.timeout_us = MICROBIT_RADIO_TIMESLOT_TIMEOUT;
+
+    return &timeslot_request;
+}
+
+static nrf_radio_signal_callback_return_param_t *radio_timeslot_handler(uint8_t signal)
+{
+    timeslot_return.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_NONE;
 
-        // Start listening and wait for the END event
-        NRF_RADIO->TASKS_START = 1;
+    switch (signal)
+    {
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_START:
+            // TIMER0 counts up from zero at the start of each timeslot. Use it to hand the RADIO back in good time.
+            NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+            NRF_TIMER0->CC[0] = MICROBIT_RADIO_TIMESLOT_LENGTH - MICROBIT_RADIO_TIMESLOT_GUARD;
+            NRF_TIMER0->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+            NVIC_EnableIRQ(TIMER0_IRQn);
+
+            MicroBitRadio::instance->startTimeslot();
+            break;
+
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_RADIO:
+            radio_irq_handler();
+            break;
+
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_TIMER0:
+            NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+            NRF_TIMER0->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+
+            MicroBitRadio::instance->endTimeslot();
+
+            // Ask for the next timeslot as we end this one, unless the radio has since been disabled.
+            if (MicroBitRadio::instance->isTimeslotMode())
+            {
+                timeslot_return.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_REQUEST_AND_END;
+                timeslot_return.params.request.p_next = radio_timeslot_request();
+            }
+            else
+            {
+                timeslot_return.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_END;
+            }
+            break;
+    }
+
+    return &timeslot_return;
+}
+
+static void radio_soc_event_handler(uint32_t sys_evt, void *)
+{
+    // A request that can't be met in time (e.g. due to BLE activity) is dropped, so simply ask again.
+    if (sys_evt == NRF_EVT_RADIO_BLOCKED || sys_evt == NRF_EVT_RADIO_CANCELED || sys_evt == NRF_EVT_RADIO_SESSION_IDLE)
+    {
+        if (MicroBitRadio::instance && MicroBitRadio::instance->isTimeslotMode())
+            sd_radio_request(radio_timeslot_request());
     }
 }
 
+NRF_SDH_SOC_OBSERVER(microbitradio_soc_observer, 0, radio_soc_event_handler, NULL);
+
+extern "C" void SWI3_EGU3_IRQHandler(void)
+{
+    if (MicroBitRadio::instance)
+        MicroBitRadio::instance->raiseDeferredEvents();
+}
+
+#endif
+
 /**
   * Constructor.
   *
@@ -105,7 +233,7 @@ extern "C" void RADIO_IRQHandler(void)
   * @note This class is demand activated, as a result most resources are only
   *       committed if send/recv or event registrations calls are made.
   */
-MicroBitRadio::MicroBitRadio(uint16_t id) : datagram(*this), event (*this)
+MicroBitRadio::MicroBitRadio(uint16_t id) : datagram(*this), event (*this), reliable(*this), tdma(*this), mesh(*this)
 {
     this->id = id;
     this->status = 0;
@@ -113,13 +241,49 @@ MicroBitRadio::MicroBitRadio(uint16_t id) : datagram(*this), event (*this)
     this->power = MICROBIT_RADIO_DEFAULT_TX_POWER;
     this->group = MICROBIT_RADIO_DEFAULT_GROUP;
     this->queueDepth = 0;
+    this->queueSize = MICROBIT_RADIO_MAXIMUM_RX_BUFFERS;
+    this->rxHead = 0;
     this->rssi = 0;
     this->rxQueue = NULL;
     this->rxBuf = NULL;
+    this->rxSpare = NULL;
+    this->rxArmed = false;
+    this->rxPool = NULL;
+    this->rxPoolSize = 0;
+    this->txStart = 0;
+    this->txHold = false;
+    this->slotActive = false;
+    this->listening = true;
+    this->rxBusy = false;
+    this->rxLocked = false;
+    this->txCompleteRaised = 0;
+    this->txCompleteSeen = 0;
+    this->txIdleRaised = 0;
+    this->txIdleSeen = 0;
+    this->listenWindow = 0;
+    this->listenPeriod = 0;
+    this->listenFrames = 0;
+    memset(&this->stats, 0, sizeof(this->stats));
+    this->txQueue = NULL;
+    this->txHead = 0;
+    this->txTail = 0;
+    this->txState = MICROBIT_RADIO_TX_IDLE;
 
     instance = this;
 }
 
+/**
+  * Releases a FrameBuffer. Buffers taken from the MicroBitRadio receive pool are returned to it, all others
+  * are freed to the heap. This allows received buffers to be deleted as before.
+  */
+void FrameBuffer::operator delete(void *p)
+{
+    if (MicroBitRadio::instance && MicroBitRadio::instance->releaseRxBuf((FrameBuffer *) p))
+        return;
+
+    ::operator delete(p);
+}
+
 /**
   * Change the output power level of the transmitter to the given value.
   *
@@ -135,7 +299,9 @@ int MicroBitRadio::setTransmitPower(int power)
     // Record our power locally
     this->power = power;
 
-    NRF_RADIO->TXPOWER = (uint32_t)MICROBIT_RADIO_POWER_LEVEL[power];
+    // In timeslot mode, this is applied at the start of the next timeslot.
+    if (!(status & MICROBIT_RADIO_STATUS_TIMESLOT))
+        NRF_RADIO->TXPOWER = (uint32_t)MICROBIT_RADIO_POWER_LEVEL[power];
 
     return DEVICE_OK;
 }
@@ -146,11 +312,11 @@ int MicroBitRadio::setTransmitPower(int power)
   * @param band a frequency band in the range 0 - 100. Each step is 1MHz wide, based at 2400MHz.
   *
   * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the value is out of range,
-  *         or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  *         or DEVICE_NOT_SUPPORTED if the BLE stack is running and the radio is not in timeslot mode.
   */
 int MicroBitRadio::setFrequencyBand(int band)
 {
-    if (ble_running())
+    if (ble_running() && !isTimeslotMode())
         return DEVICE_NOT_SUPPORTED;
 
     if (band < 0 || band > 100)
@@ -159,23 +325,30 @@ int MicroBitRadio::setFrequencyBand(int band)
     // Record our frequency band locally
     this->band = band;
 
+    // In timeslot mode, this is applied at the start of the next timeslot.
+    if (status & MICROBIT_RADIO_STATUS_TIMESLOT)
+        return DEVICE_OK;
+
     if ( NRF_RADIO->FREQUENCY != (uint32_t) band && (status & MICROBIT_RADIO_STATUS_INITIALISED))
     {
-        // We need to restart the radio for the frequency change to take effect
+        // Let any queued transmissions complete on the old band.
+        awaitTxIdle();
+
+        // We need to restart the radio for the frequency change to take effect. Between listen windows, it's already stopped.
         NVIC_DisableIRQ(RADIO_IRQn);
-        NRF_RADIO->EVENTS_DISABLED = 0;
-        NRF_RADIO->TASKS_DISABLE = 1;
-        while (NRF_RADIO->EVENTS_DISABLED == 0);
 
-        NRF_RADIO->FREQUENCY = (uint32_t) band;
+        if (listening)
+        {
+            NRF_RADIO->EVENTS_DISABLED = 0;
+            NRF_RADIO->TASKS_DISABLE = 1;
+            while (NRF_RADIO->EVENTS_DISABLED == 0);
+        }
 
-        // Reenable the radio to wait for the next packet
-        NRF_RADIO->EVENTS_READY = 0;
-        NRF_RADIO->TASKS_RXEN = 1;
-        while (NRF_RADIO->EVENTS_READY == 0);
+        NRF_RADIO->FREQUENCY = (uint32_t) band;
 
-        NRF_RADIO->EVENTS_END = 0;
-        NRF_RADIO->TASKS_START = 1;
+        // Reenable the radio to wait for the next packet, unless we're between listen windows.
+        if (listening)
+            startReceiver();
 
         NVIC_ClearPendingIRQ(RADIO_IRQn);
         NVIC_EnableIRQ(RADIO_IRQn);
@@ -196,53 +369,347 @@ FrameBuffer* MicroBitRadio::getRxBuf()
 }
 
 /**
-  * Attempt to queue a buffer received by the radio hardware, if sufficient space is available.
+  * Takes a free buffer from the receive pool. Only the RADIO interrupt (or code running while it is disabled)
+  * takes buffers, and buffers are released with a single store, so no locking is needed.
   *
-  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if a replacement receiver buffer
-  *         could not be allocated (either by policy or memory exhaustion).
+  * @return a free buffer, or NULL if the pool is exhausted or not yet allocated.
   */
-int MicroBitRadio::queueRxBuf()
+FrameBuffer* MicroBitRadio::allocRxBuf()
 {
-    if (rxBuf == NULL)
-        return DEVICE_INVALID_PARAMETER;
+    for (FrameBufferPool *pool = rxPool; pool != NULL; pool = pool->next)
+    {
+        for (int i = 0; i < pool->size; i++)
+        {
+            if (!pool->used[i])
+            {
+                pool->used[i] = 1;
+                return &pool->buffers[i];
+            }
+        }
+    }
 
-    if (queueDepth >= MICROBIT_RADIO_MAXIMUM_RX_BUFFERS)
-        return DEVICE_NO_RESOURCES;
+    return NULL;
+}
 
-    // Store the received RSSI value in the frame
-    rxBuf->rssi = getRSSI();
+/**
+  * Returns a buffer to the receive pool, if it was taken from it.
+  *
+  * @param buffer the buffer to release.
+  *
+  * @return true if the buffer belongs to the receive pool and has been released, false otherwise.
+  */
+bool MicroBitRadio::releaseRxBuf(FrameBuffer *buffer)
+{
+    for (FrameBufferPool *pool = rxPool; pool != NULL; pool = pool->next)
+    {
+        if (buffer >= pool->buffers && buffer < pool->buffers + pool->size)
+        {
+            pool->used[buffer - pool->buffers] = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+  * Provides the PacketBuffer header reserved for a buffer in the receive pool, allowing a received
+  * frame to be wrapped in a PacketBuffer without copying.
+  *
+  * @param buffer the received buffer.
+  *
+  * @return the header for the buffer, or NULL if the buffer does not belong to the receive pool.
+  */
+PacketData* MicroBitRadio::getRxPacketData(FrameBuffer *buffer)
+{
+    for (FrameBufferPool *pool = rxPool; pool != NULL; pool = pool->next)
+    {
+        if (buffer >= pool->buffers && buffer < pool->buffers + pool->size)
+            return (PacketData *) ((uint8_t *) pool->packets + (buffer - pool->buffers) * sizeof(PacketData));
+    }
+
+    return NULL;
+}
+
+/**
+  * Grows the receive pool so that it holds at least the given number of buffers.
+  *
+  * @param size the number of buffers required.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the buffers could not be allocated.
+  */
+int MicroBitRadio::growRxPool(int size)
+{
+    if (size <= rxPoolSize)
+        return DEVICE_OK;
 
-    // Ensure that a replacement buffer is available before queuing.
-    FrameBuffer *newRxBuf = new FrameBuffer();
+    FrameBufferPool *pool = new FrameBufferPool();
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, pool, sizeof(FrameBufferPool));
 
-    if (newRxBuf == NULL)
+    if (pool == NULL)
         return DEVICE_NO_RESOURCES;
 
-    // We add to the tail of the queue to preserve causal ordering.
-    rxBuf->next = NULL;
+    pool->size = size - rxPoolSize;
+    pool->buffers = new FrameBuffer[pool->size];
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, pool->buffers, pool->size * sizeof(FrameBuffer));
+    pool->used = new uint8_t[pool->size];
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, pool->used, pool->size);
+    pool->packets = (PacketData *) malloc(pool->size * sizeof(PacketData));
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, pool->packets, pool->size * sizeof(PacketData));
+
+    if (pool->buffers == NULL || pool->used == NULL || pool->packets == NULL)
+    {
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_RADIO, pool->buffers);
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_RADIO, pool->used);
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_RADIO, pool->packets);
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_RADIO, pool);
+        delete[] pool->buffers;
+        delete[] pool->used;
+        free(pool->packets);
+        delete pool;
+        return DEVICE_NO_RESOURCES;
+    }
+
+    memset((void *) pool->used, 0, pool->size);
+
+    // Pools are never freed, as buffers may still be held by higher layers. Publishing the new pool is a single store,
+    // so the RADIO interrupt sees either the old or the new chain.
+    pool->next = rxPool;
+    rxPool = pool;
+    rxPoolSize = size;
+
+    return DEVICE_OK;
+}
 
+/**
+  * Changes the maximum number of received packets that may be queued awaiting processing.
+  * Deeper queues absorb larger bursts of traffic. If the queue currently holds more packets than the new depth,
+  * the oldest are discarded.
+  *
+  * @param depth the new queue depth, in the range 1..MICROBIT_RADIO_MAXIMUM_QUEUE_DEPTH.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the depth is out of range,
+  *         or DEVICE_NO_RESOURCES if memory for the deeper queue could not be allocated.
+  */
+int MicroBitRadio::setQueueDepth(int depth)
+{
+    if (depth < 1 || depth > MICROBIT_RADIO_MAXIMUM_QUEUE_DEPTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    // If the radio has never been enabled, the queue will be allocated with the requested depth when it is.
     if (rxQueue == NULL)
     {
-        rxQueue = rxBuf;
+        queueSize = depth;
+        return DEVICE_OK;
     }
-    else
+
+    if (growRxPool(MICROBIT_RADIO_RX_POOL_SIZE(depth)) != DEVICE_OK)
+        return DEVICE_NO_RESOURCES;
+
+    FrameBuffer **queue = new FrameBuffer*[depth];
+    MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, queue, depth * sizeof(FrameBuffer *));
+
+    if (queue == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    // Protect shared resource from ISR activity. Frames beyond the new depth are unlinked here, and freed once the lock is released.
+    bool irq = lockRadio();
+    FrameBuffer *excess = NULL;
+
+    while (queueDepth > depth)
     {
-        FrameBuffer *p = rxQueue;
-        while (p->next != NULL)
-            p = p->next;
+        FrameBuffer *p = recv();
+        p->next = excess;
+        excess = p;
+    }
+
+    for (int i = 0; i < queueDepth; i++)
+        queue[i] = rxQueue[(rxHead + i) % queueSize];
+
+    FrameBuffer **oldQueue = rxQueue;
+    rxQueue = queue;
+    rxHead = 0;
+    queueSize = depth;
+
+    // Allow ISR access to shared resource
+    unlockRadio(irq);
+
+    while (excess)
+    {
+        FrameBuffer *p = excess;
+        excess = p->next;
+        delete p;
+    }
+
+    MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_RADIO, oldQueue);
+    delete[] oldQueue;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines the maximum number of received packets that may be queued awaiting processing.
+  *
+  * @return the receive queue depth.
+  */
+int MicroBitRadio::getQueueDepth()
+{
+    return queueSize;
+}
+
+/**
+  * Determines the number of received packets dropped because the receive queue was full.
+  *
+  * @return the number of packets dropped since the last call to resetDroppedCount().
+  */
+uint32_t MicroBitRadio::getDroppedCount()
+{
+    return stats.rxQueueFull;
+}
+
+/**
+  * Resets the count of received packets dropped because the receive queue was full.
+  */
+void MicroBitRadio::resetDroppedCount()
+{
+    stats.rxQueueFull = 0;
+}
+
+/**
+  * Provides a snapshot of the link statistics gathered by the radio.
+  *
+  * @return the statistics gathered since the last call to resetStatistics().
+  */
+MicroBitRadioStatistics MicroBitRadio::getStatistics()
+{
+    // Take a consistent copy, as the statistics are updated by the RADIO interrupt. In timeslot mode that interrupt
+    // can't be held off, so a frame ending meanwhile may leave the copy slightly inconsistent.
+    bool irq = lockRadio();
+
+    MicroBitRadioStatistics s = stats;
+
+    unlockRadio(irq);
+
+    return s;
+}
+
+/**
+  * Resets all link statistics to zero.
+  */
+void MicroBitRadio::resetStatistics()
+{
+    bool irq = lockRadio();
+
+    memset(&stats, 0, sizeof(stats));
+
+    unlockRadio(irq);
+}
+
+/**
+  * Records the reception of a frame in the link statistics, using the RSSI last set by setRSSI().
+  *
+  * @param crcOk true if the frame was received with a valid CRC.
+  *
+  * @note should only be called from RADIO_IRQHandler...
+  */
+void MicroBitRadio::recordRxFrame(bool crcOk)
+{
+    rxBusy = false;
+
+    if (!crcOk)
+    {
+        stats.rxCrcErrors++;
+        return;
+    }
+
+    int bin = (-rssi - MICROBIT_RADIO_RSSI_BIN_START) / MICROBIT_RADIO_RSSI_BIN_WIDTH;
+
+    stats.rxOk++;
+    stats.rssi[min(max(bin, 0), MICROBIT_RADIO_RSSI_BINS - 1)]++;
+}
+
+/**
+  * Attempt to queue a buffer received by the radio hardware, if sufficient space is available.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the queue is full or no replacement receiver buffer
+  *         was armed in time (either by policy or memory exhaustion).
+  */
+int MicroBitRadio::queueRxBuf()
+{
+    if (rxBuf == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    // In timeslot mode a fiber can't mask this interrupt while it changes the queue, so the frame is dropped instead.
+    if (queueDepth >= queueSize || rxLocked)
+    {
+        stats.rxQueueFull++;
+        return DEVICE_NO_RESOURCES;
+    }
 
-        p->next = rxBuf;
+    // Reception restarted as soon as this frame ended. Unless a replacement buffer was armed in time,
+    // it restarted into this same buffer, which is already being overwritten.
+    if (!rxArmed)
+    {
+        stats.rxAllocFailures++;
+        return DEVICE_NO_RESOURCES;
     }
 
+    // Store the received RSSI value in the frame, along with the time it was received.
+    rxBuf->rssi = getRSSI();
+    rxBuf->timestamp = (uint32_t) system_timer_current_time_us();
+
+    // We add to the tail of the queue to preserve causal ordering.
+    rxBuf->next = NULL;
+    rxQueue[(rxHead + queueDepth) % queueSize] = rxBuf;
+
     // Increase our received packet count
     queueDepth++;
 
-    // Allocate a new buffer for the receiver hardware to use. the old on will be passed on to higher layer protocols/apps.
-    rxBuf = newRxBuf;
+    // The armed buffer is now in use by the receiver hardware. the old on will be passed on to higher layer protocols/apps.
+    rxBuf = rxSpare;
+    rxSpare = NULL;
+    rxArmed = false;
 
     return DEVICE_OK;
 }
 
+/**
+  * Hands a spare buffer to the RADIO, to be used for the next reception. Called on the ADDRESS event,
+  * as PACKETPTR is double buffered and is read again when reception restarts at the end of the frame.
+  *
+  * @note should only be called from RADIO_IRQHandler...
+  */
+void MicroBitRadio::armRxBuf()
+{
+    rxBusy = true;
+
+    if (rxSpare == NULL)
+        rxSpare = allocRxBuf();
+
+    if (rxSpare != NULL)
+    {
+        NRF_RADIO->PACKETPTR = (uint32_t) rxSpare;
+        rxArmed = true;
+    }
+}
+
+/**
+  * Keeps the buffer holding a frame that was not queued (e.g. due to a CRC error) as the next spare,
+  * if reception has already moved on to the armed buffer.
+  *
+  * @note should only be called from RADIO_IRQHandler...
+  */
+void MicroBitRadio::recycleRxBuf()
+{
+    if (rxArmed)
+    {
+        FrameBuffer *b = rxBuf;
+        rxBuf = rxSpare;
+        rxSpare = b;
+        rxArmed = false;
+    }
+}
+
 /**
   * Sets the RSSI for the most recent packet.
   * The value is measured in -dbm. The higher the value, the stronger the signal.
@@ -278,33 +745,10 @@ int MicroBitRadio::getRSSI()
 }
 
 /**
-  * Initialises the radio for use as a multipoint sender/receiver
-  *
-  * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  * Applies our packet format, address, group, band and power settings to the RADIO.
   */
-int MicroBitRadio::enable()
+void MicroBitRadio::configureRadio()
 {
-    // If the device is already initialised, then there's nothing to do.
-    if (status & MICROBIT_RADIO_STATUS_INITIALISED)
-        return DEVICE_OK;
-
-    // Only attempt to enable this radio mode if BLE is disabled.
-    if (ble_running())
-        return DEVICE_NOT_SUPPORTED;
-
-    // If this is the first time we've been enable, allocate out receive buffers.
-    if (rxBuf == NULL)
-        rxBuf = new FrameBuffer();
-
-    if (rxBuf == NULL)
-        return DEVICE_NO_RESOURCES;
-
-    // Enable the High Frequency clock on the processor. This is a pre-requisite for
-    // the RADIO module. Without this clock, no communication is possible.
-    NRF_CLOCK->EVENTS_HFCLKSTARTED = 0;
-    NRF_CLOCK->TASKS_HFCLKSTART = 1;
-    while (NRF_CLOCK->EVENTS_HFCLKSTARTED == 0);
-
     // Bring up the nrf RADIO module in Nordic's proprietary 1MBps packet radio mode.
     NRF_RADIO->TXPOWER = (uint32_t)MICROBIT_RADIO_POWER_LEVEL[this->power];
     NRF_RADIO->FREQUENCY = (uint32_t)this->band;
@@ -319,9 +763,7 @@ int MicroBitRadio::enable()
     // We also map the assigned 8-bit GROUP id into the PREFIX field. This allows the RADIO hardware to perform
     // address matching for us, and only generate an interrupt when a packet matching our group is received.
     NRF_RADIO->BASE0 = MICROBIT_RADIO_BASE_ADDRESS;
-
-    // Join the default group. This will configure the remaining byte in the RADIO hardware module.
-    setGroup(this->group);
+    NRF_RADIO->PREFIX0 = (uint32_t)this->group;
 
     // The RADIO hardware module supports the use of multiple addresses, but as we're running anonymously, we only need one.
     // Configure the RADIO module to use the default address (address 0) for both send and receive operations.
@@ -346,85 +788,340 @@ int MicroBitRadio::enable()
 
     // Set the start random value of the data whitening algorithm. This can be any non zero number.
     NRF_RADIO->DATAWHITEIV = 0x18;
+}
 
-    // Set up the RADIO module to read and write from our internal buffer.
-    NRF_RADIO->PACKETPTR = (uint32_t)rxBuf;
-
-    // Configure the hardware to issue an interrupt whenever a task is complete (e.g. send/receive).
-    NRF_RADIO->INTENSET = 0x00000008;
-    NVIC_ClearPendingIRQ(RADIO_IRQn);
-    NVIC_EnableIRQ(RADIO_IRQn);
-
-    NRF_RADIO->SHORTS |= RADIO_SHORTS_ADDRESS_RSSISTART_Msk;
-
-    // Start listening for the next packet
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->TASKS_RXEN = 1;
-    while(NRF_RADIO->EVENTS_READY == 0);
+/**
+  * Initialises the radio for use as a multipoint sender/receiver.
+  * If the BLE stack is running and MICROBIT_RADIO_TIMESLOT is enabled, the radio operates in SoftDevice timeslots.
+  *
+  * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the BLE stack is running and timeslots are not available.
+  */
+int MicroBitRadio::enable()
+{
+    // If the device is already initialised, then there's nothing to do.
+    if (status & MICROBIT_RADIO_STATUS_INITIALISED)
+        return DEVICE_OK;
+
+    // Only attempt to enable this radio mode if BLE is disabled, unless we can share the RADIO with it.
+    bool timeslot = ble_running();
+
+    if (timeslot && !CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT))
+        return DEVICE_NOT_SUPPORTED;
+
+    // If this is the first time we've been enable, allocate out receive buffers.
+    // All buffers are allocated up front, so the receive interrupt never needs to use the heap.
+    if (growRxPool(MICROBIT_RADIO_RX_POOL_SIZE(queueSize)) != DEVICE_OK)
+        return DEVICE_NO_RESOURCES;
+
+    if (rxQueue == NULL)
+    {
+        rxQueue = new FrameBuffer*[queueSize];
+        MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, rxQueue, queueSize * sizeof(FrameBuffer *));
+    }
+
+    if (rxQueue == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    if (rxBuf == NULL)
+        rxBuf = allocRxBuf();
+
+    if (rxBuf == NULL)
+        return DEVICE_NO_RESOURCES;
 
+    // The SoftDevice configures the clocks, and we configure the RADIO at the start of each timeslot.
+    if (timeslot)
+        return openTimeslotSession();
+
+    // Enable the High Frequency clock on the processor. This is a pre-requisite for
+    // the RADIO module. Without this clock, no communication is possible.
+    NRF_CLOCK->EVENTS_HFCLKSTARTED = 0;
+    NRF_CLOCK->TASKS_HFCLKSTART = 1;
+    while (NRF_CLOCK->EVENTS_HFCLKSTARTED == 0);
+
+    configureRadio();
+
+    // Set up the RADIO module to read and write from our internal buffer.
+    NRF_RADIO->PACKETPTR = (uint32_t)rxBuf;
+    rxArmed = false;
+
+    // Configure the hardware to issue an interrupt whenever a task is complete (e.g. send/receive), whenever
+    // an address is matched (so the next receive buffer can be armed), and whenever the RADIO is disabled,
+    // which marks the completion of an asynchronous transmission.
+    NRF_RADIO->INTENSET = RADIO_INTENSET_ADDRESS_Msk | RADIO_INTENSET_END_Msk | RADIO_INTENSET_DISABLED_Msk;
+    NVIC_ClearPendingIRQ(RADIO_IRQn);
+    NVIC_EnableIRQ(RADIO_IRQn);
+
+    NRF_RADIO->SHORTS = MICROBIT_RADIO_SHORTS_RX;
+
+    // Start listening for the next packet. The READY_START short begins reception once the receiver has ramped up.
     NRF_RADIO->EVENTS_END = 0;
-    NRF_RADIO->TASKS_START = 1;
+    NRF_RADIO->EVENTS_ADDRESS = 0;
+    NRF_RADIO->TASKS_RXEN = 1;
 
     // register ourselves for a callback event, in order to empty the receive queue.
     status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
 
     // Done. Record that our RADIO is configured.
     status |= MICROBIT_RADIO_STATUS_INITIALISED;
+    microbit_energy_report(MICROBIT_ENERGY_RADIO, true);
+
+    // Under a listen schedule, this is the first receive window.
+    if (status & MICROBIT_RADIO_STATUS_LISTEN)
+        openListenWindow();
 
     return DEVICE_OK;
 }
 
+/**
+  * Opens a SoftDevice radio session, and requests the first timeslot. Used to enable the radio while the BLE stack is running.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if timeslots are not available.
+  */
+int MicroBitRadio::openTimeslotSession()
+{
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+    // This fails if the session from a previous enable() has yet to close.
+    if (sd_radio_session_open(radio_timeslot_handler) != NRF_SUCCESS)
+        return DEVICE_NOT_SUPPORTED;
+
+    slotActive = false;
+    txState = MICROBIT_RADIO_TX_IDLE;
+
+    // Discard any frames abandoned by disable(). No timeslot is active, so the RADIO interrupt can't move txHead.
+    txTail = txHead;
+
+    // Transmit events are raised from a software interrupt, as the timeslot signal handler may not use the event bus.
+    txCompleteSeen = txCompleteRaised;
+    txIdleSeen = txIdleRaised;
+    NVIC_SetPriority(MICROBIT_RADIO_EVT_IRQn, 7);
+    NVIC_ClearPendingIRQ(MICROBIT_RADIO_EVT_IRQn);
+    NVIC_EnableIRQ(MICROBIT_RADIO_EVT_IRQn);
+
+    // We must be ready before the first timeslot starts, which may be as soon as it is requested.
+    status |= MICROBIT_RADIO_STATUS_TIMESLOT | MICROBIT_RADIO_STATUS_INITIALISED | DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+    if (sd_radio_request(radio_timeslot_request()) != NRF_SUCCESS)
+    {
+        status &= ~(MICROBIT_RADIO_STATUS_TIMESLOT | MICROBIT_RADIO_STATUS_INITIALISED | DEVICE_COMPONENT_STATUS_IDLE_TICK);
+        sd_radio_session_close();
+
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    microbit_energy_report(MICROBIT_ENERGY_RADIO, true);
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
 /**
   * Disables the radio for use as a multipoint sender/receiver.
   *
-  * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the BLE stack is running and the radio is not in timeslot mode.
   */
 int MicroBitRadio::disable()
 {
     // Only attempt to enable.disable the radio if the protocol is alreayd running.
-    if (ble_running())
+    if (ble_running() && !isTimeslotMode())
         return DEVICE_NOT_SUPPORTED;
 
     if (!(status & MICROBIT_RADIO_STATUS_INITIALISED))
         return DEVICE_OK;
 
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+    if (status & MICROBIT_RADIO_STATUS_TIMESLOT)
+    {
+        // Abandon any queued transmissions. The RADIO interrupt still owns the queue until the current timeslot (if any)
+        // has ended, so the frames are left in place, but no more are started. The SoftDevice closes the session
+        // once the timeslot has ended, and no further timeslots are requested.
+        status &= ~(MICROBIT_RADIO_STATUS_INITIALISED | DEVICE_COMPONENT_STATUS_IDLE_TICK);
+
+        // Release any fibers waiting on the abandoned transmissions.
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_IDLE);
+
+        status &= ~MICROBIT_RADIO_STATUS_TIMESLOT;
+        sd_radio_session_close();
+        microbit_energy_report(MICROBIT_ENERGY_RADIO, false);
+
+        return DEVICE_OK;
+    }
+#endif
+
+    // The listen schedule restarts when the radio is next enabled.
+    system_timer_cancel_event(DEVICE_ID_RADIO_LISTEN, MICROBIT_RADIO_LISTEN_EVT_OPEN);
+    system_timer_cancel_event(DEVICE_ID_RADIO_LISTEN, MICROBIT_RADIO_LISTEN_EVT_CLOSE);
+
     // Disable interrupts and STOP any ongoing packet reception.
     NVIC_DisableIRQ(RADIO_IRQn);
 
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while(NRF_RADIO->EVENTS_DISABLED == 0);
+    // Between listen windows, the RADIO is already stopped unless it is transmitting.
+    bool active = listening || txState != MICROBIT_RADIO_TX_IDLE;
+
+    // Abandon any queued transmissions. The RADIO SHORTS are reconfigured when the radio is next enabled.
+    txTail = txHead;
+    txState = MICROBIT_RADIO_TX_IDLE;
+    listening = true;
+    rxBusy = false;
+
+    if (active)
+    {
+        NRF_RADIO->EVENTS_DISABLED = 0;
+        NRF_RADIO->TASKS_DISABLE = 1;
+        while(NRF_RADIO->EVENTS_DISABLED == 0);
+    }
 
     // deregister ourselves from the callback event used to empty the receive queue.
     status &= ~DEVICE_COMPONENT_STATUS_IDLE_TICK;
 
     // record that the radio is now disabled
     status &= ~MICROBIT_RADIO_STATUS_INITIALISED;
+    microbit_energy_report(MICROBIT_ENERGY_RADIO, false);
+
+    // Release any fibers waiting on the abandoned transmissions.
+    Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_IDLE);
 
     return DEVICE_OK;
 }
 
+/**
+  * Determines if the radio is operating in SoftDevice timeslots, alongside the BLE stack.
+  *
+  * @return true if the radio is in timeslot mode, false otherwise.
+  */
+bool MicroBitRadio::isTimeslotMode()
+{
+    return (status & MICROBIT_RADIO_STATUS_TIMESLOT) != 0;
+}
+
+/**
+  * Determines if the RADIO registers may be used. They may not while we're waiting for a SoftDevice timeslot.
+  *
+  * @return true if the RADIO registers may be used, false otherwise.
+  */
+bool MicroBitRadio::ownsRadio()
+{
+    return !(status & MICROBIT_RADIO_STATUS_TIMESLOT) || slotActive;
+}
+
+/**
+  * Masks the RADIO interrupt, to protect state shared with it. In timeslot mode, the RADIO interrupt belongs to the
+  * SoftDevice and must not be masked, so all interrupts are briefly disabled instead.
+  *
+  * @return true if interrupts were masked by this call, and should be restored with unlockRadio().
+  */
+bool MicroBitRadio::lockRadio()
+{
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+    // The RADIO interrupt belongs to the SoftDevice whenever it is enabled, even during the last timeslot after disable().
+    if (ble_running())
+    {
+        uint8_t nested = 0;
+        sd_nvic_critical_region_enter(&nested);
+
+        if (nested)
+            return false;
+
+        rxLocked = true;
+        return true;
+    }
+#endif
+
+    bool irq = NVIC_GetEnableIRQ(RADIO_IRQn);
+    NVIC_DisableIRQ(RADIO_IRQn);
+
+    return irq;
+}
+
+/**
+  * Restores interrupts masked by lockRadio().
+  *
+  * @param irq the value returned by lockRadio().
+  */
+void MicroBitRadio::unlockRadio(bool irq)
+{
+    if (!irq)
+        return;
+
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+    if (ble_running())
+    {
+        rxLocked = false;
+        sd_nvic_critical_region_exit(0);
+        return;
+    }
+#endif
+
+    NVIC_EnableIRQ(RADIO_IRQn);
+}
+
 /**
   * Sets the radio to listen to packets sent with the given group id.
   *
   * @param group The group to join. A micro:bit can only listen to one group ID at any time.
   *
-  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running and the radio is not in timeslot mode.
   */
 int MicroBitRadio::setGroup(uint8_t group)
 {
-    if (ble_running())
+    if (ble_running() && !isTimeslotMode())
         return DEVICE_NOT_SUPPORTED;
 
     // Record our group id locally
     this->group = group;
 
     // Also append it to the address of this device, to allow the RADIO module to filter for us.
-    NRF_RADIO->PREFIX0 = (uint32_t)group;
+    // In timeslot mode, this is applied at the start of the next timeslot.
+    if (!(status & MICROBIT_RADIO_STATUS_TIMESLOT))
+        NRF_RADIO->PREFIX0 = (uint32_t)group;
+
+    if (status & MICROBIT_RADIO_STATUS_AUTO_BAND)
+        return setFrequencyBand(getBandForGroup(group));
 
     return DEVICE_OK;
 }
 
+/**
+  * Enables or disables automatic frequency band assignment. When enabled, each group is placed on one of
+  * a fixed set of well separated bands, chosen from the group id, so that groups sharing a space also share
+  * the available spectrum rather than all colliding on the default band. All members of a group must enable
+  * this to hear each other.
+  *
+  * While enabled, the band is reassigned whenever the group changes.
+  *
+  * @param enabled true to assign the band from the group, false to leave the band as it is.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  */
+int MicroBitRadio::setAutomaticBand(bool enabled)
+{
+    if (ble_running() && !isTimeslotMode())
+        return DEVICE_NOT_SUPPORTED;
+
+    if (!enabled)
+    {
+        status &= ~MICROBIT_RADIO_STATUS_AUTO_BAND;
+        return DEVICE_OK;
+    }
+
+    status |= MICROBIT_RADIO_STATUS_AUTO_BAND;
+
+    return setFrequencyBand(getBandForGroup(group));
+}
+
+/**
+  * Determines the frequency band used for the given group by automatic band assignment.
+  *
+  * @param group The group id.
+  *
+  * @return the frequency band assigned to the group.
+  */
+int MicroBitRadio::getBandForGroup(uint8_t group)
+{
+    return MICROBIT_RADIO_AUTO_BANDS[group % sizeof(MICROBIT_RADIO_AUTO_BANDS)];
+}
+
 /**
   * A background, low priority callback that is triggered whenever the processor is idle.
   * Here, we empty our queue of received packets, and pass them onto higher level protocol handlers.
@@ -432,9 +1129,9 @@ int MicroBitRadio::setGroup(uint8_t group)
 void MicroBitRadio::idleCallback()
 {
     // Walk the list of packets and process each one.
-    while(rxQueue)
+    while(queueDepth)
     {
-        FrameBuffer *p = rxQueue;
+        FrameBuffer *p = rxQueue[rxHead];
 
         switch (p->protocol)
         {
@@ -446,18 +1143,40 @@ void MicroBitRadio::idleCallback()
                 event.packetReceived();
                 break;
 
+            case MICROBIT_RADIO_PROTOCOL_FRAGMENT:
+                datagram.fragmentReceived();
+                break;
+
+            case MICROBIT_RADIO_PROTOCOL_RELIABLE:
+                reliable.packetReceived();
+                break;
+
+            case MICROBIT_RADIO_PROTOCOL_TDMA:
+                tdma.packetReceived();
+                break;
+
+            case MICROBIT_RADIO_PROTOCOL_MESH:
+                mesh.packetReceived();
+                break;
+
             default:
                 Event(DEVICE_ID_RADIO_DATA_READY, p->protocol);
         }
 
         // If the packet was processed, it will have been recv'd, and taken from the queue.
         // If this was a packet for an unknown protocol, it will still be there, so simply free it.
-        if (p == rxQueue)
+        if (queueDepth && p == rxQueue[rxHead])
         {
             recv();
             delete p;
         }
     }
+
+    // Service retransmission timers and delayed acknowledgements.
+    reliable.idleCallback();
+
+    // Rebroadcast mesh messages whose delay has expired.
+    mesh.idleCallback();
 }
 
 /**
@@ -482,18 +1201,20 @@ int MicroBitRadio::dataReady()
   */
 FrameBuffer* MicroBitRadio::recv()
 {
-    FrameBuffer *p = rxQueue;
+    FrameBuffer *p = NULL;
 
-    if (p)
+    if (queueDepth)
     {
-         // Protect shared resource from ISR activity
-        NVIC_DisableIRQ(RADIO_IRQn);
+        // Protect shared resource from ISR activity
+        bool irq = lockRadio();
 
-        rxQueue = rxQueue->next;
+        // The ISR appends at rxHead + queueDepth, so both must change together.
+        p = rxQueue[rxHead];
+        rxHead = (rxHead + 1) % queueSize;
         queueDepth--;
 
         // Allow ISR access to shared resource
-        NVIC_EnableIRQ(RADIO_IRQn);
+        unlockRadio(irq);
     }
 
     return p;
@@ -505,11 +1226,11 @@ FrameBuffer* MicroBitRadio::recv()
   *
   * @param data The packet contents to transmit.
   *
-  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running and the radio is not in timeslot mode.
   */
 int MicroBitRadio::send(FrameBuffer *buffer)
 {
-    if (ble_running())
+    if (ble_running() && !isTimeslotMode())
         return DEVICE_NOT_SUPPORTED;
 
     if (buffer == NULL)
@@ -518,50 +1239,569 @@ int MicroBitRadio::send(FrameBuffer *buffer)
     if (buffer->length > MICROBIT_RADIO_MAX_PACKET_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1)
         return DEVICE_INVALID_PARAMETER;
 
-    // Firstly, disable the Radio interrupt. We want to wait until the trasmission completes.
-    NVIC_DisableIRQ(RADIO_IRQn);
+    // Transmit through the asynchronous queue, behind any frames already queued by sendAsync(), so the RADIO SHORTS
+    // configuration is managed in one place. Then wait until the queue (and so this frame) has been sent.
+    awaitTxSpace();
 
-    // Turn off the transceiver.
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while(NRF_RADIO->EVENTS_DISABLED == 0);
+    int result = sendAsync(buffer);
+
+    // The deepest point of a blocking send, with the caller's FrameBuffer still on the stack.
+    MICROBIT_STACK_SAMPLE();
+
+    if (result == DEVICE_OK)
+        awaitTxIdle();
+
+    return result;
+}
+
+/**
+  * Queues the given buffer for transmission onto the broadcast radio, and returns immediately.
+  * The buffer is copied, so may be reused as soon as this call returns. Queued frames are sent back to back by
+  * the RADIO interrupt, and a MICROBIT_RADIO_EVT_TX_COMPLETE event is raised as each one is transmitted.
+  *
+  * @param buffer The packet contents to transmit.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the buffer is invalid, DEVICE_INVALID_STATE if the radio
+  *         is not enabled, DEVICE_NO_RESOURCES if the transmit queue is full, or DEVICE_NOT_SUPPORTED if the BLE stack is running
+  *         and the radio is not in timeslot mode.
+  */
+int MicroBitRadio::sendAsync(FrameBuffer *buffer)
+{
+    if (ble_running() && !isTimeslotMode())
+        return DEVICE_NOT_SUPPORTED;
+
+    if (buffer == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (buffer->length > MICROBIT_RADIO_MAX_PACKET_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (!(status & MICROBIT_RADIO_STATUS_INITIALISED))
+        return DEVICE_INVALID_STATE;
+
+    if (txQueue == NULL)
+    {
+        txQueue = new FrameBuffer[MICROBIT_RADIO_TX_QUEUE_SIZE];
+        MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_RADIO, txQueue, MICROBIT_RADIO_TX_QUEUE_SIZE * sizeof(FrameBuffer));
+    }
+
+    if (txQueue == NULL || txQueued() >= MICROBIT_RADIO_TX_QUEUE_SIZE)
+        return DEVICE_NO_RESOURCES;
+
+    // The RADIO interrupt only reads the frames before txTail, so the frame is filled in before txTail publishes it.
+    // The length field and the header fields it counts are copied along with the payload.
+    memcpy(&txQueue[txTail % MICROBIT_RADIO_TX_QUEUE_SIZE], buffer, buffer->length + 1);
+    __DMB();
+    txTail = (txTail + 1) % (2 * MICROBIT_RADIO_TX_QUEUE_SIZE);
+
+    // In timeslot mode only the signal handler drives the RADIO, so the frame waits for the start of the next timeslot.
+    if (isTimeslotMode())
+        return DEVICE_OK;
+
+    // If the transmitter is idle, stop the receiver. The DISABLED interrupt will then start the transmission.
+    bool irq = lockRadio();
+
+    if (txState == MICROBIT_RADIO_TX_IDLE && !txHold)
+        startTransmitter();
+
+    unlockRadio(irq);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines if frames queued by sendAsync() are awaiting transmission.
+  *
+  * @return true if frames are queued or being transmitted, false otherwise.
+  */
+bool MicroBitRadio::isTransmitting()
+{
+    // Frames abandoned by disable() in timeslot mode stay queued until the radio is next enabled.
+    return (status & MICROBIT_RADIO_STATUS_INITIALISED) && (txState != MICROBIT_RADIO_TX_IDLE || txQueued());
+}
+
+/**
+  * Determines the number of frames queued by sendAsync() and not yet transmitted. txHead and txTail each have a
+  * single writer, so this may be called from any context without locking.
+  *
+  * @return the number of frames in txQueue.
+  */
+int MicroBitRadio::txQueued()
+{
+    return (txTail - txHead + 2 * MICROBIT_RADIO_TX_QUEUE_SIZE) % (2 * MICROBIT_RADIO_TX_QUEUE_SIZE);
+}
+
+/**
+  * Determines the state of the transmitter.
+  *
+  * @return one of MICROBIT_RADIO_TX_IDLE, MICROBIT_RADIO_TX_DISABLING or MICROBIT_RADIO_TX_SENDING.
+  */
+int MicroBitRadio::getTransmitterState()
+{
+    return txState;
+}
+
+/**
+  * Holds back (or releases) frames queued by sendAsync(). While held, frames are queued but not transmitted,
+  * and a frame already on air is allowed to complete. This allows transmissions to be confined to time slots.
+  *
+  * @param hold true to hold queued frames, false to transmit them.
+  *
+  * @note may be called from interrupt context.
+  */
+void MicroBitRadio::setTransmitHold(bool hold)
+{
+    bool irq = lockRadio();
+
+    txHold = hold;
+
+    // If frames are waiting, stop the receiver. The DISABLED interrupt will then start the transmission.
+    // In timeslot mode, they wait for the start of the next timeslot.
+    if (!hold && txQueued() && txState == MICROBIT_RADIO_TX_IDLE && (status & MICROBIT_RADIO_STATUS_INITIALISED) && !isTimeslotMode())
+        startTransmitter();
 
-    // Configure the radio to send the buffer provided.
-    NRF_RADIO->PACKETPTR = (uint32_t) buffer;
+    unlockRadio(irq);
+}
+
+/**
+  * Moves the transmitter on to its next state, each time the RADIO signals it has been disabled.
+  * This either starts transmission of the next queued frame, or returns the RADIO to receive mode.
+  *
+  * @note should only be called from RADIO_IRQHandler...
+  */
+void MicroBitRadio::serviceTxQueue()
+{
+    // The RADIO is also disabled by blocking operations, which don't rely on this interrupt.
+    if (txState == MICROBIT_RADIO_TX_IDLE)
+        return;
+
+    // If we were transmitting, the frame at the head of the queue is complete.
+    if (txState == MICROBIT_RADIO_TX_SENDING)
+    {
+        txHead = (txHead + 1) % (2 * MICROBIT_RADIO_TX_QUEUE_SIZE);
+
+        stats.txCount++;
+        stats.txTime += (uint32_t) system_timer_current_time_us() - txStart;
+
+        raiseTxEvent(MICROBIT_RADIO_EVT_TX_COMPLETE);
+    }
 
-    // Turn on the transmitter, and wait for it to signal that it's ready to use.
     NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->TASKS_TXEN = 1;
-    while (NRF_RADIO->EVENTS_READY == 0);
+    NRF_RADIO->EVENTS_END = 0;
+
+    // Once disabled, no new frames are started. See disable().
+    if (txQueued() && !txHold && (status & MICROBIT_RADIO_STATUS_INITIALISED))
+    {
+        // Ramp up the transmitter, and let the RADIO SHORTS start the transmission and disable the transmitter afterwards.
+        NRF_RADIO->PACKETPTR = (uint32_t) &txQueue[txHead % MICROBIT_RADIO_TX_QUEUE_SIZE];
+        NRF_RADIO->SHORTS = MICROBIT_RADIO_SHORTS_TX;
+        NRF_RADIO->TASKS_TXEN = 1;
+        txStart = (uint32_t) system_timer_current_time_us();
+
+        txState = MICROBIT_RADIO_TX_SENDING;
+    }
+    else
+    {
+        // Return to receive mode, unless the listen window closed while we were transmitting.
+        if (listening)
+            startReceiver();
+
+        txState = MICROBIT_RADIO_TX_IDLE;
 
-    // Start transmission and wait for end of packet.
-    NRF_RADIO->TASKS_START = 1;
+        if (txQueued() == 0)
+            raiseTxEvent(MICROBIT_RADIO_EVT_TX_IDLE);
+    }
+}
+
+/**
+  * Raises a transmit event from the RADIO interrupt. In timeslot mode this runs in the SoftDevice's highest
+  * priority signal handler, where the event bus must not be used, so the event is passed on to a software
+  * interrupt at application priority instead.
+  *
+  * @param value MICROBIT_RADIO_EVT_TX_COMPLETE or MICROBIT_RADIO_EVT_TX_IDLE.
+  */
+void MicroBitRadio::raiseTxEvent(uint16_t value)
+{
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+    // Within a timeslot we're in the signal handler, even during the last timeslot after disable().
+    if (slotActive)
+    {
+        if (value == MICROBIT_RADIO_EVT_TX_COMPLETE)
+            txCompleteRaised++;
+        else
+            txIdleRaised++;
+
+        NVIC_SetPendingIRQ(MICROBIT_RADIO_EVT_IRQn);
+        return;
+    }
+#endif
+
+    Event(DEVICE_ID_RADIO, value);
+}
+
+/**
+  * Raises the transmit events recorded by the RADIO interrupt in timeslot mode. See raiseTxEvent().
+  *
+  * @note should only be called from the software interrupt raiseTxEvent() pends.
+  */
+void MicroBitRadio::raiseDeferredEvents()
+{
+    // Each counter has a single writer, so the signal handler may record more events while these are raised.
+    while (txCompleteSeen != txCompleteRaised)
+    {
+        txCompleteSeen++;
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_COMPLETE);
+    }
+
+    // An idle queue needs only be reported once.
+    if (txIdleSeen != txIdleRaised)
+    {
+        txIdleSeen = txIdleRaised;
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_IDLE);
+    }
+}
+
+/**
+  * Starts the receiver. The READY_START short begins reception once the receiver has ramped up.
+  */
+void MicroBitRadio::startReceiver()
+{
+    NRF_RADIO->SHORTS = MICROBIT_RADIO_SHORTS_RX;
+    NRF_RADIO->PACKETPTR = (uint32_t) rxBuf;
     NRF_RADIO->EVENTS_END = 0;
-    while(NRF_RADIO->EVENTS_END == 0);
+    NRF_RADIO->EVENTS_ADDRESS = 0;
+    rxArmed = false;
+    NRF_RADIO->TASKS_RXEN = 1;
+}
+
+/**
+  * Starts transmission of the frame at the head of the transmit queue, stopping the receiver first if necessary.
+  * Must be called with the RADIO locked, while the transmitter is idle.
+  */
+void MicroBitRadio::startTransmitter()
+{
+    txState = MICROBIT_RADIO_TX_DISABLING;
+
+    // Stop the receiver, and let the DISABLED interrupt start the transmission. Between listen windows the RADIO
+    // is already disabled, so there's no interrupt to wait for.
+    if (listening)
+        NRF_RADIO->TASKS_DISABLE = 1;
+    else
+        serviceTxQueue();
+}
+
+/**
+  * Takes over the RADIO at the start of a SoftDevice timeslot, and sends any queued frames or starts listening.
+  *
+  * @note should only be called from the timeslot signal handler...
+  */
+void MicroBitRadio::startTimeslot()
+{
+    // The SoftDevice will have reconfigured the RADIO for BLE since our last timeslot.
+    configureRadio();
 
-    // Return the radio to using the default receive buffer
     NRF_RADIO->PACKETPTR = (uint32_t) rxBuf;
+    rxArmed = false;
+
+    NRF_RADIO->EVENTS_DISABLED = 0;
+    NRF_RADIO->INTENSET = RADIO_INTENSET_ADDRESS_Msk | RADIO_INTENSET_END_Msk | RADIO_INTENSET_DISABLED_Msk;
+    NVIC_EnableIRQ(RADIO_IRQn);
+
+    slotActive = true;
+
+    // The RADIO is already disabled, so move straight on to transmitting anything queued since the last timeslot,
+    // or to listening if there's nothing to send.
+    txState = MICROBIT_RADIO_TX_DISABLING;
+    serviceTxQueue();
+}
+
+/**
+  * Hands the RADIO back at the end of a SoftDevice timeslot. A frame cut short is sent again in the next timeslot.
+  *
+  * @note should only be called from the timeslot signal handler...
+  */
+void MicroBitRadio::endTimeslot()
+{
+    slotActive = false;
+
+    NRF_RADIO->INTENCLR = RADIO_INTENCLR_ADDRESS_Msk | RADIO_INTENCLR_END_Msk | RADIO_INTENCLR_DISABLED_Msk;
+    NRF_RADIO->SHORTS = 0;
 
-    // Turn off the transmitter.
     NRF_RADIO->EVENTS_DISABLED = 0;
     NRF_RADIO->TASKS_DISABLE = 1;
-    while(NRF_RADIO->EVENTS_DISABLED == 0);
+    while (NRF_RADIO->EVENTS_DISABLED == 0);
+    NRF_RADIO->EVENTS_DISABLED = 0;
 
-    // Start listening for the next packet
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->TASKS_RXEN = 1;
-    while(NRF_RADIO->EVENTS_READY == 0);
+    // Any frame being transmitted stays at the head of the queue. Any frame being received is lost.
+    txState = MICROBIT_RADIO_TX_IDLE;
+    rxArmed = false;
+}
 
-    NRF_RADIO->EVENTS_END = 0;
-    NRF_RADIO->TASKS_START = 1;
+/**
+  * Schedules the given listen schedule timer event, replacing any matching event already scheduled.
+  * The events wake the processor from tickless idle.
+  */
+static void listen_schedule(uint16_t event, uint32_t delay)
+{
+    system_timer_cancel_event(DEVICE_ID_RADIO_LISTEN, event);
+    system_timer_event_after_us(delay, DEVICE_ID_RADIO_LISTEN, event, CODAL_TIMER_EVENT_FLAGS_WAKEUP);
+}
 
-    // Re-enable the Radio interrupt.
-    NVIC_ClearPendingIRQ(RADIO_IRQn);
-    NVIC_EnableIRQ(RADIO_IRQn);
+/**
+  * Applies a low power listening schedule. Rather than listening continuously, the receiver is turned on for a short
+  * window at the start of each period, and is off in between, leaving the processor free to sleep until the next window
+  * (e.g. through the tickless idle of MicroBitPowerManager). A window is held open for MICROBIT_RADIO_LISTEN_HOLD after
+  * each frame heard, so that bursts are received whole. Frames may still be sent at any time.
+  *
+  * Senders must make sure their frames fall within a window, either by repeating a frame for a full period, or by
+  * aligning the schedule to a known transmission time with syncListenSchedule(), as MicroBitRadioTDMA does with its beacons.
+  *
+  * @param window The length of each receive window (in microseconds), or 0 to listen continuously.
+  *
+  * @param period The interval between the start of each window (in microseconds).
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the window is shorter than MICROBIT_RADIO_LISTEN_MIN_WINDOW
+  *         or not shorter than the period, DEVICE_NO_RESOURCES if no default EventModel is available, or
+  *         DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  */
+int MicroBitRadio::setListenSchedule(uint32_t window, uint32_t period)
+{
+    // The SoftDevice decides when we may use the RADIO in timeslot mode.
+    if (ble_running())
+        return DEVICE_NOT_SUPPORTED;
+
+    if (window && (window < MICROBIT_RADIO_LISTEN_MIN_WINDOW || window >= period))
+        return DEVICE_INVALID_PARAMETER;
+
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    stopListenSchedule();
+
+    listenWindow = window;
+    listenPeriod = period;
+
+    if (window == 0)
+    {
+        if (status & MICROBIT_RADIO_STATUS_LISTEN)
+        {
+            status &= ~MICROBIT_RADIO_STATUS_LISTEN;
+            EventModel::defaultEventBus->ignore(DEVICE_ID_RADIO_LISTEN, DEVICE_EVT_ANY, this, &MicroBitRadio::listenEvent);
+        }
+
+        return DEVICE_OK;
+    }
+
+    // Windows must open and close promptly, so handle the timer events in interrupt context.
+    if (!(status & MICROBIT_RADIO_STATUS_LISTEN))
+    {
+        status |= MICROBIT_RADIO_STATUS_LISTEN;
+        EventModel::defaultEventBus->listen(DEVICE_ID_RADIO_LISTEN, DEVICE_EVT_ANY, this, &MicroBitRadio::listenEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
+    }
+
+    // The schedule starts from now. Otherwise, it starts when the radio is enabled.
+    if (status & MICROBIT_RADIO_STATUS_INITIALISED)
+        openListenWindow();
 
     return DEVICE_OK;
 }
 
+/**
+  * Aligns the listen schedule to a sender, so that the next receive window opens after the given delay.
+  * Later windows follow on at the scheduled period. A window that is currently open is left to close as usual.
+  *
+  * @param delay The time until the next window opens (in microseconds).
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if no listen schedule is in use.
+  */
+int MicroBitRadio::syncListenSchedule(uint32_t delay)
+{
+    if (!(status & MICROBIT_RADIO_STATUS_LISTEN))
+        return DEVICE_INVALID_STATE;
+
+    if (status & MICROBIT_RADIO_STATUS_INITIALISED)
+        listen_schedule(MICROBIT_RADIO_LISTEN_EVT_OPEN, delay);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines if a listen schedule is in use.
+  *
+  * @return true if the receiver is turned on in windows, false if it listens continuously.
+  */
+bool MicroBitRadio::isListenScheduled()
+{
+    return (status & MICROBIT_RADIO_STATUS_LISTEN) != 0;
+}
+
+/**
+  * Determines if the receiver is currently turned on.
+  *
+  * @return true if the radio is enabled and listening, false if it is disabled or between receive windows.
+  */
+bool MicroBitRadio::isListening()
+{
+    return (status & MICROBIT_RADIO_STATUS_INITIALISED) && listening;
+}
+
+/**
+  * Opens a receive window of the listen schedule, and schedules the next.
+  */
+void MicroBitRadio::openListenWindow()
+{
+    // Schedule the next window first, to keep the period as steady as possible.
+    listen_schedule(MICROBIT_RADIO_LISTEN_EVT_OPEN, listenPeriod);
+    listen_schedule(MICROBIT_RADIO_LISTEN_EVT_CLOSE, listenWindow);
+
+    listenFrames = stats.rxOk + stats.rxCrcErrors;
+
+    bool irq = lockRadio();
+
+    // If we're transmitting, the transmitter returns to receive mode once the transmit queue is empty.
+    if (!listening && txState == MICROBIT_RADIO_TX_IDLE)
+        startReceiver();
+
+    listening = true;
+
+    unlockRadio(irq);
+
+    microbit_energy_report(MICROBIT_ENERGY_RADIO, true);
+}
+
+/**
+  * Closes the current receive window of the listen schedule, unless frames are still arriving.
+  */
+void MicroBitRadio::closeListenWindow()
+{
+    uint32_t frames = stats.rxOk + stats.rxCrcErrors;
+
+    // Hold the window open while a frame is being received, and for a while after each frame, as more may follow.
+    if (rxBusy || frames != listenFrames)
+    {
+        listenFrames = frames;
+        listen_schedule(MICROBIT_RADIO_LISTEN_EVT_CLOSE, MICROBIT_RADIO_LISTEN_HOLD);
+        return;
+    }
+
+    bool irq = lockRadio();
+
+    listening = false;
+
+    // A frame being transmitted is left to complete, after which the transmitter leaves the RADIO disabled.
+    if (txState == MICROBIT_RADIO_TX_IDLE)
+    {
+        NRF_RADIO->SHORTS = 0;
+        NRF_RADIO->EVENTS_DISABLED = 0;
+        NRF_RADIO->TASKS_DISABLE = 1;
+        while (NRF_RADIO->EVENTS_DISABLED == 0);
+        NRF_RADIO->EVENTS_DISABLED = 0;
+        rxArmed = false;
+    }
+
+    unlockRadio(irq);
+
+    microbit_energy_report(MICROBIT_ENERGY_RADIO, false);
+}
+
+/**
+  * Cancels any listen schedule timer events, and turns the receiver back on if it is between windows.
+  */
+void MicroBitRadio::stopListenSchedule()
+{
+    system_timer_cancel_event(DEVICE_ID_RADIO_LISTEN, MICROBIT_RADIO_LISTEN_EVT_OPEN);
+    system_timer_cancel_event(DEVICE_ID_RADIO_LISTEN, MICROBIT_RADIO_LISTEN_EVT_CLOSE);
+
+    if (!listening && (status & MICROBIT_RADIO_STATUS_INITIALISED))
+    {
+        bool irq = lockRadio();
+
+        if (txState == MICROBIT_RADIO_TX_IDLE)
+            startReceiver();
+
+        listening = true;
+
+        unlockRadio(irq);
+
+        microbit_energy_report(MICROBIT_ENERGY_RADIO, true);
+    }
+
+    listening = true;
+}
+
+/**
+  * Listen schedule timer event handler, called in interrupt context at the start and end of each receive window.
+  */
+void MicroBitRadio::listenEvent(Event e)
+{
+    if (!(status & MICROBIT_RADIO_STATUS_LISTEN) || !(status & MICROBIT_RADIO_STATUS_INITIALISED))
+        return;
+
+    if (e.value == MICROBIT_RADIO_LISTEN_EVT_OPEN)
+        openListenWindow();
+
+    if (e.value == MICROBIT_RADIO_LISTEN_EVT_CLOSE && listening)
+        closeListenWindow();
+}
+
+/**
+  * Waits until all frames queued by sendAsync() have been transmitted.
+  * Other fibers continue to run in the meantime.
+  */
+void MicroBitRadio::awaitTxIdle()
+{
+    awaitTxDepth(0);
+}
+
+/**
+  * Waits until the transmit queue has room for another frame.
+  * Other fibers continue to run in the meantime.
+  */
+void MicroBitRadio::awaitTxSpace()
+{
+    awaitTxDepth(MICROBIT_RADIO_TX_QUEUE_SIZE);
+}
+
+/**
+  * Blocks the calling fiber until fewer than the given number of frames are queued by sendAsync(), or, if depth
+  * is zero, until the transmitter is idle. Falls back to waiting for an interrupt if the caller cannot block.
+  *
+  * @param depth the queue depth to wait for, or zero to wait for the transmitter to be idle.
+  */
+void MicroBitRadio::awaitTxDepth(int depth)
+{
+    // Each sent frame raises MICROBIT_RADIO_EVT_TX_COMPLETE, and an emptied queue MICROBIT_RADIO_EVT_TX_IDLE.
+    uint16_t value = depth ? DEVICE_EVT_ANY : MICROBIT_RADIO_EVT_TX_IDLE;
+    bool block = fiber_scheduler_running() && (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0;
+
+    while (true)
+    {
+        // Check and start waiting with the interrupt that raises the event masked, so it can't be raised in between
+        // and missed. In timeslot mode, that is the software interrupt alone.
+        IRQn_Type source = RADIO_IRQn;
+#if defined(SOFTDEVICE_PRESENT) && CONFIG_ENABLED(MICROBIT_RADIO_TIMESLOT)
+        if (ble_running())
+            source = MICROBIT_RADIO_EVT_IRQn;
+#endif
+        bool irq = NVIC_GetEnableIRQ(source);
+        NVIC_DisableIRQ(source);
+
+        bool busy = depth ? txQueued() >= depth : isTransmitting();
+        bool waiting = busy && block && fiber_wake_on_event(DEVICE_ID_RADIO, value) == DEVICE_OK;
+
+        if (irq)
+            NVIC_EnableIRQ(source);
+
+        if (!busy)
+            return;
+
+        if (waiting)
+            schedule();
+        else
+            target_wait_for_event();
+    }
+}
+
 /**
  * Puts the component in (or out of) sleep (low power) mode.
  */
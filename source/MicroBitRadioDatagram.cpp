@@ -24,6 +24,7 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "MicroBitRadio.h"
+#include "CodalFiber.h"
 
 using namespace codal;
 
@@ -50,6 +51,13 @@ using namespace codal;
 MicroBitRadioDatagram::MicroBitRadioDatagram(MicroBitRadio &r) : radio(r)
 {
     this->rxQueue = NULL;
+
+    this->fragmentsRemaining = 0;
+    this->fragmentId = 0;
+    this->txFragmentId = 0;
+    this->fragmentTime = 0;
+    this->largeHead = 0;
+    this->largeDepth = 0;
 }
 
 /**
@@ -98,10 +106,8 @@ PacketBuffer MicroBitRadioDatagram::recv()
     FrameBuffer *p = rxQueue;
     rxQueue = rxQueue->next;
 
-    PacketBuffer packet(p->payload, p->length - (MICROBIT_RADIO_HEADER_SIZE - 1), p->rssi);
-
-    delete p;
-    return packet;
+    // The PacketBuffer adopts the frame, and returns it to the radio's receive pool once released.
+    return PacketBuffer(p);
 }
 
 /**
@@ -165,6 +171,177 @@ int MicroBitRadioDatagram::send(ManagedString data)
     return send((uint8_t *)data.toCharArray(), data.length());
 }
 
+/**
+  * Transmits the given buffer onto the broadcast radio, split into as many fragments as are needed.
+  * Fragments are queued back to back with MicroBitRadio::sendAsync(), then reassembled by the receiver
+  * and delivered through recvLarge().
+  *
+  * This is a synchronous call that will wait until the transmission of the last fragment
+  * has completed before returning.
+  *
+  * @param buffer The datagram contents to transmit.
+  *
+  * @param len The number of bytes to transmit, up to MICROBIT_RADIO_LARGE_MAX_SIZE.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer is invalid or the
+  *         number of bytes to transmit is out of range.
+  *
+  * @note There is no acknowledgement or retransmission, so a transfer is lost if any of its fragments
+  *       are lost. Only one large datagram can be reassembled at a time, so concurrent large transfers
+  *       from different senders in the same group will interfere with each other.
+  */
+int MicroBitRadioDatagram::sendLarge(uint8_t *buffer, int len)
+{
+    if (buffer == NULL || len <= 0 || len > MICROBIT_RADIO_LARGE_MAX_SIZE ||
+        len > MICROBIT_RADIO_FRAGMENT_MAX_COUNT * MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    FrameBuffer buf;
+    int result = DEVICE_OK;
+
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_FRAGMENT;
+    buf.payload[0] = ++txFragmentId;
+    buf.payload[2] = len & 0xFF;
+    buf.payload[3] = len >> 8;
+
+    for (int offset = 0, index = 0; offset < len && result == DEVICE_OK; offset += MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE, index++)
+    {
+        int l = min(len - offset, MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE);
+
+        buf.length = l + MICROBIT_RADIO_FRAGMENT_HEADER_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+        buf.payload[1] = index;
+        memcpy(&buf.payload[MICROBIT_RADIO_FRAGMENT_HEADER_SIZE], buffer + offset, l);
+
+        // sendAsync() copies the frame, so buf can be reused straight away. Wait for room if the transmit queue is full.
+        while ((result = radio.sendAsync(&buf)) == DEVICE_NO_RESOURCES && radio.isTransmitting())
+            radio.awaitTxSpace();
+    }
+
+    radio.awaitTxIdle();
+
+    return result;
+}
+
+/**
+  * Transmits the given buffer onto the broadcast radio, split into as many fragments as are needed.
+  *
+  * This is a synchronous call that will wait until the transmission of the last fragment
+  * has completed before returning.
+  *
+  * @param data The datagram contents to transmit.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer is empty or
+  *         larger than MICROBIT_RADIO_LARGE_MAX_SIZE.
+  */
+int MicroBitRadioDatagram::sendLarge(PacketBuffer data)
+{
+    return sendLarge(data.getBytes(), data.length());
+}
+
+/**
+  * Retrieves a large datagram, reassembled from the fragments sent by sendLarge().
+  *
+  * If a datagram is already available, then it will be returned immediately to the caller.
+  * A MICROBIT_RADIO_EVT_LARGE_DATAGRAM event is raised as each one becomes available.
+  *
+  * @return the data received, or an empty PacketBuffer if no data is available.
+  */
+PacketBuffer MicroBitRadioDatagram::recvLarge()
+{
+    expireFragments();
+
+    if (largeDepth == 0)
+        return PacketBuffer::EmptyPacket;
+
+    PacketBuffer packet = largeQueue[largeHead];
+
+    // Release our reference, so the buffer is freed once the caller has finished with it.
+    largeQueue[largeHead] = PacketBuffer::EmptyPacket;
+    largeHead = (largeHead + 1) % MICROBIT_RADIO_LARGE_QUEUE_SIZE;
+    largeDepth--;
+
+    return packet;
+}
+
+/**
+  * Abandons the datagram being reassembled, if no fragment of it has been received within
+  * MICROBIT_RADIO_FRAGMENT_TIMEOUT milliseconds, releasing its reassembly buffer.
+  */
+void MicroBitRadioDatagram::expireFragments()
+{
+    if (fragmentsRemaining && system_timer_current_time() - fragmentTime > MICROBIT_RADIO_FRAGMENT_TIMEOUT)
+    {
+        fragmentsRemaining = 0;
+        fragmentBuffer = PacketBuffer::EmptyPacket;
+    }
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as a fragment.
+  *
+  * This function copies the fragment into the reassembly buffer, and queues the datagram for user
+  * reception once all of its fragments have been received.
+  */
+void MicroBitRadioDatagram::fragmentReceived()
+{
+    FrameBuffer *packet = radio.recv();
+
+    int l = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - MICROBIT_RADIO_FRAGMENT_HEADER_SIZE;
+    uint8_t id = packet->payload[0];
+    int index = packet->payload[1];
+    int total = packet->payload[2] | (packet->payload[3] << 8);
+    int count = (total + MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE;
+    int offset = index * MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE;
+
+    // Discard anything malformed, or too large for us to reassemble. Every fragment but the last is full.
+    if (l <= 0 || total == 0 || total > MICROBIT_RADIO_LARGE_MAX_SIZE || index >= count || l != min(total - offset, MICROBIT_RADIO_FRAGMENT_PAYLOAD_SIZE))
+    {
+        delete packet;
+        return;
+    }
+
+    expireFragments();
+
+    // A fragment of a different transfer supersedes the one in progress.
+    if (fragmentsRemaining == 0 || id != fragmentId || total != fragmentBuffer.length())
+    {
+        fragmentBuffer = PacketBuffer(total);
+        memset(fragmentMap, 0, sizeof(fragmentMap));
+        fragmentsRemaining = count;
+        fragmentId = id;
+    }
+
+    fragmentTime = system_timer_current_time();
+
+    // Fragments may be repeated, so only count each one once.
+    if (!(fragmentMap[index / 32] & (1 << (index % 32))))
+    {
+        memcpy(fragmentBuffer.getBytes() + offset, &packet->payload[MICROBIT_RADIO_FRAGMENT_HEADER_SIZE], l);
+        fragmentMap[index / 32] |= 1 << (index % 32);
+        fragmentsRemaining--;
+    }
+
+    int rssi = packet->rssi;
+    delete packet;
+
+    if (fragmentsRemaining)
+        return;
+
+    // The datagram is complete. Queue it if there's room, and release the reassembly buffer either way.
+    if (largeDepth < MICROBIT_RADIO_LARGE_QUEUE_SIZE)
+    {
+        fragmentBuffer.setRSSI(rssi);
+        largeQueue[(largeHead + largeDepth) % MICROBIT_RADIO_LARGE_QUEUE_SIZE] = fragmentBuffer;
+        largeDepth++;
+
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_LARGE_DATAGRAM);
+    }
+
+    fragmentBuffer = PacketBuffer::EmptyPacket;
+}
+
 /**
   * Protocol handler callback. This is called when the radio receives a packet marked as a datagram.
   *
@@ -191,7 +368,7 @@ void MicroBitRadioDatagram::packetReceived()
             queueDepth++;
         }
 
-        if (queueDepth >= MICROBIT_RADIO_MAXIMUM_RX_BUFFERS)
+        if (queueDepth >= radio.getQueueDepth())
         {
             delete packet;
             return;
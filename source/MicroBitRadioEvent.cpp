@@ -52,6 +52,8 @@ using namespace codal;
 MicroBitRadioEvent::MicroBitRadioEvent(MicroBitRadio &r) : radio(r)
 {
     this->suppressForwarding = false;
+    this->batchWindow = MICROBIT_RADIO_EVENT_BATCH_WINDOW;
+    this->batchLength = 0;
 }
 
 /**
@@ -96,6 +98,9 @@ int MicroBitRadioEvent::listen(uint16_t id, uint16_t value)
   */
 int MicroBitRadioEvent::listen(uint16_t id, uint16_t value, EventModel &eventBus)
 {
+    // The batch window is closed from a fiber, so frames are never sent from the timer interrupt.
+    eventBus.listen(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_EVENTBUS_FLUSH, this, &MicroBitRadioEvent::flushEvent);
+
     return eventBus.listen(id, value, this, &MicroBitRadioEvent::eventReceived, MESSAGE_BUS_LISTENER_IMMEDIATE);
 }
 
@@ -136,19 +141,93 @@ int MicroBitRadioEvent::ignore(uint16_t id, uint16_t value, EventModel &eventBus
     return eventBus.ignore(id, value, this, &MicroBitRadioEvent::eventReceived);
 }
 
+/**
+  * Sets the time over which forwarded events are gathered into a single frame. Batching reduces radio airtime
+  * and processing at high event rates, at the cost of a little latency.
+  *
+  * @param window The batch window in milliseconds, or zero to transmit each event as soon as it is raised.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the window is negative or too long.
+  */
+int MicroBitRadioEvent::setBatchWindow(int window)
+{
+    if (window < 0 || window > 0xFFFF)
+        return DEVICE_INVALID_PARAMETER;
+
+    batchWindow = window;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Transmits the events gathered so far, in a single frame.
+  */
+void MicroBitRadioEvent::flush()
+{
+    FrameBuffer buf;
+
+    // Take the batch atomically, as events may be gathered from interrupt context.
+    target_disable_irq();
+
+    int len = batchLength;
+
+    for (int i = 0; i < len * 2; i++)
+    {
+        buf.payload[i * 2] = batch[i] & 0xFF;
+        buf.payload[i * 2 + 1] = batch[i] >> 8;
+    }
+
+    batchLength = 0;
+
+    target_enable_irq();
+
+    if (len == 0)
+        return;
+
+    buf.length = len * MICROBIT_RADIO_EVENT_PAIR_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = MICROBIT_RADIO_EVENT_VERSION_BATCH;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_EVENTBUS;
+
+    radio.send(&buf);
+}
+
+/**
+  * Event handler callback, called when the batch window closes.
+  */
+void MicroBitRadioEvent::flushEvent(Event)
+{
+    flush();
+}
+
 
 /**
   * Protocol handler callback. This is called when the radio receives a packet marked as using the event protocol.
   *
-  * This function process this packet, and fires the event contained inside onto the default EventModel.
+  * This function process this packet, and fires the events contained inside onto the default EventModel.
   */
 void MicroBitRadioEvent::packetReceived()
 {
     FrameBuffer *p = radio.recv();
-    Event *e = (Event *) p->payload;
 
     suppressForwarding = true;
-    e->fire();
+
+    if (p->version == MICROBIT_RADIO_EVENT_VERSION_BATCH)
+    {
+        int len = (p->length - (MICROBIT_RADIO_HEADER_SIZE - 1)) / MICROBIT_RADIO_EVENT_PAIR_SIZE;
+
+        for (int i = 0; i < len; i++)
+        {
+            uint8_t *pair = &p->payload[i * MICROBIT_RADIO_EVENT_PAIR_SIZE];
+            Event(pair[0] | (pair[1] << 8), pair[2] | (pair[3] << 8));
+        }
+    }
+    else
+    {
+        Event *e = (Event *) p->payload;
+        e->fire();
+    }
+
     suppressForwarding = false;
 
     delete p;
@@ -156,21 +235,37 @@ void MicroBitRadioEvent::packetReceived()
 
 /**
   * Event handler callback. This is called whenever an event is received matching one of those registered through
-  * the registerEvent() method described above. Upon receiving such an event, it is wrapped into
-  * a radio packet and transmitted to any other micro:bits in the same group.
+  * the registerEvent() method described above. Upon receiving such an event, it is gathered into
+  * a radio packet with any others raised within the batch window, and transmitted to any other
+  * micro:bits in the same group.
   */
 void MicroBitRadioEvent::eventReceived(Event e)
 {
     if(suppressForwarding)
         return;
 
-    FrameBuffer buf;
+    // Don't forward our own batch window timer.
+    if (e.source == DEVICE_ID_RADIO && e.value == MICROBIT_RADIO_EVT_EVENTBUS_FLUSH)
+        return;
 
-    buf.length = sizeof(Event) + MICROBIT_RADIO_HEADER_SIZE - 1;
-    buf.version = 1;
-    buf.group = 0;
-    buf.protocol = MICROBIT_RADIO_PROTOCOL_EVENTBUS;
-    memcpy(buf.payload, (const uint8_t *)&e, sizeof(Event));
+    target_disable_irq();
 
-    radio.send(&buf);
+    bool first = batchLength == 0;
+    bool full = batchLength >= MICROBIT_RADIO_EVENT_BATCH_SIZE;
+
+    if (!full)
+    {
+        batch[batchLength * 2] = e.source;
+        batch[batchLength * 2 + 1] = e.value;
+        batchLength++;
+        full = batchLength >= MICROBIT_RADIO_EVENT_BATCH_SIZE;
+    }
+
+    target_enable_irq();
+
+    // Send at once if batching is disabled or the frame is full. Otherwise, close the batch window when it expires.
+    if (batchWindow == 0 || full)
+        flush();
+    else if (first)
+        system_timer_event_after(batchWindow, DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_EVENTBUS_FLUSH);
 }
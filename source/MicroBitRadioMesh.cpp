@@ -0,0 +1,348 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+#include "CodalFiber.h"
+
+using namespace codal;
+
+/**
+ * Provides multi-hop broadcast delivery between micro:bits, by flooding messages over MicroBitRadio.
+ *
+ * Every node rebroadcasts each message it hears for the first time, until the message has travelled its
+ * allowed number of hops. Nodes remember the messages they have seen recently so that copies arriving by
+ * other routes are discarded, wait for a random time before rebroadcasting, and abandon a rebroadcast
+ * altogether if enough neighbours are heard forwarding the same message first.
+ *
+ * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+ * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+ * For serious applications, BLE should be considered a substantially more secure alternative.
+ */
+
+static void write32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+  * Constructor.
+  *
+  * Creates an instance of MicroBitRadioMesh which offers multi-hop broadcast
+  * delivery of data to other micro:bits beyond the range of a single radio hop.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioMesh::MicroBitRadioMesh(MicroBitRadio &r) : radio(r)
+{
+    memset(cache, 0, sizeof(cache));
+    memset(forwardQueue, 0, sizeof(forwardQueue));
+
+    for (int i = 0; i < MICROBIT_RADIO_MESH_RX_QUEUE_SIZE; i++)
+        rxQueue[i] = NULL;
+
+    cacheNext = 0;
+    rxHead = 0;
+    rxDepth = 0;
+    nextSeq = 0;
+    seeded = false;
+    forwarding = true;
+}
+
+/**
+  * Records a message as seen.
+  *
+  * @return true if the message was already in the cache, false if it is new.
+  */
+bool MicroBitRadioMesh::seen(uint32_t origin, uint16_t seq)
+{
+    for (int i = 0; i < MICROBIT_RADIO_MESH_CACHE_SIZE; i++)
+        if (cache[i].origin == origin && cache[i].seq == seq)
+            return true;
+
+    cache[cacheNext].origin = origin;
+    cache[cacheNext].seq = seq;
+    cacheNext = (cacheNext + 1) % MICROBIT_RADIO_MESH_CACHE_SIZE;
+
+    return false;
+}
+
+/**
+  * Queues a copy of a received frame for rebroadcast after a random delay, with one fewer hop to travel.
+  */
+void MicroBitRadioMesh::forward(FrameBuffer *packet)
+{
+    for (int i = 0; i < MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE; i++)
+    {
+        MicroBitRadioMeshForward &q = forwardQueue[i];
+
+        if (q.frame != NULL)
+            continue;
+
+        q.frame = new FrameBuffer;
+
+        if (q.frame == NULL)
+            return;
+
+        memcpy(q.frame, packet, packet->length + 1);
+        q.frame->payload[6]--;
+        q.frame->payload[7]++;
+        q.heard = 0;
+        q.due = (uint32_t) system_timer_current_time_us() + MICROBIT_RADIO_MESH_DELAY_MIN + microbit_random(MICROBIT_RADIO_MESH_DELAY_MAX - MICROBIT_RADIO_MESH_DELAY_MIN);
+
+        return;
+    }
+}
+
+/**
+  * Notes that a neighbour has rebroadcast a message, abandoning our own rebroadcast of it if enough have.
+  */
+void MicroBitRadioMesh::overheard(uint32_t origin, uint16_t seq)
+{
+    for (int i = 0; i < MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE; i++)
+    {
+        MicroBitRadioMeshForward &q = forwardQueue[i];
+
+        if (q.frame == NULL || read32(&q.frame->payload[0]) != origin || (q.frame->payload[4] | (q.frame->payload[5] << 8)) != seq)
+            continue;
+
+        if (++q.heard >= MICROBIT_RADIO_MESH_REDUNDANCY)
+        {
+            delete q.frame;
+            q.frame = NULL;
+        }
+
+        return;
+    }
+}
+
+/**
+  * Broadcasts the given buffer across the mesh.
+  *
+  * @param buffer The data to send.
+  *
+  * @param len The number of bytes to send, up to MICROBIT_RADIO_MESH_PAYLOAD_SIZE.
+  *
+  * @param ttl The number of hops the message may travel, in the range 1..255. A value of 1 reaches only our neighbours.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the parameters are invalid, or the error
+  *         from MicroBitRadio::sendAsync() if the radio cannot transmit.
+  */
+int MicroBitRadioMesh::send(uint8_t *buffer, int len, int ttl)
+{
+    if (buffer == NULL || len <= 0 || len > MICROBIT_RADIO_MESH_PAYLOAD_SIZE || ttl < 1 || ttl > 255)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Start numbering from a random point, so that neighbours who remember our messages from before a reset
+    // don't mistake new ones for copies.
+    if (!seeded)
+    {
+        nextSeq = microbit_random(65536);
+        seeded = true;
+    }
+
+    FrameBuffer buf;
+    uint32_t me = microbit_serial_number();
+    uint16_t seq = nextSeq++;
+
+    buf.length = len + MICROBIT_RADIO_MESH_HEADER_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_MESH;
+    write32(&buf.payload[0], me);
+    buf.payload[4] = seq;
+    buf.payload[5] = seq >> 8;
+    buf.payload[6] = ttl;
+    buf.payload[7] = 0;
+    memcpy(&buf.payload[MICROBIT_RADIO_MESH_HEADER_SIZE], buffer, len);
+
+    // Remember our own message, so that copies rebroadcast by our neighbours are ignored.
+    seen(me, seq);
+
+    // Wait for room in the radio's transmit queue, which may be shared with rebroadcasts.
+    int result;
+
+    while ((result = radio.sendAsync(&buf)) == DEVICE_NO_RESOURCES && radio.isTransmitting())
+        radio.awaitTxSpace();
+
+    return result;
+}
+
+/**
+  * Broadcasts the given buffer across the mesh.
+  *
+  * @param data The data to send.
+  *
+  * @param ttl The number of hops the message may travel, in the range 1..255. A value of 1 reaches only our neighbours.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the parameters are invalid, or the error
+  *         from MicroBitRadio::sendAsync() if the radio cannot transmit.
+  */
+int MicroBitRadioMesh::send(PacketBuffer data, int ttl)
+{
+    return send(data.getBytes(), data.length(), ttl);
+}
+
+/**
+  * Retrieves the next message received from the mesh.
+  * A MICROBIT_RADIO_EVT_MESH_DATA event is raised as messages become available.
+  *
+  * @param origin If not NULL, set to the serial number of the micro:bit that originated the message.
+  *
+  * @param hops If not NULL, set to the number of hops the message travelled to reach us, 1 meaning it was heard directly.
+  *
+  * @return the data received, or an empty PacketBuffer if no data is available. The RSSI is that of the last hop.
+  */
+PacketBuffer MicroBitRadioMesh::recv(uint32_t *origin, int *hops)
+{
+    if (rxDepth == 0)
+        return PacketBuffer::EmptyPacket;
+
+    FrameBuffer *f = rxQueue[rxHead];
+
+    PacketBuffer packet(&f->payload[MICROBIT_RADIO_MESH_HEADER_SIZE], f->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - MICROBIT_RADIO_MESH_HEADER_SIZE, f->rssi);
+
+    if (origin)
+        *origin = read32(&f->payload[0]);
+
+    if (hops)
+        *hops = f->payload[7] + 1;
+
+    delete f;
+    rxQueue[rxHead] = NULL;
+    rxHead = (rxHead + 1) % MICROBIT_RADIO_MESH_RX_QUEUE_SIZE;
+    rxDepth--;
+
+    return packet;
+}
+
+/**
+  * Enables or disables the rebroadcast of messages originated by other nodes. Enabled by default.
+  * Messages are received either way.
+  *
+  * @param enabled true to relay messages for other nodes, false to act only as an end point.
+  */
+void MicroBitRadioMesh::setForwarding(bool enabled)
+{
+    forwarding = enabled;
+
+    if (!forwarding)
+    {
+        for (int i = 0; i < MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE; i++)
+        {
+            delete forwardQueue[i].frame;
+            forwardQueue[i].frame = NULL;
+        }
+    }
+}
+
+/**
+  * Determines if messages originated by other nodes are rebroadcast.
+  *
+  * @return true if forwarding is enabled, false otherwise.
+  */
+bool MicroBitRadioMesh::isForwarding()
+{
+    return forwarding;
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as using the mesh protocol.
+  *
+  * This function delivers and forwards messages not seen before, and discards the rest.
+  */
+void MicroBitRadioMesh::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+    int len = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1);
+
+    if (len <= MICROBIT_RADIO_MESH_HEADER_SIZE || packet->payload[6] == 0)
+    {
+        delete packet;
+        return;
+    }
+
+    uint32_t origin = read32(&packet->payload[0]);
+    uint16_t seq = packet->payload[4] | (packet->payload[5] << 8);
+
+    // A copy of a message we already have. Hearing it means a neighbour has forwarded it, which may make our own rebroadcast redundant.
+    if (origin == microbit_serial_number() || seen(origin, seq))
+    {
+        overheard(origin, seq);
+        delete packet;
+        return;
+    }
+
+    if (forwarding && packet->payload[6] > 1)
+        forward(packet);
+
+    // Copy the frame out of the radio's receive pool, as it may be held for some time.
+    if (rxDepth < MICROBIT_RADIO_MESH_RX_QUEUE_SIZE)
+    {
+        FrameBuffer *f = new FrameBuffer;
+
+        if (f != NULL)
+        {
+            memcpy(f, packet, packet->length + 1);
+            f->rssi = packet->rssi;
+
+            rxQueue[(rxHead + rxDepth) % MICROBIT_RADIO_MESH_RX_QUEUE_SIZE] = f;
+            rxDepth++;
+
+            Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_MESH_DATA);
+        }
+    }
+
+    delete packet;
+}
+
+/**
+  * Periodic callback, from MicroBitRadio's idle callback. Rebroadcasts messages whose delay has expired.
+  */
+void MicroBitRadioMesh::idleCallback()
+{
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+
+    for (int i = 0; i < MICROBIT_RADIO_MESH_FORWARD_QUEUE_SIZE; i++)
+    {
+        MicroBitRadioMeshForward &q = forwardQueue[i];
+
+        if (q.frame == NULL || (int32_t)(now - q.due) < 0)
+            continue;
+
+        // If the transmit queue is full, the rebroadcast is retried on the next idle callback.
+        if (radio.sendAsync(q.frame) == DEVICE_NO_RESOURCES)
+            continue;
+
+        delete q.frame;
+        q.frame = NULL;
+    }
+}
@@ -0,0 +1,564 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 British Broadcasting Corporation.
+This software is provided by Lancaster University by arrangement with the BBC.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+#include "CodalFiber.h"
+
+using namespace codal;
+
+/**
+ * Provides a reliable, ordered, point to point transport between micro:bits, built upon MicroBitRadio.
+ *
+ * Peers are addressed by their serial number. Frames are numbered per peer, delivered in order, and
+ * acknowledged with a cumulative acknowledgement plus a selective acknowledgement bitmap. Up to
+ * MICROBIT_RADIO_RELIABLE_WINDOW frames may be in flight to each peer, and lost frames are retransmitted
+ * after a timeout that adapts to the measured round trip time.
+ *
+ * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+ * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+ * For serious applications, BLE should be considered a substantially more secure alternative.
+ */
+
+static void write32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+  * Constructor.
+  *
+  * Creates an instance of MicroBitRadioReliable which offers reliable, ordered
+  * delivery of data to other micro:bits in the vicinity.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioReliable::MicroBitRadioReliable(MicroBitRadio &r) : radio(r)
+{
+    for (int i = 0; i < MICROBIT_RADIO_RELIABLE_PEERS; i++)
+        peers[i] = NULL;
+
+    nextPeer = 0;
+}
+
+/**
+  * Finds the transport state held for the given peer.
+  *
+  * @param id The serial number of the peer.
+  *
+  * @param create If true, allocate state for the peer if none is held, evicting the least recently active idle peer if necessary.
+  *
+  * @return the peer's state, or NULL if none is held and none could be allocated.
+  */
+MicroBitRadioPeer* MicroBitRadioReliable::getPeer(uint32_t id, bool create)
+{
+    MicroBitRadioPeer *victim = NULL;
+    int slot = -1;
+
+    for (int i = 0; i < MICROBIT_RADIO_RELIABLE_PEERS; i++)
+    {
+        MicroBitRadioPeer *p = peers[i];
+
+        if (p == NULL)
+        {
+            if (slot < 0)
+                slot = i;
+
+            continue;
+        }
+
+        if (p->id == id)
+            return p;
+
+        // A peer is idle if it has nothing in flight, and nothing waiting to be read.
+        bool idle = p->txBase == p->txNext && p->rxRead == p->rxNext && !p->ackPending;
+
+        for (int s = 0; idle && s < MICROBIT_RADIO_RELIABLE_WINDOW; s++)
+            idle = p->rx[s] == NULL;
+
+        if (idle && (victim == NULL || p->lastActive < victim->lastActive))
+            victim = p;
+    }
+
+    if (!create)
+        return NULL;
+
+    MicroBitRadioPeer *p = victim;
+
+    if (p == NULL)
+    {
+        if (slot < 0)
+            return NULL;
+
+        p = new MicroBitRadioPeer;
+        if (p == NULL)
+            return NULL;
+
+        peers[slot] = p;
+    }
+
+    memset(p, 0, sizeof(MicroBitRadioPeer));
+    p->id = id;
+    p->rto = MICROBIT_RADIO_RELIABLE_RTO_INITIAL;
+    p->lastActive = system_timer_current_time();
+
+    return p;
+}
+
+/**
+  * (Re)transmits the given unacknowledged frame to a peer.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the radio transmit queue is full.
+  */
+int MicroBitRadioReliable::transmit(MicroBitRadioPeer *peer, uint8_t seq)
+{
+    FrameBuffer *f = peer->tx[seq % MICROBIT_RADIO_RELIABLE_WINDOW];
+
+    // Let the receiver know which frames we've given up waiting for an acknowledgement of.
+    f->payload[10] = peer->txBase;
+
+    int result = radio.sendAsync(f);
+
+    if (result == DEVICE_OK)
+        peer->txTime[seq % MICROBIT_RADIO_RELIABLE_WINDOW] = (uint32_t) system_timer_current_time_us();
+
+    return result;
+}
+
+/**
+  * Sends an acknowledgement of the frames received from a peer.
+  */
+void MicroBitRadioReliable::sendAck(MicroBitRadioPeer *peer)
+{
+    FrameBuffer buf;
+    uint8_t sack = 0;
+
+    for (int i = 0; i < MICROBIT_RADIO_RELIABLE_WINDOW; i++)
+    {
+        uint8_t seq = peer->rxNext + 1 + i;
+
+        if ((uint8_t)(seq - peer->rxRead) < MICROBIT_RADIO_RELIABLE_WINDOW && peer->rx[seq % MICROBIT_RADIO_RELIABLE_WINDOW])
+            sack |= 1 << i;
+    }
+
+    buf.length = MICROBIT_RADIO_RELIABLE_HEADER_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_RELIABLE;
+    buf.payload[0] = MICROBIT_RADIO_RELIABLE_ACK;
+    write32(&buf.payload[1], microbit_serial_number());
+    write32(&buf.payload[5], peer->id);
+    buf.payload[9] = peer->rxNext;
+    buf.payload[10] = sack;
+
+    // If the transmit queue is full, the acknowledgement stays pending and is retried from idleCallback().
+    if (radio.sendAsync(&buf) == DEVICE_OK)
+        peer->ackPending = 0;
+}
+
+/**
+  * Releases an acknowledged frame, and (if it was not retransmitted) uses it to update the peer's round trip time estimate.
+  */
+void MicroBitRadioReliable::acknowledge(MicroBitRadioPeer *peer, uint8_t seq)
+{
+    int slot = seq % MICROBIT_RADIO_RELIABLE_WINDOW;
+
+    if (peer->tx[slot] == NULL)
+        return;
+
+    // Only frames sent once give an unambiguous round trip time (Karn's algorithm).
+    if (peer->txRetries[slot] == 0)
+    {
+        uint32_t rtt = (uint32_t) system_timer_current_time_us() - peer->txTime[slot];
+
+        // Smooth the estimate as per RFC 6298.
+        if (peer->srtt == 0)
+        {
+            peer->srtt = rtt;
+            peer->rttvar = rtt / 2;
+        }
+        else
+        {
+            uint32_t error = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+
+            peer->rttvar = (3 * peer->rttvar + error) / 4;
+            peer->srtt = (7 * peer->srtt + rtt) / 8;
+        }
+
+        peer->rto = min(max(peer->srtt + 4 * peer->rttvar, (uint32_t) MICROBIT_RADIO_RELIABLE_RTO_MIN), (uint32_t) MICROBIT_RADIO_RELIABLE_RTO_MAX);
+    }
+
+    delete peer->tx[slot];
+    peer->tx[slot] = NULL;
+}
+
+/**
+  * Queues the given buffer for reliable delivery to a peer.
+  *
+  * Returns as soon as the frame has been sent for the first time, waiting only if the window of
+  * frames awaiting acknowledgement from that peer is full. Use flush() to wait for delivery.
+  *
+  * @param destination The serial number of the micro:bit to send to.
+  *
+  * @param buffer The data to send.
+  *
+  * @param len The number of bytes to send, up to MICROBIT_RADIO_RELIABLE_PAYLOAD_SIZE.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the parameters are invalid,
+  *         DEVICE_NO_RESOURCES if no state could be allocated for the peer, or the error from
+  *         MicroBitRadio::sendAsync() if the radio cannot transmit.
+  */
+int MicroBitRadioReliable::send(uint32_t destination, uint8_t *buffer, int len)
+{
+    if (buffer == NULL || len <= 0 || len > MICROBIT_RADIO_RELIABLE_PAYLOAD_SIZE || destination == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    MicroBitRadioPeer *peer;
+
+    // Wait for the window to open. Look the peer up again each time, as its state may be recycled while we wait.
+    while (true)
+    {
+        peer = getPeer(destination, true);
+
+        if (peer == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        if ((uint8_t)(peer->txNext - peer->txBase) < MICROBIT_RADIO_RELIABLE_WINDOW)
+            break;
+
+        fiber_wait_for_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_WINDOW);
+    }
+
+    FrameBuffer *f = new FrameBuffer;
+
+    if (f == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    uint8_t seq = peer->txNext++;
+
+    f->length = len + MICROBIT_RADIO_RELIABLE_HEADER_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+    f->version = 1;
+    f->group = 0;
+    f->protocol = MICROBIT_RADIO_PROTOCOL_RELIABLE;
+    f->payload[0] = MICROBIT_RADIO_RELIABLE_DATA;
+    write32(&f->payload[1], microbit_serial_number());
+    write32(&f->payload[5], destination);
+    f->payload[9] = seq;
+    memcpy(&f->payload[MICROBIT_RADIO_RELIABLE_HEADER_SIZE], buffer, len);
+
+    peer->tx[seq % MICROBIT_RADIO_RELIABLE_WINDOW] = f;
+    peer->txRetries[seq % MICROBIT_RADIO_RELIABLE_WINDOW] = 0;
+    peer->lastActive = system_timer_current_time();
+
+    // Wait for room in the radio's transmit queue, rather than leaving the frame for the retransmission timer.
+    int result;
+
+    while ((result = transmit(peer, seq)) == DEVICE_NO_RESOURCES && radio.isTransmitting())
+        radio.awaitTxSpace();
+
+    // If the radio can't send at all (e.g. it isn't enabled), take the frame back out of the window.
+    if (result != DEVICE_OK && result != DEVICE_NO_RESOURCES)
+    {
+        peer->tx[seq % MICROBIT_RADIO_RELIABLE_WINDOW] = NULL;
+        peer->txNext--;
+        delete f;
+
+        return result;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Queues the given buffer for reliable delivery to a peer.
+  *
+  * @param destination The serial number of the micro:bit to send to.
+  *
+  * @param data The data to send.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the parameters are invalid, or
+  *         DEVICE_NO_RESOURCES if no state could be allocated for the peer.
+  */
+int MicroBitRadioReliable::send(uint32_t destination, PacketBuffer data)
+{
+    return send(destination, data.getBytes(), data.length());
+}
+
+/**
+  * Waits until all frames sent to a peer have been acknowledged, or abandoned.
+  *
+  * @param destination The serial number of the micro:bit.
+  *
+  * @return DEVICE_OK if all frames were delivered, or DEVICE_CANCELLED if frames were abandoned
+  *         after MICROBIT_RADIO_RELIABLE_MAX_RETRIES retransmissions since the last call.
+  */
+int MicroBitRadioReliable::flush(uint32_t destination)
+{
+    MicroBitRadioPeer *peer;
+
+    while ((peer = getPeer(destination, false)) != NULL && peer->txBase != peer->txNext)
+        fiber_wait_for_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_WINDOW);
+
+    if (peer == NULL || !peer->failed)
+        return DEVICE_OK;
+
+    peer->failed = false;
+    return DEVICE_CANCELLED;
+}
+
+/**
+  * Retrieves the next frame received in order from any peer.
+  * A MICROBIT_RADIO_EVT_RELIABLE_DATA event is raised as frames become available.
+  *
+  * @param source If not NULL, set to the serial number of the micro:bit that sent the frame.
+  *
+  * @return the data received, or an empty PacketBuffer if no data is available.
+  */
+PacketBuffer MicroBitRadioReliable::recv(uint32_t *source)
+{
+    for (int i = 0; i < MICROBIT_RADIO_RELIABLE_PEERS; i++)
+    {
+        MicroBitRadioPeer *peer = peers[(nextPeer + i) % MICROBIT_RADIO_RELIABLE_PEERS];
+
+        if (peer == NULL || peer->rxRead == peer->rxNext)
+            continue;
+
+        int slot = peer->rxRead % MICROBIT_RADIO_RELIABLE_WINDOW;
+        FrameBuffer *f = peer->rx[slot];
+
+        PacketBuffer packet(&f->payload[MICROBIT_RADIO_RELIABLE_HEADER_SIZE], f->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - MICROBIT_RADIO_RELIABLE_HEADER_SIZE, f->rssi);
+
+        delete f;
+        peer->rx[slot] = NULL;
+        peer->rxRead++;
+
+        // Reading a frame frees a slot in the window, which may let frames already received out of order count as in order.
+        while ((uint8_t)(peer->rxNext - peer->rxRead) < MICROBIT_RADIO_RELIABLE_WINDOW && peer->rx[peer->rxNext % MICROBIT_RADIO_RELIABLE_WINDOW])
+            peer->rxNext++;
+
+        if (source)
+            *source = peer->id;
+
+        nextPeer = (nextPeer + i + 1) % MICROBIT_RADIO_RELIABLE_PEERS;
+
+        return packet;
+    }
+
+    return PacketBuffer::EmptyPacket;
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as using the reliable protocol.
+  *
+  * This function stores new data frames for recv() and acknowledges them, and releases acknowledged frames.
+  */
+void MicroBitRadioReliable::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+    int len = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1);
+    MicroBitRadioPeer *peer = NULL;
+
+    if (len >= MICROBIT_RADIO_RELIABLE_HEADER_SIZE && read32(&packet->payload[5]) == microbit_serial_number())
+        peer = getPeer(read32(&packet->payload[1]), true);
+
+    if (peer == NULL)
+    {
+        delete packet;
+        return;
+    }
+
+    peer->lastActive = system_timer_current_time();
+
+    if (packet->payload[0] == MICROBIT_RADIO_RELIABLE_DATA && len > MICROBIT_RADIO_RELIABLE_HEADER_SIZE)
+    {
+        uint8_t seq = packet->payload[9];
+        uint8_t base = packet->payload[10];
+
+        // The sender never has more than a window of frames unacknowledged. If its oldest is outside that range
+        // of what we've received, the sender has lost its state (or we lost ours, or it gave up on some frames),
+        // so start again from there. Frames already received in order are kept until they've been read.
+        if ((uint8_t)(peer->rxNext - base) > MICROBIT_RADIO_RELIABLE_WINDOW)
+        {
+            if (peer->rxRead != peer->rxNext)
+            {
+                delete packet;
+                return;
+            }
+
+            for (int i = 0; i < MICROBIT_RADIO_RELIABLE_WINDOW; i++)
+            {
+                delete peer->rx[i];
+                peer->rx[i] = NULL;
+            }
+
+            peer->rxRead = peer->rxNext = base;
+        }
+
+        int slot = seq % MICROBIT_RADIO_RELIABLE_WINDOW;
+        bool inWindow = (uint8_t)(seq - peer->rxRead) < MICROBIT_RADIO_RELIABLE_WINDOW;
+
+        if (inWindow && peer->rx[slot] == NULL)
+        {
+            // Copy the frame out of the radio's receive pool, as it may be held for some time.
+            FrameBuffer *f = new FrameBuffer;
+
+            if (f != NULL)
+            {
+                memcpy(f, packet, packet->length + 1);
+                f->rssi = packet->rssi;
+                peer->rx[slot] = f;
+
+                bool inOrder = seq == peer->rxNext;
+
+                while ((uint8_t)(peer->rxNext - peer->rxRead) < MICROBIT_RADIO_RELIABLE_WINDOW && peer->rx[peer->rxNext % MICROBIT_RADIO_RELIABLE_WINDOW])
+                    peer->rxNext++;
+
+                if (inOrder)
+                {
+                    peer->ackPending++;
+                    Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_DATA);
+                }
+                else
+                {
+                    peer->ackPending = MICROBIT_RADIO_RELIABLE_ACK_EVERY;
+                }
+            }
+        }
+        else if (inWindow || (uint8_t)(peer->rxRead - 1 - seq) < MICROBIT_RADIO_RELIABLE_WINDOW)
+        {
+            // A duplicate. Our acknowledgement must have been lost, so send another right away.
+            peer->ackPending = MICROBIT_RADIO_RELIABLE_ACK_EVERY;
+        }
+
+        // Frames beyond the space we have to hold them are simply dropped, and will be retransmitted.
+        if (peer->ackPending >= MICROBIT_RADIO_RELIABLE_ACK_EVERY)
+            sendAck(peer);
+    }
+
+    if (packet->payload[0] == MICROBIT_RADIO_RELIABLE_ACK)
+    {
+        uint8_t ack = packet->payload[9];
+        uint8_t sack = packet->payload[10];
+        bool progress = false;
+
+        // Ignore acknowledgements of frames we haven't sent.
+        if ((uint8_t)(ack - peer->txBase) <= (uint8_t)(peer->txNext - peer->txBase))
+        {
+            while (peer->txBase != ack)
+            {
+                acknowledge(peer, peer->txBase++);
+                progress = true;
+            }
+
+            for (int i = 0; i < MICROBIT_RADIO_RELIABLE_WINDOW; i++)
+            {
+                uint8_t seq = ack + 1 + i;
+
+                if ((sack & (1 << i)) && (uint8_t)(seq - peer->txBase) < (uint8_t)(peer->txNext - peer->txBase))
+                    acknowledge(peer, seq);
+            }
+
+            // A gap reported ahead of later frames means the oldest frame was probably lost. Resend it without waiting
+            // for the timer, unless it was only sent within the last round trip.
+            int slot = ack % MICROBIT_RADIO_RELIABLE_WINDOW;
+
+            if (sack && peer->tx[slot] && (uint32_t) system_timer_current_time_us() - peer->txTime[slot] > peer->srtt)
+            {
+                if (transmit(peer, ack) == DEVICE_OK)
+                    peer->txRetries[slot]++;
+            }
+        }
+
+        if (progress)
+            Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_WINDOW);
+    }
+
+    delete packet;
+}
+
+/**
+  * Periodic callback, from MicroBitRadio's idle callback. Retransmits frames whose acknowledgement has
+  * timed out, and sends any delayed acknowledgements.
+  */
+void MicroBitRadioReliable::idleCallback()
+{
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+
+    for (int i = 0; i < MICROBIT_RADIO_RELIABLE_PEERS; i++)
+    {
+        MicroBitRadioPeer *peer = peers[i];
+        bool expired = false;
+
+        if (peer == NULL)
+            continue;
+
+        if (peer->ackPending)
+            sendAck(peer);
+
+        for (uint8_t seq = peer->txBase; seq != peer->txNext; seq++)
+        {
+            int slot = seq % MICROBIT_RADIO_RELIABLE_WINDOW;
+
+            if (peer->tx[slot] == NULL || now - peer->txTime[slot] < peer->rto)
+                continue;
+
+            // Give up on the peer if it has stopped responding, releasing everything in flight.
+            if (peer->txRetries[slot] >= MICROBIT_RADIO_RELIABLE_MAX_RETRIES)
+            {
+                for (int s = 0; s < MICROBIT_RADIO_RELIABLE_WINDOW; s++)
+                {
+                    delete peer->tx[s];
+                    peer->tx[s] = NULL;
+                }
+
+                peer->txBase = peer->txNext;
+                peer->failed = true;
+                peer->rto = MICROBIT_RADIO_RELIABLE_RTO_INITIAL;
+
+                Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_FAILED);
+                Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_RELIABLE_WINDOW);
+                break;
+            }
+
+            if (transmit(peer, seq) != DEVICE_OK)
+                break;
+
+            peer->txRetries[slot]++;
+            expired = true;
+        }
+
+        // Back off exponentially while frames are being lost.
+        if (expired)
+            peer->rto = min(peer->rto * 2, (uint32_t) MICROBIT_RADIO_RELIABLE_RTO_MAX);
+    }
+}
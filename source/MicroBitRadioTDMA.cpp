@@ -0,0 +1,415 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 British Broadcasting Corporation.
+This software is provided by Lancaster University by arrangement with the BBC.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+#include "EventModel.h"
+
+using namespace codal;
+
+/**
+ * Provides an optional time division multiple access (TDMA) mode for MicroBitRadio.
+ *
+ * One micro:bit in the group acts as the beacon node. At the start of each superframe it broadcasts a beacon
+ * carrying the slot layout and a rotating list of slot assignments. Other nodes synchronise to the end of each beacon
+ * they receive, ask for a slot in the shared slot, and from then on only transmit during their own slot. Frames
+ * sent at other times are held in the MicroBitRadio transmit queue until the slot begins.
+ *
+ * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+ * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+ * For serious applications, BLE should be considered a substantially more secure alternative.
+ */
+
+static void write32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+  * Constructor.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioTDMA::MicroBitRadioTDMA(MicroBitRadio &r) : radio(r)
+{
+    this->mode = MICROBIT_RADIO_TDMA_OFF;
+    this->slots = MICROBIT_RADIO_TDMA_DEFAULT_SLOTS;
+    this->slotLength = MICROBIT_RADIO_TDMA_DEFAULT_SLOT_LENGTH;
+    this->slot = 0;
+    this->assigned = false;
+    this->synchronised = false;
+    this->nextAssignment = 0;
+
+    resetAssignments();
+}
+
+/**
+  * Schedules the given timer event, replacing any matching event already scheduled.
+  */
+void MicroBitRadioTDMA::schedule(uint16_t event, uint32_t delay)
+{
+    system_timer_cancel_event(DEVICE_ID_RADIO_TDMA, event);
+    system_timer_event_after_us(delay, DEVICE_ID_RADIO_TDMA, event);
+}
+
+/**
+  * Cancels all scheduled timer events.
+  */
+void MicroBitRadioTDMA::cancelAll()
+{
+    system_timer_cancel_event(DEVICE_ID_RADIO_TDMA, MICROBIT_RADIO_TDMA_EVT_SUPERFRAME);
+    system_timer_cancel_event(DEVICE_ID_RADIO_TDMA, MICROBIT_RADIO_TDMA_EVT_SLOT_START);
+    system_timer_cancel_event(DEVICE_ID_RADIO_TDMA, MICROBIT_RADIO_TDMA_EVT_SLOT_END);
+    system_timer_cancel_event(DEVICE_ID_RADIO_TDMA, MICROBIT_RADIO_TDMA_EVT_SYNC_LOST);
+}
+
+/**
+  * Starts TDMA as the beacon node for the group.
+  *
+  * @param slots The number of slots in each superframe, in the range 3..MICROBIT_RADIO_TDMA_MAX_SLOTS.
+  *
+  * @param slotLength The length of each slot (in microseconds). Must exceed MICROBIT_RADIO_TDMA_GUARD_TIME.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the layout is invalid, or
+  *         DEVICE_NO_RESOURCES if no default EventModel is available.
+  */
+int MicroBitRadioTDMA::startBeacon(int slots, int slotLength)
+{
+    if (slots <= MICROBIT_RADIO_TDMA_FIRST_SLOT || slots > MICROBIT_RADIO_TDMA_MAX_SLOTS ||
+        slotLength <= MICROBIT_RADIO_TDMA_GUARD_TIME || slotLength > 0xFFFF)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    stop();
+
+    this->slots = slots;
+    this->slotLength = slotLength;
+    this->slot = 0;
+    this->mode = MICROBIT_RADIO_TDMA_BEACON_NODE;
+
+    // Slot boundaries must be handled promptly, so handle the timer events in interrupt context.
+    EventModel::defaultEventBus->listen(DEVICE_ID_RADIO_TDMA, DEVICE_EVT_ANY, this, &MicroBitRadioTDMA::timerEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+    // Start the first superframe from here, rather than from the timer, so the radio allocates its transmit queue outside
+    // interrupt context.
+    radio.setTransmitHold(true);
+    sendBeacon();
+    radio.setTransmitHold(false);
+
+    synchronised = true;
+    schedule(MICROBIT_RADIO_TDMA_EVT_SLOT_END, slotLength - MICROBIT_RADIO_TDMA_GUARD_TIME);
+    schedule(MICROBIT_RADIO_TDMA_EVT_SUPERFRAME, slots * slotLength);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Starts TDMA as an ordinary node. Until a beacon is heard, frames are transmitted at will.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if no default EventModel is available.
+  */
+int MicroBitRadioTDMA::startNode()
+{
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    stop();
+
+    this->assigned = false;
+    this->mode = MICROBIT_RADIO_TDMA_NODE;
+
+    EventModel::defaultEventBus->listen(DEVICE_ID_RADIO_TDMA, DEVICE_EVT_ANY, this, &MicroBitRadioTDMA::timerEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Stops TDMA. Queued frames are transmitted at once, and subsequent frames are transmitted at will.
+  *
+  * @return DEVICE_OK on success.
+  */
+int MicroBitRadioTDMA::stop()
+{
+    if (mode == MICROBIT_RADIO_TDMA_OFF)
+        return DEVICE_OK;
+
+    mode = MICROBIT_RADIO_TDMA_OFF;
+    synchronised = false;
+
+    cancelAll();
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->ignore(DEVICE_ID_RADIO_TDMA, DEVICE_EVT_ANY, this, &MicroBitRadioTDMA::timerEvent);
+
+    radio.setTransmitHold(false);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines the slot in which we transmit.
+  *
+  * @return our assigned slot, 1 if we share the unassigned slot, 0 if we are the beacon node,
+  *         or DEVICE_INVALID_STATE if TDMA is not active or not synchronised.
+  */
+int MicroBitRadioTDMA::getSlot()
+{
+    if (!isSynchronised())
+        return DEVICE_INVALID_STATE;
+
+    return slot;
+}
+
+/**
+  * Determines if our transmissions are currently confined to a slot.
+  *
+  * @return true if TDMA is active and synchronised to a beacon, false otherwise.
+  */
+bool MicroBitRadioTDMA::isSynchronised()
+{
+    return mode != MICROBIT_RADIO_TDMA_OFF && synchronised;
+}
+
+/**
+  * Discards all slot assignments made by the beacon node. Nodes will ask for new ones.
+  */
+void MicroBitRadioTDMA::resetAssignments()
+{
+    for (int i = 0; i < MICROBIT_RADIO_TDMA_MAX_SLOTS; i++)
+        assignments[i] = 0;
+}
+
+/**
+  * Builds and queues a beacon, advertising as many slot assignments as fit in a frame.
+  */
+void MicroBitRadioTDMA::sendBeacon()
+{
+    FrameBuffer buf;
+    int len = MICROBIT_RADIO_TDMA_BEACON_HEADER_SIZE;
+
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_TDMA;
+    buf.payload[0] = MICROBIT_RADIO_TDMA_BEACON;
+    buf.payload[1] = slots;
+    buf.payload[2] = slotLength & 0xFF;
+    buf.payload[3] = slotLength >> 8;
+
+    // Advertise the assignments in rotation, as there may be more than fit in one beacon.
+    for (int i = MICROBIT_RADIO_TDMA_FIRST_SLOT; i < slots && len + MICROBIT_RADIO_TDMA_ASSIGNMENT_SIZE <= MICROBIT_RADIO_MAX_PACKET_SIZE; i++)
+    {
+        if (nextAssignment < MICROBIT_RADIO_TDMA_FIRST_SLOT || nextAssignment >= slots)
+            nextAssignment = MICROBIT_RADIO_TDMA_FIRST_SLOT;
+
+        uint8_t s = nextAssignment++;
+
+        if (assignments[s])
+        {
+            write32(&buf.payload[len], assignments[s]);
+            buf.payload[len + 4] = s;
+            len += MICROBIT_RADIO_TDMA_ASSIGNMENT_SIZE;
+        }
+    }
+
+    buf.length = len + MICROBIT_RADIO_HEADER_SIZE - 1;
+
+    radio.sendAsync(&buf);
+}
+
+/**
+  * Handles a beacon, synchronising our slot schedule to the time it was received.
+  */
+void MicroBitRadioTDMA::beaconReceived(FrameBuffer *packet)
+{
+    int len = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1);
+    int beaconSlots = packet->payload[1];
+    int beaconSlotLength = packet->payload[2] | (packet->payload[3] << 8);
+    uint32_t me = microbit_serial_number();
+
+    if (len < MICROBIT_RADIO_TDMA_BEACON_HEADER_SIZE || beaconSlots <= MICROBIT_RADIO_TDMA_FIRST_SLOT || beaconSlotLength <= MICROBIT_RADIO_TDMA_GUARD_TIME)
+        return;
+
+    if (beaconSlots != slots || beaconSlotLength != slotLength)
+        assigned = false;
+
+    slots = beaconSlots;
+    slotLength = beaconSlotLength;
+
+    // Look for our assignment, and check our slot hasn't been given to someone else.
+    for (int i = MICROBIT_RADIO_TDMA_BEACON_HEADER_SIZE; i + MICROBIT_RADIO_TDMA_ASSIGNMENT_SIZE <= len; i += MICROBIT_RADIO_TDMA_ASSIGNMENT_SIZE)
+    {
+        uint32_t id = read32(&packet->payload[i]);
+        uint8_t s = packet->payload[i + 4];
+
+        if (id == me && s >= MICROBIT_RADIO_TDMA_FIRST_SLOT && s < slots)
+        {
+            slot = s;
+            assigned = true;
+        }
+        else if (assigned && s == slot)
+        {
+            assigned = false;
+        }
+    }
+
+    if (!assigned)
+        slot = MICROBIT_RADIO_TDMA_FIRST_SLOT - 1;
+
+    // Slots are timed from the end of the beacon, which falls at the start of slot 1.
+    uint32_t elapsed = (uint32_t) system_timer_current_time_us() - packet->timestamp;
+    uint32_t start = (slot - 1) * slotLength;
+    uint32_t end = start + slotLength - MICROBIT_RADIO_TDMA_GUARD_TIME;
+
+    synchronised = true;
+
+    if (elapsed < start)
+    {
+        radio.setTransmitHold(true);
+        schedule(MICROBIT_RADIO_TDMA_EVT_SLOT_START, start - elapsed);
+    }
+    else if (elapsed < end)
+    {
+        radio.setTransmitHold(false);
+        schedule(MICROBIT_RADIO_TDMA_EVT_SLOT_END, end - elapsed);
+    }
+    else
+    {
+        // We heard the beacon too late to use our slot this time around.
+        radio.setTransmitHold(true);
+    }
+
+    schedule(MICROBIT_RADIO_TDMA_EVT_SYNC_LOST, MICROBIT_RADIO_TDMA_SYNC_TIMEOUT * slots * slotLength);
+
+    // Under a listen schedule, open the next receive window just ahead of the next beacon.
+    if (radio.isListenScheduled() && elapsed + MICROBIT_RADIO_LISTEN_GUARD < (uint32_t) slots * slotLength)
+        radio.syncListenSchedule(slots * slotLength - elapsed - MICROBIT_RADIO_LISTEN_GUARD);
+
+    // Ask for a slot. The request is held until the shared slot.
+    if (!assigned)
+    {
+        FrameBuffer buf;
+
+        buf.length = 5 + MICROBIT_RADIO_HEADER_SIZE - 1;
+        buf.version = 1;
+        buf.group = 0;
+        buf.protocol = MICROBIT_RADIO_PROTOCOL_TDMA;
+        buf.payload[0] = MICROBIT_RADIO_TDMA_JOIN;
+        write32(&buf.payload[1], me);
+
+        radio.sendAsync(&buf);
+    }
+}
+
+/**
+  * Handles a request for a slot, assigning the first free slot to the node if it has none already.
+  */
+void MicroBitRadioTDMA::joinReceived(FrameBuffer *packet)
+{
+    if (packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1) < 5)
+        return;
+
+    uint32_t id = read32(&packet->payload[1]);
+    int vacant = -1;
+
+    for (int i = MICROBIT_RADIO_TDMA_FIRST_SLOT; i < slots; i++)
+    {
+        if (assignments[i] == id)
+            return;
+
+        if (assignments[i] == 0 && vacant < 0)
+            vacant = i;
+    }
+
+    // If all slots are taken, the node carries on sharing the unassigned slot.
+    if (vacant >= 0)
+        assignments[vacant] = id;
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as using the TDMA protocol.
+  */
+void MicroBitRadioTDMA::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+
+    if (packet->length >= MICROBIT_RADIO_HEADER_SIZE)
+    {
+        if (mode == MICROBIT_RADIO_TDMA_NODE && packet->payload[0] == MICROBIT_RADIO_TDMA_BEACON)
+            beaconReceived(packet);
+
+        if (mode == MICROBIT_RADIO_TDMA_BEACON_NODE && packet->payload[0] == MICROBIT_RADIO_TDMA_JOIN)
+            joinReceived(packet);
+    }
+
+    delete packet;
+}
+
+/**
+  * Timer event handler, called in interrupt context at slot boundaries.
+  */
+void MicroBitRadioTDMA::timerEvent(Event e)
+{
+    if (mode == MICROBIT_RADIO_TDMA_OFF)
+        return;
+
+    switch (e.value)
+    {
+        case MICROBIT_RADIO_TDMA_EVT_SUPERFRAME:
+            // Schedule the next superframe first, to keep the period as steady as possible.
+            schedule(MICROBIT_RADIO_TDMA_EVT_SUPERFRAME, slots * slotLength);
+
+            // Our own frames are held until the beacon has been queued, so the beacon goes first whenever possible.
+            sendBeacon();
+            radio.setTransmitHold(false);
+            schedule(MICROBIT_RADIO_TDMA_EVT_SLOT_END, slotLength - MICROBIT_RADIO_TDMA_GUARD_TIME);
+            break;
+
+        case MICROBIT_RADIO_TDMA_EVT_SLOT_START:
+            radio.setTransmitHold(false);
+            schedule(MICROBIT_RADIO_TDMA_EVT_SLOT_END, slotLength - MICROBIT_RADIO_TDMA_GUARD_TIME);
+            break;
+
+        case MICROBIT_RADIO_TDMA_EVT_SLOT_END:
+            if (synchronised)
+                radio.setTransmitHold(true);
+            break;
+
+        case MICROBIT_RADIO_TDMA_EVT_SYNC_LOST:
+            // Without a beacon, fall back to transmitting at will until the next one is heard.
+            synchronised = false;
+            radio.setTransmitHold(false);
+            break;
+    }
+}
@@ -0,0 +1,178 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRandomPool.h"
+#include "MicroBitDevice.h"
+#include "nrf.h"
+
+#ifdef SOFTDEVICE_PRESENT
+#include "nrf_soc.h"
+#endif
+
+using namespace codal;
+
+static uint8_t pool[MICROBIT_RANDOM_POOL_SIZE];
+static volatile uint32_t poolHead = 0;              // Total bytes ever written to the pool, by the RNG interrupt.
+static volatile uint32_t poolTail = 0;              // Total bytes ever taken from the pool.
+static volatile bool poolRunning = false;           // true if the pool is being filled.
+static volatile bool poolHardware = false;          // true if the pool is being filled from the RNG peripheral.
+
+extern "C" void RNG_IRQHandler(void)
+{
+    if (NRF_RNG->EVENTS_VALRDY)
+    {
+        NRF_RNG->EVENTS_VALRDY = 0;
+
+        pool[poolHead & (MICROBIT_RANDOM_POOL_SIZE - 1)] = (uint8_t) NRF_RNG->VALUE;
+        poolHead = poolHead + 1;
+
+        // Stop the generator once the pool is full, to save power. It is restarted as bytes are taken.
+        if (poolHead - poolTail >= MICROBIT_RANDOM_POOL_SIZE)
+            NRF_RNG->TASKS_STOP = 1;
+    }
+}
+
+/**
+ * Starts filling the random pool from the hardware random number generator, in the background.
+ */
+void codal::microbit_random_pool_start()
+{
+    if (poolRunning)
+        return;
+
+    poolRunning = true;
+
+    // The SoftDevice owns the generator while it's running, and maintains a pool of its own.
+    if (ble_running())
+        return;
+
+    poolHardware = true;
+
+    NRF_RNG->CONFIG = RNG_CONFIG_DERCEN_Msk;
+    NRF_RNG->EVENTS_VALRDY = 0;
+    NRF_RNG->INTENSET = RNG_INTENSET_VALRDY_Msk;
+
+    NVIC_SetPriority(RNG_IRQn, 7);
+    NVIC_ClearPendingIRQ(RNG_IRQn);
+    NVIC_EnableIRQ(RNG_IRQn);
+
+    NRF_RNG->TASKS_START = 1;
+}
+
+/**
+ * Stops filling the random pool from the hardware random number generator.
+ */
+void codal::microbit_random_pool_stop()
+{
+    if (!poolHardware)
+        return;
+
+    poolHardware = false;
+
+    NRF_RNG->TASKS_STOP = 1;
+    NRF_RNG->INTENCLR = RNG_INTENCLR_VALRDY_Msk;
+
+    NVIC_DisableIRQ(RNG_IRQn);
+    NVIC_ClearPendingIRQ(RNG_IRQn);
+    NRF_RNG->EVENTS_VALRDY = 0;
+}
+
+/**
+ * Determines if the random pool is being filled, either from the hardware or the SoftDevice.
+ *
+ * @return true if the pool is running, false otherwise.
+ */
+bool codal::microbit_random_pool_running()
+{
+    return poolRunning;
+}
+
+/**
+ * Determines how many bytes of entropy can be taken from the pool immediately.
+ *
+ * @return The number of bytes available.
+ */
+int codal::microbit_random_available()
+{
+    int available = poolHead - poolTail;
+
+#ifdef SOFTDEVICE_PRESENT
+    if (poolRunning && ble_running())
+    {
+        uint8_t sdAvailable = 0;
+
+        sd_rand_application_bytes_available_get(&sdAvailable);
+        available += sdAvailable;
+    }
+#endif
+
+    return available;
+}
+
+/**
+ * Takes bytes of entropy from the pool, without waiting for more to be generated.
+ *
+ * @param buffer The buffer to fill.
+ * @param len The number of bytes required.
+ *
+ * @return The number of bytes written to the buffer, which may be fewer than len if the pool is running low.
+ */
+int codal::microbit_random_bytes(uint8_t *buffer, int len)
+{
+    int count = 0;
+
+    if (buffer == NULL || len <= 0)
+        return 0;
+
+    // Bytes may be taken from interrupt context, so claim them in one step. The copy is at most the size of the pool.
+    __disable_irq();
+
+    while (count < len && poolTail != poolHead)
+    {
+        buffer[count++] = pool[poolTail & (MICROBIT_RANDOM_POOL_SIZE - 1)];
+        poolTail = poolTail + 1;
+    }
+
+    __enable_irq();
+
+    // Restart the generator, now there's room. Starting it again while it is running has no effect.
+    if (poolHardware && count > 0)
+        NRF_RNG->TASKS_START = 1;
+
+#ifdef SOFTDEVICE_PRESENT
+    if (count < len && poolRunning && ble_running())
+    {
+        uint8_t sdAvailable = 0;
+
+        sd_rand_application_bytes_available_get(&sdAvailable);
+
+        int n = min(len - count, (int) sdAvailable);
+
+        if (n > 0 && sd_rand_application_vector_get(buffer + count, n) == NRF_SUCCESS)
+            count += n;
+    }
+#endif
+
+    return count;
+}
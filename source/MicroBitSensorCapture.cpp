@@ -0,0 +1,362 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#include "MicroBitSensorCapture.h"
+#include "CodalFiber.h"
+#include "EventModel.h"
+#include "ErrorNo.h"
+#include "Timer.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param log The log to write to, e.g. MicroBit::log.
+ */
+MicroBitSensorCapture::MicroBitSensorCapture(MicroBitLog &log) : log(log)
+{
+    accelerometer = NULL;
+    compass = NULL;
+    thermometer = NULL;
+    display = NULL;
+    channels = 0;
+    samples = NULL;
+    times = NULL;
+    head = 0;
+    count = 0;
+    overruns = 0;
+    running = false;
+    flushing = false;
+    sampling = false;
+    result = DEVICE_OK;
+}
+
+/**
+ * Destructor. Stops capturing, if running.
+ */
+MicroBitSensorCapture::~MicroBitSensorCapture()
+{
+    stop();
+
+    // Wait for any write in progress to finish with the buffers before releasing them.
+    while (flushing)
+        fiber_sleep(1);
+
+    free(samples);
+    free(times);
+}
+
+/**
+ * Adds the accelerometer as a source, captured in the "accel x", "accel y" and "accel z" columns, in milli-g.
+ *
+ * @param accelerometer The accelerometer to sample, e.g. MicroBit::accelerometer.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+ */
+int MicroBitSensorCapture::addAccelerometer(Accelerometer &accelerometer)
+{
+    if (running)
+        return DEVICE_INVALID_STATE;
+
+    this->accelerometer = &accelerometer;
+    return DEVICE_OK;
+}
+
+/**
+ * Adds the compass as a source, captured in the "compass x", "compass y" and "compass z" columns, in nano teslas.
+ *
+ * @param compass The compass to sample, e.g. MicroBit::compass.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+ */
+int MicroBitSensorCapture::addCompass(Compass &compass)
+{
+    if (running)
+        return DEVICE_INVALID_STATE;
+
+    this->compass = &compass;
+    return DEVICE_OK;
+}
+
+/**
+ * Adds the thermometer as a source, captured in the "temperature" column, in degrees Celsius.
+ *
+ * @param thermometer The thermometer to sample, e.g. MicroBit::thermometer.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+ */
+int MicroBitSensorCapture::addThermometer(MicroBitThermometer &thermometer)
+{
+    if (running)
+        return DEVICE_INVALID_STATE;
+
+    this->thermometer = &thermometer;
+    return DEVICE_OK;
+}
+
+/**
+ * Adds the light level sensed by the display as a source, captured in the "light" column, from 0 to 255.
+ *
+ * @param display The display to sample, e.g. MicroBit::display.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if capture is running.
+ */
+int MicroBitSensorCapture::addLightLevel(NRF52LEDMatrix &display)
+{
+    if (running)
+        return DEVICE_INVALID_STATE;
+
+    this->display = &display;
+    return DEVICE_OK;
+}
+
+/**
+ * Starts capturing from every source added.
+ *
+ * @param period The time between samples (in milliseconds).
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the period is not positive, DEVICE_INVALID_STATE
+ * if no sources have been added, or DEVICE_NO_RESOURCES if no buffer could be allocated or no default EventModel is available.
+ */
+int MicroBitSensorCapture::start(int period)
+{
+    if (running)
+        return DEVICE_OK;
+
+    if (period <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    // Anything left from an earlier capture must be written out before the buffers are laid out afresh.
+    flush();
+
+    const char *names[MICROBIT_SENSOR_CAPTURE_MAX_CHANNELS];
+    int n = 0;
+
+    if (accelerometer)
+    {
+        names[n++] = "accel x";
+        names[n++] = "accel y";
+        names[n++] = "accel z";
+    }
+
+    if (compass)
+    {
+        names[n++] = "compass x";
+        names[n++] = "compass y";
+        names[n++] = "compass z";
+    }
+
+    if (thermometer)
+        names[n++] = "temperature";
+
+    if (display)
+        names[n++] = "light";
+
+    if (n == 0)
+        return DEVICE_INVALID_STATE;
+
+    if (n != channels)
+    {
+        free(samples);
+        samples = (int32_t *) malloc(n * MICROBIT_SENSOR_CAPTURE_BUFFER * sizeof(int32_t));
+        channels = samples ? n : 0;
+    }
+
+    if (times == NULL)
+        times = (CODAL_TIMESTAMP *) malloc(MICROBIT_SENSOR_CAPTURE_BUFFER * sizeof(CODAL_TIMESTAMP));
+
+    if (samples == NULL || times == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    for (int c = 0; c < channels; c++)
+        columnHandles[c] = log.getColumnHandle(names[c]);
+
+    head = 0;
+    count = 0;
+    overruns = 0;
+    result = DEVICE_OK;
+    running = true;
+
+    // Each handler has a fiber of its own, so a slow write to the log doesn't hold up sampling.
+    EventModel::defaultEventBus->listen(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_SAMPLE, this, &MicroBitSensorCapture::onSample);
+    EventModel::defaultEventBus->listen(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_FLUSH, this, &MicroBitSensorCapture::onFlush);
+    system_timer_event_every(period, MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_SAMPLE);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops capturing, and writes any buffered rows to the log.
+ *
+ * @return DEVICE_OK on success, or the error from MicroBitLog::logRows() if the rows could not be written.
+ */
+int MicroBitSensorCapture::stop()
+{
+    if (running)
+    {
+        running = false;
+
+        system_timer_cancel_event(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_SAMPLE);
+        EventModel::defaultEventBus->ignore(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_SAMPLE, this, &MicroBitSensorCapture::onSample);
+        EventModel::defaultEventBus->ignore(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_FLUSH, this, &MicroBitSensorCapture::onFlush);
+    }
+
+    return flush();
+}
+
+/**
+ * Writes any buffered rows to the log, waiting for a write already in progress to complete.
+ *
+ * @return DEVICE_OK on success, or the error from MicroBitLog::logRows() if the rows could not be written.
+ */
+int MicroBitSensorCapture::flush()
+{
+    // Let a row being sampled complete, so that it is written with the rest.
+    while (flushing || sampling)
+        fiber_sleep(1);
+
+    drain();
+
+    return result;
+}
+
+/**
+ * Determines if capture is running.
+ *
+ * @return true if running, false otherwise.
+ */
+bool MicroBitSensorCapture::isRunning()
+{
+    return running;
+}
+
+/**
+ * Determines the number of rows lost since capture started, because the log could not be written quickly enough.
+ *
+ * @return the number of rows lost.
+ */
+uint32_t MicroBitSensorCapture::getOverrunCount()
+{
+    return overruns;
+}
+
+/**
+ * Takes a sample from every source.
+ */
+void MicroBitSensorCapture::onSample(Event)
+{
+    if (!running)
+        return;
+
+    // Rows being written to the log are still in the buffer, so never overwrite the oldest.
+    if (count >= MICROBIT_SENSOR_CAPTURE_BUFFER)
+    {
+        overruns++;
+        return;
+    }
+
+    // Reserve the row before reading any sensor, as the reads may yield to other fibers.
+    int row = (head + count) % MICROBIT_SENSOR_CAPTURE_BUFFER;
+    int32_t *p = samples + row;
+
+    count++;
+    sampling = true;
+
+    times[row] = system_timer_current_time();
+
+    if (accelerometer)
+    {
+        Sample3D s = accelerometer->getSample();
+
+        *p = s.x; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+        *p = s.y; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+        *p = s.z; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+    }
+
+    if (compass)
+    {
+        Sample3D s = compass->getSample();
+
+        *p = s.x; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+        *p = s.y; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+        *p = s.z; p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+    }
+
+    if (thermometer)
+    {
+        *p = thermometer->getTemperature();
+        p += MICROBIT_SENSOR_CAPTURE_BUFFER;
+    }
+
+    if (display)
+        *p = display->readLightLevel();
+
+    sampling = false;
+
+    if (count == MICROBIT_SENSOR_CAPTURE_FLUSH_THRESHOLD && !flushing)
+        Event(MICROBIT_ID_SENSOR_CAPTURE, MICROBIT_SENSOR_CAPTURE_EVT_FLUSH);
+}
+
+/**
+ * Writes the buffered rows to the log.
+ */
+void MicroBitSensorCapture::onFlush(Event)
+{
+    drain();
+}
+
+/**
+ * Writes the buffered rows to the log, unless another fiber is already doing so.
+ */
+void MicroBitSensorCapture::drain()
+{
+    if (flushing || samples == NULL)
+        return;
+
+    flushing = true;
+
+    // Rows sampled while a block is written are picked up by the next pass, so keep going until the buffer is empty.
+    // A row still being sampled is left for the next flush.
+    while (count > (sampling ? 1 : 0))
+    {
+        int rows = min(count - (sampling ? 1 : 0), MICROBIT_SENSOR_CAPTURE_BUFFER - head);
+        const int32_t *values[MICROBIT_SENSOR_CAPTURE_MAX_CHANNELS];
+
+        for (int c = 0; c < channels; c++)
+            values[c] = samples + c * MICROBIT_SENSOR_CAPTURE_BUFFER + head;
+
+        result = log.logRows(columnHandles, values, channels, rows, times + head);
+
+        head = (head + rows) % MICROBIT_SENSOR_CAPTURE_BUFFER;
+        count -= rows;
+
+        // If the log is full, there is nowhere for the remaining rows to go.
+        if (result != DEVICE_OK)
+        {
+            overruns += count;
+            head = (head + count) % MICROBIT_SENSOR_CAPTURE_BUFFER;
+            count = 0;
+        }
+    }
+
+    flushing = false;
+}
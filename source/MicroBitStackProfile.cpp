@@ -0,0 +1,240 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitStackProfile.h"
+#include "codal_target_hal.h"
+#include "ErrorNo.h"
+#include "nrf.h"
+#include <string.h>
+
+using namespace codal;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+
+static MicroBitStackProfileRecord records[MICROBIT_STACK_PROFILE_FIBERS];
+static int recordCount = 0;
+static uint32_t deepest = 0;
+static uint32_t totalSamples = 0;
+static uint32_t unattributed = 0;
+
+/**
+ * Records a sample of the stack depth of the running fiber. Must be called with interrupts disabled, or from the
+ * SysTick handler.
+ *
+ * @param sp the stack pointer of the running fiber.
+ */
+static void stack_record(uint32_t sp)
+{
+    // All fibers run on the same stack, paged in below DEVICE_STACK_BASE. Anything else isn't a fiber stack.
+    if (sp > DEVICE_STACK_BASE || sp < DEVICE_SRAM_BASE)
+        return;
+
+    uint32_t depth = DEVICE_STACK_BASE - sp;
+    Fiber *f = currentFiber;
+
+    totalSamples++;
+
+    if (depth > deepest)
+        deepest = depth;
+
+    if (f == NULL)
+    {
+        unattributed++;
+        return;
+    }
+
+    for (int i = 0; i < recordCount; i++)
+    {
+        if (records[i].fiber == f)
+        {
+            records[i].samples++;
+
+            if (depth > records[i].maxDepth)
+                records[i].maxDepth = depth;
+
+            return;
+        }
+    }
+
+    if (recordCount == MICROBIT_STACK_PROFILE_FIBERS)
+    {
+        unattributed++;
+        return;
+    }
+
+    records[recordCount].fiber = f;
+    records[recordCount].maxDepth = depth;
+    records[recordCount].samples = 1;
+    recordCount++;
+}
+
+/**
+ * Called from SysTick_Handler, with the stack pointer of the code it interrupted.
+ */
+extern "C" void microbit_stack_profile_sample_irq(uint32_t sp)
+{
+    stack_record(sp);
+}
+
+/**
+ * SysTick interrupt handler. Passes on whichever of MSP or PSP the interrupted code was using (from bit 2 of EXC_RETURN),
+ * so the exception frame pushed onto the fiber's stack is counted as part of its depth.
+ */
+extern "C" __attribute__((naked)) void SysTick_Handler()
+{
+    __asm volatile(
+        "tst lr, #4             \n"
+        "ite eq                 \n"
+        "mrseq r0, msp          \n"
+        "mrsne r0, psp          \n"
+        "b microbit_stack_profile_sample_irq\n"
+    );
+}
+
+#endif
+
+/**
+ * Starts sampling the stack depth of whichever fiber is running, from the SysTick interrupt at the lowest priority.
+ *
+ * @param rate the number of samples to take per second.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the rate is out of range, or DEVICE_NOT_SUPPORTED
+ *         if CONFIG_MICROBIT_STACK_PROFILE is not enabled.
+ */
+int codal::microbit_stack_profile_start(uint32_t rate)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    // SysTick has a 24 bit reload value, which bounds the slowest rate.
+    if (rate == 0 || rate > SystemCoreClock || SystemCoreClock / rate > SysTick_LOAD_RELOAD_Msk)
+        return DEVICE_INVALID_PARAMETER;
+
+    SysTick->LOAD = SystemCoreClock / rate - 1;
+    SysTick->VAL = 0;
+
+    // At the lowest priority we only ever interrupt thread mode, so always see a fiber's stack.
+    NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+
+    return DEVICE_OK;
+#else
+    (void) rate;
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Stops sampling.
+ */
+void codal::microbit_stack_profile_stop()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    SysTick->CTRL = 0;
+    SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+#endif
+}
+
+/**
+ * Discards all watermarks and sample counts.
+ */
+void codal::microbit_stack_profile_clear()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    target_disable_irq();
+
+    memset(records, 0, sizeof(records));
+    recordCount = 0;
+    deepest = 0;
+    totalSamples = 0;
+    unattributed = 0;
+
+    target_enable_irq();
+#endif
+}
+
+/**
+ * Samples the stack depth of the calling fiber now.
+ */
+void codal::microbit_stack_sample()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    target_disable_irq();
+    stack_record(__get_CONTROL() & CONTROL_SPSEL_Msk ? __get_PSP() : __get_MSP());
+    target_enable_irq();
+#endif
+}
+
+/**
+ * Provides the watermarks recorded, one per fiber sampled, in the order the fibers were first seen.
+ *
+ * @param buffer the array to fill in.
+ * @param count the number of entries in the array.
+ * @return the number of entries filled in.
+ */
+int codal::microbit_stack_profile_read(MicroBitStackProfileRecord *buffer, int count)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    if (buffer == NULL || count <= 0)
+        return 0;
+
+    target_disable_irq();
+
+    int n = count < recordCount ? count : recordCount;
+
+    for (int i = 0; i < n; i++)
+    {
+        buffer[i] = records[i];
+
+        // Fibers are recycled rather than freed, so this stays valid once a fiber has ended.
+        buffer[i].savedBytes = buffer[i].fiber->stack_top - buffer[i].fiber->stack_bottom;
+    }
+
+    target_enable_irq();
+
+    return n;
+#else
+    (void) buffer;
+    (void) count;
+    return 0;
+#endif
+}
+
+/**
+ * Prints a report of the watermarks recorded to the given serial port.
+ *
+ * @param serial the serial port to print to.
+ */
+void codal::microbit_stack_profile_print(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_STACK_PROFILE)
+    MicroBitStackProfileRecord r[MICROBIT_STACK_PROFILE_FIBERS];
+    int n = microbit_stack_profile_read(r, MICROBIT_STACK_PROFILE_FIBERS);
+
+    serial.printf("STACK %d %d %d %d\r\n", deepest, DEVICE_STACK_SIZE, totalSamples, unattributed);
+
+    for (int i = 0; i < n; i++)
+        serial.printf("FIBER %x %d %d %d\r\n", (uint32_t) r[i].fiber, r[i].maxDepth, r[i].samples, r[i].savedBytes);
+#endif
+
+    serial.printf("END\r\n");
+}
@@ -31,6 +31,19 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+static MicroBitThermometer *thermometer = NULL;
+
+extern "C" void TEMP_IRQHandler(void)
+{
+    if (NRF_TEMP->EVENTS_DATARDY)
+    {
+        NRF_TEMP->EVENTS_DATARDY = 0;
+
+        if (thermometer)
+            thermometer->measurementComplete();
+    }
+}
+
 /*
  * The underlying Nordic libraries that support BLE do not compile cleanly with the stringent GCC settings we employ
  * If we're compiling under GCC, then we suppress any warnings generated from this code (but not the rest of the DAL)
@@ -55,6 +68,12 @@ MicroBitThermometer::MicroBitThermometer(uint16_t id)
     this->sampleTime = 0;
     this->offset = 0;
     this->temperature = 0;
+    this->measuring = false;
+    this->sampleValid = false;
+    this->measurements = 0;
+    this->measurementSum = 0;
+
+    thermometer = this;
 }
 
 /**
@@ -69,6 +88,10 @@ MicroBitThermometer::MicroBitThermometer(uint16_t id)
 int MicroBitThermometer::getTemperature()
 {
     updateSample();
+
+    // Before our first sample there's nothing to report, so wait for it. This only takes as long as the measurements themselves.
+    while (!sampleValid);
+
     return temperature - offset;
 }
 
@@ -87,11 +110,18 @@ int MicroBitThermometer::updateSample()
     // Ensure we're registered for a background processing callbacks.
     status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
 
-    // check if we need to update our sample...
-    if(isSampleNeeded())
+#ifdef SOFTDEVICE_PRESENT
+    // If Bluetooth started part way through a measurement, the TEMP peripheral now belongs to the SoftDevice, so start again.
+    if (measuring && ble_running())
     {
-        int32_t processorTemperature = 0;
+        NVIC_DisableIRQ(TEMP_IRQn);
+        measuring = false;
+    }
+#endif
 
+    // check if we need to update our sample...
+    if(isSampleNeeded() && !measuring)
+    {
         // For now, we just rely on the nrf senesor to be the most accurate.
         // The compass module also has a temperature sensor, and has the lowest power consumption, so will run the cooler...
         // ...however it isn't trimmed for accuracy during manufacture, so requires calibration.
@@ -99,35 +129,78 @@ int MicroBitThermometer::updateSample()
 #ifdef SOFTDEVICE_PRESENT
         if ( ble_running())
         {
-            // If Bluetooth is enabled, we need to go through the Nordic software to safely do this
-            sd_temp_get(&processorTemperature);
+            // If Bluetooth is enabled, the TEMP peripheral belongs to the SoftDevice, so we need to go through the Nordic software to safely do this
+            int32_t sum = 0;
+
+            for (int i = 0; i < MICROBIT_THERMOMETER_OVERSAMPLE; i++)
+            {
+                int32_t processorTemperature = 0;
+                sd_temp_get(&processorTemperature);
+                sum += processorTemperature;
+            }
+
+            sampleComplete(sum);
         }
         else
 #endif
         {
-            // Othwerwise, we access the information directly...
-            NRF_TEMP->TASKS_START = 1;
-            while (NRF_TEMP->EVENTS_DATARDY == 0);
-            NRF_TEMP->EVENTS_DATARDY = 0;
+            // Othwerwise, we access the information directly, and complete the measurement in the TEMP interrupt.
+            measuring = true;
+            measurements = 0;
+            measurementSum = 0;
 
-            processorTemperature = NRF_TEMP->TEMP;
+            NRF_TEMP->EVENTS_DATARDY = 0;
+            NRF_TEMP->INTENSET = TEMP_INTENSET_DATARDY_Msk;
+            NVIC_SetPriority(TEMP_IRQn, 7);
+            NVIC_ClearPendingIRQ(TEMP_IRQn);
+            NVIC_EnableIRQ(TEMP_IRQn);
 
-            NRF_TEMP->TASKS_STOP = 1;
+            NRF_TEMP->TASKS_START = 1;
         }
+    }
 
+    return DEVICE_OK;
+};
 
-        // Record our reading...
-        temperature = processorTemperature / 4;
-
-        // Schedule our next sample.
-        sampleTime = system_timer_current_time() + samplePeriod;
+/**
+  * Completes a measurement started by updateSample(). Called from the TEMP interrupt.
+  */
+void MicroBitThermometer::measurementComplete()
+{
+    measurementSum += (int32_t) NRF_TEMP->TEMP;
+    measurements++;
 
-        // Send an event to indicate that we'e updated our temperature.
-        Event e(id, MICROBIT_THERMOMETER_EVT_UPDATE);
+    if (measurements < MICROBIT_THERMOMETER_OVERSAMPLE)
+    {
+        NRF_TEMP->TASKS_START = 1;
+        return;
     }
 
-    return DEVICE_OK;
-};
+    NRF_TEMP->TASKS_STOP = 1;
+    NRF_TEMP->INTENCLR = TEMP_INTENCLR_DATARDY_Msk;
+    NVIC_DisableIRQ(TEMP_IRQn);
+
+    sampleComplete(measurementSum);
+    measuring = false;
+}
+
+/**
+  * Records a completed sample, schedules the next, and raises MICROBIT_THERMOMETER_EVT_UPDATE.
+  *
+  * @param sum the sum of MICROBIT_THERMOMETER_OVERSAMPLE measurements, in quarter degrees.
+  */
+void MicroBitThermometer::sampleComplete(int32_t sum)
+{
+    // Record our reading...
+    temperature = sum / (4 * MICROBIT_THERMOMETER_OVERSAMPLE);
+    sampleValid = true;
+
+    // Schedule our next sample.
+    sampleTime = system_timer_current_time() + samplePeriod;
+
+    // Send an event to indicate that we'e updated our temperature.
+    Event e(id, MICROBIT_THERMOMETER_EVT_UPDATE);
+}
 
 /**
   * Periodic callback from MicroBit idle thread.
@@ -0,0 +1,108 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitTrace.h"
+
+using namespace codal;
+
+MicroBitTraceRecord codal::microbit_trace_buffer[MICROBIT_TRACE_BUFFER_SIZE];
+volatile uint32_t codal::microbit_trace_head = 0;
+volatile bool codal::microbit_trace_enabled = false;
+
+/**
+ * Starts recording trace events, enabling the processor cycle counter if necessary.
+ */
+void codal::microbit_trace_start()
+{
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    microbit_trace_enabled = true;
+}
+
+/**
+ * Stops recording trace events. Those already recorded are kept.
+ */
+void codal::microbit_trace_stop()
+{
+    microbit_trace_enabled = false;
+}
+
+/**
+ * Discards all trace events recorded.
+ */
+void codal::microbit_trace_clear()
+{
+    microbit_trace_head = 0;
+}
+
+/**
+ * Copies the trace events recorded, oldest first.
+ *
+ * @param buffer the array to copy records into.
+ * @param count the maximum number of records to copy.
+ * @param first the index of the first record to copy, counting from the oldest.
+ *
+ * @return the number of records copied.
+ */
+int codal::microbit_trace_read(MicroBitTraceRecord *buffer, int count, int first)
+{
+    uint32_t head = microbit_trace_head;
+    uint32_t available = head < MICROBIT_TRACE_BUFFER_SIZE ? head : MICROBIT_TRACE_BUFFER_SIZE;
+    uint32_t oldest = head - available;
+    int n = 0;
+
+    for (uint32_t i = first; i < available && n < count; i++)
+        buffer[n++] = microbit_trace_buffer[(oldest + i) & (MICROBIT_TRACE_BUFFER_SIZE - 1)];
+
+    return n;
+}
+
+/**
+ * Prints the trace events recorded to the given serial port, oldest first.
+ *
+ * @param serial the serial port to print to.
+ */
+void codal::microbit_trace_print(Serial &serial)
+{
+    uint32_t head = microbit_trace_head;
+    int available = head < MICROBIT_TRACE_BUFFER_SIZE ? head : MICROBIT_TRACE_BUFFER_SIZE;
+    MicroBitTraceRecord r;
+
+    serial.printf("TRACE %d %d\r\n", available, SystemCoreClock);
+
+    for (int i = 0; i < available; i++)
+    {
+        if (microbit_trace_read(&r, 1, i) != 1)
+            break;
+
+        serial.printf("%x %x %x\r\n", r.time, r.event, r.arg);
+    }
+
+    serial.printf("END\r\n");
+}
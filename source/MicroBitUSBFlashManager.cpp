@@ -23,6 +23,9 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "MicroBitUSBFlashManager.h"
+#include "CodalFiber.h"
+#include "MicroBitBootProfile.h"
+#include "MicroBitTrace.h"
 
 using namespace codal;
 
@@ -49,11 +52,23 @@ CREATE_KEY_VALUE_TABLE(usbFlashPropertyLength, usbFlashPropertyLengthData);
  */
 MicroBitUSBFlashManager::MicroBitUSBFlashManager(MicroBitI2C &i2c, MicroBitIO &ioPins, MicroBitPowerManager &powerManager, uint16_t id) : i2cBus(i2c), io(ioPins), power(powerManager)
 {
+    MICROBIT_BOOT_PROFILE_BEGIN(MICROBIT_BOOT_PHASE_USB_FLASH_MANAGER);
+
     this->id = id;
-    this->maxWriteLength = 64;
+    this->maxWriteLength = MICROBIT_USB_FLASH_MAX_WRITE_LENGTH;
+    this->pendingAddress = 0;
+    this->pendingLength = 0;
+    this->eraseQueueLength = 0;
+    resetStats();
 
     // Be pessimistic about the interface chip in use, until we obtain version information.
     status = (MICROBIT_USB_FLASH_SINGLE_PAGE_ERASE_ONLY | MICROBIT_USB_FLASH_USE_NULL_TRANSACTION);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_USB_FLASH_COMPARE_WRITES)
+    status |= MICROBIT_USB_FLASH_COMPARE_WRITES;
+#endif
+
+    MICROBIT_BOOT_PROFILE_END(MICROBIT_BOOT_PHASE_USB_FLASH_MANAGER);
 }
 
 /**
@@ -68,6 +83,7 @@ MicroBitUSBFlashConfig MicroBitUSBFlashManager::getConfiguration()
     if (!(status & MICROBIT_USB_FLASH_CONFIG_LOADED))
     {
         ManagedBuffer response;
+        bool valid = true;
 
         // Load the configured filename
         response = transact(MICROBIT_USB_FLASH_FILENAME_CMD);
@@ -77,22 +93,34 @@ MicroBitUSBFlashConfig MicroBitUSBFlashManager::getConfiguration()
             n[n.length()-4] = '.';
             config.fileName = n;
         }
+        else
+            valid = false;
 
         // Load the filesize
         response = transact(MICROBIT_USB_FLASH_FILESIZE_CMD);
-        uint32_t s;
-        memcpy(&s, &response[1], 4);
-        config.fileSize = htonl(s);
+        if (response.length() >= 5)
+        {
+            uint32_t s;
+            memcpy(&s, &response[1], 4);
+            config.fileSize = htonl(s);
 
-        // Sanity check that the filesize isnt longer than the possible block count
-        if( config.fileSize > MICROBIT_USB_FLASH_MAX_FLASH_STORAGE )
-            config.fileSize = MICROBIT_USB_FLASH_MAX_FLASH_STORAGE;
+            // Sanity check that the filesize isnt longer than the possible block count
+            if( config.fileSize > MICROBIT_USB_FLASH_MAX_FLASH_STORAGE )
+                config.fileSize = MICROBIT_USB_FLASH_MAX_FLASH_STORAGE;
+        }
+        else
+            valid = false;
 
         // Load the visibility status
         response = transact(MICROBIT_USB_FLASH_VISIBILITY_CMD);
-        config.visible = response[1] == 0 ? 0 : 1;
+        if (response.length() >= 2)
+            config.visible = response[1] == 0 ? 0 : 1;
+        else
+            valid = false;
 
-        status |= MICROBIT_USB_FLASH_CONFIG_LOADED;
+        // Ensure we don't cache invalid state.
+        if (valid)
+            status |= MICROBIT_USB_FLASH_CONFIG_LOADED;
     }
 
     return config;    
@@ -167,15 +195,24 @@ int MicroBitUSBFlashManager::setConfiguration(MicroBitUSBFlashConfig config, boo
     fvisible[1] = config.visible ? 1 : 0;
 
     // Write out each of the parameters in turn.
-    transact(fname, 12);
-    transact(fsize, 5);
-    transact(fvisible, 2);
+    bool valid = transact(fname, 12).length() > 0;
+    valid = transact(fsize, 5).length() > 0 && valid;
+    valid = transact(fvisible, 2).length() > 0 && valid;
 
     if (persist)
         transact(MICROBIT_USB_FLASH_WRITE_CONFIG_CMD);
 
-    // Cache for later.
-    this->config = config;
+    // Cache for later. If any part of the update failed, we no longer know the interface chip's configuration, so reload it on next use.
+    if (valid)
+    {
+        this->config = config;
+        status |= MICROBIT_USB_FLASH_CONFIG_LOADED;
+    }
+    else
+    {
+        status &= ~MICROBIT_USB_FLASH_CONFIG_LOADED;
+        return DEVICE_I2C_ERROR;
+    }
 
     return DEVICE_OK;
 }
@@ -259,6 +296,9 @@ int MicroBitUSBFlashManager::remount()
     cmd[0] = MICROBIT_USB_FLASH_REMOUNT_CMD;
     transact(cmd, 1);
 
+    // The interface chip reloads its configuration when it remounts, so refresh our cached copy on next use.
+    status &= ~MICROBIT_USB_FLASH_CONFIG_LOADED;
+
     return DEVICE_OK;
 }
 
@@ -294,6 +334,12 @@ MicroBitUSBFlashManager::read(uint32_t address, uint32_t length)
     // Convert length parameter from 32-bit count to a byte count.
     length = length * sizeof(uint32_t);
 
+    // Ensure we don't read data that is about to be erased, or stale data from beneath a pending write.
+    awaitErase(address, length);
+
+    if (pendingLength > 0 && address < pendingAddress + pendingLength && address + length > pendingAddress)
+        flush();
+
     uint32_t *p = (uint32_t *) &request[0];
     *p++ = htonl((uint32_t) address | (MICROBIT_USB_FLASH_READ_CMD << 24));
     *p++ = htonl(length);
@@ -344,41 +390,216 @@ MicroBitUSBFlashManager::read(uint32_t* dest, uint32_t address, uint32_t length)
  */
 int MicroBitUSBFlashManager::write(uint32_t address, uint32_t *data, uint32_t length)
 {
+    const uint8_t *src = (const uint8_t *) data;
+    int r;
+
     // Convert length parameter from 32-bit count to a byte count.
     length = length * sizeof(uint32_t);
 
-    ManagedBuffer response;
+    // Don't write to an area that is about to be erased.
+    awaitErase(address, length);
 
-    ManagedBuffer request(min(maxWriteLength, length) + 8);
-    request.fill(0xFF);
+    // If this write continues the pending one, combine the two into a single transaction.
+    if (pendingLength > 0 && address == pendingAddress + pendingLength)
+    {
+        uint32_t l = min(maxWriteLength - pendingLength, length);
+
+        memcpy(pendingData + pendingLength, src, l);
+        pendingLength += l;
 
-    uint32_t p = address;
-    uint32_t end = p + length;
-    uint32_t bytesWritten = 0;
-    uint32_t segmentLength;
+        address += l;
+        src += l;
+        length -= l;
+
+        if (pendingLength == (uint32_t) maxWriteLength)
+        {
+            r = flush();
+            if (r != DEVICE_OK)
+                return r;
+        }
+
+        if (length == 0)
+            return DEVICE_OK;
+    }
 
-    while (p < end)
+    // Otherwise, ensure any pending write is stored before this one.
+    r = flush();
+    if (r != DEVICE_OK)
+        return r;
+
+    // Send all complete segments now.
+    while (length >= (uint32_t) maxWriteLength)
     {
-        segmentLength = min(maxWriteLength, length-bytesWritten);
-        
-        uint32_t *ptr = (uint32_t *) &request[0];
-        *ptr++ = htonl( p | (MICROBIT_USB_FLASH_WRITE_CMD << 24));
-        *ptr++ = htonl(segmentLength);
-        memcpy(ptr, data + (bytesWritten/4), segmentLength);
+        r = writeSegment(address, src, maxWriteLength);
+        if (r != DEVICE_OK)
+            return r;
 
-        request.truncate(segmentLength + 8);
-        response = transact(request, 9);
+        address += maxWriteLength;
+        src += maxWriteLength;
+        length -= maxWriteLength;
+    }
 
-        if (response.length() == 0)
-            return DEVICE_I2C_ERROR;
+    // Hold back any remainder for a short while, in case the next write continues it.
+    if (length > 0)
+    {
+        memcpy(pendingData, src, length);
+        pendingAddress = address;
+        pendingLength = length;
+
+        if (!(status & MICROBIT_USB_FLASH_WRITE_LISTENER) && EventModel::defaultEventBus)
+        {
+            EventModel::defaultEventBus->listen(id, MICROBIT_USB_FLASH_EVT_FLUSH, this, &MicroBitUSBFlashManager::onFlushEvent);
+            status |= MICROBIT_USB_FLASH_WRITE_LISTENER;
+        }
+
+        // If we can't schedule a deferred write, don't hold the data back at all.
+        if (status & MICROBIT_USB_FLASH_WRITE_LISTENER)
+            system_timer_event_after(MICROBIT_USB_FLASH_WRITE_DELAY, id, MICROBIT_USB_FLASH_EVT_FLUSH);
+        else
+            return flush();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes a single segment of data of no more than maxWriteLength bytes to the interface chip.
+ * If compare before write is enabled, only the runs of data that differ from the existing contents are sent.
+ *
+ * @param address the location to write to. Must be 32 bit aligned.
+ * @param data a buffer containing the data to write.
+ * @param length the number of bytes to write.
+ * @return DEVICE_OK on success, or error code.
+ */
+int MicroBitUSBFlashManager::writeSegment(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    // Don't compare against data queued for erasure. The read would wait for the erase, which may itself be
+    // waiting for this write to be stored, and the existing contents are about to be discarded anyway.
+    if (!(status & MICROBIT_USB_FLASH_COMPARE_WRITES) || isErasePending(address, length))
+        return sendSegment(address, data, length);
+
+    ManagedBuffer existing = read(address, length / sizeof(uint32_t));
 
-        bytesWritten += segmentLength;
-        p+= segmentLength;
+    // If we can't read back the existing data, simply write it all.
+    if (existing.length() < (int) length)
+        return sendSegment(address, data, length);
+
+    const uint32_t *d = (const uint32_t *) data;
+    const uint32_t *e = (const uint32_t *) &existing[0];
+    int words = length / sizeof(uint32_t);
+    int gap = (MICROBIT_USB_FLASH_COMPARE_GAP + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    int i = 0;
+
+    while (i < words)
+    {
+        // Find the start of the next run of words that differ.
+        if (memcmp(&d[i], &e[i], sizeof(uint32_t)) == 0)
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the run until we see a long enough gap of unchanged words to justify another transaction.
+        int start = i;
+        int end = i + 1;
+
+        for (i = end; i < words && i - end < gap; i++)
+        {
+            if (memcmp(&d[i], &e[i], sizeof(uint32_t)) != 0)
+                end = i + 1;
+        }
+
+        int r = sendSegment(address + start * sizeof(uint32_t), (const uint8_t *) &d[start], (end - start) * sizeof(uint32_t));
+        if (r != DEVICE_OK)
+            return r;
+
+        i = end;
     }
 
     return DEVICE_OK;
 }
 
+/**
+ * Determines if each write first reads back the existing contents of FLASH, and only sends the 32-bit aligned runs
+ * of data that differ. Unchanged data is then never rewritten, reducing I2C traffic and interface chip FLASH wear
+ * for metadata heavy workloads, at the cost of a read transaction per write.
+ *
+ * @param enable true to compare before each write, false to always write all data.
+ */
+void MicroBitUSBFlashManager::setCompareBeforeWrite(bool enable)
+{
+    if (enable)
+        status |= MICROBIT_USB_FLASH_COMPARE_WRITES;
+    else
+        status &= ~MICROBIT_USB_FLASH_COMPARE_WRITES;
+}
+
+/**
+ * Sends a single write transaction of no more than maxWriteLength bytes to the interface chip.
+ *
+ * @param address the location to write to. Must be 32 bit aligned.
+ * @param data a buffer containing the data to write.
+ * @param length the number of bytes to write.
+ * @return DEVICE_OK on success, or error code.
+ */
+int MicroBitUSBFlashManager::sendSegment(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    ManagedBuffer request(length + 8);
+    ManagedBuffer response;
+
+    uint32_t *ptr = (uint32_t *) &request[0];
+    *ptr++ = htonl(address | (MICROBIT_USB_FLASH_WRITE_CMD << 24));
+    *ptr++ = htonl(length);
+    memcpy(ptr, data, length);
+
+    response = transact(request, 9);
+
+    if (response.length() == 0)
+        return DEVICE_I2C_ERROR;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Sends any write held back to be combined with following writes to the interface chip.
+ * n.b. Pending writes are also sent automatically after MICROBIT_USB_FLASH_WRITE_DELAY, and before any
+ * conflicting read, erase or configuration operation.
+ *
+ * @return DEVICE_OK on success, or error code.
+ */
+int MicroBitUSBFlashManager::flush()
+{
+    if (pendingLength == 0)
+        return DEVICE_OK;
+
+    // Take a copy of the pending segment, as sending it may yield (to read back existing data, or wait for the bus),
+    // and another fiber may then start a new pending write in its place.
+    ManagedBuffer segment(pendingData, pendingLength);
+    uint32_t address = pendingAddress;
+    pendingLength = 0;
+
+    return writeSegment(address, &segment[0], segment.length());
+}
+
+/**
+ * Event handler, called when a pending write has been held for MICROBIT_USB_FLASH_WRITE_DELAY.
+ */
+void MicroBitUSBFlashManager::onFlushEvent(Event)
+{
+    if (pendingLength == 0)
+        return;
+
+    // Don't interleave with a transaction already in progress on another fiber. Try again a little later.
+    if (status & MICROBIT_USB_FLASH_AWAITING_RESPONSE)
+    {
+        system_timer_event_after(MICROBIT_USB_FLASH_WRITE_DELAY, id, MICROBIT_USB_FLASH_EVT_FLUSH);
+        return;
+    }
+
+    if (flush() != DEVICE_OK)
+        DMESG("USB_FLASH: Deferred write failed.");
+}
+
 /**
  * Writes data to the specified location in the USB file staorage area.
  * 
@@ -483,6 +704,116 @@ int MicroBitUSBFlashManager::erase(uint32_t address, uint32_t length)
     return DEVICE_OK;
 }
 
+/**
+ * Queues one or more whole pages to be erased in the background, and returns immediately.
+ * A MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE event is raised as each queued range is erased.
+ * Reads and writes to a queued range block until it has been erased. If the queue is full, this call blocks
+ * until space is available.
+ *
+ * @param address the logical address of the first page to erase. Must be page aligned.
+ * @param length the number of 32-bit words to erase. Must be a whole number of pages.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the range is invalid or not page aligned, or the error
+ *         from storing a pending write.
+ */
+int MicroBitUSBFlashManager::eraseAsync(uint32_t address, uint32_t length)
+{
+    getGeometry();
+
+    // Convert length parameter from 32-bit count to a byte count.
+    length = length * sizeof(uint32_t);
+
+    if (length == 0 || address % geometry.blockSize != 0 || length % geometry.blockSize != 0 || address + length > geometry.blockSize * geometry.blockCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Store any pending write before its range can be queued for erasure. This keeps pending data clear of every
+    // queued range, so the erase task's own flush (with its compare read) never waits on an erase it is performing.
+    int r = flush();
+    if (r != DEVICE_OK)
+        return r;
+
+    // Extend the last queued range if this one follows on from it, and it is not already in progress.
+    if (eraseQueueLength > 1)
+    {
+        MicroBitUSBFlashEraseRequest &last = eraseQueue[eraseQueueLength - 1];
+
+        if (last.address + last.length == address)
+        {
+            last.length += length;
+            return DEVICE_OK;
+        }
+    }
+
+    while (eraseQueueLength == MICROBIT_USB_FLASH_ERASE_QUEUE_SIZE)
+        fiber_wait_for_event(id, MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE);
+
+    eraseQueue[eraseQueueLength].address = address;
+    eraseQueue[eraseQueueLength].length = length;
+    eraseQueueLength++;
+
+    if (!(status & MICROBIT_USB_FLASH_ERASING))
+    {
+        status |= MICROBIT_USB_FLASH_ERASING;
+        create_fiber(MicroBitUSBFlashManager::eraseTask, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if any part of the given range is queued for erasure by eraseAsync(), and not yet erased.
+ *
+ * @param address the logical address of the start of the range.
+ * @param length the length of the range, in bytes.
+ * @return true if the range has an erase pending, false otherwise.
+ */
+bool MicroBitUSBFlashManager::isErasePending(uint32_t address, uint32_t length)
+{
+    for (int i = 0; i < eraseQueueLength; i++)
+        if (address < eraseQueue[i].address + eraseQueue[i].length && address + length > eraseQueue[i].address)
+            return true;
+
+    return false;
+}
+
+/**
+ * Blocks the calling fiber until the given range has no erase pending.
+ *
+ * @param address the logical address of the start of the range.
+ * @param length the length of the range, in bytes.
+ */
+void MicroBitUSBFlashManager::awaitErase(uint32_t address, uint32_t length)
+{
+    while (isErasePending(address, length))
+        fiber_wait_for_event(id, MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE);
+}
+
+/**
+ * Erases the ranges queued by eraseAsync(), in order.
+ * Runs in its own fiber, started by eraseAsync().
+ *
+ * @param manager the MicroBitUSBFlashManager instance to erase.
+ */
+void MicroBitUSBFlashManager::eraseTask(void *manager)
+{
+    MicroBitUSBFlashManager *m = (MicroBitUSBFlashManager *) manager;
+
+    while (m->eraseQueueLength > 0)
+    {
+        // The range remains in the queue while it is erased, so that conflicting reads and writes wait for it.
+        MicroBitUSBFlashEraseRequest r = m->eraseQueue[0];
+
+        if (m->erase(r.address, r.length / sizeof(uint32_t)) != DEVICE_OK)
+            DMESG("USB_FLASH: Background erase failed.");
+
+        m->eraseQueueLength--;
+        memmove(&m->eraseQueue[0], &m->eraseQueue[1], m->eraseQueueLength * sizeof(MicroBitUSBFlashEraseRequest));
+
+        Event(m->id, MICROBIT_USB_FLASH_EVT_ERASE_COMPLETE);
+    }
+
+    m->status &= ~MICROBIT_USB_FLASH_ERASING;
+}
+
 /**
  * Erases a given page in non-volatile memory.
  * 
@@ -554,6 +885,15 @@ MicroBitUSBFlashManager::getFlashSize()
  */
 ManagedBuffer MicroBitUSBFlashManager::transact(ManagedBuffer request, int responseLength)
 {
+    ManagedBuffer response;
+
+    // Any operation other than a read or write may depend upon the pending write, so ensure it is stored first.
+    // (reads check for overlap themselves)
+    if (request[0] != MICROBIT_USB_FLASH_READ_CMD && request[0] != MICROBIT_USB_FLASH_WRITE_CMD)
+        flush();
+
+    transactionLock.wait();
+    status |= MICROBIT_USB_FLASH_AWAITING_RESPONSE;
     power.nop();
 
     if (status & MICROBIT_USB_FLASH_USE_NULL_TRANSACTION)
@@ -563,7 +903,11 @@ ManagedBuffer MicroBitUSBFlashManager::transact(ManagedBuffer request, int respo
         _transact(nop_request, usbFlashPropertyLength.get(MICROBIT_USB_FLASH_VISIBILITY_CMD));
     }
 
-    return _transact(request, responseLength);
+    response = _transact(request, responseLength);
+    status &= ~MICROBIT_USB_FLASH_AWAITING_RESPONSE;
+    transactionLock.notify();
+
+    return response;
 }
 
 /**
@@ -574,11 +918,30 @@ ManagedBuffer MicroBitUSBFlashManager::transact(ManagedBuffer request, int respo
  */
 ManagedBuffer MicroBitUSBFlashManager::_transact(ManagedBuffer request, int responseLength)
 {
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_USB_FLASH_TRANSACT, request.length());
+
     int tx_attempts = 0;
     int rx_attempts = 0;
 
     ManagedBuffer b(max(responseLength, 3));
 
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+    int polls = 0;
+    int busyResponses = 0;
+    MicroBitInterfaceStats &s = stats[request[0] < MICROBIT_USB_FLASH_STATS_SIZE ? request[0] : 0];
+#endif
+
+    // Wake as soon as the interface chip signals a response, rather than waiting for the next scheduler tick.
+    // n.b. the IRQ line is shared with the motion sensors, so edge events are only requested for the duration of the transaction.
+    if (!(status & MICROBIT_USB_FLASH_IRQ_LISTENER) && EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->listen(io.irq1.id, DEVICE_PIN_EVT_FALL, this, &MicroBitUSBFlashManager::onIrq, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        status |= MICROBIT_USB_FLASH_IRQ_LISTENER;
+    }
+
+    power.enableIrqEvents(true);
+
     while(tx_attempts < MICROBIT_USB_FLASH_MAX_TX_RETRIES)
     {
         rx_attempts = 0;
@@ -586,7 +949,12 @@ ManagedBuffer MicroBitUSBFlashManager::_transact(ManagedBuffer request, int resp
 
         power.awaitingPacket(true);
 
-        if (i2cBus.write(MICROBIT_USB_FLASH_I2C_ADDRESS, &request[0], request.length(), false) != DEVICE_OK)
+        // Hold the bus for one transfer at a time, so that higher priority clients can get in between.
+        i2cBus.acquire(MICROBIT_I2C_PRIORITY_BULK);
+        int w = i2cBus.write(MICROBIT_USB_FLASH_I2C_ADDRESS, &request[0], request.length(), false);
+        i2cBus.release();
+
+        if (w != DEVICE_OK)
         {
             DMESG("TRANSACT: [I2C WRITE ERROR]");
             fiber_sleep(1);
@@ -597,24 +965,33 @@ ManagedBuffer MicroBitUSBFlashManager::_transact(ManagedBuffer request, int resp
         // (DAPLink workaround)
         if (request[0] == MICROBIT_USB_FLASH_ERASE_CMD)
             fiber_sleep(status & MICROBIT_USB_FLASH_100MS_AFTER_ERASE ? 100 : 20);
-        else
-            fiber_sleep(1);
+        else if (!io.irq1.isActive())
+            awaitIrq();
 
         while(rx_attempts < MICROBIT_USB_FLASH_MAX_RX_RETRIES)
         {
             rx_attempts++;
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+            polls++;
+#endif
 
             if(io.irq1.isActive())
             {
                 b.fill(0);
+                i2cBus.acquire(MICROBIT_I2C_PRIORITY_BULK);
                 int r = i2cBus.read(MICROBIT_USB_FLASH_I2C_ADDRESS, &b[0], b.length(), false);
+                i2cBus.release();
 
                 if (r == MICROBIT_OK)
                 {
                     if (b[0] == request[0])
                     {
                         // We have a valid response. Consume it, and we're done.
+                        power.enableIrqEvents(false);
                         power.awaitingPacket(false);
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+                        microbit_interface_stats_record(s, start, polls - 1, busyResponses, true);
+#endif
                         b.truncate(responseLength);
                         return b;
                     }
@@ -626,7 +1003,12 @@ ManagedBuffer MicroBitUSBFlashManager::_transact(ManagedBuffer request, int resp
                         bool busy = (status & MICROBIT_USB_FLASH_BUSY_FLAG_SUPPORTED) ? b[0] == 0x20 && b[1] == 0x39 : b[0] == 0x00 || (b[0] == 0x20 && (b[1] == request[0] || b[1] == 0x00));
 
                         if (busy)
+                        {
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+                            busyResponses++;
+#endif
                             rx_attempts = 0;
+                        }
                         else
                             break;
                     }
@@ -638,15 +1020,39 @@ ManagedBuffer MicroBitUSBFlashManager::_transact(ManagedBuffer request, int resp
                 }
             }
 
-            fiber_sleep(1);
+            awaitIrq();
         }
     }
 
     DMESG("USB_FLASH: Transaction Failed.");
+    power.enableIrqEvents(false);
     power.awaitingPacket(false);
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    microbit_interface_stats_record(s, start, polls - 1, busyResponses, false);
+#endif
     return ManagedBuffer();
 }
 
+/**
+ * Blocks the calling fiber until the IRQ line is asserted, or MICROBIT_USB_FLASH_POLL_PERIOD has elapsed.
+ * The timeout covers edges missed before the fiber started waiting, and the line being held by another device.
+ * It is cancelled on return, so a wake by the IRQ leaves no stale timeout to fire later.
+ */
+void MicroBitUSBFlashManager::awaitIrq()
+{
+    system_timer_event_after(MICROBIT_USB_FLASH_POLL_PERIOD, id, MICROBIT_USB_FLASH_EVT_IRQ);
+    fiber_wait_for_event(id, MICROBIT_USB_FLASH_EVT_IRQ);
+    system_timer_cancel_event(id, MICROBIT_USB_FLASH_EVT_IRQ);
+}
+
+/**
+ * Event handler, called when the IRQ line falls during a transaction.
+ */
+void MicroBitUSBFlashManager::onIrq(Event)
+{
+    Event(id, MICROBIT_USB_FLASH_EVT_IRQ);
+}
+
 /**
  * Performs a flash storage transaction with the interface chip.
  * @param command Identifier of a command to issue (one byte write operation).
@@ -661,6 +1067,47 @@ ManagedBuffer MicroBitUSBFlashManager::transact(int command)
     return transact(request, usbFlashPropertyLength.get(command));
 }
 
+/**
+ * Retrieves statistics on transactions with the USB interface chip's flash interface for a given command.
+ * Statistics are only collected if CONFIG_MICROBIT_INTERFACE_STATS is enabled.
+ *
+ * @param command the command to query (one of MICROBIT_USB_FLASH_*_CMD).
+ * @return the statistics for the given command, or NULL if statistics are disabled or the command is invalid.
+ */
+const MicroBitInterfaceStats *MicroBitUSBFlashManager::getStats(int command)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    if (command >= 0 && command < MICROBIT_USB_FLASH_STATS_SIZE)
+        return &stats[command];
+#endif
+
+    return NULL;
+}
+
+/**
+ * Reset all transaction statistics to zero.
+ */
+void MicroBitUSBFlashManager::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    memset(stats, 0, sizeof(stats));
+#endif
+}
+
+/**
+ * Print the statistics for each command with recorded transactions to the given serial port.
+ *
+ * @param serial the serial port to print to.
+ */
+void MicroBitUSBFlashManager::printStats(Serial &serial)
+{
+#if CONFIG_ENABLED(CONFIG_MICROBIT_INTERFACE_STATS)
+    microbit_interface_stats_print(serial, "USB_FLASH", stats, MICROBIT_USB_FLASH_STATS_SIZE);
+#else
+    serial.printf("USB_FLASH: statistics disabled\r\n");
+#endif
+}
+
 /**
  * Destructor.
  */
@@ -23,6 +23,8 @@ SOFTWARE.
 */
 
 #include "MicroSynth.h"
+#include "AudioKernels.h"
+#include "AudioStats.h"
 
 #if CONFIG_ENABLED(CODAL_POLYSYNTH)
 
@@ -31,8 +33,69 @@ SOFTWARE.
 
 using namespace codal;
 
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+// Fixed point layout. Samples carry SynthSampleBits fractional bits, envelopes SynthEnvBits, and filter
+// coefficients SynthCoefBits, leaving enough headroom for the largest filter gain.
+static constexpr int SynthEnvBits = 30;
+static constexpr int SynthCoefBits = 27;
+
+static inline int32_t synthToFixed(float v, int bits)
+{
+    return static_cast<int32_t>(v*static_cast<float>(1u << bits));
+}
+
+static inline float synthToFloat(int32_t v, int bits)
+{
+    return static_cast<float>(v)/static_cast<float>(1u << bits);
+}
+
+// converts a phase or phase increment in the range -1 to 1 to Q31, wrapping 1 around to -1
+static inline uint32_t synthToPhase(float v)
+{
+    return static_cast<uint32_t>(static_cast<int64_t>(v*2147483648.f));
+}
+
+static inline int32_t synthMul(int32_t a, int32_t b, int bits)
+{
+    return static_cast<int32_t>((static_cast<int64_t>(a)*b) >> bits);
+}
+
+// interpolated wavetable read, at a Q32 phase in the range 0 to 1
+static inline int32_t synthTableRead(const int16_t* t, uint32_t phase)
+{
+    const uint32_t i = phase >> (32 - SynthWaveTableBits);
+    const int32_t frac = (phase >> (16 - SynthWaveTableBits)) & 0xFFFF;
+    const int32_t a = t[i], b = t[i + 1];
+    return (a + (((b - a)*frac) >> 16)) << (SynthSampleBits - SynthWaveBits);
+}
+
+// band limited pulse at Q31 phase acc, as the difference of two sawtooths offset by (1 - pw)/2 of a cycle
+static inline int32_t synthPulseRead(const int16_t* t, uint32_t acc, uint32_t offset)
+{
+    const uint32_t phase = acc + 0x80000000u;
+    return synthTableRead(t, phase) - synthTableRead(t, phase + offset);
+}
+#endif
+
+// interpolated wavetable read, at phase x in the range -1 to 1 (or beyond 1, which wraps)
+static inline float synthTableRead(const int16_t* t, float x)
+{
+    const float pos = (x + 1.f)*(0.5f*SynthWaveTableSize);
+    const int ind = static_cast<int>(pos);
+    const float frac = pos - ind;
+    const int i = ind & (SynthWaveTableSize - 1);
+    return (t[i] + frac*(t[i + 1] - t[i]))*(1.f/(1 << SynthWaveBits));
+}
+
+// band limited pulse, as the difference of two sawtooths offset by (1 - pw)/2 of a cycle
+static inline float synthPulseRead(const int16_t* t, float x, float pw)
+{
+    return synthTableRead(t, x) - synthTableRead(t, x + 1.f - pw);
+}
+
 bool SynthTables::inited_ = false;
 float SynthTables::notetab_[129];
+int16_t SynthTables::sawtab_[SynthWaveTables][SynthWaveTableSize + 1];
 
 void SynthTables::init()
 {
@@ -41,9 +104,44 @@ void SynthTables::init()
     for (int i = 0; i < 128; ++i)
         notetab_[i] = powf(2.f, (i - 69)/12.f);
     notetab_[128] = notetab_[127];
+
+    // sawtooth wavetables by additive synthesis, saw(t) = -2/pi * sum(sin(2 pi n t)/n). each table holds the
+    // harmonics that stay below nyquist at the top of its octave, so the tables nest: add harmonics one at a time,
+    // and take a copy as each table's limit is reached (highest octave first).
+    float* sine = new float[SynthWaveTableSize];
+    float* acc = new float[SynthWaveTableSize];
+    for (int j = 0; j < SynthWaveTableSize; ++j) {
+        sine[j] = sinf(2.f*_PI*j/SynthWaveTableSize);
+        acc[j] = 0.f;
+    }
+    int table = SynthWaveTables - 1;
+    for (int n = 1; table >= 0; ++n) {
+        for (int j = 0; j < SynthWaveTableSize; ++j)
+            acc[j] += sine[(n*j) & (SynthWaveTableSize - 1)]/n;
+        while (table >= 0) {
+            const int harmonics = static_cast<int>(SynthSampleRate_f*0.5f/(SynthWaveBase*(2 << table)));
+            if (n < harmonics && n < SynthWaveTableSize/2 - 1) break;
+            for (int j = 0; j < SynthWaveTableSize; ++j)
+                sawtab_[table][j] = static_cast<int16_t>(-2.f/_PI*acc[j]*(1 << SynthWaveBits));
+            sawtab_[table][SynthWaveTableSize] = sawtab_[table][0];
+            --table;
+        }
+    }
+    delete[] sine;
+    delete[] acc;
+
     inited_ = true;
 }
 
+const int16_t* SynthTables::sawTable(float delta)
+{
+    // delta is two per cycle, so this is the frequency in units of SynthWaveBase
+    const float f = fabsf(delta)*(SynthSampleRate_f*0.5f/SynthWaveBase);
+    int table = 0;
+    while (table < SynthWaveTables - 1 && f > static_cast<float>(2 << table)) ++table;
+    return sawtab_[table];
+}
+
 inline float SynthTables::noteToScaler(float ind)
 {
     const int i = min(max(static_cast<int>(ind), 0), 127);
@@ -100,6 +198,98 @@ inline float StateVariableFilter::process(float x, FilterType f)
     }
 }
 
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+void StateVariableFilter::process(SynthSample* buf, int num, FilterType f)
+{
+    // as the floating point version, with coefficients in SynthCoefBits and state in SynthSampleBits fixed point
+    const int32_t g = synthToFixed(g_, SynthCoefBits), g1 = synthToFixed(g1_, SynthCoefBits), d = synthToFixed(d_, SynthCoefBits);
+    int32_t s1 = synthToFixed(s1_, SynthSampleBits), s2 = synthToFixed(s2_, SynthSampleBits);
+    switch (f) {
+    case FilterType::LPF:
+    default:
+        for (int i = 0; i < num; ++i) {
+            const int32_t hp = synthMul(buf[i] - synthMul(g1, s1, SynthCoefBits) - s2, d, SynthCoefBits);
+            const int32_t v1 = synthMul(g, hp, SynthCoefBits);
+            const int32_t bp = v1 + s1;
+            s1 = bp + v1;
+            const int32_t v2 = synthMul(g, bp, SynthCoefBits);
+            const int32_t lp = v2 + s2;
+            s2 = lp + v2;
+            buf[i] = lp;
+        }
+        break;
+    case FilterType::BPF:
+        for (int i = 0; i < num; ++i) {
+            const int32_t hp = synthMul(buf[i] - synthMul(g1, s1, SynthCoefBits) - s2, d, SynthCoefBits);
+            const int32_t v1 = synthMul(g, hp, SynthCoefBits);
+            const int32_t bp = v1 + s1;
+            s1 = bp + v1;
+            const int32_t v2 = synthMul(g, bp, SynthCoefBits);
+            s2 = v2 + s2 + v2;
+            buf[i] = bp;
+        }
+        break;
+    case FilterType::HPF:
+        for (int i = 0; i < num; ++i) {
+            const int32_t hp = synthMul(buf[i] - synthMul(g1, s1, SynthCoefBits) - s2, d, SynthCoefBits);
+            const int32_t v1 = synthMul(g, hp, SynthCoefBits);
+            const int32_t bp = v1 + s1;
+            s1 = bp + v1;
+            const int32_t v2 = synthMul(g, bp, SynthCoefBits);
+            s2 = v2 + s2 + v2;
+            buf[i] = hp;
+        }
+        break;
+    }
+    s1_ = synthToFloat(s1, SynthSampleBits); s2_ = synthToFloat(s2, SynthSampleBits);
+}
+#else
+void StateVariableFilter::process(SynthSample* buf, int num, FilterType f)
+{
+    // one loop per filter type, keeping the state in registers throughout
+    const float g = g_, g1 = g1_, d = d_;
+    float s1 = s1_, s2 = s2_;
+    switch (f) {
+    case FilterType::LPF:
+    default:
+        for (int i = 0; i < num; ++i) {
+            const float hp = (buf[i] - g1*s1 - s2)*d;
+            const float v1 = g*hp;
+            const float bp = v1 + s1;
+            s1 = bp + v1;
+            const float v2 = g*bp;
+            const float lp = v2 + s2;
+            s2 = lp + v2;
+            buf[i] = lp;
+        }
+        break;
+    case FilterType::BPF:
+        for (int i = 0; i < num; ++i) {
+            const float hp = (buf[i] - g1*s1 - s2)*d;
+            const float v1 = g*hp;
+            const float bp = v1 + s1;
+            s1 = bp + v1;
+            const float v2 = g*bp;
+            s2 = v2 + s2 + v2;
+            buf[i] = bp;
+        }
+        break;
+    case FilterType::HPF:
+        for (int i = 0; i < num; ++i) {
+            const float hp = (buf[i] - g1*s1 - s2)*d;
+            const float v1 = g*hp;
+            const float bp = v1 + s1;
+            s1 = bp + v1;
+            const float v2 = g*bp;
+            s2 = v2 + s2 + v2;
+            buf[i] = hp;
+        }
+        break;
+    }
+    s1_ = s1; s2_ = s2;
+}
+#endif
+
 void StateVariableFilter::reset()
 {
     s1_ = s2_ = 0.f;
@@ -127,6 +317,80 @@ inline float ADSREnv::process()
     return cur_;
 }
 
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+void ADSREnv::process(SynthSample* buf, int num)
+{
+    int i = 0;
+    while (i < num) {
+        if (state_ == State::Done) {
+            memset(&buf[i], 0, (num - i)*sizeof(SynthSample));
+            return;
+        }
+        if (phase_ >= 1.f) {
+            phase_ = 0.f;
+            int next_state = static_cast<int>(state_) + 1;
+            state_ = static_cast<State>(next_state);
+            if (state_ == State::Done) {
+                cur_ = 0.f;
+                continue;
+            }
+            start_val_ = levels_[next_state];
+            phase_inc_ = inc_[next_state];
+        }
+        // each segment runs in SynthEnvBits fixed point, with the state written back at its end
+        const int32_t start = synthToFixed(start_val_, SynthEnvBits);
+        const int32_t range = synthToFixed(levels_[static_cast<int>(state_) + 1] - start_val_, SynthEnvBits);
+        const int32_t inc = synthToFixed(phase_inc_, SynthEnvBits);
+        int32_t phase = synthToFixed(phase_, SynthEnvBits);
+        int32_t cur = synthToFixed(cur_, SynthEnvBits);
+        while (i < num) {
+            phase += inc;
+            cur = start + synthMul(range, phase, SynthEnvBits);
+            buf[i++] = cur >> (SynthEnvBits - SynthSampleBits);
+            if (phase >= (1 << SynthEnvBits)) break;
+        }
+        phase_ = synthToFloat(phase, SynthEnvBits);
+        cur_ = synthToFloat(cur, SynthEnvBits);
+    }
+}
+#else
+void ADSREnv::process(SynthSample* buf, int num)
+{
+    int i = 0;
+    while (i < num) {
+        if (state_ == State::Done) {
+            memset(&buf[i], 0, (num - i)*sizeof(float));
+            return;
+        }
+        if (phase_ >= 1.f) {
+            phase_ = 0.f;
+            int next_state = static_cast<int>(state_) + 1;
+            state_ = static_cast<State>(next_state);
+            if (state_ == State::Done) {
+                cur_ = 0.f;
+                continue;
+            }
+            start_val_ = levels_[next_state];
+            phase_inc_ = inc_[next_state];
+        }
+        // within a segment the envelope is a straight line, so run to its end (or the end of the block)
+        const float start = start_val_;
+        const float range = levels_[static_cast<int>(state_) + 1] - start;
+        const float inc = phase_inc_;
+        float phase = phase_;
+        float cur = cur_;
+        while (i < num) {
+            phase += inc;
+            cur = start + range*phase;
+            buf[i++] = cur;
+            if (phase >= 1.f) break;
+        }
+        phase_ = phase;
+        cur_ = cur;
+    }
+}
+#endif
+
 inline void ADSREnv::gate(bool g)
 {
     start_val_ = cur_;
@@ -175,6 +439,10 @@ inline float Oscillator::process()
         return out;
     case OscType::Pulse:
         return (out > pw_ ? 1.f : -1.f) + pw_;  // remove dc offset
+    case OscType::BLSaw:
+        return synthTableRead(table_, out);
+    case OscType::BLPulse:
+        return synthPulseRead(table_, out, pw_);
     case OscType::Triangle:
     default:
         return fabsf(out)*2.f - 1.f;
@@ -193,15 +461,211 @@ inline float Oscillator::processPM(float pm)
         return out;
     case OscType::Pulse:
         return (out > pw_ ? 1.f : -1.f) + pw_;
+    case OscType::BLSaw:
+        return synthTableRead(table_, out);
+    case OscType::BLPulse:
+        return synthPulseRead(table_, out, pw_);
     case OscType::Triangle:
     default:
         return fabsf(out)*2.f - 1.f;
     }
 }
 
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+void Oscillator::process(SynthSample* buf, int num)
+{
+    // the phase is held in Q31, so that it wraps from 1 to -1 by integer overflow
+    uint32_t acc = synthToPhase(acc_);
+    const uint32_t delta = synthToPhase(delta_);
+    const int32_t pw = synthToFixed(pw_, SynthSampleBits);
+    switch (wave_) {
+    case OscType::Saw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = static_cast<int32_t>(acc) >> (31 - SynthSampleBits);
+            acc += delta;
+        }
+        break;
+    case OscType::Pulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = ((static_cast<int32_t>(acc) >> (31 - SynthSampleBits)) > pw ? (1 << SynthSampleBits) : -(1 << SynthSampleBits)) + pw;
+            acc += delta;
+        }
+        break;
+    case OscType::BLSaw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthTableRead(table_, acc + 0x80000000u);
+            acc += delta;
+        }
+        break;
+    case OscType::BLPulse: {
+        const uint32_t offset = synthToPhase(1.f - pw_);
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthPulseRead(table_, acc, offset);
+            acc += delta;
+        }
+        break;
+    }
+    case OscType::Triangle:
+    default:
+        for (int i = 0; i < num; ++i) {
+            const int32_t a = static_cast<int32_t>(acc);
+            buf[i] = ((a ^ (a >> 31)) >> (30 - SynthSampleBits)) - (1 << SynthSampleBits);
+            acc += delta;
+        }
+        break;
+    }
+    acc_ = synthToFloat(static_cast<int32_t>(acc), 31);
+}
+#else
+void Oscillator::process(SynthSample* buf, int num)
+{
+    // one loop per waveform, with the phase kept in a register throughout
+    float acc = acc_;
+    const float delta = delta_, pw = pw_;
+    switch (wave_) {
+    case OscType::Saw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = acc;
+            acc += delta;
+            if (acc > 1.f) acc -= 2.f;
+        }
+        break;
+    case OscType::Pulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = (acc > pw ? 1.f : -1.f) + pw;
+            acc += delta;
+            if (acc > 1.f) acc -= 2.f;
+        }
+        break;
+    case OscType::BLSaw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthTableRead(table_, acc);
+            acc += delta;
+            if (acc > 1.f) acc -= 2.f;
+        }
+        break;
+    case OscType::BLPulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthPulseRead(table_, acc, pw);
+            acc += delta;
+            if (acc > 1.f) acc -= 2.f;
+        }
+        break;
+    case OscType::Triangle:
+    default:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = fabsf(acc)*2.f - 1.f;
+            acc += delta;
+            if (acc > 1.f) acc -= 2.f;
+        }
+        break;
+    }
+    acc_ = acc;
+}
+#endif
+
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+void Oscillator::processPM(SynthSample* buf, const SynthSample* pm, float amount, int num)
+{
+    // modulation of any depth wraps with the phase, so unlike the floating point version needs no range checks
+    uint32_t acc = synthToPhase(acc_);
+    const uint32_t delta = synthToPhase(delta_);
+    const int32_t pw = synthToFixed(pw_, SynthSampleBits);
+    const int32_t depth = synthToFixed(amount, 31 - SynthSampleBits);
+    switch (wave_) {
+    case OscType::Saw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = static_cast<int32_t>(acc) >> (31 - SynthSampleBits);
+            acc += delta + static_cast<uint32_t>(static_cast<int64_t>(depth)*pm[i]);
+        }
+        break;
+    case OscType::Pulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = ((static_cast<int32_t>(acc) >> (31 - SynthSampleBits)) > pw ? (1 << SynthSampleBits) : -(1 << SynthSampleBits)) + pw;
+            acc += delta + static_cast<uint32_t>(static_cast<int64_t>(depth)*pm[i]);
+        }
+        break;
+    case OscType::BLSaw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthTableRead(table_, acc + 0x80000000u);
+            acc += delta + static_cast<uint32_t>(static_cast<int64_t>(depth)*pm[i]);
+        }
+        break;
+    case OscType::BLPulse: {
+        const uint32_t offset = synthToPhase(1.f - pw_);
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthPulseRead(table_, acc, offset);
+            acc += delta + static_cast<uint32_t>(static_cast<int64_t>(depth)*pm[i]);
+        }
+        break;
+    }
+    case OscType::Triangle:
+    default:
+        for (int i = 0; i < num; ++i) {
+            const int32_t a = static_cast<int32_t>(acc);
+            buf[i] = ((a ^ (a >> 31)) >> (30 - SynthSampleBits)) - (1 << SynthSampleBits);
+            acc += delta + static_cast<uint32_t>(static_cast<int64_t>(depth)*pm[i]);
+        }
+        break;
+    }
+    acc_ = synthToFloat(static_cast<int32_t>(acc), 31);
+}
+#else
+void Oscillator::processPM(SynthSample* buf, const SynthSample* pm, float amount, int num)
+{
+    float acc = acc_;
+    const float delta = delta_, pw = pw_;
+    switch (wave_) {
+    case OscType::Saw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = acc;
+            acc += delta + amount*pm[i];
+            if (acc > 1.f) acc -= 2.f;
+            else if (acc < -1.f) acc += 2.f;
+        }
+        break;
+    case OscType::Pulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = (acc > pw ? 1.f : -1.f) + pw;
+            acc += delta + amount*pm[i];
+            if (acc > 1.f) acc -= 2.f;
+            else if (acc < -1.f) acc += 2.f;
+        }
+        break;
+    case OscType::BLSaw:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthTableRead(table_, acc);
+            acc += delta + amount*pm[i];
+            if (acc > 1.f) acc -= 2.f;
+            else if (acc < -1.f) acc += 2.f;
+        }
+        break;
+    case OscType::BLPulse:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = synthPulseRead(table_, acc, pw);
+            acc += delta + amount*pm[i];
+            if (acc > 1.f) acc -= 2.f;
+            else if (acc < -1.f) acc += 2.f;
+        }
+        break;
+    case OscType::Triangle:
+    default:
+        for (int i = 0; i < num; ++i) {
+            buf[i] = fabsf(acc)*2.f - 1.f;
+            acc += delta + amount*pm[i];
+            if (acc > 1.f) acc -= 2.f;
+            else if (acc < -1.f) acc += 2.f;
+        }
+        break;
+    }
+    acc_ = acc;
+}
+#endif
+
 inline void Oscillator::setFreq(float f)
 {
     delta_ = 2.f*f/SynthSampleRate_f;
+    table_ = SynthTables::sawTable(delta_);
 }
 
 void Oscillator::setType(OscType t)
@@ -239,24 +703,96 @@ Voice::Voice()
     vibLfo_.setType(OscType::Triangle);
 }
 
-inline float Voice::process()
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+void Voice::process_stage(SynthSample* buf, int num)
 {
-    const float env = env_.process();
-    const float osc1 = osc_[0].process();
-    const float gate = stopping_ ? 0.f : 1.f;
+    SynthSample oscs[SynthStageSize];
+    SynthSample amp[SynthStageSize];
+    const SynthPreset& p = *preset_;
 
-    smoothedGate_ += (gate - smoothedGate_)*0.005f;
-    const float amp_env = preset_->ampGate ? smoothedGate_ : env;
-    auto oscs = osc1*preset_->osc1Vol + osc_[1].processPM(preset_->fmAmount*osc1)*preset_->osc2Vol;
-    noise_ = 1664525*noise_ + 1013904223;
-    const float noise = preset_->noise*noise_*1.f/std::numeric_limits<int32_t>::max();
-    auto out = gain_*amp_env*filter_.process(oscs + noise, preset_->filterType);
-    return out;
+    // oscillators, with osc1 phase modulating osc2
+    osc_[0].process(oscs, num);
+    osc_[1].processPM(amp, oscs, p.fmAmount, num);
+    const int32_t vol1 = synthToFixed(p.osc1Vol, SynthSampleBits), vol2 = synthToFixed(p.osc2Vol, SynthSampleBits);
+    for (int i = 0; i < num; ++i)
+        oscs[i] = synthMul(oscs[i], vol1, SynthSampleBits) + synthMul(amp[i], vol2, SynthSampleBits);
+
+    if (p.noise != 0.f) {
+        const int32_t noise_scale = synthToFixed(p.noise, SynthSampleBits);
+        uint32_t noise = static_cast<uint32_t>(noise_);
+        for (int i = 0; i < num; ++i) {
+            noise = 1664525u*noise + 1013904223u;
+            oscs[i] += synthMul(static_cast<int32_t>(noise), noise_scale, 31);
+        }
+        noise_ = static_cast<int32_t>(noise);
+    }
+
+    filter_.process(oscs, num, p.filterType);
+
+    // amplitude envelope. the adsr envelope always runs, as it also modulates the filter and ends the voice
+    env_.process(amp, num);
+    if (p.ampGate) {
+        const int32_t gate = stopping_ ? 0 : (1 << SynthEnvBits);
+        const int32_t rate = synthToFixed(0.005f, SynthEnvBits);
+        int32_t smoothed = synthToFixed(smoothedGate_, SynthEnvBits);
+        for (int i = 0; i < num; ++i) {
+            smoothed += synthMul(gate - smoothed, rate, SynthEnvBits);
+            amp[i] = smoothed >> (SynthEnvBits - SynthSampleBits);
+        }
+        smoothedGate_ = synthToFloat(smoothed, SynthEnvBits);
+    }
+
+    const int32_t gain = synthToFixed(gain_, SynthSampleBits);
+    for (int i = 0; i < num; ++i)
+        buf[i] += synthMul(synthMul(amp[i], gain, SynthSampleBits), oscs[i], SynthSampleBits);
+}
+#else
+void Voice::process_stage(SynthSample* buf, int num)
+{
+    float oscs[SynthStageSize];
+    float amp[SynthStageSize];
+    const SynthPreset& p = *preset_;
+
+    // oscillators, with osc1 phase modulating osc2
+    osc_[0].process(oscs, num);
+    osc_[1].processPM(amp, oscs, p.fmAmount, num);
+    for (int i = 0; i < num; ++i)
+        oscs[i] = oscs[i]*p.osc1Vol + amp[i]*p.osc2Vol;
+
+    if (p.noise != 0.f) {
+        const float noise_scale = p.noise*1.f/std::numeric_limits<int32_t>::max();
+        int32_t noise = noise_;
+        for (int i = 0; i < num; ++i) {
+            noise = 1664525*noise + 1013904223;
+            oscs[i] += noise_scale*noise;
+        }
+        noise_ = noise;
+    }
+
+    filter_.process(oscs, num, p.filterType);
+
+    // amplitude envelope. the adsr envelope always runs, as it also modulates the filter and ends the voice
+    env_.process(amp, num);
+    if (p.ampGate) {
+        const float gate = stopping_ ? 0.f : 1.f;
+        float smoothed = smoothedGate_;
+        for (int i = 0; i < num; ++i) {
+            smoothed += (gate - smoothed)*0.005f;
+            amp[i] = smoothed;
+        }
+        smoothedGate_ = smoothed;
+    }
+
+    const float gain = gain_;
+    for (int i = 0; i < num; ++i)
+        buf[i] += gain*amp[i]*oscs[i];
 }
+#endif
 
-void Voice::process(float* buf, int num)
+void Voice::process(SynthSample* buf, int num)
 {
     if (preset_ == nullptr) return;
+    age_ += num;
     const float lfo = lfo_.process();
     vibLfo_.setFreq(preset_->vibFreq*SynthBlockSize);
     const float vib = vibLfo_.process()*preset_->vibAmount;
@@ -269,8 +805,8 @@ void Voice::process(float* buf, int num)
     filter_.set(filt_freq, preset_->filterReso);
     osc_[0].setPW(preset_->osc1Pw + preset_->osc1Pwm*lfo);
     osc_[1].setPW(preset_->osc2Pw + preset_->osc2Pwm*lfo);
-    for (int i = 0; i < num; ++i) {
-        buf[i] += process();
+    for (int i = 0; i < num; i += SynthStageSize) {
+        process_stage(&buf[i], min(num - i, SynthStageSize));
     }
     // check if it's time to move amp envelope to release
     if (gateLength_ >= 0) gateLength_ -= min(gateLength_, SynthBlockSize);
@@ -285,6 +821,7 @@ void Voice::trig(int8_t note, float velocity, const SynthPreset* preset, int len
     stopping_ = false;
     note_ = note;
     gateLength_ = length;
+    age_ = 0;
     smoothedGate_ = 0.f;
     apply_preset();
     gain_ = preset_->gain*velocity;
@@ -308,6 +845,22 @@ bool Voice::isStopping() const
     return stopping_;
 }
 
+float Voice::getLevel() const
+{
+    if (preset_ == nullptr) return 0.f;
+    return gain_*(preset_->ampGate ? smoothedGate_ : env_.value());
+}
+
+uint32_t Voice::getAge() const
+{
+    return age_;
+}
+
+void Voice::kill()
+{
+    note_ = -1;
+}
+
 int PolySynth::findVoice(int8_t note)
 {
     for (int i = 0; i < numVoices_; ++i) {
@@ -316,17 +869,51 @@ int PolySynth::findVoice(int8_t note)
     return -1;
 }
 
-Voice& PolySynth::alloc(int /*note*/)
+int PolySynth::findVictim()
 {
-    // find first free note
+    // prefer voices already releasing, then the quietest, then the oldest
+    int victim = -1;
     for (int i = 0; i < numVoices_; ++i) {
-        if (voice_[i].getNote() == -1) return voice_[i];
+        const Voice& v = voice_[i];
+        if (v.getNote() == -1) continue;
+        if (victim == -1) { victim = i; continue; }
+        const Voice& w = voice_[victim];
+        if (v.isStopping() != w.isStopping()) {
+            if (v.isStopping()) victim = i;
+        }
+        else if (v.getLevel() != w.getLevel()) {
+            if (v.getLevel() < w.getLevel()) victim = i;
+        }
+        else if (v.getAge() > w.getAge()) {
+            victim = i;
+        }
     }
-    // or else we steal the first voice. should probably do something better...
-    return voice_[0];
+    return victim;
 }
 
-PolySynth::PolySynth(int num_voices) : numVoices_(num_voices)
+int PolySynth::activeVoices() const
+{
+    int active = 0;
+    for (int i = 0; i < numVoices_; ++i) {
+        if (voice_[i].getNote() != -1) ++active;
+    }
+    return active;
+}
+
+Voice& PolySynth::alloc(int /*note*/)
+{
+    // find first free note, unless the cpu budget means we're already playing as many as we can afford
+    if (activeVoices() < maxVoices_) {
+        for (int i = 0; i < numVoices_; ++i) {
+            if (voice_[i].getNote() == -1) return voice_[i];
+        }
+    }
+    // or else we steal a voice
+    const int victim = findVictim();
+    return voice_[victim == -1 ? 0 : victim];
+}
+
+PolySynth::PolySynth(int num_voices) : numVoices_(num_voices), maxVoices_(num_voices), voiceCycles_(0.f)
 {
     voice_ = new Voice[numVoices_];
     SynthTables::init();
@@ -350,23 +937,52 @@ void PolySynth::noteOff(int8_t note)
     if (ind != -1) voice_[ind].detrig();
 }
 
-void PolySynth::process_noclip(float* buf, int num)
+void PolySynth::process_noclip(SynthSample* buf, int num)
 {
     // clear mixing buffer
-    memset(buf, 0, num*sizeof(float));
+    memset(buf, 0, num*sizeof(SynthSample));
 
+    const uint32_t start = audio_stats_begin();
+    int active = 0;
     for (int i = 0; i < numVoices_; ++i) {
         Voice& v = voice_[i];
         if (v.getNote() == -1) continue;
         v.process(buf, num);
+        ++active;
+    }
+    if (active == 0 || num == 0) return;
+
+    // track the cost of a voice, and from that how many we can afford within our share of the block period
+    const float cycles = static_cast<float>(audio_stats_begin() - start)/(active*num);
+    voiceCycles_ += (cycles - voiceCycles_)*(voiceCycles_ == 0.f ? 1.f : 0.125f);
+    const float budget = static_cast<float>(SystemCoreClock)/SynthSampleRate_f*CONFIG_POLYSYNTH_CPU_BUDGET/100.f;
+    if (voiceCycles_ > 0.f) {
+        const float affordable = budget/voiceCycles_;
+        maxVoices_ = affordable < numVoices_ ? max(static_cast<int>(affordable), 1) : numVoices_;
+    }
+
+    // shed voices until we're back within budget for the next block
+    while (activeVoices() > maxVoices_) {
+        voice_[findVictim()].kill();
     }
 }
 
+int PolySynth::getVoiceLimit() const
+{
+    return maxVoices_;
+}
+
 void PolySynth::process(float* buf, int num)
 {
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+    process_noclip(mixbuf_, num);
+    for (int i = 0; i < num; ++i) {
+        float out = synthToFloat(mixbuf_[i], SynthSampleBits);
+#else
     process_noclip(buf, num);
     for (int i = 0; i < num; ++i) {
         float out = buf[i];
+#endif
         if (out > 1.f) out = 1.f;
         else if (out < -1.f) out = -1.f;
         buf[i] = out;
@@ -376,16 +992,18 @@ void PolySynth::process(float* buf, int num)
 void PolySynth::process(uint16_t* buf, int num)
 {
     process_noclip(mixbuf_, num);
-    for (int i = 0; i < num; ++i) {
-        // convert to 10 bits
-        const float out = mixbuf_[i]*511.f + 512.f;
-        // add dither and noise shaping here if we ever want that
-        buf[i] = static_cast<uint16_t>(max(min(static_cast<int>(out), 1023), 0));
-    }
+    // convert to 10 bits
+    // add dither and noise shaping here if we ever want that
+#if CONFIG_ENABLED(CONFIG_POLYSYNTH_FIXED_POINT)
+    audio_pack_u16(buf, mixbuf_, num, 511, SynthSampleBits, 512, 0, 1023, 0);
+#else
+    audio_pack_float_u16(buf, mixbuf_, num, 511.f, 512.f, 0, 1023, 0);
+#endif
 }
 
 PolySynthSource::PolySynthSource(PolySynth& s) : synth_(s)
 {
+    resetStats();
 }
 
 void PolySynthSource::start()
@@ -408,11 +1026,29 @@ int PolySynthSource::getFormat()
 
 ManagedBuffer PolySynthSource::pull()
 {
+    AUDIO_STATS_SCOPE(stats_);
     ManagedBuffer buf(512);
     uint16_t* out = reinterpret_cast<uint16_t*>(&buf[0]);
     synth_.process(out, 256);
+    AUDIO_LATENCY_STAMP(buf);
     downStream_->pullRequest();
     return buf;
 }
 
+const AudioStats* PolySynthSource::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    return &stats_;
+#else
+    return nullptr;
+#endif
+}
+
+void PolySynthSource::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(stats_);
+#endif
+}
+
 #endif // CONFIG
\ No newline at end of file
@@ -27,9 +27,173 @@ DEALINGS IN THE SOFTWARE.
 #include "ErrorNo.h"
 #include "Timer.h"
 #include "CodalDmesg.h"
+#include "codal_target_hal.h"
+#include "AudioKernels.h"
+#include "ManagedString.h"
+#include "MicroBitTrace.h"
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT) && defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#endif
 
 using namespace codal;
 
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+
+// Fixed point layout. Accumulated samples carry MIXER_FRACTION_BITS fractional bits, and channel gains
+// carry MIXER_GAIN_FRACTION_BITS. Input samples are doubled before scaling, so that the half level offset
+// of unsigned formats is exact.
+#define MIXER_FRACTION_BITS         8
+#define MIXER_GAIN_FRACTION_BITS    24
+#define MIXER_SCALE_FRACTION_BITS   16
+#define MIXER_GAIN_SHIFT            (MIXER_GAIN_FRACTION_BITS + 1 - MIXER_FRACTION_BITS)
+
+static inline int32_t mixerAdd(int32_t a, int32_t b)
+{
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+    return __qadd(a, b);
+#else
+    return a + b;
+#endif
+}
+
+static inline int32_t mixerToFixed(float v, int bits)
+{
+    float f = v * (float) (1 << bits);
+
+    if (f >= 2147483647.0f)
+        return 0x7FFFFFFF;
+
+    if (f <= -2147483648.0f)
+        return (int32_t) 0x80000000;
+
+    return (int32_t) f;
+}
+
+template <typename T> static void mixerPack(uint8_t *w, int32_t *r, int len, int32_t scale, int32_t offset, int32_t lo, int32_t hi, uint32_t orMask)
+{
+    T *out = (T *) w;
+
+    while (len--)
+    {
+        int32_t s = (int32_t) (((int64_t) *r++ * scale) >> (MIXER_SCALE_FRACTION_BITS + MIXER_FRACTION_BITS)) + offset;
+
+        s = s < lo ? lo : s > hi ? hi : s;
+
+        *out++ = (T) (s | orMask);
+    }
+}
+
+#endif
+
+template <int format> static inline int32_t mixerRead(uint8_t *d);
+
+template <> inline int32_t mixerRead<DATASTREAM_FORMAT_8BIT_UNSIGNED>(uint8_t *d) { return *d; }
+template <> inline int32_t mixerRead<DATASTREAM_FORMAT_8BIT_SIGNED>(uint8_t *d) { return *(int8_t *) d; }
+template <> inline int32_t mixerRead<DATASTREAM_FORMAT_16BIT_UNSIGNED>(uint8_t *d) { return *(uint16_t *) d; }
+template <> inline int32_t mixerRead<DATASTREAM_FORMAT_16BIT_SIGNED>(uint8_t *d) { return *(int16_t *) d; }
+
+/**
+ * Accumulates len samples from a channel's current input buffer into the mix, applying the channel's gain and volume,
+ * and moves the channel on through its input buffer. Specialised for each common input format, and for channels
+ * that are (resample) or are not (!resample) running at the output sample rate.
+ *
+ * @param out The first mix sample to update.
+ * @param len The number of output samples to generate.
+ * @param ch The channel to read from.
+ */
+template <int format, bool resample> void Mixer2::accumulate(MixerSample *out, int len, MixerChannel *ch)
+{
+    const int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+    // Combine the gain and volume once, and apply the unsigned offset to doubled samples so it remains exact.
+    int32_t gain = mixerToFixed(ch->gain * ch->volume, MIXER_GAIN_FRACTION_BITS);
+    int32_t bias = (int32_t) (ch->offset * 2.0f);
+#else
+    float gain = ch->gain * ch->volume;
+    float offset = ch->offset;
+#endif
+
+    if (!resample)
+    {
+        // Every input sample is used in turn, so simply walk through the buffer.
+        uint8_t *in = ch->in + (int) ch->position * bytesPerSample;
+        ch->position += len;
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+        // Signed 16 bit input needs no bias, so (2 * sample * gain) >> MIXER_GAIN_SHIFT reduces to a Q16 multiply,
+        // which the block kernel performs two samples at a time.
+        if (format == DATASTREAM_FORMAT_16BIT_SIGNED && bias == 0)
+        {
+            audio_accumulate_s16(out, (const int16_t *) in, len, gain);
+            return;
+        }
+#endif
+
+        while (len--)
+        {
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+            *out = mixerAdd(*out, (int32_t) (((int64_t) (2 * mixerRead<format>(in) + bias) * gain) >> MIXER_GAIN_SHIFT));
+#else
+            *out += (mixerRead<format>(in) + offset) * gain;
+#endif
+            in += bytesPerSample;
+            out++;
+        }
+
+        return;
+    }
+
+    float position = ch->position;
+
+    while (len--)
+    {
+        uint8_t *in = ch->in + (int) position * bytesPerSample;
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+        *out = mixerAdd(*out, (int32_t) (((int64_t) (2 * mixerRead<format>(in) + bias) * gain) >> MIXER_GAIN_SHIFT));
+#else
+        *out += (mixerRead<format>(in) + offset) * gain;
+#endif
+        position += ch->skip;
+        out++;
+    }
+
+    ch->position = position;
+}
+
+/**
+ * Accumulates len samples from a channel's current input buffer into the mix, for input formats without a
+ * specialised kernel.
+ *
+ * @param out The first mix sample to update.
+ * @param len The number of output samples to generate.
+ * @param ch The channel to read from.
+ */
+void Mixer2::accumulateAny(MixerSample *out, int len, MixerChannel *ch)
+{
+    float gain = ch->gain * ch->volume;
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+    // Wider formats are scaled in floating point, as their doubled samples would not fit the fixed point layout.
+    gain *= (float) (1 << MIXER_FRACTION_BITS);
+#endif
+
+    while (len--)
+    {
+        uint8_t *d = ch->in + (int)(ch->position * ch->bytesPerSample);
+        float v = StreamNormalizer::readSample[ch->format](d);
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+        *out = mixerAdd(*out, (int32_t) ((v + ch->offset) * gain));
+#else
+        *out += (v + ch->offset) * gain;
+#endif
+        ch->position += ch->skip;
+        out++;
+    }
+}
 
 /**
  * Constructor.
@@ -51,6 +215,18 @@ Mixer2::Mixer2(float sampleRate, int sampleRange, int format)
     this->silent = true;
     this->silenceStartTime = 0;
     this->silenceEndTime = 0;
+    this->sampleTime = 0;
+    this->bufferSize = CONFIG_MIXER_BUFFER_SIZE;
+    this->mixLength = bufferSize / bytesPerSampleOut;
+    this->mix = (MixerSample *) malloc(sizeof(MixerSample) * mixLength);
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(stats);
+    lastPullTime = 0;
+#endif
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    audio_latency_reset(latency);
+#endif
 
     // Attempt to configure output format to requested value
     this->setFormat(format);
@@ -64,15 +240,19 @@ Mixer2::~Mixer2()
     {
         MixerChannel *n = channels;
         channels = n->next;
-        n->stream->disconnect();
+        if (n->stream)
+            n->stream->disconnect();
         delete n;
     }
+
+    free(mix);
 }
 
 void Mixer2::configureChannel(MixerChannel *c)
 {
     c->volume = 1.0f;
-    c->format = c->stream->getFormat();
+    if (c->stream)
+        c->format = c->stream->getFormat();
     c->bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(c->format);
     c->gain = CONFIG_MIXER_INTERNAL_RANGE / (float) c->range;
     c->skip = c->rate / outputRate;
@@ -80,6 +260,40 @@ void Mixer2::configureChannel(MixerChannel *c)
 
     if (c->format == DATASTREAM_FORMAT_8BIT_UNSIGNED || c->format == DATASTREAM_FORMAT_16BIT_UNSIGNED)
         c->offset = c->range * -0.5f;       
+
+    selectKernel(c);
+}
+
+/**
+ * Chooses the inner loop used to mix a channel, based on its format and whether it needs resampling.
+ * Must be called whenever either changes.
+ */
+void Mixer2::selectKernel(MixerChannel *c)
+{
+    bool resample = c->skip != 1.0f;
+
+    switch (c->format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            c->kernel = resample ? accumulate<DATASTREAM_FORMAT_8BIT_UNSIGNED, true> : accumulate<DATASTREAM_FORMAT_8BIT_UNSIGNED, false>;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            c->kernel = resample ? accumulate<DATASTREAM_FORMAT_8BIT_SIGNED, true> : accumulate<DATASTREAM_FORMAT_8BIT_SIGNED, false>;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            c->kernel = resample ? accumulate<DATASTREAM_FORMAT_16BIT_UNSIGNED, true> : accumulate<DATASTREAM_FORMAT_16BIT_UNSIGNED, false>;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            c->kernel = resample ? accumulate<DATASTREAM_FORMAT_16BIT_SIGNED, true> : accumulate<DATASTREAM_FORMAT_16BIT_SIGNED, false>;
+            break;
+
+        default:
+            c->kernel = accumulateAny;
+            break;
+    }
 }
 
 /**
@@ -91,14 +305,7 @@ void Mixer2::configureChannel(MixerChannel *c)
  */
 MixerChannel *Mixer2::addChannel(DataSource &stream, float sampleRate, int sampleRange)
 {
-    MixerChannel *c = new MixerChannel();
-    c->stream = &stream;
-    c->range = sampleRange;
-    c->rate = sampleRate ? sampleRate : outputRate;
-    c->pullRequests = 0;
-    c->in = NULL;
-    c->end = NULL;
-    c->position = 0;
+    MixerChannel *c = createChannel(&stream, sampleRate, sampleRange);
 
     configureChannel(c);
 
@@ -111,6 +318,57 @@ MixerChannel *Mixer2::addChannel(DataSource &stream, float sampleRate, int sampl
     return c;
 }
 
+/**
+ * Add a new channel to the mixer, with no source, that plays only the clips queued on it. See MixerChannel::queueClip().
+ *
+ * @param format The format of the clips that will be queued on the channel (e.g. DATASTREAM_FORMAT_16BIT_SIGNED)
+ * @param sampleRate (samples per second) - if set to zero, defaults to the output sample rate of the Mixer
+ * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level of the clips
+ * @return The new channel, or NULL if the format is invalid.
+ */
+MixerChannel *Mixer2::addClipChannel(int format, float sampleRate, int sampleRange)
+{
+    if (format != DATASTREAM_FORMAT_8BIT_UNSIGNED && format != DATASTREAM_FORMAT_8BIT_SIGNED &&
+        format != DATASTREAM_FORMAT_16BIT_UNSIGNED && format != DATASTREAM_FORMAT_16BIT_SIGNED)
+        return NULL;
+
+    MixerChannel *c = createChannel(NULL, sampleRate, sampleRange);
+    c->format = format;
+
+    configureChannel(c);
+
+    c->next = channels;
+    channels = c;
+
+    return c;
+}
+
+MixerChannel *Mixer2::createChannel(DataSource *stream, float sampleRate, int sampleRange)
+{
+    MixerChannel *c = new MixerChannel();
+    c->stream = stream;
+    c->range = sampleRange;
+    c->rate = sampleRate ? sampleRate : outputRate;
+    c->pullRequests = 0;
+    c->in = NULL;
+    c->end = NULL;
+    c->position = 0;
+    c->startTime = 0;
+    c->clips = NULL;
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(c->stats);
+#endif
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    audio_latency_reset(c->latency);
+    c->stamp = 0;
+    c->mixedStamp = 0;
+    c->mixedOffset = 0;
+#endif
+
+    return c;
+}
+
 int Mixer2::removeChannel( MixerChannel * channel )
 {
     DMESG( "Unsupported operation! Channel retained!" );
@@ -119,19 +377,65 @@ int Mixer2::removeChannel( MixerChannel * channel )
 
 ManagedBuffer Mixer2::pull() 
 {
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_MIXER_PULL, 0);
+
     // Take a local timestamp, in case we need to compute a time when a pice of audio will be played out of the speaker
     CODAL_TIMESTAMP pullTime = system_timer_current_time_us();
 
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    AUDIO_STATS_SCOPE(stats);
+
+    // If we're pulled later than a buffer period (plus some margin) after the last pull, the sink may have run dry.
+    if (lastPullTime && pullTime - lastPullTime > (getOutputLatency() * (100 + CONFIG_AUDIO_STATS_LATE_MARGIN)) / 100)
+        stats.late++;
+
+    lastPullTime = pullTime;
+#endif
+
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    // We are pulled as the previous output buffer starts to play, so this is when the samples mixed into it become audible.
+    for (MixerChannel *ch = channels; ch; ch = ch->next)
+    {
+        if (ch->mixedStamp)
+        {
+            uint32_t us = (uint32_t) pullTime + (uint32_t) (ch->mixedOffset * (1000000.0f / outputRate)) - ch->mixedStamp;
+
+            audio_latency_record(ch->latency, us);
+            audio_latency_record(latency, us);
+            ch->mixedStamp = 0;
+        }
+    }
+#endif
+
+    int samples = bufferSize/bytesPerSampleOut;
+    uint64_t bufferTime = sampleTime;
+    sampleTime += samples;
+
     // If we have no channels, just return an empty buffer.
     if (!channels)
     {
         downStream->pullRequest();
-        return ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
+        return ManagedBuffer(bufferSize);
+    }
+
+    // If we are silent and every channel is suspended, the output is unchanged from the last silent buffer, so simply send that again.
+    if (silent && silenceBuffer.length())
+    {
+        bool suspended = true;
+
+        for (MixerChannel *ch = channels; ch && suspended; ch = ch->next)
+            suspended = ch->isSuspended();
+
+        if (suspended)
+        {
+            downStream->pullRequest();
+            return silenceBuffer;
+        }
     }
 
     // Clear the accumulator buffer
-    for (int i=0; i<CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut; i++)
-        mix[i] = 0.0f;
+    for (int i=0; i<bufferSize/bytesPerSampleOut; i++)
+        mix[i] = 0;
 
     MixerChannel *next;
     bool silence = true;
@@ -149,13 +453,30 @@ ManagedBuffer Mixer2::pull()
                 continue;
         }
 
-        float *out = &mix[0];
-        float *end = &mix[CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut];
-        int inputFormat = ch->format;
+        MixerSample *out = &mix[0];
+        MixerSample *end = &mix[samples];
 
         // Check if we need to recalculate skip after a channel rate change
         if( ch->skip == 0.0f )
+        {
             ch->skip = ch->rate / outputRate;
+            selectKernel(ch);
+        }
+
+        // Skip channels that have nothing to contribute.
+        if (ch->isSuspended())
+            continue;
+
+        // Hold back a channel until its start time, then start it at exactly that sample of this buffer.
+        if (ch->startTime > bufferTime)
+        {
+            if (ch->startTime >= bufferTime + samples)
+                continue;
+
+            out += (int) (ch->startTime - bufferTime);
+        }
+
+        AUDIO_STATS_SCOPE(ch->stats);
 
         while (out < end)
         {
@@ -166,35 +487,57 @@ ManagedBuffer Mixer2::pull()
             int len =  min(outLen, inLen);
 
             if (len)
+            {
                 silence = false;
 
-            uint8_t *d = ch->in;
-
-            while(len)
-            {
-                d = ch->in + (int)(ch->position * ch->bytesPerSample);
-
-                float v = StreamNormalizer::readSample[inputFormat](d);
-                v += ch->offset;
-                v *= ch->gain;    
-                v *= ch->volume;    
-                *out += v;
- 
-                ch->position += ch->skip;
-
-                out++;
-                len--;
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+                // Note where the first sample of a newly received buffer lands in our output.
+                if (ch->stamp)
+                {
+                    ch->mixedStamp = ch->stamp;
+                    ch->mixedOffset = (int) (out - &mix[0]);
+                    ch->stamp = 0;
+                }
+#endif
+                ch->kernel(out, len, ch);
+                out += len;
             }
 
             // Check if we've completed an input buffer. If so, pull down another if available.
             // if no buffer is available, then move on to the next channel.
             if (inLen < outLen)
             {
+                // Queued clips take their turn ahead of the source, each starting at its own sample time.
+                if (ch->clips)
+                {
+                    MixerClip *clip = ch->clips;
+
+                    if (clip->time > bufferTime + (out - &mix[0]))
+                    {
+                        if (clip->time >= bufferTime + samples)
+                            break;
+
+                        out = &mix[clip->time - bufferTime];
+                    }
+
+                    ch->clips = clip->next;
+                    ch->buffer = clip->buffer;
+                    ch->in = &ch->buffer[0];
+                    ch->position = 0;
+                    ch->end = ch->in + ch->buffer.length();
+                    delete clip;
+
+                    continue;
+                }
+
                 if (ch->pullRequests == 0)
                     break;
 
                 ch->pullRequests--;
                 ch->buffer = ch->stream->pull();
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+                ch->stamp = audio_latency_claim(ch->buffer);
+#endif
                 ch->in = &ch->buffer[0];
                 ch->position = 0;
                 ch->end = ch->in + ch->buffer.length();
@@ -208,8 +551,13 @@ ManagedBuffer Mixer2::pull()
     // If we have silence, set output level to predefined value.
     if (silence && silenceLevel != 0.0f)
     {
-        for (int i=0; i<CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut; i++)
-            mix[i] = silenceLevel;
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+        int32_t level = mixerToFixed(silenceLevel, MIXER_FRACTION_BITS);
+#else
+        float level = silenceLevel;
+#endif
+        for (int i=0; i<bufferSize/bytesPerSampleOut; i++)
+            mix[i] = level;
     }
 
     if (this->silent != silence)
@@ -231,9 +579,8 @@ ManagedBuffer Mixer2::pull()
     }
 
     // Scale and pack to our output format
-    ManagedBuffer output = ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
+    ManagedBuffer output = outputPool.allocate(bufferSize);
     uint8_t *w = &output[0];
-    float *r = mix;
 
     int len = output.length() / bytesPerSampleOut;
     float scale = volume * outputRange / CONFIG_MIXER_INTERNAL_RANGE;
@@ -241,28 +588,66 @@ ManagedBuffer Mixer2::pull()
     float lo = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? 0 : -outputRange/2;
     float hi = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? outputRange : outputRange/2;
 
-    while(len--)
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+    // Combine the master volume and output range into a single fixed point scale, and pack with a loop specialised for the output format.
+    int32_t fixedScale = mixerToFixed(scale, MIXER_SCALE_FRACTION_BITS);
+
+    switch (outputFormat)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            mixerPack<uint8_t>(w, mix, len, fixedScale, offset, (int32_t) lo, (int32_t) hi, orMask);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            mixerPack<int8_t>(w, mix, len, fixedScale, offset, (int32_t) lo, (int32_t) hi, orMask);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            audio_pack_u16((uint16_t *) w, mix, len, fixedScale, MIXER_SCALE_FRACTION_BITS + MIXER_FRACTION_BITS, offset, (int32_t) lo, (int32_t) hi, (uint16_t) orMask);
+            break;
+
+        default:
+            mixerPack<int16_t>(w, mix, len, fixedScale, offset, (int32_t) lo, (int32_t) hi, orMask);
+            break;
+    }
+#else
+    // The native output format of the nRF52 PWM is packed by a block kernel, other formats sample by sample.
+    if (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED)
     {
-        float sample = *r * scale;
-        sample += offset;
+        audio_pack_float_u16((uint16_t *) w, mix, len, scale, (float) offset, (int32_t) lo, (int32_t) hi, (uint16_t) orMask);
+    }
+    else
+    {
+        float *r = mix;
+
+        while(len--)
+        {
+            float sample = *r * scale;
+            sample += offset;
         
-        // Clamp output range. Would be nice to use apply some compression here, 
-        // but we don't really want ot use more CPU than we already do.
-        if (sample < lo)
-            sample = lo;
-
-        if (sample > hi)
-            sample = hi;
-
-        // Apply any requested bit mask
-        int s = (int)sample;
-        s |= orMask;
-
-        // Write out the sample.
-        StreamNormalizer::writeSample[outputFormat](w, s);
-        w += bytesPerSampleOut;
-        r++;
+            // Clamp output range. Would be nice to use apply some compression here, 
+            // but we don't really want ot use more CPU than we already do.
+            if (sample < lo)
+                sample = lo;
+
+            if (sample > hi)
+                sample = hi;
+
+            // Apply any requested bit mask
+            int s = (int)sample;
+            s |= orMask;
+
+            // Write out the sample.
+            StreamNormalizer::writeSample[outputFormat](w, s);
+            w += bytesPerSampleOut;
+            r++;
+        }
     }
+#endif
+
+    // Hold on to silent output, so it can be reused for as long as every channel remains suspended.
+    if (silence)
+        silenceBuffer = output;
 
     // Return the buffer and we're done.
     downStream->pullRequest();
@@ -275,6 +660,144 @@ int MixerChannel::pullRequest()
     return DEVICE_OK;
 }
 
+/**
+ * Destructor. Discards any queued clips.
+ */
+MixerChannel::~MixerChannel()
+{
+    clearClips();
+}
+
+/**
+ * Holds this channel silent until the mixer reaches the given sample time, then resumes mixing it from
+ * exactly that sample of the output.
+ *
+ * @param time The sample time to start at, as given by Mixer2::getSampleTime(). Times already passed start immediately.
+ * @return DEVICE_OK on success.
+ */
+int MixerChannel::startAt(uint64_t time)
+{
+    target_disable_irq();
+    startTime = time;
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Queues a buffer of samples to play on this channel, starting at the given sample time.
+ *
+ * @param clip The samples to play, in the format and at the sample rate of this channel.
+ * @param time The sample time at which to play the first sample, as given by Mixer2::getSampleTime().
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the clip is empty.
+ */
+int MixerChannel::queueClip(ManagedBuffer clip, uint64_t time)
+{
+    if (clip.length() == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    MixerClip *c = new MixerClip();
+    c->buffer = clip;
+    c->time = time;
+
+    // Insert in order of time, after any clips due at the same time, so a phrase may be queued in any order.
+    target_disable_irq();
+
+    MixerClip **p = &clips;
+    while (*p && (*p)->time <= time)
+        p = &(*p)->next;
+
+    c->next = *p;
+    *p = c;
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Discards any clips queued on this channel that have not yet started to play.
+ *
+ * @return DEVICE_OK on success.
+ */
+int MixerChannel::clearClips()
+{
+    target_disable_irq();
+    MixerClip *c = clips;
+    clips = NULL;
+    target_enable_irq();
+
+    while (c)
+    {
+        MixerClip *n = c->next;
+        delete c;
+        c = n;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of clips queued on this channel that have not yet started to play.
+ *
+ * @return The number of queued clips.
+ */
+int MixerChannel::getClipCount()
+{
+    int count = 0;
+
+    target_disable_irq();
+    for (MixerClip *c = clips; c; c = c->next)
+        count++;
+    target_enable_irq();
+
+    return count;
+}
+
+/**
+ * Retrieves the cost of mixing this channel, including the time taken by its source to generate data.
+ * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+ *
+ * @return The statistics for this channel, or NULL if statistics are disabled.
+ */
+const AudioStats *MixerChannel::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    return &stats;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Retrieves the measured latency of this channel, from the production of each buffer of samples by its source
+ * to the playout of its first sample. Latency is only measured if CONFIG_AUDIO_LATENCY is enabled.
+ *
+ * @return The latency statistics for this channel, or NULL if measurement is disabled.
+ */
+const AudioLatency *MixerChannel::getLatency()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    return &latency;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Determines if this channel is suspended. A channel is suspended once it has mixed all the data it has
+ * received, it has no clips queued, and its source has not issued a further pullRequest().
+ *
+ * @return true if this channel has no data available to mix.
+ */
+bool MixerChannel::isSuspended()
+{
+    if (pullRequests || clips || format == DATASTREAM_FORMAT_UNKNOWN || skip == 0.0f)
+        return false;
+
+    return (buffer.length() / bytesPerSample) - position < skip;
+}
+
 void Mixer2::connect(DataSink &sink)
 {
     this->downStream = &sink;
@@ -295,15 +818,54 @@ int Mixer2::setFormat(int format)
 {
     if (format == DATASTREAM_FORMAT_16BIT_UNSIGNED || format == DATASTREAM_FORMAT_16BIT_SIGNED || format == DATASTREAM_FORMAT_8BIT_UNSIGNED || format == DATASTREAM_FORMAT_8BIT_SIGNED)
     {
-        this->outputFormat = format;
-        this->bytesPerSampleOut = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+        // The buffer size must remain a whole number of samples, and the accumulator may need to grow to hold them.
+        if (bufferSize % DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format))
+            return DEVICE_INVALID_PARAMETER;
 
-        return DEVICE_OK;
+        return configureOutput(bufferSize, format);
     }
 
     return DEVICE_INVALID_PARAMETER;
 }
 
+/**
+ * Applies a new output buffer size and format together, resizing the accumulator to one entry per output sample.
+ *
+ * @param size The buffer size, in bytes. This must be a positive multiple of the sample size of the format.
+ * @param format The output format.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the accumulator could not be allocated.
+ */
+int Mixer2::configureOutput(int size, int format)
+{
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int length = size / bytesPerSample;
+    MixerSample *m = mix;
+
+    if (length != mixLength)
+    {
+        m = (MixerSample *) malloc(sizeof(MixerSample) * length);
+
+        if (m == NULL)
+            return DEVICE_NO_RESOURCES;
+    }
+
+    // pull() is typically called from interrupt context, so swap over the accumulator and output settings atomically.
+    target_disable_irq();
+    MixerSample *old = mix;
+    mix = m;
+    mixLength = length;
+    bufferSize = size;
+    outputFormat = format;
+    bytesPerSampleOut = bytesPerSample;
+    silenceBuffer = ManagedBuffer();
+    target_enable_irq();
+
+    if (old != m)
+        free(old);
+
+    return DEVICE_OK;
+}
+
 /**
  * Defines the overall master volume of the mixer.
  *
@@ -317,6 +879,7 @@ Mixer2::setVolume(int volume)
         return DEVICE_INVALID_PARAMETER;
 
     this->volume = (float)volume / 1023.f;
+    this->silenceBuffer = ManagedBuffer();
     return DEVICE_OK;
 }
 
@@ -338,6 +901,7 @@ Mixer2::getVolume()
 int Mixer2::setSampleRange(uint16_t sampleRange)
 {
     this->outputRange = (float)sampleRange;
+    this->silenceBuffer = ManagedBuffer();
     return DEVICE_OK;
 }
 
@@ -352,7 +916,10 @@ int Mixer2::setSampleRate(float sampleRate)
     
     // Recompute the sub/super sampling constants for each channel.    
     for (MixerChannel *c = channels; c; c=c->next)
+    {
         c->skip = c->rate / outputRate;
+        selectKernel(c);
+    }
 
     return DEVICE_OK;
 }
@@ -386,6 +953,7 @@ float Mixer2::getSampleRate()
 int Mixer2::setOrMask(uint32_t mask)
 {
     orMask = mask;
+    silenceBuffer = ManagedBuffer();
     return DEVICE_OK;
 }
 
@@ -402,9 +970,144 @@ int Mixer2::setSilenceLevel(float level)
         return DEVICE_INVALID_PARAMETER;
 
     silenceLevel = level - 512.0f;
+    silenceBuffer = ManagedBuffer();
     return DEVICE_OK;
 }
 
+/**
+ * Changes the size of the buffers generated by this mixer. Smaller buffers reduce output latency,
+ * whereas larger buffers reduce the CPU overhead of each pull.
+ *
+ * @param size The new buffer size, in bytes. This must be a positive multiple of the output sample size.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is invalid, or DEVICE_NO_RESOURCES
+ * if the accumulator could not be allocated.
+ */
+int Mixer2::setBufferSize(int size)
+{
+    if (size <= 0 || size % bytesPerSampleOut)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (size == bufferSize)
+        return DEVICE_OK;
+
+    return configureOutput(size, outputFormat);
+}
+
+/**
+ * Determines the size of the buffers generated by this mixer.
+ *
+ * @return The buffer size, in bytes.
+ */
+int Mixer2::getBufferSize()
+{
+    return bufferSize;
+}
+
+/**
+ * Determines the playout latency introduced by a single output buffer at the current
+ * buffer size, output format and sample rate.
+ *
+ * @return The latency in microseconds.
+ */
+uint32_t Mixer2::getOutputLatency()
+{
+    return (uint32_t) ((bufferSize / bytesPerSampleOut) * (1000000.0f / outputRate));
+}
+
+/**
+ * Retrieves the cost of each pull, and the number of pulls that arrived late from downstream (i.e. where
+ * the sink may have run out of data). Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+ *
+ * @return The statistics for this mixer, or NULL if statistics are disabled.
+ */
+const AudioStats *Mixer2::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    return &stats;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Retrieves the measured latency of the mixer output, from the production of each buffer of samples by any
+ * channel to the playout of its first sample. Latency is only measured if CONFIG_AUDIO_LATENCY is enabled.
+ *
+ * @return The latency statistics for the mixer, or NULL if measurement is disabled.
+ */
+const AudioLatency *Mixer2::getLatency()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    return &latency;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Resets the statistics of this mixer and all of its channels.
+ */
+void Mixer2::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(stats);
+    lastPullTime = 0;
+
+    for (MixerChannel *c = channels; c; c = c->next)
+        audio_stats_reset(c->stats);
+#endif
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    audio_latency_reset(latency);
+
+    for (MixerChannel *c = channels; c; c = c->next)
+        audio_latency_reset(c->latency);
+#endif
+}
+
+/**
+ * Outputs the statistics of this mixer and each of its channels via DMESG.
+ */
+void Mixer2::printStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_print("mixer", stats);
+
+    int i = 0;
+    for (MixerChannel *c = channels; c; c = c->next)
+    {
+        ManagedString name = ManagedString("channel ") + ManagedString(i++);
+        audio_stats_print(name.toCharArray(), c->stats);
+    }
+#else
+    DMESG("AUDIO_STATS: disabled");
+#endif
+#if CONFIG_ENABLED(CONFIG_AUDIO_LATENCY)
+    audio_latency_print("mixer", latency);
+
+    int j = 0;
+    for (MixerChannel *c = channels; c; c = c->next)
+    {
+        ManagedString name = ManagedString("channel ") + ManagedString(j++);
+        audio_latency_print(name.toCharArray(), c->latency);
+    }
+#endif
+}
+
+/**
+ * Determines the mixer's sample clock: the number of output samples generated since it was created, which is
+ * the time of the first sample of the next buffer to be mixed.
+ *
+ * @return The current sample time.
+ */
+uint64_t Mixer2::getSampleTime()
+{
+    target_disable_irq();
+    uint64_t t = sampleTime;
+    target_enable_irq();
+
+    return t;
+}
+
 /**
   * Determines if the mixer is silent
   * @return true if the mixer is silent 
@@ -415,6 +1118,22 @@ bool Mixer2::isSilent()
   return silent;
 }
 
+/**
+ * Determines if every channel of the mixer, other than the one given, is suspended.
+ * See MixerChannel::isSuspended().
+ *
+ * @param except A channel to disregard, or NULL to consider all channels.
+ * @return true if no channel (other than that given) has data available to mix.
+ */
+bool Mixer2::isSuspended(MixerChannel *except)
+{
+    for (MixerChannel *ch = channels; ch; ch = ch->next)
+        if (ch != except && !ch->isSuspended())
+            return false;
+
+    return true;
+}
+
 /**
  * Determines the time at which the mixer has most recently been generating silence 
  *
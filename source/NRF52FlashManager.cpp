@@ -24,6 +24,8 @@ DEALINGS IN THE SOFTWARE.
 
 #include "NRF52FlashManager.h"
 #include "Timer.h"
+#include "EventModel.h"
+#include "CodalFiber.h"
 #include "nrf.h"
 
 #ifdef SOFTDEVICE_PRESENT
@@ -41,7 +43,152 @@ using namespace codal;
  */
 extern "C" void btle_set_user_evt_handler(void (*func)(uint32_t));
 
-static volatile bool flash_op_complete = false;
+#define FLASH_OP_NONE       0
+#define FLASH_OP_WRITE      1
+#define FLASH_OP_ERASE      2
+
+// Only one flash operation may be in progress at a time, so its state is shared by all instances.
+static volatile uint8_t flash_op = FLASH_OP_NONE;
+static volatile int flash_op_result = DEVICE_OK;
+static uint32_t flash_op_address;
+static uint32_t *flash_op_data;
+static uint32_t flash_op_length;
+static uint32_t flash_op_page_size;
+static uint32_t flash_op_slices;
+static bool flash_listening = false;
+
+static bool flash_softdevice_enabled()
+{
+    uint8_t sd_enabled = 0;
+
+#ifdef SOFTDEVICE_PRESENT
+    sd_softdevice_is_enabled(&sd_enabled);
+#endif
+
+    return sd_enabled == 1;
+}
+
+// Determines if operations in progress can be advanced by timer events, handled on a fiber.
+static bool flash_can_poll()
+{
+    return flash_listening && fiber_scheduler_running();
+}
+
+// Determines if the caller can sleep while a flash operation completes.
+static bool flash_can_wait()
+{
+    return flash_can_poll() && (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0;
+}
+
+static void flash_op_end(int result)
+{
+    flash_op_result = result;
+    flash_op = FLASH_OP_NONE;
+
+    Event(MICROBIT_ID_FLASH_MANAGER, result == DEVICE_OK ? NRF52_FLASH_EVT_COMPLETE : NRF52_FLASH_EVT_ERROR);
+}
+
+static void flash_op_retry(uint32_t delay)
+{
+    system_timer_event_after_us(delay * 1000, MICROBIT_ID_FLASH_MANAGER, NRF52_FLASH_EVT_POLL);
+}
+
+static void flash_wait_ready()
+{
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+}
+
+static void flash_write_words(uint32_t *addr, uint32_t *data, uint32_t length)
+{
+    // Turn on flash write enable and wait until the NVMC is ready:
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos);
+    flash_wait_ready();
+
+    for(uint32_t i=0;i<length;i++)
+    {
+        *(addr+i) = *(data+i);
+        flash_wait_ready();
+    }
+
+    // Turn off flash write enable and wait until the NVMC is ready:
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
+    flash_wait_ready();
+}
+
+/*
+ * Submits the operation in progress to the SoftDevice, retrying later if it is busy with another.
+ */
+static void flash_op_submit_softdevice()
+{
+#ifdef SOFTDEVICE_PRESENT
+    while(1)
+    {
+        uint32_t r;
+
+        if (flash_op == FLASH_OP_WRITE)
+            r = sd_flash_write((uint32_t *) flash_op_address, flash_op_data, flash_op_length);
+        else
+            r = sd_flash_page_erase(flash_op_address / flash_op_page_size);
+
+        if (r == NRF_SUCCESS)
+            return;
+
+        if (r != NRF_ERROR_BUSY)
+        {
+            flash_op_end(DEVICE_NOT_SUPPORTED);
+            return;
+        }
+
+        if (flash_can_poll())
+        {
+            flash_op_retry(NRF52_FLASH_RETRY_INTERVAL);
+            return;
+        }
+
+        system_timer_wait_ms(NRF52_FLASH_RETRY_INTERVAL);
+    }
+#endif
+}
+
+/*
+ * Performs the next slice of a partial erase, and schedules the one after it.
+ */
+static void flash_op_erase_slice()
+{
+    NRF_NVMC->ERASEPAGEPARTIALCFG = NRF52_FLASH_ERASE_SLICE;
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Een);
+    flash_wait_ready();
+
+    NRF_NVMC->ERASEPAGEPARTIAL = flash_op_address;
+    flash_wait_ready();
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
+    flash_wait_ready();
+
+    // The page is only reliably erased once the slices add up to a full erase, whatever it reads as meanwhile.
+    flash_op_slices++;
+
+    if (flash_op_slices * NRF52_FLASH_ERASE_SLICE >= NRF52_FLASH_ERASE_TIME)
+        flash_op_end(DEVICE_OK);
+    else
+        flash_op_retry(NRF52_FLASH_ERASE_INTERVAL);
+}
+
+/*
+ * Advances the operation in progress. Runs on a fiber, from the message bus.
+ */
+static void flash_op_poll(Event)
+{
+    if (flash_op == FLASH_OP_NONE)
+        return;
+
+    // If the SoftDevice has started since this operation began, it now owns the NVMC, so hand the rest over to it.
+    if (flash_softdevice_enabled())
+        flash_op_submit_softdevice();
+    else
+        flash_op_erase_slice();
+}
 
 /*
  * When SoftDevice is present,
@@ -53,8 +200,20 @@ static volatile bool flash_op_complete = false;
 
 static void nvmc_event_handler(uint32_t sys_evt, void *)
 {
+    if (flash_op == FLASH_OP_NONE)
+        return;
+
     if (sys_evt == NRF_EVT_FLASH_OPERATION_SUCCESS)
-        flash_op_complete = true;
+        flash_op_end(DEVICE_OK);
+
+    // The SoftDevice couldn't find time for the operation between radio events, so try again.
+    if (sys_evt == NRF_EVT_FLASH_OPERATION_ERROR)
+    {
+        if (flash_can_poll())
+            flash_op_retry(NRF52_FLASH_RETRY_INTERVAL);
+        else
+            flash_op_submit_softdevice();
+    }
 }
 
 NRF_SDH_SOC_OBSERVER( nrf52flash_soc_observer, 0, nvmc_event_handler, NULL);
@@ -106,49 +265,15 @@ NRF52FlashManager::read(uint32_t* dest, uint32_t address, uint32_t length)
 int 
 NRF52FlashManager::write(uint32_t address, uint32_t *data, uint32_t length)
 {
-    address += startAddress;
-
-#ifdef SOFTDEVICE_PRESENT
-    // Schedule SoftDevice to write this memory for us, and wait for it to complete.
-    // This happens ASYNCHRONOUSLY when SD is enabled (and synchronously if disabled!!)
-    uint8_t sd_enabled = 0;
-    sd_softdevice_is_enabled(&sd_enabled);
-
-    if (sd_enabled)
-    {
-        flash_op_complete = false;
-
-        while(1)
-        {
-            if (sd_flash_write((uint32_t *) address, data, length) == NRF_SUCCESS)
-                break;
-
-            system_timer_wait_ms(10);
-        }
-
-        // Wait for SoftDevice to diable the write operation when it completes...
-        while(!flash_op_complete);
-    }
-    else
-#endif
-    {
-        uint32_t *addr = (uint32_t *) address;
+    int result;
 
-        // Turn on flash write enable and wait until the NVMC is ready:
-        NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos);
-        while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+    while ((result = writeAsync(address, data, length)) == DEVICE_BUSY)
+        wait();
 
-        for(uint32_t i=0;i<length;i++)
-        {
-            *(addr+i) = *(data+i);
-            while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
-        }
+    if (result != DEVICE_OK)
+        return result;
 
-        // Turn off flash write enable and wait until the NVMC is ready:
-        NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
-        while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
-    }
-    return DEVICE_OK;
+    return wait();
 }
 
 /**
@@ -159,43 +284,163 @@ NRF52FlashManager::write(uint32_t address, uint32_t *data, uint32_t length)
 int
 NRF52FlashManager::erase(uint32_t page)
 {
-    page += startAddress;
+    int result;
 
-#ifdef SOFTDEVICE_PRESENT
-    uint8_t sd_enabled = 0;
-    sd_softdevice_is_enabled(&sd_enabled);
-    
-    if (sd_enabled)
-    {
-        flash_op_complete = false;
-        while(1)
-        {
-            if (sd_flash_page_erase(page / pageSize) == NRF_SUCCESS)
-                break;
+    wait();
 
-            system_timer_wait_ms(10);
-        }
-        // Wait for SoftDevice to diable the write operation when it completes...
-        while(!flash_op_complete);
-    }
-    else   
-#endif
+    // Without a fiber to advance a partial erase, or the SoftDevice to do it for us, erase the page in one go.
+    if (!flash_can_wait() && !flash_softdevice_enabled())
     {
+        page += startAddress;
+
         // Turn on flash erase enable and wait until the NVMC is ready:
         NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Een);
-        while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
-        
+        flash_wait_ready();
+
         // Erase page:
         NRF_NVMC->ERASEPAGE = page;
-        while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+        flash_wait_ready();
 
         // Turn off flash erase enable and wait until the NVMC is ready:
         NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
-        while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+        flash_wait_ready();
+
+        return DEVICE_OK;
+    }
+
+    while ((result = eraseAsync(page)) == DEVICE_BUSY)
+        wait();
+
+    if (result != DEVICE_OK)
+        return result;
+
+    return wait();
+}
+
+/**
+ * Starts writing data to the specified location, returning before the write has completed.
+ * NRF52_FLASH_EVT_COMPLETE or NRF52_FLASH_EVT_ERROR is raised on MICROBIT_ID_FLASH_MANAGER once it ends.
+ *
+ * @param address the location to write to
+ * @param data a buffer containing the data to write, which must remain valid until the write ends.
+ * @param length the number of 32-bit words to write
+ *
+ * @return DEVICE_OK on success, or DEVICE_BUSY if another flash operation is in progress.
+ */
+int
+NRF52FlashManager::writeAsync(uint32_t address, uint32_t *data, uint32_t length)
+{
+    if (flash_op != FLASH_OP_NONE)
+        return DEVICE_BUSY;
+
+    listen();
+
+    flash_op = FLASH_OP_WRITE;
+    flash_op_address = address + startAddress;
+    flash_op_data = data;
+    flash_op_length = length;
+    flash_op_page_size = pageSize;
+
+    if (flash_softdevice_enabled())
+    {
+        flash_op_submit_softdevice();
     }
+    else
+    {
+        flash_write_words((uint32_t *) flash_op_address, data, length);
+        flash_op_end(DEVICE_OK);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Starts erasing a given page, returning before the erase has completed.
+ * NRF52_FLASH_EVT_COMPLETE or NRF52_FLASH_EVT_ERROR is raised on MICROBIT_ID_FLASH_MANAGER once it ends.
+ *
+ * @param page The address of the page to erase (logical address of the start of the page).
+ *
+ * @return DEVICE_OK on success, DEVICE_BUSY if another flash operation is in progress,
+ * or DEVICE_NOT_SUPPORTED if there is neither the SoftDevice nor a running scheduler to complete the erase.
+ */
+int
+NRF52FlashManager::eraseAsync(uint32_t page)
+{
+    if (flash_op != FLASH_OP_NONE)
+        return DEVICE_BUSY;
+
+    listen();
+
+    if (!flash_can_poll() && !flash_softdevice_enabled())
+        return DEVICE_NOT_SUPPORTED;
+
+    flash_op = FLASH_OP_ERASE;
+    flash_op_address = page + startAddress;
+    flash_op_page_size = pageSize;
+    flash_op_slices = 0;
+
+    if (flash_softdevice_enabled())
+        flash_op_submit_softdevice();
+    else
+        flash_op_erase_slice();
+
     return DEVICE_OK;
 }
 
+/**
+ * Determines if a flash operation is in progress. Only one may be in progress at a time, across all instances.
+ *
+ * @return true if an operation is in progress, false otherwise.
+ */
+bool
+NRF52FlashManager::isBusy()
+{
+    return flash_op != FLASH_OP_NONE;
+}
+
+/**
+ * Waits for any flash operation in progress to end. The calling fiber sleeps while it does, if it can.
+ *
+ * @return DEVICE_OK if the last operation succeeded, or DEVICE_NOT_SUPPORTED if it failed.
+ */
+int
+NRF52FlashManager::wait()
+{
+    while (flash_op != FLASH_OP_NONE)
+    {
+        if (!flash_can_wait())
+            continue;
+
+        // Check again with interrupts disabled, so the end of the operation can't slip in before we sleep.
+        target_disable_irq();
+
+        if (flash_op == FLASH_OP_NONE)
+        {
+            target_enable_irq();
+            break;
+        }
+
+        fiber_wake_on_event(MICROBIT_ID_FLASH_MANAGER, DEVICE_EVT_ANY);
+        target_enable_irq();
+
+        schedule();
+    }
+
+    return flash_op_result;
+}
+
+/**
+ * Registers for the events used to advance asynchronous operations, once the message bus is available.
+ */
+void
+NRF52FlashManager::listen()
+{
+    if (flash_listening || EventModel::defaultEventBus == NULL)
+        return;
+
+    flash_listening = true;
+    EventModel::defaultEventBus->listen(MICROBIT_ID_FLASH_MANAGER, NRF52_FLASH_EVT_POLL, flash_op_poll);
+}
 
 /**
  * Determines the logical address of the start of non-volatile memory region
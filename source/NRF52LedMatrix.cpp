@@ -31,6 +31,11 @@ DEALINGS IN THE SOFTWARE.
 #include "NRF52Pin.h"
 #include "CodalDmesg.h"
 #include "ErrorNo.h"
+#include "MicroBitPowerManager.h"
+#include "Timer.h"
+#include "CodalFiber.h"
+#include "MicroBitTrace.h"
+#include <string.h>
 
 using namespace codal;
 
@@ -60,8 +65,43 @@ NRF52LEDMatrix::NRF52LEDMatrix(NRFLowLevelTimer &displayTimer, const MatrixMap &
     strobeRow = 0;
     instance = this;
     lightLevel = 0;
+    lightTime = 0;
+    lightRequest = false;
+    resetStats();
     this->mode = mode;
 
+    // Row tables are computed on demand, from the first frame onward.
+    rowCompare = new uint32_t[matrixMap.rows * matrixMap.columns];
+    rowConfig = new uint32_t[matrixMap.rows * matrixMap.columns];
+    tableImage = new uint8_t[width * height];
+    tableDirty = true;
+    generation = 0;
+    swapPending = false;
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+    rowSpan = new uint8_t[matrixMap.rows];
+    staticFrames = 0;
+
+    for (int row = 0; row < matrixMap.rows; row++)
+        rowSpan[row] = 1;
+#endif
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    rowPort = new NRF_GPIO_Type *[matrixMap.rows];
+    rowMask = new uint32_t[matrixMap.rows];
+
+    for (int row = 0; row < matrixMap.rows; row++)
+    {
+        int name = matrixMap.rowPins[row]->name;
+#ifdef NRF_P1
+        rowPort[row] = name < 32 ? NRF_P0 : NRF_P1;
+#else
+        rowPort[row] = NRF_P0;
+#endif
+        rowMask[row] = 1 << (name & 31);
+    }
+#endif
+
     // Validate that we can deliver the requested display.
     if (matrixMap.columns <= NRF52_LED_MATRIX_MAXIMUM_COLUMNS)
     {
@@ -103,19 +143,19 @@ void NRF52LEDMatrix::setDisplayMode(DisplayMode mode)
         status &= ~NRF52_LEDMATRIX_STATUS_RESET;
     }
 
-    // Determine the number of timeslots we'll need.
+    // Determine the number of timeslots we'll need. Light sensing borrows an extra timeslot only when a reading is requested,
+    // so the refresh rate is the same in every mode.
     timeslots = matrixMap.rows;
 
-    if (mode == DISPLAY_MODE_BLACK_AND_WHITE_LIGHT_SENSE || mode == DISPLAY_MODE_GREYSCALE_LIGHT_SENSE)
-        timeslots++;
-
     timerPeriod = NRF52_LED_MATRIX_CLOCK_FREQUENCY / (NRF52_LED_MATRIX_FREQUENCY * timeslots);
+    strobePeriod = timerPeriod;
     quantum = (timerPeriod * brightness) / (256 * 255);
     
     timer.setCompare(0, timerPeriod);
     timer.timer->TASKS_CLEAR = 1;
 
     this->mode = mode;
+    tableDirty = true;
 }
 
 /**
@@ -140,6 +180,7 @@ DisplayMode NRF52LEDMatrix::getDisplayMode()
 void NRF52LEDMatrix::rotateTo(DisplayRotation rotation)
 {
     this->rotation = rotation;
+    tableDirty = true;
 }
 
 /**
@@ -167,10 +208,25 @@ void NRF52LEDMatrix::enable()
     for (int col = 0; col < matrixMap.columns; col++)
         matrixMap.columnPins[col]->getDigitalValue(PullMode::None);
 
+    // Ensure the row tables are valid before the first strobe.
+    updateRowTables();
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    // Configure the row pins as outputs, so that they can then be driven through their port registers alone.
+    for (int row = 0; row < matrixMap.rows; row++)
+        matrixMap.rowPins[row]->setDigitalValue(0);
+#endif
+
     timer.enable();
     timer.enableIRQ();
 
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    // Have the timer stop itself at the end of each strobe, so that the row can be reconfigured without a race.
+    timer.timer->SHORTS |= TIMER_SHORTS_COMPARE0_STOP_Msk;
+#endif
+
     enabled = true;
+    microbit_energy_report(MICROBIT_ENERGY_DISPLAY, true);
 }
 
 /**
@@ -191,6 +247,18 @@ void NRF52LEDMatrix::disable()
     timer.disable();
     timer.disableIRQ();
 
+    // No frame will take a pending back buffer now, so take it here and release any fiber waiting in swap().
+    if (swapPending)
+    {
+        memcpy(image.getBitmap(), backBuffer.getBitmap(), width * height);
+        swapPending = false;
+        Event(id, NRF52_LED_MATRIX_EVT_SWAP_COMPLETE);
+    }
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    timer.timer->SHORTS &= ~TIMER_SHORTS_COMPARE0_STOP_Msk;
+#endif
+
     // Disable GPIOTE control of the display pins
     // FIXME: When GPIOTE is disabled here "system off" consumes almost 1mA @ 3V
     // It's unclear how changing this peripheral causes the additional power consumption
@@ -209,43 +277,41 @@ void NRF52LEDMatrix::disable()
     status &= ~NRF52_LEDMATRIX_STATUS_LIGHTREADY;
 
     enabled = false;
+    microbit_energy_report(MICROBIT_ENERGY_DISPLAY, false);
 }
 
 /**
- * Configure the next frame to be drawn.
+ * Recomputes the timer compare values and GPIOTE configuration of every row, if the image, rotation,
+ * mode or brightness has changed since they were last computed.
  */
-void NRF52LEDMatrix::render()
+void NRF52LEDMatrix::updateRowTables()
 {
     uint8_t *screenBuffer = image.getBitmap();
-    uint32_t value;
 
-    if (strobeRow < matrixMap.rows)
-    {
-        // We just completed a normal diplay strobe. 
-        // Turn off the LED drive to the row that was completed.
-        matrixMap.rowPins[strobeRow]->setDigitalValue(0);
-    }
-    else
-    {
-        // We just completed a light sense strobe. Record the light level sensed.
-        lightLevel = 255 - ((255 * timer.timer->CC[1]) / (timerPeriod * NRF52_LED_MATRIX_LIGHTSENSE_STROBES));
-        status |= NRF52_LEDMATRIX_STATUS_LIGHTREADY;
+    // For a static image, this comparison is the only per frame cost.
+    if (!tableDirty && memcmp(screenBuffer, tableImage, width * height) == 0)
+        return;
 
-        // Restore the hardware configuration into LED drive mode.
-        status |= NRF52_LEDMATRIX_STATUS_RESET;
-        setDisplayMode(mode);
-    }
-    
-    // Stop the timer temporarily, to avoid possible race conditions.
-    timer.timer->TASKS_STOP = 1;
+    memcpy(tableImage, screenBuffer, width * height);
+    tableDirty = false;
+    generation++;
 
-    // Move on to the next row.
-    strobeRow = (strobeRow + 1) % timeslots;
+    buildRowTables();
+}
 
-    if(strobeRow < matrixMap.rows)
+/**
+ * Computes the timer compare values and GPIOTE configuration of every row, from the last image recorded by updateRowTables().
+ */
+void NRF52LEDMatrix::buildRowTables()
+{
+    uint8_t *screenBuffer = tableImage;
+    uint32_t value;
+    uint32_t *compare = rowCompare;
+    uint32_t *config = rowConfig;
+
+    for (int row = 0; row < matrixMap.rows; row++)
     {
-        // Common case - configure timer values.
-        MatrixPoint *p = (MatrixPoint *)matrixMap.map + strobeRow;
+        MatrixPoint *p = (MatrixPoint *)matrixMap.map + row;
 
         for (int column = 0; column < matrixMap.columns; column++)
         {
@@ -273,19 +339,192 @@ void NRF52LEDMatrix::render()
                 value = value ? 255 : 0;
 
             value = value * quantum;
-            timer.timer->CC[column+1] = value;
+            *compare++ = value;
 
             // Set the initial polarity of the column output to HIGH if the pixel brightness is >0. LOW otherwise.
-            if (value)
-                NRF_GPIOTE->CONFIG[gpiote[column]] &= ~0x00100000;
-            else
-                NRF_GPIOTE->CONFIG[gpiote[column]] |= 0x00100000;
-            
+            *config++ = 0x00010003 | (matrixMap.columnPins[column]->name << 8) | (value ? 0 : 0x00100000);
+
             p += matrixMap.rows;
         }
+    }
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+    // Let the strobe of each lit row (and of the first row, which starts each frame) absorb the dark rows that follow it.
+    // The LEDs of that row are lit for no longer, so brightness is unchanged, but the dark rows cost no interrupts of their own.
+    int dark = 0;
+
+    for (int row = matrixMap.rows - 1; row >= 0; row--)
+    {
+        bool lit = false;
+
+        for (int column = 0; column < matrixMap.columns; column++)
+            lit = lit || rowCompare[row * matrixMap.columns + column];
+
+        rowSpan[row] = 1 + dark;
+        dark = lit ? 0 : dark + 1;
+    }
+#endif
+}
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+/**
+ * Changes the period of each row strobe, rescaling the brightness quantum so that the display is no brighter or dimmer.
+ *
+ * @param period The new strobe period, in timer ticks.
+ */
+void NRF52LEDMatrix::setStrobePeriod(uint32_t period)
+{
+    strobePeriod = period;
+    quantum = (strobePeriod * brightness) / (256 * 255);
+    buildRowTables();
+}
+
+/**
+ * Drops the refresh rate once the display has been static for a while, and restores it as soon as the display changes.
+ */
+void NRF52LEDMatrix::updateRefreshRate()
+{
+    uint32_t last = generation;
+
+    updateRowTables();
+
+    if (generation != last)
+    {
+        staticFrames = 0;
+
+        if (strobePeriod != timerPeriod)
+            setStrobePeriod(timerPeriod);
+    }
+    else if (staticFrames < CONFIG_NRF52_LED_MATRIX_IDLE_FRAMES && ++staticFrames == CONFIG_NRF52_LED_MATRIX_IDLE_FRAMES)
+    {
+        setStrobePeriod(NRF52_LED_MATRIX_CLOCK_FREQUENCY / (CONFIG_NRF52_LED_MATRIX_IDLE_FREQUENCY * timeslots));
+    }
+}
+#endif
+
+/**
+ * Turns off the LED drive to the given row.
+ */
+void NRF52LEDMatrix::rowOff(int row)
+{
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    rowPort[row]->OUTCLR = rowMask[row];
+#else
+    matrixMap.rowPins[row]->setDigitalValue(0);
+#endif
+}
+
+/**
+ * Turns on the LED drive to the given row.
+ */
+void NRF52LEDMatrix::rowOn(int row)
+{
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    rowPort[row]->OUTSET = rowMask[row];
+#else
+    matrixMap.rowPins[row]->setDigitalValue(1);
+#endif
+}
+
+/**
+ * Returns the GPIOTE channel, PPI channel and timer period borrowed for light sensing to LED drive.
+ */
+void NRF52LEDMatrix::endLightSense()
+{
+    // Only the first channel is repurposed for sensing. The GPIOTE configuration of every column is rewritten from the
+    // row tables on each strobe, so there's no need to reconfigure the whole display (and recompute the row tables) here.
+    NRF_GPIOTE->CONFIG[gpiote[0]] = 0x00010003 | (matrixMap.columnPins[0]->name << 8);
+    NRF_PPI->CH[ppi[0]].EEP = (uint32_t) &timer.timer->EVENTS_COMPARE[1];
+    NRF_PPI->CH[ppi[0]].TEP = (uint32_t) &NRF_GPIOTE->TASKS_SET[gpiote[0]];
+
+    timer.setCompare(0, timerPeriod);
+}
+
+/**
+ * Configure the next frame to be drawn.
+ */
+void NRF52LEDMatrix::render()
+{
+    MICROBIT_TRACE_SCOPE(MICROBIT_TRACE_DISPLAY_RENDER, strobeRow);
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+    uint32_t start = audio_stats_begin();
+    bool sensing = strobeRow >= matrixMap.rows;
+#endif
+
+    if (strobeRow < matrixMap.rows)
+    {
+        // We just completed a normal diplay strobe. 
+        // Turn off the LED drive to the row that was completed.
+        rowOff(strobeRow);
+    }
+    else
+    {
+        // We just completed a light sense strobe. Record the light level sensed.
+        lightLevel = 255 - ((255 * timer.timer->CC[1]) / (timerPeriod * NRF52_LED_MATRIX_LIGHTSENSE_STROBES));
+        lightTime = system_timer_current_time();
+        lightRequest = false;
+        status |= NRF52_LEDMATRIX_STATUS_LIGHTREADY;
+
+        // Restore the hardware configuration into LED drive mode.
+        endLightSense();
+    }
+    
+#if !CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    // Stop the timer temporarily, to avoid possible race conditions.
+    timer.timer->TASKS_STOP = 1;
+#endif
+
+    // Move on to the next row.
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+    // Skip any dark rows absorbed by the strobe just completed.
+    strobeRow = strobeRow + (strobeRow < matrixMap.rows ? rowSpan[strobeRow] : 1);
+#else
+    strobeRow = strobeRow + 1;
+#endif
+
+    // At the end of a frame, take a light sense timeslot only if a reading has been requested.
+    bool lightSense = mode == DISPLAY_MODE_BLACK_AND_WHITE_LIGHT_SENSE || mode == DISPLAY_MODE_GREYSCALE_LIGHT_SENSE;
+
+    if (strobeRow > matrixMap.rows || (strobeRow == matrixMap.rows && !(lightSense && lightRequest)))
+        strobeRow = 0;
+
+    if(strobeRow < matrixMap.rows)
+    {
+        // Common case - load the precomputed timer values and polarities for this row.
+        // Changes to the image or its settings are picked up once per frame, so each frame is drawn consistently.
+        if (strobeRow == 0)
+        {
+            // Take any completed back buffer now, so that it is picked up below along with any other changes.
+            if (swapPending)
+            {
+                memcpy(image.getBitmap(), backBuffer.getBitmap(), width * height);
+                swapPending = false;
+                Event(id, NRF52_LED_MATRIX_EVT_SWAP_COMPLETE);
+            }
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+            updateRefreshRate();
+#else
+            updateRowTables();
+#endif
+        }
+
+        uint32_t *compare = rowCompare + strobeRow * matrixMap.columns;
+        uint32_t *config = rowConfig + strobeRow * matrixMap.columns;
+
+        for (int column = 0; column < matrixMap.columns; column++)
+        {
+            timer.timer->CC[column+1] = compare[column];
+            NRF_GPIOTE->CONFIG[gpiote[column]] = config[column];
+        }
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+        timer.timer->CC[0] = strobePeriod * rowSpan[strobeRow];
+#endif
 
         // Enable the drive pin, and start the timer.
-        matrixMap.rowPins[strobeRow]->setDigitalValue(1);
+        rowOn(strobeRow);
     }
     else
     {
@@ -315,6 +554,28 @@ void NRF52LEDMatrix::render()
     
     timer.timer->TASKS_CLEAR = 1;
     timer.timer->TASKS_START = 1;
+
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+    // Light sensing is counted on both the interrupt that starts a reading and the one that completes it.
+    uint32_t cycles = audio_stats_begin() - start;
+    sensing = sensing || strobeRow >= matrixMap.rows;
+
+    if (sensing)
+    {
+        stats.senses++;
+        stats.senseCycles += cycles;
+        stats.senseWorst = max(stats.senseWorst, cycles);
+    }
+    else
+    {
+        stats.strobes++;
+        stats.strobeCycles += cycles;
+        stats.strobeWorst = max(stats.strobeWorst, cycles);
+    }
+
+    if (strobeRow == 0)
+        stats.frames++;
+#endif
 }
 
 /**
@@ -346,13 +607,136 @@ int NRF52LEDMatrix::setBrightness(int b)
         return result;
 
     // Recalculate our quantum based on the new brightness setting.
-    quantum = (timerPeriod * brightness) / (256 * 255);
+    quantum = (strobePeriod * brightness) / (256 * 255);
+    tableDirty = true;
 
     return DEVICE_OK;
 }
 
 /**
- * Determines the last ambient light level sensed.
+ * Retrieves the processor cycles spent in the display interrupt, for row strobes and light sensing separately,
+ * and the number of frames drawn. Statistics are only collected if CONFIG_NRF52_LED_MATRIX_STATS is enabled.
+ *
+ * @return The statistics for this display, or NULL if statistics are disabled.
+ */
+const LEDMatrixStats *NRF52LEDMatrix::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+    return &stats;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Resets the display interrupt statistics, and restarts the collection period.
+ */
+void NRF52LEDMatrix::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+    memset(&stats, 0, sizeof(stats));
+    stats.resetTime = (uint32_t) system_timer_current_time();
+#endif
+}
+
+/**
+ * Outputs the display interrupt statistics via DMESG, including the average and worst case cost of each
+ * kind of interrupt, the frame rate, and the share of the processor used by the display.
+ */
+void NRF52LEDMatrix::printStats()
+{
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_STATS)
+    uint32_t elapsed = (uint32_t) system_timer_current_time() - stats.resetTime;
+    uint32_t strobeAverage = stats.strobes ? (uint32_t) (stats.strobeCycles / stats.strobes) : 0;
+    uint32_t senseAverage = stats.senses ? (uint32_t) (stats.senseCycles / stats.senses) : 0;
+    uint64_t available = (uint64_t) elapsed * (SystemCoreClock / 1000);
+
+    // Frame rate and processor load, both in tenths.
+    uint32_t fps = elapsed ? (stats.frames * 10000) / elapsed : 0;
+    uint32_t load = available ? (uint32_t) (((stats.strobeCycles + stats.senseCycles) * 1000) / available) : 0;
+
+    DMESG("DISPLAY_STATS: strobes %d avg %d worst %d senses %d avg %d worst %d fps %d.%d load %d.%d%%", stats.strobes, strobeAverage,
+        stats.strobeWorst, stats.senses, senseAverage, stats.senseWorst, fps / 10, fps % 10, load / 10, load % 10);
+#else
+    DMESG("DISPLAY_STATS: disabled");
+#endif
+}
+
+/**
+ * Determines how many distinct frames have been shown. This is incremented whenever the image, rotation, mode or
+ * brightness has changed since the previous frame, so is unchanged for as long as a static image is displayed.
+ *
+ * @return The frame generation.
+ */
+uint32_t NRF52LEDMatrix::getFrameGeneration()
+{
+    return generation;
+}
+
+/**
+ * Provides a back buffer that can be drawn into without affecting the display, for tear free animation.
+ * Once a frame is complete, call swap() to show it.
+ *
+ * @return The back buffer, of the same size as the display.
+ */
+Image &NRF52LEDMatrix::getBackBuffer()
+{
+    if (backBuffer.getWidth() != width || backBuffer.getHeight() != height)
+    {
+        backBuffer = Image(width, height);
+        memcpy(backBuffer.getBitmap(), image.getBitmap(), width * height);
+    }
+
+    return backBuffer;
+}
+
+/**
+ * Shows the contents of the back buffer, from the start of the next frame scan.
+ *
+ * @param wait If true, the calling fiber waits until the new image has been taken (at most one frame).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if getBackBuffer() has not been called.
+ */
+int NRF52LEDMatrix::swap(bool wait)
+{
+    if (backBuffer.getWidth() != width || backBuffer.getHeight() != height)
+        return DEVICE_INVALID_STATE;
+
+    // If the display isn't being scanned there is no frame to tear, so take the new image straight away.
+    if (!enabled)
+    {
+        memcpy(image.getBitmap(), backBuffer.getBitmap(), width * height);
+        swapPending = false;
+        return DEVICE_OK;
+    }
+
+    // Arm the wait with the display interrupt masked, so the back buffer can't be taken (and the event missed) in between.
+    // From interrupt context, or before the scheduler is running, we can't wait at all.
+    bool block = wait && fiber_scheduler_running() && (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0;
+
+    timer.disableIRQ();
+    swapPending = true;
+    bool waiting = block && fiber_wake_on_event(id, NRF52_LED_MATRIX_EVT_SWAP_COMPLETE) == DEVICE_OK;
+    timer.enableIRQ();
+
+    if (waiting)
+        schedule();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if a swap() is still waiting for the start of the next frame.
+ *
+ * @return true if the back buffer has yet to be taken.
+ */
+bool NRF52LEDMatrix::isSwapPending()
+{
+    return swapPending;
+}
+
+/**
+ * Determines the last ambient light level sensed. If the last reading is older than CONFIG_NRF52_LED_MATRIX_LIGHTSENSE_INTERVAL,
+ * a new reading is taken at the end of the current frame, and the calling fiber waits for it.
  *
  * @return The light level sensed, as an unsigned 8-bit value in the range 0..255
  */
@@ -372,9 +756,18 @@ NRF52LEDMatrix::readLightLevel()
         status &= ~NRF52_LEDMATRIX_STATUS_LIGHTREADY;
     }
 
-    // if we've just enabled light sensing, ensure we have a valid reading before returning.
-    if ( ( status & NRF52_LEDMATRIX_STATUS_LIGHTREADY) == 0)
-        fiber_sleep(1500.0f/((float)NRF52_LED_MATRIX_FREQUENCY));
+    // Light is only sampled on request. If we have no reading, or it is older than the sampling interval, take a new one.
+    if ((status & NRF52_LEDMATRIX_STATUS_LIGHTREADY) == 0 || system_timer_current_time() - lightTime >= CONFIG_NRF52_LED_MATRIX_LIGHTSENSE_INTERVAL)
+    {
+        lightRequest = true;
+
+        // The reading is taken at the end of the current frame. Allow for that frame, and the sensing timeslot itself.
+        if (enabled)
+        {
+            for (int i = 0; i < 3 && lightRequest; i++)
+                fiber_sleep(1000.0f/((float)NRF52_LED_MATRIX_FREQUENCY));
+        }
+    }
 
     return lightLevel;
 }
@@ -406,4 +799,15 @@ int NRF52LEDMatrix::setSleep(bool doSleep)
 NRF52LEDMatrix::~NRF52LEDMatrix()
 {
     this->status &= ~DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+
+    delete[] rowCompare;
+    delete[] rowConfig;
+    delete[] tableImage;
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_DIRECT_SCAN)
+    delete[] rowPort;
+    delete[] rowMask;
+#endif
+#if CONFIG_ENABLED(CONFIG_NRF52_LED_MATRIX_ADAPTIVE_REFRESH)
+    delete[] rowSpan;
+#endif
 }
\ No newline at end of file
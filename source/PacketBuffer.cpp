@@ -24,10 +24,99 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "PacketBuffer.h"
+#include "MicroBitRadio.h"
 #include "ErrorNo.h"
+#include "MicroBitHeapProfile.h"
+#include "RefCountedUtil.h"
 
 using namespace codal;
 
+// The payload, wherever it is held.
+static inline uint8_t *bytes(PacketData *p)
+{
+    return p->frame ? p->frame->payload : p->payload;
+}
+
+#if MICROBIT_PACKET_BUFFER_SLAB_BLOCKS > 0
+#define PACKET_BUFFER_SLAB_CLASSES      2
+
+// A free block in a slab, linked through its first word.
+struct PacketSlabBlock
+{
+    PacketSlabBlock     *next;
+};
+
+static const int slabPayload[PACKET_BUFFER_SLAB_CLASSES] = { MICROBIT_PACKET_BUFFER_SLAB_SMALL, MICROBIT_RADIO_MAX_PACKET_SIZE };
+static PacketSlabBlock *slabFree[PACKET_BUFFER_SLAB_CLASSES];
+
+// The size of each block in a size class, rounded up to keep every block word aligned.
+static inline int slab_block_size(int c)
+{
+    return (sizeof(PacketData) + slabPayload[c] + 3) & ~3;
+}
+
+/*
+ * Takes a block from the smallest size class that can hold the given payload, growing the class if it has run out.
+ * Blocks are never returned to the heap, so the slabs settle at the peak number of packets in use.
+ */
+static PacketData *slab_alloc(int length)
+{
+    for (int c = 0; c < PACKET_BUFFER_SLAB_CLASSES; c++)
+    {
+        if (length > slabPayload[c])
+            continue;
+
+        target_disable_irq();
+        PacketSlabBlock *b = slabFree[c];
+        if (b)
+            slabFree[c] = b->next;
+        target_enable_irq();
+
+        if (b == NULL)
+        {
+            int size = slab_block_size(c);
+            uint8_t *blocks = (uint8_t *) malloc(size * MICROBIT_PACKET_BUFFER_SLAB_BLOCKS);
+            MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_PACKET_BUFFER, blocks, size * MICROBIT_PACKET_BUFFER_SLAB_BLOCKS);
+
+            if (blocks == NULL)
+                return NULL;
+
+            // Keep the first block, and give the rest to the free list.
+            b = (PacketSlabBlock *) blocks;
+
+            target_disable_irq();
+            for (int i = 1; i < MICROBIT_PACKET_BUFFER_SLAB_BLOCKS; i++)
+            {
+                PacketSlabBlock *f = (PacketSlabBlock *) (blocks + i * size);
+                f->next = slabFree[c];
+                slabFree[c] = f;
+            }
+            target_enable_irq();
+        }
+
+        PacketData *p = (PacketData *) b;
+        p->slab = c + 1;
+        return p;
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns a block to its size class.
+ */
+static void slab_free(PacketData *p)
+{
+    int c = p->slab - 1;
+    PacketSlabBlock *b = (PacketSlabBlock *) p;
+
+    target_disable_irq();
+    b->next = slabFree[c];
+    slabFree[c] = b;
+    target_enable_irq();
+}
+#endif
+
 // Create the EmptyPacket reference.
 PacketBuffer PacketBuffer::EmptyPacket = PacketBuffer(1);
 
@@ -80,6 +169,38 @@ PacketBuffer::PacketBuffer(uint8_t *data, int length, int rssi)
     this->init(data, length, rssi);
 }
 
+/**
+  * Constructor.
+  * Creates a Packet Buffer holding the payload of a received radio frame, taking ownership of the frame.
+  *
+  * Frames taken from the MicroBitRadio receive pool are adopted without copying, and are returned to the
+  * pool once the last PacketBuffer referring to them is released. Any other frame is copied and deleted.
+  *
+  * @param frame The received frame.
+  *
+  * @note Adopted frames are unavailable to the receiver until released, so holding many received
+  *       PacketBuffers at once will cause incoming packets to be dropped. See MicroBitRadio::setQueueDepth().
+  */
+PacketBuffer::PacketBuffer(FrameBuffer *frame)
+{
+    int length = frame->length - (MICROBIT_RADIO_HEADER_SIZE - 1);
+
+    ptr = MicroBitRadio::instance ? MicroBitRadio::instance->getRxPacketData(frame) : NULL;
+
+    if (ptr == NULL)
+    {
+        this->init(frame->payload, length, frame->rssi);
+        delete frame;
+        return;
+    }
+
+    ptr->init();
+    ptr->length = length;
+    ptr->slab = 0;
+    ptr->rssi = frame->rssi;
+    ptr->frame = frame;
+}
+
 /**
   * Copy Constructor.
   * Add ourselves as a reference to an existing PacketBuffer.
@@ -111,11 +232,22 @@ void PacketBuffer::init(uint8_t *data, int length, int rssi)
     if (length < 0)
         length = 0;
 
-    ptr = (PacketData *) malloc(sizeof(PacketData) + length);
+#if MICROBIT_PACKET_BUFFER_SLAB_BLOCKS > 0
+    ptr = slab_alloc(length);
+
+    if (ptr == NULL)
+#endif
+    {
+        ptr = (PacketData *) malloc(sizeof(PacketData) + length);
+        MICROBIT_HEAP_ALLOC(MICROBIT_HEAP_TAG_PACKET_BUFFER, ptr, sizeof(PacketData) + length);
+        ptr->slab = 0;
+    }
+
     ptr->init();
 
     ptr->length = length;
     ptr->rssi = rssi;
+    ptr->frame = NULL;
 
     // Copy in the data buffer, if provided.
     if (data)
@@ -129,6 +261,39 @@ void PacketBuffer::init(uint8_t *data, int length, int rssi)
   */
 PacketBuffer::~PacketBuffer()
 {
+    release();
+}
+
+/**
+  * Drops our reference to the payload data. Data adopted from a radio receive buffer is returned to
+  * the receive pool along with its last reference, rather than being freed to the heap.
+  */
+void PacketBuffer::release()
+{
+    if (refcounted_is_unique(ptr))
+    {
+        if (ptr->frame)
+        {
+            FrameBuffer *frame = ptr->frame;
+            ptr->frame = NULL;
+
+            // The PacketData lives alongside the frame in the receive pool, so this releases both.
+            delete frame;
+            return;
+        }
+
+#if MICROBIT_PACKET_BUFFER_SLAB_BLOCKS > 0
+        if (ptr->slab)
+        {
+            slab_free(ptr);
+            return;
+        }
+#endif
+
+        // This is the last reference, so decr() frees the payload.
+        MICROBIT_HEAP_FREE(MICROBIT_HEAP_TAG_PACKET_BUFFER, ptr);
+    }
+
     ptr->decr();
 }
 
@@ -157,7 +322,7 @@ PacketBuffer& PacketBuffer::operator = (const PacketBuffer &p)
     if(ptr == p.ptr)
         return *this;
 
-    ptr->decr();
+    release();
     ptr = p.ptr;
     ptr->incr();
 
@@ -178,7 +343,7 @@ PacketBuffer& PacketBuffer::operator = (const PacketBuffer &p)
   */
 uint8_t PacketBuffer::operator [] (int i) const
 {
-    return ptr->payload[i];
+    return bytes(ptr)[i];
 }
 
 /**
@@ -195,7 +360,7 @@ uint8_t PacketBuffer::operator [] (int i) const
   */
 uint8_t& PacketBuffer::operator [] (int i)
 {
-    return ptr->payload[i];
+    return bytes(ptr)[i];
 }
 
 /**
@@ -222,7 +387,7 @@ bool PacketBuffer::operator== (const PacketBuffer& p)
     if (ptr == p.ptr)
         return true;
     else
-        return (ptr->length == p.ptr->length && (memcmp(ptr->payload, p.ptr->payload, ptr->length)==0));
+        return (ptr->length == p.ptr->length && (memcmp(bytes(ptr), bytes(p.ptr), ptr->length)==0));
 }
 
 /**
@@ -243,7 +408,7 @@ int PacketBuffer::setByte(int position, uint8_t value)
 {
     if (position < ptr->length)
     {
-        ptr->payload[position] = value;
+        bytes(ptr)[position] = value;
         return DEVICE_OK;
     }
     else
@@ -268,7 +433,7 @@ int PacketBuffer::setByte(int position, uint8_t value)
 int PacketBuffer::getByte(int position)
 {
     if (position < ptr->length)
-        return ptr->payload[position];
+        return bytes(ptr)[position];
     else
         return DEVICE_INVALID_PARAMETER;
 }
@@ -280,7 +445,7 @@ int PacketBuffer::getByte(int position)
   */
 uint8_t*PacketBuffer::getBytes()
 {
-    return ptr->payload;
+    return bytes(ptr);
 }
 
 /**
@@ -28,6 +28,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalUtil.h"
 #include "ErrorNo.h"
 #include "MicroBitAudio.h"
+#include "AudioKernels.h"
 
 using namespace codal;
 
@@ -39,7 +40,9 @@ SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate) : Coda
 {
     this->downStream = NULL;
     this->bufferSize = EMOJI_SYNTHESIZER_BUFFER_SIZE;
-    this->position = 0.0f;
+    this->phase = 0;
+    this->toneTable = NULL;
+    this->toneTableFunction = NULL;
     this->effect = NULL;
     this->partialBuffer = NULL;
     this->playbackCompleteIn = 0;
@@ -48,6 +51,8 @@ SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate) : Coda
     this->samplesToWrite = 0;
     this->samplesWritten = 0;
 
+    resetStats();
+
     setSampleRate(sampleRate);
     setSampleRange(1023);
     setOrMask(0);
@@ -59,6 +64,7 @@ SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate) : Coda
  */
 SoundEmojiSynthesizer::~SoundEmojiSynthesizer()
 {
+    free(toneTable);
 }
 
 /**
@@ -124,9 +130,11 @@ int SoundEmojiSynthesizer::play(ManagedBuffer sound)
 
     // Perform on demand activiation if this is the first time this compoennt has been used.
     // Simply issue a pull request to start the process.
-    if (!(status & EMOJI_SYNTHESIZER_STATUS_ACTIVE))
+    // Similarly, resume if we have suspended ourselves during a period of silence.
+    if (!(status & EMOJI_SYNTHESIZER_STATUS_ACTIVE) || (status & EMOJI_SYNTHESIZER_STATUS_SUSPENDED))
     {
         status |= EMOJI_SYNTHESIZER_STATUS_ACTIVE;
+        status &= ~EMOJI_SYNTHESIZER_STATUS_SUSPENDED;
         downStream->pullRequest();
     }
 
@@ -195,6 +203,8 @@ bool SoundEmojiSynthesizer::nextSoundEffect()
  */
 ManagedBuffer SoundEmojiSynthesizer::pull()
 {
+    AUDIO_STATS_SCOPE(stats);
+
     ManagedBuffer output = buffer2;
 
     // If the last DMA buffer was only partially filled, try to fill it.
@@ -208,6 +218,13 @@ ManagedBuffer SoundEmojiSynthesizer::pull()
     // Generate another buffer if possible. This may be empty if there is no sound effect scheduled.
     fillOutputBuffer();
 
+    // If we have nothing left to send, stop requesting pulls until a new sound effect is played. This lets the mixer skip us.
+    if (buffer.length() == 0 && buffer2.length() == 0 && playbackCompleteIn == 0 && (status & EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY))
+    {
+        status |= EMOJI_SYNTHESIZER_STATUS_SUSPENDED;
+        return output;
+    }
+
     // Issue a Pull Request so that we are always receiver driven, and we're done.
     downStream->pullRequest();
 
@@ -223,6 +240,40 @@ ManagedBuffer SoundEmojiSynthesizer::pull()
     return output;
 }
 
+/**
+ * Provides a precomputed wavetable for the given tonePrint, if it is a built in tonePrint
+ * whose output depends only upon position.
+ *
+ * @param tone The tonePrint to render.
+ * @return A table of EMOJI_SYNTHESIZER_TONE_WIDTH samples, or NULL if the tonePrint must be evaluated per sample.
+ */
+const uint16_t *SoundEmojiSynthesizer::getToneTable(TonePrint &tone)
+{
+    // Only tabulate tonePrints known to ignore their parameter and to be deterministic. Others (e.g. noise) are evaluated per sample.
+    if (tone.tonePrint != Synthesizer::SineTone && tone.tonePrint != Synthesizer::SawtoothTone &&
+        tone.tonePrint != Synthesizer::TriangleTone && tone.tonePrint != Synthesizer::SquareWaveTone)
+        return NULL;
+
+    if (tone.tonePrint == toneTableFunction)
+        return toneTable;
+
+    // A single table is kept, and rebuilt whenever the waveform changes.
+    if (toneTable == NULL)
+    {
+        toneTable = (uint16_t *) malloc(EMOJI_SYNTHESIZER_TONE_WIDTH * sizeof(uint16_t));
+
+        if (toneTable == NULL)
+            return NULL;
+    }
+
+    for (int i = 0; i < EMOJI_SYNTHESIZER_TONE_WIDTH; i++)
+        toneTable[i] = tone.tonePrint(tone.parameter, i);
+
+    toneTableFunction = tone.tonePrint;
+
+    return toneTable;
+}
+
 /**
  * Provide the next available ManagedBuffer to our downstream caller, if available.
  */
@@ -271,8 +322,11 @@ ManagedBuffer SoundEmojiSynthesizer::fillOutputBuffer()
             }
             else
             {
-                buffer = ManagedBuffer(bufferSize);
+                // Drop our own reference first, so the buffer can be recycled once it has been played out.
+                buffer = ManagedBuffer();
+                buffer = bufferPool.allocate(bufferSize);
                 sample = (uint16_t *) &buffer[0];
+                AUDIO_LATENCY_STAMP(buffer);
             }
 
             bufferEnd = (uint16_t *) (&buffer[0] + buffer.length());
@@ -281,9 +335,19 @@ ManagedBuffer SoundEmojiSynthesizer::fillOutputBuffer()
         // Generate some samples with the current effect parameters.
         while(samplesWritten < samplesToWrite)
         {
-            float skip = ((EMOJI_SYNTHESIZER_TONE_WIDTH_F * frequency) / sampleRate);
-            float gain = (sampleRange * volume) / 1024.0f;
-            float offset = 512.0f - (512.0f * gain);
+            // Determine the phase increment per sample, as a fraction of the tonePrint. Whole cycles have no effect on the phase.
+            float cycles = frequency / sampleRate;
+            cycles -= (int) cycles;
+            if (cycles < 0.0f)
+                cycles += 1.0f;
+
+            uint32_t skip = (uint32_t) (cycles * 4294967296.0f);
+
+            // Volume scaling, applied in 16.16 fixed point.
+            int32_t gain = (int32_t) (((sampleRange * volume) / 1024.0f) * 65536.0f);
+            int32_t offset = (512 << 16) - (512 * gain);
+
+            const uint16_t *table = getToneTable(effect->tone);
 
             int effectStepEnd[EMOJI_SYNTHESIZER_TONE_EFFECTS];
 
@@ -306,19 +370,16 @@ ManagedBuffer SoundEmojiSynthesizer::fillOutputBuffer()
                     return buffer;
 
                 // Synthesize a sample
-                float s = effect->tone.tonePrint(effect->tone.parameter, (int) position);
+                int index = phase >> EMOJI_SYNTHESIZER_PHASE_SHIFT;
+                int32_t s = table ? table[index] : effect->tone.tonePrint(effect->tone.parameter, index);
 
                 // Apply volume scaling and OR mask (if specified).
-                *sample = ((uint16_t) ((s * gain) + offset)) | orMask;
+                *sample = ((uint16_t) ((s * gain + offset) >> 16)) | orMask;
 
-                // Move on our pointers.
+                // Move on our pointers. The phase wraps around the end of the toneprint with the accumulator.
                 sample++;
                 samplesWritten++;
-                position += skip;
-
-                // Keep our toneprint pointer in range
-                while(position > EMOJI_SYNTHESIZER_TONE_WIDTH_F)
-                    position -= EMOJI_SYNTHESIZER_TONE_WIDTH_F;
+                phase += skip;
             }
 
             // Invoke the effect function for any effects that are due.
@@ -347,11 +408,7 @@ ManagedBuffer SoundEmojiSynthesizer::fillOutputBuffer()
     {
         // Pad the output buffer with silence if necessary.
         uint16_t silence = ((uint16_t) (sampleRange *0.5f)) | orMask;
-        while(sample < bufferEnd)
-        {
-            *sample = silence;
-            sample++;
-        }
+        audio_fill_u16(sample, bufferEnd - sample, silence);
     }
 
     return buffer;
@@ -446,4 +503,29 @@ void SoundEmojiSynthesizer::allowEmptyBuffers(bool mode)
         this->status &= ~EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY;
 
     
+}
+
+/**
+ * Retrieves the cost of each pull made of this component.
+ * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+ *
+ * @return The statistics for this component, or NULL if statistics are disabled.
+ */
+const AudioStats *SoundEmojiSynthesizer::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    return &stats;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Resets the statistics of this component.
+ */
+void SoundEmojiSynthesizer::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(stats);
+#endif
 }
\ No newline at end of file
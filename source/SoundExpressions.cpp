@@ -40,7 +40,14 @@ using namespace codal;
   * Default Constructor.
   */
 SoundExpressions::SoundExpressions(SoundEmojiSynthesizer &synth): synth(synth)
-{}
+{
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+    cacheUseCount = 0;
+
+    for (int i = 0; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++)
+        cacheLastUsed[i] = 0;
+#endif
+}
 
 /**
   * Destructor.
@@ -78,8 +85,59 @@ void SoundExpressions::play(ManagedString sound, uint16_t event) {
 }
 
 void SoundExpressions::playAsync(ManagedString sound) {
-    // Sound is either encoded data or a name of a built-in sound for which we have the data.
-    sound = lookupBuiltIn(sound);
+    ManagedBuffer b = compile(sound);
+
+    if (b.length())
+        synth.play(b);
+}
+
+/**
+ * Plays one of the built in sounds.
+ * Blocks until the sound is complete.
+ */
+void SoundExpressions::play(BuiltInSound sound, uint16_t event)
+{
+    fiber_wake_on_event(synth.id, event);
+    playAsync(sound);
+    schedule();
+}
+
+/**
+ * Plays one of the built in sounds.
+ * Does not block unless a sound effect is already queued.
+ */
+void SoundExpressions::playAsync(BuiltInSound sound)
+{
+    synth.play(compile(sound));
+}
+
+/**
+ * Compiles a sound expression into an array of SoundEffect structures, which may be played any number of times
+ * through play(ManagedBuffer) or playAsync(ManagedBuffer) without being parsed again.
+ */
+ManagedBuffer SoundExpressions::compile(ManagedString sound) {
+    // Sound is either encoded data or a name of a built-in sound, which is held already decoded.
+    int builtIn = lookupBuiltIn(sound);
+    if (builtIn >= 0) {
+        return compile((BuiltInSound) builtIn);
+    }
+
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+    // If we've compiled this expression recently, reuse the result. The only state the synthesizer keeps within
+    // a SoundEffect is its step count, which is reset as each effect starts, so the same buffer can be replayed.
+    for (int i = 0; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++)
+    {
+        if (cacheEffects[i].length() && cacheKey[i] == sound)
+        {
+            cacheLastUsed[i] = ++cacheUseCount;
+            return cacheEffects[i];
+        }
+    }
+
+    ManagedString key = sound;
+    bool deterministic = true;
+#endif
+
     const unsigned soundLen = sound.length();
     const char *soundChars = sound.toCharArray();
 
@@ -88,7 +146,7 @@ void SoundExpressions::playAsync(ManagedString sound) {
     const unsigned effectCount = (soundLen + 1) / (charsPerEffect + 1);
     const unsigned expectedLength = effectCount * (charsPerEffect + 1) - 1;
     if (soundLen != expectedLength) {
-        return;
+        return ManagedBuffer();
     }
     
     ManagedBuffer b(sizeof(SoundEffect) * effectCount);
@@ -96,13 +154,43 @@ void SoundExpressions::playAsync(ManagedString sound) {
     for (unsigned i = 0; i < effectCount; ++i)  {
         const int start = i * charsPerEffect + i;
         if (start > 0 && soundChars[start - 1] != ',') {
-            return;
+            return ManagedBuffer();
         }
-        if (!parseSoundExpression(&soundChars[start], fx++)) {
-            return;
+        SoundExpressionEffect effect;
+        decodeSoundExpression(&soundChars[start], &effect);
+        if (!buildSoundEffect(effect, fx++)) {
+            return ManagedBuffer();
         }
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+        deterministic = deterministic && isDeterministic(effect);
+#endif
+    }
+
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+    // Retain the result, replacing an empty or the least recently used entry.
+    if (deterministic)
+    {
+        int victim = 0;
+
+        for (int i = 1; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++)
+            if (cacheLastUsed[i] < cacheLastUsed[victim])
+                victim = i;
+
+        cacheKey[victim] = key;
+        cacheEffects[victim] = b;
+        cacheLastUsed[victim] = ++cacheUseCount;
     }
-    synth.play(b);
+#endif
+
+    return b;
+}
+
+/**
+ * Determines if the given effect is free of randomness, and so builds the same SoundEffect every time.
+ */
+bool SoundExpressions::isDeterministic(const SoundExpressionEffect &effect) {
+    return effect.frequencyRandom == 0 && effect.endFrequencyRandom == 0 && effect.volumeRandom == 0 && effect.endVolumeRandom == 0 &&
+        effect.durationRandom == 0 && effect.fxParamRandom == 0 && effect.fxnStepsRandom == 0;
 }
 
 int SoundExpressions::parseDigits(const char *input, const int digits) {
@@ -135,53 +223,68 @@ int SoundExpressions::applyRandom(int value, int rand) {
     return abs(value + delta);
 }
 
-bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundEffect *fx) {
+void SoundExpressions::decodeSoundExpression(const char *soundChars, SoundExpressionEffect *effect) {
     // Encoded as a sequence of zero padded decimal strings.
     // This encoding is worth reconsidering if we can!
     // The ADSR effect (and perhaps others in future) has two parameters which cannot be expressed.
 
     // 72 chars total
     //  [0] 0-4 wave
-    int wave = parseDigits(&soundChars[0], 1);
+    effect->wave = parseDigits(&soundChars[0], 1);
     //  [1] 0000-1023 volume
-    int effectVolume = parseDigits(&soundChars[1], 4);
+    effect->volume = parseDigits(&soundChars[1], 4);
     //  [5] 0000-9999 frequency
-    int frequency = parseDigits(&soundChars[5], 4);
+    effect->frequency = parseDigits(&soundChars[5], 4);
     //  [9] 0000-9999 duration
-    int duration = parseDigits(&soundChars[9], 4);
+    effect->duration = parseDigits(&soundChars[9], 4);
     // [13] 00 shape (specific known values)
-    int shape = parseDigits(&soundChars[13], 2);
+    effect->shape = parseDigits(&soundChars[13], 2);
     // [15] XXX unused/bug. This was startFrequency but we use frequency above.
     // [18] 0000-9999 end frequency
-    int endFrequency = parseDigits(&soundChars[18], 4);
+    effect->endFrequency = parseDigits(&soundChars[18], 4);
     // [22] XXXX unused. This was start volume but we use volume above.
     // [26] 0000-1023 end volume
-    int endVolume = parseDigits(&soundChars[26], 4);
+    effect->endVolume = parseDigits(&soundChars[26], 4);
     // [30] 0000-9999 steps
-    int steps = parseDigits(&soundChars[30], 4);
+    effect->steps = parseDigits(&soundChars[30], 4);
     // [34] 00-03 fx choice
-    int fxChoice = parseDigits(&soundChars[34], 2);
+    effect->fxChoice = parseDigits(&soundChars[34], 2);
     // [36] 0000-9999 fxParam
-    int fxParam = parseDigits(&soundChars[36], 4);
+    effect->fxParam = parseDigits(&soundChars[36], 4);
     // [40] 0000-9999 fxnSteps
-    int fxnSteps = parseDigits(&soundChars[40], 4);
+    effect->fxnSteps = parseDigits(&soundChars[40], 4);
 
     // Details that encoded randomness to be applied when frame is used:
-    // Can the randomness cause any parameters to go out of range?
     // [44] 0000-9999 frequency random
-    frequency = applyRandom(frequency, parseDigits(&soundChars[44], 4));
+    effect->frequencyRandom = parseDigits(&soundChars[44], 4);
     // [48] 0000-9999 end frequency random
-    endFrequency = applyRandom(endFrequency, parseDigits(&soundChars[48], 4));
+    effect->endFrequencyRandom = parseDigits(&soundChars[48], 4);
     // [52] 0000-9999 volume random
-    effectVolume = applyRandom(effectVolume, parseDigits(&soundChars[52], 4));
+    effect->volumeRandom = parseDigits(&soundChars[52], 4);
     // [56] 0000-9999 end volume random
-    endVolume = applyRandom(endVolume, parseDigits(&soundChars[56], 4));
+    effect->endVolumeRandom = parseDigits(&soundChars[56], 4);
     // [60] 0000-9999 duration random
-    duration = applyRandom(duration, parseDigits(&soundChars[60], 4));
+    effect->durationRandom = parseDigits(&soundChars[60], 4);
     // [64] 0000-9999 fxParamRandom
-    fxParam = applyRandom(fxParam, parseDigits(&soundChars[64], 4));
+    effect->fxParamRandom = parseDigits(&soundChars[64], 4);
     // [68] 0000-9999 fxnStepsRandom
-    fxnSteps = applyRandom(fxnSteps, parseDigits(&soundChars[68], 4));
+    effect->fxnStepsRandom = parseDigits(&soundChars[68], 4);
+}
+
+bool SoundExpressions::buildSoundEffect(const SoundExpressionEffect &effect, SoundEffect *fx) {
+    const int wave = effect.wave;
+    const int shape = effect.shape;
+    const int steps = effect.steps;
+    const int fxChoice = effect.fxChoice;
+
+    // Can the randomness cause any parameters to go out of range?
+    int frequency = applyRandom(effect.frequency, effect.frequencyRandom);
+    int endFrequency = applyRandom(effect.endFrequency, effect.endFrequencyRandom);
+    int effectVolume = applyRandom(effect.volume, effect.volumeRandom);
+    int endVolume = applyRandom(effect.endVolume, effect.endVolumeRandom);
+    int duration = applyRandom(effect.duration, effect.durationRandom);
+    int fxParam = applyRandom(effect.fxParam, effect.fxParamRandom);
+    int fxnSteps = applyRandom(effect.fxnSteps, effect.fxnStepsRandom);
 
     if (frequency == -1 || endFrequency == -1 || effectVolume == -1 || endVolume == -1 || duration == -1 || fxParam == -1 || fxnSteps == -1) {
         return false;
@@ -306,48 +409,132 @@ bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundEffect
     return true;
 }
 
-// Names and data for each built-in sound expression.
-static ManagedString giggle("giggle");
-static ManagedString giggleData("010230988019008440044008881023001601003300240000000000000000000000000000,110232570087411440044008880352005901003300010000000000000000010000000000,310232729021105440288908880091006300000000240700020000000000003000000000,310232729010205440288908880091006300000000240700020000000000003000000000,310232729011405440288908880091006300000000240700020000000000003000000000");
-static ManagedString happy("happy");
-static ManagedString happyData("010231992066911440044008880262002800001800020500000000000000010000000000,002322129029508440240408880000000400022400110000000000000000007500000000,000002129029509440240408880145000400022400110000000000000000007500000000");
-static ManagedString hello("hello");
-static ManagedString helloData("310230673019702440118708881023012800000000240000000000000000000000000000,300001064001602440098108880000012800000100040000000000000000000000000000,310231064029302440098108881023012800000100040000000000000000000000000000");
-static ManagedString mysterious("mysterious");
-static ManagedString mysteriousData("400002390033100440240408880477000400022400110400000000000000008000000000,405512845385000440044008880000012803010500160000000000000000085000500015");
-static ManagedString sad("sad");
-static ManagedString sadData("310232226070801440162408881023012800000100240000000000000000000000000000,310231623093602440093908880000012800000100240000000000000000000000000000");
-static ManagedString slide("slide");
-static ManagedString slideData("105202325022302440240408881023012801020000110400000000000000010000000000,010232520091002440044008881023012801022400110400000000000000010000000000");
-static ManagedString soaring("soaring");
-static ManagedString soaringData("210234009530905440599908881023002202000400020250000000000000020000000000,402233727273014440044008880000003101024400030000000000000000000000000000");
-static ManagedString spring("spring");
-static ManagedString springData("306590037116312440058708880807003400000000240000000000000000050000000000,010230037116313440058708881023003100000000240000000000000000050000000000");
-static ManagedString twinkle("twinkle");
-static ManagedString twinkleData("010180007672209440075608880855012800000000240000000000000000000000000000");
-static ManagedString yawn("yawn");
-static ManagedString yawnData("200002281133202440150008881023012801024100240400030000000000010000000000,005312520091002440044008880636012801022400110300000000000000010000000000,008220784019008440044008880681001600005500240000000000000000005000000000,004790784019008440044008880298001600000000240000000000000000005000000000,003210784019008440044008880108001600003300080000000000000000005000000000");
-
-ManagedString SoundExpressions::lookupBuiltIn(ManagedString sound) {
-    if (sound == giggle)
-        return giggleData;
-    if (sound == happy)
-        return happyData;
-    if (sound == hello)
-        return helloData;
-    if (sound == mysterious)
-        return mysteriousData;
-    if (sound == sad)
-        return sadData;
-    if (sound == slide)
-        return slideData;
-    if (sound == soaring)
-        return soaringData;
-    if (sound == spring)
-        return springData;
-    if (sound == twinkle)
-        return twinkleData;
-    if (sound == yawn)
-        return yawnData;
-    return sound;
+// Each built-in sound, decoded at build time from the encoded form shown above its table. Field order follows
+// SoundExpressionEffect; note that decoding applies no randomness, so that is still done as each sound is played.
+// 010230988019008440044008881023001601003300240000000000000000000000000000,110232570087411440044008880352005901003300010000000000000000010000000000,310232729021105440288908880091006300000000240700020000000000003000000000,310232729010205440288908880091006300000000240700020000000000003000000000,310232729011405440288908880091006300000000240700020000000000003000000000
+static const SoundExpressionEffect giggleEffects[] = {
+    { 0, 1023, 988, 190, 8, 440, 1023, 16, 1, 33, 24, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, 1023, 2570, 874, 11, 440, 352, 59, 1, 33, 1, 0, 0, 0, 0, 100, 0, 0 },
+    { 3, 1023, 2729, 211, 5, 2889, 91, 63, 0, 0, 24, 700, 200, 0, 0, 30, 0, 0 },
+    { 3, 1023, 2729, 102, 5, 2889, 91, 63, 0, 0, 24, 700, 200, 0, 0, 30, 0, 0 },
+    { 3, 1023, 2729, 114, 5, 2889, 91, 63, 0, 0, 24, 700, 200, 0, 0, 30, 0, 0 },
+};
+// 010231992066911440044008880262002800001800020500000000000000010000000000,002322129029508440240408880000000400022400110000000000000000007500000000,000002129029509440240408880145000400022400110000000000000000007500000000
+static const SoundExpressionEffect happyEffects[] = {
+    { 0, 1023, 1992, 669, 11, 440, 262, 28, 0, 18, 2, 500, 0, 0, 0, 100, 0, 0 },
+    { 0, 232, 2129, 295, 8, 2404, 0, 4, 0, 224, 11, 0, 0, 0, 0, 75, 0, 0 },
+    { 0, 0, 2129, 295, 9, 2404, 145, 4, 0, 224, 11, 0, 0, 0, 0, 75, 0, 0 },
+};
+// 310230673019702440118708881023012800000000240000000000000000000000000000,300001064001602440098108880000012800000100040000000000000000000000000000,310231064029302440098108881023012800000100040000000000000000000000000000
+static const SoundExpressionEffect helloEffects[] = {
+    { 3, 1023, 673, 197, 2, 1187, 1023, 128, 0, 0, 24, 0, 0, 0, 0, 0, 0, 0 },
+    { 3, 0, 1064, 16, 2, 981, 0, 128, 0, 1, 4, 0, 0, 0, 0, 0, 0, 0 },
+    { 3, 1023, 1064, 293, 2, 981, 1023, 128, 0, 1, 4, 0, 0, 0, 0, 0, 0, 0 },
+};
+// 400002390033100440240408880477000400022400110400000000000000008000000000,405512845385000440044008880000012803010500160000000000000000085000500015
+static const SoundExpressionEffect mysteriousEffects[] = {
+    { 4, 0, 2390, 331, 0, 2404, 477, 4, 0, 224, 11, 400, 0, 0, 0, 80, 0, 0 },
+    { 4, 551, 2845, 3850, 0, 440, 0, 128, 3, 105, 16, 0, 0, 0, 0, 850, 50, 15 },
+};
+// 310232226070801440162408881023012800000100240000000000000000000000000000,310231623093602440093908880000012800000100240000000000000000000000000000
+static const SoundExpressionEffect sadEffects[] = {
+    { 3, 1023, 2226, 708, 1, 1624, 1023, 128, 0, 1, 24, 0, 0, 0, 0, 0, 0, 0 },
+    { 3, 1023, 1623, 936, 2, 939, 0, 128, 0, 1, 24, 0, 0, 0, 0, 0, 0, 0 },
+};
+// 105202325022302440240408881023012801020000110400000000000000010000000000,010232520091002440044008881023012801022400110400000000000000010000000000
+static const SoundExpressionEffect slideEffects[] = {
+    { 1, 520, 2325, 223, 2, 2404, 1023, 128, 1, 200, 11, 400, 0, 0, 0, 100, 0, 0 },
+    { 0, 1023, 2520, 910, 2, 440, 1023, 128, 1, 224, 11, 400, 0, 0, 0, 100, 0, 0 },
+};
+// 210234009530905440599908881023002202000400020250000000000000020000000000,402233727273014440044008880000003101024400030000000000000000000000000000
+static const SoundExpressionEffect soaringEffects[] = {
+    { 2, 1023, 4009, 5309, 5, 5999, 1023, 22, 2, 4, 2, 250, 0, 0, 0, 200, 0, 0 },
+    { 4, 223, 3727, 2730, 14, 440, 0, 31, 1, 244, 3, 0, 0, 0, 0, 0, 0, 0 },
+};
+// 306590037116312440058708880807003400000000240000000000000000050000000000,010230037116313440058708881023003100000000240000000000000000050000000000
+static const SoundExpressionEffect springEffects[] = {
+    { 3, 659, 37, 1163, 12, 587, 807, 34, 0, 0, 24, 0, 0, 0, 0, 500, 0, 0 },
+    { 0, 1023, 37, 1163, 13, 587, 1023, 31, 0, 0, 24, 0, 0, 0, 0, 500, 0, 0 },
+};
+// 010180007672209440075608880855012800000000240000000000000000000000000000
+static const SoundExpressionEffect twinkleEffects[] = {
+    { 0, 1018, 7, 6722, 9, 756, 855, 128, 0, 0, 24, 0, 0, 0, 0, 0, 0, 0 },
+};
+// 200002281133202440150008881023012801024100240400030000000000010000000000,005312520091002440044008880636012801022400110300000000000000010000000000,008220784019008440044008880681001600005500240000000000000000005000000000,004790784019008440044008880298001600000000240000000000000000005000000000,003210784019008440044008880108001600003300080000000000000000005000000000
+static const SoundExpressionEffect yawnEffects[] = {
+    { 2, 0, 2281, 1332, 2, 1500, 1023, 128, 1, 241, 24, 400, 300, 0, 0, 100, 0, 0 },
+    { 0, 531, 2520, 910, 2, 440, 636, 128, 1, 224, 11, 300, 0, 0, 0, 100, 0, 0 },
+    { 0, 822, 784, 190, 8, 440, 681, 16, 0, 55, 24, 0, 0, 0, 0, 50, 0, 0 },
+    { 0, 479, 784, 190, 8, 440, 298, 16, 0, 0, 24, 0, 0, 0, 0, 50, 0, 0 },
+    { 0, 321, 784, 190, 8, 440, 108, 16, 0, 33, 8, 0, 0, 0, 0, 50, 0, 0 },
+};
+
+struct SoundExpressionBuiltIn
+{
+    const char *name;
+    const SoundExpressionEffect *effects;
+    int count;
+};
+
+// Indexed by BuiltInSound.
+static const SoundExpressionBuiltIn builtInSounds[SOUND_EXPRESSIONS_BUILT_IN_COUNT] = {
+    { "giggle",     giggleEffects,      sizeof(giggleEffects) / sizeof(SoundExpressionEffect) },
+    { "happy",      happyEffects,       sizeof(happyEffects) / sizeof(SoundExpressionEffect) },
+    { "hello",      helloEffects,       sizeof(helloEffects) / sizeof(SoundExpressionEffect) },
+    { "mysterious", mysteriousEffects,  sizeof(mysteriousEffects) / sizeof(SoundExpressionEffect) },
+    { "sad",        sadEffects,         sizeof(sadEffects) / sizeof(SoundExpressionEffect) },
+    { "slide",      slideEffects,       sizeof(slideEffects) / sizeof(SoundExpressionEffect) },
+    { "soaring",    soaringEffects,     sizeof(soaringEffects) / sizeof(SoundExpressionEffect) },
+    { "spring",     springEffects,      sizeof(springEffects) / sizeof(SoundExpressionEffect) },
+    { "twinkle",    twinkleEffects,     sizeof(twinkleEffects) / sizeof(SoundExpressionEffect) },
+    { "yawn",       yawnEffects,        sizeof(yawnEffects) / sizeof(SoundExpressionEffect) },
+};
+
+/**
+ * Determines the built-in sound with the given name.
+ * @return the BuiltInSound value of the sound, or -1 if there is no built-in sound of that name.
+ */
+int SoundExpressions::lookupBuiltIn(ManagedString sound) {
+    // Encoded expressions are always much longer than any name.
+    if (sound.length() > 16)
+        return -1;
+
+    for (int i = 0; i < SOUND_EXPRESSIONS_BUILT_IN_COUNT; i++)
+        if (strcmp(sound.toCharArray(), builtInSounds[i].name) == 0)
+            return i;
+
+    return -1;
+}
+
+/**
+ * Compiles one of the built in sounds into an array of SoundEffect structures, without any parsing.
+ */
+ManagedBuffer SoundExpressions::compile(BuiltInSound sound) {
+    const int index = (int) sound;
+    const SoundExpressionBuiltIn &builtIn = builtInSounds[index];
+
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+    if (builtInEffects[index].length())
+        return builtInEffects[index];
+
+    bool deterministic = true;
+#endif
+
+    ManagedBuffer b(sizeof(SoundEffect) * builtIn.count);
+    SoundEffect *fx = (SoundEffect *) &b[0];
+
+    for (int i = 0; i < builtIn.count; i++) {
+        buildSoundEffect(builtIn.effects[i], fx++);
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+        deterministic = deterministic && isDeterministic(builtIn.effects[i]);
+#endif
+    }
+
+#if CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE > 0
+    // Sounds with no randomness are the same every time, so are only ever built once.
+    if (deterministic)
+        builtInEffects[index] = b;
+#endif
+
+    return b;
 }
\ No newline at end of file
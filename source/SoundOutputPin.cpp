@@ -50,6 +50,10 @@ SoundOutputPin::SoundOutputPin(Mixer2 &mix, int id) : codal::Pin(id, 0, PIN_CAPA
     this->bufferWritePos = outputBuffer.getBytes();
     this->position = 0.0f;
     this->volume = 0;
+    this->periodicPeriodUs = -1;
+    this->periodicVolume = -1;
+
+    resetStats();
 
     // Enable lazy periodic callback and optimised silence generation.
     CodalComponent::status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
@@ -182,6 +186,13 @@ void SoundOutputPin::update()
         CodalComponent::status |= SOUND_OUTPUT_PIN_STATUS_ENABLED;
         channel->pullRequest();
     }
+
+#if CONFIG_ENABLED(CONFIG_SOUND_OUTPUT_PIN_PWM_BYPASS)
+    // If nothing else is playing, have the PWM hardware generate our tone directly, and let our mixer channel fall idle.
+    // idleCallback() restarts the channel if the bypass is later ended by another audio source.
+    if (MicroBitAudio::instance && MicroBitAudio::instance->setToneBypass(channel, periodUs, volume))
+        CodalComponent::status &= ~SOUND_OUTPUT_PIN_STATUS_ACTIVE;
+#endif
 }
 
 /**
@@ -236,33 +247,119 @@ void SoundOutputPin::updateOutputBuffer(bool all)
  */
 void SoundOutputPin::idleCallback()
 {
+#if CONFIG_ENABLED(CONFIG_SOUND_OUTPUT_PIN_PWM_BYPASS)
+    // Our tone is being generated by the PWM hardware, so there is nothing for us to do.
+    if (MicroBitAudio::instance && MicroBitAudio::instance->isToneBypassed())
+        return;
+#endif
+
     if ((CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE) && (this->volume == 0) && (system_timer_current_time() - this->timeOfLastUpdate > CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE))
         CodalComponent::status &= ~SOUND_OUTPUT_PIN_STATUS_ACTIVE;
 
     // If our volume is non-zero and we're not active, then restart to synthesizer.
     if (!(CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE) && this->volume > 0)
+    {
         CodalComponent::status |= SOUND_OUTPUT_PIN_STATUS_ACTIVE;
+
+        // Wake our mixer channel if we have let it fall idle.
+        if (CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_SUSPENDED)
+        {
+            CodalComponent::status &= ~SOUND_OUTPUT_PIN_STATUS_SUSPENDED;
+            channel->pullRequest();
+        }
+    }
 }
 
 ManagedBuffer SoundOutputPin::pull()
 {
+    AUDIO_STATS_SCOPE(stats);
+
     ManagedBuffer result;
 
     if (CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE)
     {
-        result = outputBuffer;
+        // If no samples have been backfilled since our last pull, nothing has changed and the output is periodic.
+        if (bufferWritePos == outputBuffer.getBytes())
+            result = getPeriodicBuffer();
+
+        if (result.length() == 0)
+        {
+            result = outputBuffer;
+
+            updateOutputBuffer(true);
+            outputBuffer = ManagedBuffer(SOUND_OUTPUT_PIN_BUFFER_SIZE);
+        }
 
-        updateOutputBuffer(true);
-        outputBuffer = ManagedBuffer(SOUND_OUTPUT_PIN_BUFFER_SIZE);
+        AUDIO_LATENCY_STAMP(result);
     }
 
     this->bufferWritePos = outputBuffer.getBytes();
     this->timeOfLastPull = system_timer_current_time();
-    channel->pullRequest();
+
+    // Whilst inactive, we have nothing to send. Stop requesting pulls, so the mixer can skip our channel until we restart.
+    if (CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE)
+        channel->pullRequest();
+    else
+        CodalComponent::status |= SOUND_OUTPUT_PIN_STATUS_SUSPENDED;
 
     return result;
 }
 
+/**
+ * Provides the next buffer of output whilst the sound parameters are unchanged since the last pull.
+ * In this steady state the output is periodic, so a buffer holding a whole number of periods is
+ * generated once, and then handed out repeatedly until the parameters change.
+ *
+ * @return The next buffer of output, or an empty buffer if the output cannot be generated this way.
+ */
+ManagedBuffer SoundOutputPin::getPeriodicBuffer()
+{
+#if CONFIG_ENABLED(CONFIG_SOUND_OUTPUT_PIN_TONEPRINT)
+    // Toneprint output is not sample aligned, so does not repeat exactly.
+    return ManagedBuffer();
+#else
+    uint32_t samplePeriodUs = (1000000 / SOUND_OUTPUT_PIN_SAMPLE_RATE);
+    uint32_t skip = periodUs / samplePeriodUs;
+    int period = skip + 1;
+    int start = (int) position;
+
+    if (period > SOUND_OUTPUT_PIN_BUFFER_SIZE)
+        return ManagedBuffer();
+
+    // Only a buffer starting at the beginning of a period can be reused. Otherwise, complete the current period
+    // (plus as many whole periods as fit) in a buffer of its own, so that we are aligned from the next pull onward.
+    int periods = (SOUND_OUTPUT_PIN_BUFFER_SIZE - (start ? period - start : 0)) / period;
+    int length = (start ? period - start : 0) + periods * period;
+
+    if (start == 0 && periodicBuffer.length() && periodicPeriodUs == periodUs && periodicVolume == volume)
+        return periodicBuffer;
+
+    ManagedBuffer b(length);
+    uint8_t *out = b.getBytes();
+
+    for (int i = 0; i < length; i++)
+    {
+        *out++ = position < skip / 2 ? this->volume : 0;
+        position++;
+
+        if(position > skip)
+            position = 0;
+    }
+
+    _periodUs = periodUs;
+    _value = value;
+
+    if (start == 0)
+    {
+        periodicBuffer = b;
+        periodicPeriodUs = periodUs;
+        periodicVolume = volume;
+    }
+
+    return b;
+#endif
+}
+
 int SoundOutputPin::getFormat()
 {
     return DATASTREAM_FORMAT_8BIT_UNSIGNED;
@@ -271,4 +368,29 @@ int SoundOutputPin::getFormat()
 bool SoundOutputPin::isConnected()
 {
     return this->channel != NULL;
+}
+
+/**
+ * Retrieves the cost of each pull made of this component.
+ * Statistics are only collected if CONFIG_AUDIO_STATS is enabled.
+ *
+ * @return The statistics for this component, or NULL if statistics are disabled.
+ */
+const AudioStats *SoundOutputPin::getStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    return &stats;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Resets the statistics of this component.
+ */
+void SoundOutputPin::resetStats()
+{
+#if CONFIG_ENABLED(CONFIG_AUDIO_STATS)
+    audio_stats_reset(stats);
+#endif
 }
\ No newline at end of file
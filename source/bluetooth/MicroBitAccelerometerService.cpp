@@ -36,7 +36,21 @@ DEALINGS IN THE SOFTWARE.
 using namespace codal;
 
 const uint16_t MicroBitAccelerometerService::serviceUUID               = 0x0753;
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+const uint16_t MicroBitAccelerometerService::charUUID[ mbbs_cIdxCOUNT] = { 0xca4b, 0xfb24, 0x3c5e };
+
+#include "sdk_config.h"
+#include "Timer.h"
+
+// The largest batch notification: the largest ATT MTU the SoftDevice is configured for, less the 3 byte ATT header.
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define MICROBIT_ACCELEROMETER_SERVICE_BATCH_ATTRSIZE   (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#else
+#define MICROBIT_ACCELEROMETER_SERVICE_BATCH_ATTRSIZE   20
+#endif
+#else
 const uint16_t MicroBitAccelerometerService::charUUID[ mbbs_cIdxCOUNT] = { 0xca4b, 0xfb24 };
+#endif
 
 
 /**
@@ -69,6 +83,19 @@ MicroBitAccelerometerService::MicroBitAccelerometerService( BLEDevice &_ble, cod
                          sizeof(accelerometerPeriodCharacteristicBuffer), sizeof(accelerometerPeriodCharacteristicBuffer),
                          microbit_propREAD | microbit_propWRITE);
 
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+    samples = new AccelerometerSample[ MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER];
+    batchBuffer = new uint8_t[ MICROBIT_ACCELEROMETER_SERVICE_BATCH_ATTRSIZE];
+    sampleHead = 0;
+    sampleCount = 0;
+    sending = false;
+
+    CreateCharacteristic( mbbs_cIdxBATCH, charUUID[ mbbs_cIdxBATCH],
+                         batchBuffer,
+                         0, MICROBIT_ACCELEROMETER_SERVICE_BATCH_ATTRSIZE,
+                         microbit_propNOTIFY);
+#endif
+
     if ( getConnected())
         listen( true);
 }
@@ -119,6 +146,11 @@ void MicroBitAccelerometerService::onConnect( const microbit_ble_evt_t *p_ble_ev
 void MicroBitAccelerometerService::onDisconnect( const microbit_ble_evt_t *p_ble_evt)
 {
     listen( false);
+
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+    // Samples are only of use to the client that was streaming them.
+    sampleCount = 0;
+#endif
 }
 
 
@@ -148,8 +180,98 @@ void MicroBitAccelerometerService::accelerometerUpdate(MicroBitEvent)
     if ( getConnected())
     {
         readXYZ();
-        notifyChrValue( mbbs_cIdxDATA, (uint8_t *)accelerometerDataCharacteristicBuffer, sizeof(accelerometerDataCharacteristicBuffer));
+        queueChrValue( mbbs_cIdxDATA, (uint8_t *)accelerometerDataCharacteristicBuffer, sizeof(accelerometerDataCharacteristicBuffer));
+
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+        if ( notifyChrValueEnabled( mbbs_cIdxBATCH))
+        {
+            storeSample();
+            sendSamples();
+        }
+#endif
     }
 }
 
+#if CONFIG_ENABLED(MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH)
+/**
+  * Handles BLE events not dispatched by MicroBitBLEService.
+  */
+bool MicroBitAccelerometerService::onBleEvent( const microbit_ble_evt_t *p_ble_evt)
+{
+    // Space has been freed in the SoftDevice queue, so send any backlog.
+    if ( p_ble_evt->header.evt_id == BLE_GATTS_EVT_HVN_TX_COMPLETE && p_ble_evt->evt.gatts_evt.conn_handle == getConnectionHandle())
+        if ( sampleCount > 0)
+            sendSamples();
+
+    return MicroBitBLEService::onBleEvent( p_ble_evt);
+}
+
+
+/**
+  * Adds the current sample to the ring buffer, if there is space.
+  */
+void MicroBitAccelerometerService::storeSample()
+{
+    // When full, the newest sample is dropped, as the oldest may be in the process of being sent.
+    if ( sampleCount >= MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER)
+        return;
+
+    AccelerometerSample &s = samples[ (sampleHead + sampleCount) % MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER];
+
+    s.time = (uint16_t) system_timer_current_time();
+    s.x = (int16_t) accelerometerDataCharacteristicBuffer[0];
+    s.y = (int16_t) accelerometerDataCharacteristicBuffer[1];
+    s.z = (int16_t) accelerometerDataCharacteristicBuffer[2];
+
+    target_disable_irq();
+    sampleCount++;
+    target_enable_irq();
+}
+
+
+/**
+  * Sends as many batches of samples from the ring buffer as the SoftDevice will queue.
+  * A partial batch is only sent once its oldest sample has waited MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_LATENCY ms.
+  */
+void MicroBitAccelerometerService::sendSamples()
+{
+    // We may be called from both the accelerometer and the BLE event handler. Only one of them need send.
+    target_disable_irq();
+    bool busy = sending;
+    sending = true;
+    target_enable_irq();
+
+    if ( busy)
+        return;
+
+    int perBatch = min( (int) MicroBitBLEManager::manager->getMaxAttributeSize(), MICROBIT_ACCELEROMETER_SERVICE_BATCH_ATTRSIZE) / (int) sizeof(AccelerometerSample);
+
+    while ( getConnected() && sampleCount > 0)
+    {
+        int count = min( (int) sampleCount, perBatch);
+
+        if ( count < perBatch)
+        {
+            uint16_t age = (uint16_t) system_timer_current_time() - samples[ sampleHead].time;
+            if ( age < MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_LATENCY)
+                break;
+        }
+
+        for ( int i = 0; i < count; i++)
+            memcpy( batchBuffer + i * sizeof(AccelerometerSample), &samples[ (sampleHead + i) % MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER], sizeof(AccelerometerSample));
+
+        // Leave the samples in the buffer if the SoftDevice queue is full. They'll be sent when it drains.
+        if ( !notifyChrValue( mbbs_cIdxBATCH, batchBuffer, count * sizeof(AccelerometerSample)))
+            break;
+
+        target_disable_irq();
+        sampleHead = (sampleHead + count) % MICROBIT_BLE_ACCELEROMETER_SERVICE_BATCH_BUFFER;
+        sampleCount -= count;
+        target_enable_irq();
+    }
+
+    sending = false;
+}
+#endif
+
 #endif
@@ -69,6 +69,9 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitDevice.h"
 #include "MicroBitEventService.h"
 #include "MicroBitPartialFlashingService.h"
+#include "MicroBitPowerManager.h"
+#include "MicroBitBootProfile.h"
+#include "MicroBitRandomPool.h"
 
 #include "CodalDmesg.h"
 #include "nrf_log_backend_dmesg.h"
@@ -137,6 +140,14 @@ static volatile int         m_pending;
 
 NRF_BLE_GATT_DEF( m_gatt);
 
+static int                  m_profile       = MICROBIT_BLE_PROFILE_DEFAULT;
+static ble_gap_conn_params_t m_conn_params;
+static uint8_t              m_tx_phy        = BLE_GAP_PHY_1MBPS;
+static uint8_t              m_rx_phy        = BLE_GAP_PHY_1MBPS;
+static uint16_t             m_data_length   = BLE_GAP_DATA_LENGTH_DEFAULT;
+
+static void microbit_ble_apply_profile( uint16_t conn_handle);
+
 
 static void const_ascii_to_utf8(ble_srv_utf8_str_t * p_utf8, const char * p_ascii);
 
@@ -155,8 +166,45 @@ static void microbit_dfu_init(void);
 static void microbit_ble_configureAdvertising( bool connectable, bool discoverable, bool whitelist, uint16_t interval_ms, int timeout_seconds);
 
 #if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL) || CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_UID)
+// An encoded advertising payload. The SoftDevice refers to it for as long as it is being advertised.
+typedef struct microbit_adv_frame_t
+{
+    uint8_t     data[ BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+    uint16_t    len;
+} microbit_adv_frame_t;
+
+static void microbit_ble_encodeEddystone( const uint8_t *frameData, uint16_t frameSize, microbit_adv_frame_t *frame);
 static void microbit_ble_configureAdvertising( bool connectable, bool discoverable, bool whitelist, uint16_t interval_ms, int timeout_seconds,
-                                               uint8_t *frameData, uint16_t frameSize);
+                                               microbit_adv_frame_t *frame);
+#endif
+
+// Eddystone frames, encoded when they are set and reused until they change.
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL)
+static microbit_adv_frame_t m_url_frame;
+static char                 m_url_key[ 32];
+static int8_t               m_url_power;
+#endif
+
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_UID)
+static microbit_adv_frame_t m_uid_frame;
+static uint8_t              m_uid_key[ 16];
+static int8_t               m_uid_power;
+#endif
+
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+// Telemetry changes with each rotation, so is rebuilt into alternate buffers. The SoftDevice requires a new
+// payload to be in a different buffer to the one being advertised.
+static microbit_adv_frame_t m_tlm_frame[ 2];
+static int                  m_tlm_next;
+
+static bool                 m_rotating;
+static bool                 m_rotation_tlm;
+static int                  m_rotation_index;
+static uint16_t             m_rotation_period;
+static uint16_t             m_rotation_interval;
+static uint32_t             m_rotation_adv_count;
+
+static void microbit_ble_eddystone_rotate( MicroBitEvent);
 #endif
 
 
@@ -234,6 +282,7 @@ void MicroBitBLEManager::init( ManagedString deviceName, ManagedString serialNum
     if ( this->status & DEVICE_COMPONENT_RUNNING)
       return;
 
+    MICROBIT_BOOT_PROFILE_BEGIN( MICROBIT_BOOT_PHASE_BLE);
     MICROBIT_DEBUG_DMESG( "MicroBitBLEManager::init");
     
     MICROBIT_DEBUG_DMESG( "NRF_SDH_BLE_VS_UUID_COUNT = %d", (int) NRF_SDH_BLE_VS_UUID_COUNT);
@@ -260,6 +309,10 @@ void MicroBitBLEManager::init( ManagedString deviceName, ManagedString serialNum
     // Start the BLE stack.
     uint32_t ram_start = 0;
     MICROBIT_BLE_ECHK( nrf_pwr_mgmt_init());
+
+    // The SoftDevice requires the RNG, and its interrupt, to itself.
+    microbit_random_pool_stop();
+
     MICROBIT_BLE_ECHK( nrf_sdh_enable_request());
     MICROBIT_BLE_ECHK( nrf_sdh_ble_default_cfg_set( microbit_ble_CONN_CFG_TAG, &ram_start));
     
@@ -280,6 +333,14 @@ void MicroBitBLEManager::init( ManagedString deviceName, ManagedString serialNum
     ble_cfg.gap_cfg.device_name_cfg.max_len     = gapName.length();
     MICROBIT_BLE_ECHK( sd_ble_cfg_set( BLE_GAP_CFG_DEVICE_NAME, &ble_cfg, ram_start));
 
+#if MICROBIT_BLE_HVN_TX_QUEUE_SIZE > 1
+    // Allow notifications to be queued, so several can be sent per connection event.
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                           = microbit_ble_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = MICROBIT_BLE_HVN_TX_QUEUE_SIZE;
+    MICROBIT_BLE_ECHK( sd_ble_cfg_set( BLE_CONN_CFG_GATTS, &ble_cfg, ram_start));
+#endif
+
     MICROBIT_BLE_ECHK( nrf_sdh_ble_enable(&ram_start));
     NRF_SDH_BLE_OBSERVER( microbit_ble_observer, microbit_ble_OBSERVER_PRIO, microbit_ble_evt_handler, NULL);
 
@@ -383,6 +444,7 @@ void MicroBitBLEManager::init( ManagedString deviceName, ManagedString serialNum
     gap_conn_params.slave_latency     = 0;
     gap_conn_params.conn_sup_timeout  = 400;    // 4s
     MICROBIT_BLE_ECHK( sd_ble_gap_ppcp_set( &gap_conn_params));
+    m_conn_params = gap_conn_params;
     
     // Set up GATT
     MICROBIT_BLE_ECHK( nrf_ble_gatt_init( &m_gatt, NULL));
@@ -492,6 +554,8 @@ void MicroBitBLEManager::init( ManagedString deviceName, ManagedString serialNum
         advertise();
 
     this->status |= DEVICE_COMPONENT_RUNNING;
+
+    MICROBIT_BOOT_PROFILE_END( MICROBIT_BOOT_PHASE_BLE);
 }
 
 
@@ -635,6 +699,15 @@ void MicroBitBLEManager::idleCallback()
         }
     }
 
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    // Send what has been queued once per connection interval (in units of 1.25ms), so it shares a connection event.
+    if ( notifyCount > 0)
+    {
+        if ( notifyUrgent || (system_timer_current_time() - notifyTime) >= (unsigned long) ( m_conn_params.max_conn_interval * 5 / 4))
+            flushNotifications();
+    }
+#endif
+
     if ( this->status & MICROBIT_BLE_STATUS_SHUTDOWN)
     {
         //MICROBIT_DEBUG_DMESG( "MicroBitBLEManager::idleCallback");
@@ -673,6 +746,11 @@ void MicroBitBLEManager::onDisconnect()
     MICROBIT_DEBUG_DMESG( "onDisconnect");
         
     MicroBitEvent(MICROBIT_ID_BLE, MICROBIT_BLE_EVT_DISCONNECTED);
+
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    notifyCount = 0;
+    notifyUrgent = false;
+#endif
     
     if ( advertiseOnDisconnect && ble_conn_state_peripheral_conn_count() == 0)
         advertise();
@@ -689,6 +767,212 @@ bool MicroBitBLEManager::getConnected()
     return ble_conn_state_peripheral_conn_count() > 0;
 }
 
+/**
+ * Queues a notification of a characteristic's value, to be sent with those of other services in the next
+ * connection event. Notifications are sent once per connection interval, from idleCallback(), highest priority
+ * first. A high priority notification causes everything queued to be sent at the next idle callback.
+ *
+ * If a notification is already queued for the characteristic, it is replaced, keeping the higher priority.
+ *
+ * @param service the service the characteristic belongs to.
+ * @param idx the index of the characteristic within the service.
+ * @param data the value to send. This is read when the notification is sent, so must remain valid until then.
+ * @param length the length of the value, in bytes.
+ * @param priority one of MICROBIT_BLE_NOTIFY_PRIORITY_HIGH, MICROBIT_BLE_NOTIFY_PRIORITY_NORMAL or MICROBIT_BLE_NOTIFY_PRIORITY_LOW.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the service or priority is invalid,
+ *         or DEVICE_NO_RESOURCES if the queue is full and cannot be flushed.
+ */
+int MicroBitBLEManager::queueNotification( MicroBitBLEService *service, int idx, const uint8_t *data, uint16_t length, int priority)
+{
+    if ( service == NULL || priority < 0 || priority >= MICROBIT_BLE_NOTIFY_PRIORITIES)
+        return DEVICE_INVALID_PARAMETER;
+
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    if ( !service->getConnected())
+        return DEVICE_OK;
+
+    MicroBitBLENotification *n = NULL;
+
+    for ( int i = 0; i < notifyCount; i++)
+        if ( notifyQueue[ i].service == service && notifyQueue[ i].idx == idx)
+            n = &notifyQueue[ i];
+
+    if ( n == NULL)
+    {
+        if ( notifyCount == MICROBIT_BLE_NOTIFY_QUEUE_SIZE && flushNotifications() == MICROBIT_BLE_NOTIFY_QUEUE_SIZE)
+            return DEVICE_NO_RESOURCES;
+
+        n = &notifyQueue[ notifyCount++];
+        n->service = service;
+        n->idx = idx;
+        n->priority = priority;
+    }
+
+    n->data = data;
+    n->length = length;
+    if ( priority < n->priority)
+        n->priority = priority;
+
+    if ( priority == MICROBIT_BLE_NOTIFY_PRIORITY_HIGH)
+        notifyUrgent = true;
+
+    status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+    return DEVICE_OK;
+#else
+    return service->notifyChrValue( idx, data, length) ? DEVICE_OK : DEVICE_NO_RESOURCES;
+#endif
+}
+
+/**
+ * Sends all queued notifications now, highest priority first, for as long as the SoftDevice has room for them.
+ * Any left over are kept for the next connection interval.
+ *
+ * @return the number of notifications still queued.
+ */
+int MicroBitBLEManager::flushNotifications()
+{
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    bool full = false;
+
+    for ( int p = 0; p < MICROBIT_BLE_NOTIFY_PRIORITIES && !full; p++)
+    {
+        for ( int i = 0; i < notifyCount && !full; i++)
+        {
+            MicroBitBLENotification &n = notifyQueue[ i];
+
+            if ( n.priority != p)
+                continue;
+
+            // A notification is refused either because the client hasn't enabled them (in which case the value is
+            // just stored, and we're done with it) or because the SoftDevice queue is full, for this connection event.
+            if ( !n.service->notifyChrValue( n.idx, n.data, n.length) && n.service->notifyChrValueEnabled( n.idx))
+            {
+                full = true;
+                break;
+            }
+
+            n.service = NULL;
+        }
+    }
+
+    // Close up the queue, keeping any left over in order.
+    int count = 0;
+    for ( int i = 0; i < notifyCount; i++)
+        if ( notifyQueue[ i].service)
+            notifyQueue[ count++] = notifyQueue[ i];
+
+    notifyCount = count;
+    notifyUrgent = false;
+    notifyTime = system_timer_current_time();
+
+    for ( int i = 0; i < notifyCount; i++)
+        if ( notifyQueue[ i].priority == MICROBIT_BLE_NOTIFY_PRIORITY_HIGH)
+            notifyUrgent = true;
+
+    return notifyCount;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Determines if a notification is queued for a characteristic, and has yet to be sent.
+ *
+ * @param service the service the characteristic belongs to.
+ * @param idx the index of the characteristic within the service.
+ *
+ * @return true if a notification is queued.
+ */
+bool MicroBitBLEManager::isNotificationQueued( MicroBitBLEService *service, int idx)
+{
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    for ( int i = 0; i < notifyCount; i++)
+        if ( notifyQueue[ i].service == service && notifyQueue[ i].idx == idx)
+            return true;
+#endif
+
+    return false;
+}
+
+/**
+ * Determines the largest attribute value that can be sent in a single notification or indication
+ * on the current connection, given the ATT MTU negotiated with the central device.
+ *
+ * @return The size in bytes, which is 20 if not connected or no larger MTU has been negotiated.
+ */
+uint16_t MicroBitBLEManager::getMaxAttributeSize()
+{
+    ble_conn_state_conn_handle_list_t list = ble_conn_state_periph_handles();
+    uint16_t mtu = list.len ? nrf_ble_gatt_eff_mtu_get( &m_gatt, list.conn_handles[0]) : 0;
+
+    // Each notification or indication carries a 3 byte ATT header (opcode and handle) within the MTU.
+    if ( mtu < BLE_GATT_ATT_MTU_DEFAULT)
+        mtu = BLE_GATT_ATT_MTU_DEFAULT;
+
+    return mtu - 3;
+}
+
+/**
+ * Requests a set of connection parameters suited to a given use, for the current connection and any later ones.
+ * The connection interval, PHY, data length and ATT MTU are negotiated with the central device, which may grant
+ * something other than what was asked for. Use getLinkParameters() to see what was granted.
+ *
+ * @param profile One of MICROBIT_BLE_PROFILE_DEFAULT, MICROBIT_BLE_PROFILE_THROUGHPUT or MICROBIT_BLE_PROFILE_LOW_POWER.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the profile is not recognised.
+ */
+int MicroBitBLEManager::setConnectionProfile(int profile)
+{
+    if ( profile < MICROBIT_BLE_PROFILE_DEFAULT || profile > MICROBIT_BLE_PROFILE_LOW_POWER)
+        return DEVICE_INVALID_PARAMETER;
+
+    MICROBIT_DEBUG_DMESG( "setConnectionProfile %d", profile);
+
+    m_profile = profile;
+
+    ble_conn_state_conn_handle_list_t list = ble_conn_state_periph_handles();
+    for ( uint32_t i = 0; i < list.len; i++)
+        microbit_ble_apply_profile( list.conn_handles[i]);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the connection profile last requested.
+ *
+ * @return One of MICROBIT_BLE_PROFILE_DEFAULT, MICROBIT_BLE_PROFILE_THROUGHPUT or MICROBIT_BLE_PROFILE_LOW_POWER.
+ */
+int MicroBitBLEManager::getConnectionProfile()
+{
+    return m_profile;
+}
+
+/**
+ * Determines the parameters granted on the current connection.
+ *
+ * @param params The structure to fill in.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if not connected.
+ */
+int MicroBitBLEManager::getLinkParameters(MicroBitBLELinkParameters &params)
+{
+    ble_conn_state_conn_handle_list_t list = ble_conn_state_periph_handles();
+    if ( list.len == 0)
+        return DEVICE_INVALID_STATE;
+
+    params.interval     = m_conn_params.max_conn_interval;
+    params.latency      = m_conn_params.slave_latency;
+    params.timeout      = m_conn_params.conn_sup_timeout;
+    params.txPhy        = m_tx_phy;
+    params.rxPhy        = m_rx_phy;
+    params.mtu          = max( nrf_ble_gatt_eff_mtu_get( &m_gatt, list.conn_handles[0]), (uint16_t) BLE_GATT_ATT_MTU_DEFAULT);
+    params.dataLength   = m_data_length;
+
+    return DEVICE_OK;
+}
+
 
 #if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL)
 /**
@@ -708,22 +992,45 @@ bool MicroBitBLEManager::getConnected()
 int MicroBitBLEManager::advertiseEddystoneUrl(const char* url, int8_t calibratedPower, bool connectable, uint16_t interval)
 {
     MICROBIT_DEBUG_DMESG( "advertiseEddystoneUrl");
-    
-    uint8_t frameData[ MicroBitEddystone::frameSizeURL];
-    uint16_t frameSize;
-    
-    int ret = MicroBitEddystone::getInstance()->getURL( frameData, &frameSize, url, calibratedPower);
 
-    if ( ret == MICROBIT_OK)
+    // Only encode the frame again if it has changed since it was last set.
+    bool cached = m_url_frame.len && m_url_power == calibratedPower && url && strcmp( m_url_key, url) == 0;
+    microbit_adv_frame_t frame;
+
+    if ( !cached)
     {
-      stopAdvertising();
-      
-      microbit_ble_configureAdvertising( connectable, true /*discoverable*/, false /*whitelist*/, interval, MICROBIT_BLE_ADVERTISING_TIMEOUT, frameData + 2, frameSize - 2);
+        uint8_t frameData[ MicroBitEddystone::frameSizeURL];
+        uint16_t frameSize;
+
+        int ret = MicroBitEddystone::getInstance()->getURL( frameData, &frameSize, url, calibratedPower);
+        if ( ret != MICROBIT_OK)
+            return ret;
 
-      advertise();
+        microbit_ble_encodeEddystone( frameData + 2, frameSize - 2, &frame);
     }
 
-    return ret;
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+    stopEddystoneRotation();
+#endif
+    stopAdvertising();
+
+    if ( !cached)
+    {
+        m_url_frame = frame;
+        m_url_power = calibratedPower;
+
+        // URLs too long to keep are simply encoded every time.
+        if ( strlen( url) < sizeof( m_url_key))
+            strcpy( m_url_key, url);
+        else
+            m_url_key[0] = 0;
+    }
+
+    microbit_ble_configureAdvertising( connectable, true /*discoverable*/, false /*whitelist*/, interval, MICROBIT_BLE_ADVERTISING_TIMEOUT, &m_url_frame);
+
+    advertise();
+
+    return MICROBIT_OK;
 }
 
 /**
@@ -766,22 +1073,183 @@ int MicroBitBLEManager::advertiseEddystoneUrl(ManagedString url, int8_t calibrat
 int MicroBitBLEManager::advertiseEddystoneUid(const char* uid_namespace, const char* uid_instance, int8_t calibratedPower, bool connectable, uint16_t interval)
 {
     MICROBIT_DEBUG_DMESG( "advertiseEddystoneUid");
-    
-    uint8_t frameData[ MicroBitEddystone::frameSizeUID];
+
+    if ( uid_namespace == NULL || uid_instance == NULL)
+        return MICROBIT_INVALID_PARAMETER;
+
+    // Only encode the frame again if it has changed since it was last set.
+    bool cached = m_uid_frame.len && m_uid_power == calibratedPower && memcmp( m_uid_key, uid_namespace, 10) == 0 && memcmp( m_uid_key + 10, uid_instance, 6) == 0;
+    microbit_adv_frame_t frame;
+
+    if ( !cached)
+    {
+        uint8_t frameData[ MicroBitEddystone::frameSizeUID];
+        uint16_t frameSize;
+
+        int ret = MicroBitEddystone::getInstance()->getUID( frameData, &frameSize, uid_namespace, uid_instance, calibratedPower);
+        if ( ret != MICROBIT_OK)
+            return ret;
+
+        microbit_ble_encodeEddystone( frameData + 2, frameSize - 2, &frame);
+    }
+
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+    stopEddystoneRotation();
+#endif
+    stopAdvertising();
+
+    if ( !cached)
+    {
+        m_uid_frame = frame;
+        m_uid_power = calibratedPower;
+        memcpy( m_uid_key, uid_namespace, 10);
+        memcpy( m_uid_key + 10, uid_instance, 6);
+    }
+
+    microbit_ble_configureAdvertising( connectable, true /*discoverable*/, false /*whitelist*/, interval, MICROBIT_BLE_ADVERTISING_TIMEOUT, &m_uid_frame);
+
+    advertise();
+
+    return MICROBIT_OK;
+}
+#endif
+
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+/**
+ * Builds a TLM frame into whichever telemetry buffer is not being advertised.
+ */
+static microbit_adv_frame_t *microbit_ble_eddystone_tlm()
+{
+    // The SoftDevice measures the die temperature in units of 0.25 degrees. TLM wants 8.8 fixed point.
+    int32_t temp;
+    int16_t temperature = (int16_t) 0x8000;
+    if ( sd_temp_get( &temp) == NRF_SUCCESS)
+        temperature = (int16_t) (temp * 64);
+
+    uint32_t now = (uint32_t) system_timer_current_time();
+
+    uint8_t frameData[ MicroBitEddystone::frameSizeTLM];
     uint16_t frameSize;
-    
-    int ret = MicroBitEddystone::getInstance()->getUID( frameData, &frameSize, uid_namespace, uid_instance, calibratedPower);
+    MicroBitEddystone::getInstance()->getTLM( frameData, &frameSize, 0, temperature, m_rotation_adv_count, now / 100);
+
+    microbit_adv_frame_t *frame = &m_tlm_frame[ m_tlm_next];
+    m_tlm_next ^= 1;
 
-    if ( ret == MICROBIT_OK)
+    microbit_ble_encodeEddystone( frameData + 2, frameSize - 2, frame);
+    return frame;
+}
+
+/**
+ * Selects the next frame in the rotation, or NULL if there are none.
+ */
+static microbit_adv_frame_t *microbit_ble_eddystone_next()
+{
+    // Slots in the rotation: URL, UID, then TLM. Empty slots are skipped.
+    for ( int i = 0; i < 3; i++)
     {
-      stopAdvertising();
-      
-      microbit_ble_configureAdvertising( connectable, true /*discoverable*/, false /*whitelist*/, interval, MICROBIT_BLE_ADVERTISING_TIMEOUT, frameData + 2, frameSize - 2);
+        m_rotation_index = ( m_rotation_index + 1) % 3;
 
-      advertise();
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL)
+        if ( m_rotation_index == 0 && m_url_frame.len)
+            return &m_url_frame;
+#endif
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_UID)
+        if ( m_rotation_index == 1 && m_uid_frame.len)
+            return &m_uid_frame;
+#endif
+        if ( m_rotation_index == 2 && m_rotation_tlm)
+            return microbit_ble_eddystone_tlm();
     }
 
-    return ret;
+    return NULL;
+}
+
+/**
+ * Timer event handler, moving the advertising on to the next frame.
+ */
+static void microbit_ble_eddystone_rotate( MicroBitEvent)
+{
+    if ( !m_rotating)
+        return;
+
+    // An estimate of the advertising PDUs sent, for telemetry.
+    m_rotation_adv_count += m_rotation_period / m_rotation_interval;
+
+    microbit_adv_frame_t *frame = microbit_ble_eddystone_next();
+    if ( frame == NULL)
+        return;
+
+    // Passing no parameters replaces just the payload, leaving advertising running.
+    ble_gap_adv_data_t  gap_adv_data;
+    memset( &gap_adv_data, 0, sizeof( gap_adv_data));
+    gap_adv_data.adv_data.p_data    = frame->data;
+    gap_adv_data.adv_data.len       = frame->len;
+    MICROBIT_BLE_ECHK( sd_ble_gap_adv_set_configure( &m_adv_handle, &gap_adv_data, NULL));
+}
+
+/**
+  * Advertises the Eddystone URL and UID frames most recently given to advertiseEddystoneUrl() and advertiseEddystoneUid()
+  * in turn, optionally interleaved with Eddystone TLM (telemetry) frames.
+  *
+  * Each frame is encoded once, when it is set, so moving from one frame to the next only hands a different payload to the SoftDevice.
+  * Calling advertiseEddystoneUrl() or advertiseEddystoneUid() stops the rotation, which may then be restarted to include the new frame.
+  *
+  * @param period the time, in milliseconds, each frame is advertised for. (Defaults to MICROBIT_BLE_EDDYSTONE_ROTATION_PERIOD)
+  *
+  * @param telemetry true to include TLM frames, reporting temperature, uptime and an estimate of the advertising count. (Defaults to true)
+  *
+  * @param connectable true to keep bluetooth connectable for other services, false otherwise. (Defaults to true)
+  *
+  * @param interval the rate at which the micro:bit will advertise frames. (Defaults to MICROBIT_BLE_EDDYSTONE_ADV_INTERVAL)
+  *
+  * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if there are no frames to advertise.
+  */
+int MicroBitBLEManager::advertiseEddystoneRotation(uint16_t period, bool telemetry, bool connectable, uint16_t interval)
+{
+    MICROBIT_DEBUG_DMESG( "advertiseEddystoneRotation");
+
+    if ( period == 0 || interval == 0)
+        return MICROBIT_INVALID_PARAMETER;
+
+    stopEddystoneRotation();
+
+    m_rotation_tlm = telemetry;
+    m_rotation_index = 2;
+
+    microbit_adv_frame_t *frame = microbit_ble_eddystone_next();
+    if ( frame == NULL)
+        return MICROBIT_INVALID_PARAMETER;
+
+    stopAdvertising();
+    microbit_ble_configureAdvertising( connectable, true /*discoverable*/, false /*whitelist*/, interval, 0, frame);
+    advertise();
+
+    static bool listening = false;
+    if ( !listening && EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->listen( MICROBIT_ID_BLE, MICROBIT_BLE_EVT_EDDYSTONE_ROTATE, microbit_ble_eddystone_rotate);
+        listening = true;
+    }
+
+    m_rotation_period = period;
+    m_rotation_interval = interval;
+    m_rotating = true;
+
+    system_timer_event_every( period, MICROBIT_ID_BLE, MICROBIT_BLE_EVT_EDDYSTONE_ROTATE);
+
+    return MICROBIT_OK;
+}
+
+/**
+  * Stops rotating between Eddystone frames, leaving the current frame advertised.
+  */
+void MicroBitBLEManager::stopEddystoneRotation()
+{
+    if ( m_rotating)
+    {
+        system_timer_cancel_event( MICROBIT_ID_BLE, MICROBIT_BLE_EVT_EDDYSTONE_ROTATE);
+        m_rotating = false;
+    }
 }
 #endif
 
@@ -1172,10 +1640,13 @@ void MicroBitBLEManager::servicesChanged()
  * @param whitelist Filter scan and connect requests with whitelist.
  * @param interval_ms Advertising interval in milliseconds.
  * @param timeout_seconds Advertising timeout in seconds
+ * @param p_advdata The advertising data to encode, if p_data is NULL.
+ * @param p_data An already encoded payload, which must remain valid while it is advertised.
+ * @param len The length of p_data.
  */
 static void microbit_ble_configureAdvertising( bool connectable, bool discoverable, bool whitelist,
                                                uint16_t interval_ms, int timeout_seconds,
-                                               ble_advdata_t *p_advdata)
+                                               ble_advdata_t *p_advdata, const uint8_t *p_data = NULL, uint16_t len = 0)
 {
     MICROBIT_DEBUG_DMESG( "configureAdvertising connectable %d, discoverable %d", (int) connectable, (int) discoverable);
     MICROBIT_DEBUG_DMESG( "whitelist %d, interval_ms %d, timeout_seconds %d", (int) whitelist, (int) interval_ms, (int) timeout_seconds);
@@ -1196,9 +1667,10 @@ static void microbit_ble_configureAdvertising( bool connectable, bool discoverab
                 
     ble_gap_adv_data_t  gap_adv_data;
     memset( &gap_adv_data, 0, sizeof( gap_adv_data));
-    gap_adv_data.adv_data.p_data    = m_enc_advdata;
-    gap_adv_data.adv_data.len       = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
-    MICROBIT_BLE_ECHK( ble_advdata_encode( p_advdata, gap_adv_data.adv_data.p_data, &gap_adv_data.adv_data.len));
+    gap_adv_data.adv_data.p_data    = p_data ? p_data : m_enc_advdata;
+    gap_adv_data.adv_data.len       = p_data ? len : BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+    if ( !p_data)
+        MICROBIT_BLE_ECHK( ble_advdata_encode( p_advdata, gap_adv_data.adv_data.p_data, &gap_adv_data.adv_data.len));
     NRF_LOG_HEXDUMP_INFO( gap_adv_data.adv_data.p_data, gap_adv_data.adv_data.len);
     MICROBIT_BLE_ECHK( sd_ble_gap_adv_set_configure( &m_adv_handle, &gap_adv_data, &gap_adv_params));
 }
@@ -1220,9 +1692,14 @@ static void microbit_ble_configureAdvertising( bool connectable, bool discoverab
 
 #if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_URL) || CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_UID)
 
-static void microbit_ble_configureAdvertising( bool connectable, bool discoverable, bool whitelist,
-                                               uint16_t interval_ms, int timeout_seconds,
-                                               uint8_t *frameData, uint16_t frameSize)
+/**
+ * Encodes an Eddystone frame as an advertising payload.
+ *
+ * @param frameData The Eddystone frame, without the Eddystone service UUID.
+ * @param frameSize The length of frameData.
+ * @param frame The payload to fill in.
+ */
+static void microbit_ble_encodeEddystone( const uint8_t *frameData, uint16_t frameSize, microbit_adv_frame_t *frame)
 {
     ble_uuid_t  esUuid = { 0xFEAA, BLE_UUID_TYPE_BLE};
     
@@ -1230,7 +1707,7 @@ static void microbit_ble_configureAdvertising( bool connectable, bool discoverab
     memset( &service_data, 0, sizeof( service_data));
     service_data.service_uuid = esUuid.uuid;
     service_data.data.size    = frameSize;
-    service_data.data.p_data  = frameSize ? frameData : NULL;
+    service_data.data.p_data  = frameSize ? (uint8_t *) frameData : NULL;
 
     ble_advdata_t advdata;
     memset( &advdata, 0, sizeof( advdata));
@@ -1245,7 +1722,16 @@ static void microbit_ble_configureAdvertising( bool connectable, bool discoverab
         advdata.p_service_data_array = &service_data;
     }
 
-    microbit_ble_configureAdvertising( connectable, discoverable, whitelist, interval_ms, timeout_seconds, &advdata);
+    frame->len = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+    MICROBIT_BLE_ECHK( ble_advdata_encode( &advdata, frame->data, &frame->len));
+}
+
+
+static void microbit_ble_configureAdvertising( bool connectable, bool discoverable, bool whitelist,
+                                               uint16_t interval_ms, int timeout_seconds,
+                                               microbit_adv_frame_t *frame)
+{
+    microbit_ble_configureAdvertising( connectable, discoverable, whitelist, interval_ms, timeout_seconds, NULL, frame->data, frame->len);
 }
 
 #endif
@@ -1259,7 +1745,16 @@ static void bleConnectionCallback( microbit_gaphandle_t handle)
     MICROBIT_DEBUG_DMESG( "bleConnectionCallback %d", (int) handle);
     
     if ( handle != BLE_CONN_HANDLE_INVALID)
+    {
         sd_ble_gap_tx_power_set( BLE_GAP_TX_POWER_ROLE_CONN, handle, MICROBIT_BLE_POWER_LEVEL[ m_power]);
+
+        // A new link starts on the 1M PHY with the default data length, until either side negotiates otherwise.
+        m_tx_phy = m_rx_phy = BLE_GAP_PHY_1MBPS;
+        m_data_length = BLE_GAP_DATA_LENGTH_DEFAULT;
+
+        if ( m_profile != MICROBIT_BLE_PROFILE_DEFAULT)
+            microbit_ble_apply_profile( handle);
+    }
     
     MicroBitEvent(MICROBIT_ID_BLE, MICROBIT_BLE_EVT_CONNECTED);
 }
@@ -1291,24 +1786,51 @@ static void microbit_ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_conte
         {
             if ( MicroBitBLEManager::manager)
                 MicroBitBLEManager::manager->onDisconnect();
+            microbit_energy_report(MICROBIT_ENERGY_BLE_CONNECTION, false);
             break;
         }
         case BLE_GAP_EVT_CONNECTED:
         {
             MICROBIT_DEBUG_DMESG( "BLE_GAP_EVT_CONNECTED %d", ble_conn_state_conn_count());
+            m_conn_params = p_ble_evt->evt.gap_evt.params.connected.conn_params;
             bleConnectionCallback( p_ble_evt->evt.gap_evt.conn_handle);
+            microbit_energy_report(MICROBIT_ENERGY_BLE_CONNECTION, true);
             break;
         }
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
+            // The low power profile stays on the 1M PHY, for range. Otherwise accept whatever the central prefers.
+            uint8_t phy = m_profile == MICROBIT_BLE_PROFILE_LOW_POWER ? BLE_GAP_PHY_1MBPS : BLE_GAP_PHY_AUTO;
             ble_gap_phys_t const phys =
             {
-                .tx_phys = BLE_GAP_PHY_AUTO,
-                .rx_phys = BLE_GAP_PHY_AUTO,
+                .tx_phys = phy,
+                .rx_phys = phy,
             };
             MICROBIT_BLE_ECHK( sd_ble_gap_phy_update( p_ble_evt->evt.gap_evt.conn_handle, &phys));
             break;
         }
+        case BLE_GAP_EVT_PHY_UPDATE:
+        {
+            if ( p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+            {
+                m_tx_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+                m_rx_phy = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+            }
+            MICROBIT_DEBUG_DMESG( "BLE_GAP_EVT_PHY_UPDATE tx %d rx %d", (int) m_tx_phy, (int) m_rx_phy);
+            break;
+        }
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        {
+            m_conn_params = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+            MICROBIT_DEBUG_DMESG( "BLE_GAP_EVT_CONN_PARAM_UPDATE interval %d latency %d", (int) m_conn_params.max_conn_interval, (int) m_conn_params.slave_latency);
+            break;
+        }
+        case BLE_GAP_EVT_DATA_LENGTH_UPDATE:
+        {
+            m_data_length = p_ble_evt->evt.gap_evt.params.data_length_update.effective_params.max_tx_octets;
+            MICROBIT_DEBUG_DMESG( "BLE_GAP_EVT_DATA_LENGTH_UPDATE %d", (int) m_data_length);
+            break;
+        }
         case BLE_GAP_EVT_PASSKEY_DISPLAY:
         {
             ManagedString passKey( (const char *)p_ble_evt->evt.gap_evt.params.passkey_display.passkey, BLE_GAP_PASSKEY_LEN);
@@ -1422,6 +1944,57 @@ static void microbit_ble_for_each_connected_disconnect( uint16_t conn_handle, vo
 }
 
 
+/**
+ * Requests the connection parameters, PHY, data length and ATT MTU of the current profile on a connection.
+ */
+static void microbit_ble_apply_profile( uint16_t conn_handle)
+{
+    ble_gap_conn_params_t params;
+    ble_gap_phys_t phys;
+
+    params.conn_sup_timeout = 400;      // 4s
+
+    switch ( m_profile)
+    {
+        case MICROBIT_BLE_PROFILE_THROUGHPUT:
+            params.min_conn_interval = 6;       // 7.5 ms
+            params.max_conn_interval = 12;      // 15 ms
+            params.slave_latency     = 0;
+            phys.tx_phys = phys.rx_phys = BLE_GAP_PHY_2MBPS;
+            break;
+
+        case MICROBIT_BLE_PROFILE_LOW_POWER:
+            params.min_conn_interval = 80;      // 100 ms
+            params.max_conn_interval = 160;     // 200 ms
+            params.slave_latency     = 4;
+            params.conn_sup_timeout  = 600;     // 6s
+            phys.tx_phys = phys.rx_phys = BLE_GAP_PHY_1MBPS;
+            break;
+
+        default:
+            params.min_conn_interval = 8;       // 10 ms
+            params.max_conn_interval = 16;      // 20 ms
+            params.slave_latency     = 0;
+            phys.tx_phys = phys.rx_phys = BLE_GAP_PHY_AUTO;
+            break;
+    }
+
+    MICROBIT_DEBUG_DMESG( "microbit_ble_apply_profile %d profile %d", (int) conn_handle, m_profile);
+
+    // The connection parameters module owns parameter negotiation, so we ask it rather than the SoftDevice,
+    // or it would negotiate its own preferences back again.
+    MICROBIT_BLE_ECHK( ble_conn_params_change_conn_params( conn_handle, &params));
+    MICROBIT_BLE_ECHK( sd_ble_gap_phy_update( conn_handle, &phys));
+
+    if ( m_profile == MICROBIT_BLE_PROFILE_THROUGHPUT)
+    {
+        // nrf_ble_gatt negotiates data length and MTU on connection, but the central may not have agreed then.
+        MICROBIT_BLE_ECHK( nrf_ble_gatt_data_length_set( &m_gatt, conn_handle, NRF_SDH_BLE_GAP_DATA_LENGTH));
+        if ( nrf_ble_gatt_eff_mtu_get( &m_gatt, conn_handle) < NRF_SDH_BLE_GATT_MAX_MTU_SIZE)
+            MICROBIT_BLE_ECHK( sd_ble_gattc_exchange_mtu_request( conn_handle, NRF_SDH_BLE_GATT_MAX_MTU_SIZE));
+    }
+}
+
 static void microbit_ble_for_each_connected_tx_power_set( uint16_t conn_handle, void *p_context)
 {
     int power = *( int *) p_context;
@@ -34,6 +34,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitBLEServices.h"
 #include "MicroBitBLEService.h"
+#include "MicroBitBLEManager.h"
 
 #include "ble.h"
 #include "ble_srv_common.h"
@@ -132,6 +133,8 @@ void MicroBitBLEService::CreateCharacteristic(
     //ble_gatts_char_pf_t         *p_presentation_format;
     
     MICROBIT_BLE_ECHK( characteristic_add( bs_service_handle, &params, ( ble_gatts_char_handles_t *) charHandles( idx)));
+
+    MicroBitBLEServices::getShared()->AddHandles( this, idx, charHandles( idx));
     
     MICROBIT_DEBUG_DMESG( "MicroBitBLEService::CreateCharacteristic( %x) = %d %d %d %d",
           (unsigned int) uuid,
@@ -154,9 +157,39 @@ bool MicroBitBLEService::getConnected()
     return ble_conn_state_peripheral_conn_count() > 0;
 }
 
+
+bool MicroBitBLEService::queueChrValue( int idx, const uint8_t *data, uint16_t length, int priority)
+{
+#if CONFIG_ENABLED(MICROBIT_BLE_NOTIFY_SCHEDULER)
+    if ( MicroBitBLEManager::manager)
+        return MicroBitBLEManager::manager->queueNotification( this, idx, data, length, priority) == MICROBIT_OK;
+#endif
+
+    return notifyChrValue( idx, data, length);
+}
+
+
+bool MicroBitBLEService::chrValueQueued( int idx)
+{
+    return MicroBitBLEManager::manager && MicroBitBLEManager::manager->isNotificationQueued( this, idx);
+}
+
                                             
 int MicroBitBLEService::charHandleToIdx( uint16_t handle, microbit_charattr_t *type)
 {
+    int found;
+    MicroBitBLEService *owner = MicroBitBLEServices::getShared()->FindHandle( handle, &found, type);
+
+    if ( owner == this)
+        return found;
+
+    if ( owner)
+    {
+        *type = microbit_charattrINVALID;
+        return -1;
+    }
+
+    // Handles beyond the shared table are found by searching our characteristics.
     int charCount = characteristicCount();
     
     for ( int idx = 0; idx < charCount; idx++)
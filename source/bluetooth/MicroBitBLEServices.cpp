@@ -38,6 +38,8 @@ DEALINGS IN THE SOFTWARE.
 
 #include "nrf_sdh_ble.h"
 
+#include <string.h>
+
 using namespace codal;
 
 /**
@@ -66,6 +68,7 @@ MicroBitBLEServices *MicroBitBLEServices::getShared()
 MicroBitBLEServices::MicroBitBLEServices() :
     bs_services_count(0)
 {
+    memset( bs_handles, 0xFF, sizeof( bs_handles));
 }
 
 
@@ -91,6 +94,18 @@ void MicroBitBLEServices::RemoveService( MicroBitBLEService *service)
     
     if ( count < bs_services_count)
     {
+        // Forget the handles of the service, and renumber those of the services that move down.
+        for ( int h = 0; h < MICROBIT_BLE_SERVICES_MAX_HANDLES; h++)
+        {
+            if ( bs_handles[ h].service == 0xFF)
+                continue;
+
+            if ( bs_handles[ h].service == count)
+                bs_handles[ h].service = 0xFF;
+            else if ( bs_handles[ h].service > count)
+                bs_handles[ h].service--;
+        }
+
         for ( int i = count + 1; i < bs_services_count; i++)
         {
             bs_services[ count] = bs_services[ i];
@@ -102,9 +117,101 @@ void MicroBitBLEServices::RemoveService( MicroBitBLEService *service)
 }
 
 
+/**
+  * Records the attribute handles of a characteristic, so that events on them can be passed
+  * straight to the service that owns them.
+  */
+void MicroBitBLEServices::AddHandles( MicroBitBLEService *service, int idx, const microbit_charhandles_t *handles)
+{
+    int slot;
+
+    for ( slot = 0; slot < bs_services_count; slot++)
+    {
+        if ( bs_services[ slot] == service)
+            break;
+    }
+
+    if ( slot >= bs_services_count)
+        return;
+
+    const microbit_charhandle_t h[] = { handles->value, handles->desc, handles->cccd, handles->sccd };
+    const microbit_charattr_t   t[] = { microbit_charattrVALUE, microbit_charattrDESC, microbit_charattrCCCD, microbit_charattrSCCD };
+
+    for ( int i = 0; i < 4; i++)
+    {
+        // Characteristics without a given attribute have a handle of zero.
+        if ( h[ i] == 0 || h[ i] >= MICROBIT_BLE_SERVICES_MAX_HANDLES)
+            continue;
+
+        bs_handles[ h[ i]].service = slot;
+        bs_handles[ h[ i]].idx     = idx;
+        bs_handles[ h[ i]].type    = t[ i];
+    }
+}
+
+
+/**
+  * Finds the service and characteristic that own an attribute handle.
+  *
+  * @param handle The attribute handle.
+  * @param idx Set to the index of the characteristic within its service.
+  * @param type Set to the attribute of the characteristic the handle refers to.
+  * @return The owning service, or NULL if the handle isn't in our table.
+  */
+MicroBitBLEService *MicroBitBLEServices::FindHandle( uint16_t handle, int *idx, microbit_charattr_t *type)
+{
+    if ( handle >= MICROBIT_BLE_SERVICES_MAX_HANDLES || bs_handles[ handle].service == 0xFF)
+        return NULL;
+
+    *idx  = bs_handles[ handle].idx;
+    *type = ( microbit_charattr_t) bs_handles[ handle].type;
+    return bs_services[ bs_handles[ handle].service];
+}
+
+
+/**
+  * Determines the attribute handle an event refers to, if any.
+  */
+static uint16_t microbit_ble_services_evt_handle( ble_evt_t const * p_ble_evt)
+{
+    switch ( p_ble_evt->header.evt_id)
+    {
+        case BLE_GATTS_EVT_WRITE:
+            return p_ble_evt->evt.gatts_evt.params.write.handle;
+
+        case BLE_GATTS_EVT_HVC:
+            return p_ble_evt->evt.gatts_evt.params.hvc.handle;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            if ( p_ble_evt->evt.gatts_evt.params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_READ)
+                return p_ble_evt->evt.gatts_evt.params.authorize_request.request.read.handle;
+            if ( p_ble_evt->evt.gatts_evt.params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+                return p_ble_evt->evt.gatts_evt.params.authorize_request.request.write.handle;
+            break;
+    }
+
+    return 0;
+}
+
+
 void MicroBitBLEServices::onBleEvent( ble_evt_t const * p_ble_evt)
 {
     //MICROBIT_DEBUG_DMESG("MicroBitBLEServices::onBleEvent 0x%x", (unsigned int) p_ble_evt->header.evt_id);
+
+    // Events on a characteristic need only go to the service that owns it.
+    uint16_t handle = microbit_ble_services_evt_handle( p_ble_evt);
+    if ( handle)
+    {
+        int idx;
+        microbit_charattr_t type;
+        MicroBitBLEService *service = FindHandle( handle, &idx, &type);
+
+        if ( service)
+        {
+            service->onBleEvent( p_ble_evt);
+            return;
+        }
+    }
     
     for ( int i = 0; i < bs_services_count; i++)
     {
@@ -0,0 +1,267 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Class definition for the MicroBit BLE Benchmark Service.
+  * Measures the GATT throughput achieved with a connected device.
+  */
+#include "MicroBitConfig.h"
+
+#if CONFIG_ENABLED(DEVICE_BLE)
+
+#include "MicroBitBenchmarkService.h"
+#include "Timer.h"
+#include "sdk_config.h"
+
+using namespace codal;
+
+const uint16_t MicroBitBenchmarkService::serviceUUID               = 0xbe00;
+const uint16_t MicroBitBenchmarkService::charUUID[ mbbs_cIdxCOUNT] = { 0xbe01, 0xbe02, 0xbe03, 0xbe04 };
+
+// The largest value held by the sink and source characteristics: the largest ATT MTU the SoftDevice is configured for,
+// less the 3 byte ATT header. Notifications actually sent are limited to what has been negotiated on the connection.
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define MICROBIT_BENCHMARK_ATTRSIZE         (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#else
+#define MICROBIT_BENCHMARK_ATTRSIZE         20
+#endif
+
+/**
+  * Constructor.
+  * Create a representation of the BenchmarkService
+  * @param _ble The instance of a BLE device that we're running on.
+  */
+MicroBitBenchmarkService::MicroBitBenchmarkService( BLEDevice &_ble)
+{
+    sourceBuffer = new uint8_t[ MICROBIT_BENCHMARK_ATTRSIZE];
+    memset( sourceBuffer, 0, MICROBIT_BENCHMARK_ATTRSIZE);
+    memset( controlBuffer, 0, sizeof( controlBuffer));
+    memset( &results, 0, sizeof( results));
+
+    sourceRunning = false;
+    sourceDuration = 0;
+    sourceSequence = 0;
+    sourceLength = 0;
+    reset();
+
+    // Register the base UUID and create the service.
+    RegisterBaseUUID( bs_base_uuid);
+    CreateService( serviceUUID);
+
+    // The sink is given its own buffer, but only its length matters.
+    CreateCharacteristic( mbbs_cIdxSINK, charUUID[ mbbs_cIdxSINK],
+                          sourceBuffer,
+                          0, MICROBIT_BENCHMARK_ATTRSIZE,
+                          microbit_propWRITE | microbit_propWRITE_WITHOUT);
+
+    CreateCharacteristic( mbbs_cIdxSOURCE, charUUID[ mbbs_cIdxSOURCE],
+                          sourceBuffer,
+                          0, MICROBIT_BENCHMARK_ATTRSIZE,
+                          microbit_propNOTIFY);
+
+    CreateCharacteristic( mbbs_cIdxCONTROL, charUUID[ mbbs_cIdxCONTROL],
+                          controlBuffer,
+                          0, sizeof( controlBuffer),
+                          microbit_propWRITE);
+
+    CreateCharacteristic( mbbs_cIdxRESULTS, charUUID[ mbbs_cIdxRESULTS],
+                          (uint8_t *)&results,
+                          sizeof( results), sizeof( results),
+                          microbit_propREAD | microbit_propNOTIFY | microbit_propREADAUTH);
+}
+
+
+/**
+  * Clears all counters.
+  */
+void MicroBitBenchmarkService::reset()
+{
+    rxBytes = rxPackets = rxStart = rxEnd = 0;
+    txBytes = txPackets = txStart = txEnd = 0;
+}
+
+
+/**
+  * Fills in the results of the current run.
+  *
+  * @param r The structure to fill in.
+  */
+void MicroBitBenchmarkService::getResults( MicroBitBenchmarkResults &r)
+{
+    memset( &r, 0, sizeof( r));
+
+    r.rxBytes = rxBytes;
+    r.rxPackets = rxPackets;
+    r.rxThroughput = rxEnd > rxStart ? (uint32_t) ((uint64_t) rxBytes * 1000 / (rxEnd - rxStart)) : 0;
+    r.txBytes = txBytes;
+    r.txPackets = txPackets;
+    r.txThroughput = txEnd > txStart ? (uint32_t) ((uint64_t) txBytes * 1000 / (txEnd - txStart)) : 0;
+
+    MicroBitBLELinkParameters link;
+    if ( MicroBitBLEManager::manager->getLinkParameters( link) == MICROBIT_OK)
+    {
+        r.interval = link.interval;
+        r.txPhy = link.txPhy;
+        r.rxPhy = link.rxPhy;
+        r.mtu = link.mtu;
+        r.dataLength = link.dataLength;
+    }
+}
+
+
+/**
+  * Invoked when BLE disconnects.
+  */
+void MicroBitBenchmarkService::onDisconnect( const microbit_ble_evt_t *p_ble_evt)
+{
+    MICROBIT_DEBUG_DMESG( "BENCHMARK: rx %d bytes in %d ms, tx %d bytes in %d ms", (int) rxBytes, (int) (rxEnd - rxStart), (int) txBytes, (int) (txEnd - txStart));
+    sourceRunning = false;
+}
+
+
+/**
+  * Callback. Invoked when any of our attributes are written via BLE.
+  */
+void MicroBitBenchmarkService::onDataWritten( const microbit_ble_evt_write_t *params)
+{
+    if ( params->handle == valueHandle( mbbs_cIdxSINK))
+    {
+        uint32_t now = (uint32_t) system_timer_current_time();
+
+        if ( rxPackets == 0)
+            rxStart = now;
+
+        rxEnd = now;
+        rxBytes += params->len;
+        rxPackets++;
+        return;
+    }
+
+    if ( params->handle == valueHandle( mbbs_cIdxCONTROL) && params->len >= 1)
+    {
+        switch ( params->data[0])
+        {
+            case MICROBIT_BENCHMARK_CMD_RESET:
+                reset();
+                break;
+
+            case MICROBIT_BENCHMARK_CMD_SOURCE:
+                sourceDuration = 0;
+                if ( params->len >= 5)
+                    memcpy( &sourceDuration, params->data + 1, sizeof( sourceDuration));
+
+                // Each run uses packets of the largest size the connection allows when it starts.
+                sourceLength = min( (int) MicroBitBLEManager::manager->getMaxAttributeSize(), MICROBIT_BENCHMARK_ATTRSIZE);
+                sourceSequence = 0;
+
+                txBytes = txPackets = 0;
+                txStart = txEnd = (uint32_t) system_timer_current_time();
+                sourceRunning = true;
+                sendSource();
+                break;
+
+            case MICROBIT_BENCHMARK_CMD_STOP:
+                if ( sourceRunning)
+                    stopSource();
+                break;
+        }
+    }
+}
+
+
+/**
+  * Callback. Invoked when any of our attributes are read via BLE.
+  */
+void MicroBitBenchmarkService::onDataRead( microbit_onDataRead_t *params)
+{
+    if ( params->handle == valueHandle( mbbs_cIdxRESULTS))
+    {
+        getResults( results);
+        params->data    = (uint8_t *)&results;
+        params->length  = sizeof( results);
+    }
+}
+
+
+/**
+  * Handles BLE events not dispatched by MicroBitBLEService.
+  */
+bool MicroBitBenchmarkService::onBleEvent( const microbit_ble_evt_t *p_ble_evt)
+{
+    if ( p_ble_evt->header.evt_id == BLE_GATTS_EVT_HVN_TX_COMPLETE && p_ble_evt->evt.gatts_evt.conn_handle == getConnectionHandle())
+    {
+        // Packets are only counted once the SoftDevice reports them sent. Other services may share the queue,
+        // so count no more than we have outstanding.
+        uint32_t count = min( (uint32_t) p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count, sourceSequence - txPackets);
+        txPackets += count;
+        txBytes += count * sourceLength;
+        txEnd = (uint32_t) system_timer_current_time();
+
+        if ( sourceRunning)
+            sendSource();
+    }
+
+    return MicroBitBLEService::onBleEvent( p_ble_evt);
+}
+
+
+/**
+  * Queues notifications of the source characteristic until the SoftDevice will take no more.
+  */
+void MicroBitBenchmarkService::sendSource()
+{
+    if ( sourceDuration && (uint32_t) system_timer_current_time() - txStart >= sourceDuration)
+    {
+        stopSource();
+        return;
+    }
+
+    if ( !getConnected() || !notifyChrValueEnabled( mbbs_cIdxSOURCE))
+        return;
+
+    while ( sourceRunning)
+    {
+        // Number each packet, so that the client can detect any that are lost.
+        memcpy( sourceBuffer, &sourceSequence, sizeof( sourceSequence));
+
+        if ( !notifyChrValue( mbbs_cIdxSOURCE, sourceBuffer, sourceLength))
+            break;
+
+        sourceSequence++;
+    }
+}
+
+
+/**
+  * Ends a run of the source characteristic, and notifies the results.
+  */
+void MicroBitBenchmarkService::stopSource()
+{
+    sourceRunning = false;
+
+    getResults( results);
+    notifyChrValue( mbbs_cIdxRESULTS, (uint8_t *)&results, sizeof( results));
+}
+
+#endif
@@ -53,6 +53,11 @@ const int EDDYSTONE_UID_INSTANCE_MAX_LENGTH = 6;
 const uint8_t EDDYSTONE_UID_FRAME_TYPE = 0x00;
 #endif
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+const uint8_t EDDYSTONE_TLM_FRAME_TYPE = 0x20;
+const uint8_t EDDYSTONE_TLM_VERSION = 0x00;
+#endif
+
 /**
  * Constructor.
  *
@@ -204,4 +209,46 @@ int MicroBitEddystone::getUID( uint8_t *rawFrame /*[frameSizeUID]*/, uint16_t *p
 
 #endif
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EDDYSTONE_ROTATION)
+
+/**
+  * Get the content of unencrypted Eddystone TLM (telemetry) frames
+  *
+  * @param batteryVoltage the battery voltage in millivolts, or 0 if not known.
+  *
+  * @param temperature the temperature in degrees Celsius, as signed 8.8 fixed point, or 0x8000 if not known.
+  *
+  * @param advertisingCount the number of advertising PDUs sent since the beacon started.
+  *
+  * @param uptime the time since the beacon started, in units of 0.1 seconds.
+  *
+  * @note More information can be found at https://github.com/google/eddystone/tree/master/eddystone-tlm
+  */
+int MicroBitEddystone::getTLM( uint8_t *rawFrame /*[frameSizeTLM]*/, uint16_t *pLength, uint16_t batteryVoltage, int16_t temperature, uint32_t advertisingCount, uint32_t uptime)
+{
+    size_t index = 0;
+    rawFrame[index++] = EDDYSTONE_UUID[0];
+    rawFrame[index++] = EDDYSTONE_UUID[1];
+    rawFrame[index++] = EDDYSTONE_TLM_FRAME_TYPE;
+    rawFrame[index++] = EDDYSTONE_TLM_VERSION;
+
+    // All fields are big endian.
+    rawFrame[index++] = batteryVoltage >> 8;
+    rawFrame[index++] = batteryVoltage;
+    rawFrame[index++] = (uint16_t) temperature >> 8;
+    rawFrame[index++] = (uint16_t) temperature;
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+        rawFrame[index++] = advertisingCount >> shift;
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+        rawFrame[index++] = uptime >> shift;
+
+    *pLength = index;
+
+    return MICROBIT_OK;
+}
+
+#endif
+
 #endif
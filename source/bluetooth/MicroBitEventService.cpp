@@ -35,9 +35,19 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitEventService.h"
 #include "ExternalEvents.h"
 #include "MicroBitFiber.h"
+#include "sdk_config.h"
 
 using namespace codal;
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+// The most events sent in one notification: as many as fit the largest ATT MTU the SoftDevice is configured for.
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define MICROBIT_EVENT_SERVICE_BATCH_SIZE   ((NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3) / sizeof(EventServiceEvent))
+#else
+#define MICROBIT_EVENT_SERVICE_BATCH_SIZE   (20 / sizeof(EventServiceEvent))
+#endif
+#endif
+
 const uint16_t MicroBitEventService::serviceUUID               = 0x93af;
 const uint16_t MicroBitEventService::charUUID[ mbbs_cIdxCOUNT] = { 0x9775, 0xb84c, 0x5404, 0x23c4 };
 
@@ -62,10 +72,22 @@ MicroBitEventService::MicroBitEventService(BLEDevice &_ble, EventModel &_message
     RegisterBaseUUID( bs_base_uuid);
     CreateService( serviceUUID);
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+    pendingCount = 0;
+    pendingEvents = new EventServiceEvent[ MICROBIT_EVENT_SERVICE_BATCH_SIZE];
+    batchBuffer = new EventServiceEvent[ MICROBIT_EVENT_SERVICE_BATCH_SIZE];
+    batchBuffer[0] = microBitEventBuffer;
+
+    CreateCharacteristic( mbbs_cIdxMEVENT, charUUID[ mbbs_cIdxMEVENT],
+                        (uint8_t *)batchBuffer,
+                         sizeof(EventServiceEvent), MICROBIT_EVENT_SERVICE_BATCH_SIZE * sizeof(EventServiceEvent),
+                         microbit_propREAD | microbit_propNOTIFY);
+#else
     CreateCharacteristic( mbbs_cIdxMEVENT, charUUID[ mbbs_cIdxMEVENT],
                         (uint8_t *)&microBitEventBuffer,
                          sizeof(EventServiceEvent), sizeof(EventServiceEvent),
                          microbit_propREAD | microbit_propNOTIFY);
+#endif
 
     CreateCharacteristic( mbbs_cIdxCEVENT, charUUID[ mbbs_cIdxCEVENT],
                          (uint8_t *)&clientEventBuffer,
@@ -127,6 +149,22 @@ void MicroBitEventService::onDataWritten( const microbit_ble_evt_write_t *params
   */
 void MicroBitEventService::onMicroBitEvent(MicroBitEvent evt)
 {
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+    if ( !getConnected())
+        return;
+
+    // Queue the event, to be sent with any others raised before the next idle callback.
+    // If a full batch can't be sent, the newest events are dropped until it has been.
+    if ( pendingCount == MICROBIT_EVENT_SERVICE_BATCH_SIZE && !flushEvents())
+        return;
+
+    pendingEvents[pendingCount].type = evt.source;
+    pendingEvents[pendingCount].reason = evt.value;
+    pendingCount++;
+
+    if ( MicroBitBLEManager::manager && pendingCount * sizeof(EventServiceEvent) + sizeof(EventServiceEvent) > MicroBitBLEManager::manager->getMaxAttributeSize())
+        flushEvents();
+#else
     EventServiceEvent *e = &microBitEventBuffer;
 
     if ( getConnected())
@@ -135,14 +173,52 @@ void MicroBitEventService::onMicroBitEvent(MicroBitEvent evt)
         e->reason = evt.value;
         notifyChrValue( mbbs_cIdxMEVENT, (const uint8_t *)e, sizeof(EventServiceEvent));
     }
+#endif
 }
 
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+/**
+  * Sends any events waiting to be batched, as a single notification.
+  *
+  * @return true if there are no events left waiting.
+  */
+bool MicroBitEventService::flushEvents()
+{
+    if ( pendingCount == 0)
+        return true;
+
+    if ( !getConnected())
+    {
+        pendingCount = 0;
+        return true;
+    }
+
+    // Send as many as fit the negotiated MTU, keeping the rest for the next notification.
+    int count = pendingCount;
+    if ( MicroBitBLEManager::manager)
+        count = min( count, (int) (MicroBitBLEManager::manager->getMaxAttributeSize() / sizeof(EventServiceEvent)));
+
+    if ( !notifyChrValue( mbbs_cIdxMEVENT, (const uint8_t *)pendingEvents, count * sizeof(EventServiceEvent)))
+        return false;
+
+    pendingCount -= count;
+    memmove( pendingEvents, pendingEvents + count, pendingCount * sizeof(EventServiceEvent));
+
+    return pendingCount == 0;
+}
+#endif
+
 /**
   * Periodic callback from MicroBit scheduler.
   * If we're no longer connected, remove any registered Message Bus listeners.
+  * Sends any events waiting to be batched, if batching is enabled.
   */
 void MicroBitEventService::idleCallback()
 {
+#if CONFIG_ENABLED(MICROBIT_BLE_EVENT_SERVICE_BATCH)
+    flushEvents();
+#endif
+
     if ( !getConnected() && messageBusListenerOffset > 0)
     {
         messageBusListenerOffset = 0;
@@ -33,6 +33,8 @@ DEALINGS IN THE SOFTWARE.
 
 #include "MicroBitIOPinService.h"
 #include "MicroBitFiber.h"
+#include "EventModel.h"
+#include "Timer.h"
 
 using namespace codal;
 
@@ -55,6 +57,20 @@ MicroBitIOPinService::MicroBitIOPinService(BLEDevice &_ble, MicroBitIO &_io) :
     ioPinServiceIOCharacteristicBuffer = 0;
     memset(ioPinServiceIOData, 0, sizeof(ioPinServiceIOData));
     memset(ioPinServicePWMCharacteristicBuffer, 0, sizeof(ioPinServicePWMCharacteristicBuffer));    // Create the AD characteristic, that defines whether each pin is treated as analogue or digital
+
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+    pendingChanges = 0;
+    edgePins = 0;
+    analogSampling = false;
+
+    if (EventModel::defaultEventBus)
+    {
+        for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
+            EventModel::defaultEventBus->listen(edgePin(i).id, DEVICE_EVT_ANY, this, &MicroBitIOPinService::onPinEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+        EventModel::defaultEventBus->listen(MICROBIT_ID_IO_PIN_SERVICE, MICROBIT_IO_PIN_SERVICE_EVT_SAMPLE, this, &MicroBitIOPinService::onAnalogSample);
+    }
+#endif
     
     // Register the base UUID and create the service.
     RegisterBaseUUID( bs_base_uuid);
@@ -136,13 +152,18 @@ int MicroBitIOPinService::updateBLEInputs(bool updateAll)
 {
     int pairs = 0;
 
+    // Sample all the digital inputs together, rather than one pin at a time.
+    uint32_t levels = io.readEdgePins();
+
     for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
     {
         if (isActiveInput(i))
         {
             uint8_t value;
 
-            if (isDigital(i))
+            if (isDigital(i) && edgePin(i).isDigital() && edgePin(i).isInput())
+                value = (levels >> i) & 1;
+            else if (isDigital(i))
                	value = edgePin(i).getDigitalValue();
             else
                	value = edgePin(i).getAnalogValue() >> 2;
@@ -181,6 +202,9 @@ void MicroBitIOPinService::onDataWritten( const microbit_ble_evt_write_t *params
         setChrValue( mbbs_cIdxIO, (const uint8_t *)&ioPinServiceIOCharacteristicBuffer, sizeof(ioPinServiceIOCharacteristicBuffer));
 
         // Also, drop any selected pins into input mode, so we can pick up changes later
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+        updateWatchedPins();
+#else
         for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
         {
             if(isDigital(i) && isActiveInput(i))
@@ -189,6 +213,7 @@ void MicroBitIOPinService::onDataWritten( const microbit_ble_evt_write_t *params
             if(isAnalog(i) && isActiveInput(i))
                 edgePin(i).getAnalogValue();
         }
+#endif
     }
 
     // Check for writes to the IO configuration characteristic
@@ -201,14 +226,18 @@ void MicroBitIOPinService::onDataWritten( const microbit_ble_evt_write_t *params
         setChrValue( mbbs_cIdxADC, (const uint8_t *)&ioPinServiceADCharacteristicBuffer, sizeof(ioPinServiceADCharacteristicBuffer));
 
         // Also, drop any selected pins into input mode, so we can pick up changes later
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+        updateWatchedPins();
+#else
         for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
         {
             if(isDigital(i) && isActiveInput(i))
-               edgePin(i).getDigitalValue();
+                edgePin(i).getDigitalValue();
 
             if(isAnalog(i) && isActiveInput(i))
-               edgePin(i).getAnalogValue();
+                edgePin(i).getAnalogValue();
         }
+#endif
     }
 
     // Check for writes to the PWM Control characteristic
@@ -243,13 +272,25 @@ void MicroBitIOPinService::onDataWritten( const microbit_ble_evt_write_t *params
         // We have some pin data to change...
         uint16_t len = params->len;
         IOData *data = (IOData *)params->data;
+        uint32_t mask = 0;
+        uint32_t levels = 0;
 
-        // There may be multiple write operations... take each in turn and update the pin values
+        // There may be multiple write operations... take each in turn and update the pin values.
+        // Pins that are already digital outputs are gathered up, and driven together once all the operations are known.
         while (len >= sizeof(IOData))
         {
             if (!isActiveInput(data->pin))
             {
-                if (isDigital(data->pin))
+                if (data->pin < MICROBIT_IO_PIN_SERVICE_PINCOUNT && isDigital(data->pin) && edgePin(data->pin).isDigital() && edgePin(data->pin).isOutput())
+                {
+                    mask |= (1UL << data->pin);
+
+                    if (data->value)
+                        levels |= (1UL << data->pin);
+                    else
+                        levels &= ~(1UL << data->pin);
+                }
+                else if (isDigital(data->pin))
                		edgePin(data->pin).setDigitalValue(data->value);
                 else
                		edgePin(data->pin).setAnalogValue(data->value == 255 ? 1023 : data->value << 2);
@@ -258,6 +299,9 @@ void MicroBitIOPinService::onDataWritten( const microbit_ble_evt_write_t *params
             data++;
             len -= sizeof(IOData);
         }
+
+        if (mask)
+            io.writeEdgePins(mask, levels);
     }
 }
 
@@ -289,16 +333,156 @@ void MicroBitIOPinService::onDataRead( microbit_onDataRead_t *params)
  */
 void MicroBitIOPinService::idleCallback()
 {
-    if ( getConnected())
+    // Changes are reported relative to the last notification, so hold any new ones until a queued notification has been sent.
+    if ( getConnected() && !chrValueQueued( mbbs_cIdxDATA))
     {
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+        // Pins are watched by events and the sampling timer, so we need only look at what they have recorded.
+        if ( pendingChanges == 0)
+            return;
+
+        int pairs = takePendingInputs();
+#else
         int pairs = updateBLEInputs( false);
+#endif
         // If there's any data, issue a BLE notification.
         if ( pairs)
         {
-            notifyChrValue( mbbs_cIdxDATA, (uint8_t *)ioPinServiceDataCharacteristicBuffer, pairs * sizeof(IOData));
+            queueChrValue( mbbs_cIdxDATA, (uint8_t *)ioPinServiceDataCharacteristicBuffer, pairs * sizeof(IOData));
         }
     }
 }
 
 
+#if CONFIG_ENABLED(MICROBIT_BLE_IO_PIN_SERVICE_EVENTS)
+/**
+  * Brings the pins we watch into line with the configuration given by our client.
+  * Digital inputs are set to raise edge events, and the analog sampling timer is started or stopped as needed.
+  */
+void MicroBitIOPinService::updateWatchedPins()
+{
+    bool analog = false;
+
+    for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
+    {
+        bool watch = isDigital(i) && isActiveInput(i);
+
+        if (watch && !(edgePins & (1 << i)))
+        {
+            // Record the current value, so that only later changes are reported by events.
+            setPending(i, edgePin(i).getDigitalValue());
+            edgePin(i).eventOn(DEVICE_PIN_EVENT_ON_EDGE);
+            edgePins |= (1 << i);
+        }
+
+        if (!watch && (edgePins & (1 << i)))
+        {
+            edgePin(i).eventOn(DEVICE_PIN_EVENT_NONE);
+            edgePins &= ~(1 << i);
+        }
+
+        if (isAnalog(i) && isActiveInput(i))
+        {
+            edgePin(i).getAnalogValue();
+            analog = true;
+        }
+    }
+
+    if (analog && !analogSampling)
+        system_timer_event_every(MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_PERIOD, MICROBIT_ID_IO_PIN_SERVICE, MICROBIT_IO_PIN_SERVICE_EVT_SAMPLE);
+
+    if (!analog && analogSampling)
+        system_timer_cancel_event(MICROBIT_ID_IO_PIN_SERVICE, MICROBIT_IO_PIN_SERVICE_EVT_SAMPLE);
+
+    analogSampling = analog;
+}
+
+/**
+  * Callback. Invoked, in interrupt context, on a rise or fall of a digital input we're watching.
+  */
+void MicroBitIOPinService::onPinEvent(MicroBitEvent e)
+{
+    if (e.value != DEVICE_PIN_EVT_RISE && e.value != DEVICE_PIN_EVT_FALL)
+        return;
+
+    for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
+    {
+        if (edgePin(i).id == e.source)
+        {
+            if (edgePins & (1 << i))
+                setPending(i, e.value == DEVICE_PIN_EVT_RISE ? 1 : 0);
+
+            return;
+        }
+    }
+}
+
+/**
+  * Callback. Invoked periodically while any analog inputs are configured, to sample them.
+  */
+void MicroBitIOPinService::onAnalogSample(MicroBitEvent)
+{
+    for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT; i++)
+    {
+        if (isAnalog(i) && isActiveInput(i))
+        {
+            int value = edgePin(i).getAnalogValue() >> 2;
+            int delta = value - ioPinServiceIOData[i];
+
+            if (delta >= MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_THRESHOLD || -delta >= MICROBIT_BLE_IO_PIN_SERVICE_ANALOG_THRESHOLD)
+                setPending(i, value);
+        }
+    }
+}
+
+/**
+  * Marks a pin as having a new value to send to our client.
+  *
+  * @param i the enumeration of the pin
+  * @param value the new value of the pin
+  */
+void MicroBitIOPinService::setPending(int i, uint8_t value)
+{
+    // Shared with pin event handlers running in interrupt context.
+    target_disable_irq();
+
+    if (value != ioPinServiceIOData[i])
+    {
+        ioPinServiceIOData[i] = value;
+        pendingChanges |= (1 << i);
+    }
+
+    target_enable_irq();
+}
+
+/**
+  * Fills the data characteristic buffer with pins that have changed since the last notification.
+  * Any changes that don't fit are left pending, for the next idle callback.
+  *
+  * @return number of changed pins
+  */
+int MicroBitIOPinService::takePendingInputs()
+{
+    int pairs = 0;
+
+    target_disable_irq();
+
+    for (int i=0; i < MICROBIT_IO_PIN_SERVICE_PINCOUNT && pairs < MICROBIT_IO_PIN_SERVICE_DATA_SIZE; i++)
+    {
+        if (pendingChanges & (1 << i))
+        {
+            pendingChanges &= ~(1 << i);
+
+            ioPinServiceDataCharacteristicBuffer[pairs].pin = i;
+            ioPinServiceDataCharacteristicBuffer[pairs].value = ioPinServiceIOData[i];
+            pairs++;
+        }
+    }
+
+    target_enable_irq();
+
+    return pairs;
+}
+#endif
+
 #endif
@@ -33,6 +33,7 @@ DEALINGS IN THE SOFTWARE.
 #if CONFIG_ENABLED(DEVICE_BLE)
 
 #include "MicroBitMagnetometerService.h"
+#include <stdlib.h>
 
 using namespace codal;
 
@@ -56,16 +57,27 @@ MicroBitMagnetometerService::MicroBitMagnetometerService(BLEDevice &_ble, codal:
     magnetometerBearingCharacteristicBuffer = 0;
     magnetometerPeriodCharacteristicBuffer = compass.getPeriod();
     magnetometerCalibrationCharacteristicBuffer = 0;
+    lastDataValid = false;
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH > 1
+    batchCount = 0;
+#endif
     
     // Register the base UUID and create the service.
     RegisterBaseUUID( bs_base_uuid);
     CreateService( serviceUUID);
     
     // Create the data structures that represent each of our characteristics in Soft Device.
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH > 1
+    CreateCharacteristic( mbbs_cIdxDATA, charUUID[ mbbs_cIdxDATA],
+                         (uint8_t *)magnetometerDataCharacteristicBuffer,
+                         sizeof(magnetometerDataCharacteristicBuffer), sizeof(batchBuffer),
+                         microbit_propREAD | microbit_propNOTIFY);
+#else
     CreateCharacteristic( mbbs_cIdxDATA, charUUID[ mbbs_cIdxDATA],
                          (uint8_t *)magnetometerDataCharacteristicBuffer,
                          sizeof(magnetometerDataCharacteristicBuffer), sizeof(magnetometerDataCharacteristicBuffer),
                          microbit_propREAD | microbit_propNOTIFY);
+#endif
 
     CreateCharacteristic( mbbs_cIdxBEARING, charUUID[ mbbs_cIdxBEARING],
                          (uint8_t *)&magnetometerBearingCharacteristicBuffer,
@@ -144,6 +156,12 @@ void MicroBitMagnetometerService::onDisconnect( const microbit_ble_evt_t *p_ble_
 {
     //MICROBIT_DEBUG_DMESG( "MicroBitMagnetometerService::onDisconnect");
     listen( false);
+
+    // Start afresh with the next client.
+    lastDataValid = false;
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH > 1
+    batchCount = 0;
+#endif
 }
 
 
@@ -210,12 +228,52 @@ void MicroBitMagnetometerService::magnetometerUpdate()
         read();
 
         setChrValue( mbbs_cIdxPERIOD, (const uint8_t *)&magnetometerPeriodCharacteristicBuffer, sizeof(magnetometerPeriodCharacteristicBuffer));
-        notifyChrValue( mbbs_cIdxDATA,(uint8_t *)magnetometerDataCharacteristicBuffer, sizeof(magnetometerDataCharacteristicBuffer));
+        sendData();
+    }
+}
 
-        if ( compass.isCalibrated())
-        {
-            notifyChrValue( mbbs_cIdxBEARING,(uint8_t *)&magnetometerBearingCharacteristicBuffer, sizeof(magnetometerBearingCharacteristicBuffer));
-        }
+
+/**
+  * Sends the current sample to our client, subject to MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD,
+  * and collecting samples into batches if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH is greater than 1.
+  */
+void MicroBitMagnetometerService::sendData()
+{
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD > 0
+    if ( lastDataValid)
+    {
+        bool changed = false;
+
+        for ( int i = 0; i < 3; i++)
+            if ( abs( magnetometerDataCharacteristicBuffer[i] - lastData[i]) >= MICROBIT_BLE_MAGNETOMETER_SERVICE_THRESHOLD)
+                changed = true;
+
+        if ( !changed)
+            return;
+    }
+#endif
+
+    memcpy( lastData, magnetometerDataCharacteristicBuffer, sizeof(lastData));
+    lastDataValid = true;
+
+#if MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH > 1
+    memcpy( &batchBuffer[ 3 * batchCount], magnetometerDataCharacteristicBuffer, sizeof(magnetometerDataCharacteristicBuffer));
+    batchCount++;
+
+    // Send once the batch is full, or once it fills the negotiated MTU.
+    int limit = min( MICROBIT_BLE_MAGNETOMETER_SERVICE_BATCH, (int) MicroBitBLEManager::manager->getMaxAttributeSize() / (int) sizeof(magnetometerDataCharacteristicBuffer));
+    if ( batchCount < limit)
+        return;
+
+    notifyChrValue( mbbs_cIdxDATA,(uint8_t *)batchBuffer, batchCount * sizeof(magnetometerDataCharacteristicBuffer));
+    batchCount = 0;
+#else
+    queueChrValue( mbbs_cIdxDATA,(uint8_t *)magnetometerDataCharacteristicBuffer, sizeof(magnetometerDataCharacteristicBuffer));
+#endif
+
+    if ( compass.isCalibrated())
+    {
+        queueChrValue( mbbs_cIdxBEARING,(uint8_t *)&magnetometerBearingCharacteristicBuffer, sizeof(magnetometerBearingCharacteristicBuffer), MICROBIT_BLE_NOTIFY_PRIORITY_LOW);
     }
 }
 
@@ -37,9 +37,18 @@ DEALINGS IN THE SOFTWARE.
 #include "nrf_sdm.h"
 #include "nrf_dfu_types.h"
 #include "crc32.h"
+#include "sdk_config.h"
 
 using namespace codal;
 
+// The largest packet: the largest ATT MTU the SoftDevice is configured for, less the 3 byte ATT header.
+// Only version 2 FLASH_PAGE_DATA packets use more than 20 bytes.
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define PARTIAL_FLASHING_ATTRSIZE (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#else
+#define PARTIAL_FLASHING_ATTRSIZE 20
+#endif
+
 const uint8_t  MicroBitPartialFlashingService::base_uuid[ 16] =
 { 0xe9,0x7d,0x00,0x00,0x25,0x1d,0x47,0x0a,0xa0,0x62,0xfa,0x19,0x22,0xdf,0xa9,0xa8 };
 
@@ -60,7 +69,8 @@ MicroBitPartialFlashingService::MicroBitPartialFlashingService( BLEDevice &_ble,
     messageBus(_messageBus), storage(_storage)
 {
     // Set up partial flashing characteristic
-    memclr( characteristicValue, sizeof( characteristicValue));
+    characteristicValue = (uint8_t *) malloc( PARTIAL_FLASHING_ATTRSIZE);
+    memclr( characteristicValue, PARTIAL_FLASHING_ATTRSIZE);
     
     // Register the base UUID and create the service.
     RegisterBaseUUID( base_uuid);
@@ -68,7 +78,7 @@ MicroBitPartialFlashingService::MicroBitPartialFlashingService( BLEDevice &_ble,
 
     CreateCharacteristic( mbbs_cIdxCTRL, charUUID[ mbbs_cIdxCTRL],
                          characteristicValue,
-                         sizeof(characteristicValue), sizeof(characteristicValue),
+                         20, PARTIAL_FLASHING_ATTRSIZE,
                          microbit_propWRITE_WITHOUT | microbit_propNOTIFY);
 
     // Set up listener for SD writing
@@ -136,6 +146,7 @@ void MicroBitPartialFlashingService::onDataWritten(const microbit_ble_evt_write_
           blockPacketCount = 0;
           blockNum = 0;
           offset = 0;
+          pageAddress = 0xFFFFFFFF;
 
           break;
         }
@@ -145,6 +156,26 @@ void MicroBitPartialFlashingService::onDataWritten(const microbit_ble_evt_write_
           flashData(data);
           break;
         }
+        case FLASH_PAGE_START:
+        {
+          flashPageStart(data, params->len);
+          break;
+        }
+        case FLASH_PAGE_DATA:
+        {
+          flashPageData(data, params->len);
+          break;
+        }
+        case FLASH_PAGE_END:
+        {
+          flashPageEnd(data, params->len);
+          break;
+        }
+        case FLASH_PAGE_HASHES:
+        {
+          flashPageHashes(data, params->len);
+          break;
+        }
         case END_OF_TRANSMISSION:
         {
           /* Start of embedded source isn't always on a page border so client must
@@ -281,6 +312,246 @@ void MicroBitPartialFlashingService::flashData(uint8_t *data)
 
 }
 
+/**
+  * Version 2 transfers a page at a time, as a series of variable length packets:
+  *
+  * FLASH_PAGE_START
+  * +-----------+-----------------------------+
+  * | 1 Byte    | 4 Bytes                     |
+  * +-----------+-----------------------------+
+  * | COMMAND   | PAGE ADDRESS (big endian)   |
+  * +-----------+-----------------------------+
+  *
+  * FLASH_PAGE_DATA, any number, in any order. OFFSET is a multiple of PARTIAL_FLASHING_GRANULE.
+  * +-----------+-----------------------------+-----------------------+
+  * | 1 Byte    | 2 Bytes                     | up to MTU - 6 Bytes   |
+  * +-----------+-----------------------------+-----------------------+
+  * | COMMAND   | OFFSET IN PAGE (big endian) | DATA                  |
+  * +-----------+-----------------------------+-----------------------+
+  *
+  * FLASH_PAGE_END. LENGTH is the amount of the page to be written, normally PARTIAL_FLASHING_PAGE_SIZE.
+  * +-----------+-----------------------------+-----------------------+-----------------------+
+  * | 1 Byte    | 4 Bytes                     | 2 Bytes               | 4 Bytes               |
+  * +-----------+-----------------------------+-----------------------+-----------------------+
+  * | COMMAND   | PAGE ADDRESS (big endian)   | LENGTH (big endian)   | CRC32 (big endian)    |
+  * +-----------+-----------------------------+-----------------------+-----------------------+
+  *
+  * The reply to FLASH_PAGE_END is FLASH_PAGE_END, a status, and the page address. Only the missing granules of the
+  * page need be resent following FLASH_PAGE_MISSING. FLASH_PAGE_OK is sent as soon as a buffer is free to receive
+  * the next page, so the next page is received while this one is written.
+  *
+  * Before sending any pages, the client may send the hashes of the pages it means to write, to learn which differ
+  * from what is already in flash. Only those need be sent at all.
+  *
+  * FLASH_PAGE_HASHES. Each HASH is the CRC32 of a page of the new program, padded with 0xFF.
+  * +-----------+-----------------------------+-------------------------------------------+
+  * | 1 Byte    | 4 Bytes                     | 4 Bytes per page, up to MTU - 8 Bytes     |
+  * +-----------+-----------------------------+-------------------------------------------+
+  * | COMMAND   | FIRST PAGE ADDRESS (big e.) | HASH (big endian) ...                     |
+  * +-----------+-----------------------------+-------------------------------------------+
+  *
+  * The reply is FLASH_PAGE_HASHES, the first page address, the number of pages compared, and a bitmap with a bit
+  * set for each page that differs (least significant bit first).
+  */
+static uint32_t readBigEndian(const uint8_t *data, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v = (v << 8) | data[i];
+    return v;
+}
+
+/**
+  * Process a FLASH_PAGE_START packet
+  */
+void MicroBitPartialFlashingService::flashPageStart(const uint8_t *data, int len)
+{
+    pageAddress = 0xFFFFFFFF;
+
+    if (len < 5)
+        return;
+
+    uint32_t address = readBigEndian(data + 1, 4);
+    if (address % PARTIAL_FLASHING_PAGE_SIZE)
+        return;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (pageBuffer[i] == NULL)
+            pageBuffer[i] = (uint32_t *) malloc(PARTIAL_FLASHING_PAGE_SIZE);
+
+        if (pageBuffer[i] == NULL)
+            return;
+    }
+
+    // We only acknowledge a page once the other buffer is free, so the receiving buffer is never waiting to be written.
+    if (pageWriting & (1 << pageReceiving))
+        return;
+
+    MICROBIT_DEBUG_DMESGF( "FLASH_PAGE_START %x", (unsigned int) address);
+
+    memset(pageBuffer[pageReceiving], 0xFF, PARTIAL_FLASHING_PAGE_SIZE);
+    memset(pageReceived, 0, sizeof(pageReceived));
+    pageAddress = address;
+    pageMode = true;
+}
+
+/**
+  * Process a FLASH_PAGE_DATA packet
+  */
+void MicroBitPartialFlashingService::flashPageData(const uint8_t *data, int len)
+{
+    if (pageAddress == 0xFFFFFFFF || len < 4)
+        return;
+
+    uint32_t pageOffset = readBigEndian(data + 1, 2);
+    int size = len - 3;
+
+    if (pageOffset % PARTIAL_FLASHING_GRANULE || pageOffset + size > PARTIAL_FLASHING_PAGE_SIZE)
+        return;
+
+    memcpy((uint8_t *)pageBuffer[pageReceiving] + pageOffset, data + 3, size);
+
+    for (uint32_t g = pageOffset / PARTIAL_FLASHING_GRANULE; g < (pageOffset + size + PARTIAL_FLASHING_GRANULE - 1) / PARTIAL_FLASHING_GRANULE; g++)
+        pageReceived[g / 8] |= 1 << (g % 8);
+}
+
+/**
+  * Process a FLASH_PAGE_END packet
+  */
+void MicroBitPartialFlashingService::flashPageEnd(const uint8_t *data, int len)
+{
+    if (len < 11)
+        return;
+
+    uint32_t address = readBigEndian(data + 1, 4);
+    uint32_t length = readBigEndian(data + 5, 2);
+    uint32_t crc = readBigEndian(data + 7, 4);
+
+    if (address != pageAddress || length == 0 || length > PARTIAL_FLASHING_PAGE_SIZE)
+    {
+        flashPageReply(FLASH_PAGE_INVALID, address);
+        return;
+    }
+
+    // Report as many missing granules as fit in a reply.
+    uint8_t missing[PARTIAL_FLASHING_ATTRSIZE - 6];
+    int missingMax = sizeof(missing);
+    int missingCount = 0;
+
+    if (MicroBitBLEManager::manager)
+        missingMax = min(missingMax, MicroBitBLEManager::manager->getMaxAttributeSize() - 6);
+
+    for (uint32_t g = 0; g < (length + PARTIAL_FLASHING_GRANULE - 1) / PARTIAL_FLASHING_GRANULE && missingCount < missingMax; g++)
+        if (!(pageReceived[g / 8] & (1 << (g % 8))))
+            missing[missingCount++] = g;
+
+    if (missingCount)
+    {
+        MICROBIT_DEBUG_DMESGF( "FLASH_PAGE_END %x missing %d", (unsigned int) address, missingCount);
+        flashPageReply(FLASH_PAGE_MISSING, address, missing, missingCount);
+        return;
+    }
+
+    if (crc32_compute((const uint8_t *) pageBuffer[pageReceiving], length, NULL) != crc)
+    {
+        MICROBIT_DEBUG_DMESGF( "FLASH_PAGE_END %x crc error", (unsigned int) address);
+        memset(pageReceived, 0, sizeof(pageReceived));
+        flashPageReply(FLASH_PAGE_CRC_ERROR, address);
+        return;
+    }
+
+    // Queue the page for writing, and receive the next into the other buffer.
+    pageWriteAddress[pageReceiving] = address;
+    pageWriteLength[pageReceiving] = length;
+    pageWriting |= 1 << pageReceiving;
+    pageReceiving ^= 1;
+    pageAddress = 0xFFFFFFFF;
+
+    MicroBitEvent evt(MICROBIT_ID_PARTIAL_FLASHING, FLASH_PAGE_END);
+
+    // If the other buffer is still being written, the client waits for it before sending the next page.
+    if (pageWriting & (1 << pageReceiving))
+        pageAckPending = true;
+    else
+        flashPageReply(FLASH_PAGE_OK, address);
+}
+
+/**
+  * Process a FLASH_PAGE_HASHES packet. Hashing several pages takes too long for the BLE ISR, so the comparison is
+  * made by the FLASH_PAGE_HASHES event.
+  */
+void MicroBitPartialFlashingService::flashPageHashes(const uint8_t *data, int len)
+{
+    int count = (len - 5) / 4;
+
+    if (count <= 0 || hashCount)
+        return;
+
+    if (hashes == NULL)
+        hashes = (uint32_t *) malloc(PARTIAL_FLASHING_ATTRSIZE);
+
+    if (hashes == NULL)
+        return;
+
+    hashAddress = readBigEndian(data + 1, 4);
+    for (int i = 0; i < count; i++)
+        hashes[i] = readBigEndian(data + 5 + 4 * i, 4);
+
+    hashCount = count;
+    MicroBitEvent evt(MICROBIT_ID_PARTIAL_FLASHING, FLASH_PAGE_HASHES);
+}
+
+/**
+  * Send a FLASH_PAGE_END reply for the given page
+  */
+void MicroBitPartialFlashingService::flashPageReply(uint8_t status, uint32_t address, const uint8_t *missing, int missingCount)
+{
+    uint8_t buffer[PARTIAL_FLASHING_ATTRSIZE];
+
+    buffer[0] = FLASH_PAGE_END;
+    buffer[1] = status;
+    buffer[2] = (address & 0xFF000000) >> 24;
+    buffer[3] = (address & 0x00FF0000) >> 16;
+    buffer[4] = (address & 0x0000FF00) >>  8;
+    buffer[5] = (address & 0x000000FF);
+
+    if (missingCount)
+        memcpy(&buffer[6], missing, missingCount);
+
+    notifyChrValue( mbbs_cIdxCTRL, (const uint8_t *)buffer, 6 + missingCount);
+}
+
+/**
+  * Prepare for the first write of a flash: mark the flash as incomplete, so a failed flash boots into BLE mode,
+  * and erase any MicroPython filesystem.
+  */
+void MicroBitPartialFlashingService::flashBegin(MicroBitFlash &flash)
+{
+    KeyValuePair* flashIncomplete = storage.get("flashIncomplete");
+    if(flashIncomplete == NULL){
+
+      uint8_t flashIncompleteVal = 0x01;
+      storage.put("flashIncomplete", &flashIncompleteVal, sizeof(flashIncompleteVal));
+
+      // Check if FS exists
+      if(micropython_fs_end != 0x00) {
+         for(uint32_t *page = (uint32_t *)micropython_fs_start; page < (uint32_t *)(micropython_fs_end); page += (MICROBIT_CODEPAGESIZE / sizeof(uint32_t))) {
+             // Check if page needs erasing
+             for(uint32_t i = 0; i < 1024; i++) {
+                 if(*(page + i) != 0xFFFFFFFF) {
+                     DMESG( "Erase page at %x", page);
+                     flash.erase_page(page);
+                     break; // If page has been erased we can skip the remaining bytes
+                 }
+             }
+         }
+      }
+
+    }
+    delete flashIncomplete;
+}
+
 /**
  * Ensure CRC validation settings are correct.
  */
@@ -323,6 +594,9 @@ void MicroBitPartialFlashingService::setDefaultBootloaderSettings()
 
     uint32_t settingsSizeInWords = ( sizeof( nrf_dfu_settings_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
 
+    // The settings page is built on the stack, so this is one of the deepest paths on the BLE fiber.
+    MICROBIT_STACK_SAMPLE();
+
     // save settings to flash settings page if different
     uint32_t *pSettings = (uint32_t *) MICROBIT_BOOTLOADER_SETTINGS;
     if ( memcmp( pSettings, &settings, sizeof( nrf_dfu_settings_t)))
@@ -357,29 +631,7 @@ void MicroBitPartialFlashingService::partialFlashingEvent(MicroBitEvent e)
        * Set flashIncomplete flag if not already set to boot into BLE mode
        * upon a failed flash.
        */
-       
-       KeyValuePair* flashIncomplete = storage.get("flashIncomplete");
-       if(flashIncomplete == NULL){
-
-         uint8_t flashIncompleteVal = 0x01;
-         storage.put("flashIncomplete", &flashIncompleteVal, sizeof(flashIncompleteVal));
-            
-         // Check if FS exists
-         if(micropython_fs_end != 0x00) {
-            for(uint32_t *page = (uint32_t *)micropython_fs_start; page < (uint32_t *)(micropython_fs_end); page += (MICROBIT_CODEPAGESIZE / sizeof(uint32_t))) {
-                // Check if page needs erasing
-                for(uint32_t i = 0; i < 1024; i++) {
-                    if(*(page + i) != 0xFFFFFFFF) {
-                        DMESG( "Erase page at %x", page);
-                        flash.erase_page(page);
-                        break; // If page has been erased we can skip the remaining bytes
-                    }
-                }
-            }
-         }
-
-       }
-       delete flashIncomplete;
+      flashBegin(flash);
 
       uint32_t *flashPointer   = (uint32_t *)(offset);
 
@@ -407,15 +659,77 @@ void MicroBitPartialFlashingService::partialFlashingEvent(MicroBitEvent e)
       notifyChrValue( mbbs_cIdxCTRL, (const uint8_t *)flashNotificationBuffer, sizeof(flashNotificationBuffer));
       break;
     }
+    case FLASH_PAGE_END:
+    {
+      // Pages are queued alternately in each buffer, so are written in the order they were received.
+      int b = pageWriteNext;
+      pageWriteNext ^= 1;
+
+      MICROBIT_DEBUG_DMESG( "FLASH_PAGE_END write %x", (unsigned int) pageWriteAddress[b]);
+      flashBegin(flash);
+
+      // A page the client sends regardless of its hash may still be unchanged, and needn't be erased and rewritten.
+      if (memcmp((const void *) pageWriteAddress[b], pageBuffer[b], pageWriteLength[b]))
+      {
+          for (uint32_t page = 0; page < PARTIAL_FLASHING_PAGE_SIZE; page += MICROBIT_CODEPAGESIZE)
+          {
+              uint32_t *flashPointer = (uint32_t *)(pageWriteAddress[b] + page);
+
+              for(uint32_t i = 0; i < (MICROBIT_CODEPAGESIZE / sizeof(uint32_t)); i++) {
+                if(*(flashPointer + i) != 0xFFFFFFFF) {
+                    flash.erase_page(flashPointer);
+                    break; // If page has been erased we can skip the remaining bytes
+                }
+              }
+          }
+
+          flash.flash_burn((uint32_t *)pageWriteAddress[b], pageBuffer[b], (pageWriteLength[b] + 3) / 4);
+      }
+
+      // Release the buffer, and if the client is waiting for one, tell it to send the next page.
+      target_disable_irq();
+      pageWriting &= ~(1 << b);
+      bool ack = pageAckPending;
+      pageAckPending = false;
+      target_enable_irq();
+
+      if (ack)
+          flashPageReply(FLASH_PAGE_OK, pageWriteAddress[b ^ 1]);
+      break;
+    }
+    case FLASH_PAGE_HASHES:
+    {
+      uint8_t buffer[PARTIAL_FLASHING_ATTRSIZE];
+      int count = hashCount;
+
+      buffer[0] = FLASH_PAGE_HASHES;
+      buffer[1] = (hashAddress & 0xFF000000) >> 24;
+      buffer[2] = (hashAddress & 0x00FF0000) >> 16;
+      buffer[3] = (hashAddress & 0x0000FF00) >>  8;
+      buffer[4] = (hashAddress & 0x000000FF);
+      buffer[5] = count;
+
+      int differ = MicroBitMemoryMap::comparePages(hashAddress, PARTIAL_FLASHING_PAGE_SIZE, hashes, count, &buffer[6]);
+      MICROBIT_DEBUG_DMESG( "FLASH_PAGE_HASHES %x %d of %d differ", (unsigned int) hashAddress, differ, count);
+      (void) differ;
+
+      hashCount = 0;
+      notifyChrValue( mbbs_cIdxCTRL, (const uint8_t *)buffer, 6 + (count + 7) / 8);
+      break;
+    }
     case END_OF_TRANSMISSION:
     {
       MICROBIT_DEBUG_DMESG( "END_OF_TRANSMISSION offset %x", (unsigned int) offset);
-      // Write final packet
-      uint32_t *blockPointer;
-      uint32_t *flashPointer   = (uint32_t *) offset;
 
-      blockPointer = block;
-      flash.flash_burn(flashPointer, blockPointer, 16);
+      // Write final packet. Version 2 transfers have already written every page, as FLASH_PAGE_END events precede this one.
+      if (!pageMode)
+      {
+        uint32_t *blockPointer;
+        uint32_t *flashPointer   = (uint32_t *) offset;
+
+        blockPointer = block;
+        flash.flash_burn(flashPointer, blockPointer, 16);
+      }
 
       // Set no validation
       setDefaultBootloaderSettings();
@@ -32,6 +32,7 @@ DEALINGS IN THE SOFTWARE.
 #if CONFIG_ENABLED(DEVICE_BLE)
 
 #include "MicroBitTemperatureService.h"
+#include <stdlib.h>
 
 using namespace codal;
 
@@ -51,16 +52,28 @@ MicroBitTemperatureService::MicroBitTemperatureService( BLEDevice &_ble, MicroBi
     // Initialise our characteristic values.
     temperatureDataCharacteristicBuffer   = 0;
     temperaturePeriodCharacteristicBuffer = 0;
+    lastData = 0;
+    lastDataValid = false;
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH > 1
+    batchCount = 0;
+#endif
     
     // Register the base UUID and create the service.
     RegisterBaseUUID( bs_base_uuid);
     CreateService( serviceUUID);
 
     // Create the data structures that represent each of our characteristics in Soft Device.
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH > 1
+    CreateCharacteristic( mbbs_cIdxDATA, charUUID[ mbbs_cIdxDATA],
+                         (uint8_t *)&temperatureDataCharacteristicBuffer,
+                         sizeof(temperatureDataCharacteristicBuffer), sizeof(batchBuffer),
+                         microbit_propREAD | microbit_propNOTIFY);
+#else
     CreateCharacteristic( mbbs_cIdxDATA, charUUID[ mbbs_cIdxDATA],
                          (uint8_t *)&temperatureDataCharacteristicBuffer,
                          sizeof(temperatureDataCharacteristicBuffer), sizeof(temperatureDataCharacteristicBuffer),
                          microbit_propREAD | microbit_propNOTIFY);
+#endif
 
     CreateCharacteristic( mbbs_cIdxPERIOD, charUUID[ mbbs_cIdxPERIOD],
                          (uint8_t *)&temperaturePeriodCharacteristicBuffer,
@@ -109,6 +122,12 @@ void MicroBitTemperatureService::onConnect( const microbit_ble_evt_t *p_ble_evt)
 void MicroBitTemperatureService::onDisconnect( const microbit_ble_evt_t *p_ble_evt)
 {
     listen( false);
+
+    // Start afresh with the next client.
+    lastDataValid = false;
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH > 1
+    batchCount = 0;
+#endif
 }
 
 
@@ -138,8 +157,38 @@ void MicroBitTemperatureService::temperatureUpdate(MicroBitEvent)
     if ( getConnected())
     {
         temperatureDataCharacteristicBuffer = thermometer.getTemperature();
-        notifyChrValue( mbbs_cIdxDATA, (uint8_t *)&temperatureDataCharacteristicBuffer, sizeof(temperatureDataCharacteristicBuffer));
+        sendData();
     }
 }
 
+
+/**
+  * Sends the current sample to our client, subject to MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD,
+  * and collecting samples into batches if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH is greater than 1.
+  */
+void MicroBitTemperatureService::sendData()
+{
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD > 0
+    if ( lastDataValid && abs( temperatureDataCharacteristicBuffer - lastData) < MICROBIT_BLE_TEMPERATURE_SERVICE_THRESHOLD)
+        return;
+#endif
+
+    lastData = temperatureDataCharacteristicBuffer;
+    lastDataValid = true;
+
+#if MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH > 1
+    batchBuffer[ batchCount++] = temperatureDataCharacteristicBuffer;
+
+    // Send once the batch is full, or once it fills the negotiated MTU.
+    int limit = min( MICROBIT_BLE_TEMPERATURE_SERVICE_BATCH, (int) MicroBitBLEManager::manager->getMaxAttributeSize());
+    if ( batchCount < limit)
+        return;
+
+    notifyChrValue( mbbs_cIdxDATA, (uint8_t *)batchBuffer, batchCount * sizeof(temperatureDataCharacteristicBuffer));
+    batchCount = 0;
+#else
+    queueChrValue( mbbs_cIdxDATA, (uint8_t *)&temperatureDataCharacteristicBuffer, sizeof(temperatureDataCharacteristicBuffer), MICROBIT_BLE_NOTIFY_PRIORITY_LOW);
+#endif
+}
+
 #endif
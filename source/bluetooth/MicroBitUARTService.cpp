@@ -38,6 +38,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitFiber.h"
 #include "ErrorNo.h"
 #include "NotifyEvents.h"
+#include "sdk_config.h"
 
 using namespace codal;
 
@@ -62,24 +63,50 @@ const uint16_t MicroBitUARTService::charUUID[ mbbs_cIdxCOUNT] = { 0x0003, 0x0002
 const uint16_t MicroBitUARTService::charUUID[ mbbs_cIdxCOUNT] = { 0x0002, 0x0003 };
 #endif 
 
+// The largest value held by either characteristic: the largest ATT MTU the SoftDevice is configured for,
+// less the 3 byte ATT header. Values actually sent are limited to what has been negotiated on the connection.
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define MICROBIT_UART_S_ATTRSIZE            (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#else
 #define MICROBIT_UART_S_ATTRSIZE            20
+#endif
+
+/**
+  * Builds a bitmap of the byte values in the given string, so each received character can be matched with a single test.
+  */
+static void delimeter_set(uint32_t *set, ManagedString delimeters)
+{
+    memclr(set, 8 * sizeof(uint32_t));
+
+    for (int i = 0; i < delimeters.length(); i++)
+    {
+        uint8_t c = delimeters.charAt(i);
+        set[c >> 5] |= 1UL << (c & 31);
+    }
+}
+
+static inline bool delimeter_match(const uint32_t *set, uint8_t c)
+{
+    return set[c >> 5] & (1UL << (c & 31));
+}
 
 /**
  * Constructor for the UARTService.
  * @param _ble an instance of BLEDevice
- * @param rxBufferSize the size of the rxBuffer
- * @param txBufferSize the size of the txBuffer
+ * @param rxBufferSize the size of the rxBuffer, up to MICROBIT_UART_S_MAX_BUF_SIZE bytes
+ * @param txBufferSize the size of the txBuffer, up to MICROBIT_UART_S_MAX_BUF_SIZE bytes
  *
  * @note defaults to 20
  */
-MicroBitUARTService::MicroBitUARTService(BLEDevice &_ble, uint8_t rxBufferSize, uint8_t txBufferSize)
+MicroBitUARTService::MicroBitUARTService(BLEDevice &_ble, uint16_t rxBufferSize, uint16_t txBufferSize)
 {
     // Initialise our characteristic values.
     txBufferHead = 0;
     txBufferTail = 0;
     
-    rxBufferSize += 1;
-    txBufferSize += 1;
+    // One byte of each ring buffer is always left empty, to tell a full buffer from an empty one.
+    rxBufferSize = min((int) rxBufferSize, MICROBIT_UART_S_MAX_BUF_SIZE) + 1;
+    txBufferSize = min((int) txBufferSize, MICROBIT_UART_S_MAX_BUF_SIZE) + 1;
 
     // Allocate memory for rxBuffer, rx characteristic, txBuffer, tx characteristic
     int size = rxBufferSize + txBufferSize + 2 * MICROBIT_UART_S_ATTRSIZE;
@@ -100,6 +127,9 @@ MicroBitUARTService::MicroBitUARTService(BLEDevice &_ble, uint8_t rxBufferSize,
 
     waitingForEmpty = false;
 
+    memclr(delimeterSet, sizeof(delimeterSet));
+    rxBuffHeadMatch = -1;
+
     // Register the base UUID and create the service.
     RegisterBaseUUID( base_uuid);
     CreateService( serviceUUID);
@@ -113,7 +143,7 @@ MicroBitUARTService::MicroBitUARTService(BLEDevice &_ble, uint8_t rxBufferSize,
     CreateCharacteristic( mbbs_cIdxTX, charUUID[ mbbs_cIdxTX],
                           txBuffer + txBufferSize,
                           0, MICROBIT_UART_S_ATTRSIZE,
-                          microbit_propINDICATE);
+                          microbit_propINDICATE | microbit_propNOTIFY);
 }
 
 
@@ -146,6 +176,40 @@ void MicroBitUARTService::onConfirmation( const microbit_ble_evt_hvc_t *params)
 }
 
 
+/**
+  * A callback function for whenever the SoftDevice completes the transmission of queued notifications
+  */
+void MicroBitUARTService::onTxComplete()
+{
+    // Queued notifications have already been released from the tx buffer, so we just need to refill the queue.
+    bool async = !waitingForEmpty;
+    MicroBitEvent(MICROBIT_ID_NOTIFY, MICROBIT_UART_S_EVT_TX_EMPTY);
+    if ( async)
+        sendNext();
+}
+
+
+/**
+  * Determines if the connected device has enabled either indications or notifications of our TX characteristic.
+  */
+bool MicroBitUARTService::txEnabled()
+{
+    return indicateChrValueEnabled( mbbs_cIdxTX) || notifyChrValueEnabled( mbbs_cIdxTX);
+}
+
+
+/**
+  * Handles BLE events not dispatched by MicroBitBLEService.
+  */
+bool MicroBitUARTService::onBleEvent( const microbit_ble_evt_t *p_ble_evt)
+{
+    if ( p_ble_evt->header.evt_id == BLE_GATTS_EVT_HVN_TX_COMPLETE && p_ble_evt->evt.gatts_evt.conn_handle == getConnectionHandle())
+        onTxComplete();
+
+    return MicroBitBLEService::onBleEvent( p_ble_evt);
+}
+
+
 /**
   * A callback function for whenever a Bluetooth device writes to our RX characteristic.
   */
@@ -163,18 +227,9 @@ void MicroBitUARTService::onDataWritten(const microbit_ble_evt_write_t *params)
             {
                 char c = params->data[byteIterator];
 
-                int delimeterOffset = 0;
-                int delimLength = this->delimeters.length();
-
-                //iterate through our delimeters (if any) to see if there is a match
-                while(delimeterOffset < delimLength)
-                {
-                    //fire an event if there is to block any waiting fibers
-                    if(this->delimeters.charAt(delimeterOffset) == c)
-                        MicroBitEvent(MICROBIT_ID_BLE_UART, MICROBIT_UART_S_EVT_DELIM_MATCH);
-
-                    delimeterOffset++;
-                }
+                //fire an event if we match one of our delimeters (if any), to unblock any waiting fibers
+                if(delimeter_match(delimeterSet, c))
+                    MicroBitEvent(MICROBIT_ID_BLE_UART, MICROBIT_UART_S_EVT_DELIM_MATCH);
 
                 rxBuffer[rxBufferHead] = c;
 
@@ -193,27 +248,29 @@ void MicroBitUARTService::onDataWritten(const microbit_ble_evt_write_t *params)
 }
 
 /**
-  * An internal method that copies values from a circular buffer to a linear buffer.
+  * An internal method that finds the first received character that is in the given delimeter set.
   *
-  * @param circularBuff a pointer to the source circular buffer
-  * @param circularBuffSize the size of the circular buffer
-  * @param linearBuff a pointer to the destination linear buffer
-  * @param tailPosition the tail position in the circular buffer you want to copy from
-  * @param headPosition the head position in the circular buffer you want to copy to
+  * @param set the delimeters to match against, as a bitmap of byte values.
+  * @param offset the number of buffered characters already known not to match, which are skipped.
   *
-  * @note this method assumes that the linear buffer has the appropriate amount of
-  *       memory to contain the copy operation
+  * @return the number of characters before the match, or -1 if there is no match.
   */
-void MicroBitUARTService::circularCopy(uint8_t *circularBuff, uint8_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition)
+int MicroBitUARTService::findDelimeter(const uint32_t *set, int offset)
 {
-    int toBuffIndex = 0;
+    const uint8_t *data;
+    int len;
 
-    while(tailPosition != headPosition)
+    // Scan each contiguous span of the circular buffer in turn.
+    while((len = peek(&data, offset)) > 0)
     {
-        linearBuff[toBuffIndex++] = circularBuff[tailPosition];
+        for(int i = 0; i < len; i++)
+            if(delimeter_match(set, data[i]))
+                return offset + i;
 
-        tailPosition = (tailPosition + 1) % circularBuffSize;
+        offset += len;
     }
+
+    return -1;
 }
 
 /**
@@ -305,12 +362,12 @@ int MicroBitUARTService::send(const uint8_t *buf, int length, MicroBitSerialMode
     if(length < 1 || mode == SYNC_SPINWAIT)
         return MICROBIT_INVALID_PARAMETER;
 
-    if( !getConnected() || !indicateChrValueEnabled( mbbs_cIdxTX))
+    if( !getConnected() || !txEnabled())
         return MICROBIT_NOT_SUPPORTED;
 
     int bytesWritten = 0;
 
-    while ( getConnected() && indicateChrValueEnabled( mbbs_cIdxTX))
+    while ( getConnected() && txEnabled())
     {
         // Add new data that fits in the tx buffer
         while ( bytesWritten < length)
@@ -352,13 +409,45 @@ bool MicroBitUARTService::sendNext()
     if ( txValueSize != 0 || txBufferTail == txBufferHead)
         return false;
 
-    if( !getConnected() || !indicateChrValueEnabled( mbbs_cIdxTX))
+    if( !getConnected() || !txEnabled())
         return false;
 
-    // Duplicate the next tx data into the attribute buffer
+    // Send as much as the negotiated MTU allows in each indication or notification.
+    int valueSize = MICROBIT_UART_S_ATTRSIZE;
+    if ( MicroBitBLEManager::manager)
+        valueSize = min( valueSize, (int) MicroBitBLEManager::manager->getMaxAttributeSize());
+
     uint8_t *value = txBuffer + txBufferSize;
+
+    // The SoftDevice copies each notification as it is queued, so we can queue as many as it has room for,
+    // releasing each from the tx buffer straight away. It refuses any more once its queue is full.
+    if ( notifyChrValueEnabled( mbbs_cIdxTX))
+    {
+        bool sent = false;
+
+        while ( txBufferTail != txBufferHead)
+        {
+            int size = 0;
+            int txBufferNext = txBufferTail;
+            while ( size < valueSize && txBufferNext != txBufferHead)
+            {
+                value[ size++] = txBuffer[ txBufferNext];
+                txBufferNext = ( txBufferNext + 1) % txBufferSize;
+            }
+
+            if ( !notifyChrValue( mbbs_cIdxTX, value, size))
+                break;
+
+            txBufferTail = txBufferNext;
+            sent = true;
+        }
+
+        return sent;
+    }
+
+    // Duplicate the next tx data into the attribute buffer
     int txBufferNext = txBufferTail;
-    while ( txValueSize < MICROBIT_UART_S_ATTRSIZE && txBufferNext != txBufferHead)
+    while ( txValueSize < valueSize && txBufferNext != txBufferHead)
     {
         value[ txValueSize++] = txBuffer[ txBufferNext];
         txBufferNext = ( txBufferNext + 1) % txBufferSize;
@@ -499,50 +588,54 @@ ManagedString MicroBitUARTService::readUntil(ManagedString delimeters, MicroBitS
     if(mode == SYNC_SPINWAIT)
         return MICROBIT_INVALID_PARAMETER;
 
-    int localTail = rxBufferTail;
-    int preservedTail = rxBufferTail;
+    uint32_t set[8];
+    delimeter_set(set, delimeters);
 
-    int foundIndex = -1;
-
-    //ASYNC mode just iterates through our stored characters checking for any matches.
-    while(localTail != rxBufferHead && foundIndex  == -1)
-    {
-        //we use localTail to prevent modification of the actual tail.
-        char c = rxBuffer[localTail];
-
-        for(int delimeterIterator = 0; delimeterIterator < delimeters.length(); delimeterIterator++)
-            if(delimeters.charAt(delimeterIterator) == c)
-                foundIndex = localTail;
-
-        localTail = (localTail + 1) % rxBufferSize;
-    }
+    //ASYNC mode just checks our stored characters for any matches.
+    int scanned = rxBufferedSize();
+    int foundIndex = findDelimeter(set, 0);
 
     //if our mode is SYNC_SLEEP, we set up an event to be fired when we see a
-    //matching character.
+    //matching character, then search only what has arrived since.
     if(mode == SYNC_SLEEP && foundIndex == -1)
     {
-        eventOn(delimeters, mode);
+        memcpy(delimeterSet, set, sizeof(delimeterSet));
+
+        while(foundIndex == -1)
+        {
+            int available = rxBufferedSize();
 
-        foundIndex = rxBufferHead - 1;
+            foundIndex = findDelimeter(set, scanned);
+            scanned = available;
 
-        this->delimeters = ManagedString();
+            if(foundIndex == -1)
+                fiber_wait_for_event(MICROBIT_ID_BLE_UART, MICROBIT_UART_S_EVT_DELIM_MATCH);
+        }
+
+        memclr(delimeterSet, sizeof(delimeterSet));
     }
 
     if(foundIndex >= 0)
     {
-        //calculate our local buffer size
-        int localBuffSize = (preservedTail > foundIndex) ? (rxBufferSize - preservedTail) + foundIndex : foundIndex - preservedTail;
-
-        uint8_t localBuff[localBuffSize + 1];
+        // Build the string straight from the rxBuffer, which takes two spans if the line wraps around its end.
+        const uint8_t *data;
+        int len = peek(&data, 0);
+        ManagedString s;
 
-        memclr(&localBuff, localBuffSize + 1);
+        if(len >= foundIndex)
+            s = ManagedString((const char *)data, foundIndex);
+        else
+        {
+            ManagedString first((const char *)data, len);
 
-        circularCopy(rxBuffer, rxBufferSize, localBuff, preservedTail, foundIndex);
+            peek(&data, len);
+            s = first + ManagedString((const char *)data, foundIndex - len);
+        }
 
         //plus one for the character we listened for...
-        rxBufferTail = (rxBufferTail + localBuffSize + 1) % rxBufferSize;
+        consume(foundIndex + 1);
 
-        return ManagedString((char *)localBuff, localBuffSize);
+        return s;
     }
 
     return ManagedString();
@@ -571,8 +664,8 @@ int MicroBitUARTService::eventOn(ManagedString delimeters, MicroBitSerialMode mo
     if(mode == SYNC_SPINWAIT)
         return MICROBIT_INVALID_PARAMETER;
 
-    //configure our head match...
-    this->delimeters = delimeters;
+    //configure our delimeter match...
+    delimeter_set(delimeterSet, delimeters);
 
     //block!
     if(mode == SYNC_SLEEP)
@@ -612,6 +705,72 @@ int MicroBitUARTService::eventAfter(int len, MicroBitSerialMode mode)
     return MICROBIT_OK;
 }
 
+/**
+  * Provides direct access to received characters in the rxBuffer, without copying or consuming them.
+  *
+  * The rxBuffer is circular, so the buffered characters may be split into two contiguous spans.
+  * Call again with an offset of the length of the first span to reach the second.
+  *
+  * @param data set to point to the first character at the given offset.
+  * @param offset the number of buffered characters to skip.
+  *
+  * @return the number of contiguous characters available from data, 0 if there are none,
+  *         or MICROBIT_INVALID_PARAMETER if data is NULL.
+  *
+  * @note the characters stay valid until they are consumed.
+  */
+int MicroBitUARTService::peek(const uint8_t **data, int offset)
+{
+    if(data == NULL)
+        return MICROBIT_INVALID_PARAMETER;
+
+    // The head is moved as characters arrive, so take a single snapshot of it.
+    int head = rxBufferHead;
+    int buffered = (rxBufferTail > head) ? (rxBufferSize - rxBufferTail) + head : head - rxBufferTail;
+
+    if(offset < 0 || offset >= buffered)
+        return 0;
+
+    int start = (rxBufferTail + offset) % rxBufferSize;
+
+    *data = &rxBuffer[start];
+
+    return (start < head) ? head - start : rxBufferSize - start;
+}
+
+/**
+  * Discards characters from the rxBuffer, e.g. once they have been parsed in place with peek().
+  *
+  * @param len the number of characters to discard.
+  *
+  * @return the number of characters discarded, which is less than len if fewer are buffered.
+  */
+int MicroBitUARTService::consume(int len)
+{
+    len = max(0, min(len, rxBufferedSize()));
+
+    rxBufferTail = (rxBufferTail + len) % rxBufferSize;
+
+    return len;
+}
+
+/**
+  * Finds the first received character that matches one of the given delimeters, without consuming anything.
+  *
+  * @param delimeters the characters to match against e.g. ManagedString("\r\n")
+  *
+  * @return the number of characters before the match, or MICROBIT_NO_DATA if there is no match.
+  */
+int MicroBitUARTService::indexOf(ManagedString delimeters)
+{
+    uint32_t set[8];
+    delimeter_set(set, delimeters);
+
+    int index = findDelimeter(set, 0);
+
+    return index >= 0 ? index : MICROBIT_NO_DATA;
+}
+
 /**
   * Determines if we have space in our rxBuff.
   *
@@ -33,6 +33,7 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBit.h"
 #include "MicroBitUtilityService.h"
 #include "MicroBitUtilityTypes.h"
+#include "sdk_config.h"
 
 using namespace codal;
 using namespace codal::MicroBitUtility;
@@ -42,6 +43,19 @@ using namespace codal::MicroBitUtility;
 #define MicroBitUtilityService_SLEEP 10
 #define MicroBitUtilityService_TIMEOUT 10
 
+// The largest reply packet: the largest ATT MTU the SoftDevice is configured for, less the 3 byte ATT header.
+// Only requestTypeLogExport replies use more than sizeof(reply_t).
+#if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && NRF_SDH_BLE_GATT_MAX_MTU_SIZE > 23
+#define MicroBitUtilityService_ATTRSIZE (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#else
+#define MicroBitUtilityService_ATTRSIZE 20
+#endif
+
+// The amount of log data read at a time by requestTypeLogExport, and then sent as a series of packets.
+#ifndef MicroBitUtilityService_EXPORT_BUFFER
+#define MicroBitUtilityService_EXPORT_BUFFER 1024
+#endif
+
 typedef enum replyState_t
 {
     replyStateClear,
@@ -74,15 +88,28 @@ class codal::MicroBitUtilityWorkspace
     uint8_t   jobLow;
     bool      lock;
 
+    uint8_t   *exportBuffer;            // requestTypeLogExport read ahead buffer, followed by space for one reply packet
+    uint16_t  exportOffset;             // the next byte of the read ahead buffer to send
+    uint16_t  exportLength;             // the number of bytes in the read ahead buffer
+
     /**
      * Constructor.
      */
     MicroBitUtilityWorkspace()
     {
+        exportBuffer = NULL;
         init();
         lock = false;
     }
 
+    /**
+     * Destructor.
+     */
+    ~MicroBitUtilityWorkspace()
+    {
+        free( exportBuffer);
+    }
+
     /**
      * Initialise workspace
      */
@@ -93,6 +120,8 @@ class codal::MicroBitUtilityWorkspace
         replyState = replyStateClear;
         replyLength = 0;
         jobLow = 0;
+        exportOffset = 0;
+        exportLength = 0;
     }
 
     /**
@@ -175,7 +204,8 @@ MicroBitUtilityService::MicroBitUtilityService( BLEDevice &_ble, EventModel &_me
     messageBus(_messageBus), storage(_storage), log(_log), workspace(NULL)
 {
     // Initialise data
-    memclr( characteristicValue, sizeof( characteristicValue));
+    characteristicValue = (uint8_t *) malloc( MicroBitUtilityService_ATTRSIZE);
+    memclr( characteristicValue, MicroBitUtilityService_ATTRSIZE);
 
     // Register the base UUID and create the service.
     RegisterBaseUUID( bs_base_uuid);
@@ -183,7 +213,7 @@ MicroBitUtilityService::MicroBitUtilityService( BLEDevice &_ble, EventModel &_me
 
     CreateCharacteristic( mbbs_cIdxCTRL, charUUID[ mbbs_cIdxCTRL],
                          characteristicValue,
-                         0, sizeof(characteristicValue),
+                         0, MicroBitUtilityService_ATTRSIZE,
                          microbit_propWRITE | microbit_propWRITE_WITHOUT | microbit_propNOTIFY);
     
     if ( getConnected())
@@ -307,6 +337,9 @@ int MicroBitUtilityService::processRequest()
             case requestTypeLogRead:
                 result = processLogRead();
                 break;
+            case requestTypeLogExport:
+                result = processLogExport();
+                break;
             default:
                 break;
         }
@@ -379,4 +412,70 @@ int MicroBitUtilityService::processLogRead()
     return DEVICE_OK;
 }
 
+
+/**
+ * Process request typeLogExport
+ * @return DEVICE_OK if finished
+ */
+int MicroBitUtilityService::processLogExport()
+{
+    requestLogRead_t *request = (requestLogRead_t *) &workspace->request;
+
+    if ( !workspace->exportBuffer)
+    {
+        workspace->exportBuffer = (uint8_t *) malloc( MicroBitUtilityService_EXPORT_BUFFER + MicroBitUtilityService_ATTRSIZE);
+        if ( !workspace->exportBuffer && workspace->replyState == replyStateClear)
+            workspace->setReplyError( DEVICE_NO_RESOURCES);
+    }
+
+    // Fill each packet as far as the MTU negotiated on this connection allows.
+    int packetSize = MicroBitUtilityService_ATTRSIZE;
+    if ( MicroBitBLEManager::manager)
+        packetSize = min( packetSize, (int) MicroBitBLEManager::manager->getMaxAttributeSize());
+
+    uint8_t *packet = workspace->exportBuffer + MicroBitUtilityService_EXPORT_BUFFER;
+
+    while ( request->batchlen && workspace->replyState != replyStateError)
+    {
+        if ( workspace->replyState == replyStateClear)
+        {
+            // Read ahead a buffer at a time, rather than a packet at a time, to amortise the cost of each log read.
+            if ( workspace->exportOffset == workspace->exportLength)
+            {
+                uint32_t chunk = min( request->batchlen, (uint32_t) MicroBitUtilityService_EXPORT_BUFFER);
+                int result = log.readData( workspace->exportBuffer, request->index, chunk, (DataFormat) request->format, request->length);
+                if ( result)
+                {
+                    workspace->setReplyError( result);
+                    break;
+                }
+
+                workspace->exportOffset = 0;
+                workspace->exportLength = chunk;
+            }
+
+            int block = min( packetSize - (int) offsetof( reply_t, data), workspace->exportLength - workspace->exportOffset);
+            packet[0] = workspace->request.job + workspace->jobLow;
+            memcpy( packet + offsetof( reply_t, data), workspace->exportBuffer + workspace->exportOffset, block);
+            workspace->replyLength = block;
+            workspace->replyState = replyStateReady;
+        }
+
+        // A full SoftDevice queue returns DEVICE_BUSY, and we're rescheduled to carry on from here.
+        int r = sendReply( packet, offsetof(reply_t, data) + workspace->replyLength);
+        if ( r != DEVICE_OK)
+            return r;
+
+        workspace->replyState = replyStateClear;
+        workspace->exportOffset += workspace->replyLength;
+        request->index          += workspace->replyLength;
+        request->batchlen       -= workspace->replyLength;
+    }
+
+    if ( workspace->replyState == replyStateError)
+        return sendReply( &workspace->reply, offsetof(reply_t, data) + workspace->replyLength);
+
+    return DEVICE_OK;
+}
+
 #endif
@@ -55,6 +55,7 @@ static PullMode getPullModeFronPinMode(PinMode mode)
      */
 MicroBitButton::MicroBitButton(PinName name, uint16_t id, MicroBitButtonEventConfiguration eventConfiguration, PinMode mode) : NRF52Pin(id, name, PIN_CAPABILITY_DIGITAL), Button(*this, id, eventConfiguration, ButtonPolarity::ACTIVE_LOW, getPullModeFronPinMode(mode))
 {
+    initInterruptMode(eventConfiguration);
 }
 
 /**
@@ -73,6 +74,7 @@ MicroBitButton::MicroBitButton(PinName name, uint16_t id, MicroBitButtonEventCon
      */
 MicroBitButton::MicroBitButton(PinNumber p_number, uint16_t id, MicroBitButtonEventConfiguration eventConfiguration, PinMode mode) : NRF52Pin(id, p_number, PIN_CAPABILITY_DIGITAL), Button(*this, id, eventConfiguration, ButtonPolarity::ACTIVE_LOW, getPullModeFronPinMode(mode))
 {
+    initInterruptMode(eventConfiguration);
 }
 
 /**
@@ -92,7 +94,170 @@ MicroBitButton::MicroBitButton(PinNumber p_number, uint16_t id, MicroBitButtonEv
  */
 MicroBitButton::MicroBitButton(Pin &p, uint16_t id, ButtonEventConfiguration eventConfiguration, ButtonPolarity polarity, PullMode mode) : NRF52Pin(id, p.name, PIN_CAPABILITY_DIGITAL), Button(p, id, eventConfiguration, polarity, mode)
 {
+    initInterruptMode(eventConfiguration);
+}
+
+/**
+ * Common initialisation for all constructors.
+ */
+void MicroBitButton::initInterruptMode(ButtonEventConfiguration eventConfiguration)
+{
+    downTime = 0;
+    clickConfiguration = eventConfiguration;
+    interruptMode = false;
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_BUTTON_INTERRUPT_MODE)
+    setInterruptMode(true);
+#endif
+}
+
+/**
+ * Destructor.
+ */
+MicroBitButton::~MicroBitButton()
+{
+    setInterruptMode(false);
+}
+
+/**
+ * Selects how this button is debounced.
+ *
+ * In interrupt mode the pin raises an event on each edge, and a change in state is accepted once the pin
+ * has been stable for MICROBIT_BUTTON_DEBOUNCE_TIME. The button is then no longer polled from the system tick,
+ * so costs nothing while idle and doesn't prevent tickless idle sleep. Otherwise, the pin is sampled on every
+ * system tick, as by Button.
+ *
+ * @param enable true to use interrupt mode, false to return to polling.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if there is no message bus to deliver edge events.
+ */
+int MicroBitButton::setInterruptMode(bool enable)
+{
+    if (enable == interruptMode)
+        return DEVICE_OK;
+
+    if (EventModel::defaultEventBus == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    if (enable)
+    {
+        // Our own pin carries the id of the button, so its edge events would be taken for button events. Move them aside.
+        if (_pin.id == Button::id)
+            _pin.id = MICROBIT_ID_BUTTON_EDGE;
+
+        EventModel::defaultEventBus->listen(_pin.id, DEVICE_PIN_EVT_RISE, this, &MicroBitButton::onEdge, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(_pin.id, DEVICE_PIN_EVT_FALL, this, &MicroBitButton::onEdge, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE, this, &MicroBitButton::onTimer, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(Button::id, MICROBIT_BUTTON_EVT_HOLD_CHECK, this, &MicroBitButton::onTimer, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+        interruptMode = true;
+        status &= ~DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+
+        // The pin must be read once to apply our pull mode, then set to raise edge events.
+        buttonActive();
+        _pin.eventOn(DEVICE_PIN_EVENT_ON_EDGE);
+
+        // Pick up the current state of the pin, in case it differs from the state we last saw by polling.
+        system_timer_event_after_us(MICROBIT_BUTTON_DEBOUNCE_TIME, Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE);
+    }
+    else
+    {
+        _pin.eventOn(DEVICE_PIN_EVENT_NONE);
+
+        system_timer_cancel_event(Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE);
+        system_timer_cancel_event(Button::id, MICROBIT_BUTTON_EVT_HOLD_CHECK);
+
+        EventModel::defaultEventBus->ignore(_pin.id, DEVICE_PIN_EVT_RISE, this, &MicroBitButton::onEdge);
+        EventModel::defaultEventBus->ignore(_pin.id, DEVICE_PIN_EVT_FALL, this, &MicroBitButton::onEdge);
+        EventModel::defaultEventBus->ignore(Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE, this, &MicroBitButton::onTimer);
+        EventModel::defaultEventBus->ignore(Button::id, MICROBIT_BUTTON_EVT_HOLD_CHECK, this, &MicroBitButton::onTimer);
+
+        if (_pin.id == MICROBIT_ID_BUTTON_EDGE)
+            _pin.id = Button::id;
+
+        interruptMode = false;
+        status |= DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if this button is debounced in interrupt mode.
+ *
+ * @return true if in interrupt mode, false if polled from the system tick.
+ */
+bool MicroBitButton::isInterruptMode()
+{
+    return interruptMode;
+}
+
+/**
+ * Changes the event configuration used by this button to the given ButtonEventConfiguration.
+ *
+ * @param config The new configuration for this button. Legal values are MICROBIT_BUTTON_ALL_EVENTS or MICROBIT_BUTTON_SIMPLE_EVENTS.
+ */
+void MicroBitButton::setEventConfiguration(ButtonEventConfiguration config)
+{
+    clickConfiguration = config;
+    Button::setEventConfiguration(config);
+}
+
+/**
+ * Callback. Invoked, in interrupt context, on each edge of our pin. (Re)starts the debounce timer.
+ */
+void MicroBitButton::onEdge(MicroBitEvent)
+{
+    // Each edge pushes the deadline back, so a bouncing contact is only sampled once it has settled.
+    system_timer_cancel_event(Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE);
+    system_timer_event_after_us(MICROBIT_BUTTON_DEBOUNCE_TIME, Button::id, MICROBIT_BUTTON_EVT_DEBOUNCE);
+}
+
+/**
+ * Callback. Invoked once the pin has been stable for the debounce time, or may have been held long enough to raise a hold event.
+ */
+void MicroBitButton::onTimer(MicroBitEvent e)
+{
+    if (!interruptMode)
+        return;
+
+    if (e.value == MICROBIT_BUTTON_EVT_HOLD_CHECK)
+    {
+        if ((status & DEVICE_BUTTON_STATE) && !(status & DEVICE_BUTTON_STATE_HOLD_TRIGGERED))
+        {
+            status |= DEVICE_BUTTON_STATE_HOLD_TRIGGERED;
+            Event(Button::id, DEVICE_BUTTON_EVT_HOLD);
+        }
+        return;
+    }
+
+    bool active = buttonActive();
+
+    // Check to see if we have off->on state change.
+    if (active && !(status & DEVICE_BUTTON_STATE))
+    {
+        status |= DEVICE_BUTTON_STATE;
+        Event(Button::id, DEVICE_BUTTON_EVT_DOWN);
+        clickCount++;
+
+        downTime = system_timer_current_time();
+        system_timer_event_after_us((CODAL_TIMESTAMP) DEVICE_BUTTON_HOLD_TIME * 1000, Button::id, MICROBIT_BUTTON_EVT_HOLD_CHECK);
+    }
+
+    // Check to see if we have on->off state change.
+    if (!active && (status & DEVICE_BUTTON_STATE))
+    {
+        status &= ~(DEVICE_BUTTON_STATE | DEVICE_BUTTON_STATE_HOLD_TRIGGERED);
+        system_timer_cancel_event(Button::id, MICROBIT_BUTTON_EVT_HOLD_CHECK);
+        Event(Button::id, DEVICE_BUTTON_EVT_UP);
 
+        if (clickConfiguration == DEVICE_BUTTON_ALL_EVENTS)
+        {
+            if ((system_timer_current_time() - downTime) >= DEVICE_BUTTON_LONG_CLICK_TIME)
+                Event(Button::id, DEVICE_BUTTON_EVT_LONG_CLICK);
+            else
+                Event(Button::id, DEVICE_BUTTON_EVT_CLICK);
+        }
+    }
 }
 
 
@@ -23,9 +23,27 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "MicroBitI2C.h"
+#include "CodalFiber.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "nrf.h"
+#include <stdlib.h>
+#include <string.h>
 
 using namespace codal;
 
+// Determines if we can block waiting for the bus: i.e. we are in a fiber, and the scheduler is running.
+static bool i2c_can_wait()
+{
+    return fiber_scheduler_running() && (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0;
+}
+
+// The event value a fiber waits on to be granted the bus. Never zero, so it never matches DEVICE_EVT_ANY.
+static uint16_t i2c_ticket_value(int priority, uint16_t ticket)
+{
+    return ((priority + 1) << 12) | (ticket & 0x0FFF);
+}
+
 /**
   * Constructor.
   *
@@ -36,6 +54,7 @@ using namespace codal;
   * @param device
   */
  MicroBitI2C::MicroBitI2C(NRF52Pin &sda, NRF52Pin &scl) : NRF52I2C(sda, scl) {
+     initScheduler();
  }
 
 /**
@@ -48,6 +67,7 @@ using namespace codal;
   * @param device
   */
  MicroBitI2C::MicroBitI2C(PinName sda, PinName scl) : NRF52I2C(*new NRF52Pin(sda, sda, PIN_CAPABILITY_ALL), *new NRF52Pin(scl, scl, PIN_CAPABILITY_ALL)) {
+     initScheduler();
  }
 
 /**
@@ -60,4 +80,309 @@ using namespace codal;
   * @param device
   */
  MicroBitI2C::MicroBitI2C(PinNumber sda, PinNumber scl) : NRF52I2C(*new NRF52Pin(sda, sda, PIN_CAPABILITY_ALL), *new NRF52Pin(scl, scl, PIN_CAPABILITY_ALL)) {
+     initScheduler();
  }
+
+/**
+  * Initialises the bus scheduler.
+  */
+void MicroBitI2C::initScheduler()
+{
+    busy = false;
+    workerRunning = false;
+
+    for (int i = 0; i < MICROBIT_I2C_PRIORITIES; i++)
+    {
+        waiting[i] = 0;
+        nextTicket[i] = 0;
+        servedTicket[i] = 0;
+        queue[i] = NULL;
+    }
+}
+
+/**
+  * Awaits exclusive use of the bus, for one or more transfers.
+  * Fibers waiting for the bus are served in priority order, so bulk clients should hold it for a single
+  * transfer at a time, to let latency sensitive clients in between. Calls must not be nested.
+  *
+  * When called from interrupt context, or before the scheduler is running, this returns immediately,
+  * as no fiber can be part way through a transfer.
+  *
+  * @param priority One of MICROBIT_I2C_PRIORITY_*.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the priority is out of range.
+  */
+int MicroBitI2C::acquire(int priority)
+{
+    if (priority < 0 || priority >= MICROBIT_I2C_PRIORITIES)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (!i2c_can_wait())
+        return DEVICE_OK;
+
+    if (!busy)
+    {
+        busy = true;
+        return DEVICE_OK;
+    }
+
+    // Wait our turn. The bus is handed to us directly by release(), so it is ours once we wake.
+    uint16_t ticket = nextTicket[priority]++;
+    waiting[priority]++;
+
+    fiber_wake_on_event(MICROBIT_ID_I2C_SCHEDULER, i2c_ticket_value(priority, ticket));
+    schedule();
+
+    return DEVICE_OK;
+}
+
+/**
+  * Releases the bus, following a successful call to acquire(), passing it to the highest priority fiber waiting.
+  */
+void MicroBitI2C::release()
+{
+    if (!i2c_can_wait())
+        return;
+
+    for (int i = 0; i < MICROBIT_I2C_PRIORITIES; i++)
+    {
+        if (waiting[i])
+        {
+            waiting[i]--;
+            Event(MICROBIT_ID_I2C_SCHEDULER, i2c_ticket_value(i, servedTicket[i]++));
+            return;
+        }
+    }
+
+    busy = false;
+}
+
+/**
+  * Queues an asynchronous transfer. Transfers are serviced by a fiber, highest priority first,
+  * with the bus acquired at the priority of the transfer. The callback of the transfer is
+  * invoked from that fiber once the transfer completes.
+  *
+  * @param transfer The transfer to queue.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the transfer is invalid,
+  *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+  */
+int MicroBitI2C::transfer(MicroBitI2CTransfer *transfer)
+{
+    if (transfer == NULL || transfer->data == NULL || transfer->length <= 0 || transfer->priority >= MICROBIT_I2C_PRIORITIES)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (!i2c_can_wait())
+        return DEVICE_NOT_SUPPORTED;
+
+    transfer->result = DEVICE_BUSY;
+    transfer->next = NULL;
+
+    MicroBitI2CTransfer **tail = &queue[transfer->priority];
+    while (*tail)
+        tail = &(*tail)->next;
+
+    *tail = transfer;
+
+    if (!workerRunning)
+    {
+        workerRunning = true;
+        create_fiber(MicroBitI2C::worker, this);
+    }
+    else
+    {
+        Event(MICROBIT_ID_I2C_SCHEDULER, MICROBIT_I2C_EVT_QUEUED);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Services queued asynchronous transfers, highest priority first.
+  */
+void MicroBitI2C::worker(void *bus)
+{
+    MicroBitI2C *i2c = (MicroBitI2C *)bus;
+
+    while (true)
+    {
+        MicroBitI2CTransfer *t = NULL;
+
+        for (int i = 0; i < MICROBIT_I2C_PRIORITIES && t == NULL; i++)
+        {
+            if (i2c->queue[i])
+            {
+                t = i2c->queue[i];
+                i2c->queue[i] = t->next;
+            }
+        }
+
+        // Transfers are only queued from fibers, so nothing can be queued between this check and our wait.
+        if (t == NULL)
+        {
+            fiber_wait_for_event(MICROBIT_ID_I2C_SCHEDULER, MICROBIT_I2C_EVT_QUEUED);
+            continue;
+        }
+
+        // Record the id first, as the callback may reuse the transfer.
+        uint16_t id = t->id;
+        int result = i2c->perform(t);
+
+        t->result = result;
+
+        if (t->callback)
+            t->callback(t);
+
+        if (id)
+            Event(id, result == DEVICE_OK ? MICROBIT_I2C_EVT_TRANSFER_COMPLETE : MICROBIT_I2C_EVT_TRANSFER_ERROR);
+    }
+}
+
+/**
+  * Performs a transfer, holding the bus at the priority of the transfer.
+  */
+int MicroBitI2C::perform(MicroBitI2CTransfer *t)
+{
+    int result;
+
+    if (!t->read && t->reg >= 0)
+    {
+        // The register address and data must go out in one transaction, so build them into a single buffer.
+        uint8_t local[MICROBIT_I2C_REGISTER_WRITE_BUFFER + 1];
+        uint8_t *buffer = t->length <= MICROBIT_I2C_REGISTER_WRITE_BUFFER ? local : (uint8_t *) malloc(t->length + 1);
+
+        if (buffer == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        buffer[0] = (uint8_t) t->reg;
+        memcpy(&buffer[1], t->data, t->length);
+
+        acquire(t->priority);
+        result = write(t->address, buffer, t->length + 1);
+        release();
+
+        if (buffer != local)
+            free(buffer);
+
+        return result;
+    }
+
+    acquire(t->priority);
+
+    if (t->read)
+        result = t->reg >= 0 ? readRegister(t->address, (uint8_t) t->reg, t->data, t->length) : read(t->address, t->data, t->length);
+    else
+        result = write(t->address, t->data, t->length);
+
+    release();
+
+    return result;
+}
+
+/**
+  * Prepares and queues an asynchronous transfer.
+  */
+int MicroBitI2C::queueAsync(MicroBitI2CTransfer *transfer, uint16_t address, int reg, bool read, uint8_t *data, int length, uint16_t id, int priority)
+{
+    if (transfer == NULL || priority < 0 || priority >= MICROBIT_I2C_PRIORITIES)
+        return DEVICE_INVALID_PARAMETER;
+
+    transfer->address = address;
+    transfer->reg = reg;
+    transfer->read = read;
+    transfer->priority = priority;
+    transfer->data = data;
+    transfer->length = length;
+    transfer->id = id;
+    transfer->callback = NULL;
+    transfer->context = NULL;
+
+    return this->transfer(transfer);
+}
+
+/**
+  * Queues an asynchronous read, letting the calling fiber carry on while the transfer takes place.
+  *
+  * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+  * @param address The 8 bit I2C address of the device.
+  * @param data The buffer to read into, which must be in RAM, as it is filled by EasyDMA.
+  * @param length The number of bytes to read.
+  * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+  * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+  *
+  * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+  *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+  */
+int MicroBitI2C::readAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t *data, int length, uint16_t id, int priority)
+{
+    return queueAsync(transfer, address, -1, true, data, length, id, priority);
+}
+
+/**
+  * Queues an asynchronous read of one or more registers, as a combined transaction (a write of the
+  * register address, then a repeated start and the read).
+  *
+  * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+  * @param address The 8 bit I2C address of the device.
+  * @param reg The register to read from.
+  * @param data The buffer to read into, which must be in RAM, as it is filled by EasyDMA.
+  * @param length The number of bytes to read.
+  * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+  * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+  *
+  * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+  *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+  */
+int MicroBitI2C::readRegisterAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t reg, uint8_t *data, int length, uint16_t id, int priority)
+{
+    return queueAsync(transfer, address, reg, true, data, length, id, priority);
+}
+
+/**
+  * Queues an asynchronous write, letting the calling fiber carry on while the transfer takes place.
+  *
+  * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+  * @param address The 8 bit I2C address of the device.
+  * @param data The data to write, which must remain valid until the transfer completes.
+  * @param length The number of bytes to write.
+  * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+  * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+  *
+  * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+  *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+  */
+int MicroBitI2C::writeAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t *data, int length, uint16_t id, int priority)
+{
+    return queueAsync(transfer, address, -1, false, data, length, id, priority);
+}
+
+/**
+  * Queues an asynchronous write to one or more registers, as a single transaction of the register address followed by the data.
+  *
+  * @param transfer The transfer descriptor to use, which must remain valid until the transfer completes.
+  * @param address The 8 bit I2C address of the device.
+  * @param reg The register to write to.
+  * @param data The data to write, which must remain valid until the transfer completes.
+  * @param length The number of bytes to write.
+  * @param id If non-zero, a MICROBIT_I2C_EVT_TRANSFER_COMPLETE or MICROBIT_I2C_EVT_TRANSFER_ERROR event is raised on this id on completion.
+  * @param priority One of MICROBIT_I2C_PRIORITY_*. Defaults to MICROBIT_I2C_PRIORITY_CONTROL.
+  *
+  * @return DEVICE_OK if the transfer was queued, DEVICE_INVALID_PARAMETER if a parameter is invalid,
+  *         or DEVICE_NOT_SUPPORTED if called from interrupt context.
+  */
+int MicroBitI2C::writeRegisterAsync(MicroBitI2CTransfer *transfer, uint16_t address, uint8_t reg, uint8_t *data, int length, uint16_t id, int priority)
+{
+    return queueAsync(transfer, address, reg, false, data, length, id, priority);
+}
+
+/**
+  * Determines if an asynchronous transfer has completed.
+  *
+  * @param transfer The transfer to check.
+  *
+  * @return true if the transfer has completed (successfully or otherwise), false if it is still queued or in progress.
+  */
+bool MicroBitI2C::isComplete(MicroBitI2CTransfer *transfer)
+{
+    return transfer->result != DEVICE_BUSY;
+}
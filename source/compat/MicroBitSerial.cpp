@@ -26,6 +26,18 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+/**
+ * Applies the buffer sizes requested of the compat constructors, which NRF52Serial otherwise takes no account of.
+ */
+void MicroBitSerial::setBufferSizes(uint16_t rxBufferSize, uint16_t txBufferSize)
+{
+    if (rxBufferSize != CODAL_SERIAL_DEFAULT_BUFFER_SIZE)
+        setRxBufferSize(min(rxBufferSize, (uint16_t) MICROBIT_SERIAL_MAX_BUFFER_SIZE));
+
+    if (txBufferSize != CODAL_SERIAL_DEFAULT_BUFFER_SIZE)
+        setTxBufferSize(min(txBufferSize, (uint16_t) MICROBIT_SERIAL_MAX_BUFFER_SIZE));
+}
+
 /**
  * Constructor.
  * Create an instance of DeviceSerial
@@ -47,8 +59,9 @@ using namespace codal;
  *
  *       Buffers aren't allocated until the first send or receive respectively.
  */
-MicroBitSerial::MicroBitSerial(Pin& tx, Pin& rx, uint8_t rxBufferSize, uint8_t txBufferSize, uint16_t id) : NRF52Serial(tx, rx)
+MicroBitSerial::MicroBitSerial(Pin& tx, Pin& rx, uint16_t rxBufferSize, uint16_t txBufferSize, uint16_t id) : NRF52Serial(tx, rx)
 {
+    setBufferSizes(rxBufferSize, txBufferSize);
 }
 
 /**
@@ -72,8 +85,9 @@ MicroBitSerial::MicroBitSerial(Pin& tx, Pin& rx, uint8_t rxBufferSize, uint8_t t
  *
  *       Buffers aren't allocated until the first send or receive respectively.
  */
-MicroBitSerial::MicroBitSerial(PinName tx, PinName rx, uint8_t rxBufferSize, uint8_t txBufferSize, uint16_t id) : NRF52Serial(*new NRF52Pin(tx, tx, PIN_CAPABILITY_ALL), *new NRF52Pin(rx, rx, PIN_CAPABILITY_ALL))
+MicroBitSerial::MicroBitSerial(PinName tx, PinName rx, uint16_t rxBufferSize, uint16_t txBufferSize, uint16_t id) : NRF52Serial(*new NRF52Pin(tx, tx, PIN_CAPABILITY_ALL), *new NRF52Pin(rx, rx, PIN_CAPABILITY_ALL))
 {
+    setBufferSizes(rxBufferSize, txBufferSize);
 }
 
 
@@ -98,8 +112,9 @@ MicroBitSerial::MicroBitSerial(PinName tx, PinName rx, uint8_t rxBufferSize, uin
  *
  *       Buffers aren't allocated until the first send or receive respectively.
  */
-MicroBitSerial::MicroBitSerial(PinNumber tx, PinNumber rx, uint8_t rxBufferSize, uint8_t txBufferSize, uint16_t id) : NRF52Serial(*new NRF52Pin(tx, tx, PIN_CAPABILITY_ALL), *new NRF52Pin(rx, rx, PIN_CAPABILITY_ALL))
+MicroBitSerial::MicroBitSerial(PinNumber tx, PinNumber rx, uint16_t rxBufferSize, uint16_t txBufferSize, uint16_t id) : NRF52Serial(*new NRF52Pin(tx, tx, PIN_CAPABILITY_ALL), *new NRF52Pin(rx, rx, PIN_CAPABILITY_ALL))
 {
+    setBufferSizes(rxBufferSize, txBufferSize);
 }
 
 /**